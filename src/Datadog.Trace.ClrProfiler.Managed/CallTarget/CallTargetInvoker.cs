@@ -264,6 +264,141 @@ namespace Datadog.Trace.ClrProfiler.CallTarget
             return new CallTargetReturn<TReturn>(returnValue);
         }
 
+        /// <summary>
+        /// Begin Async Method Stub invoker (stores the state for the async method state machine)
+        /// </summary>
+        /// <typeparam name="TIntegration">Integration type</typeparam>
+        /// <typeparam name="TTarget">Target type</typeparam>
+        /// <param name="instance">Instance value</param>
+        /// <param name="state">CallTarget state</param>
+        [MethodImpl(MethodImplOptions.AggressiveInlining)]
+        public static void BeginAsyncStubMethod<TIntegration, TTarget>(TTarget instance, CallTargetState state)
+        {
+            DebugLog($"ProfilerOK: BeginAsyncStubMethod<{typeof(TIntegration)}, {typeof(TTarget)}>({instance}, {state})");
+
+            if (IntegrationOptions<TIntegration, TTarget>.IsIntegrationEnabled)
+            {
+                AsyncStateMachineHandler<TIntegration, TTarget>.Begin(instance, state);
+            }
+        }
+
+        /// <summary>
+        /// Enter Async Method invoker (called at the start of the state machine MoveNext, takes the state of its stub on the first run)
+        /// </summary>
+        /// <typeparam name="TIntegration">Integration type</typeparam>
+        /// <typeparam name="TTarget">Target type</typeparam>
+        /// <param name="stateMachineState">State of the state machine</param>
+        [MethodImpl(MethodImplOptions.AggressiveInlining)]
+        public static void EnterAsyncMethod<TIntegration, TTarget>(int stateMachineState)
+        {
+            if (IntegrationOptions<TIntegration, TTarget>.IsIntegrationEnabled)
+            {
+                try
+                {
+                    AsyncStateMachineHandler<TIntegration, TTarget>.Enter(stateMachineState);
+                }
+                catch (Exception ex)
+                {
+                    IntegrationOptions<TIntegration, TTarget>.LogException(ex);
+                }
+            }
+        }
+
+        /// <summary>
+        /// End Async Method Stub invoker (the async method completion is handled by the state machine)
+        /// </summary>
+        /// <typeparam name="TIntegration">Integration type</typeparam>
+        /// <typeparam name="TTarget">Target type</typeparam>
+        /// <param name="instance">Instance value</param>
+        /// <param name="exception">Exception value</param>
+        /// <param name="state">CallTarget state</param>
+        /// <returns>CallTarget return structure</returns>
+        [MethodImpl(MethodImplOptions.AggressiveInlining)]
+        public static CallTargetReturn EndAsyncStubMethod<TIntegration, TTarget>(TTarget instance, Exception exception, CallTargetState state)
+        {
+            DebugLog($"ProfilerOK: EndAsyncStubMethod<{typeof(TIntegration)}, {typeof(TTarget)}>({instance}, {exception?.ToString() ?? "(null)"}, {state})");
+
+            if (IntegrationOptions<TIntegration, TTarget>.IsIntegrationEnabled)
+            {
+                return AsyncStateMachineHandler<TIntegration, TTarget>.EndStub(state);
+            }
+
+            return CallTargetReturn.GetDefault();
+        }
+
+        /// <summary>
+        /// End Async Method with Result value invoker (called from the state machine before the builder SetResult)
+        /// </summary>
+        /// <typeparam name="TIntegration">Integration type</typeparam>
+        /// <typeparam name="TTarget">Target type</typeparam>
+        /// <typeparam name="TResult">Result type</typeparam>
+        /// <param name="returnValue">Result value</param>
+        /// <returns>Result value to be set in the builder</returns>
+        public static TResult EndAsyncMethodResult<TIntegration, TTarget, TResult>(TResult returnValue)
+        {
+            DebugLog($"ProfilerOK: EndAsyncMethodResult<{typeof(TIntegration)}, {typeof(TTarget)}, {typeof(TResult)}>({returnValue})");
+
+            if (IntegrationOptions<TIntegration, TTarget>.IsIntegrationEnabled)
+            {
+                try
+                {
+                    return AsyncStateMachineEndMethodHandler<TIntegration, TTarget, TResult>.Invoke(returnValue, null);
+                }
+                catch (Exception ex)
+                {
+                    IntegrationOptions<TIntegration, TTarget>.LogException(ex);
+                }
+            }
+
+            return returnValue;
+        }
+
+        /// <summary>
+        /// End Async Method without Result value invoker (called from the state machine before the builder SetResult)
+        /// </summary>
+        /// <typeparam name="TIntegration">Integration type</typeparam>
+        /// <typeparam name="TTarget">Target type</typeparam>
+        public static void EndAsyncMethodVoid<TIntegration, TTarget>()
+        {
+            DebugLog($"ProfilerOK: EndAsyncMethodVoid<{typeof(TIntegration)}, {typeof(TTarget)}>()");
+
+            if (IntegrationOptions<TIntegration, TTarget>.IsIntegrationEnabled)
+            {
+                try
+                {
+                    AsyncStateMachineEndMethodHandler<TIntegration, TTarget, object>.Invoke(null, null);
+                }
+                catch (Exception ex)
+                {
+                    IntegrationOptions<TIntegration, TTarget>.LogException(ex);
+                }
+            }
+        }
+
+        /// <summary>
+        /// End Async Method with Exception invoker (called from the state machine before the builder SetException)
+        /// </summary>
+        /// <typeparam name="TIntegration">Integration type</typeparam>
+        /// <typeparam name="TTarget">Target type</typeparam>
+        /// <typeparam name="TResult">Result type</typeparam>
+        /// <param name="exception">Exception value</param>
+        public static void EndAsyncMethodException<TIntegration, TTarget, TResult>(Exception exception)
+        {
+            DebugLog($"ProfilerOK: EndAsyncMethodException<{typeof(TIntegration)}, {typeof(TTarget)}, {typeof(TResult)}>({exception})");
+
+            if (IntegrationOptions<TIntegration, TTarget>.IsIntegrationEnabled)
+            {
+                try
+                {
+                    AsyncStateMachineEndMethodHandler<TIntegration, TTarget, TResult>.Invoke(default, exception);
+                }
+                catch (Exception ex)
+                {
+                    IntegrationOptions<TIntegration, TTarget>.LogException(ex);
+                }
+            }
+        }
+
         /// <summary>
         /// Log integration exception
         /// </summary>
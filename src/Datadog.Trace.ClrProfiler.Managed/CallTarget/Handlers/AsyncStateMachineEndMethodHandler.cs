@@ -0,0 +1,38 @@
+using System;
+using System.Reflection.Emit;
+using System.Runtime.CompilerServices;
+
+namespace Datadog.Trace.ClrProfiler.CallTarget.Handlers
+{
+    internal static class AsyncStateMachineEndMethodHandler<TIntegration, TTarget, TResult>
+    {
+        private static readonly Func<TTarget, TResult, Exception, CallTargetState, TResult> _continuation;
+
+        static AsyncStateMachineEndMethodHandler()
+        {
+            try
+            {
+                DynamicMethod continuationMethod = IntegrationMapper.CreateAsyncEndMethodDelegate(typeof(TIntegration), typeof(TTarget), typeof(TResult));
+                if (continuationMethod != null)
+                {
+                    _continuation = (Func<TTarget, TResult, Exception, CallTargetState, TResult>)continuationMethod.CreateDelegate(typeof(Func<TTarget, TResult, Exception, CallTargetState, TResult>));
+                }
+            }
+            catch (Exception ex)
+            {
+                throw new CallTargetInvokerException(ex);
+            }
+        }
+
+        [MethodImpl(MethodImplOptions.AggressiveInlining)]
+        internal static TResult Invoke(TResult returnValue, Exception exception)
+        {
+            if (_continuation is null || !AsyncStateMachineHandler<TIntegration, TTarget>.TryComplete(out TTarget instance, out CallTargetState state))
+            {
+                return returnValue;
+            }
+
+            return _continuation(instance, returnValue, exception, state);
+        }
+    }
+}
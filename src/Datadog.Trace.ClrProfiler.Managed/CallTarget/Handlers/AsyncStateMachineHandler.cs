@@ -0,0 +1,100 @@
+using System.Runtime.CompilerServices;
+using System.Threading;
+
+namespace Datadog.Trace.ClrProfiler.CallTarget.Handlers
+{
+    /// <summary>
+    /// Flows the CallTarget state of an async method stub to its state machine MoveNext method.
+    /// The state is stored before the state machine starts, the first run of the state machine takes it
+    /// so it's captured by the execution context of every continuation of that state machine only.
+    /// </summary>
+    internal static class AsyncStateMachineHandler<TIntegration, TTarget>
+    {
+        // State machine runs start with this state, the first one is run by the stub itself
+        internal const int StateMachineNotStarted = -1;
+
+        private static readonly AsyncLocalCompat<StateHolder> _current = new AsyncLocalCompat<StateHolder>();
+        private static readonly AsyncLocalCompat<StateHolder> _owned = new AsyncLocalCompat<StateHolder>();
+
+        [MethodImpl(MethodImplOptions.AggressiveInlining)]
+        internal static void Begin(TTarget instance, CallTargetState state)
+        {
+            _current.Set(new StateHolder(instance, state, _current.Get()));
+        }
+
+        [MethodImpl(MethodImplOptions.AggressiveInlining)]
+        internal static void Enter(int stateMachineState)
+        {
+            if (stateMachineState != StateMachineNotStarted)
+            {
+                return;
+            }
+
+            // The holder on top belongs to this state machine only if its stub pushed it,
+            // otherwise it belongs to an outer state machine that already took it.
+            // The builder restores the execution context when the first run returns to the stub,
+            // so the holder taken here doesn't leak to the caller.
+            StateHolder holder = _current.Get();
+            if (holder != null && Interlocked.Exchange(ref holder.Taken, 1) == 0)
+            {
+                _owned.Set(holder);
+            }
+            else if (_owned.Get() != null)
+            {
+                _owned.Set(null);
+            }
+        }
+
+        [MethodImpl(MethodImplOptions.AggressiveInlining)]
+        internal static CallTargetReturn EndStub(CallTargetState state)
+        {
+            // The execution context of the stub flows to its caller, so the holder must be removed here.
+            StateHolder holder = _current.Get();
+            if (holder != null && ReferenceEquals(holder.State.Scope, state.Scope))
+            {
+                _current.Set(holder.Parent);
+            }
+
+            // The completion is handled by the state machine, we only restore the previous scope
+            // This is used to mimic the ExecutionContext copy from the StateMachine
+            if (((IDatadogTracer)Tracer.Instance).ScopeManager is IScopeRawAccess rawAccess)
+            {
+                rawAccess.Active = state.PreviousScope;
+            }
+
+            return CallTargetReturn.GetDefault();
+        }
+
+        [MethodImpl(MethodImplOptions.AggressiveInlining)]
+        internal static bool TryComplete(out TTarget instance, out CallTargetState state)
+        {
+            StateHolder holder = _owned.Get();
+            if (holder is null || Interlocked.Exchange(ref holder.Completed, 1) == 1)
+            {
+                instance = default;
+                state = CallTargetState.GetDefault();
+                return false;
+            }
+
+            instance = holder.Instance;
+            state = holder.State;
+            return true;
+        }
+
+        private class StateHolder
+        {
+            public readonly TTarget Instance;
+            public readonly CallTargetState State;
+            public readonly StateHolder Parent;
+            public int Taken;
+            public int Completed;
+
+            public StateHolder(TTarget instance, CallTargetState state, StateHolder parent)
+            {
+                Instance = instance;
+                State = state;
+                Parent = parent;
+            }
+        }
+    }
+}
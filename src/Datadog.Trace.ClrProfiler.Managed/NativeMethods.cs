@@ -18,12 +18,38 @@ namespace Datadog.Trace.ClrProfiler
             return NonWindows.IsProfilerAttached();
         }
 
+        /// <summary>
+        /// Gets the methods whose CallTarget rewrite failed, one tab separated line per method:
+        /// profiler version, module version id, methodDef, integration, assembly and reason.
+        /// </summary>
+        /// <returns>The quarantined methods</returns>
+        public static string GetRewriteQuarantine()
+        {
+            var length = IsWindows ? Windows.GetRewriteQuarantine(null, 0) : NonWindows.GetRewriteQuarantine(null, 0);
+
+            // the quarantine can grow between the calls
+            while (true)
+            {
+                var buffer = new char[length + 1];
+                var required = IsWindows ? Windows.GetRewriteQuarantine(buffer, buffer.Length) : NonWindows.GetRewriteQuarantine(buffer, buffer.Length);
+                if (required < buffer.Length)
+                {
+                    return new string(buffer, 0, required);
+                }
+
+                length = required;
+            }
+        }
+
         // the "dll" extension is required on .NET Framework
         // and optional on .NET Core
         private static class Windows
         {
             [DllImport("Datadog.Trace.ClrProfiler.Native.dll")]
             public static extern bool IsProfilerAttached();
+
+            [DllImport("Datadog.Trace.ClrProfiler.Native.dll", CharSet = CharSet.Unicode)]
+            public static extern int GetRewriteQuarantine([Out] char[] buffer, int bufferSize);
         }
 
         // assume .NET Core if not running on Windows
@@ -31,6 +57,9 @@ namespace Datadog.Trace.ClrProfiler
         {
             [DllImport("Datadog.Trace.ClrProfiler.Native")]
             public static extern bool IsProfilerAttached();
+
+            [DllImport("Datadog.Trace.ClrProfiler.Native", CharSet = CharSet.Unicode)]
+            public static extern int GetRewriteQuarantine([Out] char[] buffer, int bufferSize);
         }
     }
 }
@@ -0,0 +1,114 @@
+#include "assembly_classifier.h"
+
+#include <algorithm>
+#include <limits>
+
+#include "dd_profiler_constants.h"
+
+namespace trace {
+
+namespace {
+
+const ULONG kNoNode = std::numeric_limits<ULONG>::max();
+
+bool CompareChild(const std::pair<WCHAR, ULONG>& child, WCHAR c) {
+  return child.first < c;
+}
+
+}  // namespace
+
+ULONG AssemblyClassifier::FindChild(ULONG node, WCHAR c) const {
+  const auto& children = nodes_[node].children;
+  const auto search =
+      std::lower_bound(children.begin(), children.end(), c, CompareChild);
+  if (search == children.end() || search->first != c) {
+    return kNoNode;
+  }
+  return search->second;
+}
+
+ULONG AssemblyClassifier::GetOrAddNode(const WSTRING& value) {
+  ULONG node = 0;
+  for (const auto c : value) {
+    auto child = FindChild(node, c);
+    if (child == kNoNode) {
+      child = static_cast<ULONG>(nodes_.size());
+      nodes_.emplace_back();
+      auto& children = nodes_[node].children;
+      children.insert(
+          std::lower_bound(children.begin(), children.end(), c, CompareChild),
+          std::make_pair(static_cast<WCHAR>(c), child));
+    }
+    node = child;
+  }
+  return node;
+}
+
+void AssemblyClassifier::AddPrefix(const WSTRING& prefix) {
+  nodes_[GetOrAddNode(prefix)].is_prefix = true;
+}
+
+void AssemblyClassifier::AddName(const WSTRING& name) {
+  nodes_[GetOrAddNode(name)].is_name = true;
+}
+
+AssemblyClass AssemblyClassifier::Classify(const WCHAR* name,
+                                           size_t length) const {
+  ULONG node = 0;
+  for (size_t i = 0; i < length; i++) {
+    if (nodes_[node].is_prefix) {
+      return AssemblyClass::SkippedByPrefix;
+    }
+    node = FindChild(node, name[i]);
+    if (node == kNoNode) {
+      return AssemblyClass::Instrumentable;
+    }
+  }
+
+  if (nodes_[node].is_prefix) {
+    return AssemblyClass::SkippedByPrefix;
+  }
+  return nodes_[node].is_name ? AssemblyClass::SkippedByName
+                              : AssemblyClass::Instrumentable;
+}
+
+AssemblyClassifier AssemblyClassifier::CreateDefault(
+    const Configuration& configuration) {
+  AssemblyClassifier classifier;
+  for (auto&& prefix : skip_assembly_prefixes) {
+    classifier.AddPrefix(prefix);
+  }
+  for (auto&& name : skip_assemblies) {
+    classifier.AddName(name);
+  }
+  for (auto&& prefix : configuration.skip_assembly_prefixes) {
+    classifier.AddPrefix(prefix);
+  }
+  for (auto&& name : configuration.skip_assemblies) {
+    classifier.AddName(name);
+  }
+  return classifier;
+}
+
+AssemblyReferenceInfo::AssemblyReferenceInfo(
+    const WSTRING& assembly_reference)
+    : reference_(assembly_reference),
+      locale_(reference_.locale == "neutral"_W ? WSTRING() : reference_.locale) {
+  metadata_.usMajorVersion = reference_.version.major;
+  metadata_.usMinorVersion = reference_.version.minor;
+  metadata_.usBuildNumber = reference_.version.build;
+  metadata_.usRevisionNumber = reference_.version.revision;
+  metadata_.szLocale = const_cast<WCHAR*>(locale_.c_str());
+  metadata_.cbLocale = static_cast<ULONG>(locale_.size());
+
+  info_.pbPublicKeyOrToken = const_cast<BYTE*>(reference_.public_key.data);
+  info_.cbPublicKeyOrToken =
+      reference_.public_key == PublicKey() ? 0 : kPublicKeySize;
+  info_.szName = reference_.name.c_str();
+  info_.pMetaData = &metadata_;
+  info_.pbHashValue = nullptr;
+  info_.cbHashValue = 0;
+  info_.dwAssemblyRefFlags = 0;
+}
+
+}  // namespace trace
@@ -0,0 +1,79 @@
+#ifndef DD_CLR_PROFILER_ASSEMBLY_CLASSIFIER_H_
+#define DD_CLR_PROFILER_ASSEMBLY_CLASSIFIER_H_
+
+#include <corhlpr.h>
+#include <corprof.h>
+#include <utility>
+#include <vector>
+
+#include "configuration.h"
+#include "integration.h"
+#include "string.h"
+
+namespace trace {
+
+enum class AssemblyClass {
+  // The profiler may instrument the assembly
+  Instrumentable = 0,
+  // The name starts with one of the skipped prefixes
+  SkippedByPrefix = 1,
+  // The name is one of the skipped assemblies
+  SkippedByName = 2
+};
+
+/// <summary>
+/// Decides whether an assembly is skipped, with one walk of a prefix trie over
+/// the UTF-16 name instead of comparing it with each of the skip lists.
+/// </summary>
+class AssemblyClassifier {
+ private:
+  struct Node {
+    // Sorted by character
+    std::vector<std::pair<WCHAR, ULONG>> children{};
+    bool is_prefix = false;
+    bool is_name = false;
+  };
+
+  std::vector<Node> nodes_;
+
+  ULONG FindChild(ULONG node, WCHAR c) const;
+  ULONG GetOrAddNode(const WSTRING& value);
+
+ public:
+  AssemblyClassifier() : nodes_(1) {}
+
+  void AddPrefix(const WSTRING& prefix);
+  void AddName(const WSTRING& name);
+
+  AssemblyClass Classify(const WCHAR* name, size_t length) const;
+  AssemblyClass Classify(const WSTRING& name) const {
+    return Classify(name.c_str(), name.size());
+  }
+
+  // The skip lists of dd_profiler_constants.h, extended by the configuration
+  static AssemblyClassifier CreateDefault(const Configuration& configuration);
+};
+
+/// <summary>
+/// The COR_PRF_ASSEMBLY_REFERENCE_INFO of an assembly reference, built once
+/// and handed to the runtime for every assembly in GetAssemblyReferences.
+/// </summary>
+class AssemblyReferenceInfo {
+ private:
+  const AssemblyReference reference_;
+  const WSTRING locale_;
+  ASSEMBLYMETADATA metadata_{};
+  COR_PRF_ASSEMBLY_REFERENCE_INFO info_{};
+
+  AssemblyReferenceInfo(const AssemblyReferenceInfo&) = delete;
+  AssemblyReferenceInfo& operator=(const AssemblyReferenceInfo&) = delete;
+
+ public:
+  explicit AssemblyReferenceInfo(const WSTRING& assembly_reference);
+
+  const COR_PRF_ASSEMBLY_REFERENCE_INFO* Get() const { return &info_; }
+};
+
+}  // namespace trace
+
+#endif  // DD_CLR_PROFILER_ASSEMBLY_CLASSIFIER_H_
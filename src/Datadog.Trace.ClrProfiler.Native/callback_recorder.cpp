@@ -0,0 +1,226 @@
+#include "callback_recorder.h"
+
+#include <cstring>
+
+#include "clr_helpers.h"
+#include "logging.h"
+#include "metadata_reader.h"
+
+namespace trace {
+
+namespace {
+
+const char kTraceMagic[] = {'D', 'D', 'C', 'B'};
+const char kTraceVersion = 1;
+
+// LEB128 encoding, an id or a duration mostly takes a few bytes
+void WriteUnsigned(ULONG64 value, std::string* out) {
+  do {
+    BYTE byte = value & 0x7F;
+    value >>= 7;
+    if (value != 0) {
+      byte |= 0x80;
+    }
+    out->push_back(static_cast<char>(byte));
+  } while (value != 0);
+}
+
+bool ReadUnsigned(std::istream& stream, ULONG64* value) {
+  *value = 0;
+  for (int shift = 0; shift < 64; shift += 7) {
+    const auto byte = stream.get();
+    if (byte == std::char_traits<char>::eof()) {
+      return false;
+    }
+    *value |= static_cast<ULONG64>(byte & 0x7F) << shift;
+    if ((byte & 0x80) == 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+}  // namespace
+
+const char* GetCallbackName(CallbackKind kind) {
+  switch (kind) {
+    case CallbackKind::ModuleLoadFinished:
+      return "ModuleLoadFinished";
+    case CallbackKind::AssemblyLoadFinished:
+      return "AssemblyLoadFinished";
+    case CallbackKind::ModuleUnloadStarted:
+      return "ModuleUnloadStarted";
+    case CallbackKind::JITCompilationStarted:
+      return "JITCompilationStarted";
+    case CallbackKind::JITInlining:
+      return "JITInlining";
+    case CallbackKind::GetReJITParameters:
+      return "GetReJITParameters";
+    case CallbackKind::ReJITCompilationStarted:
+      return "ReJITCompilationStarted";
+    case CallbackKind::ReJITCompilationFinished:
+      return "ReJITCompilationFinished";
+    case CallbackKind::ReJITError:
+      return "ReJITError";
+    case CallbackKind::Shutdown:
+      return "Shutdown";
+  }
+  return nullptr;
+}
+
+void WriteCallbackRecord(const CallbackRecord& record, std::string* out) {
+  out->push_back(static_cast<char>(record.kind));
+  WriteUnsigned(record.start_ns, out);
+  WriteUnsigned(record.duration_ns, out);
+  WriteUnsigned(record.module_id, out);
+  WriteUnsigned(record.id, out);
+  WriteUnsigned(record.other_id, out);
+  WriteUnsigned(static_cast<ULONG>(record.token), out);
+  WriteUnsigned(static_cast<ULONG>(record.hr_status), out);
+  WriteUnsigned(record.flag ? 1 : 0, out);
+
+  if (record.kind == CallbackKind::ModuleLoadFinished) {
+    out->append(reinterpret_cast<const char*>(&record.module_version_id),
+                sizeof(GUID));
+    const auto path = ToString(record.module_path);
+    WriteUnsigned(path.size(), out);
+    out->append(path);
+  }
+}
+
+bool ReadCallbackRecord(std::istream& stream, CallbackRecord* record) {
+  const auto kind = stream.get();
+  if (kind == std::char_traits<char>::eof() ||
+      GetCallbackName(static_cast<CallbackKind>(kind)) == nullptr) {
+    return false;
+  }
+  record->kind = static_cast<CallbackKind>(kind);
+
+  ULONG64 token = 0;
+  ULONG64 hr_status = 0;
+  ULONG64 flag = 0;
+  if (!ReadUnsigned(stream, &record->start_ns) ||
+      !ReadUnsigned(stream, &record->duration_ns) ||
+      !ReadUnsigned(stream, &record->module_id) ||
+      !ReadUnsigned(stream, &record->id) ||
+      !ReadUnsigned(stream, &record->other_id) ||
+      !ReadUnsigned(stream, &token) || !ReadUnsigned(stream, &hr_status) ||
+      !ReadUnsigned(stream, &flag)) {
+    return false;
+  }
+  record->token = static_cast<mdToken>(token);
+  record->hr_status = static_cast<HRESULT>(static_cast<ULONG>(hr_status));
+  record->flag = flag != 0 ? TRUE : FALSE;
+  record->module_path.clear();
+  record->module_version_id = {};
+
+  if (record->kind == CallbackKind::ModuleLoadFinished) {
+    ULONG64 path_size = 0;
+    if (!stream.read(reinterpret_cast<char*>(&record->module_version_id),
+                     sizeof(GUID)) ||
+        !ReadUnsigned(stream, &path_size)) {
+      return false;
+    }
+    std::string path(static_cast<size_t>(path_size), '\0');
+    if (!stream.read(&path[0], path.size())) {
+      return false;
+    }
+    record->module_path = ToWSTRING(path);
+  }
+  return true;
+}
+
+bool ReadCallbackTrace(const WSTRING& path,
+                       std::vector<CallbackRecord>* records) {
+  std::ifstream stream(ToString(path), std::ios::binary);
+  char header[sizeof(kTraceMagic) + 1] = {};
+  if (!stream.read(header, sizeof(header)) ||
+      memcmp(header, kTraceMagic, sizeof(kTraceMagic)) != 0 ||
+      header[sizeof(kTraceMagic)] != kTraceVersion) {
+    return false;
+  }
+
+  CallbackRecord record;
+  while (ReadCallbackRecord(stream, &record)) {
+    records->push_back(record);
+  }
+  return true;
+}
+
+CallbackRecorder::CallbackRecorder(ICorProfilerInfo4* info,
+                                   const WSTRING& path)
+    : info_(info),
+      start_(std::chrono::steady_clock::now()),
+      stream_(ToString(path), std::ios::binary | std::ios::trunc) {
+  if (!stream_.is_open()) {
+    Warn("CallbackRecorder: Failed to open ", path);
+    return;
+  }
+  stream_.write(kTraceMagic, sizeof(kTraceMagic));
+  stream_.put(kTraceVersion);
+}
+
+void CallbackRecorder::Resolve(CallbackRecord* record) const {
+  switch (record->kind) {
+    case CallbackKind::ModuleLoadFinished: {
+      // the module of a failed load may not be valid
+      if (FAILED(record->hr_status)) {
+        return;
+      }
+      const auto module_info = GetModuleInfo(info_, record->module_id);
+      if (!module_info.IsValid()) {
+        return;
+      }
+      record->id = module_info.assembly.id;
+      record->module_path = module_info.path;
+      MetadataReader(module_info.base_load_address, module_info.flags)
+          .GetModuleVersionId(&record->module_version_id);
+      return;
+    }
+    case CallbackKind::JITCompilationStarted:
+    case CallbackKind::JITInlining:
+    case CallbackKind::ReJITCompilationStarted:
+    case CallbackKind::ReJITCompilationFinished: {
+      ModuleID module_id = 0;
+      if (SUCCEEDED(info_->GetFunctionInfo(record->id, nullptr, &module_id,
+                                           &record->token))) {
+        record->module_id = module_id;
+      }
+      return;
+    }
+    default:
+      return;
+  }
+}
+
+void CallbackRecorder::Record(CallbackRecord* record) {
+  Resolve(record);
+
+  std::string bytes;
+  WriteCallbackRecord(*record, &bytes);
+
+  std::lock_guard<std::mutex> guard(lock_);
+  if (!stream_.is_open()) {
+    return;
+  }
+  stream_.write(bytes.data(), bytes.size());
+  record_count_++;
+
+  if (record->kind == CallbackKind::Shutdown) {
+    stream_.close();
+  }
+}
+
+void CallbackRecorder::Flush() {
+  std::lock_guard<std::mutex> guard(lock_);
+  if (stream_.is_open()) {
+    stream_.flush();
+  }
+}
+
+ULONG64 CallbackRecorder::GetRecordCount() {
+  std::lock_guard<std::mutex> guard(lock_);
+  return record_count_;
+}
+
+}  // namespace trace
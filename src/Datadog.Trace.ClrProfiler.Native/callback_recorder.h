@@ -0,0 +1,145 @@
+#ifndef DD_CLR_PROFILER_CALLBACK_RECORDER_H_
+#define DD_CLR_PROFILER_CALLBACK_RECORDER_H_
+
+#include <corhlpr.h>
+#include <corprof.h>
+
+#include <chrono>
+#include <fstream>
+#include <istream>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "string.h"
+
+namespace trace {
+
+enum class CallbackKind : BYTE {
+  ModuleLoadFinished = 1,
+  AssemblyLoadFinished = 2,
+  ModuleUnloadStarted = 3,
+  JITCompilationStarted = 4,
+  JITInlining = 5,
+  GetReJITParameters = 6,
+  ReJITCompilationStarted = 7,
+  ReJITCompilationFinished = 8,
+  ReJITError = 9,
+  Shutdown = 10,
+};
+
+// The name of the callback, or nullptr for an unknown kind
+const char* GetCallbackName(CallbackKind kind);
+
+/// <summary>
+/// A profiler callback of a recording. The ids are the ones of the recording
+/// process, the functions are also given by their module and token so they
+/// can be found again in another process.
+/// </summary>
+struct CallbackRecord {
+  CallbackKind kind = CallbackKind::Shutdown;
+  // Since the start of the recording, and the time spent in the callback
+  ULONG64 start_ns = 0;
+  ULONG64 duration_ns = 0;
+  // The module of the callback, or of the function (the callee of JITInlining)
+  ULONG64 module_id = 0;
+  // The assembly of the load callbacks, the function of the JIT and ReJIT
+  // callbacks, the callee of JITInlining
+  ULONG64 id = 0;
+  // The caller of JITInlining, the ReJIT id of the ReJIT callbacks
+  ULONG64 other_id = 0;
+  mdToken token = mdTokenNil;
+  HRESULT hr_status = S_OK;
+  // is_safe_to_block of the JIT callbacks, the decision of JITInlining
+  BOOL flag = FALSE;
+  // Only for ModuleLoadFinished
+  WSTRING module_path{};
+  GUID module_version_id{};
+};
+
+// A record is the kind, LEB128 encoded integers and, for ModuleLoadFinished,
+// the MVID and the UTF-8 path of the image.
+void WriteCallbackRecord(const CallbackRecord& record, std::string* out);
+
+// Returns false at the end of the stream or on a truncated record, the last
+// record of a process that didn't shut down may be incomplete
+bool ReadCallbackRecord(std::istream& stream, CallbackRecord* record);
+
+// Reads the records of a trace in the order they were written, which is the
+// order the callbacks returned in
+bool ReadCallbackTrace(const WSTRING& path, std::vector<CallbackRecord>* records);
+
+/// <summary>
+/// Writes the callbacks of the profiler to a binary trace
+/// (DD_CLR_CALLBACK_RECORDING_PATH), for the profiler harness to replay them
+/// offline. The functions and modules of the records are resolved with the
+/// profiling API after the callback is timed.
+/// </summary>
+class CallbackRecorder {
+ private:
+  ICorProfilerInfo4* const info_;
+  const std::chrono::steady_clock::time_point start_;
+  std::mutex lock_;
+  std::ofstream stream_;
+  ULONG64 record_count_ = 0;
+
+  void Resolve(CallbackRecord* record) const;
+
+ public:
+  CallbackRecorder(ICorProfilerInfo4* info, const WSTRING& path);
+
+  bool IsOpen() const { return stream_.is_open(); }
+
+  // Nanoseconds since the start of the recording
+  ULONG64 Now() const {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now() - start_)
+        .count();
+  }
+
+  void Record(CallbackRecord* record);
+  void Flush();
+  ULONG64 GetRecordCount();
+};
+
+/// <summary>
+/// Times a callback and records it when the scope ends. Does nothing without
+/// a recorder.
+/// </summary>
+class RecordedCallback {
+ private:
+  CallbackRecorder* const recorder_;
+  // The decision of JITInlining, read when the callback returns
+  const BOOL* result_ = nullptr;
+
+  RecordedCallback(const RecordedCallback&) = delete;
+  RecordedCallback& operator=(const RecordedCallback&) = delete;
+
+ public:
+  CallbackRecord record;
+
+  RecordedCallback(CallbackRecorder* recorder, CallbackKind kind)
+      : recorder_(recorder) {
+    record.kind = kind;
+    if (recorder_ != nullptr) {
+      record.start_ns = recorder_->Now();
+    }
+  }
+
+  ~RecordedCallback() {
+    if (recorder_ == nullptr) {
+      return;
+    }
+    record.duration_ns = recorder_->Now() - record.start_ns;
+    if (result_ != nullptr) {
+      record.flag = *result_;
+    }
+    recorder_->Record(&record);
+  }
+
+  void SetResult(const BOOL* result) { result_ = result; }
+};
+
+}  // namespace trace
+
+#endif  // DD_CLR_PROFILER_CALLBACK_RECORDER_H_
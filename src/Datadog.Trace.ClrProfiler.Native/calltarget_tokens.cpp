@@ -15,7 +15,11 @@ HRESULT CallTargetTokens::EnsureCorLibTokens() {
   ModuleMetadata* module_metadata = GetMetadata();
   AssemblyProperty corAssemblyProperty = *module_metadata->corAssemblyProperty;
 
-  // *** Ensure corlib assembly ref
+  // *** Ensure corlib assembly ref (reuse the module's own reference if any)
+  if (corLibAssemblyRef == mdAssemblyRefNil) {
+    corLibAssemblyRef =
+        module_metadata->FindAssemblyRef(corAssemblyProperty.szName);
+  }
   if (corLibAssemblyRef == mdAssemblyRefNil) {
     auto hr = module_metadata->assembly_emit->DefineAssemblyRef(
         corAssemblyProperty.ppbPublicKey, corAssemblyProperty.pcbPublicKey,
@@ -27,6 +31,8 @@ HRESULT CallTargetTokens::EnsureCorLibTokens() {
       Warn("Wrapper corLibAssemblyRef could not be defined.");
       return hr;
     }
+    module_metadata->SetAssemblyRef(corAssemblyProperty.szName,
+                                    corLibAssemblyRef);
   }
 
   // *** Ensure System.Object type ref
@@ -79,7 +85,8 @@ HRESULT CallTargetTokens::EnsureCorLibTokens() {
     unsigned type_buffer;
     auto type_size = CorSigCompressToken(typeRef, &type_buffer);
 
-    auto* signature = new COR_SIGNATURE[runtimeTypeHandle_size + type_size + 4];
+    auto signatureLength = runtimeTypeHandle_size + type_size + 4;
+    SignatureBuffer signature(signatureLength);
     unsigned offset = 0;
 
     signature[offset++] = IMAGE_CEE_CS_CALLCONV_DEFAULT;
@@ -93,9 +100,8 @@ HRESULT CallTargetTokens::EnsureCorLibTokens() {
     offset += runtimeTypeHandle_size;
 
     auto hr = module_metadata->metadata_emit->DefineMemberRef(
-        typeRef, GetTypeFromHandleMethodName.data(), signature,
-        sizeof(signature), &getTypeFromHandleToken);
-    delete[] signature;
+        typeRef, GetTypeFromHandleMethodName.data(), signature.data(),
+        signatureLength, &getTypeFromHandleToken);
     if (FAILED(hr)) {
       Warn("Wrapper getTypeFromHandleToken could not be defined.");
       return hr;
@@ -157,6 +163,8 @@ HRESULT CallTargetTokens::EnsureBaseCalltargetTokens() {
       Warn("Wrapper profilerAssemblyRef could not be defined.");
       return hr;
     }
+    module_metadata->SetAssemblyRef(assemblyReference.name,
+                                    profilerAssemblyRef);
   }
 
   // *** Ensure calltarget type ref
@@ -188,7 +196,7 @@ HRESULT CallTargetTokens::EnsureBaseCalltargetTokens() {
         CorSigCompressToken(callTargetStateTypeRef, &callTargetStateTypeBuffer);
 
     auto signatureLength = 3 + callTargetStateTypeSize;
-    auto* signature = new COR_SIGNATURE[signatureLength];
+    SignatureBuffer signature(signatureLength);
     unsigned offset = 0;
 
     signature[offset++] = IMAGE_CEE_CS_CALLCONV_DEFAULT;
@@ -201,9 +209,8 @@ HRESULT CallTargetTokens::EnsureBaseCalltargetTokens() {
 
     auto hr = module_metadata->metadata_emit->DefineMemberRef(
         callTargetStateTypeRef,
-        managed_profiler_calltarget_statetype_getdefault_name.data(), signature,
+        managed_profiler_calltarget_statetype_getdefault_name.data(), signature.data(),
         signatureLength, &callTargetStateTypeGetDefault);
-    delete[] signature;
     if (FAILED(hr)) {
       Warn("Wrapper callTargetStateTypeGetDefault could not be defined.");
       return hr;
@@ -276,7 +283,7 @@ mdTypeSpec CallTargetTokens::GetTargetReturnValueTypeRef(
 
   auto signatureLength =
       3 + callTargetReturnTypeRefSize + returnSignatureLength;
-  auto* signature = new COR_SIGNATURE[signatureLength];
+  SignatureBuffer signature(signatureLength);
   unsigned offset = 0;
 
   signature[offset++] = ELEMENT_TYPE_GENERICINST;
@@ -288,9 +295,8 @@ mdTypeSpec CallTargetTokens::GetTargetReturnValueTypeRef(
   memcpy(&signature[offset], returnSignatureBuffer, returnSignatureLength);
   offset += returnSignatureLength;
 
-  hr = module_metadata->metadata_emit->GetTokenFromTypeSpec(
-      signature, signatureLength, &returnValueTypeSpec);
-  delete[] signature;
+  hr = GetOrDefineTypeSpec(
+      signature.data(), signatureLength, &returnValueTypeSpec);
   if (FAILED(hr)) {
     Warn("Error creating return value type spec");
     return mdTypeSpecNil;
@@ -322,7 +328,7 @@ mdMemberRef CallTargetTokens::GetCallTargetReturnVoidDefaultMemberRef() {
         callTargetReturnVoidTypeRef, &callTargetReturnVoidTypeBuffer);
 
     auto signatureLength = 3 + callTargetReturnVoidTypeSize;
-    auto* signature = new COR_SIGNATURE[signatureLength];
+    SignatureBuffer signature(signatureLength);
     unsigned offset = 0;
 
     signature[offset++] = IMAGE_CEE_CS_CALLCONV_DEFAULT;
@@ -336,8 +342,7 @@ mdMemberRef CallTargetTokens::GetCallTargetReturnVoidDefaultMemberRef() {
     hr = module_metadata->metadata_emit->DefineMemberRef(
         callTargetReturnVoidTypeRef,
         managed_profiler_calltarget_returntype_getdefault_name.data(),
-        signature, signatureLength, &callTargetReturnVoidTypeGetDefault);
-    delete[] signature;
+        signature.data(), signatureLength, &callTargetReturnVoidTypeGetDefault);
     if (FAILED(hr)) {
       Warn("Wrapper callTargetReturnVoidTypeGetDefault could not be defined.");
       return mdMemberRefNil;
@@ -358,9 +363,16 @@ mdMemberRef CallTargetTokens::GetCallTargetReturnValueDefaultMemberRef(
     return mdMemberRefNil;
   }
 
-  mdMemberRef callTargetReturnTypeGetDefault = mdMemberRefNil;
-
   // *** Ensure CallTargetReturn<T>.GetDefault() member ref
+  {
+    std::lock_guard<std::mutex> guard(tokens_cache_lock);
+    const auto it = callTargetReturnTypeGetDefaultRefs.find(callTargetReturnTypeSpec);
+    if (it != callTargetReturnTypeGetDefaultRefs.end()) {
+      return it->second;
+    }
+  }
+
+  mdMemberRef callTargetReturnTypeGetDefault = mdMemberRefNil;
   ModuleMetadata* module_metadata = GetMetadata();
 
   unsigned callTargetReturnTypeRefBuffer;
@@ -368,7 +380,7 @@ mdMemberRef CallTargetTokens::GetCallTargetReturnValueDefaultMemberRef(
       callTargetReturnTypeRef, &callTargetReturnTypeRefBuffer);
 
   auto signatureLength = 7 + callTargetReturnTypeRefSize;
-  auto* signature = new COR_SIGNATURE[signatureLength];
+  SignatureBuffer signature(signatureLength);
   unsigned offset = 0;
 
   signature[offset++] = IMAGE_CEE_CS_CALLCONV_DEFAULT;
@@ -384,14 +396,15 @@ mdMemberRef CallTargetTokens::GetCallTargetReturnValueDefaultMemberRef(
 
   hr = module_metadata->metadata_emit->DefineMemberRef(
       callTargetReturnTypeSpec,
-      managed_profiler_calltarget_returntype_getdefault_name.data(), signature,
+      managed_profiler_calltarget_returntype_getdefault_name.data(), signature.data(),
       signatureLength, &callTargetReturnTypeGetDefault);
-  delete[] signature;
   if (FAILED(hr)) {
     Warn("Wrapper callTargetReturnTypeGetDefault could not be defined.");
     return mdMemberRefNil;
   }
 
+  std::lock_guard<std::mutex> guard(tokens_cache_lock);
+  callTargetReturnTypeGetDefaultRefs[callTargetReturnTypeSpec] = callTargetReturnTypeGetDefault;
   return callTargetReturnTypeGetDefault;
 }
 
@@ -408,7 +421,7 @@ mdMethodSpec CallTargetTokens::GetCallTargetDefaultValueMethodSpec(
   // *** Ensure we have the CallTargetInvoker.GetDefaultValue<> memberRef
   if (getDefaultMemberRef == mdMemberRefNil) {
     auto signatureLength = 5;
-    auto* signature = new COR_SIGNATURE[signatureLength];
+    SignatureBuffer signature(signatureLength);
     unsigned offset = 0;
 
     signature[offset++] = IMAGE_CEE_CS_CALLCONV_GENERIC;
@@ -420,9 +433,8 @@ mdMethodSpec CallTargetTokens::GetCallTargetDefaultValueMethodSpec(
 
     auto hr = module_metadata->metadata_emit->DefineMemberRef(
         callTargetTypeRef,
-        managed_profiler_calltarget_getdefaultvalue_name.data(), signature,
+        managed_profiler_calltarget_getdefaultvalue_name.data(), signature.data(),
         signatureLength, &getDefaultMemberRef);
-    delete[] signature;
     if (FAILED(hr)) {
       Warn("Wrapper getDefaultMemberRef could not be defined.");
       return hr;
@@ -438,7 +450,7 @@ mdMethodSpec CallTargetTokens::GetCallTargetDefaultValueMethodSpec(
       methodArgument->GetSignature(methodArgumentSignature);
 
   auto signatureLength = 2 + methodArgumentSignatureSize;
-  auto* signature = new COR_SIGNATURE[signatureLength];
+  SignatureBuffer signature(signatureLength);
   unsigned offset = 0;
   signature[offset++] = IMAGE_CEE_CS_CALLCONV_GENERICINST;
   signature[offset++] = 0x01;
@@ -447,9 +459,8 @@ mdMethodSpec CallTargetTokens::GetCallTargetDefaultValueMethodSpec(
          methodArgumentSignatureSize);
   offset += methodArgumentSignatureSize;
 
-  hr = module_metadata->metadata_emit->DefineMethodSpec(
-      getDefaultMemberRef, signature, signatureLength, &getDefaultMethodSpec);
-  delete[] signature;
+  hr = GetOrDefineMethodSpec(
+      getDefaultMemberRef, signature.data(), signatureLength, &getDefaultMethodSpec);
   if (FAILED(hr)) {
     Warn("Error creating getDefaultMethodSpec.");
     return mdMethodSpecNil;
@@ -458,6 +469,63 @@ mdMethodSpec CallTargetTokens::GetCallTargetDefaultValueMethodSpec(
   return getDefaultMethodSpec;
 }
 
+std::string CallTargetTokens::GetSignatureCacheKey(mdToken parent,
+                                                   PCCOR_SIGNATURE signature,
+                                                   ULONG signatureLength) {
+  std::string key;
+  key.reserve(sizeof(mdToken) + signatureLength);
+  key.append(reinterpret_cast<const char*>(&parent), sizeof(mdToken));
+  key.append(reinterpret_cast<const char*>(signature), signatureLength);
+  return key;
+}
+
+HRESULT CallTargetTokens::GetOrDefineMethodSpec(mdToken parent,
+                                                PCCOR_SIGNATURE signature,
+                                                ULONG signatureLength,
+                                                mdMethodSpec* methodSpec) {
+  // The instantiation blob contains the integration, target and argument types,
+  // so the same (parent, blob) pair always maps to the same MethodSpec in this module.
+  auto key = GetSignatureCacheKey(parent, signature, signatureLength);
+  {
+    std::lock_guard<std::mutex> guard(tokens_cache_lock);
+    const auto it = methodSpecs.find(key);
+    if (it != methodSpecs.end()) {
+      *methodSpec = it->second;
+      return S_OK;
+    }
+  }
+
+  auto hr = GetMetadata()->metadata_emit->DefineMethodSpec(
+      parent, signature, signatureLength, methodSpec);
+  if (SUCCEEDED(hr)) {
+    std::lock_guard<std::mutex> guard(tokens_cache_lock);
+    methodSpecs[std::move(key)] = *methodSpec;
+  }
+  return hr;
+}
+
+HRESULT CallTargetTokens::GetOrDefineTypeSpec(PCCOR_SIGNATURE signature,
+                                              ULONG signatureLength,
+                                              mdTypeSpec* typeSpec) {
+  auto key = GetSignatureCacheKey(mdTokenNil, signature, signatureLength);
+  {
+    std::lock_guard<std::mutex> guard(tokens_cache_lock);
+    const auto it = typeSpecs.find(key);
+    if (it != typeSpecs.end()) {
+      *typeSpec = it->second;
+      return S_OK;
+    }
+  }
+
+  auto hr = GetMetadata()->metadata_emit->GetTokenFromTypeSpec(
+      signature, signatureLength, typeSpec);
+  if (SUCCEEDED(hr)) {
+    std::lock_guard<std::mutex> guard(tokens_cache_lock);
+    typeSpecs[std::move(key)] = *typeSpec;
+  }
+  return hr;
+}
+
 mdToken CallTargetTokens::GetCurrentTypeRef(const TypeInfo* currentType, bool& isValueType) {
   if (currentType->type_spec != mdTypeSpecNil) {
     return currentType->type_spec;
@@ -469,12 +537,56 @@ mdToken CallTargetTokens::GetCurrentTypeRef(const TypeInfo* currentType, bool& i
   }
 }
 
+HRESULT CallTargetTokens::DefineInvokerMethodSpec(
+    mdMemberRef invokerMemberRef, mdTypeRef integrationTypeRef,
+    const TypeInfo* currentType, PCCOR_SIGNATURE extraArgSignature,
+    ULONG extraArgSignatureLength, mdMethodSpec* methodSpec) {
+  unsigned integrationTypeBuffer;
+  ULONG integrationTypeSize =
+      CorSigCompressToken(integrationTypeRef, &integrationTypeBuffer);
+
+  bool isValueType = currentType->valueType;
+  mdToken currentTypeRef = GetCurrentTypeRef(currentType, isValueType);
+
+  unsigned currentTypeBuffer;
+  ULONG currentTypeSize =
+      CorSigCompressToken(currentTypeRef, &currentTypeBuffer);
+
+  auto signatureLength =
+      4 + integrationTypeSize + currentTypeSize + extraArgSignatureLength;
+  SignatureBuffer signature(signatureLength);
+  unsigned offset = 0;
+  signature[offset++] = IMAGE_CEE_CS_CALLCONV_GENERICINST;
+  signature[offset++] = extraArgSignatureLength > 0 ? 0x03 : 0x02;
+
+  signature[offset++] = ELEMENT_TYPE_CLASS;
+  memcpy(&signature[offset], &integrationTypeBuffer, integrationTypeSize);
+  offset += integrationTypeSize;
+
+  if (isValueType) {
+    signature[offset++] = ELEMENT_TYPE_VALUETYPE;
+  } else {
+    signature[offset++] = ELEMENT_TYPE_CLASS;
+  }
+  memcpy(&signature[offset], &currentTypeBuffer, currentTypeSize);
+  offset += currentTypeSize;
+
+  if (extraArgSignatureLength > 0) {
+    memcpy(&signature[offset], extraArgSignature, extraArgSignatureLength);
+    offset += extraArgSignatureLength;
+  }
+
+  auto hr = GetOrDefineMethodSpec(
+      invokerMemberRef, signature.data(), offset, methodSpec);
+  return hr;
+}
+
 HRESULT CallTargetTokens::ModifyLocalSig(
     ILRewriter* reWriter, FunctionMethodArgument* methodReturnValue,
     ULONG* callTargetStateIndex, ULONG* exceptionIndex,
     ULONG* callTargetReturnIndex, ULONG* returnValueIndex,
     mdToken* callTargetStateToken, mdToken* exceptionToken,
-    mdToken* callTargetReturnToken) {
+    mdToken* callTargetReturnToken, ULONG* samplingFlagIndex) {
   auto hr = EnsureBaseCalltargetTokens();
   if (FAILED(hr)) {
     return hr;
@@ -508,6 +620,11 @@ HRESULT CallTargetTokens::ModifyLocalSig(
 
   ULONG newLocalsCount = 3;
 
+  // The sampling flag is an extra int32 local placed right before the
+  // calltarget state, so the state stays as the last local.
+  const ULONG samplingFlagLocals = samplingFlagIndex != nullptr ? 1 : 0;
+  newLocalsCount += samplingFlagLocals;
+
   // Gets the calltarget state type buffer and size
   unsigned callTargetStateTypeRefBuffer;
   auto callTargetStateTypeRefSize = CorSigCompressToken(
@@ -556,7 +673,8 @@ HRESULT CallTargetTokens::ModifyLocalSig(
   // New signature size
   ULONG newSignatureSize =
       originalSignatureSize + returnSignatureTypeSize + (1 + exTypeRefSize) +
-      callTargetReturnSizeForNewSignature + (1 + callTargetStateTypeRefSize);
+      callTargetReturnSizeForNewSignature + samplingFlagLocals +
+      (1 + callTargetStateTypeRefSize);
   ULONG newSignatureOffset = 0;
 
 
@@ -578,7 +696,7 @@ HRESULT CallTargetTokens::ModifyLocalSig(
   }
 
   // New signature declaration
-  auto* newSignatureBuffer = new COR_SIGNATURE[newSignatureSize];
+  SignatureBuffer newSignatureBuffer(newSignatureSize);
   newSignatureBuffer[newSignatureOffset++] = IMAGE_CEE_CS_CALLCONV_LOCAL_SIG;
 
   // Set the locals count
@@ -621,6 +739,11 @@ HRESULT CallTargetTokens::ModifyLocalSig(
     newSignatureOffset += callTargetReturnSize;
   }
 
+  // Sampling flag value
+  if (samplingFlagLocals > 0) {
+    newSignatureBuffer[newSignatureOffset++] = ELEMENT_TYPE_I4;
+  }
+
   // CallTarget state value
   newSignatureBuffer[newSignatureOffset++] = ELEMENT_TYPE_VALUETYPE;
   memcpy(&newSignatureBuffer[newSignatureOffset], &callTargetStateTypeRefBuffer,
@@ -630,8 +753,7 @@ HRESULT CallTargetTokens::ModifyLocalSig(
   // Get new locals token
   mdToken newLocalVarSig;
   hr = module_metadata->metadata_emit->GetTokenFromSig(
-      newSignatureBuffer, newSignatureSize, &newLocalVarSig);
-  delete[] newSignatureBuffer;
+      newSignatureBuffer.data(), newSignatureSize, &newLocalVarSig);
   if (FAILED(hr)) {
     Warn("Error creating new locals var signature.");
     return hr;
@@ -642,12 +764,15 @@ HRESULT CallTargetTokens::ModifyLocalSig(
   *exceptionToken = exTypeRef;
   *callTargetReturnToken = callTargetReturn;
   if (returnSignatureType != nullptr) {
-    *returnValueIndex = newLocalsCount - 4;
+    *returnValueIndex = newLocalsCount - samplingFlagLocals - 4;
   } else {
     *returnValueIndex = static_cast<ULONG>(ULONG_MAX);
   }
-  *exceptionIndex = newLocalsCount - 3;
-  *callTargetReturnIndex = newLocalsCount - 2;
+  *exceptionIndex = newLocalsCount - samplingFlagLocals - 3;
+  *callTargetReturnIndex = newLocalsCount - samplingFlagLocals - 2;
+  if (samplingFlagIndex != nullptr) {
+    *samplingFlagIndex = newLocalsCount - 2;
+  }
   *callTargetStateIndex = newLocalsCount - 1;
   return hr;
 }
@@ -665,7 +790,8 @@ HRESULT CallTargetTokens::ModifyLocalSigAndInitialize(
     ULONG* callTargetStateIndex, ULONG* exceptionIndex,
     ULONG* callTargetReturnIndex, ULONG* returnValueIndex,
     mdToken* callTargetStateToken, mdToken* exceptionToken,
-    mdToken* callTargetReturnToken, ILInstr** firstInstruction) {
+    mdToken* callTargetReturnToken, ILInstr** firstInstruction,
+    ULONG* samplingFlagIndex) {
   ILRewriterWrapper* rewriterWrapper = (ILRewriterWrapper*)rewriterWrapperPtr;
 
   // Modify the Local Var Signature of the method
@@ -675,7 +801,8 @@ HRESULT CallTargetTokens::ModifyLocalSigAndInitialize(
                            &returnFunctionMethod, callTargetStateIndex,
                            exceptionIndex, callTargetReturnIndex,
                            returnValueIndex, callTargetStateToken,
-                           exceptionToken, callTargetReturnToken);
+                           exceptionToken, callTargetReturnToken,
+                           samplingFlagIndex);
 
   if (FAILED(hr)) {
     Warn("ModifyLocalSig() failed.");
@@ -722,7 +849,7 @@ HRESULT CallTargetTokens::WriteBeginMethodWithoutArguments(
         CorSigCompressToken(callTargetStateTypeRef, &callTargetStateBuffer);
 
     auto signatureLength = 6 + callTargetStateSize;
-    auto* signature = new COR_SIGNATURE[signatureLength];
+    SignatureBuffer signature(signatureLength);
     unsigned offset = 0;
 
     signature[offset++] = IMAGE_CEE_CS_CALLCONV_GENERIC;
@@ -738,8 +865,7 @@ HRESULT CallTargetTokens::WriteBeginMethodWithoutArguments(
 
     auto hr = module_metadata->metadata_emit->DefineMemberRef(
         callTargetTypeRef, managed_profiler_calltarget_beginmethod_name.data(),
-        signature, signatureLength, &beginP0MemberRef);
-    delete[] signature;
+        signature.data(), signatureLength, &beginP0MemberRef);
     if (FAILED(hr)) {
       Warn("Wrapper beginP0MemberRef could not be defined.");
       return hr;
@@ -760,7 +886,7 @@ HRESULT CallTargetTokens::WriteBeginMethodWithoutArguments(
       CorSigCompressToken(currentTypeRef, &currentTypeBuffer);
 
   auto signatureLength = 4 + integrationTypeSize + currentTypeSize;
-  auto* signature = new COR_SIGNATURE[signatureLength];
+  SignatureBuffer signature(signatureLength);
   unsigned offset = 0;
   signature[offset++] = IMAGE_CEE_CS_CALLCONV_GENERICINST;
   signature[offset++] = 0x02;
@@ -777,9 +903,8 @@ HRESULT CallTargetTokens::WriteBeginMethodWithoutArguments(
   memcpy(&signature[offset], &currentTypeBuffer, currentTypeSize);
   offset += currentTypeSize;
 
-  hr = module_metadata->metadata_emit->DefineMethodSpec(
-      beginP0MemberRef, signature, signatureLength, &beginP0MethodSpec);
-  delete[] signature;
+  hr = GetOrDefineMethodSpec(
+      beginP0MemberRef, signature.data(), signatureLength, &beginP0MethodSpec);
   if (FAILED(hr)) {
     Warn("Error creating begin method spec.");
     return hr;
@@ -807,7 +932,7 @@ HRESULT CallTargetTokens::WriteBeginMethodWithArguments(
         CorSigCompressToken(callTargetStateTypeRef, &callTargetStateBuffer);
 
     auto signatureLength = 8 + callTargetStateSize;
-    auto* signature = new COR_SIGNATURE[signatureLength];
+    SignatureBuffer signature(signatureLength);
     unsigned offset = 0;
 
     signature[offset++] = IMAGE_CEE_CS_CALLCONV_GENERIC;
@@ -826,8 +951,7 @@ HRESULT CallTargetTokens::WriteBeginMethodWithArguments(
 
     auto hr = module_metadata->metadata_emit->DefineMemberRef(
         callTargetTypeRef, managed_profiler_calltarget_beginmethod_name.data(),
-        signature, signatureLength, &beginP1MemberRef);
-    delete[] signature;
+        signature.data(), signatureLength, &beginP1MemberRef);
     if (FAILED(hr)) {
       Warn("Wrapper beginP1MemberRef could not be defined.");
       return hr;
@@ -852,7 +976,7 @@ HRESULT CallTargetTokens::WriteBeginMethodWithArguments(
 
   auto signatureLength =
       4 + integrationTypeSize + currentTypeSize + arg1SignatureSize;
-  auto* signature = new COR_SIGNATURE[signatureLength];
+  SignatureBuffer signature(signatureLength);
   unsigned offset = 0;
 
   signature[offset++] = IMAGE_CEE_CS_CALLCONV_GENERICINST;
@@ -873,9 +997,8 @@ HRESULT CallTargetTokens::WriteBeginMethodWithArguments(
   memcpy(&signature[offset], arg1SignatureBuffer, arg1SignatureSize);
   offset += arg1SignatureSize;
 
-  hr = module_metadata->metadata_emit->DefineMethodSpec(
-      beginP1MemberRef, signature, signatureLength, &beginP1MethodSpec);
-  delete[] signature;
+  hr = GetOrDefineMethodSpec(
+      beginP1MemberRef, signature.data(), signatureLength, &beginP1MethodSpec);
   if (FAILED(hr)) {
     Warn("Error creating begin method spec.");
     return hr;
@@ -903,7 +1026,7 @@ HRESULT CallTargetTokens::WriteBeginMethodWithArguments(
         CorSigCompressToken(callTargetStateTypeRef, &callTargetStateBuffer);
 
     auto signatureLength = 10 + callTargetStateSize;
-    auto* signature = new COR_SIGNATURE[signatureLength];
+    SignatureBuffer signature(signatureLength);
     unsigned offset = 0;
 
     signature[offset++] = IMAGE_CEE_CS_CALLCONV_GENERIC;
@@ -925,8 +1048,7 @@ HRESULT CallTargetTokens::WriteBeginMethodWithArguments(
 
     auto hr = module_metadata->metadata_emit->DefineMemberRef(
         callTargetTypeRef, managed_profiler_calltarget_beginmethod_name.data(),
-        signature, signatureLength, &beginP2MemberRef);
-    delete[] signature;
+        signature.data(), signatureLength, &beginP2MemberRef);
     if (FAILED(hr)) {
       Warn("Wrapper beginP2MemberRef could not be defined.");
       return hr;
@@ -954,7 +1076,7 @@ HRESULT CallTargetTokens::WriteBeginMethodWithArguments(
 
   auto signatureLength = 4 + integrationTypeSize + currentTypeSize +
                          arg1SignatureSize + arg2SignatureSize;
-  auto* signature = new COR_SIGNATURE[signatureLength];
+  SignatureBuffer signature(signatureLength);
   unsigned offset = 0;
 
   signature[offset++] = IMAGE_CEE_CS_CALLCONV_GENERICINST;
@@ -978,9 +1100,8 @@ HRESULT CallTargetTokens::WriteBeginMethodWithArguments(
   memcpy(&signature[offset], arg2SignatureBuffer, arg2SignatureSize);
   offset += arg2SignatureSize;
 
-  hr = module_metadata->metadata_emit->DefineMethodSpec(
-      beginP2MemberRef, signature, signatureLength, &beginP2MethodSpec);
-  delete[] signature;
+  hr = GetOrDefineMethodSpec(
+      beginP2MemberRef, signature.data(), signatureLength, &beginP2MethodSpec);
   if (FAILED(hr)) {
     Warn("Error creating begin method spec.");
     return hr;
@@ -1009,7 +1130,7 @@ HRESULT CallTargetTokens::WriteBeginMethodWithArguments(
         CorSigCompressToken(callTargetStateTypeRef, &callTargetStateBuffer);
 
     auto signatureLength = 12 + callTargetStateSize;
-    auto* signature = new COR_SIGNATURE[signatureLength];
+    SignatureBuffer signature(signatureLength);
     unsigned offset = 0;
 
     signature[offset++] = IMAGE_CEE_CS_CALLCONV_GENERIC;
@@ -1034,8 +1155,7 @@ HRESULT CallTargetTokens::WriteBeginMethodWithArguments(
 
     auto hr = module_metadata->metadata_emit->DefineMemberRef(
         callTargetTypeRef, managed_profiler_calltarget_beginmethod_name.data(),
-        signature, signatureLength, &beginP3MemberRef);
-    delete[] signature;
+        signature.data(), signatureLength, &beginP3MemberRef);
     if (FAILED(hr)) {
       Warn("Wrapper beginP3MemberRef could not be defined.");
       return hr;
@@ -1067,7 +1187,7 @@ HRESULT CallTargetTokens::WriteBeginMethodWithArguments(
   auto signatureLength = 4 + integrationTypeSize + currentTypeSize +
                          arg1SignatureSize + arg2SignatureSize +
                          arg3SignatureSize;
-  auto* signature = new COR_SIGNATURE[signatureLength];
+  SignatureBuffer signature(signatureLength);
   unsigned offset = 0;
 
   signature[offset++] = IMAGE_CEE_CS_CALLCONV_GENERICINST;
@@ -1094,9 +1214,8 @@ HRESULT CallTargetTokens::WriteBeginMethodWithArguments(
   memcpy(&signature[offset], arg3SignatureBuffer, arg3SignatureSize);
   offset += arg3SignatureSize;
 
-  hr = module_metadata->metadata_emit->DefineMethodSpec(
-      beginP3MemberRef, signature, signatureLength, &beginP3MethodSpec);
-  delete[] signature;
+  hr = GetOrDefineMethodSpec(
+      beginP3MemberRef, signature.data(), signatureLength, &beginP3MethodSpec);
   if (FAILED(hr)) {
     Warn("Error creating begin method spec.");
     return hr;
@@ -1125,7 +1244,7 @@ HRESULT CallTargetTokens::WriteBeginMethodWithArguments(
         CorSigCompressToken(callTargetStateTypeRef, &callTargetStateBuffer);
 
     auto signatureLength = 14 + callTargetStateSize;
-    auto* signature = new COR_SIGNATURE[signatureLength];
+    SignatureBuffer signature(signatureLength);
     unsigned offset = 0;
 
     signature[offset++] = IMAGE_CEE_CS_CALLCONV_GENERIC;
@@ -1153,8 +1272,7 @@ HRESULT CallTargetTokens::WriteBeginMethodWithArguments(
 
     auto hr = module_metadata->metadata_emit->DefineMemberRef(
         callTargetTypeRef, managed_profiler_calltarget_beginmethod_name.data(),
-        signature, signatureLength, &beginP4MemberRef);
-    delete[] signature;
+        signature.data(), signatureLength, &beginP4MemberRef);
     if (FAILED(hr)) {
       Warn("Wrapper beginP4MemberRef could not be defined.");
       return hr;
@@ -1189,7 +1307,7 @@ HRESULT CallTargetTokens::WriteBeginMethodWithArguments(
   auto signatureLength = 4 + integrationTypeSize + currentTypeSize +
                          arg1SignatureSize + arg2SignatureSize +
                          arg3SignatureSize + arg4SignatureSize;
-  auto* signature = new COR_SIGNATURE[signatureLength];
+  SignatureBuffer signature(signatureLength);
   unsigned offset = 0;
 
   signature[offset++] = IMAGE_CEE_CS_CALLCONV_GENERICINST;
@@ -1219,9 +1337,8 @@ HRESULT CallTargetTokens::WriteBeginMethodWithArguments(
   memcpy(&signature[offset], arg4SignatureBuffer, arg4SignatureSize);
   offset += arg4SignatureSize;
 
-  hr = module_metadata->metadata_emit->DefineMethodSpec(
-      beginP4MemberRef, signature, signatureLength, &beginP4MethodSpec);
-  delete[] signature;
+  hr = GetOrDefineMethodSpec(
+      beginP4MemberRef, signature.data(), signatureLength, &beginP4MethodSpec);
   if (FAILED(hr)) {
     Warn("Error creating begin method spec.");
     return hr;
@@ -1251,7 +1368,7 @@ HRESULT CallTargetTokens::WriteBeginMethodWithArguments(
         CorSigCompressToken(callTargetStateTypeRef, &callTargetStateBuffer);
 
     auto signatureLength = 16 + callTargetStateSize;
-    auto* signature = new COR_SIGNATURE[signatureLength];
+    SignatureBuffer signature(signatureLength);
     unsigned offset = 0;
 
     signature[offset++] = IMAGE_CEE_CS_CALLCONV_GENERIC;
@@ -1282,8 +1399,7 @@ HRESULT CallTargetTokens::WriteBeginMethodWithArguments(
 
     auto hr = module_metadata->metadata_emit->DefineMemberRef(
         callTargetTypeRef, managed_profiler_calltarget_beginmethod_name.data(),
-        signature, signatureLength, &beginP5MemberRef);
-    delete[] signature;
+        signature.data(), signatureLength, &beginP5MemberRef);
     if (FAILED(hr)) {
       Warn("Wrapper beginP5MemberRef could not be defined.");
       return hr;
@@ -1322,7 +1438,7 @@ HRESULT CallTargetTokens::WriteBeginMethodWithArguments(
                          arg1SignatureSize + arg2SignatureSize +
                          arg3SignatureSize + arg4SignatureSize +
                          arg5SignatureSize;
-  auto* signature = new COR_SIGNATURE[signatureLength];
+  SignatureBuffer signature(signatureLength);
   unsigned offset = 0;
 
   signature[offset++] = IMAGE_CEE_CS_CALLCONV_GENERICINST;
@@ -1355,9 +1471,8 @@ HRESULT CallTargetTokens::WriteBeginMethodWithArguments(
   memcpy(&signature[offset], arg5SignatureBuffer, arg5SignatureSize);
   offset += arg5SignatureSize;
 
-  hr = module_metadata->metadata_emit->DefineMethodSpec(
-      beginP5MemberRef, signature, signatureLength, &beginP5MethodSpec);
-  delete[] signature;
+  hr = GetOrDefineMethodSpec(
+      beginP5MemberRef, signature.data(), signatureLength, &beginP5MethodSpec);
   if (FAILED(hr)) {
     Warn("Error creating begin method spec.");
     return hr;
@@ -1387,7 +1502,7 @@ HRESULT CallTargetTokens::WriteBeginMethodWithArguments(
         CorSigCompressToken(callTargetStateTypeRef, &callTargetStateBuffer);
 
     auto signatureLength = 18 + callTargetStateSize;
-    auto* signature = new COR_SIGNATURE[signatureLength];
+    SignatureBuffer signature(signatureLength);
     unsigned offset = 0;
 
     signature[offset++] = IMAGE_CEE_CS_CALLCONV_GENERIC;
@@ -1421,8 +1536,7 @@ HRESULT CallTargetTokens::WriteBeginMethodWithArguments(
 
     auto hr = module_metadata->metadata_emit->DefineMemberRef(
         callTargetTypeRef, managed_profiler_calltarget_beginmethod_name.data(),
-        signature, signatureLength, &beginP6MemberRef);
-    delete[] signature;
+        signature.data(), signatureLength, &beginP6MemberRef);
     if (FAILED(hr)) {
       Warn("Wrapper beginP6MemberRef could not be defined.");
       return hr;
@@ -1464,7 +1578,7 @@ HRESULT CallTargetTokens::WriteBeginMethodWithArguments(
                          arg1SignatureSize + arg2SignatureSize +
                          arg3SignatureSize + arg4SignatureSize +
                          arg5SignatureSize + arg6SignatureSize;
-  auto* signature = new COR_SIGNATURE[signatureLength];
+  SignatureBuffer signature(signatureLength);
   unsigned offset = 0;
 
   signature[offset++] = IMAGE_CEE_CS_CALLCONV_GENERICINST;
@@ -1500,9 +1614,8 @@ HRESULT CallTargetTokens::WriteBeginMethodWithArguments(
   memcpy(&signature[offset], arg6SignatureBuffer, arg6SignatureSize);
   offset += arg6SignatureSize;
 
-  hr = module_metadata->metadata_emit->DefineMethodSpec(
-      beginP6MemberRef, signature, signatureLength, &beginP6MethodSpec);
-  delete[] signature;
+  hr = GetOrDefineMethodSpec(
+      beginP6MemberRef, signature.data(), signatureLength, &beginP6MethodSpec);
   if (FAILED(hr)) {
     Warn("Error creating begin method spec.");
     return hr;
@@ -1528,7 +1641,7 @@ HRESULT CallTargetTokens::WriteBeginMethodWithArgumentsArray(
         CorSigCompressToken(callTargetStateTypeRef, &callTargetStateBuffer);
 
     auto signatureLength = 8 + callTargetStateSize;
-    auto* signature = new COR_SIGNATURE[signatureLength];
+    SignatureBuffer signature(signatureLength);
     unsigned offset = 0;
 
     signature[offset++] = IMAGE_CEE_CS_CALLCONV_GENERIC;
@@ -1547,8 +1660,7 @@ HRESULT CallTargetTokens::WriteBeginMethodWithArgumentsArray(
 
     auto hr = module_metadata->metadata_emit->DefineMemberRef(
         callTargetTypeRef, managed_profiler_calltarget_beginmethod_name.data(),
-        signature, signatureLength, &beginArrayMemberRef);
-    delete[] signature;
+        signature.data(), signatureLength, &beginArrayMemberRef);
     if (FAILED(hr)) {
       Warn("Wrapper beginArrayMemberRef could not be defined.");
       return hr;
@@ -1569,7 +1681,7 @@ HRESULT CallTargetTokens::WriteBeginMethodWithArgumentsArray(
       CorSigCompressToken(currentTypeRef, &currentTypeBuffer);
 
   auto signatureLength = 4 + integrationTypeSize + currentTypeSize;
-  auto* signature = new COR_SIGNATURE[signatureLength];
+  SignatureBuffer signature(signatureLength);
   unsigned offset = 0;
   signature[offset++] = IMAGE_CEE_CS_CALLCONV_GENERICINST;
   signature[offset++] = 0x02;
@@ -1586,9 +1698,8 @@ HRESULT CallTargetTokens::WriteBeginMethodWithArgumentsArray(
   memcpy(&signature[offset], &currentTypeBuffer, currentTypeSize);
   offset += currentTypeSize;
 
-  hr = module_metadata->metadata_emit->DefineMethodSpec(
-      beginArrayMemberRef, signature, signatureLength, &beginArrayMethodSpec);
-  delete[] signature;
+  hr = GetOrDefineMethodSpec(
+      beginArrayMemberRef, signature.data(), signatureLength, &beginArrayMethodSpec);
   if (FAILED(hr)) {
     Warn("Error creating begin method spec.");
     return hr;
@@ -1622,7 +1733,7 @@ HRESULT CallTargetTokens::WriteEndVoidReturnMemberRef(
 
     auto signatureLength =
         8 + callTargetReturnVoidSize + exTypeRefSize + callTargetStateSize;
-    auto* signature = new COR_SIGNATURE[signatureLength];
+    SignatureBuffer signature(signatureLength);
     unsigned offset = 0;
 
     signature[offset++] = IMAGE_CEE_CS_CALLCONV_GENERIC;
@@ -1647,8 +1758,7 @@ HRESULT CallTargetTokens::WriteEndVoidReturnMemberRef(
 
     auto hr = module_metadata->metadata_emit->DefineMemberRef(
         callTargetTypeRef, managed_profiler_calltarget_endmethod_name.data(),
-        signature, signatureLength, &endVoidMemberRef);
-    delete[] signature;
+        signature.data(), signatureLength, &endVoidMemberRef);
     if (FAILED(hr)) {
       Warn("Wrapper endVoidMemberRef could not be defined.");
       return hr;
@@ -1669,7 +1779,7 @@ HRESULT CallTargetTokens::WriteEndVoidReturnMemberRef(
       CorSigCompressToken(currentTypeRef, &currentTypeBuffer);
 
   auto signatureLength = 4 + integrationTypeSize + currentTypeSize;
-  auto* signature = new COR_SIGNATURE[signatureLength];
+  SignatureBuffer signature(signatureLength);
   unsigned offset = 0;
   signature[offset++] = IMAGE_CEE_CS_CALLCONV_GENERICINST;
   signature[offset++] = 0x02;
@@ -1686,9 +1796,8 @@ HRESULT CallTargetTokens::WriteEndVoidReturnMemberRef(
   memcpy(&signature[offset], &currentTypeBuffer, currentTypeSize);
   offset += currentTypeSize;
 
-  hr = module_metadata->metadata_emit->DefineMethodSpec(
-      endVoidMemberRef, signature, signatureLength, &endVoidMethodSpec);
-  delete[] signature;
+  hr = GetOrDefineMethodSpec(
+      endVoidMemberRef, signature.data(), signatureLength, &endVoidMethodSpec);
   if (FAILED(hr)) {
     Warn("Error creating end void method method spec.");
     return hr;
@@ -1711,112 +1820,377 @@ HRESULT CallTargetTokens::WriteEndReturnMemberRef(
   GetTargetReturnValueTypeRef(returnArgument);
 
   // *** Define base MethodMemberRef for the type
+  // CallTargetReturn<TReturn> EndMethod<TIntegration, TTarget, TReturn>(TTarget instance, TReturn returnValue, Exception exception, CallTargetState state)
+  if (endReturnMemberRef == mdMemberRefNil) {
+    unsigned callTargetReturnTypeRefBuffer;
+    auto callTargetReturnTypeRefSize = CorSigCompressToken(
+        callTargetReturnTypeRef, &callTargetReturnTypeRefBuffer);
 
-  mdMemberRef endMethodMemberRef = mdMemberRefNil;
+    unsigned exTypeRefBuffer;
+    auto exTypeRefSize = CorSigCompressToken(exTypeRef, &exTypeRefBuffer);
 
-  unsigned callTargetReturnTypeRefBuffer;
-  auto callTargetReturnTypeRefSize = CorSigCompressToken(
-      callTargetReturnTypeRef, &callTargetReturnTypeRefBuffer);
+    unsigned callTargetStateBuffer;
+    auto callTargetStateSize =
+        CorSigCompressToken(callTargetStateTypeRef, &callTargetStateBuffer);
 
-  unsigned exTypeRefBuffer;
-  auto exTypeRefSize = CorSigCompressToken(exTypeRef, &exTypeRefBuffer);
+    auto signatureLength =
+        14 + callTargetReturnTypeRefSize + exTypeRefSize + callTargetStateSize;
+    SignatureBuffer signature(signatureLength);
+    unsigned offset = 0;
 
-  unsigned callTargetStateBuffer;
-  auto callTargetStateSize =
-      CorSigCompressToken(callTargetStateTypeRef, &callTargetStateBuffer);
+    signature[offset++] = IMAGE_CEE_CS_CALLCONV_GENERIC;
+    signature[offset++] = 0x03;
+    signature[offset++] = 0x04;
 
-  auto signatureLength =
-      14 + callTargetReturnTypeRefSize + exTypeRefSize + callTargetStateSize;
-  auto* signature = new COR_SIGNATURE[signatureLength];
-  unsigned offset = 0;
+    signature[offset++] = ELEMENT_TYPE_GENERICINST;
+    signature[offset++] = ELEMENT_TYPE_VALUETYPE;
+    memcpy(&signature[offset], &callTargetReturnTypeRefBuffer,
+           callTargetReturnTypeRefSize);
+    offset += callTargetReturnTypeRefSize;
+    signature[offset++] = 0x01;
+    signature[offset++] = ELEMENT_TYPE_MVAR;
+    signature[offset++] = 0x02;
 
-  signature[offset++] = IMAGE_CEE_CS_CALLCONV_GENERIC;
-  signature[offset++] = 0x03;
-  signature[offset++] = 0x04;
+    signature[offset++] = ELEMENT_TYPE_MVAR;
+    signature[offset++] = 0x01;
 
-  signature[offset++] = ELEMENT_TYPE_GENERICINST;
-  signature[offset++] = ELEMENT_TYPE_VALUETYPE;
-  memcpy(&signature[offset], &callTargetReturnTypeRefBuffer,
-         callTargetReturnTypeRefSize);
-  offset += callTargetReturnTypeRefSize;
-  signature[offset++] = 0x01;
-  signature[offset++] = ELEMENT_TYPE_MVAR;
-  signature[offset++] = 0x02;
+    signature[offset++] = ELEMENT_TYPE_MVAR;
+    signature[offset++] = 0x02;
 
-  signature[offset++] = ELEMENT_TYPE_MVAR;
-  signature[offset++] = 0x01;
+    signature[offset++] = ELEMENT_TYPE_CLASS;
+    memcpy(&signature[offset], &exTypeRefBuffer, exTypeRefSize);
+    offset += exTypeRefSize;
 
-  signature[offset++] = ELEMENT_TYPE_MVAR;
-  signature[offset++] = 0x02;
+    signature[offset++] = ELEMENT_TYPE_VALUETYPE;
+    memcpy(&signature[offset], &callTargetStateBuffer, callTargetStateSize);
+    offset += callTargetStateSize;
 
-  signature[offset++] = ELEMENT_TYPE_CLASS;
-  memcpy(&signature[offset], &exTypeRefBuffer, exTypeRefSize);
-  offset += exTypeRefSize;
+    hr = module_metadata->metadata_emit->DefineMemberRef(
+        callTargetTypeRef, managed_profiler_calltarget_endmethod_name.data(),
+        signature.data(), signatureLength, &endReturnMemberRef);
+    if (FAILED(hr)) {
+      Warn("Wrapper endMethodMemberRef could not be defined.");
+      return hr;
+    }
+  }
 
-  signature[offset++] = ELEMENT_TYPE_VALUETYPE;
-  memcpy(&signature[offset], &callTargetStateBuffer, callTargetStateSize);
-  offset += callTargetStateSize;
+  // *** Define Method Spec
+  PCCOR_SIGNATURE returnSignatureBuffer;
+  auto returnSignatureLength =
+      returnArgument->GetSignature(returnSignatureBuffer);
 
-  hr = module_metadata->metadata_emit->DefineMemberRef(
-      callTargetTypeRef, managed_profiler_calltarget_endmethod_name.data(),
-      signature, signatureLength, &endMethodMemberRef);
-  delete[] signature;
+  mdMethodSpec endMethodSpec = mdMethodSpecNil;
+  hr = DefineInvokerMethodSpec(endReturnMemberRef, integrationTypeRef,
+                               currentType, returnSignatureBuffer,
+                               returnSignatureLength, &endMethodSpec);
   if (FAILED(hr)) {
-    Warn("Wrapper endMethodMemberRef could not be defined.");
+    Warn("Error creating end method member spec.");
     return hr;
   }
 
-  // *** Define Method Spec
+  *instruction = rewriterWrapper->CallMember(endMethodSpec, false);
+  return S_OK;
+}
 
-  mdMethodSpec endMethodSpec = mdMethodSpecNil;
+HRESULT CallTargetTokens::WriteBeginAsyncStubMemberRef(
+    void* rewriterWrapperPtr, mdTypeRef integrationTypeRef,
+    const TypeInfo* currentType, ILInstr** instruction) {
+  auto hr = EnsureBaseCalltargetTokens();
+  if (FAILED(hr)) {
+    return hr;
+  }
+  ILRewriterWrapper* rewriterWrapper = (ILRewriterWrapper*)rewriterWrapperPtr;
+  ModuleMetadata* module_metadata = GetMetadata();
 
-  unsigned integrationTypeBuffer;
-  ULONG integrationTypeSize =
-      CorSigCompressToken(integrationTypeRef, &integrationTypeBuffer);
+  // void BeginAsyncStubMethod<TIntegration, TTarget>(TTarget instance, CallTargetState state)
+  if (beginAsyncStubMemberRef == mdMemberRefNil) {
+    unsigned callTargetStateBuffer;
+    auto callTargetStateSize =
+        CorSigCompressToken(callTargetStateTypeRef, &callTargetStateBuffer);
 
-  bool isValueType = currentType->valueType;
-  mdToken currentTypeRef = GetCurrentTypeRef(currentType, isValueType);
+    auto signatureLength = 7 + callTargetStateSize;
+    SignatureBuffer signature(signatureLength);
+    unsigned offset = 0;
 
-  unsigned currentTypeBuffer;
-  ULONG currentTypeSize =
-      CorSigCompressToken(currentTypeRef, &currentTypeBuffer);
+    signature[offset++] = IMAGE_CEE_CS_CALLCONV_GENERIC;
+    signature[offset++] = 0x02;
+    signature[offset++] = 0x02;
 
-  PCCOR_SIGNATURE returnSignatureBuffer;
-  auto returnSignatureLength =
-      returnArgument->GetSignature(returnSignatureBuffer);
+    signature[offset++] = ELEMENT_TYPE_VOID;
 
-  signatureLength =
-      4 + integrationTypeSize + currentTypeSize + returnSignatureLength;
-  signature = new COR_SIGNATURE[signatureLength];
-  offset = 0;
+    signature[offset++] = ELEMENT_TYPE_MVAR;
+    signature[offset++] = 0x01;
 
-  signature[offset++] = IMAGE_CEE_CS_CALLCONV_GENERICINST;
-  signature[offset++] = 0x03;
+    signature[offset++] = ELEMENT_TYPE_VALUETYPE;
+    memcpy(&signature[offset], &callTargetStateBuffer, callTargetStateSize);
+    offset += callTargetStateSize;
 
-  signature[offset++] = ELEMENT_TYPE_CLASS;
-  memcpy(&signature[offset], &integrationTypeBuffer, integrationTypeSize);
-  offset += integrationTypeSize;
+    hr = module_metadata->metadata_emit->DefineMemberRef(
+        callTargetTypeRef,
+        managed_profiler_calltarget_beginasyncstubmethod_name.data(), signature.data(),
+        signatureLength, &beginAsyncStubMemberRef);
+    if (FAILED(hr)) {
+      Warn("Wrapper beginAsyncStubMemberRef could not be defined.");
+      return hr;
+    }
+  }
+
+  mdMethodSpec beginAsyncStubMethodSpec = mdMethodSpecNil;
+  hr = DefineInvokerMethodSpec(beginAsyncStubMemberRef, integrationTypeRef,
+                               currentType, nullptr, 0,
+                               &beginAsyncStubMethodSpec);
+  if (FAILED(hr)) {
+    Warn("Error creating begin async stub method spec.");
+    return hr;
+  }
+
+  *instruction = rewriterWrapper->CallMember(beginAsyncStubMethodSpec, false);
+  return S_OK;
+}
+
+HRESULT CallTargetTokens::WriteEndAsyncStubMemberRef(
+    void* rewriterWrapperPtr, mdTypeRef integrationTypeRef,
+    const TypeInfo* currentType, ILInstr** instruction) {
+  auto hr = EnsureBaseCalltargetTokens();
+  if (FAILED(hr)) {
+    return hr;
+  }
+  ILRewriterWrapper* rewriterWrapper = (ILRewriterWrapper*)rewriterWrapperPtr;
+  ModuleMetadata* module_metadata = GetMetadata();
+
+  // CallTargetReturn EndAsyncStubMethod<TIntegration, TTarget>(TTarget instance, Exception exception, CallTargetState state)
+  if (endAsyncStubMemberRef == mdMemberRefNil) {
+    unsigned callTargetReturnVoidBuffer;
+    auto callTargetReturnVoidSize = CorSigCompressToken(
+        callTargetReturnVoidTypeRef, &callTargetReturnVoidBuffer);
+
+    unsigned exTypeRefBuffer;
+    auto exTypeRefSize = CorSigCompressToken(exTypeRef, &exTypeRefBuffer);
+
+    unsigned callTargetStateBuffer;
+    auto callTargetStateSize =
+        CorSigCompressToken(callTargetStateTypeRef, &callTargetStateBuffer);
+
+    auto signatureLength =
+        8 + callTargetReturnVoidSize + exTypeRefSize + callTargetStateSize;
+    SignatureBuffer signature(signatureLength);
+    unsigned offset = 0;
+
+    signature[offset++] = IMAGE_CEE_CS_CALLCONV_GENERIC;
+    signature[offset++] = 0x02;
+    signature[offset++] = 0x03;
 
-  if (isValueType) {
     signature[offset++] = ELEMENT_TYPE_VALUETYPE;
-  } else {
+    memcpy(&signature[offset], &callTargetReturnVoidBuffer,
+           callTargetReturnVoidSize);
+    offset += callTargetReturnVoidSize;
+
+    signature[offset++] = ELEMENT_TYPE_MVAR;
+    signature[offset++] = 0x01;
+
     signature[offset++] = ELEMENT_TYPE_CLASS;
+    memcpy(&signature[offset], &exTypeRefBuffer, exTypeRefSize);
+    offset += exTypeRefSize;
+
+    signature[offset++] = ELEMENT_TYPE_VALUETYPE;
+    memcpy(&signature[offset], &callTargetStateBuffer, callTargetStateSize);
+    offset += callTargetStateSize;
+
+    hr = module_metadata->metadata_emit->DefineMemberRef(
+        callTargetTypeRef,
+        managed_profiler_calltarget_endasyncstubmethod_name.data(), signature.data(),
+        signatureLength, &endAsyncStubMemberRef);
+    if (FAILED(hr)) {
+      Warn("Wrapper endAsyncStubMemberRef could not be defined.");
+      return hr;
+    }
   }
-  memcpy(&signature[offset], &currentTypeBuffer, currentTypeSize);
-  offset += currentTypeSize;
 
-  memcpy(&signature[offset], returnSignatureBuffer, returnSignatureLength);
-  offset += returnSignatureLength;
+  mdMethodSpec endAsyncStubMethodSpec = mdMethodSpecNil;
+  hr = DefineInvokerMethodSpec(endAsyncStubMemberRef, integrationTypeRef,
+                               currentType, nullptr, 0,
+                               &endAsyncStubMethodSpec);
+  if (FAILED(hr)) {
+    Warn("Error creating end async stub method spec.");
+    return hr;
+  }
+
+  *instruction = rewriterWrapper->CallMember(endAsyncStubMethodSpec, false);
+  return S_OK;
+}
 
-  hr = module_metadata->metadata_emit->DefineMethodSpec(
-      endMethodMemberRef, signature, signatureLength, &endMethodSpec);
-  delete[] signature;
+HRESULT CallTargetTokens::WriteEnterAsyncMethod(
+    void* rewriterWrapperPtr, mdTypeRef integrationTypeRef,
+    const TypeInfo* currentType, ILInstr** instruction) {
+  auto hr = EnsureBaseCalltargetTokens();
   if (FAILED(hr)) {
-    Warn("Error creating end method member spec.");
     return hr;
   }
+  ILRewriterWrapper* rewriterWrapper = (ILRewriterWrapper*)rewriterWrapperPtr;
+  ModuleMetadata* module_metadata = GetMetadata();
 
-  *instruction = rewriterWrapper->CallMember(endMethodSpec, false);
+  // void EnterAsyncMethod<TIntegration, TTarget>(int state)
+  if (enterAsyncMemberRef == mdMemberRefNil) {
+    COR_SIGNATURE signature[] = {IMAGE_CEE_CS_CALLCONV_GENERIC, 0x02, 0x01,
+                                 ELEMENT_TYPE_VOID, ELEMENT_TYPE_I4};
+
+    hr = module_metadata->metadata_emit->DefineMemberRef(
+        callTargetTypeRef,
+        managed_profiler_calltarget_enterasyncmethod_name.data(), signature,
+        sizeof(signature), &enterAsyncMemberRef);
+    if (FAILED(hr)) {
+      Warn("Wrapper enterAsyncMemberRef could not be defined.");
+      return hr;
+    }
+  }
+
+  mdMethodSpec enterAsyncMethodSpec = mdMethodSpecNil;
+  hr = DefineInvokerMethodSpec(enterAsyncMemberRef, integrationTypeRef,
+                               currentType, nullptr, 0,
+                               &enterAsyncMethodSpec);
+  if (FAILED(hr)) {
+    Warn("Error creating enter async method spec.");
+    return hr;
+  }
+
+  *instruction = rewriterWrapper->CallMember(enterAsyncMethodSpec, false);
+  return S_OK;
+}
+
+HRESULT CallTargetTokens::WriteEndAsyncMethodResult(
+    void* rewriterWrapperPtr, mdTypeRef integrationTypeRef,
+    const TypeInfo* currentType, PCCOR_SIGNATURE resultSignature,
+    ULONG resultSignatureLength, ILInstr** instruction) {
+  auto hr = EnsureBaseCalltargetTokens();
+  if (FAILED(hr)) {
+    return hr;
+  }
+  ILRewriterWrapper* rewriterWrapper = (ILRewriterWrapper*)rewriterWrapperPtr;
+  ModuleMetadata* module_metadata = GetMetadata();
+
+  // TResult EndAsyncMethodResult<TIntegration, TTarget, TResult>(TResult returnValue)
+  if (endAsyncResultMemberRef == mdMemberRefNil) {
+    COR_SIGNATURE signature[] = {IMAGE_CEE_CS_CALLCONV_GENERIC,
+                                 0x03,
+                                 0x01,
+                                 ELEMENT_TYPE_MVAR,
+                                 0x02,
+                                 ELEMENT_TYPE_MVAR,
+                                 0x02};
+
+    hr = module_metadata->metadata_emit->DefineMemberRef(
+        callTargetTypeRef,
+        managed_profiler_calltarget_endasyncmethodresult_name.data(),
+        signature, sizeof(signature), &endAsyncResultMemberRef);
+    if (FAILED(hr)) {
+      Warn("Wrapper endAsyncResultMemberRef could not be defined.");
+      return hr;
+    }
+  }
+
+  mdMethodSpec endAsyncResultMethodSpec = mdMethodSpecNil;
+  hr = DefineInvokerMethodSpec(endAsyncResultMemberRef, integrationTypeRef,
+                               currentType, resultSignature,
+                               resultSignatureLength,
+                               &endAsyncResultMethodSpec);
+  if (FAILED(hr)) {
+    Warn("Error creating end async method result method spec.");
+    return hr;
+  }
+
+  *instruction = rewriterWrapper->CallMember(endAsyncResultMethodSpec, false);
+  return S_OK;
+}
+
+HRESULT CallTargetTokens::WriteEndAsyncMethodVoid(
+    void* rewriterWrapperPtr, mdTypeRef integrationTypeRef,
+    const TypeInfo* currentType, ILInstr** instruction) {
+  auto hr = EnsureBaseCalltargetTokens();
+  if (FAILED(hr)) {
+    return hr;
+  }
+  ILRewriterWrapper* rewriterWrapper = (ILRewriterWrapper*)rewriterWrapperPtr;
+  ModuleMetadata* module_metadata = GetMetadata();
+
+  // void EndAsyncMethodVoid<TIntegration, TTarget>()
+  if (endAsyncVoidMemberRef == mdMemberRefNil) {
+    COR_SIGNATURE signature[] = {IMAGE_CEE_CS_CALLCONV_GENERIC, 0x02, 0x00,
+                                 ELEMENT_TYPE_VOID};
+
+    hr = module_metadata->metadata_emit->DefineMemberRef(
+        callTargetTypeRef,
+        managed_profiler_calltarget_endasyncmethodvoid_name.data(), signature,
+        sizeof(signature), &endAsyncVoidMemberRef);
+    if (FAILED(hr)) {
+      Warn("Wrapper endAsyncVoidMemberRef could not be defined.");
+      return hr;
+    }
+  }
+
+  mdMethodSpec endAsyncVoidMethodSpec = mdMethodSpecNil;
+  hr = DefineInvokerMethodSpec(endAsyncVoidMemberRef, integrationTypeRef,
+                               currentType, nullptr, 0,
+                               &endAsyncVoidMethodSpec);
+  if (FAILED(hr)) {
+    Warn("Error creating end async method void method spec.");
+    return hr;
+  }
+
+  *instruction = rewriterWrapper->CallMember(endAsyncVoidMethodSpec, false);
+  return S_OK;
+}
+
+HRESULT CallTargetTokens::WriteEndAsyncMethodException(
+    void* rewriterWrapperPtr, mdTypeRef integrationTypeRef,
+    const TypeInfo* currentType, PCCOR_SIGNATURE resultSignature,
+    ULONG resultSignatureLength, ILInstr** instruction) {
+  auto hr = EnsureBaseCalltargetTokens();
+  if (FAILED(hr)) {
+    return hr;
+  }
+  ILRewriterWrapper* rewriterWrapper = (ILRewriterWrapper*)rewriterWrapperPtr;
+  ModuleMetadata* module_metadata = GetMetadata();
+
+  // void EndAsyncMethodException<TIntegration, TTarget, TResult>(Exception exception)
+  if (endAsyncExceptionMemberRef == mdMemberRefNil) {
+    unsigned exTypeRefBuffer;
+    auto exTypeRefSize = CorSigCompressToken(exTypeRef, &exTypeRefBuffer);
+
+    auto signatureLength = 5 + exTypeRefSize;
+    SignatureBuffer signature(signatureLength);
+    unsigned offset = 0;
+
+    signature[offset++] = IMAGE_CEE_CS_CALLCONV_GENERIC;
+    signature[offset++] = 0x03;
+    signature[offset++] = 0x01;
+
+    signature[offset++] = ELEMENT_TYPE_VOID;
+    signature[offset++] = ELEMENT_TYPE_CLASS;
+    memcpy(&signature[offset], &exTypeRefBuffer, exTypeRefSize);
+    offset += exTypeRefSize;
+
+    hr = module_metadata->metadata_emit->DefineMemberRef(
+        callTargetTypeRef,
+        managed_profiler_calltarget_endasyncmethodexception_name.data(),
+        signature.data(), signatureLength, &endAsyncExceptionMemberRef);
+    if (FAILED(hr)) {
+      Warn("Wrapper endAsyncExceptionMemberRef could not be defined.");
+      return hr;
+    }
+  }
+
+  mdMethodSpec endAsyncExceptionMethodSpec = mdMethodSpecNil;
+  hr = DefineInvokerMethodSpec(endAsyncExceptionMemberRef, integrationTypeRef,
+                               currentType, resultSignature,
+                               resultSignatureLength,
+                               &endAsyncExceptionMethodSpec);
+  if (FAILED(hr)) {
+    Warn("Error creating end async method exception method spec.");
+    return hr;
+  }
+
+  *instruction =
+      rewriterWrapper->CallMember(endAsyncExceptionMethodSpec, false);
   return S_OK;
 }
 
@@ -1836,7 +2210,7 @@ HRESULT CallTargetTokens::WriteLogException(void* rewriterWrapperPtr,
     auto exTypeRefSize = CorSigCompressToken(exTypeRef, &exTypeRefBuffer);
 
     auto signatureLength = 5 + exTypeRefSize;
-    auto* signature = new COR_SIGNATURE[signatureLength];
+    SignatureBuffer signature(signatureLength);
     unsigned offset = 0;
 
     signature[offset++] = IMAGE_CEE_CS_CALLCONV_GENERIC;
@@ -1850,8 +2224,7 @@ HRESULT CallTargetTokens::WriteLogException(void* rewriterWrapperPtr,
 
     auto hr = module_metadata->metadata_emit->DefineMemberRef(
         callTargetTypeRef, managed_profiler_calltarget_logexception_name.data(),
-        signature, signatureLength, &logExceptionRef);
-    delete[] signature;
+        signature.data(), signatureLength, &logExceptionRef);
     if (FAILED(hr)) {
       Warn("Wrapper logExceptionRef could not be defined.");
       return hr;
@@ -1872,7 +2245,7 @@ HRESULT CallTargetTokens::WriteLogException(void* rewriterWrapperPtr,
       CorSigCompressToken(currentTypeRef, &currentTypeBuffer);
 
   auto signatureLength = 4 + integrationTypeSize + currentTypeSize;
-  auto* signature = new COR_SIGNATURE[signatureLength];
+  SignatureBuffer signature(signatureLength);
   unsigned offset = 0;
   signature[offset++] = IMAGE_CEE_CS_CALLCONV_GENERICINST;
   signature[offset++] = 0x02;
@@ -1889,9 +2262,8 @@ HRESULT CallTargetTokens::WriteLogException(void* rewriterWrapperPtr,
   memcpy(&signature[offset], &currentTypeBuffer, currentTypeSize);
   offset += currentTypeSize;
 
-  hr = module_metadata->metadata_emit->DefineMethodSpec(
-      logExceptionRef, signature, signatureLength, &logExceptionMethodSpec);
-  delete[] signature;
+  hr = GetOrDefineMethodSpec(
+      logExceptionRef, signature.data(), signatureLength, &logExceptionMethodSpec);
   if (FAILED(hr)) {
     Warn("Error creating log exception method spec.");
     return hr;
@@ -1915,7 +2287,7 @@ HRESULT CallTargetTokens::WriteCallTargetReturnGetReturnValue(
   mdMemberRef callTargetReturnGetValueMemberRef = mdMemberRefNil;
 
   auto signatureLength = 4;
-  auto* signature = new COR_SIGNATURE[signatureLength];
+  SignatureBuffer signature(signatureLength);
   unsigned offset = 0;
 
   signature[offset++] =
@@ -1926,8 +2298,7 @@ HRESULT CallTargetTokens::WriteCallTargetReturnGetReturnValue(
   hr = module_metadata->metadata_emit->DefineMemberRef(
       callTargetReturnTypeSpec,
       managed_profiler_calltarget_returntype_getreturnvalue_name.data(),
-      signature, signatureLength, &callTargetReturnGetValueMemberRef);
-  delete[] signature;
+      signature.data(), signatureLength, &callTargetReturnGetValueMemberRef);
   if (FAILED(hr)) {
     Warn("Wrapper callTargetReturnGetValueMemberRef could not be defined.");
     return mdMemberRefNil;
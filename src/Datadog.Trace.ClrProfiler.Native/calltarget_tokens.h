@@ -4,17 +4,48 @@
 #include <corhlpr.h>
 
 #include <mutex>
+#include <string>
 #include <unordered_map>
 #include <unordered_set>
+#include <vector>
 
 #include "clr_helpers.h"
 #include "com_ptr.h"
 #include "il_rewriter.h"
 #include "integration.h"
+#include "memory_counters.h"
 #include "string.h"  // NOLINT
 
 namespace trace {
 
+/// <summary>
+/// Fixed size buffer used to build signature blobs. Small signatures (almost all of them)
+/// live on the stack, the heap is only used for large generic instantiations.
+/// </summary>
+class SignatureBuffer {
+ private:
+  static const ULONG kInlineSize = 256;
+  COR_SIGNATURE inline_buffer[kInlineSize];
+  std::vector<COR_SIGNATURE> heap_buffer;
+  COR_SIGNATURE* buffer;
+
+ public:
+  explicit SignatureBuffer(ULONG size) {
+    if (size > kInlineSize) {
+      heap_buffer.resize(size);
+      buffer = heap_buffer.data();
+    } else {
+      buffer = inline_buffer;
+    }
+  }
+
+  SignatureBuffer(const SignatureBuffer&) = delete;
+  SignatureBuffer& operator=(const SignatureBuffer&) = delete;
+
+  COR_SIGNATURE* data() { return buffer; }
+  COR_SIGNATURE& operator[](ULONG index) { return buffer[index]; }
+};
+
 /// <summary>
 /// Class to control all the token references of the module where the calltarget will be called.
 /// Also provides useful helpers for the rewriting process
@@ -31,6 +62,18 @@ class CallTargetTokens {
   WSTRING managed_profiler_calltarget_logexception_name = "LogException"_W;
   WSTRING managed_profiler_calltarget_getdefaultvalue_name =
       "GetDefaultValue"_W;
+  WSTRING managed_profiler_calltarget_beginasyncstubmethod_name =
+      "BeginAsyncStubMethod"_W;
+  WSTRING managed_profiler_calltarget_endasyncstubmethod_name =
+      "EndAsyncStubMethod"_W;
+  WSTRING managed_profiler_calltarget_enterasyncmethod_name =
+      "EnterAsyncMethod"_W;
+  WSTRING managed_profiler_calltarget_endasyncmethodresult_name =
+      "EndAsyncMethodResult"_W;
+  WSTRING managed_profiler_calltarget_endasyncmethodvoid_name =
+      "EndAsyncMethodVoid"_W;
+  WSTRING managed_profiler_calltarget_endasyncmethodexception_name =
+      "EndAsyncMethodException"_W;
 
   WSTRING managed_profiler_calltarget_statetype =
       "Datadog.Trace.ClrProfiler.CallTarget.CallTargetState"_W;
@@ -74,17 +117,32 @@ class CallTargetTokens {
 
   mdMemberRef endVoidMemberRef = mdMemberRefNil;
 
+  mdMemberRef beginAsyncStubMemberRef = mdMemberRefNil;
+  mdMemberRef endReturnMemberRef = mdMemberRefNil;
+
+  mdMemberRef endAsyncStubMemberRef = mdMemberRefNil;
+  mdMemberRef enterAsyncMemberRef = mdMemberRefNil;
+  mdMemberRef endAsyncResultMemberRef = mdMemberRefNil;
+  mdMemberRef endAsyncVoidMemberRef = mdMemberRefNil;
+  mdMemberRef endAsyncExceptionMemberRef = mdMemberRefNil;
+
   mdMemberRef logExceptionRef = mdMemberRefNil;
 
   mdMemberRef callTargetStateTypeGetDefault = mdMemberRefNil;
   mdMemberRef callTargetReturnVoidTypeGetDefault = mdMemberRefNil;
   mdMemberRef getDefaultMemberRef = mdMemberRefNil;
 
+  // Per module caches of the generic instantiations emitted by the rewriter,
+  // keyed by the parent token and the signature blob.
+  std::mutex tokens_cache_lock;
+  std::unordered_map<std::string, mdMethodSpec> methodSpecs;
+  std::unordered_map<std::string, mdTypeSpec> typeSpecs;
+  std::unordered_map<mdTypeSpec, mdMemberRef> callTargetReturnTypeGetDefaultRefs;
+
   inline ModuleMetadata* GetMetadata() {
     return (ModuleMetadata*)module_metadata_ptr;
   }
   HRESULT EnsureCorLibTokens();
-  HRESULT EnsureBaseCalltargetTokens();
   mdTypeRef GetTargetStateTypeRef();
   mdTypeRef GetTargetVoidReturnTypeRef();
   mdTypeSpec GetTargetReturnValueTypeRef(
@@ -96,18 +154,38 @@ class CallTargetTokens {
   mdMethodSpec GetCallTargetDefaultValueMethodSpec(
       FunctionMethodArgument* methodArgument);
   mdToken GetCurrentTypeRef(const TypeInfo* currentType, bool& isValueType);
+  static std::string GetSignatureCacheKey(mdToken parent,
+                                          PCCOR_SIGNATURE signature,
+                                          ULONG signatureLength);
+  HRESULT GetOrDefineMethodSpec(mdToken parent, PCCOR_SIGNATURE signature,
+                                ULONG signatureLength,
+                                mdMethodSpec* methodSpec);
+  HRESULT GetOrDefineTypeSpec(PCCOR_SIGNATURE signature, ULONG signatureLength,
+                              mdTypeSpec* typeSpec);
+  HRESULT DefineInvokerMethodSpec(mdMemberRef invokerMemberRef,
+                                  mdTypeRef integrationTypeRef,
+                                  const TypeInfo* currentType,
+                                  PCCOR_SIGNATURE extraArgSignature,
+                                  ULONG extraArgSignatureLength,
+                                  mdMethodSpec* methodSpec);
 
   HRESULT ModifyLocalSig(ILRewriter* reWriter,
                          FunctionMethodArgument* methodReturnValue,
                          ULONG* callTargetStateIndex, ULONG* exceptionIndex,
                          ULONG* callTargetReturnIndex, ULONG* returnValueIndex,
                          mdToken* callTargetStateToken, mdToken* exceptionToken,
-                         mdToken* callTargetReturnToken);
+                         mdToken* callTargetReturnToken,
+                         ULONG* samplingFlagIndex);
 
  public:
   CallTargetTokens(void* module_metadata_ptr) {
     this->module_metadata_ptr = module_metadata_ptr;
+    TrackAllocation(MemoryCounter::CallTargetTokens, sizeof(CallTargetTokens));
+  }
+  ~CallTargetTokens() {
+    TrackDeallocation(MemoryCounter::CallTargetTokens, sizeof(CallTargetTokens));
   }
+  HRESULT EnsureBaseCalltargetTokens();
   mdTypeRef GetObjectTypeRef();
   mdTypeRef GetExceptionTypeRef();
   mdAssemblyRef GetCorLibAssemblyRef();
@@ -117,7 +195,8 @@ class CallTargetTokens {
       ULONG* callTargetStateIndex, ULONG* exceptionIndex,
       ULONG* callTargetReturnIndex, ULONG* returnValueIndex,
       mdToken* callTargetStateToken, mdToken* exceptionToken,
-      mdToken* callTargetReturnToken, ILInstr** firstInstruction);
+      mdToken* callTargetReturnToken, ILInstr** firstInstruction,
+      ULONG* samplingFlagIndex = nullptr);
 
   HRESULT WriteBeginMethodWithoutArguments(void* rewriterWrapperPtr,
                                            mdTypeRef integrationTypeRef,
@@ -181,6 +260,40 @@ class CallTargetTokens {
                                   FunctionMethodArgument* returnArgument,
                                   ILInstr** instruction);
 
+  HRESULT WriteBeginAsyncStubMemberRef(void* rewriterWrapperPtr,
+                                       mdTypeRef integrationTypeRef,
+                                       const TypeInfo* currentType,
+                                       ILInstr** instruction);
+
+  HRESULT WriteEndAsyncStubMemberRef(void* rewriterWrapperPtr,
+                                     mdTypeRef integrationTypeRef,
+                                     const TypeInfo* currentType,
+                                     ILInstr** instruction);
+
+  HRESULT WriteEnterAsyncMethod(void* rewriterWrapperPtr,
+                                mdTypeRef integrationTypeRef,
+                                const TypeInfo* currentType,
+                                ILInstr** instruction);
+
+  HRESULT WriteEndAsyncMethodResult(void* rewriterWrapperPtr,
+                                    mdTypeRef integrationTypeRef,
+                                    const TypeInfo* currentType,
+                                    PCCOR_SIGNATURE resultSignature,
+                                    ULONG resultSignatureLength,
+                                    ILInstr** instruction);
+
+  HRESULT WriteEndAsyncMethodVoid(void* rewriterWrapperPtr,
+                                  mdTypeRef integrationTypeRef,
+                                  const TypeInfo* currentType,
+                                  ILInstr** instruction);
+
+  HRESULT WriteEndAsyncMethodException(void* rewriterWrapperPtr,
+                                       mdTypeRef integrationTypeRef,
+                                       const TypeInfo* currentType,
+                                       PCCOR_SIGNATURE resultSignature,
+                                       ULONG resultSignatureLength,
+                                       ILInstr** instruction);
+
   HRESULT WriteLogException(void* rewriterWrapperPtr,
                             mdTypeRef integrationTypeRef,
                             const TypeInfo* currentType, ILInstr** instruction);
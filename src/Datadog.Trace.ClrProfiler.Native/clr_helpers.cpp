@@ -1,5 +1,6 @@
 #include "clr_helpers.h"
 
+#include <algorithm>
 #include <cstring>
 
 #include <set>
@@ -8,6 +9,7 @@
 #include "environment_variables.h"
 #include "logging.h"
 #include "macros.h"
+#include "metadata_cache.h"
 #include "pal.h"
 #include "sig_helpers.h"
 
@@ -111,7 +113,8 @@ std::vector<BYTE> GetSignatureByteRepresentation(
   return signature_data;
 }
 
-FunctionInfo GetFunctionInfo(const ComPtr<IMetaDataImport2>& metadata_import, const mdToken& token) {
+FunctionInfo GetFunctionInfo(const ComPtr<IMetaDataImport2>& metadata_import, const mdToken& token,
+                             MetadataCache* cache) {
   mdToken parent_token = mdTokenNil;
   mdToken method_spec_token = mdTokenNil;
   mdToken method_def_token = mdTokenNil;
@@ -145,7 +148,9 @@ FunctionInfo GetFunctionInfo(const ComPtr<IMetaDataImport2>& metadata_import, co
       if (FAILED(hr)) {
         return {};
       }
-      const auto generic_info = GetFunctionInfo(metadata_import, parent_token);
+      const auto generic_info =
+          cache != nullptr ? cache->GetFunctionInfo(parent_token)
+                           : GetFunctionInfo(metadata_import, parent_token);
       final_signature_bytes = generic_info.signature.data;
       method_spec_signature =
           GetSignatureByteRepresentation(raw_signature_len, raw_signature);
@@ -164,7 +169,9 @@ FunctionInfo GetFunctionInfo(const ComPtr<IMetaDataImport2>& metadata_import, co
   }
 
   // parent_token could be: TypeDef, TypeRef, TypeSpec, ModuleRef, MethodDef
-  const auto type_info = GetTypeInfo(metadata_import, parent_token);
+  const auto type_info = cache != nullptr
+                             ? cache->GetTypeInfo(parent_token)
+                             : GetTypeInfo(metadata_import, parent_token);
 
   if (is_generic) {
     // use the generic constructor and feed both method signatures
@@ -198,16 +205,16 @@ ModuleInfo GetModuleInfo(ICorProfilerInfo4* info, const ModuleID& module_id) {
     return {};
   }
   return {module_id, WSTRING(module_path), GetAssemblyInfo(info, assembly_id),
-          module_flags};
+          module_flags, base_load_address};
 }
 
 TypeInfo GetTypeInfo(const ComPtr<IMetaDataImport2>& metadata_import,
-                     const mdToken& token) {
+                     const mdToken& token, MetadataCache* cache) {
   mdToken parent_token = mdTokenNil;
   WCHAR type_name[kNameMaxSize]{};
   DWORD type_name_len = 0;
   DWORD type_flags;
-  TypeInfo* extendsInfo = nullptr;
+  std::shared_ptr<const TypeInfo> extendsInfo;
   mdToken type_extends = mdTokenNil;
   bool type_valueType = false;
   bool type_isGeneric = false;
@@ -221,7 +228,11 @@ TypeInfo GetTypeInfo(const ComPtr<IMetaDataImport2>& metadata_import,
                                             &type_name_len, &type_flags,
                                             &type_extends);
       if (type_extends != mdTokenNil) {
-        extendsInfo = new TypeInfo(GetTypeInfo(metadata_import, type_extends));
+        // The base type is shared with the cache entry of the base type token
+        extendsInfo = cache != nullptr
+                          ? cache->GetSharedTypeInfo(type_extends)
+                          : std::make_shared<const TypeInfo>(
+                                GetTypeInfo(metadata_import, type_extends));
         type_valueType = extendsInfo->name == "System.ValueType"_W ||
                          extendsInfo->name == "System.Enum"_W;
       }
@@ -244,7 +255,9 @@ TypeInfo GetTypeInfo(const ComPtr<IMetaDataImport2>& metadata_import,
       if (signature[0] & ELEMENT_TYPE_GENERICINST) {
         mdToken type_token;
         CorSigUncompressToken(&signature[2], &type_token);
-        const auto baseType = GetTypeInfo(metadata_import, type_token);
+        const auto baseType = cache != nullptr
+                                  ? cache->GetTypeInfo(type_token)
+                                  : GetTypeInfo(metadata_import, type_token);
         return {baseType.id, baseType.name, token, token_type,
                 baseType.extend_from, baseType.valueType, baseType.isGeneric};
       }
@@ -254,11 +267,9 @@ TypeInfo GetTypeInfo(const ComPtr<IMetaDataImport2>& metadata_import,
                                          &type_name_len);
       break;
     case mdtMemberRef:
-      return GetFunctionInfo(metadata_import, token).type;
-      break;
     case mdtMethodDef:
-      return GetFunctionInfo(metadata_import, token).type;
-      break;
+      return cache != nullptr ? cache->GetFunctionInfo(token).type
+                              : GetFunctionInfo(metadata_import, token).type;
   }
   if (FAILED(hr) || type_name_len == 0) {
     return {};
@@ -320,7 +331,7 @@ std::vector<IntegrationMethod> FlattenIntegrations(
           mr.wrapper_method.action == calltarget_modification_action;
 
       if (is_calltarget_enabled && isCallTargetIntegration) {
-        flattened.emplace_back(i.integration_name, mr);
+        flattened.emplace_back(i.integration_name, mr, i.sampling_rate);
       } else if (!is_calltarget_enabled && !isCallTargetIntegration) {
         flattened.emplace_back(i.integration_name, mr);
       }
@@ -368,10 +379,38 @@ bool AssemblyMeetsIntegrationRequirements(
 
 std::vector<IntegrationMethod> FilterIntegrationsByTarget(
     const std::vector<IntegrationMethod>& integration_methods,
-    const ComPtr<IMetaDataAssemblyImport>& assembly_import) {
+    const ComPtr<IMetaDataAssemblyImport>& assembly_import,
+    const MetadataReader& metadata_reader) {
   std::vector<IntegrationMethod> enabled;
 
-  const auto assembly_metadata = GetAssemblyImportMetadata(assembly_import);
+  AssemblyRow assembly_row;
+  const auto assembly_metadata =
+      metadata_reader.GetAssembly(&assembly_row)
+          ? AssemblyMetadata(0, ToWSTRING(assembly_row.name),
+                             TokenFromRid(1, mdtAssembly), assembly_row.major,
+                             assembly_row.minor, assembly_row.build,
+                             assembly_row.revision)
+          : GetAssemblyImportMetadata(assembly_import);
+
+  // The references are the same for every integration, read them once
+  std::vector<AssemblyMetadata> assembly_refs;
+  if (metadata_reader.IsValid()) {
+    const auto count = metadata_reader.GetRowCount(MetadataTable::AssemblyRef);
+    AssemblyRefRow row;
+    for (ULONG rid = 1; rid <= count; rid++) {
+      if (metadata_reader.GetAssemblyRef(rid, &row)) {
+        assembly_refs.emplace_back(0, ToWSTRING(row.name),
+                                   TokenFromRid(rid, mdtAssemblyRef),
+                                   row.major, row.minor, row.build,
+                                   row.revision);
+      }
+    }
+  } else {
+    for (auto& assembly_ref : EnumAssemblyRefs(assembly_import)) {
+      assembly_refs.push_back(
+          GetReferencedAssemblyMetadata(assembly_import, assembly_ref));
+    }
+  }
 
   for (auto& i : integration_methods) {
     bool found = false;
@@ -379,12 +418,11 @@ std::vector<IntegrationMethod> FilterIntegrationsByTarget(
                                              i.replacement)) {
       found = true;
     }
-    for (auto& assembly_ref : EnumAssemblyRefs(assembly_import)) {
-      const auto metadata_ref =
-          GetReferencedAssemblyMetadata(assembly_import, assembly_ref);
+    for (auto& metadata_ref : assembly_refs) {
       // Info(L"-- assembly ref: " , assembly_name , " to " , ref_name);
       if (AssemblyMeetsIntegrationRequirements(metadata_ref, i.replacement)) {
         found = true;
+        break;
       }
     }
     if (found) {
@@ -430,58 +468,87 @@ mdMethodSpec DefineMethodSpec(const ComPtr<IMetaDataEmit2>& metadata_emit,
   return spec;
 }
 
-bool DisableOptimizations() {
-  const auto disable_optimizations =
-      GetEnvironmentValue(environment::clr_disable_optimizations);
-
-  if (disable_optimizations == "1"_W ||
-      disable_optimizations == "true"_W) {
-    return true;
+HRESULT GetAsyncStateMachineMoveNext(
+    const ComPtr<IMetaDataImport2>& metadata_import,
+    const mdMethodDef method_def, mdTypeDef* state_machine_type_def,
+    mdMethodDef* move_next_method_def) {
+  const void* attribute_data = nullptr;
+  ULONG attribute_data_size = 0;
+  HRESULT hr = metadata_import->GetCustomAttributeByName(
+      method_def, async_state_machine_attribute_name.data(), &attribute_data,
+      &attribute_data_size);
+  if (hr != S_OK) {
+    return S_FALSE;
   }
 
-  // default to false: don't disable JIT optimizations
-  return false;
-}
-
-bool EnableInlining() {
-  const auto enable_inlining =
-      GetEnvironmentValue(environment::clr_enable_inlining);
-
-  if (enable_inlining == "1"_W || enable_inlining == "true"_W) {
-    return true;
+  // The attribute blob is the 0x0001 prolog followed by the state machine
+  // type name as a SerString: a compressed length and the UTF8 bytes.
+  // e.g. "Namespace.Type+<MethodAsync>d__3"
+  const auto blob = static_cast<PCCOR_SIGNATURE>(attribute_data);
+  if (attribute_data_size < 3 || blob[0] != 0x01 || blob[1] != 0x00 ||
+      blob[2] == 0xFF) {
+    return E_FAIL;
+  }
+  ULONG name_length = 0;
+  const auto name_length_size = CorSigUncompressData(&blob[2], &name_length);
+  if (2 + name_length_size + name_length > attribute_data_size) {
+    return E_FAIL;
+  }
+  const auto type_name = ToWSTRING(std::string(
+      reinterpret_cast<const char*>(&blob[2 + name_length_size]),
+      name_length));
+
+  // Resolve each nesting level of the reflection name
+  mdTypeDef type_def = mdTypeDefNil;
+  for (const auto& name_part : Split(type_name, '+')) {
+    mdTypeDef enclosing_type_def = type_def;
+    hr = metadata_import->FindTypeDefByName(
+        name_part.c_str(),
+        enclosing_type_def == mdTypeDefNil ? mdTokenNil : enclosing_type_def,
+        &type_def);
+    if (FAILED(hr)) {
+      Warn("GetAsyncStateMachineMoveNext: State machine type ", type_name,
+           " could not be found.");
+      return hr;
+    }
   }
 
-  // default to false: don't inline.
-  return false;
-}
-
-bool IsCallTargetEnabled() {
-  const auto calltarget_enabled =
-      GetEnvironmentValue(environment::calltarget_enabled);
-
-  if (calltarget_enabled == "1"_W || calltarget_enabled == "true"_W) {
-    return true;
+  HCORENUM method_enum = nullptr;
+  mdMethodDef move_next = mdMethodDefNil;
+  ULONG move_next_count = 0;
+  hr = metadata_import->EnumMethodsWithName(&method_enum, type_def,
+                                            async_state_machine_movenext_name.c_str(),
+                                            &move_next, 1, &move_next_count);
+  metadata_import->CloseEnum(method_enum);
+  if (FAILED(hr) || move_next_count == 0) {
+    Warn("GetAsyncStateMachineMoveNext: MoveNext method not found in ",
+         type_name);
+    return E_FAIL;
   }
 
-  // default to false: calltarget integrations are removed from the integrations.json
-  return false;
+  *state_machine_type_def = type_def;
+  *move_next_method_def = move_next;
+  return S_OK;
 }
 
 TypeInfo RetrieveTypeForSignature(
     const ComPtr<IMetaDataImport2>& metadata_import,
     const FunctionInfo& function_info, const size_t current_index,
-    ULONG& token_length) {
+    ULONG& token_length, MetadataCache* cache) {
   mdToken type_token;
   const auto type_token_start =
       PCCOR_SIGNATURE(&function_info.signature.data[current_index]);
   token_length = CorSigUncompressToken(type_token_start, &type_token);
-  auto type_data = GetTypeInfo(metadata_import, type_token);
-  return type_data;
+  if (cache != nullptr) {
+    return cache->GetTypeInfo(type_token);
+  }
+  return GetTypeInfo(metadata_import, type_token);
 }
 
 bool TryParseSignatureTypes(const ComPtr<IMetaDataImport2>& metadata_import,
                             const FunctionInfo& function_info,
-                            std::vector<WSTRING>& signature_result) {
+                            std::vector<WSTRING>& signature_result,
+                            MetadataCache* cache) {
   try {
     const auto signature_size = function_info.signature.data.size();
     const auto generic_count = function_info.signature.NumberOfTypeArguments();
@@ -586,7 +653,8 @@ bool TryParseSignatureTypes(const ComPtr<IMetaDataImport2>& metadata_import,
         case ELEMENT_TYPE_CLASS: {
           current_index++;
           auto type_data = RetrieveTypeForSignature(
-              metadata_import, function_info, current_index, token_length);
+              metadata_import, function_info, current_index, token_length,
+              cache);
 
           mdToken examined_type_token = type_data.id;
           auto examined_type_name = type_data.name;
@@ -603,8 +671,10 @@ bool TryParseSignatureTypes(const ComPtr<IMetaDataImport2>& metadata_import,
               break;
             }
 
-            auto nesting_type =
-                GetTypeInfo(metadata_import, potentialParentToken);
+            const auto nesting_type =
+                cache != nullptr
+                    ? cache->GetTypeInfo(potentialParentToken)
+                    : GetTypeInfo(metadata_import, potentialParentToken);
 
             examined_type_token = nesting_type.id;
             examined_type_name = nesting_type.name;
@@ -660,7 +730,8 @@ bool TryParseSignatureTypes(const ComPtr<IMetaDataImport2>& metadata_import,
           // skip past actual generic type token (probably a class)
           current_index++;
           const auto generic_type_data = RetrieveTypeForSignature(
-              metadata_import, function_info, current_index, token_length);
+              metadata_import, function_info, current_index, token_length,
+              cache);
           auto type_name = generic_type_data.name;
           current_type_name.append(type_name);
           current_type_name.append("<"_W);  // Begin generic args
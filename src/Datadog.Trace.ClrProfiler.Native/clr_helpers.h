@@ -4,15 +4,19 @@
 #include <corhlpr.h>
 #include <corprof.h>
 #include <functional>
+#include <memory>
 #include <utility>
 
 #include "com_ptr.h"
+#include "configuration.h"
 #include "integration.h"
+#include "metadata_reader.h"
 #include <set>
 #include "util.h"
 
 namespace trace {
 class ModuleMetadata;
+class MetadataCache;
 
 const size_t kNameMaxSize = 1024;
 const ULONG kEnumeratorMax = 256;
@@ -155,6 +159,20 @@ static Enumerator<mdMethodDef> EnumMethods(
       });
 }
 
+static Enumerator<mdMethodDef> EnumMethodsWithName(
+    const ComPtr<IMetaDataImport2>& metadata_import,
+    const mdToken& parent_token, const WSTRING& method_name) {
+  return Enumerator<mdMethodDef>(
+      [metadata_import, parent_token, method_name](
+          HCORENUM* ptr, mdMethodDef arr[], ULONG max, ULONG* cnt) -> HRESULT {
+        return metadata_import->EnumMethodsWithName(
+            ptr, parent_token, method_name.c_str(), arr, max, cnt);
+      },
+      [metadata_import](HCORENUM ptr) -> void {
+        metadata_import->CloseEnum(ptr);
+      });
+}
+
 static Enumerator<mdMemberRef> EnumMemberRefs(
     const ComPtr<IMetaDataImport2>& metadata_import,
     const mdToken& parent_token) {
@@ -277,10 +295,17 @@ struct ModuleInfo {
   const WSTRING path;
   const AssemblyInfo assembly;
   const DWORD flags;
+  const LPCBYTE base_load_address;
 
-  ModuleInfo() : id(0), path(""_W), assembly({}), flags(0) {}
-  ModuleInfo(ModuleID id, WSTRING path, AssemblyInfo assembly, DWORD flags)
-      : id(id), path(path), assembly(assembly), flags(flags) {}
+  ModuleInfo()
+      : id(0), path(""_W), assembly({}), flags(0), base_load_address(nullptr) {}
+  ModuleInfo(ModuleID id, WSTRING path, AssemblyInfo assembly, DWORD flags,
+             LPCBYTE base_load_address)
+      : id(id),
+        path(path),
+        assembly(assembly),
+        flags(flags),
+        base_load_address(base_load_address) {}
 
   bool IsValid() const { return id != 0; }
 
@@ -294,7 +319,7 @@ struct TypeInfo {
   const WSTRING name;
   const mdTypeSpec type_spec;
   const ULONG32 token_type;
-  const TypeInfo* extend_from;
+  const std::shared_ptr<const TypeInfo> extend_from;
   const bool valueType;
   const bool isGeneric;
 
@@ -307,7 +332,8 @@ struct TypeInfo {
         valueType(false),
         isGeneric(false) {}
   TypeInfo(mdToken id, WSTRING name, mdTypeSpec type_spec, ULONG32 token_type,
-           const TypeInfo* extend_from, bool valueType, bool isGeneric) 
+           std::shared_ptr<const TypeInfo> extend_from, bool valueType,
+           bool isGeneric)
       : id(id),
         name(name),
         type_spec(type_spec),
@@ -424,13 +450,16 @@ AssemblyMetadata GetReferencedAssemblyMetadata(
     const ComPtr<IMetaDataAssemblyImport>& assembly_import,
     const mdAssemblyRef& assembly_ref);
 
+// The referenced types and functions (parents, base types, generic
+// definitions) are resolved through the cache when one is given.
 FunctionInfo GetFunctionInfo(const ComPtr<IMetaDataImport2>& metadata_import,
-                             const mdToken& token);
+                             const mdToken& token,
+                             MetadataCache* cache = nullptr);
 
 ModuleInfo GetModuleInfo(ICorProfilerInfo4* info, const ModuleID& module_id);
 
 TypeInfo GetTypeInfo(const ComPtr<IMetaDataImport2>& metadata_import,
-                     const mdToken& token);
+                     const mdToken& token, MetadataCache* cache = nullptr);
 
 mdAssemblyRef FindAssemblyRef(
     const ComPtr<IMetaDataAssemblyImport>& assembly_import,
@@ -453,10 +482,12 @@ std::vector<IntegrationMethod> FilterIntegrationsByCaller(
     const AssemblyInfo assembly);
 
 // FilterIntegrationsByTarget removes any integrations which have a target not
-// referenced by the module's assembly import
+// referenced by the module's assembly import. The assembly and its references
+// are read from the image when a valid metadata reader is given.
 std::vector<IntegrationMethod> FilterIntegrationsByTarget(
     const std::vector<IntegrationMethod>& integration_methods,
-    const ComPtr<IMetaDataAssemblyImport>& assembly_import);
+    const ComPtr<IMetaDataAssemblyImport>& assembly_import,
+    const MetadataReader& metadata_reader = MetadataReader());
 
 // FilterIntegrationsByTargetAssemblyName removes any integrations which target any
 // of the specified assemblies
@@ -468,13 +499,18 @@ mdMethodSpec DefineMethodSpec(const ComPtr<IMetaDataEmit2>& metadata_emit,
                               const mdToken& token,
                               const MethodSignature& signature);
 
-bool DisableOptimizations();
-bool EnableInlining();
-bool IsCallTargetEnabled();
+// GetAsyncStateMachineMoveNext resolves the MoveNext method of the compiler
+// generated state machine referenced by the AsyncStateMachineAttribute of an
+// async method. Returns S_FALSE if the method is not an async method.
+HRESULT GetAsyncStateMachineMoveNext(
+    const ComPtr<IMetaDataImport2>& metadata_import,
+    const mdMethodDef method_def, mdTypeDef* state_machine_type_def,
+    mdMethodDef* move_next_method_def);
 
 bool TryParseSignatureTypes(const ComPtr<IMetaDataImport2>& metadata_import,
                          const FunctionInfo& function_info,
-                         std::vector<WSTRING>& signature_result);
+                         std::vector<WSTRING>& signature_result,
+                         MetadataCache* cache = nullptr);
 
 HRESULT CreateAssemblyRefToMscorlib(
     const ComPtr<IMetaDataAssemblyEmit>& assembly_emit,
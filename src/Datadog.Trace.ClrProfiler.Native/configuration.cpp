@@ -0,0 +1,193 @@
+#include "configuration.h"
+
+#include <algorithm>
+#include <fstream>
+#include <mutex>
+#include <unordered_map>
+
+#include "dd_profiler_constants.h"
+#include "environment_variables.h"
+#include "logging.h"
+#include "util.h"
+
+namespace trace {
+
+namespace {
+
+std::mutex configuration_lock;
+std::shared_ptr<const Configuration> current_configuration;
+
+// Values of the environment, then of the configuration file
+class ConfigurationSource {
+ private:
+  std::unordered_map<WSTRING, WSTRING> file_values_;
+
+ public:
+  explicit ConfigurationSource(const WSTRING& file_path) {
+    if (file_path.empty()) {
+      return;
+    }
+
+    // NAME=value lines, # starts a comment
+    std::ifstream stream(ToString(file_path));
+    if (!stream) {
+      Warn("Failed to read the configuration file ", file_path);
+      return;
+    }
+
+    std::string line;
+    while (std::getline(stream, line)) {
+      const auto trimmed = Trim(ToWSTRING(line));
+      const auto separator = trimmed.find('=');
+      if (trimmed.empty() || trimmed[0] == '#' ||
+          separator == WSTRING::npos) {
+        continue;
+      }
+      file_values_[Trim(trimmed.substr(0, separator))] =
+          Trim(trimmed.substr(separator + 1));
+    }
+  }
+
+  WSTRING GetValue(const WSTRING& name) const {
+    auto value = GetEnvironmentValue(name);
+    if (value.empty()) {
+      const auto search = file_values_.find(name);
+      if (search != file_values_.end()) {
+        value = search->second;
+      }
+    }
+    return value;
+  }
+
+  std::vector<WSTRING> GetValues(const WSTRING& name) const {
+    std::vector<WSTRING> values;
+    for (auto value : Split(GetValue(name), L';')) {
+      value = Trim(value);
+      if (!value.empty()) {
+        values.push_back(value);
+      }
+    }
+    return values;
+  }
+
+  // "1" and "true" enable, "0" and "false" disable, anything else is the
+  // default
+  bool GetBool(const WSTRING& name, bool default_value) const {
+    const auto value = GetValue(name);
+    if (value == "1"_W || value == "true"_W) {
+      return true;
+    }
+    if (value == "0"_W || value == "false"_W) {
+      return false;
+    }
+    return default_value;
+  }
+
+  ULONG GetULong(const WSTRING& name, ULONG default_value,
+                 ULONG max_value) const {
+    const auto value = GetValue(name);
+    if (!value.empty()) {
+      try {
+        return std::min(static_cast<ULONG>(std::stoul(ToString(value))),
+                        max_value);
+      } catch (...) {
+        Warn("Invalid value for ", name, ": ", value);
+      }
+    }
+    return default_value;
+  }
+};
+
+Configuration ReadConfiguration() {
+  Configuration configuration;
+  configuration.config_file =
+      GetEnvironmentValue(environment::clr_config_file);
+  const ConfigurationSource source(configuration.config_file);
+
+  configuration.tracing_enabled =
+      source.GetBool(environment::tracing_enabled, true);
+  configuration.debug_enabled =
+      source.GetBool(environment::debug_enabled, false);
+  configuration.dump_il_rewrite_enabled =
+      source.GetBool(environment::dump_il_rewrite_enabled, false);
+
+  configuration.include_process_names =
+      source.GetValues(environment::include_process_names);
+  configuration.exclude_process_names =
+      source.GetValues(environment::exclude_process_names);
+
+  configuration.azure_app_services =
+      source.GetValue(environment::azure_app_services) == "1"_W;
+  configuration.azure_app_services_app_pool_id =
+      source.GetValue(environment::azure_app_services_app_pool_id);
+  configuration.azure_app_services_cli_telemetry_profile_value =
+      source.GetValue(
+          environment::azure_app_services_cli_telemetry_profile_value);
+
+  configuration.integrations_paths =
+      source.GetValues(environment::integrations_path);
+  configuration.disabled_integrations =
+      source.GetValues(environment::disabled_integrations);
+  configuration.netstandard_enabled =
+      source.GetBool(environment::netstandard_enabled, false);
+
+  configuration.calltarget_enabled =
+      source.GetBool(environment::calltarget_enabled, false);
+  configuration.calltarget_async_state_machine_enabled = source.GetBool(
+      environment::calltarget_async_state_machine_enabled, false);
+
+  configuration.inlining_enabled =
+      source.GetBool(environment::clr_enable_inlining, false);
+  configuration.optimizations_disabled =
+      source.GetBool(environment::clr_disable_optimizations, false);
+  configuration.il_optimizations_enabled =
+      source.GetBool(environment::clr_enable_il_optimizations, false);
+  configuration.domain_neutral_instrumentation =
+      source.GetBool(environment::domain_neutral_instrumentation, false);
+
+  configuration.skip_assembly_prefixes =
+      source.GetValues(environment::clr_skip_assembly_prefixes);
+  configuration.skip_assemblies =
+      source.GetValues(environment::clr_skip_assemblies);
+
+  configuration.module_analysis_threads =
+      source.GetULong(environment::clr_module_analysis_threads,
+                      kDefaultModuleAnalysisThreads, kMaxModuleAnalysisThreads);
+  configuration.instrumentation_plan_cache =
+      source.GetValue(environment::clr_instrumentation_plan_cache);
+  configuration.rewrite_quarantine_path =
+      source.GetValue(environment::clr_rewrite_quarantine_path);
+  configuration.managed_loader_directory =
+      source.GetValue(environment::clr_managed_loader_directory);
+  configuration.callback_recording_path =
+      source.GetValue(environment::clr_callback_recording_path);
+
+  for (auto&& name : env_vars_to_display) {
+    configuration.displayed_values.emplace_back(name, source.GetValue(name));
+  }
+
+  return configuration;
+}
+
+}  // namespace
+
+std::shared_ptr<const Configuration> LoadConfiguration() {
+  const auto configuration =
+      std::make_shared<const Configuration>(ReadConfiguration());
+
+  std::lock_guard<std::mutex> guard(configuration_lock);
+  current_configuration = configuration;
+  return configuration;
+}
+
+std::shared_ptr<const Configuration> GetConfiguration() {
+  {
+    std::lock_guard<std::mutex> guard(configuration_lock);
+    if (current_configuration != nullptr) {
+      return current_configuration;
+    }
+  }
+  return LoadConfiguration();
+}
+
+}  // namespace trace
@@ -0,0 +1,73 @@
+#ifndef DD_CLR_PROFILER_CONFIGURATION_H_
+#define DD_CLR_PROFILER_CONFIGURATION_H_
+
+#include <corhlpr.h>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "string.h"
+
+namespace trace {
+
+const ULONG kDefaultModuleAnalysisThreads = 2;
+const ULONG kMaxModuleAnalysisThreads = 16;
+
+/// <summary>
+/// The settings of the profiler, parsed once from the environment variables
+/// and the optional configuration file (DD_CLR_CONFIG_FILE). Environment
+/// variables take precedence over the file. A snapshot is never modified, the
+/// feature checks read its fields instead of the environment.
+/// </summary>
+struct Configuration {
+  bool tracing_enabled = true;
+  bool debug_enabled = false;
+  bool dump_il_rewrite_enabled = false;
+
+  std::vector<WSTRING> include_process_names{};
+  std::vector<WSTRING> exclude_process_names{};
+
+  bool azure_app_services = false;
+  WSTRING azure_app_services_app_pool_id{};
+  WSTRING azure_app_services_cli_telemetry_profile_value{};
+
+  std::vector<WSTRING> integrations_paths{};
+  std::vector<WSTRING> disabled_integrations{};
+  bool netstandard_enabled = false;
+
+  bool calltarget_enabled = false;
+  bool calltarget_async_state_machine_enabled = false;
+
+  bool inlining_enabled = false;
+  bool optimizations_disabled = false;
+  bool il_optimizations_enabled = false;
+  bool domain_neutral_instrumentation = false;
+
+  // Skipped in addition to skip_assembly_prefixes and skip_assemblies
+  std::vector<WSTRING> skip_assembly_prefixes{};
+  std::vector<WSTRING> skip_assemblies{};
+
+  ULONG module_analysis_threads = kDefaultModuleAnalysisThreads;
+  WSTRING instrumentation_plan_cache{};
+  WSTRING rewrite_quarantine_path{};
+  WSTRING managed_loader_directory{};
+  WSTRING callback_recording_path{};
+
+  // The configuration file the settings were read from, if any
+  WSTRING config_file{};
+  // Raw values of the settings listed in env_vars_to_display, for the logs
+  std::vector<std::pair<WSTRING, WSTRING>> displayed_values{};
+};
+
+// Reads the configuration and makes it the snapshot returned by
+// GetConfiguration()
+std::shared_ptr<const Configuration> LoadConfiguration();
+
+// The current snapshot, the configuration is loaded on first use. Callers
+// should keep the returned pointer for the duration of an operation instead of
+// calling it again, so they see consistent settings.
+std::shared_ptr<const Configuration> GetConfiguration();
+
+}  // namespace trace
+
+#endif  // DD_CLR_PROFILER_CONFIGURATION_H_
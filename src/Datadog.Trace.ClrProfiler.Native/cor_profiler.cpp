@@ -1,6 +1,11 @@
 #include "cor_profiler.h"
 
 #include <corprof.h>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
 #include <string>
 #include "corhlpr.h"
 
@@ -34,37 +39,30 @@ CorProfiler* profiler = nullptr;
 //
 HRESULT STDMETHODCALLTYPE
 CorProfiler::Initialize(IUnknown* cor_profiler_info_unknown) {
-  // check if debug mode is enabled
-  const auto debug_enabled_value =
-      GetEnvironmentValue(environment::debug_enabled);
+  // read the environment and the configuration file once, the rest of the
+  // profiler only reads this snapshot
+  configuration_ = LoadConfiguration();
 
-  if (debug_enabled_value == "1"_W || debug_enabled_value == "true"_W) {
+  // check if debug mode is enabled
+  if (configuration_->debug_enabled) {
     debug_logging_enabled = true;
   }
 
   // check if dump il rewrite is enabled
-  const auto dump_il_rewrite_enabled_value = 
-      GetEnvironmentValue(environment::dump_il_rewrite_enabled);
-
-  if (dump_il_rewrite_enabled_value == "1"_W ||
-      dump_il_rewrite_enabled_value == "true"_W) {
+  if (configuration_->dump_il_rewrite_enabled) {
     dump_il_rewrite_enabled = true;
   }
 
   CorProfilerBase::Initialize(cor_profiler_info_unknown);
 
   // check if tracing is completely disabled
-  const WSTRING tracing_enabled =
-      GetEnvironmentValue(environment::tracing_enabled);
-
-  if (tracing_enabled == "0"_W || tracing_enabled == "false"_W) {
+  if (!configuration_->tracing_enabled) {
     Info("DATADOG TRACER DIAGNOSTICS - Profiler disabled in ", environment::tracing_enabled);
     return E_FAIL;
   }
 
   const auto process_name = GetCurrentProcessName();
-  const auto include_process_names =
-      GetEnvironmentValues(environment::include_process_names);
+  const auto& include_process_names = configuration_->include_process_names;
 
   // if there is a process inclusion list, attach profiler only if this
   // process's name is on the list
@@ -75,8 +73,7 @@ CorProfiler::Initialize(IUnknown* cor_profiler_info_unknown) {
     return E_FAIL;
   }
 
-  const auto exclude_process_names =
-      GetEnvironmentValues(environment::exclude_process_names);
+  const auto& exclude_process_names = configuration_->exclude_process_names;
 
   // attach profiler only if this process's name is NOT on the list
   if (Contains(exclude_process_names, process_name)) {
@@ -93,24 +90,29 @@ CorProfiler::Initialize(IUnknown* cor_profiler_info_unknown) {
     return E_FAIL;
   }
 
+  if (!configuration_->callback_recording_path.empty()) {
+    callback_recorder = new CallbackRecorder(this->info_, configuration_->callback_recording_path);
+    if (callback_recorder->IsOpen()) {
+      Info("Recording the profiler callbacks to ", configuration_->callback_recording_path);
+    }
+  }
+
   Info("Environment variables:");
 
-  for (auto&& env_var : env_vars_to_display) {
-    WSTRING env_var_value = GetEnvironmentValue(env_var);
-    if (debug_logging_enabled || !env_var_value.empty()) {
-      Info("  ", env_var, "=", env_var_value);
+  for (auto&& displayed_value : configuration_->displayed_values) {
+    if (debug_logging_enabled || !displayed_value.second.empty()) {
+      Info("  ", displayed_value.first, "=", displayed_value.second);
     }
   }
+  if (!configuration_->config_file.empty()) {
+    Info("Settings not in the environment are read from ", configuration_->config_file);
+  }
 
-  const WSTRING azure_app_services_value =
-      GetEnvironmentValue(environment::azure_app_services);
-
-  if (azure_app_services_value == "1"_W) {
+  if (configuration_->azure_app_services) {
     Info("Profiler is operating within Azure App Services context.");
     in_azure_app_services = true;
 
-    const auto app_pool_id_value =
-        GetEnvironmentValue(environment::azure_app_services_app_pool_id);
+    const auto& app_pool_id_value = configuration_->azure_app_services_app_pool_id;
 
     if (app_pool_id_value.size() > 1 && app_pool_id_value.at(0) == '~') {
       Info("DATADOG TRACER DIAGNOSTICS - Profiler disabled: ", environment::azure_app_services_app_pool_id,
@@ -119,8 +121,8 @@ CorProfiler::Initialize(IUnknown* cor_profiler_info_unknown) {
       return E_FAIL;
     }
 
-    const auto cli_telemetry_profile_value = GetEnvironmentValue(
-        environment::azure_app_services_cli_telemetry_profile_value);
+    const auto& cli_telemetry_profile_value =
+        configuration_->azure_app_services_cli_telemetry_profile_value;
 
     if (cli_telemetry_profile_value == "AzureKudu"_W) {
       Info("DATADOG TRACER DIAGNOSTICS - Profiler disabled: ", app_pool_id_value,
@@ -129,60 +131,69 @@ CorProfiler::Initialize(IUnknown* cor_profiler_info_unknown) {
     }
   }
 
-  // get path to integration definition JSON files
-  const WSTRING integrations_paths =
-      GetEnvironmentValue(environment::integrations_path);
+  assembly_classifier = new AssemblyClassifier(AssemblyClassifier::CreateDefault(*configuration_));
+  managed_profiler_reference_info = new AssemblyReferenceInfo(managed_profiler_full_assembly_version);
 
-  if (integrations_paths.empty()) {
+  // get path to integration definition JSON files
+  if (configuration_->integrations_paths.empty()) {
     Warn("DATADOG TRACER DIAGNOSTICS - Profiler disabled: ", environment::integrations_path,
          " environment variable not set.");
     return E_FAIL;
   }
 
-  const auto is_calltarget_enabled = IsCallTargetEnabled();
+  const auto is_calltarget_enabled = configuration_->calltarget_enabled;
 
   // Initialize ReJIT handler and define the Rewriter Callback
   if (is_calltarget_enabled) {
       rejit_handler = new RejitHandler(this->info_, [this](RejitHandlerModule* mod, RejitHandlerModuleMethod* method) {
           return this->CallTarget_RewriterCallback(mod, method);
       });
+      rewrite_quarantine = new RewriteQuarantine(configuration_->rewrite_quarantine_path, ToWSTRING(PROFILER_VERSION));
+
+      const auto analysis_threads = configuration_->module_analysis_threads;
+      if (analysis_threads > 0) {
+        Info("Analyzing modules on ", analysis_threads, " background threads.");
+        module_analysis_pool = new ModuleAnalysisPool(this->info_, analysis_threads, [this](ModuleID module_id) {
+          ModuleMetadata* module_metadata = nullptr;
+          {
+            // the module can't be unloaded once the analysis is claimed
+            const auto guard = LockModuleMap();
+            const auto search = module_id_to_info_map_.find(module_id);
+            if (!is_attached_ || search == module_id_to_info_map_.end() ||
+                !search->second->analysis.TryBegin()) {
+              return;
+            }
+            module_metadata = search->second;
+          }
+
+          this->CallTarget_AnalyzeModule(module_id, module_metadata);
+          module_metadata->analysis.End();
+        });
+      }
   } else {
       rejit_handler = nullptr;
   }
 
-  // load all available integrations from JSON files
-  const std::vector<Integration> all_integrations =
-      LoadIntegrationsFromEnvironment();
+  // Only the names and target assemblies of the integrations are read here,
+  // the methods of an integration are parsed when a module referencing one of
+  // its target assemblies is loaded
+  integration_directory = new IntegrationDirectory(
+      LoadIntegrationDefinitions(*configuration_), is_calltarget_enabled,
+      configuration_->netstandard_enabled);
 
-  // get list of disabled integration names
-  const std::vector<WSTRING> disabled_integration_names =
-      GetEnvironmentValues(environment::disabled_integrations);
-
-  // remove disabled integrations
-  const std::vector<Integration> integrations =
-      FilterIntegrationsByName(all_integrations, disabled_integration_names);
-
-  integration_methods_ =
-      FlattenIntegrations(integrations, is_calltarget_enabled);
-
-    // check if there are any enabled integrations left
-  if (integration_methods_.empty()) {
+  // check if there are any enabled integrations left
+  if (integration_directory->GetIntegrationCount() == 0) {
     Warn("DATADOG TRACER DIAGNOSTICS - Profiler disabled: no enabled integrations found.");
     return E_FAIL;
   } else {
-    Debug("Number of Integrations loaded: ", integration_methods_.size());
+    Debug("Number of Integrations loaded: ", integration_directory->GetIntegrationCount());
   }
 
-  const WSTRING netstandard_enabled =
-      GetEnvironmentValue(environment::netstandard_enabled);
-
-  // temporarily skip the calls into netstandard.dll that were added in
-  // https://github.com/DataDog/dd-trace-dotnet/pull/753.
-  // users can opt-in to the additional instrumentation by setting environment
-  // variable DD_TRACE_NETSTANDARD_ENABLED
-  if (netstandard_enabled != "1"_W && netstandard_enabled != "true"_W) {
-    integration_methods_ = FilterIntegrationsByTargetAssemblyName(
-        integration_methods_, {"netstandard"_W});
+  const WSTRING& instrumentation_plan_cache_directory =
+      configuration_->instrumentation_plan_cache;
+  if (!instrumentation_plan_cache_directory.empty()) {
+    Info("Instrumentation plans are cached in ", instrumentation_plan_cache_directory);
+    instrumentation_plan_cache = new InstrumentationPlanCache(instrumentation_plan_cache_directory);
   }
 
   DWORD event_mask = COR_PRF_MONITOR_JIT_COMPILATION |
@@ -198,22 +209,23 @@ CorProfiler::Initialize(IUnknown* cor_profiler_info_unknown) {
     Info("CallTarget instrumentation is disabled.");
   }
   
-  if (!EnableInlining()) {
+  if (!configuration_->inlining_enabled) {
     Info("JIT Inlining is disabled.");
     event_mask |= COR_PRF_DISABLE_INLINING;
   } else {
     Info("JIT Inlining is enabled.");
   }
 
-  if (DisableOptimizations()) {
+  if (configuration_->il_optimizations_enabled) {
+    Info("IL peephole optimizations are enabled.");
+  }
+
+  if (configuration_->optimizations_disabled) {
     Info("Disabling all code optimizations.");
     event_mask |= COR_PRF_DISABLE_OPTIMIZATIONS;
   }
 
-  const WSTRING domain_neutral_instrumentation =
-      GetEnvironmentValue(environment::domain_neutral_instrumentation);
-
-  if (domain_neutral_instrumentation == "1"_W || domain_neutral_instrumentation == "true"_W) {
+  if (configuration_->domain_neutral_instrumentation) {
     instrument_domain_neutral_assemblies = true;
   }
 
@@ -233,8 +245,7 @@ CorProfiler::Initialize(IUnknown* cor_profiler_info_unknown) {
     hr = this->info_->SetEventMask(event_mask);
 
     if (instrument_domain_neutral_assemblies) {
-      Info("Detected environment variable ", environment::domain_neutral_instrumentation,
-          "=", domain_neutral_instrumentation);
+      Info("Detected ", environment::domain_neutral_instrumentation, " enabled.");
       Info("Enabling automatic instrumentation of methods called from domain-neutral assemblies. ",
           "Please ensure that there is only one AppDomain or, if applications are being hosted in IIS, ",
           "ensure that all Application Pools have at most one application each. ",
@@ -270,6 +281,10 @@ CorProfiler::Initialize(IUnknown* cor_profiler_info_unknown) {
 
 HRESULT STDMETHODCALLTYPE CorProfiler::AssemblyLoadFinished(AssemblyID assembly_id,
     HRESULT hr_status) {
+  RecordedCallback recorded(callback_recorder, CallbackKind::AssemblyLoadFinished);
+  recorded.record.id = assembly_id;
+  recorded.record.hr_status = hr_status;
+
   if (FAILED(hr_status)) {
     // if assembly failed to load, skip it entirely,
     // otherwise we can crash the process if module is not valid
@@ -287,7 +302,7 @@ HRESULT STDMETHODCALLTYPE CorProfiler::AssemblyLoadFinished(AssemblyID assembly_
 
   // keep this lock until we are done using the module,
   // to prevent it from unloading while in use
-  std::lock_guard<std::mutex> guard(module_id_to_info_map_lock_);
+  const auto guard = LockModuleMap();
 
   // double check if is_attached_ has changed to avoid possible race condition with shutdown function
   if (!is_attached_) {
@@ -354,6 +369,11 @@ HRESULT STDMETHODCALLTYPE CorProfiler::AssemblyLoadFinished(AssemblyID assembly_
 
 HRESULT STDMETHODCALLTYPE CorProfiler::ModuleLoadFinished(ModuleID module_id,
                                                           HRESULT hr_status) {
+  RecordedCallback recorded(callback_recorder, CallbackKind::ModuleLoadFinished);
+  recorded.record.module_id = module_id;
+  recorded.record.hr_status = hr_status;
+  ScopedLatency latency(metrics_, TimedOperation::ModuleLoadFinished);
+
   if (FAILED(hr_status)) {
     // if module failed to load, skip it entirely,
     // otherwise we can crash the process if module is not valid
@@ -367,7 +387,7 @@ HRESULT STDMETHODCALLTYPE CorProfiler::ModuleLoadFinished(ModuleID module_id,
 
   // keep this lock until we are done using the module,
   // to prevent it from unloading while in use
-  std::lock_guard<std::mutex> guard(module_id_to_info_map_lock_);
+  const auto guard = LockModuleMap();
 
   // double check if is_attached_ has changed to avoid possible race condition with shutdown function
   if (!is_attached_) {
@@ -442,32 +462,93 @@ HRESULT STDMETHODCALLTYPE CorProfiler::ModuleLoadFinished(ModuleID module_id,
     return S_OK;
   }
 
-  for (auto&& skip_assembly_pattern : skip_assembly_prefixes) {
-    if (module_info.assembly.name.rfind(skip_assembly_pattern, 0) == 0) {
+  switch (assembly_classifier->Classify(module_info.assembly.name)) {
+    case AssemblyClass::SkippedByPrefix:
       Debug("ModuleLoadFinished skipping module by pattern: ", module_id, " ",
             module_info.assembly.name);
       return S_OK;
-    }
-  }
-
-  for (auto&& skip_assembly : skip_assemblies) {
-    if (module_info.assembly.name == skip_assembly) {
+    case AssemblyClass::SkippedByName:
       Debug("ModuleLoadFinished skipping known module: ", module_id, " ",
             module_info.assembly.name);
       return S_OK;
-    }
+    default:
+      break;
   }
 
-  std::vector<IntegrationMethod> filtered_integrations =
-      FilterIntegrationsByCaller(integration_methods_, module_info.assembly);
+  // Zero-copy view of the image metadata for the bulk lookups below
+  const MetadataReader metadata_reader(module_info.base_load_address,
+                                       module_info.flags);
+  if (!metadata_reader.IsValid()) {
+    Debug("ModuleLoadFinished: metadata image not readable for ", module_id,
+          " ", module_info.assembly.name, ", using the metadata interfaces");
+  }
 
-  if (filtered_integrations.empty()) {
-    // we don't need to instrument anything in this module, skip it
-    Debug("ModuleLoadFinished skipping module (filtered by caller): ",
+  // don't skip Microsoft.AspNetCore.Hosting so we can run the startup hook and
+  // subscribe to DiagnosticSource events.
+  // don't skip Dapper: it makes ADO.NET calls even though it doesn't reference
+  // System.Data or System.Data.Common
+  const bool filter_by_target =
+      module_info.assembly.name != "Microsoft.AspNetCore.Hosting"_W &&
+      module_info.assembly.name != "Dapper"_W;
+
+  // Only the integrations targeting this module or one of its references can
+  // apply, the rest of the catalog is not looked at (nor parsed)
+  std::vector<ULONG> candidate_integrations;
+  if (!filter_by_target ||
+      !integration_directory->FindIntegrations(metadata_reader,
+                                               &candidate_integrations)) {
+    candidate_integrations = integration_directory->GetAllIntegrations();
+  } else if (candidate_integrations.empty()) {
+    Debug("ModuleLoadFinished skipping module (no integration targets it): ",
           module_id, " ", module_info.assembly.name);
     return S_OK;
   }
 
+  // Reuse the decisions taken for this module version by a previous process
+  // (or by the offline plan generator). The plans are keyed by the
+  // definitions of the candidate integrations, so a skipped module doesn't
+  // parse any of them.
+  GUID plan_module_version_id;
+  const bool use_instrumentation_plan =
+      instrumentation_plan_cache != nullptr &&
+      metadata_reader.GetModuleVersionId(&plan_module_version_id);
+  const auto candidates_hash =
+      use_instrumentation_plan
+          ? integration_directory->HashIntegrations(candidate_integrations)
+          : 0;
+  std::unique_ptr<InstrumentationPlan> instrumentation_plan;
+  std::vector<IntegrationMethod> filtered_integrations;
+  if (use_instrumentation_plan) {
+    instrumentation_plan.reset(new InstrumentationPlan());
+    if (!instrumentation_plan_cache->Load(plan_module_version_id,
+                                          candidates_hash,
+                                          instrumentation_plan.get()) ||
+        !ResolveInstrumentationPlan(*instrumentation_plan,
+                                    module_info.assembly.name,
+                                    &filtered_integrations)) {
+      instrumentation_plan.reset();
+      filtered_integrations.clear();
+    } else if (instrumentation_plan->skip_module) {
+      Debug("ModuleLoadFinished skipping module (instrumentation plan): ",
+            module_id, " ", module_info.assembly.name);
+      return S_OK;
+    }
+  }
+
+  if (instrumentation_plan == nullptr) {
+    filtered_integrations = FilterIntegrationsByCaller(
+        integration_directory->GetMethods(candidate_integrations,
+                                          module_info.assembly.name),
+        module_info.assembly);
+
+    if (filtered_integrations.empty()) {
+      // we don't need to instrument anything in this module, skip it
+      Debug("ModuleLoadFinished skipping module (filtered by caller): ",
+            module_id, " ", module_info.assembly.name);
+      return S_OK;
+    }
+  }
+
   ComPtr<IUnknown> metadata_interfaces;
   auto hr = this->info_->GetModuleMetaData(module_id, ofRead | ofWrite,
                                            IID_IMetaDataImport2,
@@ -488,19 +569,22 @@ HRESULT STDMETHODCALLTYPE CorProfiler::ModuleLoadFinished(ModuleID module_id,
   const auto assembly_emit =
       metadata_interfaces.As<IMetaDataAssemblyEmit>(IID_IMetaDataAssemblyEmit);
 
-  // don't skip Microsoft.AspNetCore.Hosting so we can run the startup hook and
-  // subscribe to DiagnosticSource events.
-  // don't skip Dapper: it makes ADO.NET calls even though it doesn't reference
-  // System.Data or System.Data.Common
-  if (module_info.assembly.name != "Microsoft.AspNetCore.Hosting"_W &&
-      module_info.assembly.name != "Dapper"_W) {
+  if (instrumentation_plan == nullptr && filter_by_target) {
     filtered_integrations =
-        FilterIntegrationsByTarget(filtered_integrations, assembly_import);
+        FilterIntegrationsByTarget(filtered_integrations, assembly_import,
+                                   metadata_reader);
 
     if (filtered_integrations.empty()) {
       // we don't need to instrument anything in this module, skip it
       Debug("ModuleLoadFinished skipping module (filtered by target): ",
             module_id, " ", module_info.assembly.name);
+
+      if (use_instrumentation_plan) {
+        InstrumentationPlan skip_plan;
+        skip_plan.skip_module = true;
+        StoreInstrumentationPlan(plan_module_version_id, candidates_hash,
+                                 filtered_integrations, skip_plan);
+      }
       return S_OK;
     }
   }
@@ -524,7 +608,10 @@ HRESULT STDMETHODCALLTYPE CorProfiler::ModuleLoadFinished(ModuleID module_id,
   ModuleMetadata* module_metadata = new ModuleMetadata(
       metadata_import, metadata_emit, assembly_import, assembly_emit,
       module_info.assembly.name, app_domain_id,
-      module_version_id, filtered_integrations, &corAssemblyProperty);
+      module_version_id, filtered_integrations, &corAssemblyProperty,
+      metadata_reader);
+  module_metadata->instrumentation_plan = std::move(instrumentation_plan);
+  module_metadata->candidate_integrations_hash = candidates_hash;
 
   // store module info for later lookup
   module_id_to_info_map_[module_id] = module_metadata;
@@ -534,15 +621,29 @@ HRESULT STDMETHODCALLTYPE CorProfiler::ModuleLoadFinished(ModuleID module_id,
         module_info.assembly.app_domain_id, " ",
         module_info.assembly.app_domain_name);
 
-  // We call the function to analyze the module and request the ReJIT of integrations defined in this module.
-  if (IsCallTargetEnabled()) {
-    CallTarget_RequestRejitForModule(module_id, module_metadata, filtered_integrations);
+  // We analyze the module and request the ReJIT of integrations defined in this module,
+  // in the background when possible so the module load is not blocked.
+  if (configuration_->calltarget_enabled) {
+    if (module_analysis_pool != nullptr) {
+      module_metadata->analysis.SetPending();
+      module_analysis_pool->Enqueue(module_id);
+    } else {
+      CallTarget_AnalyzeModule(module_id, module_metadata);
+    }
+  } else if (use_instrumentation_plan &&
+             module_metadata->instrumentation_plan == nullptr) {
+    InstrumentationPlan plan;
+    StoreInstrumentationPlan(module_version_id, candidates_hash,
+                             filtered_integrations, plan);
   }
 
   return S_OK;
 }
 
 HRESULT STDMETHODCALLTYPE CorProfiler::ModuleUnloadStarted(ModuleID module_id) {
+  RecordedCallback recorded(callback_recorder, CallbackKind::ModuleUnloadStarted);
+  recorded.record.module_id = module_id;
+
   if (!is_attached_) {
     return S_OK;
   }
@@ -561,7 +662,7 @@ HRESULT STDMETHODCALLTYPE CorProfiler::ModuleUnloadStarted(ModuleID module_id) {
 
   // take this lock so we block until the
   // module metadata is not longer being used
-  std::lock_guard<std::mutex> guard(module_id_to_info_map_lock_);
+  const auto guard = LockModuleMap();
 
   // double check if is_attached_ has changed to avoid possible race condition with shutdown function
   if (!is_attached_) {
@@ -579,22 +680,58 @@ HRESULT STDMETHODCALLTYPE CorProfiler::ModuleUnloadStarted(ModuleID module_id) {
     }
 
     module_id_to_info_map_.erase(module_id);
+
+    // drop a pending analysis or wait for the running one and its waiters
+    metadata->analysis.Cancel();
+
+    // free everything tied to the module: the ReJIT records of its methods,
+    // then the metadata with its CallTarget tokens
+    if (rejit_handler != nullptr) {
+      rejit_handler->RemoveModule(module_id);
+    }
     delete metadata;
+
+    if (debug_logging_enabled) {
+      Debug("ModuleUnloadStarted: native memory ", MemoryCountersStr());
+    }
   }
 
   return S_OK;
 }
 
 HRESULT STDMETHODCALLTYPE CorProfiler::Shutdown() {
+  // the recorder writes the Shutdown record and closes the trace
+  RecordedCallback recorded(callback_recorder, CallbackKind::Shutdown);
+
   CorProfilerBase::Shutdown();
 
+  // the workers take the module lock, stop them first
+  if (module_analysis_pool != nullptr) {
+    module_analysis_pool->Shutdown();
+  }
+
   // keep this lock until we are done using the module,
   // to prevent it from unloading while in use
-  std::lock_guard<std::mutex> guard(module_id_to_info_map_lock_);
+  const auto guard = LockModuleMap();
+
+  // ModuleLoadFinished checks the pool under the lock
+  delete module_analysis_pool;
+  module_analysis_pool = nullptr;
 
   if (rejit_handler != nullptr) {
     rejit_handler->Shutdown();
   }
+  if (rewrite_quarantine != nullptr && !rewrite_quarantine->GetMethods().empty()) {
+    Info("Quarantined CallTarget rewrites: ", rewrite_quarantine->GetMethods().size());
+  }
+  Info("Native memory of loaded modules: ", MemoryCountersStr());
+  if (integration_directory != nullptr) {
+    Info("Integrations loaded: ", integration_directory->GetMaterializedCount(), " of ",
+         integration_directory->GetIntegrationCount());
+  }
+  if (callback_recorder != nullptr) {
+    Info("Callbacks recorded: ", callback_recorder->GetRecordCount());
+  }
   Warn("Exiting.");
   is_attached_.store(false);
   Logger::Shutdown();
@@ -609,7 +746,7 @@ HRESULT STDMETHODCALLTYPE CorProfiler::ProfilerDetachSucceeded() {
 
   // keep this lock until we are done using the module,
   // to prevent it from unloading while in use
-  std::lock_guard<std::mutex> guard(module_id_to_info_map_lock_);
+  const auto guard = LockModuleMap();
 
   // double check if is_attached_ has changed to avoid possible race condition with shutdown function
   if (!is_attached_) {
@@ -618,19 +755,27 @@ HRESULT STDMETHODCALLTYPE CorProfiler::ProfilerDetachSucceeded() {
 
   Warn("Detaching profiler.");
   Logger::Instance()->Flush();
+  if (callback_recorder != nullptr) {
+    callback_recorder->Flush();
+  }
   is_attached_.store(false);
   return S_OK;
 }
 
 HRESULT STDMETHODCALLTYPE CorProfiler::JITCompilationStarted(
     FunctionID function_id, BOOL is_safe_to_block) {
+  RecordedCallback recorded(callback_recorder, CallbackKind::JITCompilationStarted);
+  recorded.record.id = function_id;
+  recorded.record.flag = is_safe_to_block;
+  ScopedLatency latency(metrics_, TimedOperation::JITCompilationStarted);
+
   if (!is_attached_ || !is_safe_to_block) {
     return S_OK;
   }
 
   // keep this lock until we are done using the module,
   // to prevent it from unloading while in use
-  std::lock_guard<std::mutex> guard(module_id_to_info_map_lock_);
+  auto guard = LockModuleMap();
 
   // double check if is_attached_ has changed to avoid possible race condition with shutdown function
   if (!is_attached_) {
@@ -661,8 +806,8 @@ HRESULT STDMETHODCALLTYPE CorProfiler::JITCompilationStarted(
   }
 
   // get function info
-  const auto caller =
-      GetFunctionInfo(module_metadata->metadata_import, function_token);
+  const auto& caller =
+      module_metadata->metadata_cache.GetFunctionInfo(function_token);
   if (!caller.IsValid()) {
     return S_OK;
   }
@@ -708,6 +853,11 @@ HRESULT STDMETHODCALLTYPE CorProfiler::JITCompilationStarted(
 
     first_jit_compilation_app_domains.insert(module_metadata->app_domain_id);
 
+    // the CallTarget analysis emits into the module metadata as well
+    if (!CallTarget_EnsureModuleAnalyzed(module_id, module_metadata, guard)) {
+      return S_OK;
+    }
+
     hr = RunILStartupHook(module_metadata->metadata_emit, module_id,
                           function_token);
 
@@ -742,6 +892,11 @@ HRESULT STDMETHODCALLTYPE CorProfiler::JITCompilationStarted(
     return S_OK;
   }
 
+  // only the callers with replacements emit, the others don't wait for the analysis
+  if (!CallTarget_EnsureModuleAnalyzed(module_id, module_metadata, guard)) {
+    return S_OK;
+  }
+
   // Perform method insertion calls
   hr = ProcessInsertionCalls(module_metadata,
                              function_id,
@@ -773,6 +928,12 @@ HRESULT STDMETHODCALLTYPE CorProfiler::JITCompilationStarted(
 
 HRESULT STDMETHODCALLTYPE CorProfiler::JITInlining(FunctionID callerId, 
     FunctionID calleeId, BOOL* pfShouldInline) {
+  RecordedCallback recorded(callback_recorder, CallbackKind::JITInlining);
+  recorded.record.id = calleeId;
+  recorded.record.other_id = callerId;
+  recorded.SetResult(pfShouldInline);
+  ScopedLatency latency(metrics_, TimedOperation::JITInlining);
+
   if (!is_attached_) {
     return S_OK;
   }
@@ -793,15 +954,10 @@ HRESULT STDMETHODCALLTYPE CorProfiler::JITInlining(FunctionID callerId,
     return S_OK;
   }
 
-  RejitHandlerModule* handlerModule = nullptr;
-  if (rejit_handler->TryGetModule(calleeModuleId, &handlerModule)) {
-    RejitHandlerModuleMethod* handlerMethod = nullptr;
-    if (handlerModule->TryGetMethod(calleFunctionToken, &handlerMethod)) {
-      Debug("*** JITInlining: Inlining disabled for [ModuleId=", calleeModuleId,
-           ", MethodDef=", TokenStr(&calleFunctionToken), "]");
-      *pfShouldInline = false;
-      return S_OK;
-    } 
+  if (rejit_handler->HasMethod(calleeModuleId, calleFunctionToken)) {
+    Debug("*** JITInlining: Inlining disabled for [ModuleId=", calleeModuleId,
+         ", MethodDef=", TokenStr(&calleFunctionToken), "]");
+    *pfShouldInline = false;
   }
 
   return S_OK;
@@ -813,6 +969,8 @@ HRESULT STDMETHODCALLTYPE CorProfiler::JITInlining(FunctionID callerId,
 HRESULT STDMETHODCALLTYPE CorProfiler::GetAssemblyReferences(
     const WCHAR* wszAssemblyPath,
     ICorProfilerAssemblyReferenceProvider* pAsmRefProvider) {
+  ScopedLatency latency(metrics_, TimedOperation::GetAssemblyReferences);
+
   if (in_azure_app_services) {
     Debug("GetAssemblyReferences skipping entire callback because this is running in Azure App Services, which isn't yet supported for this feature. AssemblyPath=", wszAssemblyPath);
     return S_OK;
@@ -820,81 +978,48 @@ HRESULT STDMETHODCALLTYPE CorProfiler::GetAssemblyReferences(
 
   // Convert the assembly path to the assembly name, assuming the assembly name
   // is either <assembly_name.ni.dll> or <assembly_name>.dll
-  auto assemblyPathString = ToString(wszAssemblyPath);
-  auto filename =
-      assemblyPathString.substr(assemblyPathString.find_last_of("\\/") + 1);
-  auto lastNiDllPeriodIndex = filename.rfind(".ni.dll");
-  auto lastDllPeriodIndex = filename.rfind(".dll");
-  if (lastNiDllPeriodIndex != std::string::npos) {
-    filename.erase(lastNiDllPeriodIndex, 7);
-  } else if (lastDllPeriodIndex != std::string::npos) {
-    filename.erase(lastDllPeriodIndex, 4);
+  const WSTRING assembly_path(wszAssemblyPath);
+  const auto filename_start = assembly_path.find_last_of("\\/"_W);
+  const auto name_start =
+      filename_start == WSTRING::npos ? 0 : filename_start + 1;
+  auto name_end = assembly_path.rfind(".ni.dll"_W);
+  if (name_end == WSTRING::npos || name_end < name_start) {
+    name_end = assembly_path.rfind(".dll"_W);
+  }
+  if (name_end == WSTRING::npos || name_end < name_start) {
+    name_end = assembly_path.size();
   }
-
-  const WSTRING assembly_name = ToWSTRING(filename);
 
   // Skip known framework assemblies that we will not instrument and,
   // as a result, will not need an assembly reference to the
   // managed profiler
-  for (auto&& skip_assembly_pattern : skip_assembly_prefixes) {
-    if (assembly_name.rfind(skip_assembly_pattern, 0) == 0) {
+  switch (assembly_classifier->Classify(assembly_path.c_str() + name_start,
+                                        name_end - name_start)) {
+    case AssemblyClass::SkippedByPrefix:
       Debug("GetAssemblyReferences skipping module by pattern: Name=",
-           assembly_name, " Path=", wszAssemblyPath);
+            assembly_path.substr(name_start, name_end - name_start),
+            " Path=", wszAssemblyPath);
       return S_OK;
-    }
-  }
-
-  for (auto&& skip_assembly : skip_assemblies) {
-    if (assembly_name == skip_assembly) {
+    case AssemblyClass::SkippedByName:
       Debug("GetAssemblyReferences skipping known assembly: Name=",
-          assembly_name, " Path=", wszAssemblyPath);
+            assembly_path.substr(name_start, name_end - name_start),
+            " Path=", wszAssemblyPath);
       return S_OK;
-    }
-  }
-
-  // Construct an ASSEMBLYMETADATA structure for the managed profiler that can
-  // be consumed by the runtime
-  const AssemblyReference assemblyReference = trace::AssemblyReference(managed_profiler_full_assembly_version);
-  ASSEMBLYMETADATA assembly_metadata{};
-
-  assembly_metadata.usMajorVersion = assemblyReference.version.major;
-  assembly_metadata.usMinorVersion = assemblyReference.version.minor;
-  assembly_metadata.usBuildNumber = assemblyReference.version.build;
-  assembly_metadata.usRevisionNumber = assemblyReference.version.revision;
-  if (assemblyReference.locale == "neutral"_W) {
-    assembly_metadata.szLocale = const_cast<WCHAR*>("\0"_W.c_str());
-    assembly_metadata.cbLocale = 0;
-  } else {
-    assembly_metadata.szLocale =
-        const_cast<WCHAR*>(assemblyReference.locale.c_str());
-    assembly_metadata.cbLocale = (DWORD)(assemblyReference.locale.size());
-  }
-
-  DWORD public_key_size = 8;
-  if (assemblyReference.public_key == trace::PublicKey()) {
-    public_key_size = 0;
+    default:
+      break;
   }
 
-  COR_PRF_ASSEMBLY_REFERENCE_INFO asmRefInfo;
-  asmRefInfo.pbPublicKeyOrToken =
-        (void*)&assemblyReference.public_key.data[0];
-  asmRefInfo.cbPublicKeyOrToken = public_key_size;
-  asmRefInfo.szName = assemblyReference.name.c_str();
-  asmRefInfo.pMetaData = &assembly_metadata;
-  asmRefInfo.pbHashValue = nullptr;
-  asmRefInfo.cbHashValue = 0;
-  asmRefInfo.dwAssemblyRefFlags = 0;
-
   // Attempt to extend the assembly closure of the provided assembly to include
   // the managed profiler
-  auto hr = pAsmRefProvider->AddAssemblyReference(&asmRefInfo);
+  const auto asmRefInfo = managed_profiler_reference_info->Get();
+  auto hr = pAsmRefProvider->AddAssemblyReference(asmRefInfo);
   if (FAILED(hr)) {
     Warn("GetAssemblyReferences failed for call from ", wszAssemblyPath);
     return S_OK;
   }
 
   Debug("GetAssemblyReferences extending assembly closure for ",
-      assembly_name, " to include ", asmRefInfo.szName,
+      assembly_path.substr(name_start, name_end - name_start), " to include ", asmRefInfo->szName,
       ". Path=", wszAssemblyPath);
   instrument_domain_neutral_assemblies = true;
 
@@ -912,7 +1037,7 @@ HRESULT CorProfiler::ProcessReplacementCalls(
     const ModuleID module_id,
     const mdToken function_token,
     const FunctionInfo& caller,
-    const std::vector<MethodReplacement> method_replacements) {
+    const std::vector<const MethodReplacement*>& method_replacements) {
   ILRewriter rewriter(this->info_, nullptr, module_id, function_token);
   bool modified = false;
   auto hr = rewriter.Import();
@@ -929,14 +1054,15 @@ HRESULT CorProfiler::ProcessReplacementCalls(
   }
 
   // Perform method call replacements
-  for (auto& method_replacement : method_replacements) {
+  for (const auto* replacement : method_replacements) {
+    const auto& method_replacement = *replacement;
     // Exit early if the method replacement isn't actually doing a replacement
     if (method_replacement.wrapper_method.action != "ReplaceTargetMethod"_W) {
       continue;
     }
 
-    const auto& wrapper_method_key =
-        method_replacement.wrapper_method.get_method_cache_key();
+    const auto wrapper_method_key =
+        method_replacement.wrapper_method.method_cache_id;
     // Exit early if we previously failed to store the method ref for this wrapper_method
     if (module_metadata->IsFailedWrapperMemberKey(wrapper_method_key)) {
       continue;
@@ -951,8 +1077,8 @@ HRESULT CorProfiler::ProcessReplacementCalls(
       }
 
       // get the target function info, continue if its invalid
-      auto target =
-          GetFunctionInfo(module_metadata->metadata_import, pInstr->m_Arg32);
+      const auto& target =
+          module_metadata->metadata_cache.GetFunctionInfo(pInstr->m_Arg32);
       if (!target.IsValid()) {
         continue;
       }
@@ -1051,70 +1177,89 @@ HRESULT CorProfiler::ProcessReplacementCalls(
         method_def_md_token = target.method_def_id;
       }
 
-      std::vector<WSTRING> actual_sig;
-      const auto successfully_parsed_signature = TryParseSignatureTypes(
-          module_metadata->metadata_import, target, actual_sig);
-      auto expected_sig =
-          method_replacement.target_method.signature_types;
-
-      if (!successfully_parsed_signature) {
-        if (debug_logging_enabled) {
-          Debug(
-              "JITCompilationStarted skipping function call: failed to parse "
-              "signature. function_id=",
-              function_id, " token=", function_token,
-              " target_name=", target.type.name, ".", target.name, "()",
-              " successfully_parsed_signature=", successfully_parsed_signature,
-              " sig_types.size()=", actual_sig.size(),
-              " expected_sig_types.size()=", expected_sig.size());
-        }
-
-        continue;
-      }
+      const auto& signature_matcher = module_metadata->GetSignatureMatcher(
+          method_replacement.target_method,
+          SignatureNaming::ParsedSignatureTypes);
+      if (signature_matcher.IsCompiled()) {
+        if (!signature_matcher.MatchesMethod(target.signature)) {
+          // we have a type mismatch, drop out
+          if (debug_logging_enabled) {
+            Debug(
+                "JITCompilationStarted skipping function call: types don't "
+                "match. function_id=",
+                function_id, " token=", function_token,
+                " target_name=", target.type.name, ".", target.name, "()");
+          }
 
-      if (actual_sig.size() != expected_sig.size()) {
-        // we can't safely assume our wrapper methods handle the types
-        if (debug_logging_enabled) {
-          Debug(
-              "JITCompilationStarted skipping function call: unexpected type "
-              "count. function_id=",
-              function_id, " token=", function_token,
-              " target_name=", target.type.name, ".", target.name,
-              "() successfully_parsed_signature=",
-              successfully_parsed_signature,
-              " sig_types.size()=", actual_sig.size(),
-              " expected_sig_types.size()=", expected_sig.size());
+          continue;
         }
+      } else {
+        std::vector<WSTRING> actual_sig;
+        const auto successfully_parsed_signature = TryParseSignatureTypes(
+            module_metadata->metadata_import, target, actual_sig,
+            &module_metadata->metadata_cache);
+        auto expected_sig =
+            method_replacement.target_method.signature_types;
+
+        if (!successfully_parsed_signature) {
+          if (debug_logging_enabled) {
+            Debug(
+                "JITCompilationStarted skipping function call: failed to parse "
+                "signature. function_id=",
+                function_id, " token=", function_token,
+                " target_name=", target.type.name, ".", target.name, "()",
+                " successfully_parsed_signature=", successfully_parsed_signature,
+                " sig_types.size()=", actual_sig.size(),
+                " expected_sig_types.size()=", expected_sig.size());
+          }
 
-        continue;
-      }
-
-      auto is_match = true;
-      for (size_t i = 0; i < expected_sig.size(); i++) {
-        if (expected_sig[i] == "_"_W) {
-          // We are supposed to ignore this index
           continue;
         }
-        if (expected_sig[i] != actual_sig[i]) {
-          // we have a type mismatch, drop out
+
+        if (actual_sig.size() != expected_sig.size()) {
+          // we can't safely assume our wrapper methods handle the types
           if (debug_logging_enabled) {
             Debug(
-                "JITCompilationStarted skipping function call: types don't "
-                "match. function_id=",
+                "JITCompilationStarted skipping function call: unexpected type "
+                "count. function_id=",
                 function_id, " token=", function_token,
                 " target_name=", target.type.name, ".", target.name,
-                "() actual[", i, "]=", actual_sig[i], ", expected[",
-                i, "]=", expected_sig[i]);
+                "() successfully_parsed_signature=",
+                successfully_parsed_signature,
+                " sig_types.size()=", actual_sig.size(),
+                " expected_sig_types.size()=", expected_sig.size());
           }
 
-          is_match = false;
-          break;
+          continue;
         }
-      }
 
-      if (!is_match) {
-        // signatures don't match
-        continue;
+        auto is_match = true;
+        for (size_t i = 0; i < expected_sig.size(); i++) {
+          if (expected_sig[i] == "_"_W) {
+            // We are supposed to ignore this index
+            continue;
+          }
+          if (expected_sig[i] != actual_sig[i]) {
+            // we have a type mismatch, drop out
+            if (debug_logging_enabled) {
+              Debug(
+                  "JITCompilationStarted skipping function call: types don't "
+                  "match. function_id=",
+                  function_id, " token=", function_token,
+                  " target_name=", target.type.name, ".", target.name,
+                  "() actual[", i, "]=", actual_sig[i], ", expected[",
+                  i, "]=", expected_sig[i]);
+            }
+
+            is_match = false;
+            break;
+          }
+        }
+
+        if (!is_match) {
+          // signatures don't match
+          continue;
+        }
       }
 
       // At this point we know we've hit a match. Error out if
@@ -1239,7 +1384,7 @@ HRESULT CorProfiler::ProcessReplacementCalls(
 
         // Currently, we only expect to see `System.Threading.CancellationToken` as a valuetype in this position
         // If we expand this to a general case, we would always perform the boxing regardless of type
-        if (GetTypeInfo(module_metadata->metadata_import, valuetype_type_token).name == "System.Threading.CancellationToken"_W) {
+        if (module_metadata->metadata_cache.GetTypeInfo(valuetype_type_token).name == "System.Threading.CancellationToken"_W) {
           rewriter_wrapper.Box(valuetype_type_token);
         }
       }
@@ -1258,7 +1403,7 @@ HRESULT CorProfiler::ProcessReplacementCalls(
           // `System.ReadOnlyMemory<T>` as a valuetype in this
           // position If we expand this to a general case, we would always
           // perform the boxing regardless of type
-          if (GetTypeInfo(module_metadata->metadata_import, valuetype_type_token).name == "System.ReadOnlyMemory`1"_W
+          if (module_metadata->metadata_cache.GetTypeInfo(valuetype_type_token).name == "System.ReadOnlyMemory`1"_W
               && ParseType(&p_end_byte)) {
             size_t length = p_end_byte - p_start_byte;
             mdTypeSpec type_token;
@@ -1327,12 +1472,17 @@ HRESULT CorProfiler::ProcessReplacementCalls(
   }
 
   if (modified) {
+    if (configuration_->il_optimizations_enabled) {
+      rewriter.PeepholeOptimize();
+    }
     hr = rewriter.Export();
 
     if (FAILED(hr)) {
       Warn("ProcessReplacementCalls: Call to ILRewriter.Export() failed for ModuleID=", module_id, " ", function_token);
+      metrics_.Increment(ProfilerCounter::Failures);
       return hr;
     }
+    CountRewrite(rewriter);
 
     if (dump_il_rewrite_enabled) {
       Info(original_code);
@@ -1349,7 +1499,7 @@ HRESULT CorProfiler::ProcessInsertionCalls(
     const ModuleID module_id,
     const mdToken function_token,
     const FunctionInfo& caller,
-    const std::vector<MethodReplacement> method_replacements) {
+    const std::vector<const MethodReplacement*>& method_replacements) {
 
   ILRewriter rewriter(this->info_, nullptr, module_id, function_token);
   bool modified = false;
@@ -1365,13 +1515,14 @@ HRESULT CorProfiler::ProcessInsertionCalls(
   ILInstr* firstInstr = rewriter.GetILList()->m_pNext;
   ILInstr* lastInstr = rewriter.GetILList()->m_pPrev; // Should be a 'ret' instruction
 
-  for (auto& method_replacement : method_replacements) {
+  for (const auto* replacement : method_replacements) {
+    const auto& method_replacement = *replacement;
     if (method_replacement.wrapper_method.action == "ReplaceTargetMethod"_W) {
       continue;
     }
 
-    const auto& wrapper_method_key =
-        method_replacement.wrapper_method.get_method_cache_key();
+    const auto wrapper_method_key =
+        method_replacement.wrapper_method.method_cache_id;
 
     // Exit early if we previously failed to store the method ref for this wrapper_method
     if (module_metadata->IsFailedWrapperMemberKey(wrapper_method_key)) {
@@ -1412,12 +1563,17 @@ HRESULT CorProfiler::ProcessInsertionCalls(
   }
 
   if (modified) {
+    if (configuration_->il_optimizations_enabled) {
+      rewriter.PeepholeOptimize();
+    }
     hr = rewriter.Export();
 
     if (FAILED(hr)) {
       Warn("ProcessInsertionCalls: Call to ILRewriter.Export() failed for ModuleID=", module_id, " ", function_token);
+      metrics_.Increment(ProfilerCounter::Failures);
       return hr;
     }
+    CountRewrite(rewriter);
   }
 
   return S_OK;
@@ -1429,10 +1585,10 @@ bool CorProfiler::GetWrapperMethodRef(
     const MethodReplacement& method_replacement,
     mdMemberRef& wrapper_method_ref,
     mdTypeRef& wrapper_type_ref) {
-  const auto& wrapper_method_key =
-      method_replacement.wrapper_method.get_method_cache_key();
-  const auto& wrapper_type_key =
-      method_replacement.wrapper_method.get_type_cache_key();
+  const auto wrapper_method_key =
+      method_replacement.wrapper_method.method_cache_id;
+  const auto wrapper_type_key =
+      method_replacement.wrapper_method.type_cache_id;
 
   // Resolve the MethodRef now. If the method is generic, we'll need to use it
   // later to define a MethodSpec
@@ -1613,8 +1769,8 @@ std::string CorProfiler::GetILCodes(const std::string& title, ILRewriter* rewrit
       orig_sstream << cInstr->m_pTarget;
 
       if (cInstr->m_opcode == CEE_CALL || cInstr->m_opcode == CEE_CALLVIRT || cInstr->m_opcode == CEE_NEWOBJ) {
-        const auto memberInfo = GetFunctionInfo(module_metadata->metadata_import,
-                                            (mdMemberRef)cInstr->m_Arg32);
+        const auto& memberInfo = module_metadata->metadata_cache.GetFunctionInfo(
+            (mdMemberRef)cInstr->m_Arg32);
         orig_sstream << "  | ";
         orig_sstream << ToString(memberInfo.type.name);
         orig_sstream << ".";
@@ -1631,8 +1787,8 @@ std::string CorProfiler::GetILCodes(const std::string& title, ILRewriter* rewrit
       } else if (cInstr->m_opcode == CEE_CASTCLASS || cInstr->m_opcode == CEE_BOX ||
           cInstr->m_opcode == CEE_UNBOX_ANY || cInstr->m_opcode == CEE_NEWARR || 
           cInstr->m_opcode == CEE_INITOBJ) {
-        const auto typeInfo = GetTypeInfo(module_metadata->metadata_import,
-                                      (mdTypeRef)cInstr->m_Arg32);
+        const auto& typeInfo = module_metadata->metadata_cache.GetTypeInfo(
+            (mdTypeRef)cInstr->m_Arg32);
         orig_sstream << "  | ";
         orig_sstream << ToString(typeInfo.name);
       } else if (cInstr->m_opcode == CEE_LDSTR) {
@@ -2142,6 +2298,42 @@ Debug("GenerateVoidILStartupMethod: Linux: Setting the PInvoke native profiler l
     return hr;
   }
 
+  // Load the loader from its extracted file when a directory is configured, or
+  // copy the embedded image into a byte array. Copying the symbols too is only
+  // worth it when debugging.
+  const WSTRING managed_loader_path = ExtractManagedLoader();
+  const bool load_symbols = debug_logging_enabled;
+
+  mdMemberRef assembly_load_from_member_ref = mdMemberRefNil;
+  mdString managed_loader_path_token = mdStringNil;
+  if (!managed_loader_path.empty()) {
+    // Create method signature for Assembly.LoadFrom(string)
+    COR_SIGNATURE assembly_load_from_signature[7] = {
+        IMAGE_CEE_CS_CALLCONV_DEFAULT,
+        1,
+        ELEMENT_TYPE_CLASS  // ret = System.Reflection.Assembly
+        // insert compressed token for System.Reflection.Assembly TypeRef here
+    };
+    token_length = CorSigCompressToken(system_reflection_assembly_type_ref, &assembly_load_from_signature[3]);
+    assembly_load_from_signature[3 + token_length] = ELEMENT_TYPE_STRING;
+
+    hr = metadata_emit->DefineMemberRef(
+        system_reflection_assembly_type_ref, "LoadFrom"_W.c_str(),
+        assembly_load_from_signature, 3 + token_length + 1,
+        &assembly_load_from_member_ref);
+    if (FAILED(hr)) {
+      Warn("GenerateVoidILStartupMethod: DefineMemberRef LoadFrom failed");
+      return hr;
+    }
+
+    hr = metadata_emit->DefineUserString(managed_loader_path.c_str(), (ULONG) managed_loader_path.size(),
+                                         &managed_loader_path_token);
+    if (FAILED(hr)) {
+      Warn("GenerateVoidILStartupMethod: DefineUserString failed");
+      return hr;
+    }
+  }
+
   // Create a string representing "Datadog.Trace.ClrProfiler.Managed.Loader.Startup"
   // Create OS-specific implementations because on Windows, creating the string via
   // "Datadog.Trace.ClrProfiler.Managed.Loader.Startup"_W.c_str() does not create the
@@ -2224,166 +2416,199 @@ Debug("GenerateVoidILStartupMethod: Linux: Setting the PInvoke native profiler l
   pNewInstr->m_opcode = CEE_RET;
   rewriter_void.InsertBefore(pFirstInstr, pNewInstr);
 
-  // Step 1) Call void GetAssemblyAndSymbolsBytes(out IntPtr assemblyPtr, out int assemblySize, out IntPtr symbolsPtr, out int symbolsSize)
-
-  // ldloca.s 0 : Load the address of the "assemblyPtr" variable (locals index 0)
-  pNewInstr = rewriter_void.NewILInstr();
-  pNewInstr->m_opcode = CEE_LDLOCA_S;
-  pNewInstr->m_Arg32 = 0;
-  rewriter_void.InsertBefore(pFirstInstr, pNewInstr);
-
-  // Set the false branch target
-  pBranchFalseInstr->m_pTarget = pNewInstr;
-
-  // ldloca.s 1 : Load the address of the "assemblySize" variable (locals index 1)
-  pNewInstr = rewriter_void.NewILInstr();
-  pNewInstr->m_opcode = CEE_LDLOCA_S;
-  pNewInstr->m_Arg32 = 1;
-  rewriter_void.InsertBefore(pFirstInstr, pNewInstr);
-
-  // ldloca.s 2 : Load the address of the "symbolsPtr" variable (locals index 2)
-  pNewInstr = rewriter_void.NewILInstr();
-  pNewInstr->m_opcode = CEE_LDLOCA_S;
-  pNewInstr->m_Arg32 = 2;
-  rewriter_void.InsertBefore(pFirstInstr, pNewInstr);
-
-  // ldloca.s 3 : Load the address of the "symbolsSize" variable (locals index 3)
-  pNewInstr = rewriter_void.NewILInstr();
-  pNewInstr->m_opcode = CEE_LDLOCA_S;
-  pNewInstr->m_Arg32 = 3;
-  rewriter_void.InsertBefore(pFirstInstr, pNewInstr);
-
-  // call void GetAssemblyAndSymbolsBytes(out IntPtr assemblyPtr, out int assemblySize, out IntPtr symbolsPtr, out int symbolsSize)
-  pNewInstr = rewriter_void.NewILInstr();
-  pNewInstr->m_opcode = CEE_CALL;
-  pNewInstr->m_Arg32 = pinvoke_method_def;
-  rewriter_void.InsertBefore(pFirstInstr, pNewInstr);
-
-  // Step 2) Call void Marshal.Copy(IntPtr source, byte[] destination, int startIndex, int length) to populate the managed assembly bytes
-
-  // ldloc.1 : Load the "assemblySize" variable (locals index 1)
-  pNewInstr = rewriter_void.NewILInstr();
-  pNewInstr->m_opcode = CEE_LDLOC_1;
-  rewriter_void.InsertBefore(pFirstInstr, pNewInstr);
-
-  // newarr System.Byte : Create a new Byte[] to hold a managed copy of the assembly data
-  pNewInstr = rewriter_void.NewILInstr();
-  pNewInstr->m_opcode = CEE_NEWARR;
-  pNewInstr->m_Arg32 = byte_type_ref;
-  rewriter_void.InsertBefore(pFirstInstr, pNewInstr);
-
-  // stloc.s 4 : Assign the Byte[] to the "assemblyBytes" variable (locals index 4)
-  pNewInstr = rewriter_void.NewILInstr();
-  pNewInstr->m_opcode = CEE_STLOC_S;
-  pNewInstr->m_Arg8 = 4;
-  rewriter_void.InsertBefore(pFirstInstr, pNewInstr);
-
-  // ldloc.0 : Load the "assemblyPtr" variable (locals index 0)
-  pNewInstr = rewriter_void.NewILInstr();
-  pNewInstr->m_opcode = CEE_LDLOC_0;
-  rewriter_void.InsertBefore(pFirstInstr, pNewInstr);
-
-  // ldloc.s 4 : Load the "assemblyBytes" variable (locals index 4)
-  pNewInstr = rewriter_void.NewILInstr();
-  pNewInstr->m_opcode = CEE_LDLOC_S;
-  pNewInstr->m_Arg8 = 4;
-  rewriter_void.InsertBefore(pFirstInstr, pNewInstr);
-
-  // ldc.i4.0 : Load the integer 0 for the Marshal.Copy startIndex parameter
-  pNewInstr = rewriter_void.NewILInstr();
-  pNewInstr->m_opcode = CEE_LDC_I4_0;
-  rewriter_void.InsertBefore(pFirstInstr, pNewInstr);
-
-  // ldloc.1 : Load the "assemblySize" variable (locals index 1) for the Marshal.Copy length parameter
-  pNewInstr = rewriter_void.NewILInstr();
-  pNewInstr->m_opcode = CEE_LDLOC_1;
-  rewriter_void.InsertBefore(pFirstInstr, pNewInstr);
-
-  // call Marshal.Copy(IntPtr source, byte[] destination, int startIndex, int length)
-  pNewInstr = rewriter_void.NewILInstr();
-  pNewInstr->m_opcode = CEE_CALL;
-  pNewInstr->m_Arg32 = marshal_copy_member_ref;
-  rewriter_void.InsertBefore(pFirstInstr, pNewInstr);
-
-  // Step 3) Call void Marshal.Copy(IntPtr source, byte[] destination, int startIndex, int length) to populate the symbols bytes
-
-  // ldloc.3 : Load the "symbolsSize" variable (locals index 3)
-  pNewInstr = rewriter_void.NewILInstr();
-  pNewInstr->m_opcode = CEE_LDLOC_3;
-  rewriter_void.InsertBefore(pFirstInstr, pNewInstr);
-
-  // newarr System.Byte : Create a new Byte[] to hold a managed copy of the symbols data
-  pNewInstr = rewriter_void.NewILInstr();
-  pNewInstr->m_opcode = CEE_NEWARR;
-  pNewInstr->m_Arg32 = byte_type_ref;
-  rewriter_void.InsertBefore(pFirstInstr, pNewInstr);
-
-  // stloc.s 5 : Assign the Byte[] to the "symbolsBytes" variable (locals index 5)
-  pNewInstr = rewriter_void.NewILInstr();
-  pNewInstr->m_opcode = CEE_STLOC_S;
-  pNewInstr->m_Arg8 = 5;
-  rewriter_void.InsertBefore(pFirstInstr, pNewInstr);
-
-  // ldloc.2 : Load the "symbolsPtr" variables (locals index 2)
-  pNewInstr = rewriter_void.NewILInstr();
-  pNewInstr->m_opcode = CEE_LDLOC_2;
-  rewriter_void.InsertBefore(pFirstInstr, pNewInstr);
-
-  // ldloc.s 5 : Load the "symbolsBytes" variable (locals index 5)
-  pNewInstr = rewriter_void.NewILInstr();
-  pNewInstr->m_opcode = CEE_LDLOC_S;
-  pNewInstr->m_Arg8 = 5;
-  rewriter_void.InsertBefore(pFirstInstr, pNewInstr);
-
-  // ldc.i4.0 : Load the integer 0 for the Marshal.Copy startIndex parameter
-  pNewInstr = rewriter_void.NewILInstr();
-  pNewInstr->m_opcode = CEE_LDC_I4_0;
-  rewriter_void.InsertBefore(pFirstInstr, pNewInstr);
-
-  // ldloc.3 : Load the "symbolsSize" variable (locals index 3) for the Marshal.Copy length parameter
-  pNewInstr = rewriter_void.NewILInstr();
-  pNewInstr->m_opcode = CEE_LDLOC_3;
-  rewriter_void.InsertBefore(pFirstInstr, pNewInstr);
-
-  // call void Marshal.Copy(IntPtr source, byte[] destination, int startIndex, int length)
-  pNewInstr = rewriter_void.NewILInstr();
-  pNewInstr->m_opcode = CEE_CALL;
-  pNewInstr->m_Arg32 = marshal_copy_member_ref;
-  rewriter_void.InsertBefore(pFirstInstr, pNewInstr);
-
-  // Step 4) Call System.Reflection.Assembly System.AppDomain.CurrentDomain.Load(byte[], byte[]))
-
-  // call System.AppDomain System.AppDomain.CurrentDomain property
-  pNewInstr = rewriter_void.NewILInstr();
-  pNewInstr->m_opcode = CEE_CALL;
-  pNewInstr->m_Arg32 = appdomain_get_current_domain_member_ref;
-  rewriter_void.InsertBefore(pFirstInstr, pNewInstr);
-
-  // ldloc.s 4 : Load the "assemblyBytes" variable (locals index 4) for the first byte[] parameter of AppDomain.Load(byte[], byte[])
-  pNewInstr = rewriter_void.NewILInstr();
-  pNewInstr->m_opcode = CEE_LDLOC_S;
-  pNewInstr->m_Arg8 = 4;
-  rewriter_void.InsertBefore(pFirstInstr, pNewInstr);
+  if (!managed_loader_path.empty()) {
+    // Step 1) Call System.Reflection.Assembly System.Reflection.Assembly.LoadFrom(string) with the extracted loader,
+    // the runtime maps the file instead of copying the image into managed arrays
+
+    // ldstr <path of the extracted loader>
+    pNewInstr = rewriter_void.NewILInstr();
+    pNewInstr->m_opcode = CEE_LDSTR;
+    pNewInstr->m_Arg32 = managed_loader_path_token;
+    rewriter_void.InsertBefore(pFirstInstr, pNewInstr);
+
+    // Set the false branch target
+    pBranchFalseInstr->m_pTarget = pNewInstr;
+
+    // call System.Reflection.Assembly System.Reflection.Assembly.LoadFrom(string)
+    pNewInstr = rewriter_void.NewILInstr();
+    pNewInstr->m_opcode = CEE_CALL;
+    pNewInstr->m_Arg32 = assembly_load_from_member_ref;
+    rewriter_void.InsertBefore(pFirstInstr, pNewInstr);
+
+    // stloc.s 6 : Assign the System.Reflection.Assembly object to the "loadedAssembly" variable (locals index 6)
+    pNewInstr = rewriter_void.NewILInstr();
+    pNewInstr->m_opcode = CEE_STLOC_S;
+    pNewInstr->m_Arg8 = 6;
+    rewriter_void.InsertBefore(pFirstInstr, pNewInstr);
+  } else {
+    // Step 1) Call void GetAssemblyAndSymbolsBytes(out IntPtr assemblyPtr, out int assemblySize, out IntPtr symbolsPtr, out int symbolsSize)
+
+    // ldloca.s 0 : Load the address of the "assemblyPtr" variable (locals index 0)
+    pNewInstr = rewriter_void.NewILInstr();
+    pNewInstr->m_opcode = CEE_LDLOCA_S;
+    pNewInstr->m_Arg32 = 0;
+    rewriter_void.InsertBefore(pFirstInstr, pNewInstr);
+
+    // Set the false branch target
+    pBranchFalseInstr->m_pTarget = pNewInstr;
+
+    // ldloca.s 1 : Load the address of the "assemblySize" variable (locals index 1)
+    pNewInstr = rewriter_void.NewILInstr();
+    pNewInstr->m_opcode = CEE_LDLOCA_S;
+    pNewInstr->m_Arg32 = 1;
+    rewriter_void.InsertBefore(pFirstInstr, pNewInstr);
+
+    // ldloca.s 2 : Load the address of the "symbolsPtr" variable (locals index 2)
+    pNewInstr = rewriter_void.NewILInstr();
+    pNewInstr->m_opcode = CEE_LDLOCA_S;
+    pNewInstr->m_Arg32 = 2;
+    rewriter_void.InsertBefore(pFirstInstr, pNewInstr);
+
+    // ldloca.s 3 : Load the address of the "symbolsSize" variable (locals index 3)
+    pNewInstr = rewriter_void.NewILInstr();
+    pNewInstr->m_opcode = CEE_LDLOCA_S;
+    pNewInstr->m_Arg32 = 3;
+    rewriter_void.InsertBefore(pFirstInstr, pNewInstr);
+
+    // call void GetAssemblyAndSymbolsBytes(out IntPtr assemblyPtr, out int assemblySize, out IntPtr symbolsPtr, out int symbolsSize)
+    pNewInstr = rewriter_void.NewILInstr();
+    pNewInstr->m_opcode = CEE_CALL;
+    pNewInstr->m_Arg32 = pinvoke_method_def;
+    rewriter_void.InsertBefore(pFirstInstr, pNewInstr);
+
+    // Step 2) Call void Marshal.Copy(IntPtr source, byte[] destination, int startIndex, int length) to populate the managed assembly bytes
+
+    // ldloc.1 : Load the "assemblySize" variable (locals index 1)
+    pNewInstr = rewriter_void.NewILInstr();
+    pNewInstr->m_opcode = CEE_LDLOC_1;
+    rewriter_void.InsertBefore(pFirstInstr, pNewInstr);
+
+    // newarr System.Byte : Create a new Byte[] to hold a managed copy of the assembly data
+    pNewInstr = rewriter_void.NewILInstr();
+    pNewInstr->m_opcode = CEE_NEWARR;
+    pNewInstr->m_Arg32 = byte_type_ref;
+    rewriter_void.InsertBefore(pFirstInstr, pNewInstr);
+
+    // stloc.s 4 : Assign the Byte[] to the "assemblyBytes" variable (locals index 4)
+    pNewInstr = rewriter_void.NewILInstr();
+    pNewInstr->m_opcode = CEE_STLOC_S;
+    pNewInstr->m_Arg8 = 4;
+    rewriter_void.InsertBefore(pFirstInstr, pNewInstr);
+
+    // ldloc.0 : Load the "assemblyPtr" variable (locals index 0)
+    pNewInstr = rewriter_void.NewILInstr();
+    pNewInstr->m_opcode = CEE_LDLOC_0;
+    rewriter_void.InsertBefore(pFirstInstr, pNewInstr);
+
+    // ldloc.s 4 : Load the "assemblyBytes" variable (locals index 4)
+    pNewInstr = rewriter_void.NewILInstr();
+    pNewInstr->m_opcode = CEE_LDLOC_S;
+    pNewInstr->m_Arg8 = 4;
+    rewriter_void.InsertBefore(pFirstInstr, pNewInstr);
+
+    // ldc.i4.0 : Load the integer 0 for the Marshal.Copy startIndex parameter
+    pNewInstr = rewriter_void.NewILInstr();
+    pNewInstr->m_opcode = CEE_LDC_I4_0;
+    rewriter_void.InsertBefore(pFirstInstr, pNewInstr);
+
+    // ldloc.1 : Load the "assemblySize" variable (locals index 1) for the Marshal.Copy length parameter
+    pNewInstr = rewriter_void.NewILInstr();
+    pNewInstr->m_opcode = CEE_LDLOC_1;
+    rewriter_void.InsertBefore(pFirstInstr, pNewInstr);
+
+    // call Marshal.Copy(IntPtr source, byte[] destination, int startIndex, int length)
+    pNewInstr = rewriter_void.NewILInstr();
+    pNewInstr->m_opcode = CEE_CALL;
+    pNewInstr->m_Arg32 = marshal_copy_member_ref;
+    rewriter_void.InsertBefore(pFirstInstr, pNewInstr);
+
+    // Step 3) Call void Marshal.Copy(IntPtr source, byte[] destination, int startIndex, int length) to populate the symbols bytes,
+    // the symbols are only loaded when debugging
+    if (load_symbols) {
+      // ldloc.3 : Load the "symbolsSize" variable (locals index 3)
+      pNewInstr = rewriter_void.NewILInstr();
+      pNewInstr->m_opcode = CEE_LDLOC_3;
+      rewriter_void.InsertBefore(pFirstInstr, pNewInstr);
+
+      // newarr System.Byte : Create a new Byte[] to hold a managed copy of the symbols data
+      pNewInstr = rewriter_void.NewILInstr();
+      pNewInstr->m_opcode = CEE_NEWARR;
+      pNewInstr->m_Arg32 = byte_type_ref;
+      rewriter_void.InsertBefore(pFirstInstr, pNewInstr);
+
+      // stloc.s 5 : Assign the Byte[] to the "symbolsBytes" variable (locals index 5)
+      pNewInstr = rewriter_void.NewILInstr();
+      pNewInstr->m_opcode = CEE_STLOC_S;
+      pNewInstr->m_Arg8 = 5;
+      rewriter_void.InsertBefore(pFirstInstr, pNewInstr);
+
+      // ldloc.2 : Load the "symbolsPtr" variables (locals index 2)
+      pNewInstr = rewriter_void.NewILInstr();
+      pNewInstr->m_opcode = CEE_LDLOC_2;
+      rewriter_void.InsertBefore(pFirstInstr, pNewInstr);
+
+      // ldloc.s 5 : Load the "symbolsBytes" variable (locals index 5)
+      pNewInstr = rewriter_void.NewILInstr();
+      pNewInstr->m_opcode = CEE_LDLOC_S;
+      pNewInstr->m_Arg8 = 5;
+      rewriter_void.InsertBefore(pFirstInstr, pNewInstr);
+
+      // ldc.i4.0 : Load the integer 0 for the Marshal.Copy startIndex parameter
+      pNewInstr = rewriter_void.NewILInstr();
+      pNewInstr->m_opcode = CEE_LDC_I4_0;
+      rewriter_void.InsertBefore(pFirstInstr, pNewInstr);
+
+      // ldloc.3 : Load the "symbolsSize" variable (locals index 3) for the Marshal.Copy length parameter
+      pNewInstr = rewriter_void.NewILInstr();
+      pNewInstr->m_opcode = CEE_LDLOC_3;
+      rewriter_void.InsertBefore(pFirstInstr, pNewInstr);
+
+      // call void Marshal.Copy(IntPtr source, byte[] destination, int startIndex, int length)
+      pNewInstr = rewriter_void.NewILInstr();
+      pNewInstr->m_opcode = CEE_CALL;
+      pNewInstr->m_Arg32 = marshal_copy_member_ref;
+      rewriter_void.InsertBefore(pFirstInstr, pNewInstr);
+    }
 
-  // ldloc.s 5 : Load the "symbolsBytes" variable (locals index 5) for the second byte[] parameter of AppDomain.Load(byte[], byte[])
-  pNewInstr = rewriter_void.NewILInstr();
-  pNewInstr->m_opcode = CEE_LDLOC_S;
-  pNewInstr->m_Arg8 = 5;
-  rewriter_void.InsertBefore(pFirstInstr, pNewInstr);
+    // Step 4) Call System.Reflection.Assembly System.AppDomain.CurrentDomain.Load(byte[], byte[]))
+
+    // call System.AppDomain System.AppDomain.CurrentDomain property
+    pNewInstr = rewriter_void.NewILInstr();
+    pNewInstr->m_opcode = CEE_CALL;
+    pNewInstr->m_Arg32 = appdomain_get_current_domain_member_ref;
+    rewriter_void.InsertBefore(pFirstInstr, pNewInstr);
+
+    // ldloc.s 4 : Load the "assemblyBytes" variable (locals index 4) for the first byte[] parameter of AppDomain.Load(byte[], byte[])
+    pNewInstr = rewriter_void.NewILInstr();
+    pNewInstr->m_opcode = CEE_LDLOC_S;
+    pNewInstr->m_Arg8 = 4;
+    rewriter_void.InsertBefore(pFirstInstr, pNewInstr);
+
+    // ldloc.s 5 : Load the "symbolsBytes" variable (locals index 5) for the second byte[] parameter of AppDomain.Load(byte[], byte[]),
+    // or ldnull when the symbols are not loaded
+    pNewInstr = rewriter_void.NewILInstr();
+    if (load_symbols) {
+      pNewInstr->m_opcode = CEE_LDLOC_S;
+      pNewInstr->m_Arg8 = 5;
+    } else {
+      pNewInstr->m_opcode = CEE_LDNULL;
+    }
+    rewriter_void.InsertBefore(pFirstInstr, pNewInstr);
 
-  // callvirt System.Reflection.Assembly System.AppDomain.Load(uint8[], uint8[])
-  pNewInstr = rewriter_void.NewILInstr();
-  pNewInstr->m_opcode = CEE_CALLVIRT;
-  pNewInstr->m_Arg32 = appdomain_load_member_ref;
-  rewriter_void.InsertBefore(pFirstInstr, pNewInstr);
+    // callvirt System.Reflection.Assembly System.AppDomain.Load(uint8[], uint8[])
+    pNewInstr = rewriter_void.NewILInstr();
+    pNewInstr->m_opcode = CEE_CALLVIRT;
+    pNewInstr->m_Arg32 = appdomain_load_member_ref;
+    rewriter_void.InsertBefore(pFirstInstr, pNewInstr);
 
-  // stloc.s 6 : Assign the System.Reflection.Assembly object to the "loadedAssembly" variable (locals index 6)
-  pNewInstr = rewriter_void.NewILInstr();
-  pNewInstr->m_opcode = CEE_STLOC_S;
-  pNewInstr->m_Arg8 = 6;
-  rewriter_void.InsertBefore(pFirstInstr, pNewInstr);
+    // stloc.s 6 : Assign the System.Reflection.Assembly object to the "loadedAssembly" variable (locals index 6)
+    pNewInstr = rewriter_void.NewILInstr();
+    pNewInstr->m_opcode = CEE_STLOC_S;
+    pNewInstr->m_Arg8 = 6;
+    rewriter_void.InsertBefore(pFirstInstr, pNewInstr);
+  }
 
-  // Step 4) Call instance method Assembly.CreateInstance("Datadog.Trace.ClrProfiler.Managed.Loader.Startup")
+  // Step 5) Call instance method Assembly.CreateInstance("Datadog.Trace.ClrProfiler.Managed.Loader.Startup")
 
   // ldloc.s 6 : Load the "loadedAssembly" variable (locals index 6) to call Assembly.CreateInstance
   pNewInstr = rewriter_void.NewILInstr();
@@ -2610,13 +2835,81 @@ HRESULT CorProfiler::AddIISPreStartInitFlags(
   return S_OK;
 }
 
-#ifdef LINUX
-extern uint8_t dll_start[] asm("_binary_Datadog_Trace_ClrProfiler_Managed_Loader_dll_start");
-extern uint8_t dll_end[] asm("_binary_Datadog_Trace_ClrProfiler_Managed_Loader_dll_end");
-
-extern uint8_t pdb_start[] asm("_binary_Datadog_Trace_ClrProfiler_Managed_Loader_pdb_start");
-extern uint8_t pdb_end[] asm("_binary_Datadog_Trace_ClrProfiler_Managed_Loader_pdb_end");
-#endif
+/// <summary>
+/// Resolve the integration methods of an instrumentation plan loaded from the cache
+/// </summary>
+/// <param name="plan">Plan loaded from the cache</param>
+/// <param name="assembly_name">Name of the assembly of the module, for the integrations loaded for it</param>
+/// <param name="integrations">Receives the integrations of the plan</param>
+/// <returns>false if an integration method of the plan is not in the catalog anymore</returns>
+bool CorProfiler::ResolveInstrumentationPlan(const InstrumentationPlan& plan,
+                                             const WSTRING& assembly_name,
+                                             std::vector<IntegrationMethod>* integrations) {
+  for (const auto& key : plan.integrations) {
+    if (!integration_directory->FindMethod(key, assembly_name, integrations)) {
+      return false;
+    }
+  }
+
+  // the replay looks the methods up again, check them once here
+  std::vector<IntegrationMethod> rejit_integrations;
+  for (const auto& rejit_method : plan.rejit_methods) {
+    if (!integration_directory->FindMethod(rejit_method.second, assembly_name, &rejit_integrations)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+/// <summary>
+/// Store the decisions taken for a module in the instrumentation plan cache
+/// </summary>
+/// <param name="module_version_id">Module version id (MVID) of the module</param>
+/// <param name="candidates_hash">Hash of the integrations that may apply to the module</param>
+/// <param name="integrations">Integrations left for the module after the filtering by target</param>
+/// <param name="plan">Plan with the skip verdict and the CallTarget methods, completed with the integrations</param>
+void CorProfiler::StoreInstrumentationPlan(const GUID& module_version_id,
+                                           unsigned long long candidates_hash,
+                                           const std::vector<IntegrationMethod>& integrations,
+                                           InstrumentationPlan& plan) {
+  for (const auto& integration : integrations) {
+    plan.integrations.push_back(integration_directory->GetKey(integration));
+  }
+
+  for (const auto& key : plan.integrations) {
+    if (key.integration_name.empty()) {
+      return;
+    }
+  }
+  for (const auto& rejit_method : plan.rejit_methods) {
+    if (rejit_method.second.integration_name.empty()) {
+      return;
+    }
+  }
+
+  instrumentation_plan_cache->Store(module_version_id, candidates_hash, plan);
+}
+
+#ifdef LINUX
+extern uint8_t dll_start[] asm("_binary_Datadog_Trace_ClrProfiler_Managed_Loader_dll_start");
+extern uint8_t dll_end[] asm("_binary_Datadog_Trace_ClrProfiler_Managed_Loader_dll_end");
+
+extern uint8_t pdb_start[] asm("_binary_Datadog_Trace_ClrProfiler_Managed_Loader_pdb_start");
+extern uint8_t pdb_end[] asm("_binary_Datadog_Trace_ClrProfiler_Managed_Loader_pdb_end");
+#endif
+
+WSTRING CorProfiler::GetRewriteQuarantine() const {
+  return rewrite_quarantine != nullptr ? rewrite_quarantine->Export() : WSTRING();
+}
+
+std::unique_lock<std::mutex> CorProfiler::LockModuleMap() {
+  return LockAndRecordWait(module_id_to_info_map_lock_, metrics_, TimedOperation::ModuleLockWait);
+}
+
+void CorProfiler::CountRewrite(ILRewriter& rewriter) {
+  metrics_.Increment(ProfilerCounter::Rewrites);
+  metrics_.Increment(ProfilerCounter::ILBytesEmitted, rewriter.GetExportedSize());
+}
 
 void CorProfiler::GetAssemblyAndSymbolsBytes(BYTE** pAssemblyArray, int* assemblySize, BYTE** pSymbolsArray, int* symbolsSize) const {
 #ifdef _WIN32
@@ -2671,12 +2964,113 @@ void CorProfiler::GetAssemblyAndSymbolsBytes(BYTE** pAssemblyArray, int* assembl
 #endif
 }
 
+/// <summary>
+/// Writes the embedded managed loader to the configured directory, once per
+/// process. The file name contains a hash of the image, so processes with
+/// different profiler versions or runtimes can share the directory and an
+/// existing file is reused when its contents match the embedded image.
+/// The directory must be private to the user of the process, and the verified
+/// file is held open for the lifetime of the profiler, so the file the
+/// AppDomains load is the one that was compared with the image.
+/// </summary>
+/// <returns>Path of the extracted loader, empty if it must be loaded from a byte array</returns>
+WSTRING CorProfiler::ExtractManagedLoader() {
+  std::lock_guard<std::mutex> guard(managed_loader_lock_);
+  if (managed_loader_extracted_) {
+    return managed_loader_path_;
+  }
+  managed_loader_extracted_ = true;
+
+  const auto& directory = configuration_->managed_loader_directory;
+  if (directory.empty()) {
+    return managed_loader_path_;
+  }
+
+  if (!IsPrivateDirectory(ToString(directory))) {
+    Warn("ExtractManagedLoader: ", directory,
+         " must be a directory owned by the user of the process and not writable by its group or by others.");
+    return managed_loader_path_;
+  }
+
+  BYTE* assembly_bytes = nullptr;
+  int assembly_size = 0;
+  BYTE* symbols_bytes = nullptr;
+  int symbols_size = 0;
+  GetAssemblyAndSymbolsBytes(&assembly_bytes, &assembly_size, &symbols_bytes, &symbols_size);
+  if (assembly_bytes == nullptr || assembly_size <= 0) {
+    Warn("ExtractManagedLoader: the managed loader image was not found.");
+    return managed_loader_path_;
+  }
+
+  // FNV-1a (64 bit)
+  unsigned long long hash = 14695981039346656037ULL;
+  for (int i = 0; i < assembly_size; i++) {
+    hash ^= assembly_bytes[i];
+    hash *= 1099511628211ULL;
+  }
+
+  std::stringstream path_stream;
+  path_stream << ToString(directory) << "/Datadog.Trace.ClrProfiler.Managed.Loader-" << std::hex
+              << std::setfill('0') << std::setw(16) << hash << ".dll";
+  const auto path = path_stream.str();
+
+  // the whole file is compared with the image through the handle that stays
+  // open: a file of the same size may be truncated, corrupted or replaced, and
+  // the hash in the name is not a cryptographic one
+  const auto open_extracted = [this, &path, assembly_bytes, assembly_size]() {
+    if (managed_loader_file_.Open(path) && managed_loader_file_.HasContents(assembly_bytes, assembly_size)) {
+      return true;
+    }
+    managed_loader_file_.Close();
+    return false;
+  };
+
+  if (!open_extracted()) {
+    // a stale file is replaced, the rename doesn't overwrite it on Windows
+    std::remove(path.c_str());
+
+    // Write a temporary file and move it in place, other processes never load
+    // a partial image
+    std::stringstream temp_path;
+    temp_path << path << "." << GetPID() << ".tmp";
+    {
+      std::ofstream stream(temp_path.str(), std::ios::binary | std::ios::trunc);
+      stream.write(reinterpret_cast<const char*>(assembly_bytes), assembly_size);
+      stream.close();
+      if (!stream || !MakeReadOnly(temp_path.str())) {
+        std::remove(temp_path.str().c_str());
+        Warn("ExtractManagedLoader: failed to write ", temp_path.str());
+        return managed_loader_path_;
+      }
+    }
+
+    // the rename fails if another process extracted it meanwhile
+    const bool renamed = std::rename(temp_path.str().c_str(), path.c_str()) == 0;
+    if (!renamed) {
+      std::remove(temp_path.str().c_str());
+    }
+    if (!open_extracted()) {
+      Warn("ExtractManagedLoader: failed to ", renamed ? "verify" : "move", " the managed loader at ", path);
+      return managed_loader_path_;
+    }
+  }
+
+  managed_loader_path_ = ToWSTRING(path);
+  Info("The managed loader is loaded from ", managed_loader_path_);
+  return managed_loader_path_;
+}
+
 
 // ***
 // * ReJIT Methods
 // ***
 
 HRESULT STDMETHODCALLTYPE CorProfiler::ReJITCompilationStarted(FunctionID functionId, ReJITID rejitId, BOOL fIsSafeToBlock) {
+  RecordedCallback recorded(callback_recorder, CallbackKind::ReJITCompilationStarted);
+  recorded.record.id = functionId;
+  recorded.record.other_id = rejitId;
+  recorded.record.flag = fIsSafeToBlock;
+
   if (!is_attached_) {
     return S_OK;
   }
@@ -2686,28 +3080,50 @@ HRESULT STDMETHODCALLTYPE CorProfiler::ReJITCompilationStarted(FunctionID functi
 }
 
 HRESULT STDMETHODCALLTYPE CorProfiler::GetReJITParameters(ModuleID moduleId, mdMethodDef methodId, ICorProfilerFunctionControl* pFunctionControl) {
+  RecordedCallback recorded(callback_recorder, CallbackKind::GetReJITParameters);
+  recorded.record.module_id = moduleId;
+  recorded.record.token = methodId;
+  ScopedLatency latency(metrics_, TimedOperation::GetReJITParameters);
+
   if (!is_attached_) {
     return S_OK;
   }
 
   Debug("GetReJITParameters: [moduleId: ", moduleId, ", methodId: ", methodId, "]");
 
-  // we get the module_metadata from the moduleId. 
+  // keep this lock until the rewrite is done, ModuleUnloadStarted frees the
+  // module metadata and the ReJIT records of its methods under it
+  auto guard = LockModuleMap();
+
+  // we get the module_metadata from the moduleId.
   ModuleMetadata* module_metadata = nullptr;
-  {
-    std::lock_guard<std::mutex> guard(module_id_to_info_map_lock_);
-    if (module_id_to_info_map_.count(moduleId) > 0) {
-      module_metadata = module_id_to_info_map_[moduleId];
-    } else {
-      return S_OK;
-    }
+  if (module_id_to_info_map_.count(moduleId) > 0) {
+    module_metadata = module_id_to_info_map_[moduleId];
+  } else {
+    return S_OK;
+  }
+
+  // the rewrite needs the CallTarget tokens of the module
+  if (!CallTarget_EnsureModuleAnalyzed(moduleId, module_metadata, guard)) {
+    return S_OK;
   }
 
   // we notify the reJIT handler of this event and pass the module_metadata.
-  return rejit_handler->NotifyReJITParameters(moduleId, methodId, pFunctionControl, module_metadata);
+  const auto hr = rejit_handler->NotifyReJITParameters(moduleId, methodId, pFunctionControl, module_metadata);
+  if (FAILED(hr)) {
+    metrics_.Increment(ProfilerCounter::Failures);
+    CallTarget_QuarantineMethod(moduleId, methodId, hr);
+  }
+  return hr;
 }
 
 HRESULT STDMETHODCALLTYPE CorProfiler::ReJITCompilationFinished(FunctionID functionId, ReJITID rejitId, HRESULT hrStatus, BOOL fIsSafeToBlock) {
+  RecordedCallback recorded(callback_recorder, CallbackKind::ReJITCompilationFinished);
+  recorded.record.id = functionId;
+  recorded.record.other_id = rejitId;
+  recorded.record.hr_status = hrStatus;
+  recorded.record.flag = fIsSafeToBlock;
+
   if (!is_attached_) {
     return S_OK;
   }
@@ -2717,11 +3133,19 @@ HRESULT STDMETHODCALLTYPE CorProfiler::ReJITCompilationFinished(FunctionID funct
 }
 
 HRESULT STDMETHODCALLTYPE CorProfiler::ReJITError(ModuleID moduleId, mdMethodDef methodId, FunctionID functionId, HRESULT hrStatus) {
+  RecordedCallback recorded(callback_recorder, CallbackKind::ReJITError);
+  recorded.record.module_id = moduleId;
+  recorded.record.token = methodId;
+  recorded.record.id = functionId;
+  recorded.record.hr_status = hrStatus;
+
   if (!is_attached_) {
     return S_OK;
   }
 
   Warn("ReJITError: [functionId: ", functionId, ", moduleId: ", moduleId, ", methodId: ", methodId, ", hrStatus: ", hrStatus, "]");
+  // not quarantined: the runtime reports no reason and may succeed the next time
+  metrics_.Increment(ProfilerCounter::Failures);
   return S_OK;
 }
 
@@ -2729,17 +3153,78 @@ HRESULT STDMETHODCALLTYPE CorProfiler::ReJITError(ModuleID moduleId, mdMethodDef
 // * CallTarget Methods
 // ***
 
+/// <summary>
+/// Prepare a module for the CallTarget instrumentation: request the ReJIT of the methods to instrument
+/// and define the CallTarget tokens the rewrites will use
+/// </summary>
+/// <param name="module_id">Module id</param>
+/// <param name="module_metadata">Module metadata for the module</param>
+void CorProfiler::CallTarget_AnalyzeModule(ModuleID module_id, ModuleMetadata* module_metadata) {
+  size_t rejit_count;
+  if (module_metadata->instrumentation_plan != nullptr) {
+    rejit_count = CallTarget_ReplayInstrumentationPlan(module_id, module_metadata, *module_metadata->instrumentation_plan);
+  } else if (instrumentation_plan_cache != nullptr) {
+    InstrumentationPlan plan;
+    rejit_count = CallTarget_RequestRejitForModule(module_id, module_metadata, module_metadata->integrations, &plan);
+    StoreInstrumentationPlan(module_metadata->module_version_id, module_metadata->candidate_integrations_hash,
+                             module_metadata->integrations, plan);
+  } else {
+    rejit_count = CallTarget_RequestRejitForModule(module_id, module_metadata, module_metadata->integrations);
+  }
+
+  if (rejit_count == 0) {
+    return;
+  }
+
+  const auto hr = module_metadata->GetCallTargetTokens()->EnsureBaseCalltargetTokens();
+  if (FAILED(hr)) {
+    Warn("CallTarget_AnalyzeModule: failed to define the CallTarget tokens for ", module_metadata->assemblyName);
+  }
+}
+
+/// <summary>
+/// Wait for the CallTarget analysis of a module, running it on the current thread if it has not started yet.
+/// The module map lock is released meanwhile so the other modules are not blocked by the analysis.
+/// </summary>
+/// <param name="module_id">Module id</param>
+/// <param name="module_metadata">Module metadata for the module</param>
+/// <param name="guard">Module map lock held by the caller, held again on return</param>
+/// <returns>false when the module was unloaded or the profiler detached meanwhile</returns>
+bool CorProfiler::CallTarget_EnsureModuleAnalyzed(ModuleID module_id, ModuleMetadata* module_metadata,
+                                                  std::unique_lock<std::mutex>& guard) {
+  if (module_metadata->analysis.IsReady()) {
+    return true;
+  }
+
+  if (module_metadata->analysis.TryBegin()) {
+    // the module can't be unloaded once the analysis is claimed
+    guard.unlock();
+    CallTarget_AnalyzeModule(module_id, module_metadata);
+    module_metadata->analysis.End();
+    guard.lock();
+  } else {
+    module_metadata->analysis.Wait(guard);
+  }
+
+  const auto search = module_id_to_info_map_.find(module_id);
+  return is_attached_ && search != module_id_to_info_map_.end() &&
+         search->second == module_metadata;
+}
+
 /// <summary>
 /// Search for methods to instrument in a module and request a ReJIT to them for a CallTarget instrumentation
 /// </summary>
 /// <param name="module_id">Module id</param>
 /// <param name="module_metadata">Module metadata for the module</param>
 /// <param name="filtered_integrations">Filtered vector of integrations to be applied</param>
+/// <param name="plan">Optional plan receiving the methods found for the instrumentation plan cache</param>
 /// <returns>Number of ReJIT requests made</returns>
-size_t CorProfiler::CallTarget_RequestRejitForModule(ModuleID module_id, ModuleMetadata* module_metadata, const std::vector<IntegrationMethod> &filtered_integrations) {
+size_t CorProfiler::CallTarget_RequestRejitForModule(ModuleID module_id, ModuleMetadata* module_metadata, const std::vector<IntegrationMethod> &filtered_integrations, InstrumentationPlan* plan) {
   auto metadata_import = module_metadata->metadata_import;
+  const auto& metadata_reader = module_metadata->metadata_reader;
   std::vector<ModuleID> vtModules;
   std::vector<mdMethodDef> vtMethodDefs;
+  const bool async_state_machine_enabled = configuration_->calltarget_async_state_machine_enabled;
 
   for (const IntegrationMethod& integration : filtered_integrations) {
 
@@ -2754,31 +3239,32 @@ size_t CorProfiler::CallTarget_RequestRejitForModule(ModuleID module_id, ModuleM
     }
 
     // We are in the right module, so we try to load the mdTypeDef from the integration target type name.
-    mdTypeDef typeDef = mdTypeDefNil;
-    auto hr = metadata_import->FindTypeDefByName(integration.replacement.target_method.type_name.c_str(), mdTokenNil, &typeDef);
-    if (FAILED(hr)) {
+    const mdTypeDef typeDef = module_metadata->FindTypeDef(integration.replacement.target_method.type_name);
+    if (typeDef == mdTypeDefNil) {
       Warn("Can't load the TypeDef for: ", integration.replacement.target_method.type_name, ", Module: ", module_metadata->assemblyName);
       continue;
     }
 
+    // The integration signature compiled against this module's tokens
+    const auto& signatureMatcher = module_metadata->GetSignatureMatcher(integration.replacement.target_method, SignatureNaming::TypeTokName);
+
     // Now we enumerate all methods with the same target method name. (All overloads of the method)
-    auto enumMethods = Enumerator<mdMethodDef>(
-        [metadata_import, integration, typeDef](HCORENUM* ptr, mdMethodDef arr[], ULONG max, ULONG* cnt) -> HRESULT {
-          return metadata_import->EnumMethodsWithName(ptr, typeDef, integration.replacement.target_method.method_name.c_str(), arr, max, cnt);
-        },
-        [metadata_import](HCORENUM ptr) -> void {
-          metadata_import->CloseEnum(ptr);
-        });
+    std::vector<mdMethodDef> methodDefs;
+    if (metadata_reader.IsValid()) {
+      methodDefs = metadata_reader.FindMethodsByName(typeDef, ToString(integration.replacement.target_method.method_name));
+    } else {
+      for (const auto methodDef : EnumMethodsWithName(metadata_import, typeDef, integration.replacement.target_method.method_name)) {
+        methodDefs.push_back(methodDef);
+      }
+    }
 
-    auto enumIterator = enumMethods.begin();
-    while (enumIterator != enumMethods.end()) {
-      auto methodDef = *enumIterator;
+    for (const mdMethodDef methodDef : methodDefs) {
+      HRESULT hr;
 
       // Extract the function info from the mdMethodDef
-      const auto caller = GetFunctionInfo(module_metadata->metadata_import, methodDef);
+      const auto& caller = module_metadata->metadata_cache.GetFunctionInfo(methodDef);
       if (!caller.IsValid()) {
         Warn("The caller for the methoddef: ", TokenStr(&methodDef), " is not valid!");
-        enumIterator = ++enumIterator;
         continue;
       }
 
@@ -2788,7 +3274,6 @@ size_t CorProfiler::CallTarget_RequestRejitForModule(ModuleID module_id, ModuleM
       if (FAILED(hr)) {
         Warn("The method signature: ", functionInfo->method_signature.str(), " cannot be parsed.");
         delete functionInfo;
-        enumIterator = ++enumIterator;
         continue;
       }
 
@@ -2797,7 +3282,6 @@ size_t CorProfiler::CallTarget_RequestRejitForModule(ModuleID module_id, ModuleM
       if (numOfArgs != integration.replacement.target_method.signature_types.size() - 1) {
         Debug("The caller for the methoddef: ", integration.replacement.target_method.method_name, " doesn't have the right number of arguments.");
         delete functionInfo;
-        enumIterator = ++enumIterator;
         continue;
       }
 
@@ -2805,62 +3289,211 @@ size_t CorProfiler::CallTarget_RequestRejitForModule(ModuleID module_id, ModuleM
       bool argumentsMismatch = false;
       const auto methodArguments = functionInfo->method_signature.GetMethodArguments();
       Debug("Comparing signature for method: ", integration.replacement.target_method.type_name, ".", integration.replacement.target_method.method_name);
-      for (unsigned int i = 0; i < numOfArgs; i++) {
-        const auto argumentTypeName = methodArguments[i].GetTypeTokName(metadata_import);
-        const auto integrationArgumentTypeName = integration.replacement.target_method.signature_types[i + 1];
-        Debug("  -> ", argumentTypeName, " = ", integrationArgumentTypeName);
-        if (argumentTypeName != integrationArgumentTypeName && integrationArgumentTypeName != "_"_W) {
-          argumentsMismatch = true;
-          break;
+      if (signatureMatcher.IsCompiled()) {
+        argumentsMismatch = !signatureMatcher.MatchesArguments(methodArguments);
+      } else {
+        for (unsigned int i = 0; i < numOfArgs; i++) {
+          const auto argumentTypeName = methodArguments[i].GetTypeTokName(metadata_import);
+          const auto integrationArgumentTypeName = integration.replacement.target_method.signature_types[i + 1];
+          Debug("  -> ", argumentTypeName, " = ", integrationArgumentTypeName);
+          if (argumentTypeName != integrationArgumentTypeName && integrationArgumentTypeName != "_"_W) {
+            argumentsMismatch = true;
+            break;
+          }
         }
       }
       if (argumentsMismatch) {
         Debug("The caller for the methoddef: ", integration.replacement.target_method.method_name, " doesn't have the right type of arguments.");
         delete functionInfo;
-        enumIterator = ++enumIterator;
         continue;
       }
 
-      // As we are in the right method, we gather all information we need and stored it in to the ReJIT handler.
-      auto moduleHandler = rejit_handler->GetOrAddModule(module_id);
-      moduleHandler->SetModuleMetadata(module_metadata);
-      auto methodHandler = moduleHandler->GetOrAddMethod(methodDef);
-      methodHandler->SetFunctionInfo(functionInfo);
-      methodHandler->SetMethodReplacement(new MethodReplacement(integration.replacement));
+      if (plan != nullptr) {
+        plan->rejit_methods.emplace_back(methodDef, integration_directory->GetKey(integration));
+      }
+
+      // Don't try again the rewrites known to fail
+      if (rewrite_quarantine->IsQuarantined(module_metadata->module_version_id, methodDef, integration.replacement)) {
+        Debug("The caller for the methoddef: ", TokenStr(&methodDef), " is quarantined.");
+        delete functionInfo;
+        continue;
+      }
 
-      // Store module_id and methodDef to request the ReJIT after analyzing all integrations.
-      vtModules.push_back(module_id);
-      vtMethodDefs.push_back(methodDef);
-      
-      bool caller_assembly_is_domain_neutral = runtime_information_.is_desktop() && corlib_module_loaded && module_metadata->app_domain_id == corlib_app_domain_id;
-
-      Info("Enqueue for ReJIT [ModuleId=", module_id,
-           ", MethodDef=", TokenStr(&methodDef), 
-           ", AppDomainId=", module_metadata->app_domain_id,
-           ", IsDomainNeutral=", caller_assembly_is_domain_neutral,
-           ", Assembly=", module_metadata->assemblyName, 
-           ", Type=", caller.type.name, 
-           ", Method=", caller.name, 
-           ", Signature=", caller.signature.str(),
-           "]");
-      enumIterator = ++enumIterator;
+      CallTarget_AddRejitMethod(module_id, module_metadata, integration, methodDef, functionInfo,
+                                async_state_machine_enabled, vtModules, vtMethodDefs);
     }
   }
 
   // Request the ReJIT for all integrations found in the module.
   if (!vtMethodDefs.empty()) {
     this->rejit_handler->EnqueueForRejit(vtMethodDefs.size(), vtModules.data(), vtMethodDefs.data());
+    metrics_.Increment(ProfilerCounter::RejitRequests, vtMethodDefs.size());
   }
 
   // We return the number of ReJIT requests
   return vtMethodDefs.size();
 }
 
+/// <summary>
+/// Request the ReJIT of the methods of a module found by a previous analysis of the same module version
+/// </summary>
+/// <param name="module_id">Module id</param>
+/// <param name="module_metadata">Module metadata for the module</param>
+/// <param name="plan">Instrumentation plan loaded from the cache</param>
+/// <returns>Number of ReJIT requests made</returns>
+size_t CorProfiler::CallTarget_ReplayInstrumentationPlan(ModuleID module_id, ModuleMetadata* module_metadata, const InstrumentationPlan& plan) {
+  std::vector<ModuleID> vtModules;
+  std::vector<mdMethodDef> vtMethodDefs;
+  const bool async_state_machine_enabled = configuration_->calltarget_async_state_machine_enabled;
+
+  for (const auto& rejit_method : plan.rejit_methods) {
+    const mdMethodDef methodDef = rejit_method.first;
+    std::vector<IntegrationMethod> integrations;
+    if (!integration_directory->FindMethod(rejit_method.second, module_metadata->assemblyName, &integrations)) {
+      Warn("The integration ", rejit_method.second.integration_name, " of the instrumentation plan is not in the catalog.");
+      continue;
+    }
+    const IntegrationMethod& integration = integrations.front();
+
+    if (rewrite_quarantine->IsQuarantined(module_metadata->module_version_id, methodDef, integration.replacement)) {
+      Debug("The caller for the methoddef: ", TokenStr(&methodDef), " is quarantined.");
+      continue;
+    }
+
+    const auto& caller = module_metadata->metadata_cache.GetFunctionInfo(methodDef);
+    if (!caller.IsValid()) {
+      Warn("The caller for the methoddef: ", TokenStr(&methodDef), " of the instrumentation plan is not valid!");
+      continue;
+    }
+
+    auto functionInfo = new FunctionInfo(caller);
+    if (FAILED(functionInfo->method_signature.TryParse())) {
+      Warn("The method signature: ", functionInfo->method_signature.str(), " cannot be parsed.");
+      delete functionInfo;
+      continue;
+    }
+
+    CallTarget_AddRejitMethod(module_id, module_metadata, integration, methodDef, functionInfo,
+                              async_state_machine_enabled, vtModules, vtMethodDefs);
+  }
+
+  if (!vtMethodDefs.empty()) {
+    this->rejit_handler->EnqueueForRejit(vtMethodDefs.size(), vtModules.data(), vtMethodDefs.data());
+    metrics_.Increment(ProfilerCounter::RejitRequests, vtMethodDefs.size());
+  }
+
+  return vtMethodDefs.size();
+}
+
+/// <summary>
+/// Store a method to instrument (and the MoveNext of its state machine) in the ReJIT handler
+/// </summary>
+/// <param name="module_id">Module id</param>
+/// <param name="module_metadata">Module metadata for the module</param>
+/// <param name="integration">Integration applied to the method</param>
+/// <param name="methodDef">Method to instrument</param>
+/// <param name="functionInfo">Function info of the method with the signature parsed, owned by the ReJIT handler afterwards</param>
+/// <param name="async_state_machine_enabled">Whether the state machine of async methods is instrumented</param>
+/// <param name="vtModules">Modules to ReJIT</param>
+/// <param name="vtMethodDefs">Methods to ReJIT</param>
+void CorProfiler::CallTarget_AddRejitMethod(ModuleID module_id, ModuleMetadata* module_metadata,
+                                            const IntegrationMethod& integration, mdMethodDef methodDef,
+                                            FunctionInfo* functionInfo, bool async_state_machine_enabled,
+                                            std::vector<ModuleID>& vtModules, std::vector<mdMethodDef>& vtMethodDefs) {
+  auto metadata_import = module_metadata->metadata_import;
+
+  // As we are in the right method, we gather all information we need and stored it in to the ReJIT handler.
+  auto moduleHandler = rejit_handler->GetOrAddModule(module_id);
+  moduleHandler->SetModuleMetadata(module_metadata);
+  auto methodHandler = moduleHandler->GetOrAddMethod(methodDef);
+  methodHandler->SetFunctionInfo(functionInfo);
+  methodHandler->SetIntegrationMethod(integration);
+  methodHandler->SetSamplingRate(integration.sampling_rate);
+
+  // Store module_id and methodDef to request the ReJIT after analyzing all integrations.
+  vtModules.push_back(module_id);
+  vtMethodDefs.push_back(methodDef);
+
+  // If the target is an async method, we also rewrite the MoveNext of its state machine
+  // to observe the completion there instead of attaching a continuation to the returned task.
+  mdTypeDef stateMachineTypeDef = mdTypeDefNil;
+  mdMethodDef moveNextMethodDef = mdMethodDefNil;
+  if (async_state_machine_enabled &&
+      GetAsyncStateMachineMoveNext(metadata_import, methodDef, &stateMachineTypeDef, &moveNextMethodDef) == S_OK &&
+      !rewrite_quarantine->IsQuarantined(module_metadata->module_version_id, moveNextMethodDef, integration.replacement)) {
+    const auto& moveNext = module_metadata->metadata_cache.GetFunctionInfo(moveNextMethodDef);
+    if (moveNext.IsValid()) {
+      auto moveNextHandler = moduleHandler->GetOrAddMethod(moveNextMethodDef);
+      moveNextHandler->SetFunctionInfo(new FunctionInfo(moveNext));
+      moveNextHandler->SetIntegrationMethod(integration);
+      moveNextHandler->SetAsyncStubMethod(methodHandler);
+      methodHandler->SetAsyncMoveNextMethod(moveNextHandler);
+
+      vtModules.push_back(module_id);
+      vtMethodDefs.push_back(moveNextMethodDef);
+
+      Info("Enqueue async state machine for ReJIT [ModuleId=", module_id,
+           ", MethodDef=", TokenStr(&methodDef),
+           ", MoveNext=", TokenStr(&moveNextMethodDef),
+           ", StateMachineType=", moveNext.type.name,
+           "]");
+    }
+  }
+  
+  bool caller_assembly_is_domain_neutral = runtime_information_.is_desktop() && corlib_module_loaded && module_metadata->app_domain_id == corlib_app_domain_id;
+
+  Info("Enqueue for ReJIT [ModuleId=", module_id,
+       ", MethodDef=", TokenStr(&methodDef), 
+       ", AppDomainId=", module_metadata->app_domain_id,
+       ", IsDomainNeutral=", caller_assembly_is_domain_neutral,
+       ", Assembly=", module_metadata->assemblyName, 
+       ", Type=", functionInfo->type.name, 
+       ", Method=", functionInfo->name, 
+       ", Signature=", functionInfo->signature.str(),
+       "]");
+}
+
+/// <summary>
+/// Quarantine a method whose rewrite failed so the next instances of the module (and the next processes) don't
+/// request its ReJIT again. Only the failures the rewrite reported a reason for are quarantined: they fail again
+/// on the same module version, while a failed HRESULT alone may be transient.
+/// </summary>
+/// <param name="module_id">Module id</param>
+/// <param name="methodDef">Method that failed</param>
+/// <param name="hr">Result of the rewrite</param>
+/// <remarks>The caller holds the module map lock, the method handler is freed with its module under it</remarks>
+void CorProfiler::CallTarget_QuarantineMethod(ModuleID module_id, mdMethodDef methodDef, HRESULT hr) {
+  const auto search = module_id_to_info_map_.find(module_id);
+  if (search == module_id_to_info_map_.end()) {
+    return;
+  }
+  const ModuleMetadata* module_metadata = search->second;
+
+  RejitHandlerModule* moduleHandler = nullptr;
+  RejitHandlerModuleMethod* methodHandler = nullptr;
+  if (rejit_handler == nullptr || !rejit_handler->TryGetModule(module_id, &moduleHandler) ||
+      !moduleHandler->TryGetMethod(methodDef, &methodHandler) || methodHandler->GetMethodReplacement() == nullptr ||
+      methodHandler->GetRewriteFailure().empty()) {
+    return;
+  }
+
+  std::stringstream hr_str;
+  hr_str << "HRESULT 0x" << std::hex << std::setfill('0') << std::setw(8) << static_cast<ULONG>(hr);
+  const WSTRING reason = methodHandler->GetRewriteFailure() + " ("_W + ToWSTRING(hr_str.str()) + ")"_W;
+
+  if (rewrite_quarantine->Add(module_metadata->assemblyName, module_metadata->module_version_id, methodDef,
+                              *methodHandler->GetMethodReplacement(), reason)) {
+    Warn("Quarantined the CallTarget rewrite of ", module_metadata->assemblyName, " ", TokenStr(&methodDef), ": ",
+         reason);
+  }
+}
+
 /// <summary>
 /// Rewrite the target method body with the calltarget implementation. (This is function is triggered by the ReJIT handler)
 /// Resulting code structure:
 /// 
 /// - Add locals for TReturn (if non-void method), CallTargetState, CallTargetReturn/CallTargetReturn<TReturn>, Exception
+///   and the sampling flag (if the integration has a sampling rate)
 /// - Initialize locals
 ///
 /// try
@@ -2869,6 +3502,8 @@ size_t CorProfiler::CallTarget_RequestRejitForModule(ModuleID module_id, ModuleM
 ///   {
 ///     try
 ///     {
+///       - If sampled, increment the method counter and store (counter % rate == 0) in the sampling flag local,
+///         unsampled calls skip BeginMethod
 ///       - Invoke BeginMethod with object instance (or null if static method) and original method arguments
 ///       - Store result into CallTargetState local
 ///     }
@@ -2888,6 +3523,7 @@ size_t CorProfiler::CallTarget_RequestRejitForModule(ModuleID module_id, ModuleM
 /// }
 /// finally
 /// {
+///   - If sampled and the sampling flag is not set, skip EndMethod
 ///   try
 ///   {
 ///     - Invoke EndMethod with object instance (or null if static method), TReturn local (if non-void method), CallTargetState local, and Exception local
@@ -2907,13 +3543,20 @@ size_t CorProfiler::CallTarget_RequestRejitForModule(ModuleID module_id, ModuleM
 /// <param name="methodHandler">Method ReJIT handler representation</param>
 /// <returns>Result of the rewriting</returns>
 HRESULT CorProfiler::CallTarget_RewriterCallback(RejitHandlerModule* moduleHandler, RejitHandlerModuleMethod* methodHandler) {
+  if (methodHandler->GetAsyncStubMethod() != nullptr) {
+    return CallTarget_AsyncMoveNextRewriterCallback(moduleHandler, methodHandler);
+  }
+
+  // a reason left by a previous rewrite of the method doesn't apply to this one
+  methodHandler->SetRewriteFailure(WSTRING());
+
   ModuleID module_id = moduleHandler->GetModuleId();
   ModuleMetadata* module_metadata = moduleHandler->GetModuleMetadata();
   FunctionInfo* caller = methodHandler->GetFunctionInfo();
   CallTargetTokens* callTargetTokens = module_metadata->GetCallTargetTokens();
   mdToken function_token = caller->id;
   FunctionMethodArgument retFuncArg = caller->method_signature.GetRet();
-  MethodReplacement* method_replacement = methodHandler->GetMethodReplacement();
+  const MethodReplacement* method_replacement = methodHandler->GetMethodReplacement();
   unsigned int retFuncElementType;
   int retTypeFlags = retFuncArg.GetTypeFlags(retFuncElementType);
   bool isVoid = (retTypeFlags & TypeFlagVoid) > 0;
@@ -2922,6 +3565,16 @@ HRESULT CorProfiler::CallTarget_RewriterCallback(RejitHandlerModule* moduleHandl
   int numArgs = caller->method_signature.NumberOfArguments();
   auto metaEmit = module_metadata->metadata_emit;
   auto metaImport = module_metadata->metadata_import;
+  ULONG samplingRate = methodHandler->GetSamplingRate();
+  bool isSampled = samplingRate > kSamplingRateEveryCall;
+  // The completion of an async method is only observed in its state machine when the MoveNext can be rewritten,
+  // otherwise the returned task gets a continuation like any other method.
+  RejitHandlerModuleMethod* moveNextHandler = methodHandler->GetAsyncMoveNextMethod();
+  bool isAsyncStub = moveNextHandler != nullptr && CallTarget_PrepareAsyncMoveNext(moduleHandler, moveNextHandler) == S_OK;
+  if (moveNextHandler != nullptr && !isAsyncStub) {
+    Info("*** CallTarget_RewriterCallback(): The state machine of ", caller->type.name, ".", caller->name,
+         " cannot be rewritten, its completion is observed with a continuation.");
+  }
 
   // *** Get all references to the wrapper type
   mdMemberRef wrapper_method_ref = mdMemberRefNil;
@@ -2933,6 +3586,8 @@ HRESULT CorProfiler::CallTarget_RewriterCallback(RejitHandlerModule* moduleHandl
        ", IsStatic=", isStatic, 
        ", IntegrationType=", method_replacement->wrapper_method.type_name,
        ", Arguments=", numArgs, 
+       ", SamplingRate=", samplingRate,
+       ", IsAsyncStub=", isAsyncStub,
        "]");
 
   // *** Create rewriter
@@ -2961,6 +3616,7 @@ HRESULT CorProfiler::CallTarget_RewriterCallback(RejitHandlerModule* moduleHandl
   ULONG exceptionIndex = static_cast<ULONG>(ULONG_MAX);
   ULONG callTargetReturnIndex = static_cast<ULONG>(ULONG_MAX);
   ULONG returnValueIndex = static_cast<ULONG>(ULONG_MAX);
+  ULONG samplingFlagIndex = static_cast<ULONG>(ULONG_MAX);
   mdToken callTargetStateToken = mdTokenNil;
   mdToken exceptionToken = mdTokenNil;
   mdToken callTargetReturnToken = mdTokenNil;
@@ -2969,7 +3625,43 @@ HRESULT CorProfiler::CallTarget_RewriterCallback(RejitHandlerModule* moduleHandl
       &callTargetStateIndex, &exceptionIndex, 
       &callTargetReturnIndex, &returnValueIndex, 
       &callTargetStateToken,
-      &exceptionToken, &callTargetReturnToken, &firstInstruction);
+      &exceptionToken, &callTargetReturnToken, &firstInstruction,
+      isSampled ? &samplingFlagIndex : nullptr);
+
+  // ***
+  // SAMPLING PROBE
+  // ***
+  ILInstr* samplingSkipBeginMethodInstr = nullptr;
+  if (isSampled) {
+    // *** Increment the per-method counter through its pinned native address
+    // and store in the sampling flag local whether this call is sampled:
+    //    *counter = *counter + 1
+    //    samplingFlag = (*counter % samplingRate) == 0
+    // The increment is not atomic on purpose, losing an update under
+    // contention only shifts which call is sampled.
+    INT64 samplingCounterAddress =
+        reinterpret_cast<INT64>(methodHandler->GetSamplingCounterAddress());
+    reWriterWrapper.LoadInt64(samplingCounterAddress);
+    reWriterWrapper.CreateInstr(CEE_CONV_I);
+    reWriterWrapper.LoadInt64(samplingCounterAddress);
+    reWriterWrapper.CreateInstr(CEE_CONV_I);
+    reWriterWrapper.CreateInstr(CEE_LDIND_I4);
+    reWriterWrapper.LoadInt32(1);
+    reWriterWrapper.CreateInstr(CEE_ADD);
+    reWriterWrapper.CreateInstr(CEE_STIND_I4);
+    reWriterWrapper.LoadInt64(samplingCounterAddress);
+    reWriterWrapper.CreateInstr(CEE_CONV_I);
+    reWriterWrapper.CreateInstr(CEE_LDIND_I4);
+    reWriterWrapper.LoadInt32(static_cast<INT32>(samplingRate));
+    reWriterWrapper.CreateInstr(CEE_REM_UN);
+    reWriterWrapper.LoadInt32(0);
+    reWriterWrapper.CreateInstr(CEE_CEQ);
+    reWriterWrapper.StLocal(samplingFlagIndex);
+
+    // *** Unsampled calls jump straight to the LEAVE into the original code
+    reWriterWrapper.LoadLocal(samplingFlagIndex);
+    samplingSkipBeginMethodInstr = reWriterWrapper.CreateInstr(CEE_BRFALSE_S);
+  }
 
   // ***
   // BEGIN METHOD PART
@@ -2985,6 +3677,7 @@ HRESULT CorProfiler::CallTarget_RewriterCallback(RejitHandlerModule* moduleHandl
       //    initobj [valueType]
       //    ldloc.s [localIndex]
       Warn("*** CallTarget_RewriterCallback(): Static methods in a ValueType cannot be instrumented. ");
+      methodHandler->SetRewriteFailure("static method in a value type"_W);
       return E_FAIL;
     }
     reWriterWrapper.LoadNull();
@@ -3005,6 +3698,7 @@ HRESULT CorProfiler::CallTarget_RewriterCallback(RejitHandlerModule* moduleHandl
         // We can't emit LoadObj or Box because that would result in an invalid IL.
         // This problem doesn't occur on a class type because we can always relay in the
         // object type.
+        methodHandler->SetRewriteFailure("generic value type"_W);
         return E_FAIL;
       }
     }
@@ -3021,6 +3715,7 @@ HRESULT CorProfiler::CallTarget_RewriterCallback(RejitHandlerModule* moduleHandl
         Warn(
             "*** CallTarget_RewriterCallback(): Methods with ref parameters "
             "cannot be instrumented. ");
+        methodHandler->SetRewriteFailure("by-ref argument"_W);
         return E_FAIL;
       }
     }
@@ -3035,12 +3730,14 @@ HRESULT CorProfiler::CallTarget_RewriterCallback(RejitHandlerModule* moduleHandl
         Warn(
             "*** CallTarget_RewriterCallback(): Methods with ref parameters "
             "cannot be instrumented. ");
+        methodHandler->SetRewriteFailure("by-ref argument"_W);
         return E_FAIL;
       }
       if (argTypeFlags & TypeFlagBoxedType) {
         auto tok = methodArguments[i].GetTypeTok(
             metaEmit, callTargetTokens->GetCorLibAssemblyRef());
         if (tok == mdTokenNil) {
+          methodHandler->SetRewriteFailure("boxed argument type token not available"_W);
           return E_FAIL;
         }
         reWriterWrapper.Box(tok);
@@ -3108,7 +3805,27 @@ HRESULT CorProfiler::CallTarget_RewriterCallback(RejitHandlerModule* moduleHandl
     }
   }
   reWriterWrapper.StLocal(callTargetStateIndex);
+  if (isAsyncStub) {
+    // *** Flow the instance and the state to the state machine before it starts
+    // (static methods in a value type and generic structs were rejected by the BeginMethod call)
+    ILInstr* beginAsyncStubCallInstruction;
+    if (isStatic) {
+      reWriterWrapper.LoadNull();
+    } else {
+      reWriterWrapper.LoadArgument(0);
+      if (caller->type.valueType) {
+        reWriterWrapper.LoadObj(caller->type.type_spec != mdTypeSpecNil ? caller->type.type_spec : caller->type.id);
+      }
+    }
+    reWriterWrapper.LoadLocal(callTargetStateIndex);
+    IfFailRet(callTargetTokens->WriteBeginAsyncStubMemberRef(
+        &reWriterWrapper, wrapper_type_ref, &caller->type,
+        &beginAsyncStubCallInstruction));
+  }
   ILInstr* pStateLeaveToBeginOriginalMethodInstr = reWriterWrapper.CreateInstr(CEE_LEAVE_S);
+  if (samplingSkipBeginMethodInstr != nullptr) {
+    samplingSkipBeginMethodInstr->m_pTarget = pStateLeaveToBeginOriginalMethodInstr;
+  }
 
   // *** BeginMethod call catch
   ILInstr* beginMethodCatchFirstInstr = nullptr;
@@ -3156,6 +3873,13 @@ HRESULT CorProfiler::CallTarget_RewriterCallback(RejitHandlerModule* moduleHandl
   // ***
   ILInstr* endMethodTryStartInstr;
 
+  // *** Unsampled calls skip the EndMethod call (target resolved below)
+  ILInstr* samplingSkipEndMethodInstr = nullptr;
+  if (isSampled) {
+    reWriterWrapper.LoadLocal(samplingFlagIndex);
+    samplingSkipEndMethodInstr = reWriterWrapper.CreateInstr(CEE_BRFALSE_S);
+  }
+
   // *** Load instance into the stack (if not static)
   if (isStatic) {
     if (caller->type.valueType) {
@@ -3170,6 +3894,7 @@ HRESULT CorProfiler::CallTarget_RewriterCallback(RejitHandlerModule* moduleHandl
       Warn(
           "CallTarget_RewriterCallback: Static methods in a ValueType cannot "
           "be instrumented. ");
+      methodHandler->SetRewriteFailure("static method in a value type"_W);
       return E_FAIL;
     }
     endMethodTryStartInstr = reWriterWrapper.LoadNull();
@@ -3189,13 +3914,15 @@ HRESULT CorProfiler::CallTarget_RewriterCallback(RejitHandlerModule* moduleHandl
         // We can't emit LoadObj or Box because that would result in an invalid IL.
         // This problem doesn't occur on a class type because we can always relay in the
         // object type.
+        methodHandler->SetRewriteFailure("generic value type"_W);
         return E_FAIL;
       }
     }
   }
 
   // *** Load the return value is is not void
-  if (!isVoid) {
+  // (the completion of an async stub is handled by its state machine MoveNext)
+  if (!isVoid && !isAsyncStub) {
     reWriterWrapper.LoadLocal(returnValueIndex);
   }
 
@@ -3203,17 +3930,22 @@ HRESULT CorProfiler::CallTarget_RewriterCallback(RejitHandlerModule* moduleHandl
   reWriterWrapper.LoadLocal(callTargetStateIndex);
   
   ILInstr* endMethodCallInstr;
-  if (isVoid) {
+  if (isAsyncStub) {
+    callTargetTokens->WriteEndAsyncStubMemberRef(
+        &reWriterWrapper, wrapper_type_ref, &caller->type, &endMethodCallInstr);
+    reWriterWrapper.Pop();
+  } else if (isVoid) {
     callTargetTokens->WriteEndVoidReturnMemberRef(
         &reWriterWrapper, wrapper_type_ref, &caller->type, &endMethodCallInstr);
+    reWriterWrapper.StLocal(callTargetReturnIndex);
   } else {
     callTargetTokens->WriteEndReturnMemberRef(&reWriterWrapper,
                                               wrapper_type_ref, &caller->type,
                                               &retFuncArg, &endMethodCallInstr);
+    reWriterWrapper.StLocal(callTargetReturnIndex);
   }
-  reWriterWrapper.StLocal(callTargetReturnIndex);
 
-  if (!isVoid) {
+  if (!isVoid && !isAsyncStub) {
     ILInstr* callTargetReturnGetReturnInstr;
     reWriterWrapper.LoadLocalAddress(callTargetReturnIndex);
     callTargetTokens->WriteCallTargetReturnGetReturnValue(&reWriterWrapper, callTargetReturnToken, &callTargetReturnGetReturnInstr);
@@ -3241,6 +3973,9 @@ HRESULT CorProfiler::CallTarget_RewriterCallback(RejitHandlerModule* moduleHandl
   ILInstr* endFinallyInstr = reWriterWrapper.EndFinally();
   endMethodTryLeave->m_pTarget = endFinallyInstr;
   endMethodCatchLeaveInstr->m_pTarget = endFinallyInstr;
+  if (samplingSkipEndMethodInstr != nullptr) {
+    samplingSkipEndMethodInstr->m_pTarget = endFinallyInstr;
+  }
 
   // ***
   // METHOD RETURN
@@ -3294,7 +4029,7 @@ HRESULT CorProfiler::CallTarget_RewriterCallback(RejitHandlerModule* moduleHandl
   // Update and Add exception clauses
   // ***
   auto ehCount = rewriter.GetEHCount();
-  auto newEHClauses = new EHClause[ehCount + 4];
+  auto newEHClauses = rewriter.NewEHClauses(ehCount + 4);
   for (unsigned i = 0; i < ehCount; i++) {
     newEHClauses[i] = rewriter.GetEHPointer()[i];
   }
@@ -3313,6 +4048,10 @@ HRESULT CorProfiler::CallTarget_RewriterCallback(RejitHandlerModule* moduleHandl
                     &rewriter, *caller, module_metadata));
   }
 
+  if (configuration_->il_optimizations_enabled) {
+    rewriter.PeepholeOptimize();
+  }
+
   hr = rewriter.Export();
 
   if (FAILED(hr)) {
@@ -3322,11 +4061,254 @@ HRESULT CorProfiler::CallTarget_RewriterCallback(RejitHandlerModule* moduleHandl
         module_id, " ", function_token);
     return hr;
   }
+  CountRewrite(rewriter);
 
   Info("*** CallTarget_RewriterCallback() Finished: ", caller->type.name, ".",
         caller->name, "() [IsVoid=", isVoid, ", IsStatic=", isStatic,
         ", IntegrationType=", method_replacement->wrapper_method.type_name,
-        ", Arguments=", numArgs, "]");
+        ", Arguments=", numArgs, ", SamplingRate=", samplingRate, "]");
+  return S_OK;
+}
+
+/// <summary>
+/// Apply the rewrite of the MoveNext method of an async method state machine (This is function is triggered by the ReJIT handler)
+/// The MoveNext keeps its original code when it can't be rewritten, its async method then attaches a continuation to the returned task.
+/// </summary>
+/// <param name="moduleHandler">Module ReJIT handler representation</param>
+/// <param name="methodHandler">MoveNext method ReJIT handler representation</param>
+/// <returns>Result of the rewriting</returns>
+HRESULT CorProfiler::CallTarget_AsyncMoveNextRewriterCallback(RejitHandlerModule* moduleHandler, RejitHandlerModuleMethod* methodHandler) {
+  HRESULT hr = CallTarget_PrepareAsyncMoveNext(moduleHandler, methodHandler);
+  if (hr != S_OK) {
+    return hr;
+  }
+
+  // The MoveNext is only rewritten through the ReJIT
+  ICorProfilerFunctionControl* pFunctionControl = methodHandler->GetFunctionControl();
+  if (pFunctionControl == nullptr) {
+    return S_FALSE;
+  }
+  const auto& body = methodHandler->GetAsyncMoveNextBody();
+  return pFunctionControl->SetILFunctionBody((ULONG) body.size(), body.data());
+}
+
+/// <summary>
+/// Rewrite the MoveNext method of an async method state machine once, for both the ReJIT of the async method
+/// and of the MoveNext. The async method only flows its state to a MoveNext rewritten with success.
+/// </summary>
+/// <param name="moduleHandler">Module ReJIT handler representation</param>
+/// <param name="moveNextHandler">MoveNext method ReJIT handler representation</param>
+/// <returns>S_OK if the MoveNext is rewritten, S_FALSE or an error if it keeps its original code</returns>
+HRESULT CorProfiler::CallTarget_PrepareAsyncMoveNext(RejitHandlerModule* moduleHandler, RejitHandlerModuleMethod* moveNextHandler) {
+  return moveNextHandler->PrepareAsyncMoveNext([this, moduleHandler, moveNextHandler](ICorProfilerFunctionControl* pFunctionControl) {
+    return CallTarget_RewriteAsyncMoveNext(moduleHandler, moveNextHandler, pFunctionControl);
+  });
+}
+
+/// <summary>
+/// Rewrite the MoveNext method of an async method state machine to notify the async method completion
+/// to the integration, instead of attaching a continuation to the returned task.
+/// Resulting code structure:
+///
+/// - At the start of the method:
+///     Invoke EnterAsyncMethod<TIntegration, TTarget>(int) with the state of the state machine, to take the
+///     CallTarget state of its async method on the first run
+/// - Before each call to Async[Value]TaskMethodBuilder`1.SetResult(TResult):
+///     Invoke EndAsyncMethodResult<TIntegration, TTarget, TResult>(TResult) with the result value on the stack
+/// - Before each call to Async[Value]TaskMethodBuilder.SetResult():
+///     Invoke EndAsyncMethodVoid<TIntegration, TTarget>()
+/// - Before each call to Async[Value]TaskMethodBuilder[`1].SetException(Exception):
+///     Duplicate the exception on the stack and invoke EndAsyncMethodException<TIntegration, TTarget, TResult>(Exception)
+/// </summary>
+/// <param name="moduleHandler">Module ReJIT handler representation</param>
+/// <param name="methodHandler">MoveNext method ReJIT handler representation</param>
+/// <param name="pFunctionControl">Function control receiving the rewritten body</param>
+/// <returns>Result of the rewriting</returns>
+HRESULT CorProfiler::CallTarget_RewriteAsyncMoveNext(RejitHandlerModule* moduleHandler, RejitHandlerModuleMethod* methodHandler,
+                                                     ICorProfilerFunctionControl* pFunctionControl) {
+  ModuleID module_id = moduleHandler->GetModuleId();
+  ModuleMetadata* module_metadata = moduleHandler->GetModuleMetadata();
+  FunctionInfo* moveNext = methodHandler->GetFunctionInfo();
+  FunctionInfo* caller = methodHandler->GetAsyncStubMethod()->GetFunctionInfo();
+  CallTargetTokens* callTargetTokens = module_metadata->GetCallTargetTokens();
+  mdToken function_token = moveNext->id;
+  const MethodReplacement* method_replacement = methodHandler->GetMethodReplacement();
+  auto metaImport = module_metadata->metadata_import;
+
+  if (caller == nullptr) {
+    Warn("*** CallTarget_AsyncMoveNextRewriterCallback(): FunctionInfo of the async method is missing for ", moveNext->type.name);
+    return S_FALSE;
+  }
+
+  // *** Get all references to the wrapper type
+  mdMemberRef wrapper_method_ref = mdMemberRefNil;
+  mdTypeRef wrapper_type_ref = mdTypeRefNil;
+  GetWrapperMethodRef(module_metadata, module_id, *method_replacement, wrapper_method_ref, wrapper_type_ref);
+
+  Debug("*** CallTarget_AsyncMoveNextRewriterCallback() Start: ", moveNext->type.name, ".", moveNext->name,
+       "() [AsyncMethod=", caller->type.name, ".", caller->name,
+       ", IntegrationType=", method_replacement->wrapper_method.type_name,
+       "]");
+
+  // *** Create rewriter
+  ILRewriter rewriter(this->info_, pFunctionControl, module_id, function_token);
+  auto hr = rewriter.Import();
+  if (FAILED(hr)) {
+    Warn("*** CallTarget_AsyncMoveNextRewriterCallback(): Call to ILRewriter.Import() failed for ", module_id, " ", function_token);
+    return hr;
+  }
+
+  // *** Store the original il code text if the dump_il option is enabled.
+  std::string original_code;
+  if (dump_il_rewrite_enabled) {
+    original_code = GetILCodes(
+        "*** CallTarget_AsyncMoveNextRewriterCallback(): Original Code: ", &rewriter,
+        *moveNext, module_metadata);
+  }
+
+  ILRewriterWrapper reWriterWrapper(&rewriter);
+  const COR_SIGNATURE objectSignature[] = {ELEMENT_TYPE_OBJECT};
+  int completionCalls = 0;
+
+  for (ILInstr* pInstr = rewriter.GetILList()->m_pNext;
+       pInstr != rewriter.GetILList(); pInstr = pInstr->m_pNext) {
+    if (pInstr->m_opcode != CEE_CALL && pInstr->m_opcode != CEE_CALLVIRT) {
+      continue;
+    }
+
+    // *** Only calls to SetResult/SetException of the async method builders are instrumented
+    const auto& target = module_metadata->metadata_cache.GetFunctionInfo(pInstr->m_Arg32);
+    if (!target.IsValid()) {
+      continue;
+    }
+    const bool isSetException = target.name == async_builder_setexception_name;
+    if (!isSetException && target.name != async_builder_setresult_name) {
+      continue;
+    }
+    if (std::find(std::begin(async_method_builder_types), std::end(async_method_builder_types),
+                  target.type.name) == std::end(async_method_builder_types)) {
+      continue;
+    }
+
+    // *** Extract the TResult signature from the builder instantiation:
+    //     GENERICINST (CLASS|VALUETYPE) TypeDefOrRefEncoded GenArgCount TResult
+    //     Non generic builders use object as the result type.
+    PCCOR_SIGNATURE resultSignature = objectSignature;
+    ULONG resultSignatureLength = sizeof(objectSignature);
+    bool isGenericBuilder = target.type.type_spec != mdTypeSpecNil;
+    if (isGenericBuilder) {
+      PCCOR_SIGNATURE builderSignature = nullptr;
+      ULONG builderSignatureLength = 0;
+      hr = metaImport->GetTypeSpecFromToken(target.type.type_spec, &builderSignature, &builderSignatureLength);
+      if (FAILED(hr) || builderSignatureLength < 4) {
+        Warn("*** CallTarget_AsyncMoveNextRewriterCallback(): The builder TypeSpec cannot be read for ", moveNext->type.name);
+        methodHandler->SetRewriteFailure("unreadable async method builder"_W);
+        return E_FAIL;
+      }
+      ULONG offset = 2;
+      mdToken builderToken = mdTokenNil;
+      ULONG genericArgumentsCount = 0;
+      offset += CorSigUncompressToken(&builderSignature[offset], &builderToken);
+      offset += CorSigUncompressData(&builderSignature[offset], &genericArgumentsCount);
+      if (genericArgumentsCount != 1 || offset >= builderSignatureLength) {
+        Warn("*** CallTarget_AsyncMoveNextRewriterCallback(): Unexpected builder TypeSpec for ", moveNext->type.name);
+        methodHandler->SetRewriteFailure("unexpected async method builder"_W);
+        return E_FAIL;
+      }
+      resultSignature = &builderSignature[offset];
+      resultSignatureLength = builderSignatureLength - offset;
+    }
+
+    // *** Emit the completion notification right before the builder call
+    reWriterWrapper.SetILPosition(pInstr);
+    ILInstr* endAsyncMethodInstr;
+    if (isSetException) {
+      reWriterWrapper.Duplicate();
+      hr = callTargetTokens->WriteEndAsyncMethodException(
+          &reWriterWrapper, wrapper_type_ref, &caller->type, resultSignature,
+          resultSignatureLength, &endAsyncMethodInstr);
+    } else if (isGenericBuilder) {
+      hr = callTargetTokens->WriteEndAsyncMethodResult(
+          &reWriterWrapper, wrapper_type_ref, &caller->type, resultSignature,
+          resultSignatureLength, &endAsyncMethodInstr);
+    } else {
+      hr = callTargetTokens->WriteEndAsyncMethodVoid(
+          &reWriterWrapper, wrapper_type_ref, &caller->type,
+          &endAsyncMethodInstr);
+    }
+    if (FAILED(hr)) {
+      return hr;
+    }
+    completionCalls++;
+  }
+
+  if (completionCalls == 0) {
+    Warn("*** CallTarget_AsyncMoveNextRewriterCallback(): No SetResult/SetException calls were found in ",
+         moveNext->type.name, ".", moveNext->name);
+    return S_FALSE;
+  }
+
+  // *** Find the state field of the state machine, the MoveNext reads it before anything else
+  mdToken stateFieldToken = mdTokenNil;
+  for (ILInstr* pInstr = rewriter.GetILList()->m_pNext;
+       pInstr != rewriter.GetILList() && stateFieldToken == mdTokenNil; pInstr = pInstr->m_pNext) {
+    if (pInstr->m_opcode != CEE_LDFLD) {
+      continue;
+    }
+    WCHAR fieldName[kNameMaxSize]{};
+    ULONG fieldNameLength = 0;
+    mdToken fieldParent = mdTokenNil;
+    if (TypeFromToken(pInstr->m_Arg32) == mdtFieldDef) {
+      hr = metaImport->GetFieldProps(pInstr->m_Arg32, &fieldParent, fieldName, kNameMaxSize, &fieldNameLength,
+                                     nullptr, nullptr, nullptr, nullptr, nullptr, nullptr);
+    } else {
+      hr = metaImport->GetMemberRefProps(pInstr->m_Arg32, &fieldParent, fieldName, kNameMaxSize, &fieldNameLength,
+                                         nullptr, nullptr);
+    }
+    if (SUCCEEDED(hr) && WSTRING(fieldName) == async_state_machine_state_field_name) {
+      stateFieldToken = pInstr->m_Arg32;
+    }
+  }
+  if (stateFieldToken == mdTokenNil) {
+    Warn("*** CallTarget_AsyncMoveNextRewriterCallback(): The state field was not found in ",
+         moveNext->type.name, ".", moveNext->name);
+    methodHandler->SetRewriteFailure("async state machine without state field"_W);
+    return E_FAIL;
+  }
+
+  // *** Take the CallTarget state of the async method on the first run of the state machine
+  ILInstr* enterAsyncMethodInstr;
+  reWriterWrapper.SetILPosition(rewriter.GetILList()->m_pNext);
+  reWriterWrapper.LoadArgument(0);
+  reWriterWrapper.LoadField(stateFieldToken);
+  IfFailRet(callTargetTokens->WriteEnterAsyncMethod(&reWriterWrapper, wrapper_type_ref, &caller->type,
+                                                    &enterAsyncMethodInstr));
+
+  if (dump_il_rewrite_enabled) {
+    Info(original_code);
+    Info(GetILCodes("*** CallTarget_AsyncMoveNextRewriterCallback(): Modified Code: ",
+                    &rewriter, *moveNext, module_metadata));
+  }
+
+  if (configuration_->il_optimizations_enabled) {
+    rewriter.PeepholeOptimize();
+  }
+
+  hr = rewriter.Export();
+
+  if (FAILED(hr)) {
+    Warn(
+        "*** CallTarget_AsyncMoveNextRewriterCallback(): Call to ILRewriter.Export() failed for "
+        "ModuleID=",
+        module_id, " ", function_token);
+    return hr;
+  }
+  CountRewrite(rewriter);
+
+  Info("*** CallTarget_AsyncMoveNextRewriterCallback() Finished: ", moveNext->type.name, ".",
+       moveNext->name, "() [AsyncMethod=", caller->type.name, ".", caller->name,
+       ", IntegrationType=", method_replacement->wrapper_method.type_name,
+       ", CompletionCalls=", completionCalls, "]");
   return S_OK;
 }
 
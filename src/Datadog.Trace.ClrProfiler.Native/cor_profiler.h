@@ -9,13 +9,21 @@
 #include "cor.h"
 #include "corprof.h"
 
+#include "assembly_classifier.h"
+#include "callback_recorder.h"
+#include "configuration.h"
 #include "cor_profiler_base.h"
 #include "environment_variables.h"
+#include "instrumentation_plan.h"
 #include "integration.h"
+#include "integration_directory.h"
+#include "module_analysis_pool.h"
 #include "module_metadata.h"
 #include "pal.h"
 #include "il_rewriter.h"
+#include "profiler_metrics.h"
 #include "rejit_handler.h"
+#include "rewrite_quarantine.h"
 
 namespace trace {
 
@@ -23,7 +31,14 @@ class CorProfiler : public CorProfilerBase {
  private:
   std::atomic_bool is_attached_ = {false};
   RuntimeInformation runtime_information_;
-  std::vector<IntegrationMethod> integration_methods_;
+  // Settings read in Initialize
+  std::shared_ptr<const Configuration> configuration_;
+  // Built in Initialize from the skip lists and the configuration
+  AssemblyClassifier* assembly_classifier = nullptr;
+  // Reference to the managed profiler added by GetAssemblyReferences
+  AssemblyReferenceInfo* managed_profiler_reference_info = nullptr;
+  // Integration catalog by target assembly, built in Initialize
+  IntegrationDirectory* integration_directory = nullptr;
 
   // Startup helper variables
   bool first_jit_compilation_completed = false;
@@ -41,10 +56,26 @@ class CorProfiler : public CorProfilerBase {
   // CallTarget Members
   //
   RejitHandler* rejit_handler = nullptr;
+  ModuleAnalysisPool* module_analysis_pool = nullptr;
+  RewriteQuarantine* rewrite_quarantine = nullptr;
+
+  // Instrumentation plans of previously seen module versions, if enabled
+  InstrumentationPlanCache* instrumentation_plan_cache = nullptr;
+
+  // Records the callbacks for the profiler harness, if enabled
+  CallbackRecorder* callback_recorder = nullptr;
 
   // Cor assembly properties
   AssemblyProperty corAssemblyProperty{};
 
+  // Path of the managed loader extracted from the embedded image, empty if the
+  // loader is loaded from a byte array. The verified file stays open until the
+  // profiler is destroyed.
+  std::mutex managed_loader_lock_;
+  bool managed_loader_extracted_ = false;
+  WSTRING managed_loader_path_;
+  ProtectedFile managed_loader_file_;
+
   //
   // OpCodes helper
   //
@@ -56,6 +87,13 @@ class CorProfiler : public CorProfilerBase {
   std::mutex module_id_to_info_map_lock_;
   std::unordered_map<ModuleID, ModuleMetadata*> module_id_to_info_map_;
 
+  // Latencies of the callbacks and counters, read by GetProfilerMetrics
+  ProfilerMetrics metrics_;
+
+  // Locks module_id_to_info_map_lock_, the wait is measured
+  std::unique_lock<std::mutex> LockModuleMap();
+  void CountRewrite(ILRewriter& rewriter);
+
   //
   // Helper methods
   //
@@ -69,13 +107,13 @@ class CorProfiler : public CorProfilerBase {
                                          const ModuleID module_id,
                                          const mdToken function_token,
                                          const FunctionInfo& caller,
-                                         const std::vector<MethodReplacement> method_replacements);
+                                         const std::vector<const MethodReplacement*>& method_replacements);
   HRESULT ProcessInsertionCalls(ModuleMetadata* module_metadata,
                                          const FunctionID function_id,
                                          const ModuleID module_id,
                                          const mdToken function_token,
                                          const FunctionInfo& caller,
-                                         const std::vector<MethodReplacement> method_replacements);
+                                         const std::vector<const MethodReplacement*>& method_replacements);
   bool ProfilerAssemblyIsLoadedIntoAppDomain(AppDomainID app_domain_id);
   std::string GetILCodes(const std::string& title, ILRewriter* rewriter,
                          const FunctionInfo& caller,
@@ -88,16 +126,41 @@ class CorProfiler : public CorProfilerBase {
                              const mdToken function_token);
   HRESULT GenerateVoidILStartupMethod(const ModuleID module_id,
                            mdMethodDef* ret_method_token);
+  WSTRING ExtractManagedLoader();
   HRESULT AddIISPreStartInitFlags(const ModuleID module_id,
                            const mdToken function_token);
+  bool ResolveInstrumentationPlan(const InstrumentationPlan& plan,
+                                  const WSTRING& assembly_name,
+                                  std::vector<IntegrationMethod>* integrations);
+  void StoreInstrumentationPlan(const GUID& module_version_id,
+                                unsigned long long candidates_hash,
+                                const std::vector<IntegrationMethod>& integrations,
+                                InstrumentationPlan& plan);
 
   //
   // CallTarget Methods
   //
   size_t CallTarget_RequestRejitForModule(
     ModuleID module_id, ModuleMetadata* module_metadata,
-    const std::vector<IntegrationMethod>& filtered_integrations);
+    const std::vector<IntegrationMethod>& filtered_integrations,
+    InstrumentationPlan* plan = nullptr);
+  size_t CallTarget_ReplayInstrumentationPlan(
+    ModuleID module_id, ModuleMetadata* module_metadata,
+    const InstrumentationPlan& plan);
+  void CallTarget_AddRejitMethod(
+    ModuleID module_id, ModuleMetadata* module_metadata,
+    const IntegrationMethod& integration, mdMethodDef methodDef,
+    FunctionInfo* functionInfo, bool async_state_machine_enabled,
+    std::vector<ModuleID>& vtModules, std::vector<mdMethodDef>& vtMethodDefs);
+  void CallTarget_AnalyzeModule(ModuleID module_id, ModuleMetadata* module_metadata);
+  bool CallTarget_EnsureModuleAnalyzed(ModuleID module_id, ModuleMetadata* module_metadata,
+                                       std::unique_lock<std::mutex>& guard);
+  void CallTarget_QuarantineMethod(ModuleID module_id, mdMethodDef methodDef, HRESULT hr);
   HRESULT CallTarget_RewriterCallback(RejitHandlerModule* moduleHandler, RejitHandlerModuleMethod* methodHandler);
+  HRESULT CallTarget_AsyncMoveNextRewriterCallback(RejitHandlerModule* moduleHandler, RejitHandlerModuleMethod* methodHandler);
+  HRESULT CallTarget_PrepareAsyncMoveNext(RejitHandlerModule* moduleHandler, RejitHandlerModuleMethod* moveNextHandler);
+  HRESULT CallTarget_RewriteAsyncMoveNext(RejitHandlerModule* moduleHandler, RejitHandlerModuleMethod* methodHandler,
+                                          ICorProfilerFunctionControl* pFunctionControl);
 
  public:
   CorProfiler() = default;
@@ -107,6 +170,10 @@ class CorProfiler : public CorProfilerBase {
   void GetAssemblyAndSymbolsBytes(BYTE** pAssemblyArray, int* assemblySize,
                                  BYTE** pSymbolsArray, int* symbolsSize) const;
 
+  WSTRING GetRewriteQuarantine() const;
+
+  const ProfilerMetrics& GetMetrics() const { return metrics_; }
+
   //
   // ICorProfilerCallback methods
   //
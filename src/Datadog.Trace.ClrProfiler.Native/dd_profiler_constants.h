@@ -12,6 +12,7 @@ namespace trace {
     environment::tracing_enabled,
     environment::debug_enabled,
     environment::calltarget_enabled,
+    environment::calltarget_async_state_machine_enabled,
     environment::profiler_home_path,
     environment::integrations_path,
     environment::include_process_names,
@@ -24,8 +25,17 @@ namespace trace {
     environment::disabled_integrations,
     environment::log_path,
     environment::log_directory,
+    environment::clr_config_file,
     environment::clr_disable_optimizations,
     environment::clr_enable_inlining,
+    environment::clr_enable_il_optimizations,
+    environment::clr_module_analysis_threads,
+    environment::clr_skip_assembly_prefixes,
+    environment::clr_skip_assemblies,
+    environment::clr_instrumentation_plan_cache,
+    environment::clr_rewrite_quarantine_path,
+    environment::clr_managed_loader_directory,
+    environment::clr_callback_recording_path,
     environment::domain_neutral_instrumentation,
     environment::dump_il_rewrite_enabled,
     environment::netstandard_enabled,
@@ -70,6 +80,22 @@ namespace trace {
 
   inline WSTRING calltarget_modification_action = "CallTargetModification"_W;
 
+  inline WSTRING async_state_machine_attribute_name = "System.Runtime.CompilerServices.AsyncStateMachineAttribute"_W;
+
+  inline WSTRING async_state_machine_movenext_name = "MoveNext"_W;
+
+  inline WSTRING async_state_machine_state_field_name = "<>1__state"_W;
+
+  inline WSTRING async_builder_setresult_name = "SetResult"_W;
+
+  inline WSTRING async_builder_setexception_name = "SetException"_W;
+
+  inline WSTRING async_method_builder_types[]{
+      "System.Runtime.CompilerServices.AsyncTaskMethodBuilder"_W,
+      "System.Runtime.CompilerServices.AsyncTaskMethodBuilder`1"_W,
+      "System.Runtime.CompilerServices.AsyncValueTaskMethodBuilder"_W,
+      "System.Runtime.CompilerServices.AsyncValueTaskMethodBuilder`1"_W};
+
 }  // namespace trace
 
 #endif  // DD_PROFILER_CONSTANTS_H
\ No newline at end of file
@@ -6,6 +6,10 @@
 namespace trace {
 namespace environment {
 
+// Sets the path of a file with default values for the settings of the
+// profiler, one NAME=value per line. Environment variables take precedence.
+const WSTRING clr_config_file = "DD_CLR_CONFIG_FILE"_W;
+
 // Sets whether the profiler is enabled. Default is true.
 // Setting this to false disabled the profiler entirely.
 const WSTRING tracing_enabled = "DD_TRACE_ENABLED"_W;
@@ -109,6 +113,54 @@ const WSTRING clr_enable_inlining = "DD_CLR_ENABLE_INLINING"_W;
 // Sets whether to enable the CallTarget instrumentation mode
 const WSTRING calltarget_enabled = "DD_TRACE_CALLTARGET_ENABLED"_W;
 
+// Sets whether CallTarget instruments the completion of async methods inside
+// their compiler generated state machine instead of attaching continuations
+// to the returned Task. Default is false.
+const WSTRING calltarget_async_state_machine_enabled =
+    "DD_TRACE_CALLTARGET_ASYNC_STATE_MACHINE_ENABLED"_W;
+
+// Sets whether to run the peephole optimizer over the rewritten IL before it
+// is handed to the JIT. Default is false.
+const WSTRING clr_enable_il_optimizations = "DD_CLR_ENABLE_IL_OPTIMIZATIONS"_W;
+
+// Sets additional assembly name prefixes the profiler doesn't instrument.
+// Supports multiple values separated with semi-colons, for example:
+// "MyCompany.Internal;Contoso.Generated"
+const WSTRING clr_skip_assembly_prefixes = "DD_CLR_SKIP_ASSEMBLY_PREFIXES"_W;
+
+// Sets additional assembly names the profiler doesn't instrument.
+// Supports multiple values separated with semi-colons.
+const WSTRING clr_skip_assemblies = "DD_CLR_SKIP_ASSEMBLIES"_W;
+
+// Sets the number of background threads that analyze the loaded modules for
+// CallTarget. 0 analyzes each module on the thread that loads it.
+// Default is 2.
+const WSTRING clr_module_analysis_threads = "DD_CLR_MODULE_ANALYSIS_THREADS"_W;
+
+// Sets the directory of the instrumentation plans cached per module version.
+// The plans can also be generated ahead of time with the plan generator.
+// Default is empty (no cache).
+const WSTRING clr_instrumentation_plan_cache =
+    "DD_CLR_INSTRUMENTATION_PLAN_CACHE"_W;
+
+// Sets the file where the methods whose CallTarget rewrite failed are kept, so
+// the same profiler version doesn't instrument them again after a restart.
+// Default is empty (the quarantine only lasts for the process).
+const WSTRING clr_rewrite_quarantine_path = "DD_CLR_REWRITE_QUARANTINE_PATH"_W;
+
+// Sets the directory where the embedded managed loader is extracted once, so
+// every AppDomain loads it from that file instead of copying the embedded
+// bytes into managed arrays. The directory must be owned by the user of the
+// process and not writable by its group or by others, otherwise the loader is
+// loaded from a byte array. Default is empty (load from a byte array).
+const WSTRING clr_managed_loader_directory =
+    "DD_CLR_MANAGED_LOADER_DIRECTORY"_W;
+
+// Sets the file where the profiler callbacks are recorded, for the profiler
+// harness to replay them offline. Default is empty (no recording).
+const WSTRING clr_callback_recording_path =
+    "DD_CLR_CALLBACK_RECORDING_PATH"_W;
+
 }  // namespace environment
 }  // namespace trace
 
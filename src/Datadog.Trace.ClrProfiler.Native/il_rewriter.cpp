@@ -6,6 +6,13 @@
 
 #include "il_rewriter.h"
 
+#include <algorithm>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "sig_helpers.h"
+
 #undef IfFailRet
 #define IfFailRet(EXPR)  \
   do {                   \
@@ -104,6 +111,163 @@ static int k_rgnStackPushes[] = {
     0  // CEE_SWITCH_ARG
 };
 
+// Marker for the instructions whose stack behaviour depends on a signature
+static const int k_nVarPop = -1;
+
+static const int k_rgnStackPops[] = {
+
+#define OPDEF(c, s, pop, push, args, type, l, s1, s2, ctrl) pop,
+
+#define Pop0 0
+#define Pop1 1
+#define PopI 1
+#define PopI8 1
+#define PopR4 1
+#define PopR8 1
+#define PopRef 1
+#define VarPop k_nVarPop
+
+#include "opcode.def"
+
+#undef Pop0
+#undef Pop1
+#undef PopI
+#undef PopI8
+#undef PopR4
+#undef PopR8
+#undef PopRef
+#undef VarPop
+#undef OPDEF
+    0, // CEE_COUNT
+    0  // CEE_SWITCH_ARG
+};
+
+enum ILFlowControl {
+  ILFlowNext,
+  ILFlowBranch,
+  ILFlowCondBranch,
+  ILFlowCall,
+  ILFlowReturn,
+  ILFlowThrow,
+  ILFlowMeta,
+  ILFlowBreak
+};
+
+static const BYTE k_rgbFlowControl[] = {
+
+#define OPDEF(c, s, pop, push, args, type, l, s1, s2, ctrl) ctrl,
+
+#define NEXT ILFlowNext
+#define BRANCH ILFlowBranch
+#define COND_BRANCH ILFlowCondBranch
+#define CALL ILFlowCall
+#define RETURN ILFlowReturn
+#define THROW ILFlowThrow
+#define META ILFlowMeta
+#define BREAK ILFlowBreak
+
+#include "opcode.def"
+
+#undef NEXT
+#undef BRANCH
+#undef COND_BRANCH
+#undef CALL
+#undef RETURN
+#undef THROW
+#undef META
+#undef BREAK
+#undef OPDEF
+    ILFlowNext, // CEE_COUNT
+    ILFlowNext  // CEE_SWITCH_ARG
+};
+
+// Default size of the arena blocks, big enough for the import and export of
+// most methods in a single block.
+static const size_t k_ArenaBlockSize = 64 * 1024;
+
+// Maximum number of blocks kept per thread for reuse.
+static const size_t k_ArenaMaxPooledBlocks = 4;
+
+static const size_t k_ArenaAlignment = alignof(std::max_align_t);
+
+static size_t ArenaAlignUp(size_t size) {
+  return (size + k_ArenaAlignment - 1) & ~(k_ArenaAlignment - 1);
+}
+
+struct ILRewriterArenaPool {
+  void* m_pFree[k_ArenaMaxPooledBlocks];
+  size_t m_nFree;
+
+  ILRewriterArenaPool() : m_nFree(0) {}
+
+  ~ILRewriterArenaPool() {
+    while (m_nFree > 0) {
+      free(m_pFree[--m_nFree]);
+    }
+  }
+};
+
+static thread_local ILRewriterArenaPool t_arenaPool;
+
+ILRewriterArena::ILRewriterArena() : m_pBlocks(nullptr) {}
+
+ILRewriterArena::~ILRewriterArena() {
+  Block* pBlock = m_pBlocks;
+  while (pBlock != nullptr) {
+    Block* pNext = pBlock->m_pNext;
+    if (pBlock->m_size == k_ArenaBlockSize &&
+        t_arenaPool.m_nFree < k_ArenaMaxPooledBlocks) {
+      t_arenaPool.m_pFree[t_arenaPool.m_nFree++] = pBlock;
+    } else {
+      free(pBlock);
+    }
+    pBlock = pNext;
+  }
+}
+
+ILRewriterArena::Block* ILRewriterArena::NewBlock(size_t minSize) {
+  Block* pBlock = nullptr;
+  size_t size = k_ArenaBlockSize;
+
+  if (minSize > k_ArenaBlockSize) {
+    // Oversized allocations (huge methods) get their own block and are not pooled
+    size = minSize;
+    pBlock = (Block*)malloc(ArenaAlignUp(sizeof(Block)) + size);
+  } else if (t_arenaPool.m_nFree > 0) {
+    pBlock = (Block*)t_arenaPool.m_pFree[--t_arenaPool.m_nFree];
+  } else {
+    pBlock = (Block*)malloc(ArenaAlignUp(sizeof(Block)) + size);
+  }
+
+  if (pBlock == nullptr) {
+    return nullptr;
+  }
+
+  pBlock->m_size = size;
+  pBlock->m_used = 0;
+  pBlock->m_pNext = m_pBlocks;
+  m_pBlocks = pBlock;
+  return pBlock;
+}
+
+void* ILRewriterArena::Alloc(size_t size) {
+  size = ArenaAlignUp(size == 0 ? 1 : size);
+
+  Block* pBlock = m_pBlocks;
+  if (pBlock == nullptr || pBlock->m_size - pBlock->m_used < size) {
+    pBlock = NewBlock(size);
+    if (pBlock == nullptr) {
+      return nullptr;
+    }
+  }
+
+  BYTE* pMemory =
+      (BYTE*)pBlock + ArenaAlignUp(sizeof(Block)) + pBlock->m_used;
+  pBlock->m_used += size;
+  ZeroMemory(pMemory, size);
+  return pMemory;
+}
+
 ILRewriter::ILRewriter(
     ICorProfilerInfo* pICorProfilerInfo,
     ICorProfilerFunctionControl* pICorProfilerFunctionControl,
@@ -116,7 +280,9 @@ ILRewriter::ILRewriter(
       m_pEH(nullptr),
       m_pOffsetToInstr(nullptr),
       m_pOutputBuffer(nullptr),
-      m_pIMethodMalloc(nullptr) {
+      m_exportedSize(0),
+      m_pIMethodMalloc(nullptr),
+      m_pMetadataImport(nullptr) {
   m_IL.m_pNext = &m_IL;
   m_IL.m_pPrev = &m_IL;
 
@@ -124,15 +290,11 @@ ILRewriter::ILRewriter(
 }
 
 ILRewriter::~ILRewriter() {
-  ILInstr* p = m_IL.m_pNext;
-  while (p != &m_IL) {
-    ILInstr* t = p->m_pNext;
-    delete p;
-    p = t;
+  // Instructions, EH clauses and buffers are owned by the arena
+
+  if (m_pMetadataImport) {
+    m_pMetadataImport->Release();
   }
-  delete[] m_pEH;
-  delete[] m_pOffsetToInstr;
-  delete[] m_pOutputBuffer;
 
   if (m_pIMethodMalloc) {
     m_pIMethodMalloc->Release();
@@ -159,6 +321,10 @@ unsigned ILRewriter::GetEHCount() { return m_nEH; }
 
 EHClause* ILRewriter::GetEHPointer() { return m_pEH; }
 
+EHClause* ILRewriter::NewEHClauses(unsigned ehLength) {
+  return m_arena.AllocArray<EHClause>(ehLength);
+}
+
 void ILRewriter::SetEHClause(EHClause* ehPointer, unsigned ehLength) {
   m_nEH = ehLength;
   m_pEH = ehPointer;
@@ -186,17 +352,82 @@ HRESULT ILRewriter::Import() {
   return S_OK;
 }
 
+// Counts the instructions (including CEE_SWITCH_ARG entries) of an IL body
+// so the import can decode them into a single contiguous array.
+static HRESULT CountILInstrs(LPCBYTE pIL, unsigned codeSize,
+                             unsigned* pCount) {
+  unsigned count = 0;
+  unsigned offset = 0;
+  while (offset < codeSize) {
+    unsigned opcode = pIL[offset++];
+
+    if (opcode == CEE_PREFIX1) {
+      if (offset >= codeSize) {
+        return COR_E_INVALIDPROGRAM;
+      }
+      opcode = 0x100 + pIL[offset++];
+    }
+
+    if (opcode >= CEE_COUNT) {
+      return COR_E_INVALIDPROGRAM;
+    }
+
+    BYTE flags = s_OpCodeFlags[opcode];
+    count++;
+
+    if (flags == (0 | OPCODEFLAGS_Switch)) {
+      if (offset + sizeof(INT32) > codeSize) {
+        return COR_E_INVALIDPROGRAM;
+      }
+      unsigned nTargets = *(UNALIGNED INT32*)&(pIL[offset]);
+      offset += sizeof(INT32);
+      if (nTargets > (codeSize - offset) / sizeof(INT32)) {
+        return COR_E_INVALIDPROGRAM;
+      }
+      count += nTargets;
+      offset += nTargets * sizeof(INT32);
+    }
+
+    offset += (flags & OPCODEFLAGS_SizeMask);
+  }
+
+  *pCount = count;
+  return S_OK;
+}
+
+void ILRewriter::LinkImportedILInstrs() {
+  // The list is still what the callers walk and splice into. The header max
+  // stack already accounts for the original instructions.
+  ILInstr* pPrev = &m_IL;
+  for (ILInstr& instr : m_imported) {
+    instr.m_pPrev = pPrev;
+    pPrev->m_pNext = &instr;
+    pPrev = &instr;
+  }
+  pPrev->m_pNext = &m_IL;
+  m_IL.m_pPrev = pPrev;
+  m_nInstrs = static_cast<unsigned>(m_imported.size());
+}
+
 HRESULT ILRewriter::ImportIL(LPCBYTE pIL) {
-  m_pOffsetToInstr = new ILInstr*[m_CodeSize + 1];
+  if (!m_imported.empty() || m_IL.m_pNext != &m_IL) {
+    return COR_E_INVALIDOPERATION;
+  }
+
+  m_pOffsetToInstr = m_arena.AllocArray<ILInstr*>(m_CodeSize + 1);
   IfNullRet(m_pOffsetToInstr);
 
-  ZeroMemory(m_pOffsetToInstr, m_CodeSize * sizeof(ILInstr*));
+  unsigned nInstrs;
+  IfFailRet(CountILInstrs(pIL, m_CodeSize, &nInstrs));
+  // Never resized afterwards, the instructions don't move
+  m_imported.resize(nInstrs);
 
   // Set the sentinel instruction
   m_pOffsetToInstr[m_CodeSize] = &m_IL;
   m_IL.m_opcode = -1;
 
   bool fBranch = false;
+  unsigned iInstr = 0;
   unsigned offset = 0;
   while (offset < m_CodeSize) {
     unsigned startOffset = offset;
@@ -225,13 +456,10 @@ HRESULT ILRewriter::ImportIL(LPCBYTE pIL) {
       return COR_E_INVALIDPROGRAM;
     }
 
-    ILInstr* pInstr = NewILInstr();
-    IfNullRet(pInstr);
+    ILInstr* pInstr = &m_imported[iInstr++];
 
     pInstr->m_opcode = opcode;
 
-    InsertBefore(&m_IL, pInstr);
-
     m_pOffsetToInstr[startOffset] = pInstr;
 
     switch (flags) {
@@ -258,10 +486,7 @@ HRESULT ILRewriter::ImportIL(LPCBYTE pIL) {
         fBranch = true;
         break;
       case 0 | OPCODEFLAGS_Switch: {
-        if (offset + sizeof(INT32) > m_CodeSize) {
-          return COR_E_INVALIDPROGRAM;
-        }
-
+        // The bounds of the targets were checked by CountILInstrs
         unsigned nTargets = *(UNALIGNED INT32*)&(pIL[offset]);
         pInstr->m_Arg32 = nTargets;
         offset += sizeof(INT32);
@@ -269,19 +494,12 @@ HRESULT ILRewriter::ImportIL(LPCBYTE pIL) {
         unsigned base = offset + nTargets * sizeof(INT32);
 
         for (unsigned iTarget = 0; iTarget < nTargets; iTarget++) {
-          if (offset + sizeof(INT32) > m_CodeSize) {
-            return COR_E_INVALIDPROGRAM;
-          }
-
-          pInstr = NewILInstr();
-          IfNullRet(pInstr);
+          pInstr = &m_imported[iInstr++];
 
           pInstr->m_opcode = CEE_SWITCH_ARG;
 
           pInstr->m_Arg32 = base + *(UNALIGNED INT32*)&(pIL[offset]);
           offset += sizeof(INT32);
-
-          InsertBefore(&m_IL, pInstr);
         }
         fBranch = true;
         break;
@@ -292,20 +510,20 @@ HRESULT ILRewriter::ImportIL(LPCBYTE pIL) {
     offset += size;
   }
 
-  if (offset != m_CodeSize) {
+  if (offset != m_CodeSize || iInstr != nInstrs) {
     return COR_E_INVALIDPROGRAM;
   }
 
   if (fBranch) {
     // Go over all control flow instructions and resolve the targets
-    for (ILInstr* pInstr = m_IL.m_pNext; pInstr != &m_IL;
-         pInstr = pInstr->m_pNext) {
-      if (s_OpCodeFlags[pInstr->m_opcode] & OPCODEFLAGS_BranchTarget) {
-        IfFailRet(GetInstrFromOffset(pInstr->m_Arg32, &pInstr->m_pTarget));
+    for (ILInstr& instr : m_imported) {
+      if (s_OpCodeFlags[instr.m_opcode] & OPCODEFLAGS_BranchTarget) {
+        IfFailRet(GetInstrFromOffset(instr.m_Arg32, &instr.m_pTarget));
       }
     }
   }
 
+  LinkImportedILInstrs();
   return S_OK;
 }
 
@@ -319,7 +537,7 @@ HRESULT ILRewriter::ImportEH(const COR_ILMETHOD_SECT_EH* pILEH, unsigned nEH) {
 
   if (nEH == 0) return S_OK;
 
-  IfNullRet(m_pEH = new EHClause[m_nEH]);
+  IfNullRet(m_pEH = NewEHClauses(m_nEH));
   for (unsigned iEH = 0; iEH < m_nEH; iEH++) {
     // If the EH clause is in tiny form, the call to pILEH->EHClause() below
     // will use this as a scratch buffer to expand the EH clause into its fat
@@ -357,8 +575,7 @@ HRESULT ILRewriter::ImportEH(const COR_ILMETHOD_SECT_EH* pILEH, unsigned nEH) {
 }
 
 ILInstr* ILRewriter::NewILInstr() {
-  m_nInstrs++;
-  return new ILInstr();
+  return m_arena.AllocArray<ILInstr>(1);
 }
 
 HRESULT ILRewriter::GetInstrFromOffset(unsigned offset, ILInstr** ppInstr) {
@@ -381,6 +598,8 @@ void ILRewriter::InsertBefore(ILInstr* pWhere, ILInstr* pWhat) {
   pWhat->m_pNext->m_pPrev = pWhat;
   pWhat->m_pPrev->m_pNext = pWhat;
 
+  m_splices.push_back({pWhere, pWhat, false});
+  m_nInstrs++;
   AdjustState(pWhat);
 }
 
@@ -391,6 +610,8 @@ void ILRewriter::InsertAfter(ILInstr* pWhere, ILInstr* pWhat) {
   pWhat->m_pNext->m_pPrev = pWhat;
   pWhat->m_pPrev->m_pNext = pWhat;
 
+  m_splices.push_back({pWhere, pWhat, true});
+  m_nInstrs++;
   AdjustState(pWhat);
 }
 
@@ -400,147 +621,755 @@ void ILRewriter::AdjustState(ILInstr* pNewInstr) {
 
 ILInstr* ILRewriter::GetILList() { return &m_IL; }
 
-HRESULT ILRewriter::Export() {
-  // One instruction produces 2 + sizeof(native int) bytes in the worst case
-  // which can be 10 bytes for 64-bit. For simplification we just use 10 here.
-  unsigned maxSize = m_nInstrs * 10;
+HRESULT ILRewriter::EnsureMetadataImport() {
+  if (m_pMetadataImport == nullptr) {
+    IfFailRet(m_pICorProfilerInfo->GetModuleMetaData(
+        m_moduleId, ofRead, IID_IMetaDataImport2,
+        (IUnknown**)&m_pMetadataImport));
+  }
+  return S_OK;
+}
 
-  m_pOutputBuffer = new BYTE[maxSize];
-  IfNullRet(m_pOutputBuffer);
+HRESULT ILRewriter::GetCallStackEffect(ILInstr* pInstr, int* pPops,
+                                       int* pPushes) {
+  IfFailRet(EnsureMetadataImport());
 
-again:
-  BYTE* pIL = m_pOutputBuffer;
+  mdToken token = pInstr->m_Arg32;
+  PCCOR_SIGNATURE pSig = nullptr;
+  ULONG cbSig = 0;
 
-  bool fBranch = false;
-  unsigned offset = 0;
+  if (TypeFromToken(token) == mdtMethodSpec) {
+    IfFailRet(m_pMetadataImport->GetMethodSpecProps(token, &token, nullptr,
+                                                    nullptr));
+  }
+
+  switch (TypeFromToken(token)) {
+    case mdtMethodDef:
+      IfFailRet(m_pMetadataImport->GetMethodProps(
+          token, nullptr, nullptr, 0, nullptr, nullptr, &pSig, &cbSig, nullptr,
+          nullptr));
+      break;
+    case mdtMemberRef:
+      IfFailRet(m_pMetadataImport->GetMemberRefProps(
+          token, nullptr, nullptr, 0, nullptr, &pSig, &cbSig));
+      break;
+    case mdtSignature:
+      IfFailRet(m_pMetadataImport->GetSigFromToken(token, &pSig, &cbSig));
+      break;
+    default:
+      return E_FAIL;
+  }
+
+  PCCOR_SIGNATURE pSigEnd = pSig + cbSig;
+  if (cbSig < 3) {
+    return E_FAIL;
+  }
+
+  ULONG callConv = CorSigUncompressCallingConv(pSig);
+  ULONG data;
+  if (callConv & IMAGE_CEE_CS_CALLCONV_GENERIC) {
+    pSig += CorSigUncompressData(pSig, &data);
+  }
+  ULONG paramCount;
+  pSig += CorSigUncompressData(pSig, &paramCount);
+
+  // Skip the custom modifiers of the return type
+  while (pSig < pSigEnd && (*pSig == ELEMENT_TYPE_CMOD_REQD ||
+                            *pSig == ELEMENT_TYPE_CMOD_OPT)) {
+    pSig++;
+    mdToken modifierToken;
+    pSig += CorSigUncompressToken(pSig, &modifierToken);
+  }
+  if (pSig >= pSigEnd) {
+    return E_FAIL;
+  }
+
+  bool hasThis = (callConv & IMAGE_CEE_CS_CALLCONV_HASTHIS) != 0 &&
+                 (callConv & IMAGE_CEE_CS_CALLCONV_EXPLICITTHIS) == 0;
+  int pops = static_cast<int>(paramCount);
+  int pushes = (*pSig == ELEMENT_TYPE_VOID) ? 0 : 1;
+
+  switch (pInstr->m_opcode) {
+    case CEE_NEWOBJ:
+      // The instance is created by newobj itself
+      pushes = 1;
+      break;
+    case CEE_CALLI:
+      // Function pointer
+      pops += (hasThis ? 1 : 0) + 1;
+      break;
+    default:
+      pops += (hasThis ? 1 : 0);
+      break;
+  }
+
+  *pPops = pops;
+  *pPushes = pushes;
+  return S_OK;
+}
+
+static const unsigned k_NoSplice = static_cast<unsigned>(-1);
+
+// Heads of the splices anchored to one instruction, linked by index
+struct ILSpliceChains {
+  unsigned m_before = k_NoSplice;
+  unsigned m_lastBefore = k_NoSplice;
+  unsigned m_after = k_NoSplice;
+};
+
+HRESULT ILRewriter::GetCode(std::vector<ILInstr*>* pCode) {
+  pCode->clear();
+  pCode->reserve(m_nInstrs);
+
+  // A removed instruction is unlinked from the list, the instructions
+  // spliced next to it stay where they are
+  auto isLive = [](const ILInstr* pInstr) {
+    return pInstr->m_pNext != nullptr;
+  };
+
+  if (m_splices.empty()) {
+    for (ILInstr& instr : m_imported) {
+      if (isLive(&instr)) {
+        pCode->push_back(&instr);
+      }
+    }
+  } else {
+    // An instruction inserted before an anchor goes after the ones inserted
+    // before it earlier, and one inserted after an anchor goes before the
+    // ones inserted after it earlier, as in the list.
+    std::vector<unsigned> next(m_splices.size(), k_NoSplice);
+    std::unordered_map<const ILInstr*, ILSpliceChains> chains;
+    for (unsigned iSplice = 0; iSplice < m_splices.size(); iSplice++) {
+      const ILSplice& splice = m_splices[iSplice];
+      ILSpliceChains& anchor = chains[splice.m_pWhere];
+      if (splice.m_fAfter) {
+        next[iSplice] = anchor.m_after;
+        anchor.m_after = iSplice;
+      } else {
+        if (anchor.m_before == k_NoSplice) {
+          anchor.m_before = iSplice;
+        } else {
+          next[anchor.m_lastBefore] = iSplice;
+        }
+        anchor.m_lastBefore = iSplice;
+      }
+    }
+
+    // Depth first walk of the anchors, without recursion since every
+    // InsertAfter of the previous new instruction nests one level deeper.
+    // The second member tells if the chains of the instruction are already
+    // on the stack.
+    std::vector<std::pair<ILInstr*, bool>> stack;
+    auto pushChain = [&](unsigned iSplice) {
+      size_t first = stack.size();
+      for (; iSplice != k_NoSplice; iSplice = next[iSplice]) {
+        stack.emplace_back(m_splices[iSplice].m_pWhat, false);
+      }
+      std::reverse(stack.begin() + first, stack.end());
+    };
+    auto drain = [&]() {
+      while (!stack.empty()) {
+        std::pair<ILInstr*, bool> item = stack.back();
+        stack.pop_back();
+        ILInstr* pInstr = item.first;
+        auto anchor = item.second ? chains.end() : chains.find(pInstr);
+        if (anchor == chains.end()) {
+          if (isLive(pInstr)) {
+            pCode->push_back(pInstr);
+          }
+          continue;
+        }
+        pushChain(anchor->second.m_after);
+        stack.emplace_back(pInstr, true);
+        pushChain(anchor->second.m_before);
+      }
+    };
+
+    // Inserted after the sentinel is the start of the method, inserted
+    // before it is the end
+    auto sentinel = chains.find(&m_IL);
+    if (sentinel != chains.end()) {
+      pushChain(sentinel->second.m_after);
+      drain();
+    }
+    for (ILInstr& instr : m_imported) {
+      stack.emplace_back(&instr, false);
+      drain();
+    }
+    if (sentinel != chains.end()) {
+      pushChain(sentinel->second.m_before);
+      drain();
+    }
+  }
+
+  // The list was relinked without InsertBefore / InsertAfter
+  if (pCode->size() != m_nInstrs) {
+    return COR_E_INVALIDPROGRAM;
+  }
+  return S_OK;
+}
+
+HRESULT ILRewriter::ComputeMaxStack(const std::vector<ILInstr*>& code,
+                                    unsigned* pMaxStack) {
+  if (code.empty()) {
+    *pMaxStack = 0;
+    return S_OK;
+  }
+
+  // Until ComputeILOffsets runs, m_offset is the position in the code
+  for (unsigned iInstr = 0; iInstr < code.size(); iInstr++) {
+    code[iInstr]->m_offset = iInstr;
+    code[iInstr]->m_stackDepth = -1;
+  }
+
+  std::vector<unsigned> worklist;
+  bool fInvalidTarget = false;
+  auto propagate = [&](ILInstr* pTarget, int depth) {
+    if (pTarget == nullptr) {
+      return;
+    }
+    unsigned iTarget = pTarget->m_offset;
+    if (iTarget >= code.size() || code[iTarget] != pTarget) {
+      // Removed, or never inserted
+      fInvalidTarget = true;
+    } else if (pTarget->m_stackDepth < depth) {
+      pTarget->m_stackDepth = depth;
+      worklist.push_back(iTarget);
+    }
+  };
+
+  // Method entry and exception handler entry points (catch and filter
+  // handlers start with the exception object on the stack)
+  propagate(code[0], 0);
+  for (unsigned iEH = 0; iEH < m_nEH; iEH++) {
+    EHClause* clause = &m_pEH[iEH];
+    bool isFinallyOrFault =
+        (clause->m_Flags &
+         (COR_ILEXCEPTION_CLAUSE_FINALLY | COR_ILEXCEPTION_CLAUSE_FAULT)) != 0;
+    propagate(clause->m_pHandlerBegin, isFinallyOrFault ? 0 : 1);
+    if (clause->m_Flags & COR_ILEXCEPTION_CLAUSE_FILTER) {
+      propagate(clause->m_pFilter, 1);
+    }
+  }
 
-  // Go over all instructions and produce code for them
+  int maxStack = 0;
+  while (!worklist.empty() && !fInvalidTarget) {
+    unsigned iInstr = worklist.back();
+    worklist.pop_back();
+    int depth = code[iInstr]->m_stackDepth;
+
+    // Walk the basic block until the control flow leaves it
+    while (true) {
+      ILInstr* pInstr = code[iInstr];
+      if (depth > maxStack) {
+        maxStack = depth;
+      }
+
+      unsigned opcode = pInstr->m_opcode;
+      if (opcode > CEE_SWITCH_ARG) {
+        return COR_E_INVALIDPROGRAM;
+      }
+
+      int pops = k_rgnStackPops[opcode];
+      int pushes = k_rgnStackPushes[opcode];
+      if (opcode == CEE_RET) {
+        pops = 0;
+      } else if (pops == k_nVarPop) {
+        // Without the signature the depth after the call is unknown, any
+        // guess could under-report the max stack of the rest of the method
+        IfFailRet(GetCallStackEffect(pInstr, &pops, &pushes));
+      }
+
+      depth -= pops;
+      if (depth < 0) {
+        return COR_E_INVALIDPROGRAM;
+      }
+      depth += pushes;
+      if (depth > maxStack) {
+        maxStack = depth;
+      }
+
+      bool fallThrough = true;
+      switch (k_rgbFlowControl[opcode]) {
+        case ILFlowBranch:
+          propagate(pInstr->m_pTarget,
+                    (opcode == CEE_LEAVE || opcode == CEE_LEAVE_S) ? 0 : depth);
+          fallThrough = false;
+          break;
+        case ILFlowCondBranch:
+          // The targets of a switch are its CEE_SWITCH_ARG pseudo instructions
+          if (opcode != CEE_SWITCH) {
+            propagate(pInstr->m_pTarget, depth);
+          }
+          break;
+        case ILFlowReturn:
+        case ILFlowThrow:
+          fallThrough = false;
+          break;
+        default:
+          if (opcode == CEE_SWITCH_ARG) {
+            propagate(pInstr->m_pTarget, depth);
+          } else if (opcode == CEE_JMP) {
+            fallThrough = false;
+          }
+          break;
+      }
+
+      if (!fallThrough || iInstr + 1 == code.size() ||
+          code[iInstr + 1]->m_stackDepth >= depth) {
+        break;
+      }
+      iInstr++;
+      code[iInstr]->m_stackDepth = depth;
+    }
+  }
+
+  if (fInvalidTarget) {
+    return COR_E_INVALIDPROGRAM;
+  }
+
+  *pMaxStack = static_cast<unsigned>(maxStack);
+  return S_OK;
+}
+
+static unsigned GetILInstrSize(ILInstr* pInstr) {
+  unsigned opcode = pInstr->m_opcode;
+  unsigned size = 0;
+  if (opcode < CEE_COUNT) {
+    size += (opcode >= 0x100) ? 2 : 1;
+  }
+
+  BYTE flags = s_OpCodeFlags[opcode];
+  size += (flags & OPCODEFLAGS_SizeMask);
+  if (flags == (0 | OPCODEFLAGS_Switch)) {
+    size += sizeof(INT32);
+  }
+  return size;
+}
+
+HRESULT ILRewriter::ComputeILOffsets(const std::vector<ILInstr*>& code,
+                                     unsigned* pCodeSize) {
+  // Short branches are widened until every delta fits. Offsets only grow, so
+  // this converges in a few linear passes and no code is emitted meanwhile.
+  bool fWidened;
+  do {
+    unsigned offset = 0;
+    for (ILInstr* pInstr : code) {
+      if (pInstr->m_opcode >= (sizeof(s_OpCodeFlags) / sizeof(BYTE))) {
+        return COR_E_INVALIDPROGRAM;
+      }
+      pInstr->m_offset = offset;
+      offset += GetILInstrSize(pInstr);
+    }
+    m_IL.m_offset = offset;
+    *pCodeSize = offset;
+
+    fWidened = false;
+    for (unsigned iInstr = 0; iInstr < code.size(); iInstr++) {
+      ILInstr* pInstr = code[iInstr];
+      unsigned opcode = pInstr->m_opcode;
+      if (s_OpCodeFlags[opcode] != (1 | OPCODEFLAGS_BranchTarget)) {
+        continue;
+      }
+
+      unsigned nextOffset =
+          iInstr + 1 < code.size() ? code[iInstr + 1]->m_offset : offset;
+      int delta = pInstr->m_pTarget->m_offset - nextOffset;
+      // Check if delta is too big to fit into an INT8.
+      //
+      // (see #pragma at top of file)
+      if ((INT8)delta == delta) {
+        continue;
+      }
+
+      if (opcode == CEE_LEAVE_S) {
+        pInstr->m_opcode = CEE_LEAVE;
+      } else {
+        if (!(opcode >= CEE_BR_S && opcode <= CEE_BLT_UN_S)) {
+          return COR_E_INVALIDPROGRAM;
+        }
+        pInstr->m_opcode = opcode - CEE_BR_S + CEE_BR;
+      }
+      fWidened = true;
+    }
+  } while (fWidened);
+
+  return S_OK;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// P E E P H O L E
+//
+////////////////////////////////////////////////////////////////////////////////////////////////
+
+enum ILLocalAccess { ILLocalNone, ILLocalLoad, ILLocalStore, ILLocalAddress };
+
+static ILLocalAccess GetLocalAccess(ILInstr* pInstr, unsigned* pIndex) {
+  unsigned opcode = pInstr->m_opcode;
+  if (opcode >= CEE_LDLOC_0 && opcode <= CEE_LDLOC_3) {
+    *pIndex = opcode - CEE_LDLOC_0;
+    return ILLocalLoad;
+  }
+  if (opcode >= CEE_STLOC_0 && opcode <= CEE_STLOC_3) {
+    *pIndex = opcode - CEE_STLOC_0;
+    return ILLocalStore;
+  }
+  switch (opcode) {
+    case CEE_LDLOC_S:
+      *pIndex = (BYTE)pInstr->m_Arg8;
+      return ILLocalLoad;
+    case CEE_STLOC_S:
+      *pIndex = (BYTE)pInstr->m_Arg8;
+      return ILLocalStore;
+    case CEE_LDLOCA_S:
+      *pIndex = (BYTE)pInstr->m_Arg8;
+      return ILLocalAddress;
+    case CEE_LDLOC:
+      *pIndex = (UINT16)pInstr->m_Arg16;
+      return ILLocalLoad;
+    case CEE_STLOC:
+      *pIndex = (UINT16)pInstr->m_Arg16;
+      return ILLocalStore;
+    case CEE_LDLOCA:
+      *pIndex = (UINT16)pInstr->m_Arg16;
+      return ILLocalAddress;
+    default:
+      return ILLocalNone;
+  }
+}
+
+// Rewrites an instruction to the shortest encoding with the same semantics.
+static void ShortenILInstr(ILInstr* pInstr) {
+  unsigned opcode = pInstr->m_opcode;
+  switch (opcode) {
+    case CEE_LDLOC:
+    case CEE_STLOC:
+    case CEE_LDARG:
+    case CEE_LDLOCA:
+    case CEE_LDARGA:
+    case CEE_STARG: {
+      unsigned index = (UINT16)pInstr->m_Arg16;
+      if (index <= 3 && opcode == CEE_LDLOC) {
+        pInstr->m_opcode = CEE_LDLOC_0 + index;
+      } else if (index <= 3 && opcode == CEE_STLOC) {
+        pInstr->m_opcode = CEE_STLOC_0 + index;
+      } else if (index <= 3 && opcode == CEE_LDARG) {
+        pInstr->m_opcode = CEE_LDARG_0 + index;
+      } else if (index <= 0xFF) {
+        switch (opcode) {
+          case CEE_LDLOC: pInstr->m_opcode = CEE_LDLOC_S; break;
+          case CEE_STLOC: pInstr->m_opcode = CEE_STLOC_S; break;
+          case CEE_LDARG: pInstr->m_opcode = CEE_LDARG_S; break;
+          case CEE_LDLOCA: pInstr->m_opcode = CEE_LDLOCA_S; break;
+          case CEE_LDARGA: pInstr->m_opcode = CEE_LDARGA_S; break;
+          default: pInstr->m_opcode = CEE_STARG_S; break;
+        }
+        pInstr->m_Arg64 = 0;
+        pInstr->m_Arg8 = (INT8)(BYTE)index;
+        return;
+      } else {
+        return;
+      }
+      pInstr->m_Arg64 = 0;
+      return;
+    }
+    case CEE_LDC_I4:
+    case CEE_LDC_I4_S: {
+      INT32 value =
+          (opcode == CEE_LDC_I4) ? pInstr->m_Arg32 : (INT32)pInstr->m_Arg8;
+      if (value >= -1 && value <= 8) {
+        pInstr->m_opcode = (value == -1) ? CEE_LDC_I4_M1 : CEE_LDC_I4_0 + value;
+        pInstr->m_Arg64 = 0;
+      } else if ((INT8)value == value) {
+        pInstr->m_opcode = CEE_LDC_I4_S;
+        pInstr->m_Arg64 = 0;
+        pInstr->m_Arg8 = (INT8)value;
+      }
+      return;
+    }
+    case CEE_LEAVE:
+      // Widened again by Export if the target turns out to be too far
+      pInstr->m_opcode = CEE_LEAVE_S;
+      return;
+    default:
+      if (opcode >= CEE_BR && opcode <= CEE_BLT_UN) {
+        pInstr->m_opcode = opcode - CEE_BR + CEE_BR_S;
+      }
+      return;
+  }
+}
+
+HRESULT ILRewriter::GetForwardableLocals(std::vector<bool>* pForwardable) {
+  pForwardable->clear();
+  if (IsNilToken(m_tkLocalVarSig)) {
+    return S_OK;
+  }
+
+  IfFailRet(EnsureMetadataImport());
+
+  PCCOR_SIGNATURE pSig = nullptr;
+  ULONG cbSig = 0;
+  IfFailRet(m_pMetadataImport->GetSigFromToken(m_tkLocalVarSig, &pSig, &cbSig));
+  if (cbSig < 2 || *pSig != IMAGE_CEE_CS_CALLCONV_LOCAL_SIG) {
+    return E_FAIL;
+  }
+  pSig++;
+
+  ULONG count;
+  pSig += CorSigUncompressData(pSig, &count);
+  pForwardable->resize(count, false);
+
+  for (ULONG i = 0; i < count; i++) {
+    // Local := CustomMod* [PINNED] [BYREF] Type | TYPEDBYREF
+    bool fForwardable = true;
+    while (*pSig == ELEMENT_TYPE_CMOD_OPT || *pSig == ELEMENT_TYPE_CMOD_REQD ||
+           *pSig == ELEMENT_TYPE_PINNED) {
+      if (*pSig++ != ELEMENT_TYPE_PINNED) {
+        mdToken modifierToken;
+        pSig += CorSigUncompressToken(pSig, &modifierToken);
+      }
+      fForwardable = false;
+    }
+
+    if (*pSig == ELEMENT_TYPE_TYPEDBYREF) {
+      pSig++;
+      continue;
+    }
+    if (*pSig == ELEMENT_TYPE_BYREF) {
+      pSig++;
+      fForwardable = false;
+    }
+
+    // A store to a small integer or a floating point local narrows the value
+    // on the stack, so only the types kept as is on the evaluation stack can
+    // skip the round trip through the local.
+    switch (*pSig) {
+      case ELEMENT_TYPE_I4:
+      case ELEMENT_TYPE_U4:
+      case ELEMENT_TYPE_I8:
+      case ELEMENT_TYPE_U8:
+      case ELEMENT_TYPE_I:
+      case ELEMENT_TYPE_U:
+      case ELEMENT_TYPE_STRING:
+      case ELEMENT_TYPE_OBJECT:
+      case ELEMENT_TYPE_CLASS:
+      case ELEMENT_TYPE_VALUETYPE:
+      case ELEMENT_TYPE_GENERICINST:
+      case ELEMENT_TYPE_SZARRAY:
+      case ELEMENT_TYPE_ARRAY:
+        break;
+      default:
+        fForwardable = false;
+        break;
+    }
+
+    if (!trace::ParseType(&pSig)) {
+      pForwardable->clear();
+      return E_FAIL;
+    }
+    (*pForwardable)[i] = fForwardable;
+  }
+
+  return S_OK;
+}
+
+HRESULT ILRewriter::PeepholeOptimize() {
+  std::unordered_set<ILInstr*> ehBoundaries;
+  for (unsigned iEH = 0; iEH < m_nEH; iEH++) {
+    EHClause* pClause = &m_pEH[iEH];
+    ehBoundaries.insert(pClause->m_pTryBegin);
+    ehBoundaries.insert(pClause->m_pTryEnd);
+    ehBoundaries.insert(pClause->m_pHandlerBegin);
+    ehBoundaries.insert(pClause->m_pHandlerEnd);
+    if (pClause->m_Flags & COR_ILEXCEPTION_CLAUSE_FILTER) {
+      ehBoundaries.insert(pClause->m_pFilter);
+    }
+  }
+
+  std::unordered_set<ILInstr*> branchTargets;
   for (ILInstr* pInstr = m_IL.m_pNext; pInstr != &m_IL;
        pInstr = pInstr->m_pNext) {
+    if (s_OpCodeFlags[pInstr->m_opcode] & OPCODEFLAGS_BranchTarget) {
+      branchTargets.insert(pInstr->m_pTarget);
+    }
+  }
+
+  // *** Nops. Walk backwards so the instruction a removed nop forwards its
+  // branches to is already known. A nop that delimits an EH clause stays, as
+  // does a branch target that would forward into an EH boundary.
+  std::unordered_map<ILInstr*, ILInstr*> forwardedTargets;
+  auto resolve = [&forwardedTargets](ILInstr* pInstr) {
+    auto it = forwardedTargets.find(pInstr);
+    return it == forwardedTargets.end() ? pInstr : it->second;
+  };
+
+  for (ILInstr* pInstr = m_IL.m_pPrev; pInstr != &m_IL;
+       pInstr = pInstr->m_pPrev) {
+    if (pInstr->m_opcode != CEE_NOP || ehBoundaries.count(pInstr) > 0) {
+      continue;
+    }
+
+    ILInstr* pNext = resolve(pInstr->m_pNext);
+    if (branchTargets.count(pInstr) > 0 &&
+        (pNext == &m_IL || ehBoundaries.count(pNext) > 0)) {
+      continue;
+    }
+    forwardedTargets[pInstr] = pNext;
+  }
 
-    if(offset >= maxSize)
-    {
-      return COR_E_INDEXOUTOFRANGE;
+  if (!forwardedTargets.empty()) {
+    for (ILInstr* pInstr = m_IL.m_pNext; pInstr != &m_IL;
+         pInstr = pInstr->m_pNext) {
+      if (s_OpCodeFlags[pInstr->m_opcode] & OPCODEFLAGS_BranchTarget) {
+        pInstr->m_pTarget = resolve(pInstr->m_pTarget);
+        branchTargets.insert(pInstr->m_pTarget);
+      }
     }
+    for (const auto& forwarded : forwardedTargets) {
+      RemoveILInstr(forwarded.first);
+    }
+  }
+
+  // *** stloc X / ldloc X pairs of a local that is not used anywhere else
+  std::vector<bool> forwardableLocals;
+  if (SUCCEEDED(GetForwardableLocals(&forwardableLocals)) &&
+      !forwardableLocals.empty()) {
+    std::vector<unsigned> loads(forwardableLocals.size(), 0);
+    std::vector<unsigned> stores(forwardableLocals.size(), 0);
+    for (ILInstr* pInstr = m_IL.m_pNext; pInstr != &m_IL;
+         pInstr = pInstr->m_pNext) {
+      unsigned index;
+      ILLocalAccess access = GetLocalAccess(pInstr, &index);
+      if (access == ILLocalNone || index >= forwardableLocals.size()) {
+        continue;
+      }
+      if (access == ILLocalAddress) {
+        forwardableLocals[index] = false;
+      } else if (access == ILLocalLoad) {
+        loads[index]++;
+      } else {
+        stores[index]++;
+      }
+    }
+
+    for (ILInstr* pInstr = m_IL.m_pNext; pInstr != &m_IL;) {
+      ILInstr* pNext = pInstr->m_pNext;
+      unsigned storeIndex;
+      unsigned loadIndex;
+      if (pNext != &m_IL &&
+          GetLocalAccess(pInstr, &storeIndex) == ILLocalStore &&
+          GetLocalAccess(pNext, &loadIndex) == ILLocalLoad &&
+          storeIndex == loadIndex && storeIndex < forwardableLocals.size() &&
+          forwardableLocals[storeIndex] && stores[storeIndex] == 1 &&
+          loads[storeIndex] == 1 && branchTargets.count(pInstr) == 0 &&
+          branchTargets.count(pNext) == 0 && ehBoundaries.count(pInstr) == 0 &&
+          ehBoundaries.count(pNext) == 0) {
+        ILInstr* pAfter = pNext->m_pNext;
+        RemoveILInstr(pInstr);
+        RemoveILInstr(pNext);
+        pInstr = pAfter;
+        continue;
+      }
+      pInstr = pNext;
+    }
+  }
+
+  // *** Short forms
+  for (ILInstr* pInstr = m_IL.m_pNext; pInstr != &m_IL;
+       pInstr = pInstr->m_pNext) {
+    ShortenILInstr(pInstr);
+  }
+
+  return S_OK;
+}
+
+void ILRewriter::RemoveILInstr(ILInstr* pInstr) {
+  pInstr->m_pPrev->m_pNext = pInstr->m_pNext;
+  pInstr->m_pNext->m_pPrev = pInstr->m_pPrev;
+  pInstr->m_pNext = nullptr;
+  pInstr->m_pPrev = nullptr;
+  m_nInstrs--;
+}
+
+HRESULT ILRewriter::Export() {
+  // *** Program order from the imported instructions and the splice log
+  std::vector<ILInstr*> code;
+  IfFailRet(GetCode(&code));
+
+  // *** Exact max stack from a stack depth dataflow analysis. If the analysis
+  // is not possible, the value tracked during the rewriting is kept.
+  unsigned maxStack;
+  if (SUCCEEDED(ComputeMaxStack(code, &maxStack))) {
+    m_maxStack = maxStack;
+  }
 
-    pInstr->m_offset = offset;
+  // *** Final instruction sizes and offsets
+  unsigned offset;
+  IfFailRet(ComputeILOffsets(code, &offset));
 
+  m_pOutputBuffer = m_arena.AllocArray<BYTE>(offset);
+  IfNullRet(m_pOutputBuffer);
+  BYTE* pIL = m_pOutputBuffer;
+
+  // *** Emit the code in a single pass
+  unsigned switchBase = 0;
+  for (unsigned iInstr = 0; iInstr < code.size(); iInstr++) {
+    ILInstr* pInstr = code[iInstr];
+    unsigned nextOffset =
+        iInstr + 1 < code.size() ? code[iInstr + 1]->m_offset : offset;
+    unsigned pos = pInstr->m_offset;
     unsigned opcode = pInstr->m_opcode;
     if (opcode < CEE_COUNT) {
       // CEE_PREFIX1 refers not to instruction prefixes (like tail.), but to
       // the lead byte of multi-byte opcodes. For now, the only lead byte
       // supported is CEE_PREFIX1 = 0xFE.
-      if (opcode >= 0x100) m_pOutputBuffer[offset++] = CEE_PREFIX1;
+      if (opcode >= 0x100) pIL[pos++] = CEE_PREFIX1;
 
       // This appears to depend on an implicit conversion from
       // unsigned opcode down to BYTE, to deliberately lose data and have
       // opcode >= 0x100 wrap around to 0.
-      m_pOutputBuffer[offset++] = (opcode & 0xFF);
+      pIL[pos++] = (opcode & 0xFF);
     }
 
-    if (pInstr->m_opcode >= (sizeof(s_OpCodeFlags) / sizeof(BYTE)))
-    {
-      return COR_E_INVALIDPROGRAM;
-    }
-
-    BYTE flags = s_OpCodeFlags[pInstr->m_opcode];
+    BYTE flags = s_OpCodeFlags[opcode];
     switch (flags) {
       case 0:
         break;
       case 1:
-        *(UNALIGNED INT8*)&(pIL[offset]) = pInstr->m_Arg8;
+        *(UNALIGNED INT8*)&(pIL[pos]) = pInstr->m_Arg8;
         break;
       case 2:
-        *(UNALIGNED INT16*)&(pIL[offset]) = pInstr->m_Arg16;
+        *(UNALIGNED INT16*)&(pIL[pos]) = pInstr->m_Arg16;
         break;
       case 4:
-        *(UNALIGNED INT32*)&(pIL[offset]) = pInstr->m_Arg32;
+        *(UNALIGNED INT32*)&(pIL[pos]) = pInstr->m_Arg32;
         break;
       case 8:
-        *(UNALIGNED INT64*)&(pIL[offset]) = pInstr->m_Arg64;
+        *(UNALIGNED INT64*)&(pIL[pos]) = pInstr->m_Arg64;
         break;
       case 1 | OPCODEFLAGS_BranchTarget:
-        fBranch = true;
+        *(UNALIGNED INT8*)&(pIL[pos]) =
+            pInstr->m_pTarget->m_offset - nextOffset;
         break;
       case 4 | OPCODEFLAGS_BranchTarget:
-        fBranch = true;
+        if (opcode == CEE_SWITCH_ARG) {
+          // Switch args are special
+          *(UNALIGNED INT32*)&(pIL[pos]) =
+              pInstr->m_pTarget->m_offset - switchBase;
+        } else {
+          *(UNALIGNED INT32*)&(pIL[pos]) =
+              pInstr->m_pTarget->m_offset - nextOffset;
+        }
         break;
       case 0 | OPCODEFLAGS_Switch:
-        *(UNALIGNED INT32*)&(pIL[offset]) = pInstr->m_Arg32;
-        offset += sizeof(INT32);
+        *(UNALIGNED INT32*)&(pIL[pos]) = pInstr->m_Arg32;
+        switchBase =
+            pInstr->m_offset + 1 + sizeof(INT32) * (pInstr->m_Arg32 + 1);
         break;
       default:
         return COR_E_INVALIDPROGRAM;
     }
-    offset += (flags & OPCODEFLAGS_SizeMask);
-  }
-  m_IL.m_offset = offset;
-
-  if (fBranch) {
-    bool fTryAgain = false;
-    unsigned switchBase = 0;
-
-    // Go over all control flow instructions and resolve the targets
-    for (ILInstr* pInstr = m_IL.m_pNext; pInstr != &m_IL;
-         pInstr = pInstr->m_pNext) {
-      unsigned opcode = pInstr->m_opcode;
-
-      if (pInstr->m_opcode == CEE_SWITCH) {
-        switchBase =
-            pInstr->m_offset + 1 + sizeof(INT32) * (pInstr->m_Arg32 + 1);
-        continue;
-      }
-      if (opcode == CEE_SWITCH_ARG) {
-        // Switch args are special
-        *(UNALIGNED INT32*)&(pIL[pInstr->m_offset]) =
-            pInstr->m_pTarget->m_offset - switchBase;
-        continue;
-      }
-
-      BYTE flags = s_OpCodeFlags[pInstr->m_opcode];
-
-      if (flags & OPCODEFLAGS_BranchTarget) {
-        int delta = pInstr->m_pTarget->m_offset - pInstr->m_pNext->m_offset;
-
-        switch (flags) {
-          case 1 | OPCODEFLAGS_BranchTarget:
-            // Check if delta is too big to fit into an INT8.
-            //
-            // (see #pragma at top of file)
-            if ((INT8)delta != delta) {
-              if (opcode == CEE_LEAVE_S) {
-                pInstr->m_opcode = CEE_LEAVE;
-              } else {
-                if(!(opcode >= CEE_BR_S && opcode <= CEE_BLT_UN_S))
-                {
-                  return COR_E_INVALIDPROGRAM;
-                }
-
-                pInstr->m_opcode = opcode - CEE_BR_S + CEE_BR;
-
-                if(!(pInstr->m_opcode >= CEE_BR && pInstr->m_opcode <= CEE_BLT_UN))
-                {
-                  return COR_E_INVALIDPROGRAM;
-                }
-              }
-              fTryAgain = true;
-              continue;
-            }
-            *(UNALIGNED INT8*)&(pIL[pInstr->m_pNext->m_offset - sizeof(INT8)]) =
-                delta;
-            break;
-          case 4 | OPCODEFLAGS_BranchTarget:
-            *(UNALIGNED INT32*)&(
-                pIL[pInstr->m_pNext->m_offset - sizeof(INT32)]) = delta;
-            break;
-          default:
-            return COR_E_INVALIDPROGRAM;
-        }
-      }
-    }
-
-    // Do the whole thing again if we changed the size of some branch targets
-    if (fTryAgain) goto again;
   }
 
   unsigned codeSize = offset;
@@ -609,7 +1438,8 @@ again:
         pDst->TryLength =
             pSrc->m_pTryEnd->m_offset - pSrc->m_pTryBegin->m_offset;
         pDst->HandlerOffset = pSrc->m_pHandlerBegin->m_offset;
-        pDst->HandlerLength = pSrc->m_pHandlerEnd->m_pNext->m_offset -
+        pDst->HandlerLength = pSrc->m_pHandlerEnd->m_offset +
+                              GetILInstrSize(pSrc->m_pHandlerEnd) -
                               pSrc->m_pHandlerBegin->m_offset;
         if ((pSrc->m_Flags & COR_ILEXCEPTION_CLAUSE_FILTER) == 0)
           pDst->ClassToken = pSrc->m_ClassToken;
@@ -623,10 +1453,13 @@ again:
 
   IfFailRet(SetILFunctionBody(totalSize, pBody));
   DeallocateILMemory(pBody);
+  m_exportedSize = totalSize;
 
   return S_OK;
 }
 
+unsigned ILRewriter::GetExportedSize() { return m_exportedSize; }
+
 HRESULT ILRewriter::SetILFunctionBody(unsigned size, LPBYTE pBody) {
   if (m_pICorProfilerFunctionControl != nullptr) {
     // We're supplying IL for a rejit, so use the rejit mechanism
@@ -8,6 +8,9 @@
 #include <corhlpr.h>
 #include <corprof.h>
 
+#include <cstddef>
+#include <vector>
+
 typedef enum {
 #define OPDEF(c, s, pop, push, args, type, l, s1, s2, ctrl) c,
 #include "opcode.def"
@@ -23,6 +26,7 @@ struct ILInstr {
 
   unsigned m_opcode;
   unsigned m_offset;
+  int m_stackDepth;  // Stack depth on entry, only valid during Export
 
   union {
     ILInstr* m_pTarget;
@@ -46,8 +50,42 @@ struct EHClause {
   };
 };
 
+// Bump pointer allocator for the instructions, EH clauses and buffers of a
+// single ILRewriter. Everything is released at once when the arena is
+// destroyed, and the blocks are kept in a thread local pool so the next
+// rewrite on the same (JIT / ReJIT) thread doesn't hit the global heap.
+class ILRewriterArena {
+ private:
+  struct Block {
+    Block* m_pNext;
+    size_t m_size;
+    size_t m_used;
+  };
+
+  Block* m_pBlocks;
+
+  Block* NewBlock(size_t minSize);
+
+ public:
+  ILRewriterArena();
+  ~ILRewriterArena();
+
+  ILRewriterArena(const ILRewriterArena&) = delete;
+  ILRewriterArena& operator=(const ILRewriterArena&) = delete;
+
+  // Returns zero initialized memory, valid until the arena is destroyed.
+  void* Alloc(size_t size);
+
+  template <typename T>
+  T* AllocArray(size_t count) {
+    return static_cast<T*>(Alloc(sizeof(T) * count));
+  }
+};
+
 class ILRewriter {
  private:
+  ILRewriterArena m_arena;
+
   ICorProfilerInfo* m_pICorProfilerInfo;
   ICorProfilerFunctionControl* m_pICorProfilerFunctionControl;
 
@@ -61,6 +99,20 @@ class ILRewriter {
 
   ILInstr m_IL;  // Double linked list of all il instructions
 
+  // The instructions of the original body in IL order, sized once by
+  // ImportIL so the ILInstr* handed to the callers stay valid.
+  std::vector<ILInstr> m_imported;
+
+  // Instructions inserted by InsertBefore / InsertAfter, in call order.
+  // Export rebuilds the program order from the imported instructions and
+  // this log instead of following the list links one node at a time.
+  struct ILSplice {
+    ILInstr* m_pWhere;
+    ILInstr* m_pWhat;
+    bool m_fAfter;
+  };
+  std::vector<ILSplice> m_splices;
+
   unsigned m_nEH;
   EHClause* m_pEH;
 
@@ -71,12 +123,36 @@ class ILRewriter {
   ILInstr** m_pOffsetToInstr;
   unsigned m_CodeSize;
 
-  unsigned m_nInstrs;
+  unsigned m_nInstrs;  // Number of instructions in the list
 
   BYTE* m_pOutputBuffer;
 
+  // Size of the body set by the last Export
+  unsigned m_exportedSize;
+
   IMethodMalloc* m_pIMethodMalloc;
 
+  // Used to resolve the stack behaviour of call sites (lazily loaded)
+  IMetaDataImport2* m_pMetadataImport;
+
+  void LinkImportedILInstrs();
+
+  HRESULT GetCode(std::vector<ILInstr*>* pCode);
+
+  void RemoveILInstr(ILInstr* pInstr);
+
+  HRESULT EnsureMetadataImport();
+
+  HRESULT GetForwardableLocals(std::vector<bool>* pForwardable);
+
+  HRESULT GetCallStackEffect(ILInstr* pInstr, int* pPops, int* pPushes);
+
+  HRESULT ComputeMaxStack(const std::vector<ILInstr*>& code,
+                          unsigned* pMaxStack);
+
+  HRESULT ComputeILOffsets(const std::vector<ILInstr*>& code,
+                           unsigned* pCodeSize);
+
  public:
   ILRewriter(ICorProfilerInfo* pICorProfilerInfo,
              ICorProfilerFunctionControl* pICorProfilerFunctionControl,
@@ -94,6 +170,9 @@ class ILRewriter {
 
   EHClause* GetEHPointer();
 
+  // Allocates EH clauses owned by the rewriter (to be used with SetEHClause)
+  EHClause* NewEHClauses(unsigned ehLength);
+
   void SetEHClause(EHClause* ehPointer, unsigned ehLength);
 
   /////////////////////////////////////////////////////////////////////////////////////////////////
@@ -126,10 +205,17 @@ class ILRewriter {
   //
   ////////////////////////////////////////////////////////////////////////////////////////////////
 
+  // Optional clean up of the rewritten body before Export: removes nops,
+  // forwards single use stloc/ldloc pairs and picks the short instruction
+  // forms. EH clauses and branch targets are preserved.
+  HRESULT PeepholeOptimize();
+
   HRESULT Export();
 
   HRESULT SetILFunctionBody(unsigned size, LPBYTE pBody);
 
+  unsigned GetExportedSize();
+
   LPBYTE AllocateILMemory(unsigned size);
 
   void DeallocateILMemory(LPBYTE pBody);
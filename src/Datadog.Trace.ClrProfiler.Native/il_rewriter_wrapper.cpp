@@ -176,6 +176,14 @@ ILInstr* ILRewriterWrapper::LoadObj(mdToken token) const {
   return pNewInstr;
 }
 
+ILInstr* ILRewriterWrapper::LoadField(mdToken token) const {
+  ILInstr* pNewInstr = m_ILRewriter->NewILInstr();
+  pNewInstr->m_opcode = CEE_LDFLD;
+  pNewInstr->m_Arg32 = token;
+  m_ILRewriter->InsertBefore(m_ILInstr, pNewInstr);
+  return pNewInstr;
+}
+
 ILInstr* ILRewriterWrapper::StLocal(unsigned index) const {
   static const std::vector<OPCODE> opcodes = {
       CEE_STLOC_0,
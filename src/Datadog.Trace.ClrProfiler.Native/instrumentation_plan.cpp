@@ -0,0 +1,193 @@
+#include "instrumentation_plan.h"
+
+#include <cstdio>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+
+#include "logging.h"
+#include "pal.h"
+#include "util.h"
+
+namespace trace {
+
+namespace {
+
+const char kPlanHeader[] = "dd-instrumentation-plan 2";
+
+// FNV-1a (64 bit)
+class IntegrationHasher {
+ private:
+  unsigned long long hash_ = 14695981039346656037ULL;
+
+ public:
+  void Add(const BYTE* data, size_t size) {
+    for (size_t i = 0; i < size; i++) {
+      hash_ ^= data[i];
+      hash_ *= 1099511628211ULL;
+    }
+  }
+
+  void Add(const std::string& value) {
+    Add(reinterpret_cast<const BYTE*>(value.c_str()), value.size() + 1);
+  }
+
+  void Add(const WSTRING& value) { Add(ToString(value)); }
+
+  void Add(ULONG value) {
+    Add(reinterpret_cast<const BYTE*>(&value), sizeof(value));
+  }
+
+  void Add(unsigned long long value) {
+    Add(reinterpret_cast<const BYTE*>(&value), sizeof(value));
+  }
+
+  unsigned long long Get() const { return hash_; }
+};
+
+// "<definition hash> <method index> <integration name>", the name is last as
+// it is the rest of the line
+void WriteKey(std::ostream& stream, const IntegrationMethodKey& key) {
+  stream << std::hex << std::setfill('0') << std::setw(16)
+         << key.definition_hash << std::dec << " " << key.method_index << " "
+         << ToString(key.integration_name);
+}
+
+bool ReadKey(std::istream& stream, IntegrationMethodKey* key) {
+  std::string name;
+  stream >> std::hex >> key->definition_hash >> std::dec >>
+      key->method_index >> std::ws;
+  if (stream.fail() || !std::getline(stream, name) || name.empty()) {
+    return false;
+  }
+  key->integration_name = ToWSTRING(name);
+  return true;
+}
+
+}  // namespace
+
+unsigned long long HashIntegrationDefinition(
+    const IntegrationDefinition& definition, bool is_calltarget_enabled,
+    bool is_netstandard_enabled) {
+  IntegrationHasher hasher;
+  hasher.Add(static_cast<ULONG>(is_calltarget_enabled));
+  hasher.Add(static_cast<ULONG>(is_netstandard_enabled));
+  hasher.Add(definition.integration_name);
+  hasher.Add(definition.definition);
+  return hasher.Get();
+}
+
+unsigned long long HashCandidateIntegrations(
+    const std::vector<unsigned long long>& definition_hashes) {
+  IntegrationHasher hasher;
+  hasher.Add(static_cast<ULONG>(definition_hashes.size()));
+  for (const auto definition_hash : definition_hashes) {
+    hasher.Add(definition_hash);
+  }
+  return hasher.Get();
+}
+
+std::string InstrumentationPlanCache::GetPlanPath(
+    const GUID& module_version_id, unsigned long long candidates_hash) const {
+  std::stringstream ss;
+  ss << ToString(directory_) << "/" << ToString(GuidStr(&module_version_id))
+     << "-" << std::hex << std::setfill('0') << std::setw(16) << candidates_hash
+     << ".plan";
+  return ss.str();
+}
+
+bool InstrumentationPlanCache::Load(const GUID& module_version_id,
+                                    unsigned long long candidates_hash,
+                                    InstrumentationPlan* plan) const {
+  std::ifstream stream(GetPlanPath(module_version_id, candidates_hash));
+  if (!stream) {
+    return false;
+  }
+
+  std::string line;
+  if (!std::getline(stream, line) || line != kPlanHeader) {
+    Warn("InstrumentationPlanCache: ignoring plan with an unknown format for ",
+         GuidStr(&module_version_id));
+    return false;
+  }
+
+  InstrumentationPlan loaded;
+  while (std::getline(stream, line)) {
+    std::istringstream fields(line);
+    std::string kind;
+    fields >> kind;
+
+    if (kind == "skip") {
+      loaded.skip_module = true;
+    } else if (kind == "integration") {
+      IntegrationMethodKey key;
+      if (!ReadKey(fields, &key)) {
+        return false;
+      }
+      loaded.integrations.push_back(key);
+    } else if (kind == "rejit") {
+      mdMethodDef method_def = mdMethodDefNil;
+      IntegrationMethodKey key;
+      fields >> std::hex >> method_def >> std::dec;
+      if (fields.fail() || TypeFromToken(method_def) != mdtMethodDef ||
+          !ReadKey(fields, &key)) {
+        return false;
+      }
+      loaded.rejit_methods.emplace_back(method_def, key);
+    } else if (!kind.empty()) {
+      return false;
+    }
+  }
+
+  *plan = loaded;
+  return true;
+}
+
+bool InstrumentationPlanCache::Store(const GUID& module_version_id,
+                                     unsigned long long candidates_hash,
+                                     const InstrumentationPlan& plan) const {
+  const auto path = GetPlanPath(module_version_id, candidates_hash);
+
+  // Write a temporary file and move it in place, readers never see a partial
+  // plan. Plans of the same module and integrations are the same, so losing a
+  // race to another process is fine.
+  std::stringstream temp_path;
+  temp_path << path << "." << GetPID() << ".tmp";
+  {
+    std::ofstream stream(temp_path.str(), std::ios::trunc);
+    if (!stream) {
+      Debug("InstrumentationPlanCache: can't write ", temp_path.str());
+      return false;
+    }
+
+    stream << kPlanHeader << "\n";
+    if (plan.skip_module) {
+      stream << "skip\n";
+    }
+    for (auto& key : plan.integrations) {
+      stream << "integration ";
+      WriteKey(stream, key);
+      stream << "\n";
+    }
+    for (auto& rejit_method : plan.rejit_methods) {
+      stream << "rejit 0x" << std::hex << std::setfill('0') << std::setw(8)
+             << rejit_method.first << std::dec << " ";
+      WriteKey(stream, rejit_method.second);
+      stream << "\n";
+    }
+
+    if (!stream) {
+      stream.close();
+      std::remove(temp_path.str().c_str());
+      return false;
+    }
+  }
+
+  if (std::rename(temp_path.str().c_str(), path.c_str()) != 0) {
+    std::remove(temp_path.str().c_str());
+    return false;
+  }
+  return true;
+}
+
+}  // namespace trace
@@ -0,0 +1,91 @@
+#ifndef DD_CLR_PROFILER_INSTRUMENTATION_PLAN_H_
+#define DD_CLR_PROFILER_INSTRUMENTATION_PLAN_H_
+
+#include <corhlpr.h>
+#include <utility>
+#include <vector>
+
+#include "integration.h"
+#include "string.h"
+
+namespace trace {
+
+// An integration method, identified by its integration and its position in
+// the methods of the integration instead of its position in the catalog. The
+// definition hash ties it to one version of the integration.
+struct IntegrationMethodKey {
+  // Empty for a method that is not in the catalog
+  WSTRING integration_name;
+  unsigned long long definition_hash;
+  ULONG method_index;
+
+  IntegrationMethodKey() : definition_hash(0), method_index(0) {}
+
+  IntegrationMethodKey(const WSTRING& integration_name,
+                       unsigned long long definition_hash, ULONG method_index)
+      : integration_name(integration_name),
+        definition_hash(definition_hash),
+        method_index(method_index) {}
+
+  inline bool operator==(const IntegrationMethodKey& other) const {
+    return integration_name == other.integration_name &&
+           definition_hash == other.definition_hash &&
+           method_index == other.method_index;
+  }
+};
+
+/// <summary>
+/// What the profiler decided to do with a module: which integrations apply to
+/// it and which methods it rewrites with CallTarget. The decisions only depend
+/// on the module image (identified by its MVID) and on the integrations that
+/// may apply to it, so they can be reused by every process loading the same
+/// module.
+/// </summary>
+struct InstrumentationPlan {
+  // No integration targets the module
+  bool skip_module = false;
+  // Integration methods left after the filtering by target, in order
+  std::vector<IntegrationMethodKey> integrations{};
+  // CallTarget methods to ReJIT and the integration method applied to each
+  std::vector<std::pair<mdMethodDef, IntegrationMethodKey>> rejit_methods{};
+};
+
+// Hash of the definition of an integration and of the instrumentation mode,
+// which change the methods it is flattened to
+unsigned long long HashIntegrationDefinition(
+    const IntegrationDefinition& definition, bool is_calltarget_enabled,
+    bool is_netstandard_enabled);
+
+// Hash of the integrations that may apply to a module, from their definition
+// hashes in catalog order. Plans computed for other candidates are never used.
+unsigned long long HashCandidateIntegrations(
+    const std::vector<unsigned long long>& definition_hashes);
+
+/// <summary>
+/// Directory of instrumentation plans, one file per module version and hash
+/// of its candidate integrations. Files are replaced atomically so concurrent
+/// processes (and the offline plan generator) can share the directory.
+/// </summary>
+class InstrumentationPlanCache {
+ private:
+  const WSTRING directory_;
+
+  std::string GetPlanPath(const GUID& module_version_id,
+                          unsigned long long candidates_hash) const;
+
+ public:
+  explicit InstrumentationPlanCache(const WSTRING& directory)
+      : directory_(directory) {}
+
+  // Reads the plan of a module, false if there is none (or it is unreadable).
+  // The integration methods of the plan are not resolved.
+  bool Load(const GUID& module_version_id, unsigned long long candidates_hash,
+            InstrumentationPlan* plan) const;
+
+  bool Store(const GUID& module_version_id, unsigned long long candidates_hash,
+             const InstrumentationPlan& plan) const;
+};
+
+}  // namespace trace
+
+#endif  // DD_CLR_PROFILER_INSTRUMENTATION_PLAN_H_
@@ -0,0 +1,244 @@
+// Computes the instrumentation plans of the assemblies of an application ahead
+// of time, so the profiler doesn't have to analyze them when they are loaded.
+//
+//   Datadog.Trace.ClrProfiler.PlanGenerator <application directory> <plan cache directory>
+//
+// The integrations are read from the same configuration as the profiler
+// (DD_INTEGRATIONS, DD_DISABLED_INTEGRATIONS, DD_TRACE_CALLTARGET_ENABLED, ...
+// or DD_CLR_CONFIG_FILE), run it with the environment of the application or
+// the plans won't match its integrations.
+
+#include <dirent.h>
+
+#include <fstream>
+#include <iostream>
+#include <iterator>
+
+#include "assembly_classifier.h"
+#include "clr_helpers.h"
+#include "dd_profiler_constants.h"
+#include "instrumentation_plan.h"
+#include "integration_directory.h"
+#include "integration_loader.h"
+#include "metadata_reader.h"
+#include "module_metadata.h"
+
+using namespace trace;
+
+namespace {
+
+bool IsSkippedAssembly(const AssemblyClassifier& assembly_classifier,
+                       const WSTRING& assembly_name) {
+  // Modules ModuleLoadFinished returns from before looking for a plan
+  if (assembly_name == "mscorlib"_W ||
+      assembly_name == "System.Private.CoreLib"_W ||
+      assembly_name == "Datadog.Trace.ClrProfiler.Managed.Loader"_W) {
+    return true;
+  }
+
+  return assembly_classifier.Classify(assembly_name) !=
+         AssemblyClass::Instrumentable;
+}
+
+// Mirrors CorProfiler::CallTarget_RequestRejitForModule, with the image as the
+// only source of metadata. Returns false if a method can't be decided without
+// the metadata interfaces, the runtime analyzes those modules itself.
+bool AddCallTargetMethods(ModuleMetadata& module_metadata,
+                          const IntegrationDirectory& integration_directory,
+                          InstrumentationPlan* plan) {
+  const auto& metadata_reader = module_metadata.metadata_reader;
+
+  for (const auto& integration : module_metadata.integrations) {
+    const auto& target_method = integration.replacement.target_method;
+    if (target_method.assembly.name != module_metadata.assemblyName ||
+        integration.replacement.wrapper_method.action !=
+            calltarget_modification_action) {
+      continue;
+    }
+
+    const mdTypeDef type_def =
+        module_metadata.FindTypeDef(target_method.type_name);
+    if (type_def == mdTypeDefNil) {
+      continue;
+    }
+
+    const auto& signature_matcher = module_metadata.GetSignatureMatcher(
+        target_method, SignatureNaming::TypeTokName);
+    if (!signature_matcher.IsCompiled()) {
+      return false;
+    }
+
+    for (const auto method_def : metadata_reader.FindMethodsByName(
+             type_def, ToString(target_method.method_name))) {
+      MethodDefRow row;
+      if (!metadata_reader.GetMethodDef(RidFromToken(method_def), &row)) {
+        continue;
+      }
+
+      FunctionMethodSignature signature(row.signature.data,
+                                        row.signature.size);
+      if (FAILED(signature.TryParse()) ||
+          signature.NumberOfArguments() !=
+              target_method.signature_types.size() - 1 ||
+          !signature_matcher.MatchesArguments(
+              signature.GetMethodArguments())) {
+        continue;
+      }
+
+      plan->rejit_methods.emplace_back(
+          method_def, integration_directory.GetKey(integration));
+    }
+  }
+
+  return true;
+}
+
+// Mirrors the filtering of CorProfiler::ModuleLoadFinished
+bool PlanModule(const std::vector<BYTE>& image,
+                const AssemblyClassifier& assembly_classifier,
+                IntegrationDirectory& integration_directory,
+                bool is_calltarget_enabled, GUID* module_version_id,
+                unsigned long long* candidates_hash,
+                InstrumentationPlan* plan) {
+  // The file is read as is, so the image has the flat (on disk) layout
+  const MetadataReader metadata_reader(image.data(),
+                                       COR_PRF_MODULE_FLAT_LAYOUT);
+  AssemblyRow assembly_row;
+  if (!metadata_reader.IsValid() ||
+      !metadata_reader.GetModuleVersionId(module_version_id) ||
+      !metadata_reader.GetAssembly(&assembly_row)) {
+    return false;
+  }
+
+  const WSTRING assembly_name = ToWSTRING(assembly_row.name);
+  if (IsSkippedAssembly(assembly_classifier, assembly_name)) {
+    return false;
+  }
+
+  const bool filter_by_target =
+      assembly_name != "Microsoft.AspNetCore.Hosting"_W &&
+      assembly_name != "Dapper"_W;
+  std::vector<ULONG> candidate_integrations;
+  if (!filter_by_target) {
+    candidate_integrations = integration_directory.GetAllIntegrations();
+  } else if (!integration_directory.FindIntegrations(metadata_reader,
+                                                     &candidate_integrations) ||
+             candidate_integrations.empty()) {
+    return false;
+  }
+  *candidates_hash =
+      integration_directory.HashIntegrations(candidate_integrations);
+
+  const AssemblyInfo assembly_info(1, assembly_name, 0, 0, ""_W);
+  auto filtered_integrations = FilterIntegrationsByCaller(
+      integration_directory.GetMethods(candidate_integrations, assembly_name),
+      assembly_info);
+  if (filtered_integrations.empty()) {
+    return false;
+  }
+
+  if (filter_by_target) {
+    filtered_integrations = FilterIntegrationsByTarget(
+        filtered_integrations, ComPtr<IMetaDataAssemblyImport>(),
+        metadata_reader);
+
+    if (filtered_integrations.empty()) {
+      plan->skip_module = true;
+      return true;
+    }
+  }
+
+  for (const auto& integration : filtered_integrations) {
+    plan->integrations.push_back(integration_directory.GetKey(integration));
+  }
+
+  if (!is_calltarget_enabled) {
+    return true;
+  }
+
+  // Only the image backed lookups are used, the metadata interfaces are null
+  ModuleMetadata module_metadata(
+      ComPtr<IMetaDataImport2>(), ComPtr<IMetaDataEmit2>(),
+      ComPtr<IMetaDataAssemblyImport>(), ComPtr<IMetaDataAssemblyEmit>(),
+      assembly_name, 0, *module_version_id, filtered_integrations, nullptr,
+      metadata_reader);
+  return AddCallTargetMethods(module_metadata, integration_directory, plan);
+}
+
+bool EndsWith(const std::string& value, const std::string& suffix) {
+  return value.size() >= suffix.size() &&
+         value.compare(value.size() - suffix.size(), suffix.size(), suffix) ==
+             0;
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  if (argc != 3) {
+    std::cerr << "Usage: " << argv[0]
+              << " <application directory> <plan cache directory>"
+              << std::endl;
+    return 2;
+  }
+
+  const std::string application_directory = argv[1];
+  const auto configuration = LoadConfiguration();
+  const bool is_calltarget_enabled = configuration->calltarget_enabled;
+  IntegrationDirectory integration_directory(
+      LoadIntegrationDefinitions(*configuration), is_calltarget_enabled,
+      configuration->netstandard_enabled);
+  if (integration_directory.GetIntegrationCount() == 0) {
+    std::cerr << "No enabled integrations found, check "
+              << ToString(environment::integrations_path) << std::endl;
+    return 1;
+  }
+
+  const auto assembly_classifier =
+      AssemblyClassifier::CreateDefault(*configuration);
+  const InstrumentationPlanCache plan_cache(ToWSTRING(argv[2]));
+
+  DIR* directory = opendir(application_directory.c_str());
+  if (directory == nullptr) {
+    std::cerr << "Can't open " << application_directory << std::endl;
+    return 1;
+  }
+
+  int planned = 0;
+  int failed = 0;
+  while (const dirent* entry = readdir(directory)) {
+    const std::string file_name = entry->d_name;
+    if (!EndsWith(file_name, ".dll") && !EndsWith(file_name, ".exe")) {
+      continue;
+    }
+
+    std::ifstream file(application_directory + "/" + file_name,
+                       std::ios::binary);
+    const std::vector<BYTE> image((std::istreambuf_iterator<char>(file)),
+                                  std::istreambuf_iterator<char>());
+
+    GUID module_version_id;
+    unsigned long long candidates_hash = 0;
+    InstrumentationPlan plan;
+    if (!PlanModule(image, assembly_classifier, integration_directory,
+                    is_calltarget_enabled, &module_version_id,
+                    &candidates_hash, &plan)) {
+      continue;
+    }
+
+    if (plan_cache.Store(module_version_id, candidates_hash, plan)) {
+      std::cout << file_name << ": "
+                << (plan.skip_module ? "skip"
+                                     : std::to_string(plan.rejit_methods.size()) +
+                                           " CallTarget methods")
+                << std::endl;
+      planned++;
+    } else {
+      std::cerr << file_name << ": can't write the plan" << std::endl;
+      failed++;
+    }
+  }
+  closedir(directory);
+
+  std::cout << planned << " plans written to " << argv[2] << std::endl;
+  return failed == 0 ? 0 : 1;
+}
@@ -6,12 +6,44 @@
 #else
 #include <re2/re2.h>
 #endif
+#include <map>
+#include <mutex>
 #include <sstream>
+#include <unordered_map>
 
 #include "util.h"
 
 namespace trace {
 
+namespace {
+
+std::mutex cache_ids_lock;
+std::unordered_map<WSTRING, ULONG> method_cache_ids;
+std::unordered_map<WSTRING, ULONG> type_cache_ids;
+std::map<std::vector<WSTRING>, ULONG> signature_types_ids;
+
+ULONG GetCacheId(std::unordered_map<WSTRING, ULONG>& ids, const WSTRING& key) {
+  std::lock_guard<std::mutex> guard(cache_ids_lock);
+  return ids.emplace(key, static_cast<ULONG>(ids.size())).first->second;
+}
+
+}  // namespace
+
+ULONG GetMethodCacheId(const WSTRING& method_cache_key) {
+  return GetCacheId(method_cache_ids, method_cache_key);
+}
+
+ULONG GetTypeCacheId(const WSTRING& type_cache_key) {
+  return GetCacheId(type_cache_ids, type_cache_key);
+}
+
+ULONG GetSignatureTypesId(const std::vector<WSTRING>& signature_types) {
+  std::lock_guard<std::mutex> guard(cache_ids_lock);
+  return signature_types_ids
+      .emplace(signature_types, static_cast<ULONG>(signature_types_ids.size()))
+      .first->second;
+}
+
 AssemblyReference::AssemblyReference(const WSTRING& str)
     : name(GetNameFromAssemblyReferenceString(str)),
       version(GetVersionFromAssemblyReferenceString(str)),
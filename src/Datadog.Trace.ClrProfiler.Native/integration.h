@@ -3,6 +3,7 @@
 
 #include <corhlpr.h>
 #include <iomanip>
+#include <memory>
 #include <sstream>
 #include <vector>
 
@@ -192,6 +193,12 @@ struct MethodSignature {
   }
 };
 
+// Interns a wrapper cache key (see MethodReference) and returns a small,
+// dense id for it. Equal keys get the same id for the lifetime of the process.
+ULONG GetMethodCacheId(const WSTRING& method_cache_key);
+ULONG GetTypeCacheId(const WSTRING& type_cache_key);
+ULONG GetSignatureTypesId(const std::vector<WSTRING>& signature_types);
+
 struct MethodReference {
   const AssemblyReference assembly;
   const WSTRING type_name;
@@ -201,10 +208,19 @@ struct MethodReference {
   const Version min_version;
   const Version max_version;
   const std::vector<WSTRING> signature_types;
+  // Ids of get_method_cache_key() and get_type_cache_key(), assigned when the
+  // integrations are loaded so the per module caches don't build the keys
+  const ULONG method_cache_id;
+  const ULONG type_cache_id;
+  // Id of signature_types, to share the compiled signature matchers
+  const ULONG signature_types_id;
 
   MethodReference()
       : min_version(Version(0, 0, 0, 0)),
-        max_version(Version(USHRT_MAX, USHRT_MAX, USHRT_MAX, USHRT_MAX)) {}
+        max_version(Version(USHRT_MAX, USHRT_MAX, USHRT_MAX, USHRT_MAX)),
+        method_cache_id(GetMethodCacheId(get_method_cache_key())),
+        type_cache_id(GetTypeCacheId(get_type_cache_key())),
+        signature_types_id(GetSignatureTypesId(signature_types)) {}
 
   MethodReference(const WSTRING& assembly_name, WSTRING type_name, WSTRING method_name,
                   WSTRING action, Version min_version, Version max_version,
@@ -217,7 +233,10 @@ struct MethodReference {
         method_signature(method_signature),
         min_version(min_version),
         max_version(max_version),
-        signature_types(signature_types) {}
+        signature_types(signature_types),
+        method_cache_id(GetMethodCacheId(get_method_cache_key())),
+        type_cache_id(GetTypeCacheId(get_type_cache_key())),
+        signature_types_id(GetSignatureTypesId(signature_types)) {}
 
   inline WSTRING get_type_cache_key() const {
     return "["_W + assembly.name + "]"_W + type_name + "_vMin_"_W +
@@ -259,35 +278,97 @@ struct MethodReplacement {
   }
 };
 
+// Sampling rate that instruments every call of the target method.
+const ULONG kSamplingRateEveryCall = 1;
+
 struct Integration {
   const WSTRING integration_name;
   std::vector<MethodReplacement> method_replacements;
+  // Only one out of every sampling_rate calls to a CallTarget target method
+  // runs the BeginMethod/EndMethod plumbing.
+  const ULONG sampling_rate;
 
-  Integration() : integration_name(""_W), method_replacements({}) {}
+  Integration()
+      : integration_name(""_W),
+        method_replacements({}),
+        sampling_rate(kSamplingRateEveryCall) {}
 
   Integration(WSTRING integration_name,
-              std::vector<MethodReplacement> method_replacements)
+              std::vector<MethodReplacement> method_replacements,
+              ULONG sampling_rate = kSamplingRateEveryCall)
       : integration_name(integration_name),
-        method_replacements(method_replacements) {}
+        method_replacements(method_replacements),
+        sampling_rate(sampling_rate) {}
 
   inline bool operator==(const Integration& other) const {
     return integration_name == other.integration_name &&
-           method_replacements == other.method_replacements;
+           method_replacements == other.method_replacements &&
+           sampling_rate == other.sampling_rate;
   }
 };
 
-struct IntegrationMethod {
-  const WSTRING integration_name;
-  MethodReplacement replacement;
+// An integration of the catalog before its methods are parsed: what the
+// profiler needs to know which modules it may apply to
+struct IntegrationDefinition {
+  WSTRING integration_name;
+  // Target assemblies of the method replacements enabled in the current
+  // instrumentation mode
+  std::vector<WSTRING> target_assemblies;
+  // The JSON of the integration, parsed by LoadIntegrationMethods
+  std::string definition;
+};
 
-  IntegrationMethod() : integration_name(""_W), replacement({}) {}
+// The immutable part of an IntegrationMethod, allocated once when the
+// integrations are loaded
+struct IntegrationMethodData {
+  const WSTRING integration_name;
+  const MethodReplacement replacement;
 
-  IntegrationMethod(WSTRING integration_name, MethodReplacement replacement)
+  IntegrationMethodData(const WSTRING& integration_name,
+                        const MethodReplacement& replacement)
       : integration_name(integration_name), replacement(replacement) {}
+};
+
+// A handle to an integration method of the catalog loaded at startup. Copies
+// share the names and signatures of the catalog entry, so filtering the
+// integrations for a module or keeping them per module copies a pointer, not
+// the strings. Entries are never modified after they are created.
+struct IntegrationMethod {
+ private:
+  std::shared_ptr<const IntegrationMethodData> data;
+
+ public:
+  const WSTRING& integration_name;
+  const MethodReplacement& replacement;
+  const ULONG sampling_rate;
+
+  IntegrationMethod() : IntegrationMethod(""_W, {}) {}
+
+  IntegrationMethod(const WSTRING& integration_name,
+                    const MethodReplacement& replacement,
+                    ULONG sampling_rate = kSamplingRateEveryCall)
+      : data(std::make_shared<const IntegrationMethodData>(integration_name,
+                                                           replacement)),
+        integration_name(data->integration_name),
+        replacement(data->replacement),
+        sampling_rate(sampling_rate) {}
+
+  IntegrationMethod(const IntegrationMethod& other)
+      : data(other.data),
+        integration_name(data->integration_name),
+        replacement(data->replacement),
+        sampling_rate(other.sampling_rate) {}
+
+  // Whether both handles refer to the same catalog entry
+  inline bool SharesDataWith(const IntegrationMethod& other) const {
+    return data == other.data;
+  }
 
   inline bool operator==(const IntegrationMethod& other) const {
-    return integration_name == other.integration_name &&
-           replacement == other.replacement;
+    return sampling_rate == other.sampling_rate &&
+           (data == other.data ||
+            (integration_name == other.integration_name &&
+             replacement == other.replacement));
   }
 };
 
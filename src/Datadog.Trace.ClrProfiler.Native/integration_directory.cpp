@@ -0,0 +1,165 @@
+#include "integration_directory.h"
+
+#include <algorithm>
+
+#include "integration_loader.h"
+#include "logging.h"
+
+namespace trace {
+
+IntegrationDirectory::IntegrationDirectory(
+    const std::vector<IntegrationDefinition>& definitions,
+    bool is_calltarget_enabled, bool is_netstandard_enabled)
+    : is_calltarget_enabled_(is_calltarget_enabled),
+      is_netstandard_enabled_(is_netstandard_enabled) {
+  entries_.reserve(definitions.size());
+  for (ULONG i = 0; i < definitions.size(); i++) {
+    const auto& definition = definitions[i];
+    entries_.push_back({definition,
+                        HashIntegrationDefinition(definition,
+                                                  is_calltarget_enabled,
+                                                  is_netstandard_enabled),
+                        false,
+                        {}});
+    integrations_by_name_[definition.integration_name].push_back(i);
+    for (auto&& target_assembly : definition.target_assemblies) {
+      integrations_by_target_[target_assembly].push_back(i);
+    }
+  }
+}
+
+const std::vector<IntegrationMethod>& IntegrationDirectory::Materialize(
+    ULONG integration, const WSTRING& assembly_name) {
+  auto& entry = entries_[integration];
+  if (!entry.materialized) {
+    entry.methods =
+        LoadIntegrationMethods(entry.definition, is_calltarget_enabled_,
+                               is_netstandard_enabled_);
+    entry.materialized = true;
+    materialized_count_++;
+    Debug("IntegrationDirectory: integration ",
+          entry.definition.integration_name, " loaded for ", assembly_name,
+          ", methods: ", entry.methods.size());
+  }
+  return entry.methods;
+}
+
+std::vector<ULONG> IntegrationDirectory::GetAllIntegrations() const {
+  std::vector<ULONG> integrations(entries_.size());
+  for (ULONG i = 0; i < integrations.size(); i++) {
+    integrations[i] = i;
+  }
+  return integrations;
+}
+
+std::vector<ULONG> IntegrationDirectory::FindIntegrations(
+    const std::vector<WSTRING>& assembly_names) const {
+  std::vector<ULONG> integrations;
+  for (auto&& assembly_name : assembly_names) {
+    const auto search = integrations_by_target_.find(assembly_name);
+    if (search != integrations_by_target_.end()) {
+      integrations.insert(integrations.end(), search->second.begin(),
+                          search->second.end());
+    }
+  }
+
+  // Keep the catalog order, an integration may target several of the
+  // assemblies and an assembly may be referenced more than once
+  std::sort(integrations.begin(), integrations.end());
+  integrations.erase(std::unique(integrations.begin(), integrations.end()),
+                     integrations.end());
+  return integrations;
+}
+
+bool IntegrationDirectory::FindIntegrations(
+    const MetadataReader& metadata_reader,
+    std::vector<ULONG>* integrations) const {
+  AssemblyRow assembly_row;
+  if (!metadata_reader.GetAssembly(&assembly_row)) {
+    return false;
+  }
+
+  std::vector<WSTRING> assembly_names{ToWSTRING(assembly_row.name)};
+  const auto count = metadata_reader.GetRowCount(MetadataTable::AssemblyRef);
+  AssemblyRefRow row;
+  for (ULONG rid = 1; rid <= count; rid++) {
+    if (metadata_reader.GetAssemblyRef(rid, &row)) {
+      assembly_names.push_back(ToWSTRING(row.name));
+    }
+  }
+
+  *integrations = FindIntegrations(assembly_names);
+  return true;
+}
+
+unsigned long long IntegrationDirectory::HashIntegrations(
+    const std::vector<ULONG>& integrations) const {
+  std::vector<unsigned long long> definition_hashes;
+  definition_hashes.reserve(integrations.size());
+  for (const auto integration : integrations) {
+    definition_hashes.push_back(entries_[integration].definition_hash);
+  }
+  return HashCandidateIntegrations(definition_hashes);
+}
+
+std::vector<IntegrationMethod> IntegrationDirectory::GetMethods(
+    const std::vector<ULONG>& integrations, const WSTRING& assembly_name) {
+  std::vector<IntegrationMethod> methods;
+  std::lock_guard<std::mutex> guard(materialization_lock_);
+  for (const auto integration : integrations) {
+    for (auto&& method : Materialize(integration, assembly_name)) {
+      methods.push_back(method);
+    }
+  }
+  return methods;
+}
+
+IntegrationMethodKey IntegrationDirectory::GetKey(
+    const IntegrationMethod& method) const {
+  const auto search = integrations_by_name_.find(method.integration_name);
+  if (search == integrations_by_name_.end()) {
+    return {};
+  }
+
+  std::lock_guard<std::mutex> guard(materialization_lock_);
+  for (const auto integration : search->second) {
+    const auto& entry = entries_[integration];
+    for (ULONG i = 0; i < entry.methods.size(); i++) {
+      if (entry.methods[i].SharesDataWith(method)) {
+        return {entry.definition.integration_name, entry.definition_hash, i};
+      }
+    }
+  }
+  return {};
+}
+
+bool IntegrationDirectory::FindMethod(const IntegrationMethodKey& key,
+                                      const WSTRING& assembly_name,
+                                      std::vector<IntegrationMethod>* methods) {
+  const auto search = integrations_by_name_.find(key.integration_name);
+  if (search == integrations_by_name_.end()) {
+    return false;
+  }
+
+  std::lock_guard<std::mutex> guard(materialization_lock_);
+  for (const auto integration : search->second) {
+    if (entries_[integration].definition_hash != key.definition_hash) {
+      continue;
+    }
+
+    const auto& integration_methods = Materialize(integration, assembly_name);
+    if (key.method_index >= integration_methods.size()) {
+      return false;
+    }
+    methods->push_back(integration_methods[key.method_index]);
+    return true;
+  }
+  return false;
+}
+
+size_t IntegrationDirectory::GetMaterializedCount() const {
+  std::lock_guard<std::mutex> guard(materialization_lock_);
+  return materialized_count_;
+}
+
+}  // namespace trace
@@ -0,0 +1,100 @@
+#ifndef DD_CLR_PROFILER_INTEGRATION_DIRECTORY_H_
+#define DD_CLR_PROFILER_INTEGRATION_DIRECTORY_H_
+
+#include <corhlpr.h>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include "instrumentation_plan.h"
+#include "integration.h"
+#include "metadata_reader.h"
+#include "string.h"
+
+namespace trace {
+
+/// <summary>
+/// The integration catalog, indexed by target assembly name. Only the names
+/// and target assemblies of the integrations are read in Initialize: the
+/// methods of an integration are parsed the first time a module referencing
+/// one of its target assemblies is loaded. A module load only looks at the
+/// integrations targeting the module or one of the assemblies it references,
+/// instead of filtering the whole catalog.
+///
+/// Integrations are identified by their position in the catalog, which never
+/// changes once the directory is built. Instrumentation plans identify them by
+/// name and definition hash instead (see IntegrationMethodKey), so plans stay
+/// valid when other integrations are added or removed.
+/// </summary>
+class IntegrationDirectory {
+ private:
+  struct Entry {
+    IntegrationDefinition definition;
+    unsigned long long definition_hash;
+    // Parsed on first use, under materialization_lock_
+    bool materialized;
+    std::vector<IntegrationMethod> methods;
+  };
+
+  const bool is_calltarget_enabled_;
+  const bool is_netstandard_enabled_;
+  std::vector<Entry> entries_;
+  // Indices into entries_, in catalog order
+  std::unordered_map<WSTRING, std::vector<ULONG>> integrations_by_target_;
+  std::unordered_map<WSTRING, std::vector<ULONG>> integrations_by_name_;
+
+  mutable std::mutex materialization_lock_;
+  size_t materialized_count_ = 0;
+
+  // Parses the methods of the integration if needed, the lock must be held
+  const std::vector<IntegrationMethod>& Materialize(
+      ULONG integration, const WSTRING& assembly_name);
+
+  IntegrationDirectory(const IntegrationDirectory&) = delete;
+  IntegrationDirectory& operator=(const IntegrationDirectory&) = delete;
+
+ public:
+  // The instrumentation mode must be the one the definitions were loaded with
+  IntegrationDirectory(const std::vector<IntegrationDefinition>& definitions,
+                       bool is_calltarget_enabled, bool is_netstandard_enabled);
+
+  size_t GetIntegrationCount() const { return entries_.size(); }
+
+  // Every integration of the catalog, in catalog order
+  std::vector<ULONG> GetAllIntegrations() const;
+
+  // The integrations targeting one of the assemblies, in catalog order. Their
+  // methods are not parsed.
+  std::vector<ULONG> FindIntegrations(
+      const std::vector<WSTRING>& assembly_names) const;
+
+  // The integrations targeting the module of the metadata or one of its
+  // assembly references. Returns false if the metadata is not readable.
+  bool FindIntegrations(const MetadataReader& metadata_reader,
+                        std::vector<ULONG>* integrations) const;
+
+  // Hash of the definitions of the integrations, see HashCandidateIntegrations
+  unsigned long long HashIntegrations(
+      const std::vector<ULONG>& integrations) const;
+
+  // The methods of the integrations, in order. The integrations that were not
+  // needed before are parsed for the module of the assembly.
+  std::vector<IntegrationMethod> GetMethods(
+      const std::vector<ULONG>& integrations, const WSTRING& assembly_name);
+
+  // The key of a method returned by GetMethods, with an empty integration name
+  // if the method is not in the catalog
+  IntegrationMethodKey GetKey(const IntegrationMethod& method) const;
+
+  // Appends the method of a key, false if its integration is not in the
+  // catalog or has another definition
+  bool FindMethod(const IntegrationMethodKey& key, const WSTRING& assembly_name,
+                  std::vector<IntegrationMethod>* methods);
+
+  // Number of integrations whose methods were parsed
+  size_t GetMaterializedCount() const;
+};
+
+}  // namespace trace
+
+#endif  // DD_CLR_PROFILER_INTEGRATION_DIRECTORY_H_
@@ -1,8 +1,11 @@
 #include "integration_loader.h"
 
+#include <algorithm>
 #include <exception>
 #include <stdexcept>
 
+#include "clr_helpers.h"
+#include "dd_profiler_constants.h"
 #include "environment_variables.h"
 #include "logging.h"
 #include "util.h"
@@ -12,8 +15,14 @@ namespace trace {
 using json = nlohmann::json;
 
 std::vector<Integration> LoadIntegrationsFromEnvironment() {
+  return LoadIntegrationsFromFiles(
+      GetEnvironmentValues(environment::integrations_path));
+}
+
+std::vector<Integration> LoadIntegrationsFromFiles(
+    const std::vector<WSTRING>& file_paths) {
   std::vector<Integration> integrations;
-  for (const auto f : GetEnvironmentValues(environment::integrations_path)) {
+  for (const auto f : file_paths) {
     Debug("Loading integrations from file: ", f);
     auto is = LoadIntegrationsFromFile(f);
     for (auto& i : is) {
@@ -23,6 +32,102 @@ std::vector<Integration> LoadIntegrationsFromEnvironment() {
   return integrations;
 }
 
+std::vector<IntegrationDefinition> LoadIntegrationDefinitions(
+    const Configuration& configuration) {
+  std::vector<IntegrationDefinition> definitions;
+
+  for (const auto& f : configuration.integrations_paths) {
+    Debug("Loading integration definitions from file: ", f);
+    try {
+      std::ifstream stream;
+      stream.open(ToString(f));
+
+      if (static_cast<bool>(stream)) {
+        // temporarily skip the calls into netstandard.dll that were added in
+        // https://github.com/DataDog/dd-trace-dotnet/pull/753.
+        // users can opt-in to the additional instrumentation by setting
+        // environment variable DD_TRACE_NETSTANDARD_ENABLED
+        for (auto& definition : LoadIntegrationDefinitionsFromStream(
+                 stream, configuration.calltarget_enabled,
+                 configuration.netstandard_enabled)) {
+          definitions.push_back(definition);
+        }
+      } else {
+        Warn("Failed to load integrations from file ", f);
+      }
+
+      stream.close();
+    } catch (const std::exception& ex) {
+      Warn("Failed to load integrations: ", ex.what());
+    }
+  }
+
+  // remove disabled integrations
+  const auto& disabled = configuration.disabled_integrations;
+  definitions.erase(
+      std::remove_if(definitions.begin(), definitions.end(),
+                     [&disabled](const IntegrationDefinition& definition) {
+                       return std::find(disabled.begin(), disabled.end(),
+                                        definition.integration_name) !=
+                              disabled.end();
+                     }),
+      definitions.end());
+
+  return definitions;
+}
+
+std::vector<IntegrationDefinition> LoadIntegrationDefinitionsFromStream(
+    std::istream& stream, bool is_calltarget_enabled,
+    bool is_netstandard_enabled) {
+  std::vector<IntegrationDefinition> definitions;
+
+  try {
+    json j;
+    // parse the stream
+    stream >> j;
+
+    for (auto& el : j) {
+      auto d = IntegrationDefinitionFromJson(el, is_calltarget_enabled,
+                                             is_netstandard_enabled);
+      if (std::get<1>(d)) {
+        definitions.push_back(std::get<0>(d));
+      }
+    }
+  } catch (const json::parse_error& e) {
+    Warn("Invalid integrations:", e.what());
+  } catch (const json::type_error& e) {
+    Warn("Invalid integrations:", e.what());
+  } catch (const std::exception& e) {
+    Warn("Failed to load integrations: ", e.what());
+  }
+
+  return definitions;
+}
+
+std::vector<IntegrationMethod> LoadIntegrationMethods(
+    const IntegrationDefinition& definition, bool is_calltarget_enabled,
+    bool is_netstandard_enabled) {
+  std::vector<IntegrationMethod> integration_methods;
+
+  try {
+    const auto i = IntegrationFromJson(json::parse(definition.definition));
+    if (std::get<1>(i)) {
+      integration_methods =
+          FlattenIntegrations({std::get<0>(i)}, is_calltarget_enabled);
+    }
+  } catch (const std::exception& e) {
+    Warn("Failed to load the methods of integration ",
+         definition.integration_name, ": ", e.what());
+  }
+
+  if (!is_netstandard_enabled) {
+    integration_methods = FilterIntegrationsByTargetAssemblyName(
+        integration_methods, {"netstandard"_W});
+  }
+
+  return integration_methods;
+}
+
 std::vector<Integration> LoadIntegrationsFromFile(const WSTRING& file_path) {
   std::vector<Integration> integrations;
 
@@ -109,7 +214,76 @@ std::pair<Integration, bool> IntegrationFromJson(const json::value_type& src) {
       }
     }
   }
-  return std::make_pair<Integration, bool>({name, replacements}, true);
+
+  // optional, defaults to instrumenting every call
+  ULONG sampling_rate = kSamplingRateEveryCall;
+  const auto raw_sampling_rate = src.value("sampling_rate", json());
+  if (raw_sampling_rate.is_number_unsigned() &&
+      raw_sampling_rate.get<ULONG>() > 0) {
+    sampling_rate = raw_sampling_rate.get<ULONG>();
+  } else if (!raw_sampling_rate.is_null()) {
+    Warn("Invalid sampling_rate for integration ", name,
+         ", instrumenting every call: ", raw_sampling_rate.dump());
+  }
+
+  return std::make_pair<Integration, bool>({name, replacements, sampling_rate},
+                                           true);
+}
+
+std::pair<IntegrationDefinition, bool> IntegrationDefinitionFromJson(
+    const json::value_type& src, bool is_calltarget_enabled,
+    bool is_netstandard_enabled) {
+  if (!src.is_object()) {
+    return std::make_pair<IntegrationDefinition, bool>({}, false);
+  }
+
+  IntegrationDefinition definition;
+  definition.integration_name = ToWSTRING(src.value("name", ""));
+  if (definition.integration_name.empty()) {
+    Warn("Integration name is missing for integration: ", src.dump());
+    return std::make_pair<IntegrationDefinition, bool>({}, false);
+  }
+
+  // only the target assemblies are read, the rest of the method replacements
+  // is parsed when a module references one of them
+  bool has_enabled_methods = false;
+  auto arr = src.value("method_replacements", json::array());
+  if (arr.is_array()) {
+    for (auto& el : arr) {
+      if (!el.is_object()) {
+        continue;
+      }
+
+      const auto wrapper = el.value("wrapper", json::object());
+      const auto target = el.value("target", json::object());
+      const auto action =
+          wrapper.is_object() ? ToWSTRING(wrapper.value("action", "")) : ""_W;
+      const auto assembly =
+          target.is_object() ? ToWSTRING(target.value("assembly", "")) : ""_W;
+
+      // the same filters as FlattenIntegrations and LoadIntegrationMethods
+      if ((action == calltarget_modification_action) != is_calltarget_enabled ||
+          (!is_netstandard_enabled && assembly == "netstandard"_W)) {
+        continue;
+      }
+
+      has_enabled_methods = true;
+      auto& assemblies = definition.target_assemblies;
+      if (!assembly.empty() &&
+          std::find(assemblies.begin(), assemblies.end(), assembly) ==
+              assemblies.end()) {
+        assemblies.push_back(assembly);
+      }
+    }
+  }
+
+  if (!has_enabled_methods) {
+    return std::make_pair<IntegrationDefinition, bool>({}, false);
+  }
+
+  definition.definition = src.dump();
+  return std::make_pair<IntegrationDefinition, bool>(std::move(definition),
+                                                     true);
 }
 
 std::pair<MethodReplacement, bool> MethodReplacementFromJson(
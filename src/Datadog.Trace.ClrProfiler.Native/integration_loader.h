@@ -7,6 +7,7 @@
 #include <string>
 #include <vector>
 
+#include "configuration.h"
 #include "integration.h"
 #include "macros.h"
 
@@ -17,6 +18,23 @@ using json = nlohmann::json;
 // LoadIntegrationsFromEnvironment loads integrations from any files specified
 // in the DD_INTEGRATIONS environment variable
 std::vector<Integration> LoadIntegrationsFromEnvironment();
+// LoadIntegrationsFromFiles loads the integrations from each of the files
+std::vector<Integration> LoadIntegrationsFromFiles(
+    const std::vector<WSTRING>& file_paths);
+// LoadIntegrationDefinitions reads the names and target assemblies of the
+// enabled integrations of the configuration, without parsing their methods
+std::vector<IntegrationDefinition> LoadIntegrationDefinitions(
+    const Configuration& configuration);
+// LoadIntegrationDefinitionsFromStream reads the integrations of a stream
+// that have method replacements enabled in the instrumentation mode
+std::vector<IntegrationDefinition> LoadIntegrationDefinitionsFromStream(
+    std::istream& stream, bool is_calltarget_enabled,
+    bool is_netstandard_enabled);
+// LoadIntegrationMethods parses the methods of an integration definition and
+// flattens the enabled ones to the integration methods the profiler applies
+std::vector<IntegrationMethod> LoadIntegrationMethods(
+    const IntegrationDefinition& definition, bool is_calltarget_enabled,
+    bool is_netstandard_enabled);
 // LoadIntegrationsFromFile loads the integrations from a file
 std::vector<Integration> LoadIntegrationsFromFile(const WSTRING& file_path);
 // LoadIntegrationsFromFile loads the integrations from a stream
@@ -25,6 +43,9 @@ std::vector<Integration> LoadIntegrationsFromStream(std::istream& stream);
 namespace {
 
 std::pair<Integration, bool> IntegrationFromJson(const json::value_type& src);
+std::pair<IntegrationDefinition, bool> IntegrationDefinitionFromJson(
+    const json::value_type& src, bool is_calltarget_enabled,
+    bool is_netstandard_enabled);
 std::pair<MethodReplacement, bool> MethodReplacementFromJson(
     const json::value_type& src);
 MethodReference MethodReferenceFromJson(const json::value_type& src,
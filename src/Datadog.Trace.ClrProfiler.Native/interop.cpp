@@ -15,3 +15,27 @@ EXTERN_C BOOL STDAPICALLTYPE IsProfilerAttached() {
 EXTERN_C VOID STDAPICALLTYPE GetAssemblyAndSymbolsBytes(BYTE** pAssemblyArray, int* assemblySize, BYTE** pSymbolsArray, int* symbolsSize) {
   return trace::profiler->GetAssemblyAndSymbolsBytes(pAssemblyArray, assemblySize, pSymbolsArray, symbolsSize);
 }
+
+EXTERN_C int STDAPICALLTYPE GetRewriteQuarantine(WCHAR* buffer, int bufferSize) {
+  // Returns the length of the export, it is only copied (null terminated) when
+  // the buffer is large enough
+  if (trace::profiler == nullptr) {
+    return 0;
+  }
+  const auto quarantine = trace::profiler->GetRewriteQuarantine();
+  const int length = static_cast<int>(quarantine.size());
+  if (buffer != nullptr && bufferSize > length) {
+    memcpy(buffer, quarantine.c_str(), (length + 1) * sizeof(WCHAR));
+  }
+  return length;
+}
+
+EXTERN_C int STDAPICALLTYPE GetProfilerMetrics(INT64* values, int count) {
+  // Returns the number of values, they are only copied when the buffer is
+  // large enough. The layout is documented in profiler_metrics.h and must be
+  // kept in sync with ProfilerMetricsListener.cs.
+  if (trace::profiler == nullptr || count < 0) {
+    return 0;
+  }
+  return static_cast<int>(trace::profiler->GetMetrics().Export(values, count));
+}
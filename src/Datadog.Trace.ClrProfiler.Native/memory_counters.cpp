@@ -0,0 +1,49 @@
+#include "memory_counters.h"
+
+#include <atomic>
+#include <sstream>
+
+namespace trace {
+
+namespace {
+
+const size_t kCounterCount = static_cast<size_t>(MemoryCounter::Count);
+
+const char* const kCounterNames[kCounterCount] = {
+    "ModuleMetadata", "CallTargetTokens", "RejitModule", "RejitMethod"};
+
+std::atomic<long long> counter_objects[kCounterCount];
+std::atomic<long long> counter_bytes[kCounterCount];
+
+}  // namespace
+
+void TrackAllocation(MemoryCounter counter, size_t bytes) {
+  const auto index = static_cast<size_t>(counter);
+  counter_objects[index]++;
+  counter_bytes[index] += static_cast<long long>(bytes);
+}
+
+void TrackDeallocation(MemoryCounter counter, size_t bytes) {
+  const auto index = static_cast<size_t>(counter);
+  counter_objects[index]--;
+  counter_bytes[index] -= static_cast<long long>(bytes);
+}
+
+MemoryCounterValue GetMemoryCounter(MemoryCounter counter) {
+  const auto index = static_cast<size_t>(counter);
+  MemoryCounterValue value;
+  value.objects = counter_objects[index];
+  value.bytes = counter_bytes[index];
+  return value;
+}
+
+WSTRING MemoryCountersStr() {
+  std::stringstream ss;
+  for (size_t i = 0; i < kCounterCount; i++) {
+    ss << (i > 0 ? " " : "") << kCounterNames[i] << "=" << counter_objects[i]
+       << "/" << counter_bytes[i] << "B";
+  }
+  return ToWSTRING(ss.str());
+}
+
+}  // namespace trace
@@ -0,0 +1,36 @@
+#ifndef DD_CLR_PROFILER_MEMORY_COUNTERS_H_
+#define DD_CLR_PROFILER_MEMORY_COUNTERS_H_
+
+#include <cstddef>
+
+#include "string.h"
+
+namespace trace {
+
+// Native objects whose lifetime is tied to a loaded module
+enum class MemoryCounter : unsigned char {
+  ModuleMetadata = 0,
+  CallTargetTokens = 1,
+  RejitModule = 2,
+  RejitMethod = 3,
+  Count = 4
+};
+
+struct MemoryCounterValue {
+  long long objects = 0;
+  // Size of the objects themselves, not of what they point to
+  long long bytes = 0;
+};
+
+// Called from the constructors and destructors of the counted objects
+void TrackAllocation(MemoryCounter counter, size_t bytes);
+void TrackDeallocation(MemoryCounter counter, size_t bytes);
+
+MemoryCounterValue GetMemoryCounter(MemoryCounter counter);
+
+// "ModuleMetadata=<objects>/<bytes>B ..." for the logs
+WSTRING MemoryCountersStr();
+
+}  // namespace trace
+
+#endif  // DD_CLR_PROFILER_MEMORY_COUNTERS_H_
@@ -49,8 +49,7 @@ HRESULT MetadataBuilder::EmitAssemblyRef(
 HRESULT MetadataBuilder::FindWrapperTypeRef(
     const MethodReplacement& method_replacement,
     mdTypeRef& type_ref_out) const {
-  const auto& cache_key =
-      method_replacement.wrapper_method.get_type_cache_key();
+  const auto cache_key = method_replacement.wrapper_method.type_cache_id;
   mdTypeRef type_ref = mdTypeRefNil;
 
   if (metadata_.TryGetWrapperParentTypeRef(cache_key, type_ref)) {
@@ -71,8 +70,8 @@ HRESULT MetadataBuilder::FindWrapperTypeRef(
   } else {
     // type is defined in another assembly,
     // find a reference to the assembly where type lives
-    const auto assembly_ref = FindAssemblyRef(
-        assembly_import_, method_replacement.wrapper_method.assembly.name);
+    const auto assembly_ref = metadata_.FindAssemblyRef(
+        method_replacement.wrapper_method.assembly.name);
     if (assembly_ref == mdAssemblyRefNil) {
       // TODO: emit assembly reference if not found?
       Warn("Assembly reference for",
@@ -103,8 +102,7 @@ HRESULT MetadataBuilder::FindWrapperTypeRef(
 
 HRESULT MetadataBuilder::StoreWrapperMethodRef(
     const MethodReplacement& method_replacement) const {
-  const auto& cache_key =
-      method_replacement.wrapper_method.get_method_cache_key();
+  const auto cache_key = method_replacement.wrapper_method.method_cache_id;
   mdMemberRef member_ref = mdMemberRefNil;
 
   if (metadata_.TryGetWrapperMemberRef(cache_key, member_ref)) {
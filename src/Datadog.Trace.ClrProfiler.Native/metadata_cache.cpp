@@ -0,0 +1,48 @@
+#include "metadata_cache.h"
+
+namespace trace {
+
+MetadataCache::MetadataCache(ComPtr<IMetaDataImport2> metadata_import)
+    : metadata_import_(metadata_import) {}
+
+const FunctionInfo& MetadataCache::GetFunctionInfo(mdToken token) {
+  {
+    std::lock_guard<std::mutex> guard(lock_);
+    const auto search = functions_.find(token);
+    if (search != functions_.end()) {
+      return *search->second;
+    }
+  }
+
+  // Resolved without holding the lock, the descriptor looks up the tokens it
+  // references through this cache. If another thread won the race its entry
+  // is kept and this one is dropped.
+  std::unique_ptr<const FunctionInfo> function_info(
+      new FunctionInfo(trace::GetFunctionInfo(metadata_import_, token, this)));
+
+  std::lock_guard<std::mutex> guard(lock_);
+  return *functions_.emplace(token, std::move(function_info)).first->second;
+}
+
+const TypeInfo& MetadataCache::GetTypeInfo(mdToken token) {
+  return *GetSharedTypeInfo(token);
+}
+
+std::shared_ptr<const TypeInfo> MetadataCache::GetSharedTypeInfo(
+    mdToken token) {
+  {
+    std::lock_guard<std::mutex> guard(lock_);
+    const auto search = types_.find(token);
+    if (search != types_.end()) {
+      return search->second;
+    }
+  }
+
+  auto type_info = std::make_shared<const TypeInfo>(
+      trace::GetTypeInfo(metadata_import_, token, this));
+
+  std::lock_guard<std::mutex> guard(lock_);
+  return types_.emplace(token, std::move(type_info)).first->second;
+}
+
+}  // namespace trace
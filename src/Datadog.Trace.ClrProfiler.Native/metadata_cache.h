@@ -0,0 +1,47 @@
+#ifndef DD_CLR_PROFILER_METADATA_CACHE_H_
+#define DD_CLR_PROFILER_METADATA_CACHE_H_
+
+#include <corhlpr.h>
+
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
+#include "clr_helpers.h"
+#include "com_ptr.h"
+
+namespace trace {
+
+/// <summary>
+/// Per module cache of the type and function descriptors read from the
+/// metadata, keyed by token. Each token is resolved once and its descriptor is
+/// immutable; parents, base types and generic definitions are resolved through
+/// the cache too, so a base type is a single object shared by all the types
+/// that extend it. Entries are never evicted: the returned references are
+/// valid until the cache is destroyed with its module metadata on unload.
+/// </summary>
+class MetadataCache {
+ private:
+  const ComPtr<IMetaDataImport2> metadata_import_;
+
+  std::mutex lock_;
+  std::unordered_map<mdToken, std::shared_ptr<const TypeInfo>> types_;
+  std::unordered_map<mdToken, std::unique_ptr<const FunctionInfo>> functions_;
+
+ public:
+  explicit MetadataCache(ComPtr<IMetaDataImport2> metadata_import);
+
+  MetadataCache(const MetadataCache&) = delete;
+  MetadataCache& operator=(const MetadataCache&) = delete;
+
+  const FunctionInfo& GetFunctionInfo(mdToken token);
+
+  const TypeInfo& GetTypeInfo(mdToken token);
+
+  // Same entry as GetTypeInfo, for the descriptors linking to it
+  std::shared_ptr<const TypeInfo> GetSharedTypeInfo(mdToken token);
+};
+
+}  // namespace trace
+
+#endif  // DD_CLR_PROFILER_METADATA_CACHE_H_
@@ -0,0 +1,785 @@
+#include "metadata_reader.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace trace {
+
+namespace {
+
+// Column kinds of the table schemas. Values below the coded indexes are plain
+// indexes into the table with that number.
+enum ColumnKind : BYTE {
+  kColTypeDefOrRef = 0x40,
+  kColHasConstant,
+  kColHasCustomAttribute,
+  kColHasFieldMarshal,
+  kColHasDeclSecurity,
+  kColMemberRefParent,
+  kColHasSemantics,
+  kColMethodDefOrRef,
+  kColMemberForwarded,
+  kColImplementation,
+  kColCustomAttributeType,
+  kColResolutionScope,
+  kColTypeOrMethodDef,
+  kColU16 = 0x80,
+  kColU32,
+  kColString,
+  kColGuid,
+  kColBlob,
+  kColEnd = 0xFF
+};
+
+const BYTE kUnusedTable = 0xFF;
+
+struct CodedIndex {
+  BYTE tag_bits;
+  BYTE table_count;
+  BYTE tables[22];
+};
+
+// II.24.2.6, in the order of the coded index column kinds
+const CodedIndex kCodedIndexes[] = {
+    // TypeDefOrRef
+    {2, 3, {0x02, 0x01, 0x1B}},
+    // HasConstant
+    {2, 3, {0x04, 0x08, 0x17}},
+    // HasCustomAttribute
+    {5, 22, {0x06, 0x04, 0x01, 0x02, 0x08, 0x09, 0x0A, 0x00, 0x0E, 0x17, 0x14,
+             0x11, 0x1A, 0x1B, 0x20, 0x23, 0x26, 0x27, 0x28, 0x2A, 0x2C, 0x2B}},
+    // HasFieldMarshal
+    {1, 2, {0x04, 0x08}},
+    // HasDeclSecurity
+    {2, 3, {0x02, 0x06, 0x20}},
+    // MemberRefParent
+    {3, 5, {0x02, 0x01, 0x1A, 0x06, 0x1B}},
+    // HasSemantics
+    {1, 2, {0x14, 0x17}},
+    // MethodDefOrRef
+    {1, 2, {0x06, 0x0A}},
+    // MemberForwarded
+    {1, 2, {0x04, 0x06}},
+    // Implementation
+    {2, 3, {0x26, 0x23, 0x27}},
+    // CustomAttributeType
+    {3, 5, {kUnusedTable, kUnusedTable, 0x06, 0x0A, kUnusedTable}},
+    // ResolutionScope
+    {2, 4, {0x00, 0x1A, 0x23, 0x01}},
+    // TypeOrMethodDef
+    {1, 2, {0x02, 0x06}},
+};
+
+const ULONG kSchemaTableCount = static_cast<ULONG>(MetadataTable::Count);
+const ULONG kSchemaMaxColumns = 9;
+
+// II.22, one row per table
+const BYTE kTableSchemas[kSchemaTableCount][kSchemaMaxColumns] = {
+    // Module
+    {kColU16, kColString, kColGuid, kColGuid, kColGuid, kColEnd},
+    // TypeRef
+    {kColResolutionScope, kColString, kColString, kColEnd},
+    // TypeDef
+    {kColU32, kColString, kColString, kColTypeDefOrRef, 0x04, 0x06, kColEnd},
+    // FieldPtr
+    {0x04, kColEnd},
+    // Field
+    {kColU16, kColString, kColBlob, kColEnd},
+    // MethodPtr
+    {0x06, kColEnd},
+    // MethodDef
+    {kColU32, kColU16, kColU16, kColString, kColBlob, 0x08, kColEnd},
+    // ParamPtr
+    {0x08, kColEnd},
+    // Param
+    {kColU16, kColU16, kColString, kColEnd},
+    // InterfaceImpl
+    {0x02, kColTypeDefOrRef, kColEnd},
+    // MemberRef
+    {kColMemberRefParent, kColString, kColBlob, kColEnd},
+    // Constant (1 byte type followed by 1 byte padding)
+    {kColU16, kColHasConstant, kColBlob, kColEnd},
+    // CustomAttribute
+    {kColHasCustomAttribute, kColCustomAttributeType, kColBlob, kColEnd},
+    // FieldMarshal
+    {kColHasFieldMarshal, kColBlob, kColEnd},
+    // DeclSecurity
+    {kColU16, kColHasDeclSecurity, kColBlob, kColEnd},
+    // ClassLayout
+    {kColU16, kColU32, 0x02, kColEnd},
+    // FieldLayout
+    {kColU32, 0x04, kColEnd},
+    // StandAloneSig
+    {kColBlob, kColEnd},
+    // EventMap
+    {0x02, 0x14, kColEnd},
+    // EventPtr
+    {0x14, kColEnd},
+    // Event
+    {kColU16, kColString, kColTypeDefOrRef, kColEnd},
+    // PropertyMap
+    {0x02, 0x17, kColEnd},
+    // PropertyPtr
+    {0x17, kColEnd},
+    // Property
+    {kColU16, kColString, kColBlob, kColEnd},
+    // MethodSemantics
+    {kColU16, 0x06, kColHasSemantics, kColEnd},
+    // MethodImpl
+    {0x02, kColMethodDefOrRef, kColMethodDefOrRef, kColEnd},
+    // ModuleRef
+    {kColString, kColEnd},
+    // TypeSpec
+    {kColBlob, kColEnd},
+    // ImplMap
+    {kColU16, kColMemberForwarded, kColString, 0x1A, kColEnd},
+    // FieldRVA
+    {kColU32, 0x04, kColEnd},
+    // ENCLog
+    {kColU32, kColU32, kColEnd},
+    // ENCMap
+    {kColU32, kColEnd},
+    // Assembly
+    {kColU32, kColU16, kColU16, kColU16, kColU16, kColU32, kColBlob, kColString,
+     kColString},
+    // AssemblyProcessor
+    {kColU32, kColEnd},
+    // AssemblyOS
+    {kColU32, kColU32, kColU32, kColEnd},
+    // AssemblyRef
+    {kColU16, kColU16, kColU16, kColU16, kColU32, kColBlob, kColString,
+     kColString, kColBlob},
+    // AssemblyRefProcessor
+    {kColU32, 0x23, kColEnd},
+    // AssemblyRefOS
+    {kColU32, kColU32, kColU32, 0x23, kColEnd},
+    // File
+    {kColU32, kColString, kColBlob, kColEnd},
+    // ExportedType
+    {kColU32, kColU32, kColString, kColString, kColImplementation, kColEnd},
+    // ManifestResource
+    {kColU32, kColU32, kColString, kColImplementation, kColEnd},
+    // NestedClass
+    {0x02, 0x02, kColEnd},
+    // GenericParam
+    {kColU16, kColU16, kColTypeOrMethodDef, kColString, kColEnd},
+    // MethodSpec
+    {kColMethodDefOrRef, kColBlob, kColEnd},
+    // GenericParamConstraint
+    {0x2A, kColTypeDefOrRef, kColEnd},
+};
+
+// Images are little endian and the fields are not necessarily aligned
+USHORT ReadU16(LPCBYTE p) {
+  USHORT value;
+  memcpy(&value, p, sizeof(value));
+  return value;
+}
+
+ULONG ReadU32(LPCBYTE p) {
+  ULONG value;
+  memcpy(&value, p, sizeof(value));
+  return value;
+}
+
+unsigned long long ReadU64(LPCBYTE p) {
+  unsigned long long value;
+  memcpy(&value, p, sizeof(value));
+  return value;
+}
+
+mdToken DecodeCodedIndex(BYTE kind, ULONG value) {
+  const CodedIndex& coded_index = kCodedIndexes[kind - kColTypeDefOrRef];
+  const ULONG tag = value & ((1 << coded_index.tag_bits) - 1);
+  const ULONG rid = value >> coded_index.tag_bits;
+  if (tag >= coded_index.table_count ||
+      coded_index.tables[tag] == kUnusedTable || rid == 0) {
+    return mdTokenNil;
+  }
+  return TokenFromRid(rid, static_cast<ULONG>(coded_index.tables[tag]) << 24);
+}
+
+}  // namespace
+
+MetadataReader::MetadataReader(LPCBYTE base_load_address, DWORD module_flags) {
+  valid_ = Initialize(base_load_address, module_flags);
+}
+
+bool MetadataReader::Initialize(LPCBYTE base_load_address,
+                                DWORD module_flags) {
+  if (base_load_address == nullptr ||
+      (module_flags & COR_PRF_MODULE_DYNAMIC) != 0) {
+    return false;
+  }
+
+  // PE / COFF headers (II.25.2)
+  LPCBYTE base = base_load_address;
+  if (ReadU16(base) != 0x5A4D) {  // MZ
+    return false;
+  }
+
+  LPCBYTE pe_header = base + ReadU32(base + 0x3C);
+  if (ReadU32(pe_header) != 0x00004550) {  // PE\0\0
+    return false;
+  }
+
+  LPCBYTE file_header = pe_header + 4;
+  const USHORT section_count = ReadU16(file_header + 2);
+  const USHORT optional_header_size = ReadU16(file_header + 16);
+  LPCBYTE optional_header = file_header + 20;
+
+  ULONG data_directories_offset;
+  switch (ReadU16(optional_header)) {
+    case 0x10B:  // PE32
+      data_directories_offset = 96;
+      break;
+    case 0x20B:  // PE32+
+      data_directories_offset = 112;
+      break;
+    default:
+      return false;
+  }
+
+  const ULONG cli_header_directory = 14;
+  const ULONG data_directory_count =
+      ReadU32(optional_header + data_directories_offset - 4);
+  if (data_directory_count <= cli_header_directory ||
+      optional_header_size <
+          data_directories_offset + (cli_header_directory + 1) * 8) {
+    return false;
+  }
+
+  base_ = base;
+  flat_layout_ = (module_flags & COR_PRF_MODULE_FLAT_LAYOUT) != 0;
+  section_headers_ = optional_header + optional_header_size;
+  section_count_ = section_count;
+
+  const ULONG cli_header_rva = ReadU32(
+      optional_header + data_directories_offset + cli_header_directory * 8);
+  LPCBYTE cli_header = GetRvaAddress(cli_header_rva);
+  if (cli_header_rva == 0 || cli_header == nullptr) {
+    return false;
+  }
+
+  // CLI header (II.25.3.3) and metadata root (II.24.2.1)
+  const ULONG metadata_size = ReadU32(cli_header + 12);
+  LPCBYTE metadata = GetRvaAddress(ReadU32(cli_header + 8));
+  if (metadata == nullptr || metadata_size < 20 ||
+      ReadU32(metadata) != 0x424A5342) {  // BSJB
+    return false;
+  }
+
+  const ULONG version_length = ReadU32(metadata + 12);
+  ULONG offset = 16 + version_length;
+  if (offset + 4 > metadata_size) {
+    return false;
+  }
+
+  const USHORT stream_count = ReadU16(metadata + offset + 2);
+  offset += 4;
+
+  LPCBYTE tables_stream = nullptr;
+  ULONG tables_stream_size = 0;
+  for (USHORT i = 0; i < stream_count; i++) {
+    if (offset + 8 > metadata_size) {
+      return false;
+    }
+
+    const ULONG stream_offset = ReadU32(metadata + offset);
+    const ULONG stream_size = ReadU32(metadata + offset + 4);
+    const char* stream_name =
+        reinterpret_cast<const char*>(metadata + offset + 8);
+    const size_t name_length =
+        strnlen(stream_name, std::min<size_t>(32, metadata_size - offset - 8));
+    offset += 8 + static_cast<ULONG>((name_length + 4) & ~3);
+
+    if (stream_offset > metadata_size ||
+        stream_size > metadata_size - stream_offset) {
+      return false;
+    }
+
+    LPCBYTE stream = metadata + stream_offset;
+    if (strcmp(stream_name, "#~") == 0) {
+      tables_stream = stream;
+      tables_stream_size = stream_size;
+    } else if (strcmp(stream_name, "#Strings") == 0) {
+      strings_ = stream;
+      strings_size_ = stream_size;
+    } else if (strcmp(stream_name, "#Blob") == 0) {
+      blobs_ = stream;
+      blobs_size_ = stream_size;
+    } else if (strcmp(stream_name, "#GUID") == 0) {
+      guids_ = stream;
+      guids_size_ = stream_size;
+    } else if (strcmp(stream_name, "#US") == 0) {
+      user_strings_ = stream;
+      user_strings_size_ = stream_size;
+    } else if (strcmp(stream_name, "#-") == 0) {
+      // Uncompressed (edit and continue) tables are left to COM
+      return false;
+    }
+  }
+
+  if (tables_stream == nullptr) {
+    return false;
+  }
+
+  return InitializeTables(tables_stream, tables_stream_size);
+}
+
+bool MetadataReader::InitializeTables(LPCBYTE tables_stream,
+                                      ULONG tables_stream_size) {
+  // #~ stream header (II.24.2.6)
+  if (tables_stream_size < 24) {
+    return false;
+  }
+
+  const BYTE heap_sizes = tables_stream[6];
+  const unsigned long long valid_tables = ReadU64(tables_stream + 8);
+  ULONG offset = 24;
+
+  for (ULONG table = 0; table < 64; table++) {
+    if ((valid_tables & (1ULL << table)) == 0) {
+      continue;
+    }
+    if (table >= kTableCount || offset + 4 > tables_stream_size) {
+      return false;
+    }
+    row_counts_[table] = ReadU32(tables_stream + offset);
+    offset += 4;
+  }
+
+  // Extra data flag written by the runtime for some metadata layouts
+  if (heap_sizes & 0x40) {
+    offset += 4;
+  }
+
+  // Pointer tables only exist in unoptimized metadata, the lists of the
+  // TypeDef and MethodDef rows would be indirect.
+  if (row_counts_[static_cast<ULONG>(MetadataTable::FieldPtr)] > 0 ||
+      row_counts_[static_cast<ULONG>(MetadataTable::MethodPtr)] > 0 ||
+      row_counts_[static_cast<ULONG>(MetadataTable::ParamPtr)] > 0 ||
+      row_counts_[static_cast<ULONG>(MetadataTable::EventPtr)] > 0 ||
+      row_counts_[static_cast<ULONG>(MetadataTable::PropertyPtr)] > 0) {
+    return false;
+  }
+
+  const BYTE string_index_size = (heap_sizes & 0x01) ? 4 : 2;
+  const BYTE guid_index_size = (heap_sizes & 0x02) ? 4 : 2;
+  const BYTE blob_index_size = (heap_sizes & 0x04) ? 4 : 2;
+
+  for (ULONG table = 0; table < kTableCount; table++) {
+    ULONG row_size = 0;
+    for (ULONG column = 0; column < kMaxColumns; column++) {
+      const BYTE kind = kTableSchemas[table][column];
+      if (kind == kColEnd) {
+        break;
+      }
+
+      BYTE size;
+      switch (kind) {
+        case kColU16:
+          size = 2;
+          break;
+        case kColU32:
+          size = 4;
+          break;
+        case kColString:
+          size = string_index_size;
+          break;
+        case kColGuid:
+          size = guid_index_size;
+          break;
+        case kColBlob:
+          size = blob_index_size;
+          break;
+        default:
+          if (kind < kColTypeDefOrRef) {
+            size = row_counts_[kind] < 0x10000 ? 2 : 4;
+          } else {
+            const CodedIndex& coded_index =
+                kCodedIndexes[kind - kColTypeDefOrRef];
+            ULONG max_rows = 0;
+            for (BYTE i = 0; i < coded_index.table_count; i++) {
+              if (coded_index.tables[i] != kUnusedTable) {
+                max_rows =
+                    std::max(max_rows, row_counts_[coded_index.tables[i]]);
+              }
+            }
+            size = max_rows < (1UL << (16 - coded_index.tag_bits)) ? 2 : 4;
+          }
+          break;
+      }
+
+      column_offsets_[table][column] = static_cast<BYTE>(row_size);
+      column_sizes_[table][column] = size;
+      row_size += size;
+    }
+    row_sizes_[table] = row_size;
+  }
+
+  for (ULONG table = 0; table < kTableCount; table++) {
+    const unsigned long long table_size =
+        static_cast<unsigned long long>(row_counts_[table]) * row_sizes_[table];
+    if (offset + table_size > tables_stream_size) {
+      return false;
+    }
+    tables_[table] = tables_stream + offset;
+    offset += static_cast<ULONG>(table_size);
+  }
+
+  return true;
+}
+
+LPCBYTE MetadataReader::GetRow(MetadataTable table, ULONG rid) const {
+  const ULONG index = static_cast<ULONG>(table);
+  if (!valid_ || rid == 0 || rid > row_counts_[index]) {
+    return nullptr;
+  }
+  return tables_[index] + (rid - 1) * row_sizes_[index];
+}
+
+ULONG MetadataReader::ReadColumn(MetadataTable table, LPCBYTE row,
+                                 ULONG column) const {
+  const ULONG index = static_cast<ULONG>(table);
+  LPCBYTE value = row + column_offsets_[index][column];
+  return column_sizes_[index][column] == 2 ? ReadU16(value) : ReadU32(value);
+}
+
+const char* MetadataReader::GetString(ULONG index) const {
+  if (index >= strings_size_) {
+    return "";
+  }
+  return reinterpret_cast<const char*>(strings_ + index);
+}
+
+MetadataBlob MetadataReader::GetBlob(ULONG index) const {
+  return GetBlob(blobs_, blobs_size_, index);
+}
+
+MetadataBlob MetadataReader::GetBlob(LPCBYTE heap, ULONG heap_size,
+                                     ULONG index) const {
+  // Compressed length prefix (II.24.2.4)
+  if (index >= heap_size) {
+    return {};
+  }
+
+  LPCBYTE blob = heap + index;
+  const ULONG available = heap_size - index;
+  ULONG header_size;
+  ULONG size;
+  if ((blob[0] & 0x80) == 0) {
+    header_size = 1;
+    size = blob[0];
+  } else if ((blob[0] & 0xC0) == 0x80 && available >= 2) {
+    header_size = 2;
+    size = ((blob[0] & 0x3F) << 8) | blob[1];
+  } else if ((blob[0] & 0xE0) == 0xC0 && available >= 4) {
+    header_size = 4;
+    size = ((blob[0] & 0x1F) << 24) | (blob[1] << 16) | (blob[2] << 8) |
+           blob[3];
+  } else {
+    return {};
+  }
+
+  if (size > available - header_size) {
+    return {};
+  }
+  return {blob + header_size, size};
+}
+
+ULONG MetadataReader::GetRowCount(MetadataTable table) const {
+  return valid_ ? row_counts_[static_cast<ULONG>(table)] : 0;
+}
+
+bool MetadataReader::GetTypeRef(ULONG rid, TypeRefRow* row) const {
+  LPCBYTE data = GetRow(MetadataTable::TypeRef, rid);
+  if (data == nullptr) {
+    return false;
+  }
+  row->resolution_scope = DecodeCodedIndex(
+      kColResolutionScope, ReadColumn(MetadataTable::TypeRef, data, 0));
+  row->name = GetString(ReadColumn(MetadataTable::TypeRef, data, 1));
+  row->name_space = GetString(ReadColumn(MetadataTable::TypeRef, data, 2));
+  return true;
+}
+
+bool MetadataReader::GetTypeDef(ULONG rid, TypeDefRow* row) const {
+  LPCBYTE data = GetRow(MetadataTable::TypeDef, rid);
+  if (data == nullptr) {
+    return false;
+  }
+  row->flags = ReadColumn(MetadataTable::TypeDef, data, 0);
+  row->name = GetString(ReadColumn(MetadataTable::TypeDef, data, 1));
+  row->name_space = GetString(ReadColumn(MetadataTable::TypeDef, data, 2));
+  row->extends = DecodeCodedIndex(kColTypeDefOrRef,
+                                  ReadColumn(MetadataTable::TypeDef, data, 3));
+  row->field_list = ReadColumn(MetadataTable::TypeDef, data, 4);
+  row->method_list = ReadColumn(MetadataTable::TypeDef, data, 5);
+  return true;
+}
+
+bool MetadataReader::GetField(ULONG rid, FieldRow* row) const {
+  LPCBYTE data = GetRow(MetadataTable::Field, rid);
+  if (data == nullptr) {
+    return false;
+  }
+  row->flags = static_cast<USHORT>(ReadColumn(MetadataTable::Field, data, 0));
+  row->name = GetString(ReadColumn(MetadataTable::Field, data, 1));
+  row->signature = GetBlob(ReadColumn(MetadataTable::Field, data, 2));
+  return true;
+}
+
+bool MetadataReader::GetMethodDef(ULONG rid, MethodDefRow* row) const {
+  LPCBYTE data = GetRow(MetadataTable::MethodDef, rid);
+  if (data == nullptr) {
+    return false;
+  }
+  row->rva = ReadColumn(MetadataTable::MethodDef, data, 0);
+  row->impl_flags =
+      static_cast<USHORT>(ReadColumn(MetadataTable::MethodDef, data, 1));
+  row->flags = static_cast<USHORT>(ReadColumn(MetadataTable::MethodDef, data, 2));
+  row->name = GetString(ReadColumn(MetadataTable::MethodDef, data, 3));
+  row->signature = GetBlob(ReadColumn(MetadataTable::MethodDef, data, 4));
+  row->param_list = ReadColumn(MetadataTable::MethodDef, data, 5);
+  return true;
+}
+
+bool MetadataReader::GetMemberRef(ULONG rid, MemberRefRow* row) const {
+  LPCBYTE data = GetRow(MetadataTable::MemberRef, rid);
+  if (data == nullptr) {
+    return false;
+  }
+  row->parent = DecodeCodedIndex(kColMemberRefParent,
+                                 ReadColumn(MetadataTable::MemberRef, data, 0));
+  row->name = GetString(ReadColumn(MetadataTable::MemberRef, data, 1));
+  row->signature = GetBlob(ReadColumn(MetadataTable::MemberRef, data, 2));
+  return true;
+}
+
+bool MetadataReader::GetAssembly(AssemblyRow* row) const {
+  LPCBYTE data = GetRow(MetadataTable::Assembly, 1);
+  if (data == nullptr) {
+    return false;
+  }
+  row->hash_alg_id = ReadColumn(MetadataTable::Assembly, data, 0);
+  row->major = static_cast<USHORT>(ReadColumn(MetadataTable::Assembly, data, 1));
+  row->minor = static_cast<USHORT>(ReadColumn(MetadataTable::Assembly, data, 2));
+  row->build = static_cast<USHORT>(ReadColumn(MetadataTable::Assembly, data, 3));
+  row->revision =
+      static_cast<USHORT>(ReadColumn(MetadataTable::Assembly, data, 4));
+  row->flags = ReadColumn(MetadataTable::Assembly, data, 5);
+  row->public_key = GetBlob(ReadColumn(MetadataTable::Assembly, data, 6));
+  row->name = GetString(ReadColumn(MetadataTable::Assembly, data, 7));
+  row->culture = GetString(ReadColumn(MetadataTable::Assembly, data, 8));
+  return true;
+}
+
+bool MetadataReader::GetAssemblyRef(ULONG rid, AssemblyRefRow* row) const {
+  LPCBYTE data = GetRow(MetadataTable::AssemblyRef, rid);
+  if (data == nullptr) {
+    return false;
+  }
+  row->major =
+      static_cast<USHORT>(ReadColumn(MetadataTable::AssemblyRef, data, 0));
+  row->minor =
+      static_cast<USHORT>(ReadColumn(MetadataTable::AssemblyRef, data, 1));
+  row->build =
+      static_cast<USHORT>(ReadColumn(MetadataTable::AssemblyRef, data, 2));
+  row->revision =
+      static_cast<USHORT>(ReadColumn(MetadataTable::AssemblyRef, data, 3));
+  row->flags = ReadColumn(MetadataTable::AssemblyRef, data, 4);
+  row->public_key_or_token =
+      GetBlob(ReadColumn(MetadataTable::AssemblyRef, data, 5));
+  row->name = GetString(ReadColumn(MetadataTable::AssemblyRef, data, 6));
+  row->culture = GetString(ReadColumn(MetadataTable::AssemblyRef, data, 7));
+  row->hash_value = GetBlob(ReadColumn(MetadataTable::AssemblyRef, data, 8));
+  return true;
+}
+
+bool MetadataReader::GetNestedClass(ULONG rid, mdTypeDef* nested_class,
+                                    mdTypeDef* enclosing_class) const {
+  LPCBYTE data = GetRow(MetadataTable::NestedClass, rid);
+  if (data == nullptr) {
+    return false;
+  }
+  *nested_class = TokenFromRid(ReadColumn(MetadataTable::NestedClass, data, 0),
+                               mdtTypeDef);
+  *enclosing_class = TokenFromRid(
+      ReadColumn(MetadataTable::NestedClass, data, 1), mdtTypeDef);
+  return true;
+}
+
+bool MetadataReader::GetModuleRef(ULONG rid, const char** name) const {
+  LPCBYTE data = GetRow(MetadataTable::ModuleRef, rid);
+  if (data == nullptr) {
+    return false;
+  }
+  *name = GetString(ReadColumn(MetadataTable::ModuleRef, data, 0));
+  return true;
+}
+
+bool MetadataReader::GetTypeSpec(ULONG rid, MetadataBlob* signature) const {
+  LPCBYTE data = GetRow(MetadataTable::TypeSpec, rid);
+  if (data == nullptr) {
+    return false;
+  }
+  *signature = GetBlob(ReadColumn(MetadataTable::TypeSpec, data, 0));
+  return true;
+}
+
+bool MetadataReader::GetStandAloneSig(ULONG rid,
+                                      MetadataBlob* signature) const {
+  LPCBYTE data = GetRow(MetadataTable::StandAloneSig, rid);
+  if (data == nullptr) {
+    return false;
+  }
+  *signature = GetBlob(ReadColumn(MetadataTable::StandAloneSig, data, 0));
+  return true;
+}
+
+bool MetadataReader::GetMethodSpec(ULONG rid, MethodSpecRow* row) const {
+  LPCBYTE data = GetRow(MetadataTable::MethodSpec, rid);
+  if (data == nullptr) {
+    return false;
+  }
+  row->method = DecodeCodedIndex(kColMethodDefOrRef,
+                                 ReadColumn(MetadataTable::MethodSpec, data, 0));
+  row->instantiation = GetBlob(ReadColumn(MetadataTable::MethodSpec, data, 1));
+  return true;
+}
+
+bool MetadataReader::GetCustomAttribute(ULONG rid,
+                                        CustomAttributeRow* row) const {
+  LPCBYTE data = GetRow(MetadataTable::CustomAttribute, rid);
+  if (data == nullptr) {
+    return false;
+  }
+  row->parent = DecodeCodedIndex(
+      kColHasCustomAttribute,
+      ReadColumn(MetadataTable::CustomAttribute, data, 0));
+  row->type = DecodeCodedIndex(
+      kColCustomAttributeType,
+      ReadColumn(MetadataTable::CustomAttribute, data, 1));
+  row->value = GetBlob(ReadColumn(MetadataTable::CustomAttribute, data, 2));
+  return true;
+}
+
+const char* MetadataReader::GetModuleName() const {
+  LPCBYTE data = GetRow(MetadataTable::Module, 1);
+  if (data == nullptr) {
+    return "";
+  }
+  return GetString(ReadColumn(MetadataTable::Module, data, 1));
+}
+
+bool MetadataReader::GetUserString(ULONG index, MetadataBlob* value) const {
+  if (!valid_) {
+    return false;
+  }
+  *value = GetBlob(user_strings_, user_strings_size_, index);
+  if (value->data == nullptr) {
+    return false;
+  }
+  // An odd size means the final flag byte is present (II.24.2.4)
+  value->size &= ~1UL;
+  return true;
+}
+
+LPCBYTE MetadataReader::GetRvaAddress(ULONG rva) const {
+  if (base_ == nullptr || rva == 0) {
+    return nullptr;
+  }
+  if (!flat_layout_) {
+    return base_ + rva;
+  }
+
+  for (USHORT i = 0; i < section_count_; i++) {
+    LPCBYTE section = section_headers_ + i * 40;
+    const ULONG virtual_size = ReadU32(section + 8);
+    const ULONG virtual_address = ReadU32(section + 12);
+    const ULONG raw_data_size = ReadU32(section + 16);
+    const ULONG raw_data_pointer = ReadU32(section + 20);
+    if (rva >= virtual_address &&
+        rva < virtual_address + std::max(virtual_size, raw_data_size)) {
+      return base_ + raw_data_pointer + (rva - virtual_address);
+    }
+  }
+  return nullptr;
+}
+
+bool MetadataReader::GetModuleVersionId(GUID* module_version_id) const {
+  LPCBYTE data = GetRow(MetadataTable::Module, 1);
+  if (data == nullptr) {
+    return false;
+  }
+
+  // #GUID heap indexes are 1 based (II.24.2.5)
+  const ULONG index = ReadColumn(MetadataTable::Module, data, 2);
+  if (index == 0 || index * sizeof(GUID) > guids_size_) {
+    return false;
+  }
+  memcpy(module_version_id, guids_ + (index - 1) * sizeof(GUID), sizeof(GUID));
+  return true;
+}
+
+mdTypeDef MetadataReader::FindTypeDefByName(
+    const std::string& full_name) const {
+  const auto separator = full_name.rfind('.');
+  const std::string name_space =
+      separator == std::string::npos ? "" : full_name.substr(0, separator);
+  const std::string name = separator == std::string::npos
+                               ? full_name
+                               : full_name.substr(separator + 1);
+
+  const ULONG count = GetRowCount(MetadataTable::TypeDef);
+  TypeDefRow row;
+  for (ULONG rid = 1; rid <= count; rid++) {
+    if (GetTypeDef(rid, &row) && !IsTdNested(row.flags) &&
+        name == row.name && name_space == row.name_space) {
+      return TokenFromRid(rid, mdtTypeDef);
+    }
+  }
+  return mdTypeDefNil;
+}
+
+std::vector<mdMethodDef> MetadataReader::FindMethodsByName(
+    mdTypeDef type_def, const std::string& name) const {
+  std::vector<mdMethodDef> methods;
+
+  // The methods of a type are the run from its MethodList up to the MethodList
+  // of the next type (or the end of the table).
+  const ULONG rid = RidFromToken(type_def);
+  TypeDefRow type_row;
+  if (!GetTypeDef(rid, &type_row)) {
+    return methods;
+  }
+
+  ULONG end = GetRowCount(MetadataTable::MethodDef) + 1;
+  TypeDefRow next_type_row;
+  if (GetTypeDef(rid + 1, &next_type_row)) {
+    end = std::min(end, next_type_row.method_list);
+  }
+
+  MethodDefRow method_row;
+  for (ULONG method_rid = type_row.method_list; method_rid < end;
+       method_rid++) {
+    if (GetMethodDef(method_rid, &method_row) && name == method_row.name) {
+      methods.push_back(TokenFromRid(method_rid, mdtMethodDef));
+    }
+  }
+  return methods;
+}
+
+mdAssemblyRef MetadataReader::FindAssemblyRef(const std::string& name) const {
+  const ULONG count = GetRowCount(MetadataTable::AssemblyRef);
+  AssemblyRefRow row;
+  for (ULONG rid = 1; rid <= count; rid++) {
+    if (GetAssemblyRef(rid, &row) && name == row.name) {
+      return TokenFromRid(rid, mdtAssemblyRef);
+    }
+  }
+  return mdAssemblyRefNil;
+}
+
+}  // namespace trace
@@ -0,0 +1,235 @@
+#ifndef DD_CLR_PROFILER_METADATA_READER_H_
+#define DD_CLR_PROFILER_METADATA_READER_H_
+
+#include <corhlpr.h>
+#include <corprof.h>
+
+#include <string>
+#include <vector>
+
+namespace trace {
+
+/// <summary>
+/// ECMA-335 (II.22) metadata tables.
+/// </summary>
+enum class MetadataTable : BYTE {
+  Module = 0x00,
+  TypeRef = 0x01,
+  TypeDef = 0x02,
+  FieldPtr = 0x03,
+  Field = 0x04,
+  MethodPtr = 0x05,
+  MethodDef = 0x06,
+  ParamPtr = 0x07,
+  Param = 0x08,
+  InterfaceImpl = 0x09,
+  MemberRef = 0x0A,
+  Constant = 0x0B,
+  CustomAttribute = 0x0C,
+  FieldMarshal = 0x0D,
+  DeclSecurity = 0x0E,
+  ClassLayout = 0x0F,
+  FieldLayout = 0x10,
+  StandAloneSig = 0x11,
+  EventMap = 0x12,
+  EventPtr = 0x13,
+  Event = 0x14,
+  PropertyMap = 0x15,
+  PropertyPtr = 0x16,
+  Property = 0x17,
+  MethodSemantics = 0x18,
+  MethodImpl = 0x19,
+  ModuleRef = 0x1A,
+  TypeSpec = 0x1B,
+  ImplMap = 0x1C,
+  FieldRVA = 0x1D,
+  ENCLog = 0x1E,
+  ENCMap = 0x1F,
+  Assembly = 0x20,
+  AssemblyProcessor = 0x21,
+  AssemblyOS = 0x22,
+  AssemblyRef = 0x23,
+  AssemblyRefProcessor = 0x24,
+  AssemblyRefOS = 0x25,
+  File = 0x26,
+  ExportedType = 0x27,
+  ManifestResource = 0x28,
+  NestedClass = 0x29,
+  GenericParam = 0x2A,
+  MethodSpec = 0x2B,
+  GenericParamConstraint = 0x2C,
+  Count = 0x2D
+};
+
+struct MetadataBlob {
+  PCCOR_SIGNATURE data;
+  ULONG size;
+};
+
+struct TypeRefRow {
+  mdToken resolution_scope = mdTokenNil;
+  const char* name = "";
+  const char* name_space = "";
+};
+
+struct TypeDefRow {
+  DWORD flags = 0;
+  const char* name = "";
+  const char* name_space = "";
+  mdToken extends = mdTokenNil;
+  ULONG field_list = 0;
+  ULONG method_list = 0;
+};
+
+struct FieldRow {
+  USHORT flags = 0;
+  const char* name = "";
+  MetadataBlob signature{};
+};
+
+struct MethodDefRow {
+  ULONG rva = 0;
+  USHORT impl_flags = 0;
+  USHORT flags = 0;
+  const char* name = "";
+  MetadataBlob signature{};
+  ULONG param_list = 0;
+};
+
+struct MemberRefRow {
+  mdToken parent = mdTokenNil;
+  const char* name = "";
+  MetadataBlob signature{};
+};
+
+struct AssemblyRow {
+  ULONG hash_alg_id = 0;
+  USHORT major = 0;
+  USHORT minor = 0;
+  USHORT build = 0;
+  USHORT revision = 0;
+  DWORD flags = 0;
+  MetadataBlob public_key{};
+  const char* name = "";
+  const char* culture = "";
+};
+
+struct AssemblyRefRow {
+  USHORT major = 0;
+  USHORT minor = 0;
+  USHORT build = 0;
+  USHORT revision = 0;
+  DWORD flags = 0;
+  MetadataBlob public_key_or_token{};
+  const char* name = "";
+  const char* culture = "";
+  MetadataBlob hash_value{};
+};
+
+struct MethodSpecRow {
+  mdToken method = mdTokenNil;
+  MetadataBlob instantiation{};
+};
+
+struct CustomAttributeRow {
+  mdToken parent = mdTokenNil;
+  // MethodDef or MemberRef of the attribute constructor
+  mdToken type = mdTokenNil;
+  MetadataBlob value{};
+};
+
+/// <summary>
+/// Read only view over the metadata tables and heaps of a loaded module image.
+/// Nothing is copied: rows are decoded on demand and the strings and blobs
+/// point into the image, so they are valid as long as the module is loaded.
+/// The view reflects the metadata as it was compiled: rows defined through
+/// IMetaDataEmit afterwards are not visible, use COM for those (and for any
+/// emit). Modules without a usable image (dynamic modules, uncompressed "#-"
+/// streams) give an invalid reader and callers fall back to COM.
+/// </summary>
+class MetadataReader {
+ private:
+  static const ULONG kTableCount = static_cast<ULONG>(MetadataTable::Count);
+  static const ULONG kMaxColumns = 9;
+
+  bool valid_ = false;
+
+  LPCBYTE base_ = nullptr;
+  bool flat_layout_ = false;
+  LPCBYTE section_headers_ = nullptr;
+  USHORT section_count_ = 0;
+
+  LPCBYTE strings_ = nullptr;
+  ULONG strings_size_ = 0;
+  LPCBYTE blobs_ = nullptr;
+  ULONG blobs_size_ = 0;
+  LPCBYTE guids_ = nullptr;
+  ULONG guids_size_ = 0;
+  LPCBYTE user_strings_ = nullptr;
+  ULONG user_strings_size_ = 0;
+
+  LPCBYTE tables_[kTableCount]{};
+  ULONG row_counts_[kTableCount]{};
+  ULONG row_sizes_[kTableCount]{};
+  BYTE column_offsets_[kTableCount][kMaxColumns]{};
+  BYTE column_sizes_[kTableCount][kMaxColumns]{};
+
+  bool Initialize(LPCBYTE base_load_address, DWORD module_flags);
+  bool InitializeTables(LPCBYTE tables_stream, ULONG tables_stream_size);
+
+  LPCBYTE GetRow(MetadataTable table, ULONG rid) const;
+  ULONG ReadColumn(MetadataTable table, LPCBYTE row, ULONG column) const;
+
+  const char* GetString(ULONG index) const;
+  MetadataBlob GetBlob(ULONG index) const;
+  MetadataBlob GetBlob(LPCBYTE heap, ULONG heap_size, ULONG index) const;
+
+ public:
+  MetadataReader() = default;
+  MetadataReader(LPCBYTE base_load_address, DWORD module_flags);
+
+  bool IsValid() const { return valid_; }
+
+  ULONG GetRowCount(MetadataTable table) const;
+
+  bool GetTypeRef(ULONG rid, TypeRefRow* row) const;
+  bool GetTypeDef(ULONG rid, TypeDefRow* row) const;
+  bool GetField(ULONG rid, FieldRow* row) const;
+  bool GetMethodDef(ULONG rid, MethodDefRow* row) const;
+  bool GetMemberRef(ULONG rid, MemberRefRow* row) const;
+  bool GetAssembly(AssemblyRow* row) const;
+  bool GetAssemblyRef(ULONG rid, AssemblyRefRow* row) const;
+  bool GetNestedClass(ULONG rid, mdTypeDef* nested_class,
+                      mdTypeDef* enclosing_class) const;
+  bool GetModuleRef(ULONG rid, const char** name) const;
+  bool GetTypeSpec(ULONG rid, MetadataBlob* signature) const;
+  bool GetStandAloneSig(ULONG rid, MetadataBlob* signature) const;
+  bool GetMethodSpec(ULONG rid, MethodSpecRow* row) const;
+  bool GetCustomAttribute(ULONG rid, CustomAttributeRow* row) const;
+
+  // The name of the Module row, as IMetaDataImport::GetScopeProps gives it.
+  const char* GetModuleName() const;
+
+  // The UTF-16 characters of a #US heap entry (the token rid is the offset),
+  // without the trailing flag byte.
+  bool GetUserString(ULONG index, MetadataBlob* value) const;
+
+  // The address of an RVA in the image, e.g. of a method body, or nullptr.
+  LPCBYTE GetRvaAddress(ULONG rva) const;
+
+  // The Mvid of the Module row, as IMetaDataImport::GetScopeProps gives it.
+  bool GetModuleVersionId(GUID* module_version_id) const;
+
+  // Finds a top level (not nested) type by its full name ("Namespace.Name").
+  mdTypeDef FindTypeDefByName(const std::string& full_name) const;
+
+  // Enumerates the methods of a type with the given name (all the overloads).
+  std::vector<mdMethodDef> FindMethodsByName(mdTypeDef type_def,
+                                             const std::string& name) const;
+
+  mdAssemblyRef FindAssemblyRef(const std::string& name) const;
+};
+
+}  // namespace trace
+
+#endif  // DD_CLR_PROFILER_METADATA_READER_H_
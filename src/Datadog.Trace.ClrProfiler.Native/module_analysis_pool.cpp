@@ -0,0 +1,107 @@
+#include "module_analysis_pool.h"
+
+#include "logging.h"
+
+namespace trace {
+
+ModuleAnalysisState ModuleAnalysis::GetState() {
+  std::lock_guard<std::mutex> guard(lock_);
+  return state_;
+}
+
+void ModuleAnalysis::SetPending() {
+  std::lock_guard<std::mutex> guard(lock_);
+  state_ = ModuleAnalysisState::Pending;
+}
+
+bool ModuleAnalysis::TryBegin() {
+  std::lock_guard<std::mutex> guard(lock_);
+  if (state_ != ModuleAnalysisState::Pending) {
+    return false;
+  }
+  state_ = ModuleAnalysisState::Running;
+  return true;
+}
+
+void ModuleAnalysis::End() {
+  // notified under the lock: a Cancel woken by it may free this object
+  std::lock_guard<std::mutex> guard(lock_);
+  state_ = ModuleAnalysisState::Ready;
+  changed_.notify_all();
+}
+
+void ModuleAnalysis::Wait(std::unique_lock<std::mutex>& outer) {
+  {
+    // registered before the outer lock is released, so a Cancel under the
+    // outer lock can't miss this thread
+    std::unique_lock<std::mutex> guard(lock_);
+    waiters_++;
+    outer.unlock();
+    changed_.wait(guard,
+                  [this] { return state_ != ModuleAnalysisState::Running; });
+    waiters_--;
+    changed_.notify_all();
+  }
+  outer.lock();
+}
+
+void ModuleAnalysis::Cancel() {
+  std::unique_lock<std::mutex> guard(lock_);
+  if (state_ == ModuleAnalysisState::Pending) {
+    state_ = ModuleAnalysisState::Ready;
+  }
+  changed_.wait(guard, [this] {
+    return state_ != ModuleAnalysisState::Running && waiters_ == 0;
+  });
+}
+
+ModuleAnalysisPool::ModuleAnalysisPool(
+    ICorProfilerInfo4* pInfo, ULONG threadCount,
+    std::function<void(ModuleID)> analyzeCallback) {
+  this->profilerInfo = pInfo;
+  this->analyzeCallback = analyzeCallback;
+  this->queue_ = new BlockingQueue<ModuleID>();
+  for (ULONG i = 0; i < threadCount; i++) {
+    threads_.push_back(new std::thread(worker_thread, this));
+  }
+}
+
+ModuleAnalysisPool::~ModuleAnalysisPool() {
+  Shutdown();
+  delete queue_;
+}
+
+void ModuleAnalysisPool::Shutdown() {
+  stopping_.store(true);
+  // a null module id stops one worker
+  for (size_t i = 0; i < threads_.size(); i++) {
+    queue_->push(0);
+  }
+  for (auto thread : threads_) {
+    if (thread->joinable()) {
+      thread->join();
+    }
+    delete thread;
+  }
+  threads_.clear();
+}
+
+void ModuleAnalysisPool::worker_thread(ModuleAnalysisPool* pool) {
+  Debug("Initializing module analysis thread.");
+  HRESULT hr = pool->profilerInfo->InitializeCurrentThread();
+  if (FAILED(hr)) {
+    Warn("Call to InitializeCurrentThread fail.");
+  }
+
+  while (true) {
+    const ModuleID moduleId = pool->queue_->pop();
+    if (moduleId == 0 || pool->stopping_) {
+      break;
+    }
+
+    pool->analyzeCallback(moduleId);
+  }
+  Debug("Exiting module analysis thread.");
+}
+
+}  // namespace trace
@@ -0,0 +1,85 @@
+#ifndef DD_CLR_PROFILER_MODULE_ANALYSIS_POOL_H_
+#define DD_CLR_PROFILER_MODULE_ANALYSIS_POOL_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "cor.h"
+#include "corprof.h"
+#include "util.h"
+
+namespace trace {
+
+// Progress of the CallTarget analysis of a module
+enum class ModuleAnalysisState { Ready, Pending, Running };
+
+/// <summary>
+/// Analysis state of a module, claimed once by a pool worker or by the first
+/// callback that needs the module before a worker got to it
+/// </summary>
+class ModuleAnalysis {
+ private:
+  std::mutex lock_;
+  std::condition_variable changed_;
+  ModuleAnalysisState state_ = ModuleAnalysisState::Ready;
+  // Threads blocked in Wait, the module can't be freed until they are gone
+  int waiters_ = 0;
+
+ public:
+  ModuleAnalysisState GetState();
+  bool IsReady() { return GetState() == ModuleAnalysisState::Ready; }
+
+  // Marks the module as waiting for a background analysis
+  void SetPending();
+
+  // Claims a pending analysis, the caller must call End when done
+  bool TryBegin();
+
+  void End();
+
+  // Waits for the analysis running on another thread, if any. The caller's
+  // lock (the module map lock) is released while waiting and taken back
+  // once this object is no longer used: the module may be gone by then.
+  void Wait(std::unique_lock<std::mutex>& outer);
+
+  // Drops a pending analysis, then waits for a running one and for the
+  // threads waiting on it, so the module can be freed afterwards
+  void Cancel();
+};
+
+/// <summary>
+/// Small pool of native threads that analyze the loaded modules for CallTarget
+/// off the thread that loaded them. Each module is analyzed once: by a worker,
+/// or by the first callback that needs the module before a worker got to it
+/// (see ModuleAnalysis::TryBegin).
+/// </summary>
+class ModuleAnalysisPool {
+ private:
+  ICorProfilerInfo4* profilerInfo;
+  std::function<void(ModuleID)> analyzeCallback;
+  BlockingQueue<ModuleID>* queue_;
+  std::vector<std::thread*> threads_;
+  std::atomic_bool stopping_{false};
+
+  static void worker_thread(ModuleAnalysisPool* pool);
+
+ public:
+  ModuleAnalysisPool(ICorProfilerInfo4* pInfo, ULONG threadCount,
+                     std::function<void(ModuleID)> analyzeCallback);
+  // Stops the workers if they are still running and frees the queue
+  ~ModuleAnalysisPool();
+
+  void Enqueue(ModuleID moduleId) { queue_->push(moduleId); }
+
+  // Stops and frees the workers, the modules still queued are not analyzed.
+  // Can be called more than once.
+  void Shutdown();
+};
+
+}  // namespace trace
+
+#endif  // DD_CLR_PROFILER_MODULE_ANALYSIS_POOL_H_
@@ -0,0 +1,239 @@
+#include "module_metadata.h"
+
+#include <algorithm>
+#include <functional>
+
+namespace trace {
+
+ModuleMetadata::~ModuleMetadata() {
+  delete calltargetTokens;
+  TrackDeallocation(MemoryCounter::ModuleMetadata, sizeof(ModuleMetadata));
+}
+
+void ModuleMetadata::BuildAssemblyRefIndex() {
+  if (metadata_reader.IsValid()) {
+    const auto count = metadata_reader.GetRowCount(MetadataTable::AssemblyRef);
+    AssemblyRefRow row;
+    for (ULONG rid = 1; rid <= count; rid++) {
+      if (metadata_reader.GetAssemblyRef(rid, &row)) {
+        // the first reference wins, like the linear search did
+        assembly_ref_index.emplace(ToWSTRING(row.name),
+                                   TokenFromRid(rid, mdtAssemblyRef));
+      }
+    }
+  } else {
+    for (mdAssemblyRef assembly_ref : EnumAssemblyRefs(assembly_import)) {
+      assembly_ref_index.emplace(
+          GetReferencedAssemblyMetadata(assembly_import, assembly_ref).name,
+          assembly_ref);
+    }
+  }
+  assembly_ref_index_built = true;
+}
+
+void ModuleMetadata::BuildTypeDefIndex() {
+  std::unordered_map<mdTypeDef, WSTRING> names;
+  std::unordered_map<mdTypeDef, mdTypeDef> enclosing_types;
+
+  if (metadata_reader.IsValid()) {
+    const auto type_count = metadata_reader.GetRowCount(MetadataTable::TypeDef);
+    TypeDefRow row;
+    for (ULONG rid = 1; rid <= type_count; rid++) {
+      if (metadata_reader.GetTypeDef(rid, &row)) {
+        names[TokenFromRid(rid, mdtTypeDef)] =
+            row.name_space[0] == '\0'
+                ? ToWSTRING(row.name)
+                : ToWSTRING(row.name_space) + "."_W + ToWSTRING(row.name);
+      }
+    }
+
+    const auto nested_count =
+        metadata_reader.GetRowCount(MetadataTable::NestedClass);
+    mdTypeDef nested_class;
+    mdTypeDef enclosing_class;
+    for (ULONG rid = 1; rid <= nested_count; rid++) {
+      if (metadata_reader.GetNestedClass(rid, &nested_class,
+                                         &enclosing_class)) {
+        enclosing_types[nested_class] = enclosing_class;
+      }
+    }
+  } else {
+    WCHAR type_name[kNameMaxSize]{};
+    for (mdTypeDef type_def : EnumTypeDefs(metadata_import)) {
+      DWORD type_name_len = 0;
+      DWORD type_flags = 0;
+      mdToken type_extends = mdTokenNil;
+      if (FAILED(metadata_import->GetTypeDefProps(
+              type_def, type_name, kNameMaxSize, &type_name_len, &type_flags,
+              &type_extends)) ||
+          type_name_len == 0) {
+        continue;
+      }
+      names[type_def] = WSTRING(type_name);
+
+      mdTypeDef enclosing_class = mdTypeDefNil;
+      if (IsTdNested(type_flags) &&
+          SUCCEEDED(metadata_import->GetNestedClassProps(type_def,
+                                                         &enclosing_class))) {
+        enclosing_types[type_def] = enclosing_class;
+      }
+    }
+  }
+
+  // Prefix the nested types with their enclosing types
+  std::function<WSTRING(mdTypeDef, int)> full_name =
+      [&](mdTypeDef type_def, int depth) -> WSTRING {
+    const auto enclosing = enclosing_types.find(type_def);
+    if (enclosing == enclosing_types.end() || depth > 64) {
+      return names[type_def];
+    }
+    return full_name(enclosing->second, depth + 1) + "+"_W + names[type_def];
+  };
+
+  for (const auto& name : names) {
+    type_def_index.emplace(full_name(name.first, 0), name.first);
+  }
+  type_def_index_built = true;
+}
+
+void ModuleMetadata::BuildTypeTokenIndex() {
+  if (metadata_reader.IsValid()) {
+    indexed_type_defs = metadata_reader.GetRowCount(MetadataTable::TypeDef);
+    TypeDefRow type_def;
+    for (ULONG rid = 1; rid <= indexed_type_defs; rid++) {
+      if (metadata_reader.GetTypeDef(rid, &type_def)) {
+        type_token_index.emplace(
+            type_def.name_space[0] == '\0'
+                ? ToWSTRING(type_def.name)
+                : ToWSTRING(type_def.name_space) + "."_W +
+                      ToWSTRING(type_def.name),
+            TokenFromRid(rid, mdtTypeDef));
+      }
+    }
+
+    indexed_type_refs = metadata_reader.GetRowCount(MetadataTable::TypeRef);
+    TypeRefRow type_ref;
+    for (ULONG rid = 1; rid <= indexed_type_refs; rid++) {
+      if (metadata_reader.GetTypeRef(rid, &type_ref)) {
+        type_token_index.emplace(
+            type_ref.name_space[0] == '\0'
+                ? ToWSTRING(type_ref.name)
+                : ToWSTRING(type_ref.name_space) + "."_W +
+                      ToWSTRING(type_ref.name),
+            TokenFromRid(rid, mdtTypeRef));
+      }
+    }
+  } else {
+    WCHAR type_name[kNameMaxSize]{};
+    for (mdTypeDef type_def : EnumTypeDefs(metadata_import)) {
+      DWORD type_name_len = 0;
+      DWORD type_flags = 0;
+      mdToken type_extends = mdTokenNil;
+      if (SUCCEEDED(metadata_import->GetTypeDefProps(
+              type_def, type_name, kNameMaxSize, &type_name_len, &type_flags,
+              &type_extends)) &&
+          type_name_len > 0) {
+        type_token_index.emplace(WSTRING(type_name), type_def);
+      }
+      indexed_type_defs = std::max(indexed_type_defs, RidFromToken(type_def));
+    }
+
+    for (mdTypeRef type_ref : EnumTypeRefs(metadata_import)) {
+      DWORD type_name_len = 0;
+      mdToken parent_token = mdTokenNil;
+      if (SUCCEEDED(metadata_import->GetTypeRefProps(
+              type_ref, &parent_token, type_name, kNameMaxSize,
+              &type_name_len)) &&
+          type_name_len > 0) {
+        type_token_index.emplace(WSTRING(type_name), type_ref);
+      }
+      indexed_type_refs = std::max(indexed_type_refs, RidFromToken(type_ref));
+    }
+  }
+  type_token_index_built = true;
+}
+
+mdAssemblyRef ModuleMetadata::FindAssemblyRef(const WSTRING& assembly_name) {
+  {
+    std::lock_guard<std::mutex> guard(name_index_lock);
+    if (!assembly_ref_index_built) {
+      BuildAssemblyRefIndex();
+    }
+
+    const auto search = assembly_ref_index.find(assembly_name);
+    if (search != assembly_ref_index.end()) {
+      return search->second;
+    }
+  }
+
+  const auto assembly_ref = trace::FindAssemblyRef(assembly_import, assembly_name);
+  if (assembly_ref != mdAssemblyRefNil) {
+    SetAssemblyRef(assembly_name, assembly_ref);
+  }
+  return assembly_ref;
+}
+
+void ModuleMetadata::SetAssemblyRef(const WSTRING& assembly_name,
+                                    mdAssemblyRef assembly_ref) {
+  std::lock_guard<std::mutex> guard(name_index_lock);
+  assembly_ref_index.emplace(assembly_name, assembly_ref);
+}
+
+mdTypeDef ModuleMetadata::FindTypeDef(const WSTRING& type_name) {
+  std::lock_guard<std::mutex> guard(name_index_lock);
+  if (!type_def_index_built) {
+    BuildTypeDefIndex();
+  }
+
+  const auto search = type_def_index.find(type_name);
+  return search != type_def_index.end() ? search->second : mdTypeDefNil;
+}
+
+std::vector<mdToken> ModuleMetadata::FindTypeTokens(const WSTRING& type_name) {
+  std::lock_guard<std::mutex> guard(name_index_lock);
+  if (!type_token_index_built) {
+    BuildTypeTokenIndex();
+  }
+
+  std::vector<mdToken> tokens;
+  const auto range = type_token_index.equal_range(type_name);
+  for (auto it = range.first; it != range.second; ++it) {
+    tokens.push_back(it->second);
+  }
+  return tokens;
+}
+
+bool ModuleMetadata::IsTypeTokenIndexed(mdToken token) {
+  std::lock_guard<std::mutex> guard(name_index_lock);
+  if (!type_token_index_built) {
+    BuildTypeTokenIndex();
+  }
+
+  switch (TypeFromToken(token)) {
+    case mdtTypeDef:
+      return RidFromToken(token) <= indexed_type_defs;
+    case mdtTypeRef:
+      return RidFromToken(token) <= indexed_type_refs;
+    default:
+      return false;
+  }
+}
+
+const SignatureMatcher& ModuleMetadata::GetSignatureMatcher(
+    const MethodReference& method, SignatureNaming naming) {
+  const auto index =
+      method.signature_types_id * static_cast<ULONG>(SignatureNaming::Count) +
+      static_cast<ULONG>(naming);
+
+  std::lock_guard<std::mutex> guard(signature_matchers_lock);
+  if (index >= signature_matchers.size()) {
+    signature_matchers.resize(index + 1);
+  }
+  if (signature_matchers[index] == nullptr) {
+    signature_matchers[index].reset(
+        new SignatureMatcher(this, method.signature_types, naming));
+  }
+  return *signature_matchers[index];
+}
+
+}  // namespace trace
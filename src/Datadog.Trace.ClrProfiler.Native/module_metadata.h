@@ -2,24 +2,53 @@
 #define DD_CLR_PROFILER_MODULE_METADATA_H_
 
 #include <corhlpr.h>
+#include <memory>
+#include <mutex>
 #include <unordered_map>
 #include <unordered_set>
 
 #include "calltarget_tokens.h"
 #include "clr_helpers.h"
 #include "com_ptr.h"
+#include "instrumentation_plan.h"
 #include "integration.h"
+#include "memory_counters.h"
+#include "metadata_cache.h"
+#include "metadata_reader.h"
+#include "module_analysis_pool.h"
+#include "signature_matcher.h"
 #include "string.h"
 
 namespace trace {
 
 class ModuleMetadata {
  private:
-  std::unordered_map<WSTRING, mdMemberRef> wrapper_refs{};
-  std::unordered_map<WSTRING, mdTypeRef> wrapper_parent_type{};
-  std::unordered_set<WSTRING> failed_wrapper_keys{};
+  // Indexed by MethodReference::method_cache_id / type_cache_id
+  std::vector<mdMemberRef> wrapper_refs{};
+  std::vector<mdTypeRef> wrapper_parent_type{};
+  std::vector<bool> failed_wrapper_keys{};
   CallTargetTokens* calltargetTokens = nullptr;
 
+  // Name indexes, built on first use
+  std::mutex name_index_lock;
+  bool assembly_ref_index_built = false;
+  std::unordered_map<WSTRING, mdAssemblyRef> assembly_ref_index{};
+  bool type_def_index_built = false;
+  std::unordered_map<WSTRING, mdTypeDef> type_def_index{};
+  // TypeDefs and TypeRefs by the name GetTypeInfo gives them
+  bool type_token_index_built = false;
+  std::unordered_multimap<WSTRING, mdToken> type_token_index{};
+  ULONG indexed_type_defs = 0;
+  ULONG indexed_type_refs = 0;
+
+  // Indexed by MethodReference::signature_types_id and SignatureNaming
+  std::mutex signature_matchers_lock;
+  std::vector<std::unique_ptr<const SignatureMatcher>> signature_matchers{};
+
+  void BuildAssemblyRefIndex();
+  void BuildTypeDefIndex();
+  void BuildTypeTokenIndex();
+
  public:
   const ComPtr<IMetaDataImport2> metadata_import{};
   const ComPtr<IMetaDataEmit2> metadata_emit{};
@@ -30,7 +59,15 @@ class ModuleMetadata {
   GUID module_version_id;
   std::vector<IntegrationMethod> integrations = {};
   AssemblyProperty* corAssemblyProperty{};
-
+  const MetadataReader metadata_reader;
+  MetadataCache metadata_cache;
+  // Plan loaded from the instrumentation plan cache, replayed by the CallTarget
+  // analysis instead of searching the module
+  std::unique_ptr<InstrumentationPlan> instrumentation_plan{};
+  // Hash of the integrations that may apply to the module, the plan cache key
+  unsigned long long candidate_integrations_hash = 0;
+  // CallTarget analysis of the module when it runs in the background
+  ModuleAnalysis analysis;
 
   ModuleMetadata(ComPtr<IMetaDataImport2> metadata_import,
                  ComPtr<IMetaDataEmit2> metadata_emit,
@@ -40,7 +77,8 @@ class ModuleMetadata {
                  AppDomainID app_domain_id,
                  GUID module_version_id,
                  std::vector<IntegrationMethod> integrations, 
-                 AssemblyProperty* corAssemblyProperty)
+                 AssemblyProperty* corAssemblyProperty,
+                 MetadataReader metadata_reader = MetadataReader())
       : metadata_import(metadata_import),
         metadata_emit(metadata_emit),
         assembly_import(assembly_import),
@@ -49,68 +87,103 @@ class ModuleMetadata {
         app_domain_id(app_domain_id),
         module_version_id(module_version_id),
         integrations(integrations),
-        corAssemblyProperty(corAssemblyProperty) {}
+        corAssemblyProperty(corAssemblyProperty),
+        metadata_reader(metadata_reader),
+        metadata_cache(metadata_import) {
+    TrackAllocation(MemoryCounter::ModuleMetadata, sizeof(ModuleMetadata));
+  }
 
-  bool TryGetWrapperMemberRef(const WSTRING& keyIn,
-                              mdMemberRef& valueOut) const {
-    const auto search = wrapper_refs.find(keyIn);
+  // Frees everything owned by the module (the CallTarget tokens included)
+  ~ModuleMetadata();
 
-    if (search != wrapper_refs.end()) {
-      valueOut = search->second;
+  bool TryGetWrapperMemberRef(const ULONG method_cache_id,
+                              mdMemberRef& valueOut) const {
+    if (method_cache_id < wrapper_refs.size() &&
+        wrapper_refs[method_cache_id] != mdMemberRefNil) {
+      valueOut = wrapper_refs[method_cache_id];
       return true;
     }
 
     return false;
   }
 
-  bool TryGetWrapperParentTypeRef(const WSTRING& keyIn,
+  bool TryGetWrapperParentTypeRef(const ULONG type_cache_id,
                                   mdTypeRef& valueOut) const {
-    const auto search = wrapper_parent_type.find(keyIn);
-
-    if (search != wrapper_parent_type.end()) {
-      valueOut = search->second;
+    if (type_cache_id < wrapper_parent_type.size() &&
+        wrapper_parent_type[type_cache_id] != mdTypeRefNil) {
+      valueOut = wrapper_parent_type[type_cache_id];
       return true;
     }
 
     return false;
   }
 
-  bool IsFailedWrapperMemberKey(const WSTRING& key) const {
-    const auto search = failed_wrapper_keys.find(key);
-
-    if (search != failed_wrapper_keys.end()) {
-      return true;
-    }
-
-    return false;
+  bool IsFailedWrapperMemberKey(const ULONG method_cache_id) const {
+    return method_cache_id < failed_wrapper_keys.size() &&
+           failed_wrapper_keys[method_cache_id];
   }
 
-  void SetWrapperMemberRef(const WSTRING& keyIn, const mdMemberRef valueIn) {
-    wrapper_refs[keyIn] = valueIn;
+  void SetWrapperMemberRef(const ULONG method_cache_id,
+                           const mdMemberRef valueIn) {
+    if (method_cache_id >= wrapper_refs.size()) {
+      wrapper_refs.resize(method_cache_id + 1, mdMemberRefNil);
+    }
+    wrapper_refs[method_cache_id] = valueIn;
   }
 
-  void SetWrapperParentTypeRef(const WSTRING& keyIn, const mdTypeRef valueIn) {
-    wrapper_parent_type[keyIn] = valueIn;
+  void SetWrapperParentTypeRef(const ULONG type_cache_id,
+                               const mdTypeRef valueIn) {
+    if (type_cache_id >= wrapper_parent_type.size()) {
+      wrapper_parent_type.resize(type_cache_id + 1, mdTypeRefNil);
+    }
+    wrapper_parent_type[type_cache_id] = valueIn;
   }
 
-  void SetFailedWrapperMemberKey(const WSTRING& key) {
-    failed_wrapper_keys.insert(key);
+  void SetFailedWrapperMemberKey(const ULONG method_cache_id) {
+    if (method_cache_id >= failed_wrapper_keys.size()) {
+      failed_wrapper_keys.resize(method_cache_id + 1, false);
+    }
+    failed_wrapper_keys[method_cache_id] = true;
   }
 
-  inline std::vector<MethodReplacement> GetMethodReplacementsForCaller(
+  // The replacements point into the integrations of the module
+  inline std::vector<const MethodReplacement*> GetMethodReplacementsForCaller(
       const trace::FunctionInfo& caller) {
-    std::vector<MethodReplacement> enabled;
+    std::vector<const MethodReplacement*> enabled;
     for (auto& i : integrations) {
       if ((i.replacement.caller_method.type_name.empty() ||
            i.replacement.caller_method.type_name == caller.type.name) &&
           (i.replacement.caller_method.method_name.empty() ||
            i.replacement.caller_method.method_name == caller.name)) {
-        enabled.push_back(i.replacement);
+        enabled.push_back(&i.replacement);
       }
     }
     return enabled;
   }
 
+  // Finds a reference to an assembly by name. References defined after the
+  // index was built are found through the metadata interfaces.
+  mdAssemblyRef FindAssemblyRef(const WSTRING& assembly_name);
+
+  // Adds a reference defined by the profiler to the index
+  void SetAssemblyRef(const WSTRING& assembly_name, mdAssemblyRef assembly_ref);
+
+  // Finds a type defined in the module by its full name, nested types are
+  // named like "Namespace.Outer+Inner".
+  mdTypeDef FindTypeDef(const WSTRING& type_name);
+
+  // Finds the TypeDefs and TypeRefs named like GetTypeInfo names them
+  // ("Namespace.Name", just "Name" for nested types).
+  std::vector<mdToken> FindTypeTokens(const WSTRING& type_name);
+
+  // Whether FindTypeTokens knows the token: types defined after the index
+  // was built are not in it.
+  bool IsTypeTokenIndexed(mdToken token);
+
+  // Returns the signature_types of the method compiled against this module
+  const SignatureMatcher& GetSignatureMatcher(const MethodReference& method,
+                                              SignatureNaming naming);
+
   inline CallTargetTokens* GetCallTargetTokens() {
     if (calltargetTokens == nullptr) {
       calltargetTokens = new CallTargetTokens(this);
@@ -9,11 +9,15 @@
 
 #else
 
+#include <sys/stat.h>
 #include <unistd.h>
 #include <fstream>
 
 #endif
 
+#include <cstring>
+#include <vector>
+
 #if MACOS
 #include <libproc.h>
 #endif
@@ -22,6 +26,12 @@
 #include "string.h"  // NOLINT
 #include "util.h"
 
+#ifndef _WIN32
+// After the CLR headers: fcntl.h defines a LOCK_WRITE macro that clashes with
+// the enum of objidl.h
+#include <fcntl.h>
+#endif
+
 namespace trace {
 
 inline WSTRING DatadogLogFilePath() {
@@ -91,6 +101,126 @@ inline int GetPID() {
 #endif
 }
 
+// Whether only the user of the process can add, replace or remove the files
+// of the directory: it is owned by the effective user and not writable by its
+// group or by others. The ACLs are not inspected on Windows, where a
+// ProtectedFile keeps the file from being replaced instead.
+inline bool IsPrivateDirectory(const std::string& path) {
+#ifdef _WIN32
+  const DWORD attributes = GetFileAttributesA(path.c_str());
+  return attributes != INVALID_FILE_ATTRIBUTES &&
+         (attributes & FILE_ATTRIBUTE_DIRECTORY) != 0;
+#else
+  struct stat status;
+  return stat(path.c_str(), &status) == 0 && S_ISDIR(status.st_mode) &&
+         status.st_uid == geteuid() &&
+         (status.st_mode & (S_IWGRP | S_IWOTH)) == 0;
+#endif
+}
+
+// Removes the write permissions of a file. Not on Windows, where the read only
+// attribute would also keep a stale file from being deleted.
+inline bool MakeReadOnly(const std::string& path) {
+#ifdef _WIN32
+  return true;
+#else
+  return chmod(path.c_str(), S_IRUSR | S_IRGRP | S_IROTH) == 0;
+#endif
+}
+
+// A file opened for reading, held until it is closed or destroyed. On Windows
+// other handles can't write, rename or delete the file meanwhile. On other
+// platforms it must be a regular file owned by the effective user and not
+// writable by its group or by others.
+class ProtectedFile {
+ public:
+  ProtectedFile() = default;
+  ~ProtectedFile() { Close(); }
+
+  ProtectedFile(const ProtectedFile&) = delete;
+  ProtectedFile& operator=(const ProtectedFile&) = delete;
+
+  bool Open(const std::string& path) {
+    Close();
+#ifdef _WIN32
+    handle_ = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+                          OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    return handle_ != INVALID_HANDLE_VALUE;
+#else
+    fd_ = open(path.c_str(), O_RDONLY | O_NOFOLLOW | O_CLOEXEC);
+    struct stat status;
+    if (fd_ < 0 || fstat(fd_, &status) != 0 || !S_ISREG(status.st_mode) ||
+        status.st_uid != geteuid() ||
+        (status.st_mode & (S_IWGRP | S_IWOTH)) != 0) {
+      Close();
+      return false;
+    }
+    return true;
+#endif
+  }
+
+  // Whether the whole file, read through the open handle, is the bytes
+  bool HasContents(const BYTE* bytes, size_t size) {
+    // one more byte to tell a longer file apart
+    std::vector<BYTE> contents(size + 1);
+    size_t total = 0;
+    while (total < contents.size()) {
+      const size_t read = ReadAt(total, contents.data() + total,
+                                 contents.size() - total);
+      if (read == 0) {
+        break;
+      }
+      total += read;
+    }
+    return total == size && memcmp(contents.data(), bytes, size) == 0;
+  }
+
+  void Close() {
+#ifdef _WIN32
+    if (handle_ != INVALID_HANDLE_VALUE) {
+      CloseHandle(handle_);
+      handle_ = INVALID_HANDLE_VALUE;
+    }
+#else
+    if (fd_ >= 0) {
+      close(fd_);
+      fd_ = -1;
+    }
+#endif
+  }
+
+ private:
+#ifdef _WIN32
+  HANDLE handle_ = INVALID_HANDLE_VALUE;
+#else
+  int fd_ = -1;
+#endif
+
+  // Returns 0 at the end of the file, on errors or when the file is not open
+  size_t ReadAt(size_t offset, BYTE* buffer, size_t size) {
+#ifdef _WIN32
+    if (handle_ == INVALID_HANDLE_VALUE) {
+      return 0;
+    }
+    OVERLAPPED position{};
+    position.Offset = static_cast<DWORD>(offset);
+    position.OffsetHigh = static_cast<DWORD>(static_cast<unsigned long long>(offset) >> 32);
+    DWORD read = 0;
+    const DWORD chunk = size > MAXDWORD ? MAXDWORD : static_cast<DWORD>(size);
+    if (!ReadFile(handle_, buffer, chunk, &read, &position)) {
+      return 0;
+    }
+    return read;
+#else
+    if (fd_ < 0) {
+      return 0;
+    }
+    const ssize_t read = pread(fd_, buffer, size, static_cast<off_t>(offset));
+    return read > 0 ? static_cast<size_t>(read) : 0;
+#endif
+  }
+};
+
 } // namespace trace
 
 #endif  // DD_CLR_PROFILER_PAL_H_
@@ -0,0 +1,126 @@
+#include "profiler_metrics.h"
+
+namespace trace {
+
+// Definitions of the constants the callers may bind to a reference
+const int LatencyHistogram::kSubBucketBits;
+const ULONG64 LatencyHistogram::kSubBucketCount;
+const size_t LatencyHistogram::kBucketCount;
+
+LatencyHistogram::LatencyHistogram() {
+  for (auto& bucket : buckets_) {
+    bucket.store(0, std::memory_order_relaxed);
+  }
+}
+
+size_t LatencyHistogram::GetBucketIndex(ULONG64 value) {
+  if (value < kSubBucketCount) {
+    return static_cast<size_t>(value);
+  }
+
+  int exponent = 0;
+  for (auto shifted = value; shifted > 1; shifted >>= 1) {
+    exponent++;
+  }
+  // the top kSubBucketBits + 1 bits of the value, in [kSubBucketCount,
+  // 2 * kSubBucketCount)
+  const int shift = exponent - kSubBucketBits;
+  return static_cast<size_t>(shift) * kSubBucketCount +
+         static_cast<size_t>(value >> shift);
+}
+
+ULONG64 LatencyHistogram::GetBucketUpperBound(size_t index) {
+  if (index < kSubBucketCount) {
+    return index;
+  }
+
+  const auto shift = index / kSubBucketCount - 1;
+  const auto sub_bucket = index - shift * kSubBucketCount;
+  // wraps to the max value for the last bucket
+  return ((static_cast<ULONG64>(sub_bucket) + 1) << shift) - 1;
+}
+
+void LatencyHistogram::Record(ULONG64 value) {
+  buckets_[GetBucketIndex(value)].fetch_add(1, std::memory_order_relaxed);
+  count_.fetch_add(1, std::memory_order_relaxed);
+  sum_.fetch_add(value, std::memory_order_relaxed);
+
+  auto max = max_.load(std::memory_order_relaxed);
+  while (value > max &&
+         !max_.compare_exchange_weak(max, value, std::memory_order_relaxed)) {
+  }
+}
+
+ULONG64 LatencyHistogram::GetPercentile(double percentile) const {
+  // the buckets are summed, count_ may already include later values
+  ULONG64 total = 0;
+  for (const auto& bucket : buckets_) {
+    total += bucket.load(std::memory_order_relaxed);
+  }
+  if (total == 0) {
+    return 0;
+  }
+
+  auto rank = static_cast<ULONG64>(percentile / 100.0 * total + 0.5);
+  if (rank == 0) {
+    rank = 1;
+  } else if (rank > total) {
+    rank = total;
+  }
+
+  ULONG64 seen = 0;
+  for (size_t i = 0; i < kBucketCount; i++) {
+    seen += buckets_[i].load(std::memory_order_relaxed);
+    if (seen >= rank) {
+      const auto upper_bound = GetBucketUpperBound(i);
+      const auto max = GetMax();
+      return upper_bound < max ? upper_bound : max;
+    }
+  }
+  return GetMax();
+}
+
+ProfilerMetrics::ProfilerMetrics() {
+  for (auto& counter : counters_) {
+    counter.store(0, std::memory_order_relaxed);
+  }
+}
+
+size_t ProfilerMetrics::Export(INT64* values, size_t size) const {
+  if (values == nullptr || size < kProfilerMetricsExportValues) {
+    return kProfilerMetricsExportValues;
+  }
+
+  for (const auto& counter : counters_) {
+    *values++ = static_cast<INT64>(counter.load(std::memory_order_relaxed));
+  }
+  for (const auto& histogram : histograms_) {
+    *values++ = static_cast<INT64>(histogram.GetCount());
+    *values++ = static_cast<INT64>(histogram.GetSum());
+    *values++ = static_cast<INT64>(histogram.GetMax());
+    *values++ = static_cast<INT64>(histogram.GetPercentile(50));
+    *values++ = static_cast<INT64>(histogram.GetPercentile(90));
+    *values++ = static_cast<INT64>(histogram.GetPercentile(99));
+  }
+  return kProfilerMetricsExportValues;
+}
+
+std::unique_lock<std::mutex> LockAndRecordWait(std::mutex& mutex,
+                                               ProfilerMetrics& metrics,
+                                               TimedOperation operation) {
+  std::unique_lock<std::mutex> guard(mutex, std::try_to_lock);
+  if (guard.owns_lock()) {
+    metrics.RecordLatency(operation, 0);
+    return guard;
+  }
+
+  const auto start = std::chrono::steady_clock::now();
+  guard.lock();
+  metrics.RecordLatency(operation,
+                        std::chrono::duration_cast<std::chrono::nanoseconds>(
+                            std::chrono::steady_clock::now() - start)
+                            .count());
+  return guard;
+}
+
+}  // namespace trace
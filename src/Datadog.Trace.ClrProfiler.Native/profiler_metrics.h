@@ -0,0 +1,152 @@
+#ifndef DD_CLR_PROFILER_PROFILER_METRICS_H_
+#define DD_CLR_PROFILER_PROFILER_METRICS_H_
+
+#include <corhlpr.h>
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+
+namespace trace {
+
+// The callbacks whose latency is measured, and the wait for the module lock
+enum class TimedOperation : size_t {
+  JITCompilationStarted,
+  ModuleLoadFinished,
+  GetReJITParameters,
+  JITInlining,
+  GetAssemblyReferences,
+  ModuleLockWait,
+  Count
+};
+
+enum class ProfilerCounter : size_t {
+  // Method bodies rewritten by an integration
+  Rewrites,
+  // Methods requested for a CallTarget ReJIT
+  RejitRequests,
+  // Rewrites and ReJITs that failed
+  Failures,
+  // Bytes of the rewritten method bodies
+  ILBytesEmitted,
+  Count
+};
+
+/// <summary>
+/// A latency histogram in the HDR layout: the values below 16 are counted
+/// exactly, the others in 8 linear buckets per power of two, so the value given
+/// for a percentile is at most 12.5% above the recorded one. Recording is lock
+/// free.
+/// </summary>
+class LatencyHistogram {
+ public:
+  static const int kSubBucketBits = 3;
+  static const ULONG64 kSubBucketCount = 1 << kSubBucketBits;
+  static const size_t kBucketCount =
+      (64 - kSubBucketBits + 1) * kSubBucketCount;
+
+ private:
+  std::atomic<ULONG64> buckets_[kBucketCount];
+  std::atomic<ULONG64> count_{0};
+  std::atomic<ULONG64> sum_{0};
+  std::atomic<ULONG64> max_{0};
+
+  LatencyHistogram(const LatencyHistogram&) = delete;
+  LatencyHistogram& operator=(const LatencyHistogram&) = delete;
+
+ public:
+  LatencyHistogram();
+
+  static size_t GetBucketIndex(ULONG64 value);
+  // The highest value counted in the bucket
+  static ULONG64 GetBucketUpperBound(size_t index);
+
+  void Record(ULONG64 value);
+
+  ULONG64 GetCount() const { return count_.load(std::memory_order_relaxed); }
+  ULONG64 GetSum() const { return sum_.load(std::memory_order_relaxed); }
+  ULONG64 GetMax() const { return max_.load(std::memory_order_relaxed); }
+
+  // The upper bound of the bucket of the percentile (0 to 100), at most the
+  // max. The values recorded while it is computed may be missed.
+  ULONG64 GetPercentile(double percentile) const;
+};
+
+// Values of each timed operation in the export: count, sum, max, p50, p90
+// and p99, in nanoseconds
+const size_t kTimedOperationExportValues = 6;
+const size_t kProfilerMetricsExportValues =
+    static_cast<size_t>(ProfilerCounter::Count) +
+    static_cast<size_t>(TimedOperation::Count) * kTimedOperationExportValues;
+
+/// <summary>
+/// The self-metrics of the profiler, polled by the managed runtime metrics
+/// through GetProfilerMetrics. The values are cumulative since the profiler
+/// was loaded.
+/// </summary>
+class ProfilerMetrics {
+ private:
+  LatencyHistogram histograms_[static_cast<size_t>(TimedOperation::Count)];
+  std::atomic<ULONG64> counters_[static_cast<size_t>(ProfilerCounter::Count)];
+
+ public:
+  ProfilerMetrics();
+
+  void RecordLatency(TimedOperation operation, ULONG64 nanoseconds) {
+    histograms_[static_cast<size_t>(operation)].Record(nanoseconds);
+  }
+
+  void Increment(ProfilerCounter counter, ULONG64 value = 1) {
+    counters_[static_cast<size_t>(counter)].fetch_add(
+        value, std::memory_order_relaxed);
+  }
+
+  const LatencyHistogram& GetHistogram(TimedOperation operation) const {
+    return histograms_[static_cast<size_t>(operation)];
+  }
+
+  ULONG64 GetCounter(ProfilerCounter counter) const {
+    return counters_[static_cast<size_t>(counter)].load(
+        std::memory_order_relaxed);
+  }
+
+  // Writes the counters, then the values of each timed operation. Returns the
+  // number of values, they are only written if the buffer is large enough.
+  size_t Export(INT64* values, size_t size) const;
+};
+
+/// <summary>
+/// Records the time until the end of the scope.
+/// </summary>
+class ScopedLatency {
+ private:
+  ProfilerMetrics& metrics_;
+  const TimedOperation operation_;
+  const std::chrono::steady_clock::time_point start_;
+
+  ScopedLatency(const ScopedLatency&) = delete;
+  ScopedLatency& operator=(const ScopedLatency&) = delete;
+
+ public:
+  ScopedLatency(ProfilerMetrics& metrics, TimedOperation operation)
+      : metrics_(metrics),
+        operation_(operation),
+        start_(std::chrono::steady_clock::now()) {}
+
+  ~ScopedLatency() {
+    metrics_.RecordLatency(
+        operation_, std::chrono::duration_cast<std::chrono::nanoseconds>(
+                        std::chrono::steady_clock::now() - start_)
+                        .count());
+  }
+};
+
+// Locks the mutex and records the wait, an uncontended lock is recorded as
+// no wait without reading the clock
+std::unique_lock<std::mutex> LockAndRecordWait(std::mutex& mutex,
+                                               ProfilerMetrics& metrics,
+                                               TimedOperation operation);
+
+}  // namespace trace
+
+#endif  // DD_CLR_PROFILER_PROFILER_METRICS_H_
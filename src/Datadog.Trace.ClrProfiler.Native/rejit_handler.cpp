@@ -26,16 +26,33 @@ void RejitItem::DeleteArray() {
   }
 }
 
-void RejitHandlerModuleMethod::AddFunctionId(FunctionID functionId) {
-  std::lock_guard<std::mutex> guard(functionsIds_lock);
-  auto moduleHandler = (RejitHandlerModule*)module;
-  auto rejitHandler = (RejitHandler*)moduleHandler->GetHandler();
-  functionsIds.insert(functionId);
-  rejitHandler->_addFunctionToSet(functionId, this);
+HRESULT RejitHandlerModuleMethod::PrepareAsyncMoveNext(
+    const std::function<HRESULT(ICorProfilerFunctionControl*)>& rewrite) {
+  std::lock_guard<std::mutex> guard(asyncMoveNextBody_lock);
+  if (asyncMoveNextResult == E_PENDING) {
+    ILBodyBuffer buffer;
+    asyncMoveNextResult = rewrite(&buffer);
+    if (asyncMoveNextResult == S_OK && buffer.GetBody().empty()) {
+      asyncMoveNextResult = E_FAIL;
+    }
+    if (asyncMoveNextResult == S_OK) {
+      asyncMoveNextBody.swap(buffer.GetBody());
+    }
+  }
+  return asyncMoveNextResult;
+}
+const std::vector<BYTE>& RejitHandlerModuleMethod::GetAsyncMoveNextBody() {
+  std::lock_guard<std::mutex> guard(asyncMoveNextBody_lock);
+  return asyncMoveNextBody;
 }
-bool RejitHandlerModuleMethod::ExistFunctionId(FunctionID functionId) {
-  std::lock_guard<std::mutex> guard(functionsIds_lock);
-  return functionsIds.find(functionId) != functionsIds.end();
+
+RejitHandlerModule::~RejitHandlerModule() {
+  std::lock_guard<std::mutex> guard(methods_lock);
+  for (auto& method : methods) {
+    delete method.second;
+  }
+  methods.clear();
+  TrackDeallocation(MemoryCounter::RejitModule, sizeof(RejitHandlerModule));
 }
 
 RejitHandlerModuleMethod* RejitHandlerModule::GetOrAddMethod(mdMethodDef methodDef) {
@@ -60,38 +77,6 @@ bool RejitHandlerModule::TryGetMethod(mdMethodDef methodDef,
   *methodHandler = nullptr;
   return false;
 }
-
-RejitHandlerModuleMethod* RejitHandler::GetModuleMethodFromFunctionId(
-    FunctionID functionId) {
-  {
-    std::lock_guard<std::mutex> guard(methodByFunctionId_lock);
-    if (methodByFunctionId.count(functionId) > 0) {
-      return methodByFunctionId[functionId];
-    }
-  }
-
-  ModuleID moduleId;
-  mdToken function_token = mdTokenNil;
-
-  HRESULT hr = profilerInfo->GetFunctionInfo(functionId, nullptr, &moduleId,
-                                             &function_token);
-
-  if (FAILED(hr)) {
-    Warn(
-        "RejitHandler::GetModuleMethodFromFunctionId: Call to "
-        "ICorProfilerInfo4.GetFunctionInfo() "
-        "failed for ",
-        functionId);
-    methodByFunctionId[functionId] = nullptr;
-    return nullptr;
-  }
-
-  auto moduleHandler = GetOrAddModule(moduleId);
-  auto methodHandler = moduleHandler->GetOrAddMethod(function_token);
-  methodHandler->AddFunctionId(functionId);
-  return methodHandler;
-}
-
 RejitHandlerModule* RejitHandler::GetOrAddModule(ModuleID moduleId) {
   std::lock_guard<std::mutex> guard(modules_lock);
 
@@ -115,6 +100,14 @@ bool RejitHandler::TryGetModule(ModuleID moduleId,
   return false;
 }
 
+bool RejitHandler::HasMethod(ModuleID moduleId, mdMethodDef methodDef) {
+  std::lock_guard<std::mutex> guard(modules_lock);
+  const auto search = modules.find(moduleId);
+  RejitHandlerModuleMethod* methodHandler = nullptr;
+  return search != modules.end() &&
+         search->second->TryGetMethod(methodDef, &methodHandler);
+}
+
 HRESULT RejitHandler::NotifyReJITParameters(
     ModuleID moduleId, mdMethodDef methodId,
     ICorProfilerFunctionControl* pFunctionControl, ModuleMetadata* metadata) {
@@ -175,14 +168,23 @@ HRESULT RejitHandler::NotifyReJITParameters(
   return rewriteCallback(moduleHandler, methodHandler);
 }
 
-HRESULT RejitHandler::NotifyReJITCompilationStarted(FunctionID functionId, ReJITID rejitId) {
-  return S_OK;
+void RejitHandler::RemoveModule(ModuleID moduleId) {
+  RejitHandlerModule* moduleHandler = nullptr;
+  {
+    std::lock_guard<std::mutex> guard(modules_lock);
+    const auto search = modules.find(moduleId);
+    if (search == modules.end()) {
+      return;
+    }
+    moduleHandler = search->second;
+    modules.erase(search);
+  }
+
+  delete moduleHandler;
 }
 
-void RejitHandler::_addFunctionToSet(FunctionID functionId,
-                                     RejitHandlerModuleMethod* method) {
-  std::lock_guard<std::mutex> guard(methodByFunctionId_lock);
-  methodByFunctionId[functionId] = method;
+HRESULT RejitHandler::NotifyReJITCompilationStarted(FunctionID functionId, ReJITID rejitId) {
+  return S_OK;
 }
 
 }  // namespace trace
\ No newline at end of file
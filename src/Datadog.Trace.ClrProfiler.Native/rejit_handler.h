@@ -2,6 +2,7 @@
 #define DD_CLR_PROFILER_REJIT_HANDLER_H_
 
 #include <atomic>
+#include <functional>
 #include <mutex>
 #include <string>
 #include <unordered_map>
@@ -10,10 +11,48 @@
 #include "cor.h"
 #include "corprof.h"
 #include "logging.h"
+#include "memory_counters.h"
 #include "module_metadata.h"
 
 namespace trace {
 
+/// <summary>
+/// Function control keeping the IL body set by a rewrite instead of applying
+/// it, to prepare a body before the ReJIT of its method
+/// </summary>
+class ILBodyBuffer : public ICorProfilerFunctionControl {
+ private:
+  std::vector<BYTE> body;
+
+ public:
+  inline std::vector<BYTE>& GetBody() { return this->body; }
+
+  HRESULT STDMETHODCALLTYPE QueryInterface(REFIID riid,
+                                           void** ppvObject) override {
+    if (riid == IID_IUnknown || riid == IID_ICorProfilerFunctionControl) {
+      *ppvObject = this;
+      return S_OK;
+    }
+    *ppvObject = nullptr;
+    return E_NOINTERFACE;
+  }
+  ULONG STDMETHODCALLTYPE AddRef() override { return 1; }
+  ULONG STDMETHODCALLTYPE Release() override { return 1; }
+  HRESULT STDMETHODCALLTYPE SetCodegenFlags(DWORD flags) override {
+    return S_OK;
+  }
+  HRESULT STDMETHODCALLTYPE SetILFunctionBody(
+      ULONG cbNewILMethodHeader, LPCBYTE pbNewILMethodHeader) override {
+    this->body.assign(pbNewILMethodHeader,
+                      pbNewILMethodHeader + cbNewILMethodHeader);
+    return S_OK;
+  }
+  HRESULT STDMETHODCALLTYPE SetILInstrumentedCodeMap(
+      ULONG cILMapEntries, COR_IL_MAP rgILMapEntries[]) override {
+    return S_OK;
+  }
+};
+
 struct RejitItem {
   int length_ = 0;
   ModuleID* moduleIds_ = nullptr;
@@ -32,10 +71,29 @@ class RejitHandlerModuleMethod {
   mdMethodDef methodDef;
   ICorProfilerFunctionControl* pFunctionControl;
   FunctionInfo* functionInfo;
-  MethodReplacement* methodReplacement;
-  std::mutex functionsIds_lock;
-  std::unordered_set<FunctionID> functionsIds;
+  // Handle to the integration applied, shares the catalog entry
+  IntegrationMethod* integrationMethod;
   void* module;
+  ULONG samplingRate;
+  // MoveNext handler of the state machine when the async completion of this
+  // method is instrumented inside the state machine
+  RejitHandlerModuleMethod* asyncMoveNextMethod;
+  // Async method handler when this method is a state machine MoveNext
+  RejitHandlerModuleMethod* asyncStubMethod;
+  // Result and body of the MoveNext rewrite, prepared once by the first ReJIT
+  // of the async method or of its MoveNext: the async method only hands its
+  // state to a MoveNext known to observe the completion
+  std::mutex asyncMoveNextBody_lock;
+  HRESULT asyncMoveNextResult;
+  std::vector<BYTE> asyncMoveNextBody;
+  // Invocation counter incremented by the rewritten IL through its address,
+  // so it must stay pinned for the lifetime of the method handler. The
+  // increment is a plain load/add/store, not an interlocked one: a lost update
+  // under contention only shifts which call is sampled, and the hot path of
+  // the method doesn't pay for a locked instruction.
+  volatile LONG samplingCounter;
+  // Why the last rewrite of the method failed, for the rewrite quarantine
+  WSTRING rewriteFailure;
 
  public:
   RejitHandlerModuleMethod(mdMethodDef methodDef, void* module) {
@@ -43,7 +101,18 @@ class RejitHandlerModuleMethod {
     this->pFunctionControl = nullptr;
     this->module = module;
     this->functionInfo = nullptr;
-    this->methodReplacement = nullptr;
+    this->integrationMethod = nullptr;
+    this->samplingRate = kSamplingRateEveryCall;
+    this->asyncMoveNextMethod = nullptr;
+    this->asyncStubMethod = nullptr;
+    this->asyncMoveNextResult = E_PENDING;
+    this->samplingCounter = 0;
+    TrackAllocation(MemoryCounter::RejitMethod, sizeof(RejitHandlerModuleMethod));
+  }
+  ~RejitHandlerModuleMethod() {
+    delete this->functionInfo;
+    delete this->integrationMethod;
+    TrackDeallocation(MemoryCounter::RejitMethod, sizeof(RejitHandlerModuleMethod));
   }
   inline mdMethodDef GetMethodDef() { return this->methodDef; }
   inline ICorProfilerFunctionControl* GetFunctionControl() {
@@ -55,17 +124,51 @@ class RejitHandlerModuleMethod {
   }
   inline FunctionInfo* GetFunctionInfo() { return this->functionInfo; }
   inline void SetFunctionInfo(FunctionInfo* functionInfo) {
-    this->functionInfo = functionInfo;
+    if (this->functionInfo != functionInfo) {
+      delete this->functionInfo;
+      this->functionInfo = functionInfo;
+    }
   }
-  inline MethodReplacement* GetMethodReplacement() {
-    return this->methodReplacement;
+  inline const MethodReplacement* GetMethodReplacement() {
+    return this->integrationMethod != nullptr
+               ? &this->integrationMethod->replacement
+               : nullptr;
   }
-  inline void SetMethodReplacement(MethodReplacement* methodReplacement) {
-    this->methodReplacement = methodReplacement;
+  inline void SetIntegrationMethod(const IntegrationMethod& integrationMethod) {
+    delete this->integrationMethod;
+    this->integrationMethod = new IntegrationMethod(integrationMethod);
   }
   inline void* GetModule() { return this->module; }
-  void AddFunctionId(FunctionID functionId);
-  bool ExistFunctionId(FunctionID functionId);
+  inline ULONG GetSamplingRate() { return this->samplingRate; }
+  inline void SetSamplingRate(ULONG samplingRate) {
+    this->samplingRate = samplingRate;
+  }
+  inline volatile LONG* GetSamplingCounterAddress() {
+    return &this->samplingCounter;
+  }
+  inline RejitHandlerModuleMethod* GetAsyncMoveNextMethod() {
+    return this->asyncMoveNextMethod;
+  }
+  inline void SetAsyncMoveNextMethod(
+      RejitHandlerModuleMethod* asyncMoveNextMethod) {
+    this->asyncMoveNextMethod = asyncMoveNextMethod;
+  }
+  inline RejitHandlerModuleMethod* GetAsyncStubMethod() {
+    return this->asyncStubMethod;
+  }
+  inline void SetAsyncStubMethod(RejitHandlerModuleMethod* asyncStubMethod) {
+    this->asyncStubMethod = asyncStubMethod;
+  }
+  inline WSTRING GetRewriteFailure() { return this->rewriteFailure; }
+  inline void SetRewriteFailure(const WSTRING& rewriteFailure) {
+    this->rewriteFailure = rewriteFailure;
+  }
+  // Runs the rewrite of the MoveNext into a buffer the first time only and
+  // returns its result, the body is kept when the result is S_OK
+  HRESULT PrepareAsyncMoveNext(
+      const std::function<HRESULT(ICorProfilerFunctionControl*)>& rewrite);
+  // The prepared body of the MoveNext, empty until it is prepared
+  const std::vector<BYTE>& GetAsyncMoveNextBody();
 };
 
 /// <summary>
@@ -84,7 +187,10 @@ class RejitHandlerModule {
     this->moduleId = moduleId;
     this->metadata = nullptr;
     this->handler = handler;
+    TrackAllocation(MemoryCounter::RejitModule, sizeof(RejitHandlerModule));
   }
+  // Deletes the method handlers of the module
+  ~RejitHandlerModule();
   inline ModuleID GetModuleId() { return this->moduleId; }
   inline ModuleMetadata* GetModuleMetadata() { return this->metadata; }
   inline void SetModuleMetadata(ModuleMetadata* metadata) {
@@ -104,16 +210,12 @@ class RejitHandler {
  private:
   std::mutex modules_lock;
   std::unordered_map<ModuleID, RejitHandlerModule*> modules;
-  std::mutex methodByFunctionId_lock;
-  std::unordered_map<FunctionID, RejitHandlerModuleMethod*> methodByFunctionId;
   ICorProfilerInfo4* profilerInfo;
   std::function<HRESULT(RejitHandlerModule*, RejitHandlerModuleMethod*)> rewriteCallback;
 
   BlockingQueue<RejitItem>* rejit_queue_;
   std::thread* rejit_queue_thread_;
 
-  RejitHandlerModuleMethod* GetModuleMethodFromFunctionId(FunctionID functionId);
-
  public:
   RejitHandler(ICorProfilerInfo4* pInfo,
                std::function<HRESULT(RejitHandlerModule*,
@@ -127,12 +229,18 @@ class RejitHandler {
 
   bool TryGetModule(ModuleID moduleId, RejitHandlerModule** moduleHandler);
 
+  // Whether the method has a handler. The lookup is done under the modules
+  // lock, so RemoveModule can't free the module handler in the meantime.
+  bool HasMethod(ModuleID moduleId, mdMethodDef methodDef);
+
+  // Frees the module handler and its method handlers, once the module is
+  // unloading
+  void RemoveModule(ModuleID moduleId);
+
   HRESULT NotifyReJITParameters(ModuleID moduleId, mdMethodDef methodId,
                              ICorProfilerFunctionControl* pFunctionControl,
                              ModuleMetadata* metadata);
   HRESULT NotifyReJITCompilationStarted(FunctionID functionId, ReJITID rejitId);
-  void _addFunctionToSet(FunctionID functionId,
-                         RejitHandlerModuleMethod* method);
   
   void EnqueueForRejit(size_t length, ModuleID* moduleIds, mdMethodDef* methodDefs) {
     rejit_queue_->push(RejitItem((int)length, moduleIds, methodDefs));
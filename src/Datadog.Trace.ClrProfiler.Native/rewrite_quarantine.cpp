@@ -0,0 +1,146 @@
+#include "rewrite_quarantine.h"
+
+#include <cstdlib>
+#include <fstream>
+
+#include "logging.h"
+#include "util.h"
+
+namespace trace {
+
+namespace {
+
+const size_t kQuarantineFieldCount = 6;
+
+// Tabs and line breaks would break the line format
+WSTRING SanitizeField(const WSTRING& value) {
+  WSTRING sanitized = value;
+  for (auto& c : sanitized) {
+    if (c == '\t' || c == '\r' || c == '\n') {
+      c = ' ';
+    }
+  }
+  return sanitized;
+}
+
+WSTRING FormatMethod(const QuarantinedMethod& method) {
+  return method.profiler_version + "\t"_W + method.module_version_id +
+         "\t"_W + TokenStr(&method.method_def) + "\t"_W + method.integration +
+         "\t"_W + method.assembly_name + "\t"_W + method.reason + "\n"_W;
+}
+
+}  // namespace
+
+RewriteQuarantine::RewriteQuarantine(const WSTRING& path,
+                                     const WSTRING& profiler_version)
+    : path_(ToString(path)), profiler_version_(SanitizeField(profiler_version)) {
+  if (path_.empty()) {
+    return;
+  }
+
+  std::ifstream stream(path_);
+  std::string line;
+  while (std::getline(stream, line)) {
+    const auto fields = Split(ToWSTRING(line), '\t');
+    // the lines of the previous versions of the format have fewer fields
+    if (fields.size() != kQuarantineFieldCount ||
+        fields[0] != profiler_version_) {
+      continue;
+    }
+
+    QuarantinedMethod method;
+    method.profiler_version = fields[0];
+    method.module_version_id = fields[1];
+    method.method_def = static_cast<mdMethodDef>(
+        strtoul(ToString(fields[2]).c_str(), nullptr, 16));
+    if (TypeFromToken(method.method_def) != mdtMethodDef) {
+      continue;
+    }
+    method.integration = fields[3];
+    method.assembly_name = fields[4];
+    method.reason = fields[5];
+
+    if (keys_.insert(GetKey(method.profiler_version, method.module_version_id,
+                            method.method_def, method.integration))
+            .second) {
+      methods_.push_back(method);
+    }
+  }
+
+  if (!methods_.empty()) {
+    Info("RewriteQuarantine: ", methods_.size(),
+         " methods quarantined by previous runs in ", path);
+  }
+}
+
+WSTRING RewriteQuarantine::GetIntegrationKey(
+    const MethodReplacement& method_replacement) {
+  return method_replacement.target_method.get_method_cache_key() + " "_W +
+         method_replacement.wrapper_method.get_method_cache_key();
+}
+
+WSTRING RewriteQuarantine::GetKey(const WSTRING& profiler_version,
+                                  const WSTRING& module_version_id,
+                                  mdMethodDef method_def,
+                                  const WSTRING& integration) {
+  return profiler_version + "/"_W + module_version_id + "/"_W + TokenStr(&method_def) + "/"_W +
+         SanitizeField(integration);
+}
+
+bool RewriteQuarantine::IsQuarantined(
+    const GUID& module_version_id, mdMethodDef method_def,
+    const MethodReplacement& method_replacement) const {
+  const auto key =
+      GetKey(profiler_version_, GuidStr(&module_version_id), method_def,
+             GetIntegrationKey(method_replacement));
+
+  std::lock_guard<std::mutex> guard(lock_);
+  return keys_.find(key) != keys_.end();
+}
+
+bool RewriteQuarantine::Add(const WSTRING& assembly_name,
+                            const GUID& module_version_id,
+                            mdMethodDef method_def,
+                            const MethodReplacement& method_replacement,
+                            const WSTRING& reason) {
+  QuarantinedMethod method;
+  method.profiler_version = profiler_version_;
+  method.module_version_id = GuidStr(&module_version_id);
+  method.method_def = method_def;
+  method.integration = SanitizeField(GetIntegrationKey(method_replacement));
+  method.assembly_name = SanitizeField(assembly_name);
+  method.reason = SanitizeField(reason);
+
+  std::lock_guard<std::mutex> guard(lock_);
+  if (!keys_.insert(GetKey(method.profiler_version, method.module_version_id,
+                           method.method_def, method.integration))
+           .second) {
+    return false;
+  }
+  methods_.push_back(method);
+
+  if (!path_.empty()) {
+    std::ofstream stream(path_, std::ios::app);
+    stream << ToString(FormatMethod(method));
+    if (!stream) {
+      Warn("RewriteQuarantine: failed to persist the quarantine to ", path_);
+    }
+  }
+  return true;
+}
+
+std::vector<QuarantinedMethod> RewriteQuarantine::GetMethods() const {
+  std::lock_guard<std::mutex> guard(lock_);
+  return methods_;
+}
+
+WSTRING RewriteQuarantine::Export() const {
+  std::lock_guard<std::mutex> guard(lock_);
+  WSTRING exported;
+  for (const auto& method : methods_) {
+    exported += FormatMethod(method);
+  }
+  return exported;
+}
+
+}  // namespace trace
@@ -0,0 +1,67 @@
+#ifndef DD_CLR_PROFILER_REWRITE_QUARANTINE_H_
+#define DD_CLR_PROFILER_REWRITE_QUARANTINE_H_
+
+#include <corhlpr.h>
+#include <mutex>
+#include <unordered_set>
+#include <vector>
+
+#include "integration.h"
+#include "string.h"
+
+namespace trace {
+
+struct QuarantinedMethod {
+  // Version of the profiler whose rewrite failed
+  WSTRING profiler_version;
+  WSTRING module_version_id;
+  mdMethodDef method_def = mdMethodDefNil;
+  // Target and wrapper of the integration that failed
+  WSTRING integration;
+  WSTRING assembly_name;
+  WSTRING reason;
+};
+
+/// <summary>
+/// Methods whose CallTarget rewrite failed, by profiler version and module
+/// version (MVID), so they are not requested for ReJIT again: not for other
+/// instances of the module and, when a file is given, not after a restart
+/// either. The file is append only, one tab separated method per line, and
+/// the lines of other profiler versions are ignored: their rewrite may
+/// succeed with this one.
+/// </summary>
+class RewriteQuarantine {
+ private:
+  const std::string path_;
+  const WSTRING profiler_version_;
+  mutable std::mutex lock_;
+  std::vector<QuarantinedMethod> methods_;
+  std::unordered_set<WSTRING> keys_;
+
+  static WSTRING GetIntegrationKey(const MethodReplacement& method_replacement);
+  static WSTRING GetKey(const WSTRING& profiler_version,
+                        const WSTRING& module_version_id,
+                        mdMethodDef method_def, const WSTRING& integration);
+
+ public:
+  // Loads the methods quarantined by previous processes of the same profiler
+  // version, an empty path keeps the quarantine in memory
+  RewriteQuarantine(const WSTRING& path, const WSTRING& profiler_version);
+
+  bool IsQuarantined(const GUID& module_version_id, mdMethodDef method_def,
+                     const MethodReplacement& method_replacement) const;
+
+  // Returns false if the method was already quarantined
+  bool Add(const WSTRING& assembly_name, const GUID& module_version_id,
+           mdMethodDef method_def, const MethodReplacement& method_replacement,
+           const WSTRING& reason);
+
+  std::vector<QuarantinedMethod> GetMethods() const;
+
+  // The quarantined methods in the format of the file
+  WSTRING Export() const;
+};
+
+}  // namespace trace
+
+#endif  // DD_CLR_PROFILER_REWRITE_QUARANTINE_H_
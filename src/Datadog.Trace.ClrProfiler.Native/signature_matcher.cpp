@@ -0,0 +1,496 @@
+#include "signature_matcher.h"
+
+#include <algorithm>
+#include <limits>
+
+#include "module_metadata.h"
+
+namespace trace {
+
+namespace {
+
+struct PrimitiveName {
+  const WSTRING name;
+  const CorElementType element_type;
+};
+
+// The names GetSigTypeTokName gives to the primitive element types
+const std::vector<PrimitiveName>& TypeTokNamePrimitives() {
+  static const std::vector<PrimitiveName> primitives = {
+      {SystemBoolean, ELEMENT_TYPE_BOOLEAN},
+      {SystemChar, ELEMENT_TYPE_CHAR},
+      {SystemByte, ELEMENT_TYPE_I1},
+      {SystemSByte, ELEMENT_TYPE_U1},
+      {SystemUInt16, ELEMENT_TYPE_U2},
+      {SystemInt16, ELEMENT_TYPE_I2},
+      {SystemInt32, ELEMENT_TYPE_I4},
+      {SystemUInt32, ELEMENT_TYPE_U4},
+      {SystemInt64, ELEMENT_TYPE_I8},
+      {SystemUInt64, ELEMENT_TYPE_U8},
+      {SystemSingle, ELEMENT_TYPE_R4},
+      {SystemDouble, ELEMENT_TYPE_R8},
+      {SystemIntPtr, ELEMENT_TYPE_I},
+      {SystemUIntPtr, ELEMENT_TYPE_U},
+      {SystemString, ELEMENT_TYPE_STRING},
+      {SystemObject, ELEMENT_TYPE_OBJECT}};
+  return primitives;
+}
+
+// The names TryParseSignatureTypes gives to the primitive element types
+const std::vector<PrimitiveName>& ParsedSignaturePrimitives() {
+  static const std::vector<PrimitiveName> primitives = {
+      {"System.Void"_W, ELEMENT_TYPE_VOID},
+      {SystemBoolean, ELEMENT_TYPE_BOOLEAN},
+      {"System.Char16"_W, ELEMENT_TYPE_CHAR},
+      {SystemSByte, ELEMENT_TYPE_I1},
+      {SystemByte, ELEMENT_TYPE_U1},
+      {SystemInt16, ELEMENT_TYPE_I2},
+      {SystemUInt16, ELEMENT_TYPE_U2},
+      {SystemInt32, ELEMENT_TYPE_I4},
+      {SystemUInt32, ELEMENT_TYPE_U4},
+      {SystemInt64, ELEMENT_TYPE_I8},
+      {SystemUInt64, ELEMENT_TYPE_U8},
+      {SystemSingle, ELEMENT_TYPE_R4},
+      {SystemDouble, ELEMENT_TYPE_R8},
+      {SystemString, ELEMENT_TYPE_STRING},
+      {SystemObject, ELEMENT_TYPE_OBJECT}};
+  return primitives;
+}
+
+BYTE FindPrimitive(const std::vector<PrimitiveName>& primitives,
+                   const WSTRING& name) {
+  for (const auto& primitive : primitives) {
+    if (primitive.name == name) {
+      return static_cast<BYTE>(primitive.element_type);
+    }
+  }
+  return ELEMENT_TYPE_END;
+}
+
+bool EndsWith(const WSTRING& str, const WSTRING& suffix) {
+  return str.size() >= suffix.size() &&
+         str.compare(str.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+// Splits generic arguments at the separators that are not nested in brackets
+bool SplitGenericArguments(const WSTRING& arguments, const WSTRING& separator,
+                           WCHAR open, WCHAR close,
+                           std::vector<WSTRING>* result) {
+  int depth = 0;
+  size_t start = 0;
+  for (size_t i = 0; i < arguments.size(); i++) {
+    if (arguments[i] == open) {
+      depth++;
+    } else if (arguments[i] == close) {
+      if (--depth < 0) {
+        return false;
+      }
+    } else if (depth == 0 &&
+               arguments.compare(i, separator.size(), separator) == 0) {
+      result->push_back(arguments.substr(start, i - start));
+      i += separator.size() - 1;
+      start = i + 1;
+    }
+  }
+  if (depth != 0) {
+    return false;
+  }
+  result->push_back(arguments.substr(start));
+  return true;
+}
+
+bool ReadNumber(PCCOR_SIGNATURE& sig, PCCOR_SIGNATURE end, ULONG* number) {
+  if (sig >= end) {
+    return false;
+  }
+  const auto length = CorSigUncompressData(sig, number);
+  if (length == static_cast<ULONG>(-1) || sig + length > end) {
+    return false;
+  }
+  sig += length;
+  return true;
+}
+
+bool ReadToken(PCCOR_SIGNATURE& sig, PCCOR_SIGNATURE end, mdToken* token) {
+  if (sig >= end) {
+    return false;
+  }
+  const auto length = CorSigUncompressToken(sig, token);
+  if (length == static_cast<ULONG>(-1) || sig + length > end) {
+    return false;
+  }
+  sig += length;
+  return true;
+}
+
+}  // namespace
+
+SignatureMatcher::SignatureMatcher(ModuleMetadata* module_metadata,
+                                   const std::vector<WSTRING>& signature_types,
+                                   SignatureNaming naming)
+    : naming_(naming), module_metadata_(module_metadata) {
+  if (signature_types.empty()) {
+    return;
+  }
+
+  types_.resize(signature_types.size());
+  for (size_t i = 0; i < signature_types.size(); i++) {
+    if (!CompileType(signature_types[i], true, &types_[i])) {
+      types_.clear();
+      return;
+    }
+  }
+  compiled_ = true;
+}
+
+bool SignatureMatcher::CompileType(const WSTRING& type_name, bool top_level,
+                                   Pattern* pattern) const {
+  if (type_name == "_"_W) {
+    // Only the top level names are skipped by the name comparisons
+    pattern->kind = Pattern::Any;
+    return top_level;
+  }
+
+  return naming_ == SignatureNaming::TypeTokName
+             ? CompileTypeTokName(type_name, top_level, pattern)
+             : CompileParsedSignatureType(type_name, top_level, pattern);
+}
+
+bool SignatureMatcher::CompileTypeTokName(const WSTRING& type_name,
+                                          bool top_level,
+                                          Pattern* pattern) const {
+  if (type_name.empty()) {
+    return false;
+  }
+
+  if (EndsWith(type_name, "&"_W)) {
+    pattern->kind = Pattern::ByRef;
+    pattern->children.resize(1);
+    return CompileTypeTokName(type_name.substr(0, type_name.size() - 1), false,
+                              &pattern->children[0]);
+  }
+
+  if (EndsWith(type_name, "[]"_W)) {
+    pattern->kind = Pattern::SzArray;
+    pattern->children.resize(1);
+    return CompileTypeTokName(type_name.substr(0, type_name.size() - 2), false,
+                              &pattern->children[0]);
+  }
+
+  if (type_name.back() == ']'_W) {
+    // Name[Arg1,Arg2]
+    const auto open = type_name.find('['_W);
+    std::vector<WSTRING> arguments;
+    if (open == 0 || open == WSTRING::npos ||
+        !SplitGenericArguments(
+            type_name.substr(open + 1, type_name.size() - open - 2), ","_W,
+            '['_W, ']'_W, &arguments)) {
+      return false;
+    }
+
+    pattern->kind = Pattern::GenericInst;
+    pattern->children.resize(arguments.size() + 1);
+    if (!CompileNamedType(type_name.substr(0, open), ELEMENT_TYPE_END,
+                          &pattern->children[0])) {
+      return false;
+    }
+    for (size_t i = 0; i < arguments.size(); i++) {
+      if (!CompileTypeTokName(arguments[i], false, &pattern->children[i + 1])) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  if (type_name[0] == '!'_W) {
+    // !0 for type parameters, !!0 for method parameters
+    const auto is_method = type_name.size() > 1 && type_name[1] == '!'_W;
+    const auto number = type_name.substr(is_method ? 2 : 1);
+    if (number.empty() ||
+        number.find_first_not_of("0123456789"_W) != WSTRING::npos ||
+        number.size() > 9) {
+      return false;
+    }
+    pattern->kind = Pattern::GenericParam;
+    pattern->element_type = is_method ? ELEMENT_TYPE_MVAR : ELEMENT_TYPE_VAR;
+    pattern->number = static_cast<ULONG>(std::stoul(ToString(number)));
+    return true;
+  }
+
+  return CompileNamedType(type_name,
+                          FindPrimitive(TypeTokNamePrimitives(), type_name),
+                          pattern);
+}
+
+bool SignatureMatcher::CompileParsedSignatureType(const WSTRING& type_name,
+                                                  bool top_level,
+                                                  Pattern* pattern) const {
+  if (type_name == "T"_W) {
+    pattern->kind = Pattern::GenericParam;
+    pattern->number = std::numeric_limits<ULONG>::max();
+    return true;
+  }
+
+  if (EndsWith(type_name, "[]"_W)) {
+    // The array suffixes of generic instantiations end up after the first
+    // type argument, leave those to the name comparison
+    if (type_name.find('<'_W) != WSTRING::npos) {
+      return false;
+    }
+    pattern->kind = Pattern::SzArray;
+    pattern->children.resize(1);
+    return CompileParsedSignatureType(
+        type_name.substr(0, type_name.size() - 2), false,
+        &pattern->children[0]);
+  }
+
+  if (!type_name.empty() && type_name.back() == '>'_W) {
+    // Name<Arg1, Arg2>
+    const auto open = type_name.find('<'_W);
+    std::vector<WSTRING> arguments;
+    if (open == 0 || open == WSTRING::npos ||
+        !SplitGenericArguments(
+            type_name.substr(open + 1, type_name.size() - open - 2), ", "_W,
+            '<'_W, '>'_W, &arguments)) {
+      return false;
+    }
+
+    pattern->kind = Pattern::GenericInst;
+    pattern->children.resize(arguments.size() + 1);
+    if (!CompileParsedSignatureType(type_name.substr(0, open), false,
+                                    &pattern->children[0]) ||
+        pattern->children[0].kind != Pattern::Type) {
+      return false;
+    }
+    for (size_t i = 0; i < arguments.size(); i++) {
+      if (!CompileParsedSignatureType(arguments[i], false,
+                                      &pattern->children[i + 1])) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  const auto element_type =
+      FindPrimitive(ParsedSignaturePrimitives(), type_name);
+  if (element_type == ELEMENT_TYPE_END) {
+    // Names without a namespace are looked up as nested types, and by-ref
+    // parameters are split in two names, leave those to the name comparison
+    if (type_name.find('.'_W) == WSTRING::npos ||
+        type_name.find('+'_W) != WSTRING::npos ||
+        type_name.find('<'_W) != WSTRING::npos) {
+      return false;
+    }
+  }
+  return CompileNamedType(type_name, element_type, pattern);
+}
+
+bool SignatureMatcher::CompileNamedType(const WSTRING& type_name,
+                                        BYTE element_type,
+                                        Pattern* pattern) const {
+  if (type_name.empty()) {
+    return false;
+  }
+  pattern->kind = Pattern::Type;
+  pattern->element_type = element_type;
+  pattern->name = type_name;
+  pattern->tokens = module_metadata_->FindTypeTokens(type_name);
+  return true;
+}
+
+bool SignatureMatcher::MatchToken(const Pattern& pattern, PCCOR_SIGNATURE& sig,
+                                  PCCOR_SIGNATURE end) const {
+  mdToken token;
+  if (!ReadToken(sig, end, &token)) {
+    return false;
+  }
+
+  if (std::find(pattern.tokens.begin(), pattern.tokens.end(), token) !=
+      pattern.tokens.end()) {
+    return true;
+  }
+
+  // Types defined after the index was built are compared by name
+  return !module_metadata_->IsTypeTokenIndexed(token) &&
+         module_metadata_->metadata_cache.GetTypeInfo(token).name ==
+             pattern.name;
+}
+
+bool SignatureMatcher::MatchType(const Pattern& pattern, PCCOR_SIGNATURE& sig,
+                                 PCCOR_SIGNATURE end) const {
+  if (pattern.kind == Pattern::Any) {
+    return SkipType(sig, end);
+  }
+  if (sig >= end) {
+    return false;
+  }
+
+  const auto element_type = *sig++;
+  switch (pattern.kind) {
+    case Pattern::Type:
+      if (element_type == ELEMENT_TYPE_CLASS ||
+          element_type == ELEMENT_TYPE_VALUETYPE) {
+        return MatchToken(pattern, sig, end);
+      }
+      return element_type == pattern.element_type;
+
+    case Pattern::GenericParam: {
+      ULONG number;
+      if ((element_type != ELEMENT_TYPE_VAR &&
+           element_type != ELEMENT_TYPE_MVAR) ||
+          (pattern.element_type != ELEMENT_TYPE_END &&
+           element_type != pattern.element_type) ||
+          !ReadNumber(sig, end, &number)) {
+        return false;
+      }
+      // TryParseSignatureTypes only skips one byte positions
+      return pattern.number == std::numeric_limits<ULONG>::max()
+                 ? number < 0x80
+                 : number == pattern.number;
+    }
+
+    case Pattern::SzArray:
+      return element_type == ELEMENT_TYPE_SZARRAY &&
+             MatchType(pattern.children[0], sig, end);
+
+    case Pattern::ByRef:
+      return element_type == ELEMENT_TYPE_BYREF &&
+             MatchType(pattern.children[0], sig, end);
+
+    case Pattern::GenericInst: {
+      if (element_type != ELEMENT_TYPE_GENERICINST || sig >= end ||
+          (*sig != ELEMENT_TYPE_CLASS && *sig != ELEMENT_TYPE_VALUETYPE)) {
+        return false;
+      }
+      sig++;
+      ULONG argument_count;
+      if (!MatchToken(pattern.children[0], sig, end) ||
+          !ReadNumber(sig, end, &argument_count) ||
+          argument_count != pattern.children.size() - 1) {
+        return false;
+      }
+      for (size_t i = 1; i < pattern.children.size(); i++) {
+        if (!MatchType(pattern.children[i], sig, end)) {
+          return false;
+        }
+      }
+      return true;
+    }
+
+    default:
+      return false;
+  }
+}
+
+bool SignatureMatcher::SkipType(PCCOR_SIGNATURE& sig,
+                                PCCOR_SIGNATURE end) const {
+  // Only the element types TryParseSignatureTypes can step over
+  if (sig >= end) {
+    return false;
+  }
+
+  mdToken token;
+  ULONG number;
+  const auto element_type = *sig++;
+  switch (element_type) {
+    case ELEMENT_TYPE_VOID:
+    case ELEMENT_TYPE_BOOLEAN:
+    case ELEMENT_TYPE_CHAR:
+    case ELEMENT_TYPE_I1:
+    case ELEMENT_TYPE_U1:
+    case ELEMENT_TYPE_I2:
+    case ELEMENT_TYPE_U2:
+    case ELEMENT_TYPE_I4:
+    case ELEMENT_TYPE_U4:
+    case ELEMENT_TYPE_I8:
+    case ELEMENT_TYPE_U8:
+    case ELEMENT_TYPE_R4:
+    case ELEMENT_TYPE_R8:
+    case ELEMENT_TYPE_I:
+    case ELEMENT_TYPE_U:
+    case ELEMENT_TYPE_STRING:
+    case ELEMENT_TYPE_OBJECT:
+      return true;
+
+    case ELEMENT_TYPE_CLASS:
+    case ELEMENT_TYPE_VALUETYPE:
+      return ReadToken(sig, end, &token);
+
+    case ELEMENT_TYPE_VAR:
+    case ELEMENT_TYPE_MVAR:
+      return ReadNumber(sig, end, &number) && number < 0x80;
+
+    case ELEMENT_TYPE_SZARRAY:
+      return SkipType(sig, end);
+
+    case ELEMENT_TYPE_GENERICINST:
+      if (sig >= end ||
+          (*sig != ELEMENT_TYPE_CLASS && *sig != ELEMENT_TYPE_VALUETYPE)) {
+        return false;
+      }
+      sig++;
+      if (!ReadToken(sig, end, &token) || !ReadNumber(sig, end, &number)) {
+        return false;
+      }
+      for (ULONG i = 0; i < number; i++) {
+        if (!SkipType(sig, end)) {
+          return false;
+        }
+      }
+      return true;
+
+    default:
+      return false;
+  }
+}
+
+bool SignatureMatcher::MatchesMethod(const MethodSignature& signature) const {
+  if (!compiled_ || signature.data.empty()) {
+    return false;
+  }
+
+  PCCOR_SIGNATURE sig = signature.data.data();
+  const PCCOR_SIGNATURE end = sig + signature.data.size();
+
+  ULONG number;
+  if ((*sig++ & IMAGE_CEE_CS_CALLCONV_GENERIC) != 0 &&
+      !ReadNumber(sig, end, &number)) {
+    return false;
+  }
+
+  ULONG param_count;
+  if (!ReadNumber(sig, end, &param_count) ||
+      param_count + 1 != types_.size()) {
+    return false;
+  }
+
+  for (const auto& type : types_) {
+    if (!MatchType(type, sig, end)) {
+      return false;
+    }
+  }
+  return sig == end;
+}
+
+bool SignatureMatcher::MatchesArguments(
+    const std::vector<FunctionMethodArgument>& arguments) const {
+  if (!compiled_ || arguments.size() + 1 != types_.size()) {
+    return false;
+  }
+
+  for (size_t i = 0; i < arguments.size(); i++) {
+    const auto& pattern = types_[i + 1];
+    if (pattern.kind == Pattern::Any) {
+      continue;
+    }
+
+    PCCOR_SIGNATURE sig;
+    const auto length = arguments[i].GetSignature(sig);
+    if (!MatchType(pattern, sig, sig + length)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+}  // namespace trace
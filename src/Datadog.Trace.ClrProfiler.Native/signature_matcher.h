@@ -0,0 +1,90 @@
+#ifndef DD_CLR_PROFILER_SIGNATURE_MATCHER_H_
+#define DD_CLR_PROFILER_SIGNATURE_MATCHER_H_
+
+#include <corhlpr.h>
+#include <vector>
+
+#include "clr_helpers.h"
+#include "string.h"
+
+namespace trace {
+
+class ModuleMetadata;
+
+// The type naming conventions of the signature comparisons a matcher replaces
+enum class SignatureNaming : BYTE {
+  // FunctionMethodArgument::GetTypeTokName, used by the CallTarget path
+  TypeTokName = 0,
+  // TryParseSignatureTypes, used by the call site replacement path
+  ParsedSignatureTypes = 1,
+  Count = 2
+};
+
+/// <summary>
+/// The signature_types of an integration target compiled against the tokens of
+/// one module. Matching walks the raw signature blob comparing element types
+/// and TypeDef/TypeRef tokens, without building type names. Names that a
+/// convention can't express unambiguously are not compiled (IsCompiled() is
+/// false) and the caller keeps comparing names.
+/// </summary>
+class SignatureMatcher {
+ private:
+  struct Pattern {
+    enum Kind : BYTE { Any, Type, GenericParam, SzArray, ByRef, GenericInst };
+
+    Kind kind = Any;
+    // Type: primitive element type matching the name, if any
+    // GenericParam: ELEMENT_TYPE_VAR or ELEMENT_TYPE_MVAR, END for both
+    BYTE element_type = ELEMENT_TYPE_END;
+    // GenericParam: the position, the max ULONG for any
+    ULONG number = 0;
+    // Type: the type name and the indexed tokens with that name
+    WSTRING name;
+    std::vector<mdToken> tokens;
+    // SzArray, ByRef: the element type
+    // GenericInst: the generic type followed by the type arguments
+    std::vector<Pattern> children;
+  };
+
+  SignatureNaming naming_ = SignatureNaming::TypeTokName;
+  bool compiled_ = false;
+  // index 0 is the return type
+  std::vector<Pattern> types_;
+  ModuleMetadata* module_metadata_ = nullptr;
+
+  bool CompileType(const WSTRING& type_name, bool top_level,
+                   Pattern* pattern) const;
+  bool CompileTypeTokName(const WSTRING& type_name, bool top_level,
+                          Pattern* pattern) const;
+  bool CompileParsedSignatureType(const WSTRING& type_name, bool top_level,
+                                  Pattern* pattern) const;
+  bool CompileNamedType(const WSTRING& type_name, BYTE element_type,
+                        Pattern* pattern) const;
+
+  bool MatchType(const Pattern& pattern, PCCOR_SIGNATURE& sig,
+                 PCCOR_SIGNATURE end) const;
+  bool MatchToken(const Pattern& pattern, PCCOR_SIGNATURE& sig,
+                  PCCOR_SIGNATURE end) const;
+  bool SkipType(PCCOR_SIGNATURE& sig, PCCOR_SIGNATURE end) const;
+
+ public:
+  SignatureMatcher() = default;
+  SignatureMatcher(ModuleMetadata* module_metadata,
+                   const std::vector<WSTRING>& signature_types,
+                   SignatureNaming naming);
+
+  bool IsCompiled() const { return compiled_; }
+
+  // Matches the return type and the parameters of a method signature, like
+  // TryParseSignatureTypes followed by a comparison of the names
+  bool MatchesMethod(const MethodSignature& signature) const;
+
+  // Matches the parameters of a parsed method signature, like comparing
+  // GetTypeTokName of each argument with signature_types[1..]
+  bool MatchesArguments(
+      const std::vector<FunctionMethodArgument>& arguments) const;
+};
+
+}  // namespace trace
+
+#endif  // DD_CLR_PROFILER_SIGNATURE_MATCHER_H_
@@ -106,4 +106,26 @@ WSTRING TokenStr(const mdToken *token) {
   return s;
 }
 
+WSTRING GuidStr(const GUID *guid) {
+  const unsigned short data2 = guid->Data2;
+  const unsigned short data3 = guid->Data3;
+  WSTRING s;
+  const auto append = [&s](unsigned long long value, int digits) {
+    for (int i = digits - 1; i >= 0; i--) {
+      s.push_back(HexMap[(value >> (i * 4)) & 0x0F]);
+    }
+  };
+
+  append(guid->Data1, 8);
+  s.push_back('-');
+  append(data2, 4);
+  s.push_back('-');
+  append(data3, 4);
+  s.push_back('-');
+  s += HexStr(guid->Data4, 2);
+  s.push_back('-');
+  s += HexStr(guid->Data4 + 2, 6);
+  return s;
+}
+
 }  // namespace trace
@@ -41,6 +41,9 @@ WSTRING HexStr(const void *data, int len);
 // Convert Token to string
 WSTRING TokenStr(const mdToken *token);
 
+// Convert GUID to string (xxxxxxxx-xxxx-xxxx-xxxx-xxxxxxxxxxxx)
+WSTRING GuidStr(const GUID *guid);
+
 template <class Container>
 bool Contains(const Container &items,
               const typename Container::value_type &value) {
@@ -37,5 +37,17 @@ namespace Datadog.Trace.RuntimeMetrics
         public const string AspNetCoreCurrentConnections = "runtime.dotnet.aspnetcore.connections.current";
         public const string AspNetCoreConnectionQueueLength = "runtime.dotnet.aspnetcore.connections.queue_length";
         public const string AspNetCoreTotalConnections = "runtime.dotnet.aspnetcore.connections.total";
+
+        public const string ProfilerRewrites = "runtime.dotnet.profiler.rewrites";
+        public const string ProfilerRejitRequests = "runtime.dotnet.profiler.rejit_requests";
+        public const string ProfilerFailures = "runtime.dotnet.profiler.failures";
+        public const string ProfilerILBytes = "runtime.dotnet.profiler.il_bytes";
+
+        public const string ProfilerCallbackCount = "runtime.dotnet.profiler.callback.count";
+        public const string ProfilerCallbackTime = "runtime.dotnet.profiler.callback.time";
+        public const string ProfilerCallbackMax = "runtime.dotnet.profiler.callback.max";
+        public const string ProfilerCallbackP50 = "runtime.dotnet.profiler.callback.p50";
+        public const string ProfilerCallbackP90 = "runtime.dotnet.profiler.callback.p90";
+        public const string ProfilerCallbackP99 = "runtime.dotnet.profiler.callback.p99";
     }
 }
@@ -0,0 +1,138 @@
+using System;
+using System.Runtime.InteropServices;
+using Datadog.Trace.Logging;
+using Datadog.Trace.Vendors.StatsdClient;
+
+namespace Datadog.Trace.RuntimeMetrics
+{
+    /// <summary>
+    /// Sends the self-metrics of the native profiler: the latency of its callbacks and of the wait
+    /// for its module lock, and the methods it rewrote. The native values are cumulative, the counts
+    /// and the time are sent as the difference since the previous refresh.
+    /// </summary>
+    internal class ProfilerMetricsListener : IRuntimeMetricsListener
+    {
+        // Count, sum, max, p50, p90 and p99 in nanoseconds
+        private const int ValuesPerOperation = 6;
+
+        private static readonly IDatadogLogger Log = DatadogLogging.GetLoggerFor<ProfilerMetricsListener>();
+
+        private static readonly bool IsWindows = string.Equals(FrameworkDescription.Instance.OSPlatform, "Windows", StringComparison.OrdinalIgnoreCase);
+
+        // Must be kept in sync with ProfilerCounter and TimedOperation in profiler_metrics.h
+        private static readonly string[] CounterNames =
+        {
+            MetricsNames.ProfilerRewrites,
+            MetricsNames.ProfilerRejitRequests,
+            MetricsNames.ProfilerFailures,
+            MetricsNames.ProfilerILBytes
+        };
+
+        private static readonly string[][] OperationTags =
+        {
+            new[] { "callback:JITCompilationStarted" },
+            new[] { "callback:ModuleLoadFinished" },
+            new[] { "callback:GetReJITParameters" },
+            new[] { "callback:JITInlining" },
+            new[] { "callback:GetAssemblyReferences" },
+            new[] { "callback:ModuleLockWait" }
+        };
+
+        private static readonly int ValueCount = CounterNames.Length + (OperationTags.Length * ValuesPerOperation);
+
+        private readonly IDogStatsd _statsd;
+        private readonly long[] _values = new long[ValueCount];
+        private readonly long[] _previousValues = new long[ValueCount];
+
+        private ProfilerMetricsListener(IDogStatsd statsd)
+        {
+            _statsd = statsd;
+        }
+
+        /// <summary>
+        /// Creates the listener if the native profiler is attached and exports the metrics
+        /// </summary>
+        /// <param name="statsd">The client the metrics are sent with</param>
+        /// <returns>The listener, or null</returns>
+        public static ProfilerMetricsListener TryCreate(IDogStatsd statsd)
+        {
+            int count;
+            try
+            {
+                count = GetProfilerMetrics(null, 0);
+            }
+            catch (Exception ex) when (ex is DllNotFoundException || ex is EntryPointNotFoundException)
+            {
+                return null;
+            }
+
+            if (count != ValueCount)
+            {
+                // 0 when the profiler is not attached, another count for a native profiler of another version
+                Log.Debug<int, int>("The native profiler exports {Count} metrics instead of {Expected}, they are not sent", count, ValueCount);
+                return null;
+            }
+
+            return new ProfilerMetricsListener(statsd);
+        }
+
+        public void Dispose()
+        {
+        }
+
+        public void Refresh()
+        {
+            if (GetProfilerMetrics(_values, _values.Length) != _values.Length)
+            {
+                return;
+            }
+
+            for (var i = 0; i < CounterNames.Length; i++)
+            {
+                _statsd.Increment(CounterNames[i], (int)(_values[i] - _previousValues[i]));
+            }
+
+            for (var i = 0; i < OperationTags.Length; i++)
+            {
+                var offset = CounterNames.Length + (i * ValuesPerOperation);
+                var tags = OperationTags[i];
+
+                _statsd.Increment(MetricsNames.ProfilerCallbackCount, (int)(_values[offset] - _previousValues[offset]), tags: tags);
+                _statsd.Gauge(MetricsNames.ProfilerCallbackTime, ToMilliseconds(_values[offset + 1] - _previousValues[offset + 1]), tags: tags);
+
+                if (_values[offset] > 0)
+                {
+                    // Since the profiler was loaded
+                    _statsd.Gauge(MetricsNames.ProfilerCallbackMax, ToMilliseconds(_values[offset + 2]), tags: tags);
+                    _statsd.Gauge(MetricsNames.ProfilerCallbackP50, ToMilliseconds(_values[offset + 3]), tags: tags);
+                    _statsd.Gauge(MetricsNames.ProfilerCallbackP90, ToMilliseconds(_values[offset + 4]), tags: tags);
+                    _statsd.Gauge(MetricsNames.ProfilerCallbackP99, ToMilliseconds(_values[offset + 5]), tags: tags);
+                }
+            }
+
+            Array.Copy(_values, _previousValues, _values.Length);
+        }
+
+        private static double ToMilliseconds(long nanoseconds) => nanoseconds / 1000000.0;
+
+        private static int GetProfilerMetrics(long[] values, int count)
+        {
+            return IsWindows ? Windows.GetProfilerMetrics(values, count) : NonWindows.GetProfilerMetrics(values, count);
+        }
+
+        // the "dll" extension is required on .NET Framework
+        // and optional on .NET Core
+        private static class Windows
+        {
+            [DllImport("Datadog.Trace.ClrProfiler.Native.dll")]
+            public static extern int GetProfilerMetrics([Out] long[] values, int count);
+        }
+
+        // assume .NET Core if not running on Windows
+        private static class NonWindows
+        {
+            [DllImport("Datadog.Trace.ClrProfiler.Native")]
+            public static extern int GetProfilerMetrics([Out] long[] values, int count);
+        }
+    }
+}
@@ -19,6 +19,8 @@ namespace Datadog.Trace.RuntimeMetrics
 
         private readonly IRuntimeMetricsListener _listener;
 
+        private readonly IRuntimeMetricsListener _profilerListener;
+
         private readonly bool _enableProcessMetrics;
 
         private readonly ConcurrentDictionary<string, int> _exceptionCounts = new ConcurrentDictionary<string, int>();
@@ -69,6 +71,15 @@ namespace Datadog.Trace.RuntimeMetrics
             {
                 Log.Warning(ex, "Unable to initialize runtime listener, some runtime metrics will be missing");
             }
+
+            try
+            {
+                _profilerListener = ProfilerMetricsListener.TryCreate(statsd);
+            }
+            catch (Exception ex)
+            {
+                Log.Warning(ex, "Unable to read the metrics of the native profiler");
+            }
         }
 
         /// <summary>
@@ -81,6 +92,7 @@ namespace Datadog.Trace.RuntimeMetrics
             AppDomain.CurrentDomain.FirstChanceException -= FirstChanceException;
             _timer.Dispose();
             _listener?.Dispose();
+            _profilerListener?.Dispose();
             _exceptionCounts.Clear();
         }
 
@@ -89,6 +101,7 @@ namespace Datadog.Trace.RuntimeMetrics
             try
             {
                 _listener?.Refresh();
+                _profilerListener?.Refresh();
 
                 if (_enableProcessMetrics)
                 {
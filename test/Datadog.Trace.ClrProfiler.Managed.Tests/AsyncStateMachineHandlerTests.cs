@@ -0,0 +1,122 @@
+using System;
+using System.Threading.Tasks;
+using Datadog.Trace.ClrProfiler.CallTarget;
+using Datadog.Trace.ClrProfiler.CallTarget.Handlers;
+using Xunit;
+
+namespace Datadog.Trace.ClrProfiler.Managed.Tests
+{
+    public class AsyncStateMachineHandlerTests
+    {
+        [Fact]
+        public async Task StateMachineCompletesTheStateOfItsStub()
+        {
+            var target = new TestTarget();
+            var state = new object();
+
+            var completion = await Task.Run(() => Stub(target, state, async () => await Task.Yield()));
+
+            Assert.True(completion.Completed);
+            Assert.Same(target, completion.Instance);
+            Assert.Same(state, completion.State);
+        }
+
+        [Fact]
+        public async Task StateMachineOfAStubWithoutStateDoesntCompleteItsParent()
+        {
+            var parentTarget = new TestTarget();
+            var parentState = new object();
+            Completion child = null;
+
+            var parent = await Task.Run(() => Stub(parentTarget, parentState, async () =>
+            {
+                // e.g. a call skipped by the sampling, or a failed BeginMethod
+                child = await Stub(new TestTarget(), null, async () => await Task.Yield());
+            }));
+
+            Assert.False(child.Completed);
+            Assert.True(parent.Completed);
+            Assert.Same(parentTarget, parent.Instance);
+            Assert.Same(parentState, parent.State);
+        }
+
+        [Fact]
+        public async Task NestedStateMachinesCompleteTheStateOfTheirOwnStub()
+        {
+            var parentTarget = new TestTarget();
+            var parentState = new object();
+            var childTarget = new TestTarget();
+            var childState = new object();
+            Completion child = null;
+
+            var parent = await Task.Run(() => Stub(parentTarget, parentState, async () =>
+            {
+                child = await Stub(childTarget, childState, async () => await Task.Yield());
+            }));
+
+            Assert.True(child.Completed);
+            Assert.Same(childTarget, child.Instance);
+            Assert.Same(childState, child.State);
+            Assert.True(parent.Completed);
+            Assert.Same(parentTarget, parent.Instance);
+            Assert.Same(parentState, parent.State);
+        }
+
+        [Fact]
+        public async Task OnlyTheFirstRunOfTheStateMachineTakesTheState()
+        {
+            var completion = await Task.Run(() =>
+            {
+                AsyncStateMachineHandler<TestIntegration, TestTarget>.Begin(new TestTarget(), new CallTargetState(null, new object()));
+                return StateMachine(async () => await Task.Yield(), stateMachineState: 0);
+            });
+
+            Assert.False(completion.Completed);
+        }
+
+        // What the rewritten async method does, a null state skips the BeginAsyncStubMethod call
+        private static Task<Completion> Stub(TestTarget target, object state, Func<Task> body)
+        {
+            if (state != null)
+            {
+                AsyncStateMachineHandler<TestIntegration, TestTarget>.Begin(target, new CallTargetState(null, state));
+            }
+
+            return StateMachine(body, AsyncStateMachineHandler<TestIntegration, TestTarget>.StateMachineNotStarted);
+        }
+
+        // What the rewritten MoveNext does, the first run executes within the stub
+        private static async Task<Completion> StateMachine(Func<Task> body, int stateMachineState)
+        {
+            AsyncStateMachineHandler<TestIntegration, TestTarget>.Enter(stateMachineState);
+            await body();
+
+            bool completed = AsyncStateMachineHandler<TestIntegration, TestTarget>.TryComplete(out TestTarget instance, out CallTargetState state);
+            return new Completion(completed, instance, state.State);
+        }
+
+        private class TestIntegration
+        {
+        }
+
+        private class TestTarget
+        {
+        }
+
+        private class Completion
+        {
+            public Completion(bool completed, TestTarget instance, object state)
+            {
+                Completed = completed;
+                Instance = instance;
+                State = state;
+            }
+
+            public bool Completed { get; }
+
+            public TestTarget Instance { get; }
+
+            public object State { get; }
+        }
+    }
+}
@@ -0,0 +1,31 @@
+#include "mock_profiler_info.h"
+
+// Exported by dllmain.cpp, the entry point of the runtime
+extern "C" HRESULT STDMETHODCALLTYPE DllGetClassObject(REFCLSID rclsid,
+                                                       REFIID riid,
+                                                       LPVOID* ppv);
+
+namespace trace {
+
+HRESULT CreateProfiler(ICorProfilerCallback4** profiler) {
+  // {846F5F1C-F9AE-4B07-969E-05C26BC060D8}
+  const GUID CLSID_CorProfiler = {
+      0x846f5f1c,
+      0xf9ae,
+      0x4b07,
+      {0x96, 0x9e, 0x5, 0xc2, 0x6b, 0xc0, 0x60, 0xd8}};
+
+  IClassFactory* class_factory = nullptr;
+  HRESULT hr = DllGetClassObject(CLSID_CorProfiler, IID_IClassFactory,
+                                 reinterpret_cast<void**>(&class_factory));
+  if (FAILED(hr)) {
+    return hr;
+  }
+
+  hr = class_factory->CreateInstance(nullptr, __uuidof(ICorProfilerCallback4),
+                                     reinterpret_cast<void**>(profiler));
+  class_factory->Release();
+  return hr;
+}
+
+}  // namespace trace
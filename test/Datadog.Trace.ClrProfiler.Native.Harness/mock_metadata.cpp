@@ -0,0 +1,1359 @@
+#include "mock_metadata.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace trace {
+
+namespace {
+
+// Tokens of the user strings defined by the profiler, above any #US heap
+// offset of a real image
+const ULONG kDefinedUserStringRid = 0x800000;
+
+struct TokenEnum {
+  std::vector<mdToken> tokens;
+  ULONG position = 0;
+};
+
+// The tokens are collected on the first call, the next calls page through
+// them, as the runtime enumerators do
+template <typename T, typename Collect>
+HRESULT NextTokens(HCORENUM* enum_handle, Collect collect, T tokens[],
+                   ULONG max, ULONG* count) {
+  auto token_enum = static_cast<TokenEnum*>(*enum_handle);
+  if (token_enum == nullptr) {
+    token_enum = new TokenEnum();
+    collect(&token_enum->tokens);
+    *enum_handle = token_enum;
+  }
+
+  ULONG copied = 0;
+  while (copied < max && token_enum->position < token_enum->tokens.size()) {
+    tokens[copied++] = token_enum->tokens[token_enum->position++];
+  }
+  if (count != nullptr) {
+    *count = copied;
+  }
+  return copied > 0 ? S_OK : S_FALSE;
+}
+
+template <typename Size>
+HRESULT CopyName(const WSTRING& name, LPWSTR buffer, ULONG buffer_size,
+                 Size* name_size) {
+  if (name_size != nullptr) {
+    *name_size = static_cast<Size>(name.size() + 1);
+  }
+  if (buffer == nullptr || buffer_size == 0) {
+    return S_OK;
+  }
+
+  const size_t copied = std::min<size_t>(name.size(), buffer_size - 1);
+  memcpy(buffer, name.c_str(), copied * sizeof(WCHAR));
+  buffer[copied] = 0;
+  return copied < name.size() ? CLDB_S_TRUNCATION : S_OK;
+}
+
+WSTRING FullName(const char* name_space, const char* name) {
+  if (name_space[0] == 0) {
+    return ToWSTRING(name);
+  }
+  return ToWSTRING(std::string(name_space) + "." + name);
+}
+
+}  // namespace
+
+MockMetadata::MockMetadata(const MetadataReader& metadata_reader)
+    : metadata_reader_(metadata_reader) {
+  const ULONG type_count = SourceRows(MetadataTable::TypeDef);
+  const ULONG method_count = SourceRows(MetadataTable::MethodDef);
+  method_owners_.assign(method_count + 1, mdTypeDefNil);
+
+  TypeDefRow type_row;
+  TypeDefRow next_type_row;
+  for (ULONG rid = 1; rid <= type_count; rid++) {
+    if (!metadata_reader_.GetTypeDef(rid, &type_row)) {
+      continue;
+    }
+    ULONG end = method_count + 1;
+    if (metadata_reader_.GetTypeDef(rid + 1, &next_type_row)) {
+      end = std::min(end, next_type_row.method_list);
+    }
+    for (ULONG method_rid = type_row.method_list; method_rid < end;
+         method_rid++) {
+      method_owners_[method_rid] = TokenFromRid(rid, mdtTypeDef);
+    }
+  }
+
+  const ULONG nested_count = SourceRows(MetadataTable::NestedClass);
+  mdTypeDef nested_class;
+  mdTypeDef enclosing_class;
+  for (ULONG rid = 1; rid <= nested_count; rid++) {
+    if (metadata_reader_.GetNestedClass(rid, &nested_class,
+                                        &enclosing_class)) {
+      enclosing_classes_[RidFromToken(nested_class)] = enclosing_class;
+    }
+  }
+}
+
+size_t MockMetadata::GetDefinedRowCount() const {
+  std::lock_guard<std::mutex> guard(lock_);
+  return type_defs_.size() + method_defs_.size() + type_refs_.size() +
+         member_refs_.size() + method_specs_.size() + type_specs_.size() +
+         signatures_.size() + user_strings_.size() + module_refs_.size() +
+         assembly_refs_.size() + field_count_ + param_count_ +
+         custom_attribute_count_;
+}
+
+void MockMetadata::BuildIndexes() {
+  if (indexed_) {
+    return;
+  }
+  indexed_ = true;
+
+  TypeRefRow type_ref_row;
+  for (ULONG rid = 1; rid <= SourceRows(MetadataTable::TypeRef); rid++) {
+    if (metadata_reader_.GetTypeRef(rid, &type_ref_row)) {
+      type_ref_index_.emplace(
+          std::make_pair(type_ref_row.resolution_scope,
+                         FullName(type_ref_row.name_space, type_ref_row.name)),
+          TokenFromRid(rid, mdtTypeRef));
+    }
+  }
+
+  MemberRefRow member_ref_row;
+  for (ULONG rid = 1; rid <= SourceRows(MetadataTable::MemberRef); rid++) {
+    if (metadata_reader_.GetMemberRef(rid, &member_ref_row)) {
+      member_ref_index_.emplace(
+          std::make_pair(
+              member_ref_row.parent,
+              std::make_pair(ToWSTRING(member_ref_row.name),
+                             std::vector<BYTE>(member_ref_row.signature.data,
+                                               member_ref_row.signature.data +
+                                                   member_ref_row.signature
+                                                       .size))),
+          TokenFromRid(rid, mdtMemberRef));
+    }
+  }
+
+  AssemblyRefRow assembly_ref_row;
+  for (ULONG rid = 1; rid <= SourceRows(MetadataTable::AssemblyRef); rid++) {
+    if (metadata_reader_.GetAssemblyRef(rid, &assembly_ref_row)) {
+      assembly_ref_index_.emplace(ToWSTRING(assembly_ref_row.name),
+                                  TokenFromRid(rid, mdtAssemblyRef));
+    }
+  }
+
+  MetadataBlob blob;
+  for (ULONG rid = 1; rid <= SourceRows(MetadataTable::TypeSpec); rid++) {
+    if (metadata_reader_.GetTypeSpec(rid, &blob)) {
+      type_spec_index_.emplace(
+          std::vector<BYTE>(blob.data, blob.data + blob.size),
+          TokenFromRid(rid, mdtTypeSpec));
+    }
+  }
+  for (ULONG rid = 1; rid <= SourceRows(MetadataTable::StandAloneSig);
+       rid++) {
+    if (metadata_reader_.GetStandAloneSig(rid, &blob)) {
+      signature_index_.emplace(
+          std::vector<BYTE>(blob.data, blob.data + blob.size),
+          TokenFromRid(rid, mdtSignature));
+    }
+  }
+}
+
+bool MockMetadata::GetTypeDef(mdTypeDef type_def,
+                              TypeDefinition* definition) const {
+  if (TypeFromToken(type_def) != mdtTypeDef) {
+    return false;
+  }
+
+  const ULONG rid = RidFromToken(type_def);
+  const ULONG source_rows = SourceRows(MetadataTable::TypeDef);
+  if (rid <= source_rows) {
+    TypeDefRow row;
+    if (!metadata_reader_.GetTypeDef(rid, &row)) {
+      return false;
+    }
+    const auto enclosing_class = enclosing_classes_.find(rid);
+    definition->name = FullName(row.name_space, row.name);
+    definition->flags = row.flags;
+    definition->extends = row.extends;
+    definition->enclosing_class = enclosing_class == enclosing_classes_.end()
+                                      ? mdTypeDefNil
+                                      : enclosing_class->second;
+    return true;
+  }
+
+  std::lock_guard<std::mutex> guard(lock_);
+  if (rid - source_rows > type_defs_.size()) {
+    return false;
+  }
+  *definition = type_defs_[rid - source_rows - 1];
+  return true;
+}
+
+bool MockMetadata::GetTypeRef(mdTypeRef type_ref,
+                              TypeReference* reference) const {
+  if (TypeFromToken(type_ref) != mdtTypeRef) {
+    return false;
+  }
+
+  const ULONG rid = RidFromToken(type_ref);
+  const ULONG source_rows = SourceRows(MetadataTable::TypeRef);
+  if (rid <= source_rows) {
+    TypeRefRow row;
+    if (!metadata_reader_.GetTypeRef(rid, &row)) {
+      return false;
+    }
+    reference->resolution_scope = row.resolution_scope;
+    reference->name = FullName(row.name_space, row.name);
+    return true;
+  }
+
+  std::lock_guard<std::mutex> guard(lock_);
+  if (rid - source_rows > type_refs_.size()) {
+    return false;
+  }
+  *reference = type_refs_[rid - source_rows - 1];
+  return true;
+}
+
+bool MockMetadata::GetMethodDef(mdMethodDef method_def,
+                                MemberView* view) const {
+  if (TypeFromToken(method_def) != mdtMethodDef) {
+    return false;
+  }
+
+  const ULONG rid = RidFromToken(method_def);
+  const ULONG source_rows = SourceRows(MetadataTable::MethodDef);
+  if (rid <= source_rows) {
+    MethodDefRow row;
+    if (!metadata_reader_.GetMethodDef(rid, &row)) {
+      return false;
+    }
+    view->parent = method_owners_[rid];
+    view->name = ToWSTRING(row.name);
+    view->flags = row.flags;
+    view->signature = row.signature.data;
+    view->signature_size = row.signature.size;
+    view->rva = row.rva;
+    view->impl_flags = row.impl_flags;
+    return true;
+  }
+
+  std::lock_guard<std::mutex> guard(lock_);
+  if (rid - source_rows > method_defs_.size()) {
+    return false;
+  }
+  const auto& definition = method_defs_[rid - source_rows - 1];
+  view->parent = definition.parent;
+  view->name = definition.name;
+  view->flags = definition.flags;
+  view->signature = definition.signature.data();
+  view->signature_size = static_cast<ULONG>(definition.signature.size());
+  view->rva = definition.rva;
+  view->impl_flags = definition.impl_flags;
+  return true;
+}
+
+bool MockMetadata::GetMemberRef(mdMemberRef member_ref,
+                                MemberView* view) const {
+  if (TypeFromToken(member_ref) != mdtMemberRef) {
+    return false;
+  }
+
+  const ULONG rid = RidFromToken(member_ref);
+  const ULONG source_rows = SourceRows(MetadataTable::MemberRef);
+  if (rid <= source_rows) {
+    MemberRefRow row;
+    if (!metadata_reader_.GetMemberRef(rid, &row)) {
+      return false;
+    }
+    view->parent = row.parent;
+    view->name = ToWSTRING(row.name);
+    view->signature = row.signature.data;
+    view->signature_size = row.signature.size;
+    return true;
+  }
+
+  std::lock_guard<std::mutex> guard(lock_);
+  if (rid - source_rows > member_refs_.size()) {
+    return false;
+  }
+  const auto& reference = member_refs_[rid - source_rows - 1];
+  view->parent = reference.parent;
+  view->name = reference.name;
+  view->signature = reference.signature.data();
+  view->signature_size = static_cast<ULONG>(reference.signature.size());
+  return true;
+}
+
+std::vector<mdMethodDef> MockMetadata::GetMethods(mdTypeDef type_def) const {
+  std::vector<mdMethodDef> methods;
+
+  const ULONG rid = RidFromToken(type_def);
+  TypeDefRow type_row;
+  if (TypeFromToken(type_def) == mdtTypeDef &&
+      metadata_reader_.GetTypeDef(rid, &type_row)) {
+    ULONG end = SourceRows(MetadataTable::MethodDef) + 1;
+    TypeDefRow next_type_row;
+    if (metadata_reader_.GetTypeDef(rid + 1, &next_type_row)) {
+      end = std::min(end, next_type_row.method_list);
+    }
+    for (ULONG method_rid = type_row.method_list; method_rid < end;
+         method_rid++) {
+      methods.push_back(TokenFromRid(method_rid, mdtMethodDef));
+    }
+  }
+
+  std::lock_guard<std::mutex> guard(lock_);
+  const ULONG source_rows = SourceRows(MetadataTable::MethodDef);
+  for (ULONG i = 0; i < method_defs_.size(); i++) {
+    if (method_defs_[i].parent == type_def) {
+      methods.push_back(TokenFromRid(source_rows + i + 1, mdtMethodDef));
+    }
+  }
+  return methods;
+}
+
+bool MockMetadata::GetTypeName(mdToken type, WSTRING* name) const {
+  switch (TypeFromToken(type)) {
+    case mdtTypeDef: {
+      TypeDefinition definition;
+      if (!GetTypeDef(type, &definition)) {
+        return false;
+      }
+      *name = definition.name;
+      return true;
+    }
+    case mdtTypeRef: {
+      TypeReference reference;
+      if (!GetTypeRef(type, &reference)) {
+        return false;
+      }
+      *name = reference.name;
+      return true;
+    }
+    default:
+      return false;
+  }
+}
+
+HRESULT STDMETHODCALLTYPE MockMetadata::QueryInterface(REFIID riid,
+                                                       void** ppvObject) {
+  if (riid == IID_IUnknown || riid == IID_IMetaDataImport ||
+      riid == IID_IMetaDataImport2) {
+    *ppvObject = static_cast<IMetaDataImport2*>(this);
+  } else if (riid == IID_IMetaDataEmit || riid == IID_IMetaDataEmit2) {
+    *ppvObject = static_cast<IMetaDataEmit2*>(this);
+  } else if (riid == IID_IMetaDataAssemblyImport) {
+    *ppvObject = static_cast<IMetaDataAssemblyImport*>(this);
+  } else if (riid == IID_IMetaDataAssemblyEmit) {
+    *ppvObject = static_cast<IMetaDataAssemblyEmit*>(this);
+  } else {
+    *ppvObject = nullptr;
+    return E_NOINTERFACE;
+  }
+
+  AddRef();
+  return S_OK;
+}
+
+ULONG STDMETHODCALLTYPE MockMetadata::AddRef() {
+  return std::atomic_fetch_add(&ref_count_, 1UL) + 1;
+}
+
+ULONG STDMETHODCALLTYPE MockMetadata::Release() {
+  const ULONG count = std::atomic_fetch_sub(&ref_count_, 1UL) - 1;
+  if (count == 0) {
+    delete this;
+  }
+  return count;
+}
+
+//
+// IMetaDataImport
+//
+
+void STDMETHODCALLTYPE MockMetadata::CloseEnum(HCORENUM hEnum) {
+  delete static_cast<TokenEnum*>(hEnum);
+}
+
+HRESULT STDMETHODCALLTYPE MockMetadata::CountEnum(HCORENUM hEnum,
+                                                  ULONG* pulCount) {
+  *pulCount = hEnum == nullptr
+                  ? 0
+                  : static_cast<ULONG>(
+                        static_cast<TokenEnum*>(hEnum)->tokens.size());
+  return S_OK;
+}
+
+HRESULT STDMETHODCALLTYPE MockMetadata::ResetEnum(HCORENUM hEnum,
+                                                  ULONG ulPos) {
+  if (hEnum != nullptr) {
+    static_cast<TokenEnum*>(hEnum)->position = ulPos;
+  }
+  return S_OK;
+}
+
+HRESULT STDMETHODCALLTYPE MockMetadata::EnumTypeDefs(HCORENUM* phEnum,
+                                                     mdTypeDef rTypeDefs[],
+                                                     ULONG cMax,
+                                                     ULONG* pcTypeDefs) {
+  return NextTokens(
+      phEnum,
+      [this](std::vector<mdToken>* tokens) {
+        // The first row is the <Module> type, the runtime doesn't enumerate it
+        const ULONG source_rows = SourceRows(MetadataTable::TypeDef);
+        for (ULONG rid = 2; rid <= source_rows; rid++) {
+          tokens->push_back(TokenFromRid(rid, mdtTypeDef));
+        }
+        std::lock_guard<std::mutex> guard(lock_);
+        for (ULONG i = 0; i < type_defs_.size(); i++) {
+          tokens->push_back(TokenFromRid(source_rows + i + 1, mdtTypeDef));
+        }
+      },
+      rTypeDefs, cMax, pcTypeDefs);
+}
+
+HRESULT STDMETHODCALLTYPE MockMetadata::EnumTypeRefs(HCORENUM* phEnum,
+                                                     mdTypeRef rTypeRefs[],
+                                                     ULONG cMax,
+                                                     ULONG* pcTypeRefs) {
+  return NextTokens(
+      phEnum,
+      [this](std::vector<mdToken>* tokens) {
+        const ULONG source_rows = SourceRows(MetadataTable::TypeRef);
+        std::lock_guard<std::mutex> guard(lock_);
+        const ULONG rows = source_rows + static_cast<ULONG>(type_refs_.size());
+        for (ULONG rid = 1; rid <= rows; rid++) {
+          tokens->push_back(TokenFromRid(rid, mdtTypeRef));
+        }
+      },
+      rTypeRefs, cMax, pcTypeRefs);
+}
+
+HRESULT STDMETHODCALLTYPE MockMetadata::FindTypeDefByName(
+    LPCWSTR szTypeDef, mdToken tkEnclosingClass, mdTypeDef* ptd) {
+  const WSTRING name(szTypeDef);
+  const mdTypeDef enclosing_class =
+      TypeFromToken(tkEnclosingClass) == mdtTypeDef &&
+              !IsNilToken(tkEnclosingClass)
+          ? tkEnclosingClass
+          : mdTypeDefNil;
+
+  if (enclosing_class == mdTypeDefNil) {
+    *ptd = metadata_reader_.FindTypeDefByName(ToString(name));
+    if (*ptd != mdTypeDefNil) {
+      return S_OK;
+    }
+  } else {
+    TypeDefinition definition;
+    for (const auto& nested : enclosing_classes_) {
+      const mdTypeDef type_def = TokenFromRid(nested.first, mdtTypeDef);
+      if (nested.second == enclosing_class &&
+          GetTypeDef(type_def, &definition) && definition.name == name) {
+        *ptd = type_def;
+        return S_OK;
+      }
+    }
+  }
+
+  const ULONG source_rows = SourceRows(MetadataTable::TypeDef);
+  std::lock_guard<std::mutex> guard(lock_);
+  for (ULONG i = 0; i < type_defs_.size(); i++) {
+    if (type_defs_[i].enclosing_class == enclosing_class &&
+        type_defs_[i].name == name) {
+      *ptd = TokenFromRid(source_rows + i + 1, mdtTypeDef);
+      return S_OK;
+    }
+  }
+
+  *ptd = mdTypeDefNil;
+  return CLDB_E_RECORD_NOTFOUND;
+}
+
+HRESULT STDMETHODCALLTYPE MockMetadata::GetScopeProps(LPWSTR szName,
+                                                      ULONG cchName,
+                                                      ULONG* pchName,
+                                                      GUID* pmvid) {
+  if (pmvid != nullptr && !metadata_reader_.GetModuleVersionId(pmvid)) {
+    return CLDB_E_RECORD_NOTFOUND;
+  }
+  return CopyName(ToWSTRING(metadata_reader_.GetModuleName()), szName,
+                  cchName, pchName);
+}
+
+HRESULT STDMETHODCALLTYPE MockMetadata::GetModuleFromScope(mdModule* pmd) {
+  *pmd = TokenFromRid(1, mdtModule);
+  return S_OK;
+}
+
+HRESULT STDMETHODCALLTYPE MockMetadata::GetTypeDefProps(
+    mdTypeDef td, LPWSTR szTypeDef, ULONG cchTypeDef, ULONG* pchTypeDef,
+    DWORD* pdwTypeDefFlags, mdToken* ptkExtends) {
+  TypeDefinition definition;
+  if (!GetTypeDef(td, &definition)) {
+    return CLDB_E_RECORD_NOTFOUND;
+  }
+  if (pdwTypeDefFlags != nullptr) {
+    *pdwTypeDefFlags = definition.flags;
+  }
+  if (ptkExtends != nullptr) {
+    *ptkExtends = definition.extends;
+  }
+  return CopyName(definition.name, szTypeDef, cchTypeDef, pchTypeDef);
+}
+
+HRESULT STDMETHODCALLTYPE MockMetadata::GetTypeRefProps(
+    mdTypeRef tr, mdToken* ptkResolutionScope, LPWSTR szName, ULONG cchName,
+    ULONG* pchName) {
+  TypeReference reference;
+  if (!GetTypeRef(tr, &reference)) {
+    return CLDB_E_RECORD_NOTFOUND;
+  }
+  if (ptkResolutionScope != nullptr) {
+    *ptkResolutionScope = reference.resolution_scope;
+  }
+  return CopyName(reference.name, szName, cchName, pchName);
+}
+
+HRESULT STDMETHODCALLTYPE MockMetadata::EnumMethods(HCORENUM* phEnum,
+                                                    mdTypeDef cl,
+                                                    mdMethodDef rMethods[],
+                                                    ULONG cMax,
+                                                    ULONG* pcTokens) {
+  return NextTokens(
+      phEnum,
+      [this, cl](std::vector<mdToken>* tokens) { *tokens = GetMethods(cl); },
+      rMethods, cMax, pcTokens);
+}
+
+HRESULT STDMETHODCALLTYPE MockMetadata::EnumMethodsWithName(
+    HCORENUM* phEnum, mdTypeDef cl, LPCWSTR szName, mdMethodDef rMethods[],
+    ULONG cMax, ULONG* pcTokens) {
+  const WSTRING name(szName);
+  return NextTokens(
+      phEnum,
+      [this, cl, &name](std::vector<mdToken>* tokens) {
+        MemberView view;
+        for (const auto method_def : GetMethods(cl)) {
+          if (GetMethodDef(method_def, &view) && view.name == name) {
+            tokens->push_back(method_def);
+          }
+        }
+      },
+      rMethods, cMax, pcTokens);
+}
+
+HRESULT STDMETHODCALLTYPE MockMetadata::EnumMemberRefs(
+    HCORENUM* phEnum, mdToken tkParent, mdMemberRef rMemberRefs[], ULONG cMax,
+    ULONG* pcTokens) {
+  return NextTokens(
+      phEnum,
+      [this, tkParent](std::vector<mdToken>* tokens) {
+        const ULONG source_rows = SourceRows(MetadataTable::MemberRef);
+        MemberRefRow row;
+        for (ULONG rid = 1; rid <= source_rows; rid++) {
+          if (metadata_reader_.GetMemberRef(rid, &row) &&
+              row.parent == tkParent) {
+            tokens->push_back(TokenFromRid(rid, mdtMemberRef));
+          }
+        }
+        std::lock_guard<std::mutex> guard(lock_);
+        for (ULONG i = 0; i < member_refs_.size(); i++) {
+          if (member_refs_[i].parent == tkParent) {
+            tokens->push_back(TokenFromRid(source_rows + i + 1, mdtMemberRef));
+          }
+        }
+      },
+      rMemberRefs, cMax, pcTokens);
+}
+
+HRESULT STDMETHODCALLTYPE MockMetadata::FindTypeRef(mdToken tkResolutionScope,
+                                                    LPCWSTR szName,
+                                                    mdTypeRef* ptr) {
+  std::lock_guard<std::mutex> guard(lock_);
+  BuildIndexes();
+  const auto search =
+      type_ref_index_.find(std::make_pair(tkResolutionScope, WSTRING(szName)));
+  if (search == type_ref_index_.end()) {
+    *ptr = mdTypeRefNil;
+    return CLDB_E_RECORD_NOTFOUND;
+  }
+  *ptr = search->second;
+  return S_OK;
+}
+
+HRESULT STDMETHODCALLTYPE MockMetadata::GetMethodProps(
+    mdMethodDef mb, mdTypeDef* pClass, LPWSTR szMethod, ULONG cchMethod,
+    ULONG* pchMethod, DWORD* pdwAttr, PCCOR_SIGNATURE* ppvSigBlob,
+    ULONG* pcbSigBlob, ULONG* pulCodeRVA, DWORD* pdwImplFlags) {
+  MemberView view;
+  if (!GetMethodDef(mb, &view)) {
+    return CLDB_E_RECORD_NOTFOUND;
+  }
+  if (pClass != nullptr) {
+    *pClass = view.parent;
+  }
+  if (pdwAttr != nullptr) {
+    *pdwAttr = view.flags;
+  }
+  if (ppvSigBlob != nullptr) {
+    *ppvSigBlob = view.signature;
+  }
+  if (pcbSigBlob != nullptr) {
+    *pcbSigBlob = view.signature_size;
+  }
+  if (pulCodeRVA != nullptr) {
+    *pulCodeRVA = view.rva;
+  }
+  if (pdwImplFlags != nullptr) {
+    *pdwImplFlags = view.impl_flags;
+  }
+  return CopyName(view.name, szMethod, cchMethod, pchMethod);
+}
+
+HRESULT STDMETHODCALLTYPE MockMetadata::GetMemberRefProps(
+    mdMemberRef mr, mdToken* ptk, LPWSTR szMember, ULONG cchMember,
+    ULONG* pchMember, PCCOR_SIGNATURE* ppvSigBlob, ULONG* pbSig) {
+  MemberView view;
+  if (!GetMemberRef(mr, &view)) {
+    return CLDB_E_RECORD_NOTFOUND;
+  }
+  if (ptk != nullptr) {
+    *ptk = view.parent;
+  }
+  if (ppvSigBlob != nullptr) {
+    *ppvSigBlob = view.signature;
+  }
+  if (pbSig != nullptr) {
+    *pbSig = view.signature_size;
+  }
+  return CopyName(view.name, szMember, cchMember, pchMember);
+}
+
+HRESULT STDMETHODCALLTYPE MockMetadata::GetMemberProps(
+    mdToken mb, mdTypeDef* pClass, LPWSTR szMember, ULONG cchMember,
+    ULONG* pchMember, DWORD* pdwAttr, PCCOR_SIGNATURE* ppvSigBlob,
+    ULONG* pcbSigBlob, ULONG* pulCodeRVA, DWORD* pdwImplFlags,
+    DWORD* pdwCPlusTypeFlag, UVCP_CONSTANT* ppValue, ULONG* pcchValue) {
+  // Methods have no constant value
+  if (pdwCPlusTypeFlag != nullptr) {
+    *pdwCPlusTypeFlag = ELEMENT_TYPE_VOID;
+  }
+  if (ppValue != nullptr) {
+    *ppValue = nullptr;
+  }
+  if (pcchValue != nullptr) {
+    *pcchValue = 0;
+  }
+  return GetMethodProps(mb, pClass, szMember, cchMember, pchMember, pdwAttr,
+                        ppvSigBlob, pcbSigBlob, pulCodeRVA, pdwImplFlags);
+}
+
+HRESULT STDMETHODCALLTYPE MockMetadata::GetFieldProps(
+    mdFieldDef mb, mdTypeDef* pClass, LPWSTR szField, ULONG cchField,
+    ULONG* pchField, DWORD* pdwAttr, PCCOR_SIGNATURE* ppvSigBlob,
+    ULONG* pcbSigBlob, DWORD* pdwCPlusTypeFlag, UVCP_CONSTANT* ppValue,
+    ULONG* pcchValue) {
+  // Only the fields of the image are read, the profiler doesn't read back the
+  // ones it defines
+  FieldRow field_row;
+  if (TypeFromToken(mb) != mdtFieldDef ||
+      !metadata_reader_.GetField(RidFromToken(mb), &field_row)) {
+    return CLDB_E_RECORD_NOTFOUND;
+  }
+  if (pClass != nullptr) {
+    // The owner is the last type whose field list starts before the field
+    *pClass = mdTypeDefNil;
+    TypeDefRow type_row;
+    for (ULONG rid = 1; metadata_reader_.GetTypeDef(rid, &type_row); rid++) {
+      if (type_row.field_list > RidFromToken(mb)) {
+        break;
+      }
+      *pClass = TokenFromRid(rid, mdtTypeDef);
+    }
+  }
+  if (pdwAttr != nullptr) {
+    *pdwAttr = field_row.flags;
+  }
+  if (ppvSigBlob != nullptr) {
+    *ppvSigBlob = field_row.signature.data;
+  }
+  if (pcbSigBlob != nullptr) {
+    *pcbSigBlob = field_row.signature.size;
+  }
+  // Constant values are not read
+  if (pdwCPlusTypeFlag != nullptr) {
+    *pdwCPlusTypeFlag = ELEMENT_TYPE_VOID;
+  }
+  if (ppValue != nullptr) {
+    *ppValue = nullptr;
+  }
+  if (pcchValue != nullptr) {
+    *pcchValue = 0;
+  }
+  return CopyName(ToWSTRING(field_row.name), szField, cchField, pchField);
+}
+
+HRESULT STDMETHODCALLTYPE MockMetadata::GetRVA(mdToken tk, ULONG* pulCodeRVA,
+                                               DWORD* pdwImplFlags) {
+  MemberView view;
+  if (!GetMethodDef(tk, &view)) {
+    return CLDB_E_RECORD_NOTFOUND;
+  }
+  if (pulCodeRVA != nullptr) {
+    *pulCodeRVA = view.rva;
+  }
+  if (pdwImplFlags != nullptr) {
+    *pdwImplFlags = view.impl_flags;
+  }
+  return S_OK;
+}
+
+HRESULT STDMETHODCALLTYPE MockMetadata::GetSigFromToken(
+    mdSignature mdSig, PCCOR_SIGNATURE* ppvSig, ULONG* pcbSig) {
+  const ULONG rid = RidFromToken(mdSig);
+  const ULONG source_rows = SourceRows(MetadataTable::StandAloneSig);
+  if (TypeFromToken(mdSig) != mdtSignature || rid == 0) {
+    return CLDB_E_RECORD_NOTFOUND;
+  }
+
+  if (rid <= source_rows) {
+    MetadataBlob blob;
+    if (!metadata_reader_.GetStandAloneSig(rid, &blob)) {
+      return CLDB_E_RECORD_NOTFOUND;
+    }
+    *ppvSig = blob.data;
+    *pcbSig = blob.size;
+    return S_OK;
+  }
+
+  std::lock_guard<std::mutex> guard(lock_);
+  if (rid - source_rows > signatures_.size()) {
+    return CLDB_E_RECORD_NOTFOUND;
+  }
+  const auto& signature = signatures_[rid - source_rows - 1];
+  *ppvSig = signature.data();
+  *pcbSig = static_cast<ULONG>(signature.size());
+  return S_OK;
+}
+
+HRESULT STDMETHODCALLTYPE MockMetadata::GetModuleRefProps(mdModuleRef mur,
+                                                          LPWSTR szName,
+                                                          ULONG cchName,
+                                                          ULONG* pchName) {
+  const ULONG rid = RidFromToken(mur);
+  const ULONG source_rows = SourceRows(MetadataTable::ModuleRef);
+  if (TypeFromToken(mur) != mdtModuleRef || rid == 0) {
+    return CLDB_E_RECORD_NOTFOUND;
+  }
+
+  if (rid <= source_rows) {
+    const char* name = "";
+    if (!metadata_reader_.GetModuleRef(rid, &name)) {
+      return CLDB_E_RECORD_NOTFOUND;
+    }
+    return CopyName(ToWSTRING(name), szName, cchName, pchName);
+  }
+
+  std::lock_guard<std::mutex> guard(lock_);
+  if (rid - source_rows > module_refs_.size()) {
+    return CLDB_E_RECORD_NOTFOUND;
+  }
+  return CopyName(module_refs_[rid - source_rows - 1], szName, cchName,
+                  pchName);
+}
+
+HRESULT STDMETHODCALLTYPE MockMetadata::EnumModuleRefs(
+    HCORENUM* phEnum, mdModuleRef rModuleRefs[], ULONG cmax,
+    ULONG* pcModuleRefs) {
+  return NextTokens(
+      phEnum,
+      [this](std::vector<mdToken>* tokens) {
+        const ULONG source_rows = SourceRows(MetadataTable::ModuleRef);
+        std::lock_guard<std::mutex> guard(lock_);
+        const ULONG rows =
+            source_rows + static_cast<ULONG>(module_refs_.size());
+        for (ULONG rid = 1; rid <= rows; rid++) {
+          tokens->push_back(TokenFromRid(rid, mdtModuleRef));
+        }
+      },
+      rModuleRefs, cmax, pcModuleRefs);
+}
+
+HRESULT STDMETHODCALLTYPE MockMetadata::GetTypeSpecFromToken(
+    mdTypeSpec typespec, PCCOR_SIGNATURE* ppvSig, ULONG* pcbSig) {
+  const ULONG rid = RidFromToken(typespec);
+  const ULONG source_rows = SourceRows(MetadataTable::TypeSpec);
+  if (TypeFromToken(typespec) != mdtTypeSpec || rid == 0) {
+    return CLDB_E_RECORD_NOTFOUND;
+  }
+
+  if (rid <= source_rows) {
+    MetadataBlob blob;
+    if (!metadata_reader_.GetTypeSpec(rid, &blob)) {
+      return CLDB_E_RECORD_NOTFOUND;
+    }
+    *ppvSig = blob.data;
+    *pcbSig = blob.size;
+    return S_OK;
+  }
+
+  std::lock_guard<std::mutex> guard(lock_);
+  if (rid - source_rows > type_specs_.size()) {
+    return CLDB_E_RECORD_NOTFOUND;
+  }
+  const auto& signature = type_specs_[rid - source_rows - 1];
+  *ppvSig = signature.data();
+  *pcbSig = static_cast<ULONG>(signature.size());
+  return S_OK;
+}
+
+HRESULT STDMETHODCALLTYPE MockMetadata::GetUserString(mdString stk,
+                                                      LPWSTR szString,
+                                                      ULONG cchString,
+                                                      ULONG* pchString) {
+  const ULONG rid = RidFromToken(stk);
+  if (TypeFromToken(stk) != mdtString) {
+    return CLDB_E_RECORD_NOTFOUND;
+  }
+
+  WSTRING value;
+  if (rid < kDefinedUserStringRid) {
+    MetadataBlob blob;
+    if (!metadata_reader_.GetUserString(rid, &blob)) {
+      return CLDB_E_RECORD_NOTFOUND;
+    }
+    value.resize(blob.size / sizeof(WCHAR));
+    memcpy(&value[0], blob.data, value.size() * sizeof(WCHAR));
+  } else {
+    std::lock_guard<std::mutex> guard(lock_);
+    if (rid - kDefinedUserStringRid >= user_strings_.size()) {
+      return CLDB_E_RECORD_NOTFOUND;
+    }
+    value = user_strings_[rid - kDefinedUserStringRid];
+  }
+
+  // The length of a user string doesn't count a null terminator
+  const HRESULT hr = CopyName(value, szString, cchString, pchString);
+  if (pchString != nullptr) {
+    *pchString = static_cast<ULONG>(value.size());
+  }
+  return hr;
+}
+
+HRESULT STDMETHODCALLTYPE MockMetadata::GetCustomAttributeByName(
+    mdToken tkObj, LPCWSTR szName, const void** ppData, ULONG* pcbData) {
+  const WSTRING name(szName);
+  const ULONG count = SourceRows(MetadataTable::CustomAttribute);
+  CustomAttributeRow row;
+  WSTRING type_name;
+  for (ULONG rid = 1; rid <= count; rid++) {
+    if (!metadata_reader_.GetCustomAttribute(rid, &row) ||
+        row.parent != tkObj) {
+      continue;
+    }
+
+    // The attribute type is the parent of its constructor
+    MemberView constructor;
+    const bool found_constructor =
+        TypeFromToken(row.type) == mdtMethodDef
+            ? GetMethodDef(row.type, &constructor)
+            : GetMemberRef(row.type, &constructor);
+    if (found_constructor && GetTypeName(constructor.parent, &type_name) &&
+        type_name == name) {
+      if (ppData != nullptr) {
+        *ppData = row.value.data;
+      }
+      if (pcbData != nullptr) {
+        *pcbData = row.value.size;
+      }
+      return S_OK;
+    }
+  }
+  return S_FALSE;
+}
+
+BOOL STDMETHODCALLTYPE MockMetadata::IsValidToken(mdToken tk) {
+  const ULONG rid = RidFromToken(tk);
+  switch (TypeFromToken(tk)) {
+    case mdtTypeDef: {
+      TypeDefinition definition;
+      return GetTypeDef(tk, &definition);
+    }
+    case mdtTypeRef: {
+      TypeReference reference;
+      return GetTypeRef(tk, &reference);
+    }
+    case mdtMethodDef: {
+      MemberView view;
+      return GetMethodDef(tk, &view);
+    }
+    case mdtMemberRef: {
+      MemberView view;
+      return GetMemberRef(tk, &view);
+    }
+    default:
+      return rid != 0;
+  }
+}
+
+HRESULT STDMETHODCALLTYPE MockMetadata::GetNestedClassProps(
+    mdTypeDef tdNestedClass, mdTypeDef* ptdEnclosingClass) {
+  TypeDefinition definition;
+  if (!GetTypeDef(tdNestedClass, &definition) ||
+      definition.enclosing_class == mdTypeDefNil) {
+    return CLDB_E_RECORD_NOTFOUND;
+  }
+  *ptdEnclosingClass = definition.enclosing_class;
+  return S_OK;
+}
+
+//
+// IMetaDataImport2
+//
+
+HRESULT STDMETHODCALLTYPE MockMetadata::GetMethodSpecProps(
+    mdMethodSpec mi, mdToken* tkParent, PCCOR_SIGNATURE* ppvSigBlob,
+    ULONG* pcbSigBlob) {
+  const ULONG rid = RidFromToken(mi);
+  const ULONG source_rows = SourceRows(MetadataTable::MethodSpec);
+  if (TypeFromToken(mi) != mdtMethodSpec || rid == 0) {
+    return CLDB_E_RECORD_NOTFOUND;
+  }
+
+  mdToken parent;
+  PCCOR_SIGNATURE signature;
+  ULONG signature_size;
+  if (rid <= source_rows) {
+    MethodSpecRow row;
+    if (!metadata_reader_.GetMethodSpec(rid, &row)) {
+      return CLDB_E_RECORD_NOTFOUND;
+    }
+    parent = row.method;
+    signature = row.instantiation.data;
+    signature_size = row.instantiation.size;
+  } else {
+    std::lock_guard<std::mutex> guard(lock_);
+    if (rid - source_rows > method_specs_.size()) {
+      return CLDB_E_RECORD_NOTFOUND;
+    }
+    const auto& specification = method_specs_[rid - source_rows - 1];
+    parent = specification.parent;
+    signature = specification.signature.data();
+    signature_size = static_cast<ULONG>(specification.signature.size());
+  }
+
+  if (tkParent != nullptr) {
+    *tkParent = parent;
+  }
+  if (ppvSigBlob != nullptr) {
+    *ppvSigBlob = signature;
+  }
+  if (pcbSigBlob != nullptr) {
+    *pcbSigBlob = signature_size;
+  }
+  return S_OK;
+}
+
+//
+// IMetaDataEmit
+//
+
+HRESULT STDMETHODCALLTYPE MockMetadata::DefineTypeDef(LPCWSTR szTypeDef,
+                                                      DWORD dwTypeDefFlags,
+                                                      mdToken tkExtends,
+                                                      mdToken rtkImplements[],
+                                                      mdTypeDef* ptd) {
+  return DefineNestedType(szTypeDef, dwTypeDefFlags, tkExtends, rtkImplements,
+                          mdTypeDefNil, ptd);
+}
+
+HRESULT STDMETHODCALLTYPE MockMetadata::DefineNestedType(
+    LPCWSTR szTypeDef, DWORD dwTypeDefFlags, mdToken tkExtends,
+    mdToken rtkImplements[], mdTypeDef tdEncloser, mdTypeDef* ptd) {
+  std::lock_guard<std::mutex> guard(lock_);
+  type_defs_.push_back(
+      {WSTRING(szTypeDef), dwTypeDefFlags, tkExtends, tdEncloser});
+  *ptd = TokenFromRid(SourceRows(MetadataTable::TypeDef) +
+                          static_cast<ULONG>(type_defs_.size()),
+                      mdtTypeDef);
+  return S_OK;
+}
+
+HRESULT STDMETHODCALLTYPE MockMetadata::DefineMethod(
+    mdTypeDef td, LPCWSTR szName, DWORD dwMethodFlags,
+    PCCOR_SIGNATURE pvSigBlob, ULONG cbSigBlob, ULONG ulCodeRVA,
+    DWORD dwImplFlags, mdMethodDef* pmd) {
+  std::lock_guard<std::mutex> guard(lock_);
+  method_defs_.push_back(
+      {td, WSTRING(szName), dwMethodFlags,
+       std::vector<BYTE>(pvSigBlob, pvSigBlob + cbSigBlob), ulCodeRVA,
+       dwImplFlags});
+  *pmd = TokenFromRid(SourceRows(MetadataTable::MethodDef) +
+                          static_cast<ULONG>(method_defs_.size()),
+                      mdtMethodDef);
+  return S_OK;
+}
+
+HRESULT STDMETHODCALLTYPE MockMetadata::DefineTypeRefByName(
+    mdToken tkResolutionScope, LPCWSTR szName, mdTypeRef* ptr) {
+  std::lock_guard<std::mutex> guard(lock_);
+  BuildIndexes();
+  const auto key = std::make_pair(tkResolutionScope, WSTRING(szName));
+  const auto search = type_ref_index_.find(key);
+  if (search != type_ref_index_.end()) {
+    *ptr = search->second;
+    return S_OK;
+  }
+
+  type_refs_.push_back({tkResolutionScope, key.second});
+  *ptr = TokenFromRid(SourceRows(MetadataTable::TypeRef) +
+                          static_cast<ULONG>(type_refs_.size()),
+                      mdtTypeRef);
+  type_ref_index_.emplace(key, *ptr);
+  return S_OK;
+}
+
+HRESULT STDMETHODCALLTYPE MockMetadata::DefineMemberRef(
+    mdToken tkImport, LPCWSTR szName, PCCOR_SIGNATURE pvSigBlob,
+    ULONG cbSigBlob, mdMemberRef* pmr) {
+  std::lock_guard<std::mutex> guard(lock_);
+  BuildIndexes();
+  const auto key = std::make_pair(
+      tkImport, std::make_pair(WSTRING(szName),
+                               std::vector<BYTE>(pvSigBlob,
+                                                 pvSigBlob + cbSigBlob)));
+  const auto search = member_ref_index_.find(key);
+  if (search != member_ref_index_.end()) {
+    *pmr = search->second;
+    return S_OK;
+  }
+
+  member_refs_.push_back({tkImport, key.second.first, key.second.second});
+  *pmr = TokenFromRid(SourceRows(MetadataTable::MemberRef) +
+                          static_cast<ULONG>(member_refs_.size()),
+                      mdtMemberRef);
+  member_ref_index_.emplace(key, *pmr);
+  return S_OK;
+}
+
+HRESULT STDMETHODCALLTYPE MockMetadata::GetTokenFromSig(PCCOR_SIGNATURE pvSig,
+                                                        ULONG cbSig,
+                                                        mdSignature* pmsig) {
+  std::lock_guard<std::mutex> guard(lock_);
+  BuildIndexes();
+  std::vector<BYTE> signature(pvSig, pvSig + cbSig);
+  const auto search = signature_index_.find(signature);
+  if (search != signature_index_.end()) {
+    *pmsig = search->second;
+    return S_OK;
+  }
+
+  signatures_.push_back(signature);
+  *pmsig = TokenFromRid(SourceRows(MetadataTable::StandAloneSig) +
+                            static_cast<ULONG>(signatures_.size()),
+                        mdtSignature);
+  signature_index_.emplace(std::move(signature), *pmsig);
+  return S_OK;
+}
+
+HRESULT STDMETHODCALLTYPE MockMetadata::DefineModuleRef(LPCWSTR szName,
+                                                        mdModuleRef* pmur) {
+  const WSTRING name(szName);
+  const ULONG source_rows = SourceRows(MetadataTable::ModuleRef);
+  const char* source_name = "";
+  for (ULONG rid = 1; rid <= source_rows; rid++) {
+    if (metadata_reader_.GetModuleRef(rid, &source_name) &&
+        ToWSTRING(source_name) == name) {
+      *pmur = TokenFromRid(rid, mdtModuleRef);
+      return S_OK;
+    }
+  }
+
+  std::lock_guard<std::mutex> guard(lock_);
+  const auto search = std::find(module_refs_.begin(), module_refs_.end(), name);
+  if (search == module_refs_.end()) {
+    module_refs_.push_back(name);
+  }
+  *pmur = TokenFromRid(
+      source_rows +
+          static_cast<ULONG>(std::distance(module_refs_.begin(),
+                                           std::find(module_refs_.begin(),
+                                                     module_refs_.end(),
+                                                     name))) +
+          1,
+      mdtModuleRef);
+  return S_OK;
+}
+
+HRESULT STDMETHODCALLTYPE MockMetadata::GetTokenFromTypeSpec(
+    PCCOR_SIGNATURE pvSig, ULONG cbSig, mdTypeSpec* ptypespec) {
+  std::lock_guard<std::mutex> guard(lock_);
+  BuildIndexes();
+  std::vector<BYTE> signature(pvSig, pvSig + cbSig);
+  const auto search = type_spec_index_.find(signature);
+  if (search != type_spec_index_.end()) {
+    *ptypespec = search->second;
+    return S_OK;
+  }
+
+  type_specs_.push_back(signature);
+  *ptypespec = TokenFromRid(SourceRows(MetadataTable::TypeSpec) +
+                                static_cast<ULONG>(type_specs_.size()),
+                            mdtTypeSpec);
+  type_spec_index_.emplace(std::move(signature), *ptypespec);
+  return S_OK;
+}
+
+HRESULT STDMETHODCALLTYPE MockMetadata::DefineUserString(LPCWSTR szString,
+                                                         ULONG cchString,
+                                                         mdString* pstk) {
+  std::lock_guard<std::mutex> guard(lock_);
+  user_strings_.push_back(WSTRING(szString, cchString));
+  *pstk = TokenFromRid(
+      kDefinedUserStringRid + static_cast<ULONG>(user_strings_.size()) - 1,
+      mdtString);
+  return S_OK;
+}
+
+HRESULT STDMETHODCALLTYPE MockMetadata::SetMethodProps(mdMethodDef md,
+                                                       DWORD dwMethodFlags,
+                                                       ULONG ulCodeRVA,
+                                                       DWORD dwImplFlags) {
+  return S_OK;
+}
+
+HRESULT STDMETHODCALLTYPE MockMetadata::DefinePinvokeMap(
+    mdToken tk, DWORD dwMappingFlags, LPCWSTR szImportName,
+    mdModuleRef mrImportDLL) {
+  return S_OK;
+}
+
+HRESULT STDMETHODCALLTYPE MockMetadata::DefineCustomAttribute(
+    mdToken tkOwner, mdToken tkCtor, void const* pCustomAttribute,
+    ULONG cbCustomAttribute, mdCustomAttribute* pcv) {
+  std::lock_guard<std::mutex> guard(lock_);
+  *pcv = TokenFromRid(
+      SourceRows(MetadataTable::CustomAttribute) + ++custom_attribute_count_,
+      mdtCustomAttribute);
+  return S_OK;
+}
+
+HRESULT STDMETHODCALLTYPE MockMetadata::DefineField(
+    mdTypeDef td, LPCWSTR szName, DWORD dwFieldFlags,
+    PCCOR_SIGNATURE pvSigBlob, ULONG cbSigBlob, DWORD dwCPlusTypeFlag,
+    void const* pValue, ULONG cchValue, mdFieldDef* pmd) {
+  std::lock_guard<std::mutex> guard(lock_);
+  *pmd = TokenFromRid(SourceRows(MetadataTable::Field) + ++field_count_,
+                      mdtFieldDef);
+  return S_OK;
+}
+
+HRESULT STDMETHODCALLTYPE MockMetadata::DefineParam(
+    mdMethodDef md, ULONG ulParamSeq, LPCWSTR szName, DWORD dwParamFlags,
+    DWORD dwCPlusTypeFlag, void const* pValue, ULONG cchValue,
+    mdParamDef* ppd) {
+  std::lock_guard<std::mutex> guard(lock_);
+  *ppd = TokenFromRid(SourceRows(MetadataTable::Param) + ++param_count_,
+                      mdtParamDef);
+  return S_OK;
+}
+
+HRESULT STDMETHODCALLTYPE MockMetadata::SetMethodImplFlags(
+    mdMethodDef md, DWORD dwImplFlags) {
+  const ULONG rid = RidFromToken(md);
+  const ULONG source_rows = SourceRows(MetadataTable::MethodDef);
+  if (TypeFromToken(md) != mdtMethodDef || rid == 0) {
+    return CLDB_E_RECORD_NOTFOUND;
+  }
+
+  // The image is read only, only the defined methods are updated
+  if (rid > source_rows) {
+    std::lock_guard<std::mutex> guard(lock_);
+    if (rid - source_rows > method_defs_.size()) {
+      return CLDB_E_RECORD_NOTFOUND;
+    }
+    method_defs_[rid - source_rows - 1].impl_flags = dwImplFlags;
+  }
+  return S_OK;
+}
+
+//
+// IMetaDataEmit2
+//
+
+HRESULT STDMETHODCALLTYPE MockMetadata::DefineMethodSpec(
+    mdToken tkParent, PCCOR_SIGNATURE pvSigBlob, ULONG cbSigBlob,
+    mdMethodSpec* pmi) {
+  std::lock_guard<std::mutex> guard(lock_);
+  method_specs_.push_back(
+      {tkParent, std::vector<BYTE>(pvSigBlob, pvSigBlob + cbSigBlob)});
+  *pmi = TokenFromRid(SourceRows(MetadataTable::MethodSpec) +
+                          static_cast<ULONG>(method_specs_.size()),
+                      mdtMethodSpec);
+  return S_OK;
+}
+
+//
+// IMetaDataAssemblyImport
+//
+
+HRESULT STDMETHODCALLTYPE MockMetadata::GetAssemblyProps(
+    mdAssembly mda, const void** ppbPublicKey, ULONG* pcbPublicKey,
+    ULONG* pulHashAlgId, LPWSTR szName, ULONG cchName, ULONG* pchName,
+    ASSEMBLYMETADATA* pMetaData, DWORD* pdwAssemblyFlags) {
+  AssemblyRow row;
+  if (TypeFromToken(mda) != mdtAssembly ||
+      !metadata_reader_.GetAssembly(&row)) {
+    return CLDB_E_RECORD_NOTFOUND;
+  }
+
+  if (ppbPublicKey != nullptr) {
+    *ppbPublicKey = row.public_key.data;
+  }
+  if (pcbPublicKey != nullptr) {
+    *pcbPublicKey = row.public_key.size;
+  }
+  if (pulHashAlgId != nullptr) {
+    *pulHashAlgId = row.hash_alg_id;
+  }
+  if (pMetaData != nullptr) {
+    pMetaData->usMajorVersion = row.major;
+    pMetaData->usMinorVersion = row.minor;
+    pMetaData->usBuildNumber = row.build;
+    pMetaData->usRevisionNumber = row.revision;
+    pMetaData->cbLocale = 0;
+    pMetaData->ulProcessor = 0;
+    pMetaData->ulOS = 0;
+  }
+  if (pdwAssemblyFlags != nullptr) {
+    *pdwAssemblyFlags = row.flags;
+  }
+  return CopyName(ToWSTRING(row.name), szName, cchName, pchName);
+}
+
+HRESULT STDMETHODCALLTYPE MockMetadata::GetAssemblyRefProps(
+    mdAssemblyRef mdar, const void** ppbPublicKeyOrToken,
+    ULONG* pcbPublicKeyOrToken, LPWSTR szName, ULONG cchName, ULONG* pchName,
+    ASSEMBLYMETADATA* pMetaData, const void** ppbHashValue,
+    ULONG* pcbHashValue, DWORD* pdwAssemblyRefFlags) {
+  const ULONG rid = RidFromToken(mdar);
+  const ULONG source_rows = SourceRows(MetadataTable::AssemblyRef);
+  if (TypeFromToken(mdar) != mdtAssemblyRef || rid == 0) {
+    return CLDB_E_RECORD_NOTFOUND;
+  }
+
+  AssemblyReference reference;
+  const void* public_key_or_token;
+  ULONG public_key_or_token_size;
+  if (rid <= source_rows) {
+    AssemblyRefRow row;
+    if (!metadata_reader_.GetAssemblyRef(rid, &row)) {
+      return CLDB_E_RECORD_NOTFOUND;
+    }
+    reference = {ToWSTRING(row.name), row.major, row.minor, row.build,
+                 row.revision, {}, row.flags};
+    public_key_or_token = row.public_key_or_token.data;
+    public_key_or_token_size = row.public_key_or_token.size;
+  } else {
+    std::lock_guard<std::mutex> guard(lock_);
+    if (rid - source_rows > assembly_refs_.size()) {
+      return CLDB_E_RECORD_NOTFOUND;
+    }
+    const auto& defined_reference = assembly_refs_[rid - source_rows - 1];
+    reference = defined_reference;
+    public_key_or_token = defined_reference.public_key_or_token.data();
+    public_key_or_token_size =
+        static_cast<ULONG>(defined_reference.public_key_or_token.size());
+  }
+
+  if (ppbPublicKeyOrToken != nullptr) {
+    *ppbPublicKeyOrToken = public_key_or_token;
+  }
+  if (pcbPublicKeyOrToken != nullptr) {
+    *pcbPublicKeyOrToken = public_key_or_token_size;
+  }
+  if (pMetaData != nullptr) {
+    pMetaData->usMajorVersion = reference.major;
+    pMetaData->usMinorVersion = reference.minor;
+    pMetaData->usBuildNumber = reference.build;
+    pMetaData->usRevisionNumber = reference.revision;
+    pMetaData->cbLocale = 0;
+    pMetaData->ulProcessor = 0;
+    pMetaData->ulOS = 0;
+  }
+  if (ppbHashValue != nullptr) {
+    *ppbHashValue = nullptr;
+  }
+  if (pcbHashValue != nullptr) {
+    *pcbHashValue = 0;
+  }
+  if (pdwAssemblyRefFlags != nullptr) {
+    *pdwAssemblyRefFlags = reference.flags;
+  }
+  return CopyName(reference.name, szName, cchName, pchName);
+}
+
+HRESULT STDMETHODCALLTYPE MockMetadata::EnumAssemblyRefs(
+    HCORENUM* phEnum, mdAssemblyRef rAssemblyRefs[], ULONG cMax,
+    ULONG* pcTokens) {
+  return NextTokens(
+      phEnum,
+      [this](std::vector<mdToken>* tokens) {
+        const ULONG source_rows = SourceRows(MetadataTable::AssemblyRef);
+        std::lock_guard<std::mutex> guard(lock_);
+        const ULONG rows =
+            source_rows + static_cast<ULONG>(assembly_refs_.size());
+        for (ULONG rid = 1; rid <= rows; rid++) {
+          tokens->push_back(TokenFromRid(rid, mdtAssemblyRef));
+        }
+      },
+      rAssemblyRefs, cMax, pcTokens);
+}
+
+HRESULT STDMETHODCALLTYPE MockMetadata::GetAssemblyFromScope(
+    mdAssembly* ptkAssembly) {
+  if (SourceRows(MetadataTable::Assembly) == 0) {
+    return CLDB_E_RECORD_NOTFOUND;
+  }
+  *ptkAssembly = TokenFromRid(1, mdtAssembly);
+  return S_OK;
+}
+
+//
+// IMetaDataAssemblyEmit
+//
+
+HRESULT STDMETHODCALLTYPE MockMetadata::DefineAssemblyRef(
+    const void* pbPublicKeyOrToken, ULONG cbPublicKeyOrToken, LPCWSTR szName,
+    const ASSEMBLYMETADATA* pMetaData, const void* pbHashValue,
+    ULONG cbHashValue, DWORD dwAssemblyRefFlags, mdAssemblyRef* pmdar) {
+  std::lock_guard<std::mutex> guard(lock_);
+  BuildIndexes();
+  const WSTRING name(szName);
+  const auto search = assembly_ref_index_.find(name);
+  if (search != assembly_ref_index_.end()) {
+    *pmdar = search->second;
+    return S_OK;
+  }
+
+  const auto public_key_or_token =
+      static_cast<const BYTE*>(pbPublicKeyOrToken);
+  assembly_refs_.push_back(
+      {name, pMetaData->usMajorVersion, pMetaData->usMinorVersion,
+       pMetaData->usBuildNumber, pMetaData->usRevisionNumber,
+       std::vector<BYTE>(public_key_or_token,
+                         public_key_or_token + cbPublicKeyOrToken),
+       dwAssemblyRefFlags});
+  *pmdar = TokenFromRid(SourceRows(MetadataTable::AssemblyRef) +
+                            static_cast<ULONG>(assembly_refs_.size()),
+                        mdtAssemblyRef);
+  assembly_ref_index_.emplace(name, *pmdar);
+  return S_OK;
+}
+
+}  // namespace trace
@@ -0,0 +1,560 @@
+#ifndef DD_CLR_PROFILER_MOCK_METADATA_H_
+#define DD_CLR_PROFILER_MOCK_METADATA_H_
+
+#include <corhlpr.h>
+#include <corprof.h>
+
+#include <atomic>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "../../src/Datadog.Trace.ClrProfiler.Native/metadata_reader.h"
+#include "../../src/Datadog.Trace.ClrProfiler.Native/string.h"
+
+namespace trace {
+
+/// <summary>
+/// The metadata interfaces of a module of the profiler harness, over the image
+/// of a PE file read from disk. The rows of the image are read through a
+/// MetadataReader, the rows the profiler defines are kept in memory so they
+/// can be read back. Only the methods the profiler calls are implemented, the
+/// others return E_NOTIMPL.
+/// </summary>
+class MockMetadata final : public IMetaDataImport2,
+                           public IMetaDataEmit2,
+                           public IMetaDataAssemblyImport,
+                           public IMetaDataAssemblyEmit {
+ private:
+  struct TypeDefinition {
+    WSTRING name;
+    DWORD flags;
+    mdToken extends;
+    mdTypeDef enclosing_class;
+  };
+
+  struct MethodDefinition {
+    mdTypeDef parent;
+    WSTRING name;
+    DWORD flags;
+    std::vector<BYTE> signature;
+    ULONG rva;
+    DWORD impl_flags;
+  };
+
+  struct TypeReference {
+    mdToken resolution_scope;
+    WSTRING name;
+  };
+
+  struct MemberReference {
+    mdToken parent;
+    WSTRING name;
+    std::vector<BYTE> signature;
+  };
+
+  struct MethodSpecification {
+    mdToken parent;
+    std::vector<BYTE> signature;
+  };
+
+  struct AssemblyReference {
+    WSTRING name;
+    USHORT major;
+    USHORT minor;
+    USHORT build;
+    USHORT revision;
+    std::vector<BYTE> public_key_or_token;
+    DWORD flags;
+  };
+
+  std::atomic<ULONG> ref_count_{0};
+  const MetadataReader& metadata_reader_;
+
+  // Owner type of each MethodDef row of the image, and the enclosing type of
+  // each nested type
+  std::vector<mdTypeDef> method_owners_;
+  std::unordered_map<ULONG, mdTypeDef> enclosing_classes_;
+
+  // Rows defined by the profiler, after the rows of the image. The deques
+  // keep the addresses of the rows stable, the signatures handed out point
+  // into them.
+  mutable std::mutex lock_;
+  std::deque<TypeDefinition> type_defs_;
+  std::deque<MethodDefinition> method_defs_;
+  std::deque<TypeReference> type_refs_;
+  std::deque<MemberReference> member_refs_;
+  std::deque<MethodSpecification> method_specs_;
+  std::deque<std::vector<BYTE>> type_specs_;
+  std::deque<std::vector<BYTE>> signatures_;
+  std::deque<WSTRING> user_strings_;
+  std::deque<WSTRING> module_refs_;
+  std::deque<AssemblyReference> assembly_refs_;
+  ULONG field_count_ = 0;
+  ULONG param_count_ = 0;
+  ULONG custom_attribute_count_ = 0;
+
+  // The emit methods return the existing row for an identical definition, as
+  // the runtime does. Built on the first definition.
+  bool indexed_ = false;
+  std::map<std::pair<mdToken, WSTRING>, mdTypeRef> type_ref_index_;
+  std::map<std::pair<mdToken, std::pair<WSTRING, std::vector<BYTE>>>,
+           mdMemberRef>
+      member_ref_index_;
+  std::map<WSTRING, mdAssemblyRef> assembly_ref_index_;
+  std::map<std::vector<BYTE>, mdTypeSpec> type_spec_index_;
+  std::map<std::vector<BYTE>, mdSignature> signature_index_;
+
+  // A method or member reference, of the image or defined by the profiler
+  struct MemberView {
+    mdToken parent = mdTokenNil;
+    WSTRING name;
+    DWORD flags = 0;
+    PCCOR_SIGNATURE signature = nullptr;
+    ULONG signature_size = 0;
+    ULONG rva = 0;
+    DWORD impl_flags = 0;
+  };
+
+  ULONG SourceRows(MetadataTable table) const {
+    return metadata_reader_.GetRowCount(table);
+  }
+
+  // Called with lock_ held
+  void BuildIndexes();
+
+  bool GetTypeDef(mdTypeDef type_def, TypeDefinition* definition) const;
+  bool GetTypeRef(mdTypeRef type_ref, TypeReference* reference) const;
+  bool GetMethodDef(mdMethodDef method_def, MemberView* view) const;
+  bool GetMemberRef(mdMemberRef member_ref, MemberView* view) const;
+  std::vector<mdMethodDef> GetMethods(mdTypeDef type_def) const;
+  bool GetTypeName(mdToken type, WSTRING* name) const;
+
+  MockMetadata(const MockMetadata&) = delete;
+  MockMetadata& operator=(const MockMetadata&) = delete;
+
+ public:
+  // The reader (and the image it reads) must outlive the metadata
+  explicit MockMetadata(const MetadataReader& metadata_reader);
+
+  // Rows defined by the profiler, for the reports of the harness
+  size_t GetDefinedRowCount() const;
+
+  HRESULT STDMETHODCALLTYPE QueryInterface(REFIID riid,
+                                           void** ppvObject) override;
+  ULONG STDMETHODCALLTYPE AddRef() override;
+  ULONG STDMETHODCALLTYPE Release() override;
+
+  // IMetaDataImport
+  void STDMETHODCALLTYPE CloseEnum(HCORENUM hEnum) override;
+  HRESULT STDMETHODCALLTYPE CountEnum(HCORENUM hEnum,
+                                      ULONG* pulCount) override;
+  HRESULT STDMETHODCALLTYPE ResetEnum(HCORENUM hEnum, ULONG ulPos) override;
+  HRESULT STDMETHODCALLTYPE EnumTypeDefs(HCORENUM* phEnum,
+                                         mdTypeDef rTypeDefs[], ULONG cMax,
+                                         ULONG* pcTypeDefs) override;
+  HRESULT STDMETHODCALLTYPE EnumTypeRefs(HCORENUM* phEnum,
+                                         mdTypeRef rTypeRefs[], ULONG cMax,
+                                         ULONG* pcTypeRefs) override;
+  HRESULT STDMETHODCALLTYPE FindTypeDefByName(LPCWSTR szTypeDef,
+                                              mdToken tkEnclosingClass,
+                                              mdTypeDef* ptd) override;
+  HRESULT STDMETHODCALLTYPE GetScopeProps(LPWSTR szName, ULONG cchName,
+                                          ULONG* pchName,
+                                          GUID* pmvid) override;
+  HRESULT STDMETHODCALLTYPE GetModuleFromScope(mdModule* pmd) override;
+  HRESULT STDMETHODCALLTYPE GetTypeDefProps(mdTypeDef td, LPWSTR szTypeDef,
+                                            ULONG cchTypeDef,
+                                            ULONG* pchTypeDef,
+                                            DWORD* pdwTypeDefFlags,
+                                            mdToken* ptkExtends) override;
+  HRESULT STDMETHODCALLTYPE GetTypeRefProps(mdTypeRef tr,
+                                            mdToken* ptkResolutionScope,
+                                            LPWSTR szName, ULONG cchName,
+                                            ULONG* pchName) override;
+  HRESULT STDMETHODCALLTYPE EnumMethods(HCORENUM* phEnum, mdTypeDef cl,
+                                        mdMethodDef rMethods[], ULONG cMax,
+                                        ULONG* pcTokens) override;
+  HRESULT STDMETHODCALLTYPE EnumMethodsWithName(HCORENUM* phEnum,
+                                                mdTypeDef cl, LPCWSTR szName,
+                                                mdMethodDef rMethods[],
+                                                ULONG cMax,
+                                                ULONG* pcTokens) override;
+  HRESULT STDMETHODCALLTYPE EnumMemberRefs(HCORENUM* phEnum, mdToken tkParent,
+                                           mdMemberRef rMemberRefs[],
+                                           ULONG cMax,
+                                           ULONG* pcTokens) override;
+  HRESULT STDMETHODCALLTYPE FindTypeRef(mdToken tkResolutionScope,
+                                        LPCWSTR szName,
+                                        mdTypeRef* ptr) override;
+  HRESULT STDMETHODCALLTYPE GetMethodProps(
+      mdMethodDef mb, mdTypeDef* pClass, LPWSTR szMethod, ULONG cchMethod,
+      ULONG* pchMethod, DWORD* pdwAttr, PCCOR_SIGNATURE* ppvSigBlob,
+      ULONG* pcbSigBlob, ULONG* pulCodeRVA, DWORD* pdwImplFlags) override;
+  HRESULT STDMETHODCALLTYPE GetMemberRefProps(mdMemberRef mr, mdToken* ptk,
+                                              LPWSTR szMember,
+                                              ULONG cchMember,
+                                              ULONG* pchMember,
+                                              PCCOR_SIGNATURE* ppvSigBlob,
+                                              ULONG* pbSig) override;
+  HRESULT STDMETHODCALLTYPE GetMemberProps(
+      mdToken mb, mdTypeDef* pClass, LPWSTR szMember, ULONG cchMember,
+      ULONG* pchMember, DWORD* pdwAttr, PCCOR_SIGNATURE* ppvSigBlob,
+      ULONG* pcbSigBlob, ULONG* pulCodeRVA, DWORD* pdwImplFlags,
+      DWORD* pdwCPlusTypeFlag, UVCP_CONSTANT* ppValue,
+      ULONG* pcchValue) override;
+  HRESULT STDMETHODCALLTYPE GetFieldProps(
+      mdFieldDef mb, mdTypeDef* pClass, LPWSTR szField, ULONG cchField,
+      ULONG* pchField, DWORD* pdwAttr, PCCOR_SIGNATURE* ppvSigBlob,
+      ULONG* pcbSigBlob, DWORD* pdwCPlusTypeFlag, UVCP_CONSTANT* ppValue,
+      ULONG* pcchValue) override;
+  HRESULT STDMETHODCALLTYPE GetRVA(mdToken tk, ULONG* pulCodeRVA,
+                                   DWORD* pdwImplFlags) override;
+  HRESULT STDMETHODCALLTYPE GetSigFromToken(mdSignature mdSig,
+                                            PCCOR_SIGNATURE* ppvSig,
+                                            ULONG* pcbSig) override;
+  HRESULT STDMETHODCALLTYPE GetModuleRefProps(mdModuleRef mur, LPWSTR szName,
+                                              ULONG cchName,
+                                              ULONG* pchName) override;
+  HRESULT STDMETHODCALLTYPE EnumModuleRefs(HCORENUM* phEnum,
+                                           mdModuleRef rModuleRefs[],
+                                           ULONG cmax,
+                                           ULONG* pcModuleRefs) override;
+  HRESULT STDMETHODCALLTYPE GetTypeSpecFromToken(mdTypeSpec typespec,
+                                                 PCCOR_SIGNATURE* ppvSig,
+                                                 ULONG* pcbSig) override;
+  HRESULT STDMETHODCALLTYPE GetUserString(mdString stk, LPWSTR szString,
+                                          ULONG cchString,
+                                          ULONG* pchString) override;
+  HRESULT STDMETHODCALLTYPE GetCustomAttributeByName(mdToken tkObj,
+                                                     LPCWSTR szName,
+                                                     const void** ppData,
+                                                     ULONG* pcbData) override;
+  BOOL STDMETHODCALLTYPE IsValidToken(mdToken tk) override;
+  HRESULT STDMETHODCALLTYPE GetNestedClassProps(
+      mdTypeDef tdNestedClass, mdTypeDef* ptdEnclosingClass) override;
+
+  // IMetaDataImport2
+  HRESULT STDMETHODCALLTYPE GetMethodSpecProps(mdMethodSpec mi,
+                                               mdToken* tkParent,
+                                               PCCOR_SIGNATURE* ppvSigBlob,
+                                               ULONG* pcbSigBlob) override;
+
+  // IMetaDataEmit
+  HRESULT STDMETHODCALLTYPE DefineTypeDef(LPCWSTR szTypeDef,
+                                          DWORD dwTypeDefFlags,
+                                          mdToken tkExtends,
+                                          mdToken rtkImplements[],
+                                          mdTypeDef* ptd) override;
+  HRESULT STDMETHODCALLTYPE DefineNestedType(LPCWSTR szTypeDef,
+                                             DWORD dwTypeDefFlags,
+                                             mdToken tkExtends,
+                                             mdToken rtkImplements[],
+                                             mdTypeDef tdEncloser,
+                                             mdTypeDef* ptd) override;
+  HRESULT STDMETHODCALLTYPE DefineMethod(mdTypeDef td, LPCWSTR szName,
+                                         DWORD dwMethodFlags,
+                                         PCCOR_SIGNATURE pvSigBlob,
+                                         ULONG cbSigBlob, ULONG ulCodeRVA,
+                                         DWORD dwImplFlags,
+                                         mdMethodDef* pmd) override;
+  HRESULT STDMETHODCALLTYPE DefineTypeRefByName(mdToken tkResolutionScope,
+                                                LPCWSTR szName,
+                                                mdTypeRef* ptr) override;
+  HRESULT STDMETHODCALLTYPE DefineMemberRef(mdToken tkImport, LPCWSTR szName,
+                                            PCCOR_SIGNATURE pvSigBlob,
+                                            ULONG cbSigBlob,
+                                            mdMemberRef* pmr) override;
+  HRESULT STDMETHODCALLTYPE GetTokenFromSig(PCCOR_SIGNATURE pvSig,
+                                            ULONG cbSig,
+                                            mdSignature* pmsig) override;
+  HRESULT STDMETHODCALLTYPE DefineModuleRef(LPCWSTR szName,
+                                            mdModuleRef* pmur) override;
+  HRESULT STDMETHODCALLTYPE GetTokenFromTypeSpec(
+      PCCOR_SIGNATURE pvSig, ULONG cbSig, mdTypeSpec* ptypespec) override;
+  HRESULT STDMETHODCALLTYPE DefineUserString(LPCWSTR szString,
+                                             ULONG cchString,
+                                             mdString* pstk) override;
+  HRESULT STDMETHODCALLTYPE SetMethodProps(mdMethodDef md,
+                                           DWORD dwMethodFlags,
+                                           ULONG ulCodeRVA,
+                                           DWORD dwImplFlags) override;
+  HRESULT STDMETHODCALLTYPE DefinePinvokeMap(mdToken tk, DWORD dwMappingFlags,
+                                             LPCWSTR szImportName,
+                                             mdModuleRef mrImportDLL) override;
+  HRESULT STDMETHODCALLTYPE DefineCustomAttribute(
+      mdToken tkOwner, mdToken tkCtor, void const* pCustomAttribute,
+      ULONG cbCustomAttribute, mdCustomAttribute* pcv) override;
+  HRESULT STDMETHODCALLTYPE DefineField(mdTypeDef td, LPCWSTR szName,
+                                        DWORD dwFieldFlags,
+                                        PCCOR_SIGNATURE pvSigBlob,
+                                        ULONG cbSigBlob, DWORD dwCPlusTypeFlag,
+                                        void const* pValue, ULONG cchValue,
+                                        mdFieldDef* pmd) override;
+  HRESULT STDMETHODCALLTYPE DefineParam(mdMethodDef md, ULONG ulParamSeq,
+                                        LPCWSTR szName, DWORD dwParamFlags,
+                                        DWORD dwCPlusTypeFlag,
+                                        void const* pValue, ULONG cchValue,
+                                        mdParamDef* ppd) override;
+  HRESULT STDMETHODCALLTYPE SetMethodImplFlags(mdMethodDef md,
+                                               DWORD dwImplFlags) override;
+
+  // IMetaDataEmit2
+  HRESULT STDMETHODCALLTYPE DefineMethodSpec(mdToken tkParent,
+                                             PCCOR_SIGNATURE pvSigBlob,
+                                             ULONG cbSigBlob,
+                                             mdMethodSpec* pmi) override;
+
+  // IMetaDataAssemblyImport
+  HRESULT STDMETHODCALLTYPE GetAssemblyProps(
+      mdAssembly mda, const void** ppbPublicKey, ULONG* pcbPublicKey,
+      ULONG* pulHashAlgId, LPWSTR szName, ULONG cchName, ULONG* pchName,
+      ASSEMBLYMETADATA* pMetaData, DWORD* pdwAssemblyFlags) override;
+  HRESULT STDMETHODCALLTYPE GetAssemblyRefProps(
+      mdAssemblyRef mdar, const void** ppbPublicKeyOrToken,
+      ULONG* pcbPublicKeyOrToken, LPWSTR szName, ULONG cchName,
+      ULONG* pchName, ASSEMBLYMETADATA* pMetaData, const void** ppbHashValue,
+      ULONG* pcbHashValue, DWORD* pdwAssemblyRefFlags) override;
+  HRESULT STDMETHODCALLTYPE EnumAssemblyRefs(HCORENUM* phEnum,
+                                             mdAssemblyRef rAssemblyRefs[],
+                                             ULONG cMax,
+                                             ULONG* pcTokens) override;
+  HRESULT STDMETHODCALLTYPE GetAssemblyFromScope(
+      mdAssembly* ptkAssembly) override;
+
+  // IMetaDataAssemblyEmit
+  HRESULT STDMETHODCALLTYPE DefineAssemblyRef(
+      const void* pbPublicKeyOrToken, ULONG cbPublicKeyOrToken,
+      LPCWSTR szName, const ASSEMBLYMETADATA* pMetaData,
+      const void* pbHashValue, ULONG cbHashValue, DWORD dwAssemblyRefFlags,
+      mdAssemblyRef* pmdar) override;
+
+  // Not used by the profiler
+  // IMetaDataImport
+  HRESULT STDMETHODCALLTYPE EnumInterfaceImpls(HCORENUM*, mdTypeDef,
+      mdInterfaceImpl*, ULONG, ULONG*) override { return E_NOTIMPL; }
+  HRESULT STDMETHODCALLTYPE GetInterfaceImplProps(mdInterfaceImpl, mdTypeDef*,
+      mdToken*) override { return E_NOTIMPL; }
+  HRESULT STDMETHODCALLTYPE ResolveTypeRef(mdTypeRef, REFIID, IUnknown**,
+      mdTypeDef*) override { return E_NOTIMPL; }
+  HRESULT STDMETHODCALLTYPE EnumMembers(HCORENUM*, mdTypeDef, mdToken*, ULONG,
+      ULONG*) override { return E_NOTIMPL; }
+  HRESULT STDMETHODCALLTYPE EnumMembersWithName(HCORENUM*, mdTypeDef, LPCWSTR,
+      mdToken*, ULONG, ULONG*) override { return E_NOTIMPL; }
+  HRESULT STDMETHODCALLTYPE EnumFields(HCORENUM*, mdTypeDef, mdFieldDef*,
+      ULONG, ULONG*) override { return E_NOTIMPL; }
+  HRESULT STDMETHODCALLTYPE EnumFieldsWithName(HCORENUM*, mdTypeDef, LPCWSTR,
+      mdFieldDef*, ULONG, ULONG*) override { return E_NOTIMPL; }
+  HRESULT STDMETHODCALLTYPE EnumParams(HCORENUM*, mdMethodDef, mdParamDef*,
+      ULONG, ULONG*) override { return E_NOTIMPL; }
+  HRESULT STDMETHODCALLTYPE EnumMethodImpls(HCORENUM*, mdTypeDef, mdToken*,
+      mdToken*, ULONG, ULONG*) override { return E_NOTIMPL; }
+  HRESULT STDMETHODCALLTYPE EnumPermissionSets(HCORENUM*, mdToken, DWORD,
+      mdPermission*, ULONG, ULONG*) override { return E_NOTIMPL; }
+  HRESULT STDMETHODCALLTYPE FindMember(mdTypeDef, LPCWSTR, PCCOR_SIGNATURE,
+      ULONG, mdToken*) override { return E_NOTIMPL; }
+  HRESULT STDMETHODCALLTYPE FindMethod(mdTypeDef, LPCWSTR, PCCOR_SIGNATURE,
+      ULONG, mdMethodDef*) override { return E_NOTIMPL; }
+  HRESULT STDMETHODCALLTYPE FindField(mdTypeDef, LPCWSTR, PCCOR_SIGNATURE,
+      ULONG, mdFieldDef*) override { return E_NOTIMPL; }
+  HRESULT STDMETHODCALLTYPE FindMemberRef(mdTypeRef, LPCWSTR, PCCOR_SIGNATURE,
+      ULONG, mdMemberRef*) override { return E_NOTIMPL; }
+  HRESULT STDMETHODCALLTYPE EnumProperties(HCORENUM*, mdTypeDef, mdProperty*,
+      ULONG, ULONG*) override { return E_NOTIMPL; }
+  HRESULT STDMETHODCALLTYPE EnumEvents(HCORENUM*, mdTypeDef, mdEvent*, ULONG,
+      ULONG*) override { return E_NOTIMPL; }
+  HRESULT STDMETHODCALLTYPE GetEventProps(mdEvent, mdTypeDef*, LPCWSTR, ULONG,
+      ULONG*, DWORD*, mdToken*, mdMethodDef*, mdMethodDef*, mdMethodDef*,
+      mdMethodDef*, ULONG, ULONG*) override { return E_NOTIMPL; }
+  HRESULT STDMETHODCALLTYPE EnumMethodSemantics(HCORENUM*, mdMethodDef,
+      mdToken*, ULONG, ULONG*) override { return E_NOTIMPL; }
+  HRESULT STDMETHODCALLTYPE GetMethodSemantics(mdMethodDef, mdToken, DWORD*)
+      override { return E_NOTIMPL; }
+  HRESULT STDMETHODCALLTYPE GetClassLayout(mdTypeDef, DWORD*,
+      COR_FIELD_OFFSET*, ULONG, ULONG*, ULONG*) override { return E_NOTIMPL; }
+  HRESULT STDMETHODCALLTYPE GetFieldMarshal(mdToken, PCCOR_SIGNATURE*, ULONG*)
+      override { return E_NOTIMPL; }
+  HRESULT STDMETHODCALLTYPE GetPermissionSetProps(mdPermission, DWORD*,
+      void const**, ULONG*) override { return E_NOTIMPL; }
+  HRESULT STDMETHODCALLTYPE GetNameFromToken(mdToken, MDUTF8CSTR*)
+      override { return E_NOTIMPL; }
+  HRESULT STDMETHODCALLTYPE EnumUnresolvedMethods(HCORENUM*, mdToken*, ULONG,
+      ULONG*) override { return E_NOTIMPL; }
+  HRESULT STDMETHODCALLTYPE GetPinvokeMap(mdToken, DWORD*, LPWSTR, ULONG,
+      ULONG*, mdModuleRef*) override { return E_NOTIMPL; }
+  HRESULT STDMETHODCALLTYPE EnumSignatures(HCORENUM*, mdSignature*, ULONG,
+      ULONG*) override { return E_NOTIMPL; }
+  HRESULT STDMETHODCALLTYPE EnumTypeSpecs(HCORENUM*, mdTypeSpec*, ULONG,
+      ULONG*) override { return E_NOTIMPL; }
+  HRESULT STDMETHODCALLTYPE EnumUserStrings(HCORENUM*, mdString*, ULONG,
+      ULONG*) override { return E_NOTIMPL; }
+  HRESULT STDMETHODCALLTYPE GetParamForMethodIndex(mdMethodDef, ULONG,
+      mdParamDef*) override { return E_NOTIMPL; }
+  HRESULT STDMETHODCALLTYPE EnumCustomAttributes(HCORENUM*, mdToken, mdToken,
+      mdCustomAttribute*, ULONG, ULONG*) override { return E_NOTIMPL; }
+  HRESULT STDMETHODCALLTYPE GetCustomAttributeProps(mdCustomAttribute,
+      mdToken*, mdToken*, void const**, ULONG*) override { return E_NOTIMPL; }
+  HRESULT STDMETHODCALLTYPE GetPropertyProps(mdProperty, mdTypeDef*, LPCWSTR,
+      ULONG, ULONG*, DWORD*, PCCOR_SIGNATURE*, ULONG*, DWORD*, UVCP_CONSTANT*,
+      ULONG*, mdMethodDef*, mdMethodDef*, mdMethodDef*, ULONG, ULONG*)
+      override { return E_NOTIMPL; }
+  HRESULT STDMETHODCALLTYPE GetParamProps(mdParamDef, mdMethodDef*, ULONG*,
+      LPWSTR, ULONG, ULONG*, DWORD*, DWORD*, UVCP_CONSTANT*, ULONG*)
+      override { return E_NOTIMPL; }
+  HRESULT STDMETHODCALLTYPE GetNativeCallConvFromSig(void const*, ULONG,
+      ULONG*) override { return E_NOTIMPL; }
+  HRESULT STDMETHODCALLTYPE IsGlobal(mdToken, int*)
+      override { return E_NOTIMPL; }
+  // IMetaDataImport2
+  HRESULT STDMETHODCALLTYPE EnumGenericParams(HCORENUM*, mdToken,
+      mdGenericParam*, ULONG, ULONG*) override { return E_NOTIMPL; }
+  HRESULT STDMETHODCALLTYPE GetGenericParamProps(mdGenericParam, ULONG*,
+      DWORD*, mdToken*, DWORD*, LPWSTR, ULONG, ULONG*)
+      override { return E_NOTIMPL; }
+  HRESULT STDMETHODCALLTYPE EnumGenericParamConstraints(HCORENUM*,
+      mdGenericParam, mdGenericParamConstraint*, ULONG, ULONG*)
+      override { return E_NOTIMPL; }
+  HRESULT STDMETHODCALLTYPE GetGenericParamConstraintProps(mdGenericParamConstraint,
+      mdGenericParam*, mdToken*) override { return E_NOTIMPL; }
+  HRESULT STDMETHODCALLTYPE GetPEKind(DWORD*, DWORD*)
+      override { return E_NOTIMPL; }
+  HRESULT STDMETHODCALLTYPE GetVersionString(LPWSTR, DWORD, DWORD*)
+      override { return E_NOTIMPL; }
+  HRESULT STDMETHODCALLTYPE EnumMethodSpecs(HCORENUM*, mdToken, mdMethodSpec*,
+      ULONG, ULONG*) override { return E_NOTIMPL; }
+  // IMetaDataEmit
+  HRESULT STDMETHODCALLTYPE SetModuleProps(LPCWSTR)
+      override { return E_NOTIMPL; }
+  HRESULT STDMETHODCALLTYPE Save(LPCWSTR, DWORD) override { return E_NOTIMPL; }
+  HRESULT STDMETHODCALLTYPE SaveToStream(IStream*, DWORD)
+      override { return E_NOTIMPL; }
+  HRESULT STDMETHODCALLTYPE GetSaveSize(CorSaveSize, DWORD*)
+      override { return E_NOTIMPL; }
+  HRESULT STDMETHODCALLTYPE SetHandler(IUnknown*) override { return E_NOTIMPL; }
+  HRESULT STDMETHODCALLTYPE DefineMethodImpl(mdTypeDef, mdToken, mdToken)
+      override { return E_NOTIMPL; }
+  HRESULT STDMETHODCALLTYPE DefineImportType(IMetaDataAssemblyImport*,
+      const void*, ULONG, IMetaDataImport*, mdTypeDef, IMetaDataAssemblyEmit*,
+      mdTypeRef*) override { return E_NOTIMPL; }
+  HRESULT STDMETHODCALLTYPE DefineImportMember(IMetaDataAssemblyImport*,
+      const void*, ULONG, IMetaDataImport*, mdToken, IMetaDataAssemblyEmit*,
+      mdToken, mdMemberRef*) override { return E_NOTIMPL; }
+  HRESULT STDMETHODCALLTYPE DefineEvent(mdTypeDef, LPCWSTR, DWORD, mdToken,
+      mdMethodDef, mdMethodDef, mdMethodDef, mdMethodDef*, mdEvent*)
+      override { return E_NOTIMPL; }
+  HRESULT STDMETHODCALLTYPE SetClassLayout(mdTypeDef, DWORD, COR_FIELD_OFFSET*,
+      ULONG) override { return E_NOTIMPL; }
+  HRESULT STDMETHODCALLTYPE DeleteClassLayout(mdTypeDef)
+      override { return E_NOTIMPL; }
+  HRESULT STDMETHODCALLTYPE SetFieldMarshal(mdToken, PCCOR_SIGNATURE, ULONG)
+      override { return E_NOTIMPL; }
+  HRESULT STDMETHODCALLTYPE DeleteFieldMarshal(mdToken)
+      override { return E_NOTIMPL; }
+  HRESULT STDMETHODCALLTYPE DefinePermissionSet(mdToken, DWORD, void const*,
+      ULONG, mdPermission*) override { return E_NOTIMPL; }
+  HRESULT STDMETHODCALLTYPE SetRVA(mdMethodDef, ULONG)
+      override { return E_NOTIMPL; }
+  HRESULT STDMETHODCALLTYPE SetParent(mdMemberRef, mdToken)
+      override { return E_NOTIMPL; }
+  HRESULT STDMETHODCALLTYPE SaveToMemory(void*, ULONG)
+      override { return E_NOTIMPL; }
+  HRESULT STDMETHODCALLTYPE DeleteToken(mdToken) override { return E_NOTIMPL; }
+  HRESULT STDMETHODCALLTYPE SetTypeDefProps(mdTypeDef, DWORD, mdToken,
+      mdToken*) override { return E_NOTIMPL; }
+  HRESULT STDMETHODCALLTYPE SetEventProps(mdEvent, DWORD, mdToken, mdMethodDef,
+      mdMethodDef, mdMethodDef, mdMethodDef*) override { return E_NOTIMPL; }
+  HRESULT STDMETHODCALLTYPE SetPermissionSetProps(mdToken, DWORD, void const*,
+      ULONG, mdPermission*) override { return E_NOTIMPL; }
+  HRESULT STDMETHODCALLTYPE SetPinvokeMap(mdToken, DWORD, LPCWSTR, mdModuleRef)
+      override { return E_NOTIMPL; }
+  HRESULT STDMETHODCALLTYPE DeletePinvokeMap(mdToken)
+      override { return E_NOTIMPL; }
+  HRESULT STDMETHODCALLTYPE SetCustomAttributeValue(mdCustomAttribute,
+      void const*, ULONG) override { return E_NOTIMPL; }
+  HRESULT STDMETHODCALLTYPE DefineProperty(mdTypeDef, LPCWSTR, DWORD,
+      PCCOR_SIGNATURE, ULONG, DWORD, void const*, ULONG, mdMethodDef,
+      mdMethodDef, mdMethodDef*, mdProperty*) override { return E_NOTIMPL; }
+  HRESULT STDMETHODCALLTYPE SetFieldProps(mdFieldDef, DWORD, DWORD,
+      void const*, ULONG) override { return E_NOTIMPL; }
+  HRESULT STDMETHODCALLTYPE SetPropertyProps(mdProperty, DWORD, DWORD,
+      void const*, ULONG, mdMethodDef, mdMethodDef, mdMethodDef*)
+      override { return E_NOTIMPL; }
+  HRESULT STDMETHODCALLTYPE SetParamProps(mdParamDef, LPCWSTR, DWORD, DWORD,
+      void const*, ULONG) override { return E_NOTIMPL; }
+  HRESULT STDMETHODCALLTYPE DefineSecurityAttributeSet(mdToken, COR_SECATTR*,
+      ULONG, ULONG*) override { return E_NOTIMPL; }
+  HRESULT STDMETHODCALLTYPE ApplyEditAndContinue(IUnknown*)
+      override { return E_NOTIMPL; }
+  HRESULT STDMETHODCALLTYPE TranslateSigWithScope(IMetaDataAssemblyImport*,
+      const void*, ULONG, IMetaDataImport*, PCCOR_SIGNATURE, ULONG,
+      IMetaDataAssemblyEmit*, IMetaDataEmit*, PCOR_SIGNATURE, ULONG, ULONG*)
+      override { return E_NOTIMPL; }
+  HRESULT STDMETHODCALLTYPE SetFieldRVA(mdFieldDef, ULONG)
+      override { return E_NOTIMPL; }
+  HRESULT STDMETHODCALLTYPE Merge(IMetaDataImport*, IMapToken*, IUnknown*)
+      override { return E_NOTIMPL; }
+  HRESULT STDMETHODCALLTYPE MergeEnd() override { return E_NOTIMPL; }
+  // IMetaDataEmit2
+  HRESULT STDMETHODCALLTYPE GetDeltaSaveSize(CorSaveSize, DWORD*)
+      override { return E_NOTIMPL; }
+  HRESULT STDMETHODCALLTYPE SaveDelta(LPCWSTR, DWORD)
+      override { return E_NOTIMPL; }
+  HRESULT STDMETHODCALLTYPE SaveDeltaToStream(IStream*, DWORD)
+      override { return E_NOTIMPL; }
+  HRESULT STDMETHODCALLTYPE SaveDeltaToMemory(void*, ULONG)
+      override { return E_NOTIMPL; }
+  HRESULT STDMETHODCALLTYPE DefineGenericParam(mdToken, ULONG, DWORD, LPCWSTR,
+      DWORD, mdToken*, mdGenericParam*) override { return E_NOTIMPL; }
+  HRESULT STDMETHODCALLTYPE SetGenericParamProps(mdGenericParam, DWORD,
+      LPCWSTR, DWORD, mdToken*) override { return E_NOTIMPL; }
+  HRESULT STDMETHODCALLTYPE ResetENCLog() override { return E_NOTIMPL; }
+  // IMetaDataAssemblyImport
+  HRESULT STDMETHODCALLTYPE GetFileProps(mdFile, LPWSTR, ULONG, ULONG*,
+      const void**, ULONG*, DWORD*) override { return E_NOTIMPL; }
+  HRESULT STDMETHODCALLTYPE GetExportedTypeProps(mdExportedType, LPWSTR, ULONG,
+      ULONG*, mdToken*, mdTypeDef*, DWORD*) override { return E_NOTIMPL; }
+  HRESULT STDMETHODCALLTYPE GetManifestResourceProps(mdManifestResource,
+      LPWSTR, ULONG, ULONG*, mdToken*, DWORD*, DWORD*)
+      override { return E_NOTIMPL; }
+  HRESULT STDMETHODCALLTYPE EnumFiles(HCORENUM*, mdFile*, ULONG, ULONG*)
+      override { return E_NOTIMPL; }
+  HRESULT STDMETHODCALLTYPE EnumExportedTypes(HCORENUM*, mdExportedType*,
+      ULONG, ULONG*) override { return E_NOTIMPL; }
+  HRESULT STDMETHODCALLTYPE EnumManifestResources(HCORENUM*,
+      mdManifestResource*, ULONG, ULONG*) override { return E_NOTIMPL; }
+  HRESULT STDMETHODCALLTYPE FindExportedTypeByName(LPCWSTR, mdToken,
+      mdExportedType*) override { return E_NOTIMPL; }
+  HRESULT STDMETHODCALLTYPE FindManifestResourceByName(LPCWSTR,
+      mdManifestResource*) override { return E_NOTIMPL; }
+  HRESULT STDMETHODCALLTYPE FindAssembliesByName(LPCWSTR, LPCWSTR, LPCWSTR,
+      IUnknown**, ULONG, ULONG*) override { return E_NOTIMPL; }
+  // IMetaDataAssemblyEmit
+  HRESULT STDMETHODCALLTYPE DefineAssembly(const void*, ULONG, ULONG, LPCWSTR,
+      const ASSEMBLYMETADATA*, DWORD, mdAssembly*)
+      override { return E_NOTIMPL; }
+  HRESULT STDMETHODCALLTYPE DefineFile(LPCWSTR, const void*, ULONG, DWORD,
+      mdFile*) override { return E_NOTIMPL; }
+  HRESULT STDMETHODCALLTYPE DefineExportedType(LPCWSTR, mdToken, mdTypeDef,
+      DWORD, mdExportedType*) override { return E_NOTIMPL; }
+  HRESULT STDMETHODCALLTYPE DefineManifestResource(LPCWSTR, mdToken, DWORD,
+      DWORD, mdManifestResource*) override { return E_NOTIMPL; }
+  HRESULT STDMETHODCALLTYPE SetAssemblyProps(mdAssembly, const void*, ULONG,
+      ULONG, LPCWSTR, const ASSEMBLYMETADATA*, DWORD)
+      override { return E_NOTIMPL; }
+  HRESULT STDMETHODCALLTYPE SetAssemblyRefProps(mdAssemblyRef, const void*,
+      ULONG, LPCWSTR, const ASSEMBLYMETADATA*, const void*, ULONG, DWORD)
+      override { return E_NOTIMPL; }
+  HRESULT STDMETHODCALLTYPE SetFileProps(mdFile, const void*, ULONG, DWORD)
+      override { return E_NOTIMPL; }
+  HRESULT STDMETHODCALLTYPE SetExportedTypeProps(mdExportedType, mdToken,
+      mdTypeDef, DWORD) override { return E_NOTIMPL; }
+  HRESULT STDMETHODCALLTYPE SetManifestResourceProps(mdManifestResource,
+      mdToken, DWORD, DWORD) override { return E_NOTIMPL; }
+};
+
+}  // namespace trace
+
+#endif  // DD_CLR_PROFILER_MOCK_METADATA_H_
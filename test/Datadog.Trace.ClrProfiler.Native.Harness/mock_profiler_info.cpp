@@ -0,0 +1,465 @@
+#include "mock_profiler_info.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <thread>
+
+namespace trace {
+
+namespace {
+
+// Ids of the harness process, the ids of the profiling API are opaque
+const AppDomainID kAppDomainId = 1;
+const ProcessID kProcessId = 1;
+const AssemblyID kAssemblyIdBase = 0x100000;
+const FunctionID kFunctionIdBase = 0x200000;
+
+template <typename Size>
+HRESULT CopyName(const WSTRING& name, WCHAR buffer[], ULONG buffer_size,
+                 Size* name_size) {
+  if (name_size != nullptr) {
+    *name_size = static_cast<Size>(name.size() + 1);
+  }
+  if (buffer == nullptr || buffer_size == 0) {
+    return S_OK;
+  }
+
+  const size_t copied = std::min<size_t>(name.size(), buffer_size - 1);
+  memcpy(buffer, name.c_str(), copied * sizeof(WCHAR));
+  buffer[copied] = 0;
+  return S_OK;
+}
+
+// Size of an IL method body, header and exception sections included
+ULONG GetMethodBodySize(LPCBYTE header) {
+  if ((header[0] & 0x3) == CorILMethod_TinyFormat) {
+    return 1 + (header[0] >> 2);
+  }
+
+  const auto fat = reinterpret_cast<const IMAGE_COR_ILMETHOD_FAT*>(header);
+  ULONG size = fat->Size * 4 + fat->CodeSize;
+  if ((fat->Flags & CorILMethod_MoreSects) == 0) {
+    return size;
+  }
+
+  // The sections are aligned on 4 bytes after the code
+  bool more_sections = true;
+  while (more_sections) {
+    size = (size + 3) & ~3u;
+    const LPCBYTE section = header + size;
+    const bool fat_section = (section[0] & CorILMethod_Sect_FatFormat) != 0;
+    more_sections = (section[0] & CorILMethod_Sect_MoreSects) != 0;
+    size += fat_section ? section[1] | (section[2] << 8) | (section[3] << 16)
+                        : section[1];
+  }
+  return size;
+}
+
+}  // namespace
+
+HRESULT STDMETHODCALLTYPE MockMethodMalloc::QueryInterface(REFIID riid,
+                                                           void** ppvObject) {
+  if (riid == IID_IUnknown || riid == __uuidof(IMethodMalloc)) {
+    *ppvObject = this;
+    return S_OK;
+  }
+  *ppvObject = nullptr;
+  return E_NOINTERFACE;
+}
+
+PVOID STDMETHODCALLTYPE MockMethodMalloc::Alloc(ULONG cb) {
+  // As the runtime allocator, the bodies are never freed
+  return malloc(cb);
+}
+
+HRESULT STDMETHODCALLTYPE
+MockFunctionControl::QueryInterface(REFIID riid, void** ppvObject) {
+  if (riid == IID_IUnknown ||
+      riid == __uuidof(ICorProfilerFunctionControl)) {
+    *ppvObject = this;
+    return S_OK;
+  }
+  *ppvObject = nullptr;
+  return E_NOINTERFACE;
+}
+
+HRESULT STDMETHODCALLTYPE MockFunctionControl::SetILFunctionBody(
+    ULONG cbNewILMethodHeader, LPCBYTE pbNewILMethodHeader) {
+  il_body_.assign(pbNewILMethodHeader,
+                  pbNewILMethodHeader + cbNewILMethodHeader);
+  return S_OK;
+}
+
+MockProfilerInfo::Module* MockProfilerInfo::FindModule(
+    ModuleID module_id) const {
+  if (module_id == 0 || module_id > modules_.size()) {
+    return nullptr;
+  }
+  return modules_[module_id - 1].get();
+}
+
+ModuleID MockProfilerInfo::LoadModule(const WSTRING& path) {
+  std::unique_ptr<Module> module(new Module());
+  std::ifstream file(ToString(path), std::ios::binary);
+  module->image.assign(std::istreambuf_iterator<char>(file),
+                       std::istreambuf_iterator<char>());
+  if (module->image.empty()) {
+    return 0;
+  }
+
+  // The file is read as is, so the image has the flat (on disk) layout
+  module->metadata_reader =
+      MetadataReader(module->image.data(), COR_PRF_MODULE_FLAT_LAYOUT);
+  AssemblyRow assembly_row;
+  if (!module->metadata_reader.IsValid() ||
+      !module->metadata_reader.GetAssembly(&assembly_row)) {
+    return 0;
+  }
+
+  module->path = path;
+  module->assembly_name = ToWSTRING(assembly_row.name);
+  module->metadata.Copy(static_cast<IMetaDataImport2*>(
+      new MockMetadata(module->metadata_reader)));
+
+  std::lock_guard<std::mutex> guard(lock_);
+  module->id = modules_.size() + 1;
+  module->assembly_id = kAssemblyIdBase + module->id;
+  modules_.push_back(std::move(module));
+  return modules_.back()->id;
+}
+
+AssemblyID MockProfilerInfo::GetAssemblyId(ModuleID module_id) const {
+  std::lock_guard<std::mutex> guard(lock_);
+  const auto module = FindModule(module_id);
+  return module == nullptr ? 0 : module->assembly_id;
+}
+
+WSTRING MockProfilerInfo::GetAssemblyName(ModuleID module_id) const {
+  std::lock_guard<std::mutex> guard(lock_);
+  const auto module = FindModule(module_id);
+  return module == nullptr ? WSTRING() : module->assembly_name;
+}
+
+std::vector<mdMethodDef> MockProfilerInfo::GetMethodsWithBody(
+    ModuleID module_id) const {
+  std::vector<mdMethodDef> methods;
+  std::lock_guard<std::mutex> guard(lock_);
+  const auto module = FindModule(module_id);
+  if (module == nullptr) {
+    return methods;
+  }
+
+  const auto& metadata_reader = module->metadata_reader;
+  const ULONG count = metadata_reader.GetRowCount(MetadataTable::MethodDef);
+  MethodDefRow row;
+  for (ULONG rid = 1; rid <= count; rid++) {
+    if (metadata_reader.GetMethodDef(rid, &row) && row.rva != 0 &&
+        metadata_reader.GetRvaAddress(row.rva) != nullptr) {
+      methods.push_back(TokenFromRid(rid, mdtMethodDef));
+    }
+  }
+  return methods;
+}
+
+FunctionID MockProfilerInfo::GetFunctionId(ModuleID module_id,
+                                           mdMethodDef method_def) {
+  std::lock_guard<std::mutex> guard(lock_);
+  const auto key = std::make_pair(module_id, method_def);
+  const auto search = function_ids_.find(key);
+  if (search != function_ids_.end()) {
+    return search->second;
+  }
+
+  const FunctionID function_id = kFunctionIdBase + functions_.size();
+  functions_.push_back(key);
+  function_ids_.emplace(key, function_id);
+  return function_id;
+}
+
+std::vector<ReJitRequest> MockProfilerInfo::TakeReJitRequests() {
+  std::lock_guard<std::mutex> guard(lock_);
+  std::vector<ReJitRequest> requests;
+  requests.swap(rejit_requests_);
+  return requests;
+}
+
+std::vector<ReJitRequest> MockProfilerInfo::WaitForReJitRequests(
+    ULONG idle_ms) {
+  std::vector<ReJitRequest> requests;
+  auto last_request = std::chrono::steady_clock::now();
+  while (std::chrono::steady_clock::now() - last_request <
+         std::chrono::milliseconds(idle_ms)) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    const auto new_requests = TakeReJitRequests();
+    if (!new_requests.empty()) {
+      requests.insert(requests.end(), new_requests.begin(),
+                      new_requests.end());
+      last_request = std::chrono::steady_clock::now();
+    }
+  }
+  return requests;
+}
+
+size_t MockProfilerInfo::GetReJitRequestCount() const {
+  std::lock_guard<std::mutex> guard(lock_);
+  return rejit_requests_.size();
+}
+
+ULONG MockProfilerInfo::GetReplacedBodyCount() const {
+  std::lock_guard<std::mutex> guard(lock_);
+  return replaced_body_count_;
+}
+
+size_t MockProfilerInfo::GetDefinedRowCount() const {
+  std::lock_guard<std::mutex> guard(lock_);
+  size_t count = 0;
+  for (const auto& module : modules_) {
+    count += static_cast<MockMetadata*>(
+                 static_cast<IMetaDataImport2*>(module->metadata.Get()))
+                 ->GetDefinedRowCount();
+  }
+  return count;
+}
+
+//
+// IUnknown
+//
+
+HRESULT STDMETHODCALLTYPE MockProfilerInfo::QueryInterface(REFIID riid,
+                                                           void** ppvObject) {
+  if (riid == IID_IUnknown || riid == __uuidof(ICorProfilerInfo) ||
+      riid == __uuidof(ICorProfilerInfo2) ||
+      riid == __uuidof(ICorProfilerInfo3) ||
+      riid == __uuidof(ICorProfilerInfo4)) {
+    *ppvObject = static_cast<ICorProfilerInfo4*>(this);
+    AddRef();
+    return S_OK;
+  }
+
+  // The newer interfaces are optional, the profiler falls back on
+  // ICorProfilerInfo4
+  *ppvObject = nullptr;
+  return E_NOINTERFACE;
+}
+
+ULONG STDMETHODCALLTYPE MockProfilerInfo::AddRef() {
+  return std::atomic_fetch_add(&ref_count_, 1UL) + 1;
+}
+
+ULONG STDMETHODCALLTYPE MockProfilerInfo::Release() {
+  // The harness owns the instance, it isn't deleted on the last release
+  return std::atomic_fetch_sub(&ref_count_, 1UL) - 1;
+}
+
+//
+// ICorProfilerInfo
+//
+
+HRESULT STDMETHODCALLTYPE MockProfilerInfo::GetEventMask(DWORD* pdwEvents) {
+  std::lock_guard<std::mutex> guard(lock_);
+  *pdwEvents = event_mask_;
+  return S_OK;
+}
+
+HRESULT STDMETHODCALLTYPE MockProfilerInfo::SetEventMask(DWORD dwEvents) {
+  std::lock_guard<std::mutex> guard(lock_);
+  event_mask_ = dwEvents;
+  return S_OK;
+}
+
+HRESULT STDMETHODCALLTYPE MockProfilerInfo::GetFunctionInfo(
+    FunctionID functionId, ClassID* pClassId, ModuleID* pModuleId,
+    mdToken* pToken) {
+  std::lock_guard<std::mutex> guard(lock_);
+  if (functionId < kFunctionIdBase ||
+      functionId - kFunctionIdBase >= functions_.size()) {
+    return E_INVALIDARG;
+  }
+
+  const auto& function = functions_[functionId - kFunctionIdBase];
+  if (pClassId != nullptr) {
+    *pClassId = 0;
+  }
+  if (pModuleId != nullptr) {
+    *pModuleId = function.first;
+  }
+  if (pToken != nullptr) {
+    *pToken = function.second;
+  }
+  return S_OK;
+}
+
+HRESULT STDMETHODCALLTYPE MockProfilerInfo::GetModuleInfo(
+    ModuleID moduleId, LPCBYTE* ppBaseLoadAddress, ULONG cchName,
+    ULONG* pcchName, WCHAR szName[], AssemblyID* pAssemblyId) {
+  return GetModuleInfo2(moduleId, ppBaseLoadAddress, cchName, pcchName, szName,
+                        pAssemblyId, nullptr);
+}
+
+HRESULT STDMETHODCALLTYPE MockProfilerInfo::GetModuleMetaData(
+    ModuleID moduleId, DWORD dwOpenFlags, REFIID riid, IUnknown** ppOut) {
+  std::lock_guard<std::mutex> guard(lock_);
+  const auto module = FindModule(moduleId);
+  if (module == nullptr) {
+    return E_INVALIDARG;
+  }
+  return module->metadata->QueryInterface(riid,
+                                          reinterpret_cast<void**>(ppOut));
+}
+
+HRESULT STDMETHODCALLTYPE MockProfilerInfo::GetILFunctionBody(
+    ModuleID moduleId, mdMethodDef methodId, LPCBYTE* ppMethodHeader,
+    ULONG* pcbMethodSize) {
+  std::lock_guard<std::mutex> guard(lock_);
+  const auto module = FindModule(moduleId);
+  if (module == nullptr) {
+    return E_INVALIDARG;
+  }
+
+  LPCBYTE body = nullptr;
+  const auto replaced = module->il_bodies.find(methodId);
+  if (replaced != module->il_bodies.end()) {
+    body = replaced->second.data();
+  } else {
+    MethodDefRow row;
+    if (!module->metadata_reader.GetMethodDef(RidFromToken(methodId), &row) ||
+        row.rva == 0) {
+      return CORPROF_E_FUNCTION_NOT_IL;
+    }
+    body = module->metadata_reader.GetRvaAddress(row.rva);
+    if (body == nullptr) {
+      return CORPROF_E_FUNCTION_NOT_IL;
+    }
+  }
+
+  if (ppMethodHeader != nullptr) {
+    *ppMethodHeader = body;
+  }
+  if (pcbMethodSize != nullptr) {
+    *pcbMethodSize = GetMethodBodySize(body);
+  }
+  return S_OK;
+}
+
+HRESULT STDMETHODCALLTYPE MockProfilerInfo::GetILFunctionBodyAllocator(
+    ModuleID moduleId, IMethodMalloc** ppMalloc) {
+  *ppMalloc = &method_malloc_;
+  return S_OK;
+}
+
+HRESULT STDMETHODCALLTYPE MockProfilerInfo::SetILFunctionBody(
+    ModuleID moduleId, mdMethodDef methodid, LPCBYTE pbNewILMethodHeader) {
+  std::lock_guard<std::mutex> guard(lock_);
+  const auto module = FindModule(moduleId);
+  if (module == nullptr) {
+    return E_INVALIDARG;
+  }
+
+  module->il_bodies[methodid].assign(
+      pbNewILMethodHeader,
+      pbNewILMethodHeader + GetMethodBodySize(pbNewILMethodHeader));
+  replaced_body_count_++;
+  return S_OK;
+}
+
+HRESULT STDMETHODCALLTYPE MockProfilerInfo::GetAppDomainInfo(
+    AppDomainID appDomainId, ULONG cchName, ULONG* pcchName, WCHAR szName[],
+    ProcessID* pProcessId) {
+  if (appDomainId != kAppDomainId) {
+    return E_INVALIDARG;
+  }
+  if (pProcessId != nullptr) {
+    *pProcessId = kProcessId;
+  }
+  return CopyName("clrhost"_W, szName, cchName, pcchName);
+}
+
+HRESULT STDMETHODCALLTYPE MockProfilerInfo::GetAssemblyInfo(
+    AssemblyID assemblyId, ULONG cchName, ULONG* pcchName, WCHAR szName[],
+    AppDomainID* pAppDomainId, ModuleID* pModuleId) {
+  std::lock_guard<std::mutex> guard(lock_);
+  const auto module = FindModule(assemblyId - kAssemblyIdBase);
+  if (module == nullptr) {
+    return E_INVALIDARG;
+  }
+
+  if (pAppDomainId != nullptr) {
+    *pAppDomainId = kAppDomainId;
+  }
+  if (pModuleId != nullptr) {
+    *pModuleId = module->id;
+  }
+  return CopyName(module->assembly_name, szName, cchName, pcchName);
+}
+
+//
+// ICorProfilerInfo3
+//
+
+HRESULT STDMETHODCALLTYPE MockProfilerInfo::GetRuntimeInformation(
+    USHORT* pClrInstanceId, COR_PRF_RUNTIME_TYPE* pRuntimeType,
+    USHORT* pMajorVersion, USHORT* pMinorVersion, USHORT* pBuildNumber,
+    USHORT* pQFEVersion, ULONG cchVersionString, ULONG* pcchVersionString,
+    WCHAR szVersionString[]) {
+  if (pClrInstanceId != nullptr) {
+    *pClrInstanceId = 0;
+  }
+  if (pRuntimeType != nullptr) {
+    *pRuntimeType = COR_PRF_CORE_CLR;
+  }
+  if (pMajorVersion != nullptr) {
+    *pMajorVersion = 5;
+  }
+  if (pMinorVersion != nullptr) {
+    *pMinorVersion = 0;
+  }
+  if (pBuildNumber != nullptr) {
+    *pBuildNumber = 0;
+  }
+  if (pQFEVersion != nullptr) {
+    *pQFEVersion = 0;
+  }
+  return CopyName("5.0.0"_W, szVersionString, cchVersionString,
+                  pcchVersionString);
+}
+
+HRESULT STDMETHODCALLTYPE MockProfilerInfo::GetModuleInfo2(
+    ModuleID moduleId, LPCBYTE* ppBaseLoadAddress, ULONG cchName,
+    ULONG* pcchName, WCHAR szName[], AssemblyID* pAssemblyId,
+    DWORD* pdwModuleFlags) {
+  std::lock_guard<std::mutex> guard(lock_);
+  const auto module = FindModule(moduleId);
+  if (module == nullptr) {
+    return E_INVALIDARG;
+  }
+
+  if (ppBaseLoadAddress != nullptr) {
+    *ppBaseLoadAddress = module->image.data();
+  }
+  if (pAssemblyId != nullptr) {
+    *pAssemblyId = module->assembly_id;
+  }
+  if (pdwModuleFlags != nullptr) {
+    *pdwModuleFlags = COR_PRF_MODULE_DISK | COR_PRF_MODULE_FLAT_LAYOUT;
+  }
+  return CopyName(module->path, szName, cchName, pcchName);
+}
+
+//
+// ICorProfilerInfo4
+//
+
+HRESULT STDMETHODCALLTYPE MockProfilerInfo::RequestReJIT(
+    ULONG cFunctions, ModuleID moduleIds[], mdMethodDef methodIds[]) {
+  std::lock_guard<std::mutex> guard(lock_);
+  for (ULONG i = 0; i < cFunctions; i++) {
+    rejit_requests_.push_back({moduleIds[i], methodIds[i]});
+  }
+  return S_OK;
+}
+
+}  // namespace trace
@@ -0,0 +1,335 @@
+#ifndef DD_CLR_PROFILER_MOCK_PROFILER_INFO_H_
+#define DD_CLR_PROFILER_MOCK_PROFILER_INFO_H_
+
+#include <corhlpr.h>
+#include <corprof.h>
+
+#include <atomic>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "../../src/Datadog.Trace.ClrProfiler.Native/com_ptr.h"
+#include "../../src/Datadog.Trace.ClrProfiler.Native/metadata_reader.h"
+#include "../../src/Datadog.Trace.ClrProfiler.Native/string.h"
+#include "mock_metadata.h"
+
+namespace trace {
+
+// Creates the profiler through its class factory, as the runtime does. It is
+// defined in create_profiler.cpp, linked with the dllmain.cpp of the profiler.
+HRESULT CreateProfiler(ICorProfilerCallback4** profiler);
+
+// A method the profiler requested a ReJIT for
+struct ReJitRequest {
+  ModuleID module_id;
+  mdMethodDef method_def;
+};
+
+/// <summary>
+/// The IL body allocator of the profiler harness, the bodies live as long as
+/// the process.
+/// </summary>
+class MockMethodMalloc : public IMethodMalloc {
+ public:
+  HRESULT STDMETHODCALLTYPE QueryInterface(REFIID riid,
+                                           void** ppvObject) override;
+  ULONG STDMETHODCALLTYPE AddRef() override { return 1; }
+  ULONG STDMETHODCALLTYPE Release() override { return 1; }
+  PVOID STDMETHODCALLTYPE Alloc(ULONG cb) override;
+};
+
+/// <summary>
+/// The ICorProfilerFunctionControl of a GetReJITParameters call, it keeps the
+/// IL body the profiler sets.
+/// </summary>
+class MockFunctionControl : public ICorProfilerFunctionControl {
+ private:
+  std::vector<BYTE> il_body_;
+
+ public:
+  const std::vector<BYTE>& GetILBody() const { return il_body_; }
+
+  HRESULT STDMETHODCALLTYPE QueryInterface(REFIID riid,
+                                           void** ppvObject) override;
+  ULONG STDMETHODCALLTYPE AddRef() override { return 1; }
+  ULONG STDMETHODCALLTYPE Release() override { return 1; }
+  HRESULT STDMETHODCALLTYPE SetCodegenFlags(DWORD flags) override {
+    return S_OK;
+  }
+  HRESULT STDMETHODCALLTYPE SetILFunctionBody(
+      ULONG cbNewILMethodHeader, LPCBYTE pbNewILMethodHeader) override;
+  HRESULT STDMETHODCALLTYPE SetILInstrumentedCodeMap(
+      ULONG cILMapEntries, COR_IL_MAP rgILMapEntries[]) override {
+    return S_OK;
+  }
+};
+
+/// <summary>
+/// The ICorProfilerInfo4 of the profiler harness. The modules are PE files
+/// read from disk, their metadata is served by a MockMetadata. The ReJIT
+/// requests of the profiler are recorded for the harness to replay. Only the
+/// methods the profiler calls are implemented, the others return E_NOTIMPL.
+/// </summary>
+class MockProfilerInfo : public ICorProfilerInfo4 {
+ private:
+  struct Module {
+    ModuleID id;
+    AssemblyID assembly_id;
+    WSTRING path;
+    WSTRING assembly_name;
+    std::vector<BYTE> image;
+    MetadataReader metadata_reader;
+    ComPtr<IUnknown> metadata;
+    // IL bodies set by the profiler, by method
+    std::unordered_map<mdMethodDef, std::vector<BYTE>> il_bodies;
+  };
+
+  std::atomic<ULONG> ref_count_{0};
+  MockMethodMalloc method_malloc_;
+
+  // The modules stay loaded until the harness ends, the profiler may still
+  // hold their metadata after ModuleUnloadStarted
+  mutable std::mutex lock_;
+  std::vector<std::unique_ptr<Module>> modules_;
+  std::map<std::pair<ModuleID, mdMethodDef>, FunctionID> function_ids_;
+  std::vector<std::pair<ModuleID, mdMethodDef>> functions_;
+  std::vector<ReJitRequest> rejit_requests_;
+  DWORD event_mask_ = 0;
+  ULONG replaced_body_count_ = 0;
+
+  Module* FindModule(ModuleID module_id) const;
+
+  MockProfilerInfo(const MockProfilerInfo&) = delete;
+  MockProfilerInfo& operator=(const MockProfilerInfo&) = delete;
+
+ public:
+  MockProfilerInfo() = default;
+  virtual ~MockProfilerInfo() = default;
+
+  // Reads a PE file, returns 0 if the file has no readable metadata
+  ModuleID LoadModule(const WSTRING& path);
+  AssemblyID GetAssemblyId(ModuleID module_id) const;
+  WSTRING GetAssemblyName(ModuleID module_id) const;
+
+  // The methods of the module with an IL body
+  std::vector<mdMethodDef> GetMethodsWithBody(ModuleID module_id) const;
+  FunctionID GetFunctionId(ModuleID module_id, mdMethodDef method_def);
+
+  // The ReJIT requests made since the previous call
+  std::vector<ReJitRequest> TakeReJitRequests();
+
+  // The module analysis and the ReJIT requests run on the threads of the
+  // profiler, waits until no request was made for the idle time
+  std::vector<ReJitRequest> WaitForReJitRequests(ULONG idle_ms);
+
+  size_t GetReJitRequestCount() const;
+  ULONG GetReplacedBodyCount() const;
+  size_t GetDefinedRowCount() const;
+
+  // IUnknown
+  HRESULT STDMETHODCALLTYPE QueryInterface(REFIID riid,
+                                           void** ppvObject) override;
+  ULONG STDMETHODCALLTYPE AddRef() override;
+  ULONG STDMETHODCALLTYPE Release() override;
+
+  // ICorProfilerInfo
+  HRESULT STDMETHODCALLTYPE GetEventMask(DWORD* pdwEvents) override;
+  HRESULT STDMETHODCALLTYPE SetEventMask(DWORD dwEvents) override;
+  HRESULT STDMETHODCALLTYPE GetFunctionInfo(FunctionID functionId,
+                                            ClassID* pClassId,
+                                            ModuleID* pModuleId,
+                                            mdToken* pToken) override;
+  HRESULT STDMETHODCALLTYPE GetModuleInfo(ModuleID moduleId,
+                                          LPCBYTE* ppBaseLoadAddress,
+                                          ULONG cchName, ULONG* pcchName,
+                                          WCHAR szName[],
+                                          AssemblyID* pAssemblyId) override;
+  HRESULT STDMETHODCALLTYPE GetModuleMetaData(ModuleID moduleId,
+                                              DWORD dwOpenFlags, REFIID riid,
+                                              IUnknown** ppOut) override;
+  HRESULT STDMETHODCALLTYPE GetILFunctionBody(ModuleID moduleId,
+                                              mdMethodDef methodId,
+                                              LPCBYTE* ppMethodHeader,
+                                              ULONG* pcbMethodSize) override;
+  HRESULT STDMETHODCALLTYPE GetILFunctionBodyAllocator(
+      ModuleID moduleId, IMethodMalloc** ppMalloc) override;
+  HRESULT STDMETHODCALLTYPE SetILFunctionBody(
+      ModuleID moduleId, mdMethodDef methodid,
+      LPCBYTE pbNewILMethodHeader) override;
+  HRESULT STDMETHODCALLTYPE GetAppDomainInfo(AppDomainID appDomainId,
+                                             ULONG cchName, ULONG* pcchName,
+                                             WCHAR szName[],
+                                             ProcessID* pProcessId) override;
+  HRESULT STDMETHODCALLTYPE GetAssemblyInfo(AssemblyID assemblyId,
+                                            ULONG cchName, ULONG* pcchName,
+                                            WCHAR szName[],
+                                            AppDomainID* pAppDomainId,
+                                            ModuleID* pModuleId) override;
+
+  // ICorProfilerInfo3
+  HRESULT STDMETHODCALLTYPE GetRuntimeInformation(
+      USHORT* pClrInstanceId, COR_PRF_RUNTIME_TYPE* pRuntimeType,
+      USHORT* pMajorVersion, USHORT* pMinorVersion, USHORT* pBuildNumber,
+      USHORT* pQFEVersion, ULONG cchVersionString, ULONG* pcchVersionString,
+      WCHAR szVersionString[]) override;
+  HRESULT STDMETHODCALLTYPE GetModuleInfo2(ModuleID moduleId,
+                                           LPCBYTE* ppBaseLoadAddress,
+                                           ULONG cchName, ULONG* pcchName,
+                                           WCHAR szName[],
+                                           AssemblyID* pAssemblyId,
+                                           DWORD* pdwModuleFlags) override;
+
+  // ICorProfilerInfo4
+  HRESULT STDMETHODCALLTYPE InitializeCurrentThread() override {
+    return S_OK;
+  }
+  HRESULT STDMETHODCALLTYPE RequestReJIT(ULONG cFunctions,
+                                         ModuleID moduleIds[],
+                                         mdMethodDef methodIds[]) override;
+
+  // Not used by the profiler
+  // ICorProfilerInfo
+  HRESULT STDMETHODCALLTYPE GetClassFromObject(ObjectID, ClassID*)
+      override { return E_NOTIMPL; }
+  HRESULT STDMETHODCALLTYPE GetClassFromToken(ModuleID, mdTypeDef, ClassID*)
+      override { return E_NOTIMPL; }
+  HRESULT STDMETHODCALLTYPE GetCodeInfo(FunctionID, LPCBYTE*, ULONG*)
+      override { return E_NOTIMPL; }
+  HRESULT STDMETHODCALLTYPE GetFunctionFromIP(LPCBYTE, FunctionID*)
+      override { return E_NOTIMPL; }
+  HRESULT STDMETHODCALLTYPE GetFunctionFromToken(ModuleID, mdToken,
+      FunctionID*) override { return E_NOTIMPL; }
+  HRESULT STDMETHODCALLTYPE GetHandleFromThread(ThreadID, HANDLE*)
+      override { return E_NOTIMPL; }
+  HRESULT STDMETHODCALLTYPE GetObjectSize(ObjectID, ULONG*)
+      override { return E_NOTIMPL; }
+  HRESULT STDMETHODCALLTYPE IsArrayClass(ClassID, CorElementType*, ClassID*,
+      ULONG*) override { return E_NOTIMPL; }
+  HRESULT STDMETHODCALLTYPE GetThreadInfo(ThreadID, DWORD*)
+      override { return E_NOTIMPL; }
+  HRESULT STDMETHODCALLTYPE GetCurrentThreadID(ThreadID*)
+      override { return E_NOTIMPL; }
+  HRESULT STDMETHODCALLTYPE GetClassIDInfo(ClassID, ModuleID*, mdTypeDef*)
+      override { return E_NOTIMPL; }
+  HRESULT STDMETHODCALLTYPE SetEnterLeaveFunctionHooks(FunctionEnter*,
+      FunctionLeave*, FunctionTailcall*) override { return E_NOTIMPL; }
+  HRESULT STDMETHODCALLTYPE SetFunctionIDMapper(FunctionIDMapper*)
+      override { return E_NOTIMPL; }
+  HRESULT STDMETHODCALLTYPE GetTokenAndMetaDataFromFunction(FunctionID, REFIID,
+      IUnknown**, mdToken*) override { return E_NOTIMPL; }
+  HRESULT STDMETHODCALLTYPE SetFunctionReJIT(FunctionID)
+      override { return E_NOTIMPL; }
+  HRESULT STDMETHODCALLTYPE ForceGC() override { return E_NOTIMPL; }
+  HRESULT STDMETHODCALLTYPE SetILInstrumentedCodeMap(FunctionID, BOOL, ULONG,
+      COR_IL_MAP*) override { return E_NOTIMPL; }
+  HRESULT STDMETHODCALLTYPE GetInprocInspectionInterface(IUnknown**)
+      override { return E_NOTIMPL; }
+  HRESULT STDMETHODCALLTYPE GetInprocInspectionIThisThread(IUnknown**)
+      override { return E_NOTIMPL; }
+  HRESULT STDMETHODCALLTYPE GetThreadContext(ThreadID, ContextID*)
+      override { return E_NOTIMPL; }
+  HRESULT STDMETHODCALLTYPE BeginInprocDebugging(BOOL, DWORD*)
+      override { return E_NOTIMPL; }
+  HRESULT STDMETHODCALLTYPE EndInprocDebugging(DWORD)
+      override { return E_NOTIMPL; }
+  HRESULT STDMETHODCALLTYPE GetILToNativeMapping(FunctionID, ULONG32, ULONG32*,
+      COR_DEBUG_IL_TO_NATIVE_MAP*) override { return E_NOTIMPL; }
+  // ICorProfilerInfo2
+  HRESULT STDMETHODCALLTYPE DoStackSnapshot(ThreadID, StackSnapshotCallback*,
+      ULONG32, void*, BYTE*, ULONG32) override { return E_NOTIMPL; }
+  HRESULT STDMETHODCALLTYPE SetEnterLeaveFunctionHooks2(FunctionEnter2*,
+      FunctionLeave2*, FunctionTailcall2*) override { return E_NOTIMPL; }
+  HRESULT STDMETHODCALLTYPE GetFunctionInfo2(FunctionID, COR_PRF_FRAME_INFO,
+      ClassID*, ModuleID*, mdToken*, ULONG32, ULONG32*, ClassID*)
+      override { return E_NOTIMPL; }
+  HRESULT STDMETHODCALLTYPE GetStringLayout(ULONG*, ULONG*, ULONG*)
+      override { return E_NOTIMPL; }
+  HRESULT STDMETHODCALLTYPE GetClassLayout(ClassID, COR_FIELD_OFFSET*, ULONG,
+      ULONG*, ULONG*) override { return E_NOTIMPL; }
+  HRESULT STDMETHODCALLTYPE GetClassIDInfo2(ClassID, ModuleID*, mdTypeDef*,
+      ClassID*, ULONG32, ULONG32*, ClassID*) override { return E_NOTIMPL; }
+  HRESULT STDMETHODCALLTYPE GetCodeInfo2(FunctionID, ULONG32, ULONG32*,
+      COR_PRF_CODE_INFO*) override { return E_NOTIMPL; }
+  HRESULT STDMETHODCALLTYPE GetClassFromTokenAndTypeArgs(ModuleID, mdTypeDef,
+      ULONG32, ClassID*, ClassID*) override { return E_NOTIMPL; }
+  HRESULT STDMETHODCALLTYPE GetFunctionFromTokenAndTypeArgs(ModuleID,
+      mdMethodDef, ClassID, ULONG32, ClassID*, FunctionID*)
+      override { return E_NOTIMPL; }
+  HRESULT STDMETHODCALLTYPE EnumModuleFrozenObjects(ModuleID,
+      ICorProfilerObjectEnum**) override { return E_NOTIMPL; }
+  HRESULT STDMETHODCALLTYPE GetArrayObjectInfo(ObjectID, ULONG32, ULONG32*,
+      int*, BYTE**) override { return E_NOTIMPL; }
+  HRESULT STDMETHODCALLTYPE GetBoxClassLayout(ClassID, ULONG32*)
+      override { return E_NOTIMPL; }
+  HRESULT STDMETHODCALLTYPE GetThreadAppDomain(ThreadID, AppDomainID*)
+      override { return E_NOTIMPL; }
+  HRESULT STDMETHODCALLTYPE GetRVAStaticAddress(ClassID, mdFieldDef, void**)
+      override { return E_NOTIMPL; }
+  HRESULT STDMETHODCALLTYPE GetAppDomainStaticAddress(ClassID, mdFieldDef,
+      AppDomainID, void**) override { return E_NOTIMPL; }
+  HRESULT STDMETHODCALLTYPE GetThreadStaticAddress(ClassID, mdFieldDef,
+      ThreadID, void**) override { return E_NOTIMPL; }
+  HRESULT STDMETHODCALLTYPE GetContextStaticAddress(ClassID, mdFieldDef,
+      ContextID, void**) override { return E_NOTIMPL; }
+  HRESULT STDMETHODCALLTYPE GetStaticFieldInfo(ClassID, mdFieldDef,
+      COR_PRF_STATIC_TYPE*) override { return E_NOTIMPL; }
+  HRESULT STDMETHODCALLTYPE GetGenerationBounds(ULONG, ULONG*,
+      COR_PRF_GC_GENERATION_RANGE*) override { return E_NOTIMPL; }
+  HRESULT STDMETHODCALLTYPE GetObjectGeneration(ObjectID,
+      COR_PRF_GC_GENERATION_RANGE*) override { return E_NOTIMPL; }
+  HRESULT STDMETHODCALLTYPE GetNotifiedExceptionClauseInfo(COR_PRF_EX_CLAUSE_INFO*)
+      override { return E_NOTIMPL; }
+  // ICorProfilerInfo3
+  HRESULT STDMETHODCALLTYPE EnumJITedFunctions(ICorProfilerFunctionEnum**)
+      override { return E_NOTIMPL; }
+  HRESULT STDMETHODCALLTYPE RequestProfilerDetach(DWORD)
+      override { return E_NOTIMPL; }
+  HRESULT STDMETHODCALLTYPE SetFunctionIDMapper2(FunctionIDMapper2*, void*)
+      override { return E_NOTIMPL; }
+  HRESULT STDMETHODCALLTYPE GetStringLayout2(ULONG*, ULONG*)
+      override { return E_NOTIMPL; }
+  HRESULT STDMETHODCALLTYPE SetEnterLeaveFunctionHooks3(FunctionEnter3*,
+      FunctionLeave3*, FunctionTailcall3*) override { return E_NOTIMPL; }
+  HRESULT STDMETHODCALLTYPE SetEnterLeaveFunctionHooks3WithInfo(FunctionEnter3WithInfo*,
+      FunctionLeave3WithInfo*, FunctionTailcall3WithInfo*)
+      override { return E_NOTIMPL; }
+  HRESULT STDMETHODCALLTYPE GetFunctionEnter3Info(FunctionID, COR_PRF_ELT_INFO,
+      COR_PRF_FRAME_INFO*, ULONG*, COR_PRF_FUNCTION_ARGUMENT_INFO*)
+      override { return E_NOTIMPL; }
+  HRESULT STDMETHODCALLTYPE GetFunctionLeave3Info(FunctionID, COR_PRF_ELT_INFO,
+      COR_PRF_FRAME_INFO*, COR_PRF_FUNCTION_ARGUMENT_RANGE*)
+      override { return E_NOTIMPL; }
+  HRESULT STDMETHODCALLTYPE GetFunctionTailcall3Info(FunctionID,
+      COR_PRF_ELT_INFO, COR_PRF_FRAME_INFO*) override { return E_NOTIMPL; }
+  HRESULT STDMETHODCALLTYPE EnumModules(ICorProfilerModuleEnum**)
+      override { return E_NOTIMPL; }
+  HRESULT STDMETHODCALLTYPE GetThreadStaticAddress2(ClassID, mdFieldDef,
+      AppDomainID, ThreadID, void**) override { return E_NOTIMPL; }
+  HRESULT STDMETHODCALLTYPE GetAppDomainsContainingModule(ModuleID, ULONG32,
+      ULONG32*, AppDomainID*) override { return E_NOTIMPL; }
+  // ICorProfilerInfo4
+  HRESULT STDMETHODCALLTYPE EnumThreads(ICorProfilerThreadEnum**)
+      override { return E_NOTIMPL; }
+  HRESULT STDMETHODCALLTYPE RequestRevert(ULONG, ModuleID*, mdMethodDef*,
+      HRESULT*) override { return E_NOTIMPL; }
+  HRESULT STDMETHODCALLTYPE GetCodeInfo3(FunctionID, ReJITID, ULONG32,
+      ULONG32*, COR_PRF_CODE_INFO*) override { return E_NOTIMPL; }
+  HRESULT STDMETHODCALLTYPE GetFunctionFromIP2(LPCBYTE, FunctionID*, ReJITID*)
+      override { return E_NOTIMPL; }
+  HRESULT STDMETHODCALLTYPE GetReJITIDs(FunctionID, ULONG, ULONG*, ReJITID*)
+      override { return E_NOTIMPL; }
+  HRESULT STDMETHODCALLTYPE GetILToNativeMapping2(FunctionID, ReJITID, ULONG32,
+      ULONG32*, COR_DEBUG_IL_TO_NATIVE_MAP*) override { return E_NOTIMPL; }
+  HRESULT STDMETHODCALLTYPE EnumJITedFunctions2(ICorProfilerFunctionEnum**)
+      override { return E_NOTIMPL; }
+  HRESULT STDMETHODCALLTYPE GetObjectSize2(ObjectID, SIZE_T*)
+      override { return E_NOTIMPL; }
+};
+
+}  // namespace trace
+
+#endif  // DD_CLR_PROFILER_MOCK_PROFILER_INFO_H_
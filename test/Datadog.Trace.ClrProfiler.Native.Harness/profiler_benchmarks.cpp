@@ -0,0 +1,448 @@
+// Microbenchmarks of the hot paths of the profiler, reported as JSON in the
+// layout of Google Benchmark so the results of two commits can be compared
+// with its tools.
+//
+//   Datadog.Trace.ClrProfiler.Benchmarks [options] [assembly]
+//
+//   --filter <text>          only run the benchmarks with text in their name
+//   --min-time-ms <n>        minimum measured time of a benchmark
+//   --rewrite-methods <n>    methods of the assembly rewritten by CallTarget
+//   --out <file>             write the JSON to a file instead of stdout
+//
+// The benchmarks of the IL rewriter, of the signature parsing and of the
+// CallTarget rewrite run on the method bodies of the assembly, through the
+// mock of the profiling API of the profiler harness. They are skipped when no
+// assembly is given. The integration catalogs are synthetic.
+
+#include <unistd.h>
+
+#include <chrono>
+#include <ctime>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+
+#include "../../src/Datadog.Trace.ClrProfiler.Native/clr_helpers.h"
+#include "../../src/Datadog.Trace.ClrProfiler.Native/environment_variables.h"
+#include "../../src/Datadog.Trace.ClrProfiler.Native/il_rewriter.h"
+#include "../../src/Datadog.Trace.ClrProfiler.Native/integration_loader.h"
+#include "../../src/Datadog.Trace.ClrProfiler.Native/logging.h"
+#include "../../src/Datadog.Trace.ClrProfiler.Native/version.h"
+#include "mock_profiler_info.h"
+#include "synthetic_catalog.h"
+
+using namespace trace;
+
+namespace {
+
+struct Options {
+  std::string assembly_path;
+  std::string filter;
+  std::string output_path;
+  ULONG min_time_ms = 500;
+  ULONG rewrite_methods = 100;
+};
+
+struct BenchmarkResult {
+  std::string name;
+  ULONG64 iterations;
+  double real_time_ns;
+  double items_per_second;
+};
+
+// Accumulates the results of the benchmark bodies, so they are not optimized
+// away
+volatile size_t benchmark_sink = 0;
+
+class BenchmarkRunner {
+ private:
+  const Options& options_;
+  std::vector<BenchmarkResult> results_;
+
+ public:
+  explicit BenchmarkRunner(const Options& options) : options_(options) {}
+
+  bool IsSelected(const std::string& name) const {
+    return options_.filter.empty() ||
+           name.find(options_.filter) != std::string::npos;
+  }
+
+  // Runs the body until the minimum time is reached, an iteration processes
+  // the given number of items
+  void Run(const std::string& name, size_t items,
+           const std::function<size_t()>& body) {
+    if (!IsSelected(name)) {
+      return;
+    }
+
+    const double min_time_ns = options_.min_time_ms * 1e6;
+    ULONG64 iterations = 1;
+    double elapsed_ns = 0;
+    while (true) {
+      const auto start = std::chrono::steady_clock::now();
+      for (ULONG64 i = 0; i < iterations; i++) {
+        benchmark_sink = benchmark_sink + body();
+      }
+      elapsed_ns = std::chrono::duration<double, std::nano>(
+                       std::chrono::steady_clock::now() - start)
+                       .count();
+      if (elapsed_ns >= min_time_ns || iterations >= 1000000000) {
+        break;
+      }
+
+      // Aim past the minimum time, growing by 10x at most
+      const double multiplier =
+          elapsed_ns > 0 ? std::min(10.0, 1.4 * min_time_ns / elapsed_ns)
+                         : 10.0;
+      iterations =
+          std::max(iterations + 1, static_cast<ULONG64>(iterations * multiplier));
+    }
+
+    const BenchmarkResult result{
+        name, iterations, elapsed_ns / iterations,
+        items * iterations / (elapsed_ns / 1e9)};
+    std::cerr << name << ": " << result.real_time_ns << " ns ("
+              << iterations << " iterations)" << std::endl;
+    results_.push_back(result);
+  }
+
+  json ToJson(const std::string& executable) const {
+    char date[32] = {};
+    const std::time_t now = std::time(nullptr);
+    std::strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%S", std::localtime(&now));
+
+    json benchmarks = json::array();
+    for (const auto& result : results_) {
+      benchmarks.push_back({{"name", result.name},
+                            {"run_type", "iteration"},
+                            {"iterations", result.iterations},
+                            {"real_time", result.real_time_ns},
+                            {"time_unit", "ns"},
+                            {"items_per_second", result.items_per_second}});
+    }
+
+    return {{"context",
+             {{"date", date},
+              {"executable", executable},
+              {"num_cpus", std::thread::hardware_concurrency()},
+              {"profiler_version", PROFILER_VERSION},
+              {"assembly", options_.assembly_path}}},
+            {"benchmarks", benchmarks}};
+  }
+};
+
+bool ParseOptions(int argc, char* argv[], Options* options) {
+  for (int i = 1; i < argc; i++) {
+    const std::string argument = argv[i];
+    if (argument.compare(0, 2, "--") != 0) {
+      if (!options->assembly_path.empty()) {
+        return false;
+      }
+      options->assembly_path = argument;
+      continue;
+    }
+
+    if (++i == argc) {
+      return false;
+    }
+    const std::string value = argv[i];
+    try {
+      if (argument == "--filter") {
+        options->filter = value;
+      } else if (argument == "--out") {
+        options->output_path = value;
+      } else if (argument == "--min-time-ms") {
+        options->min_time_ms = std::stoul(value);
+      } else if (argument == "--rewrite-methods") {
+        options->rewrite_methods = std::stoul(value);
+      } else {
+        return false;
+      }
+    } catch (...) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// A catalog of integrations, one in ten targets an assembly of the given
+// names (the assembly of the benchmarks and its references)
+std::string SyntheticCatalog(size_t size,
+                             const std::vector<std::string>& assembly_names) {
+  json catalog = json::array();
+  for (size_t i = 0; i < size; i++) {
+    const std::string assembly =
+        i % 10 == 0 && !assembly_names.empty()
+            ? assembly_names[(i / 10) % assembly_names.size()]
+            : "Synthetic.Assembly" + std::to_string(i % 200);
+    catalog.push_back(SyntheticIntegration(
+        i, SyntheticTarget(assembly, "Synthetic.Type" + std::to_string(i),
+                           "Method", 1)));
+  }
+  return catalog.dump();
+}
+
+std::vector<IntegrationMethod> LoadCatalog(const std::string& catalog) {
+  std::istringstream stream(catalog);
+  return FlattenIntegrations(LoadIntegrationsFromStream(stream), true);
+}
+
+std::vector<std::string> GetAssemblyNames(
+    const MetadataReader& metadata_reader) {
+  std::vector<std::string> assembly_names;
+  AssemblyRow assembly_row;
+  if (metadata_reader.GetAssembly(&assembly_row)) {
+    assembly_names.push_back(assembly_row.name);
+  }
+  AssemblyRefRow row;
+  const auto count = metadata_reader.GetRowCount(MetadataTable::AssemblyRef);
+  for (ULONG rid = 1; rid <= count; rid++) {
+    if (metadata_reader.GetAssemblyRef(rid, &row)) {
+      assembly_names.push_back(row.name);
+    }
+  }
+  return assembly_names;
+}
+
+// The view of the image the profiler reads the module with
+MetadataReader GetMetadataReader(MockProfilerInfo& info, ModuleID module_id) {
+  if (module_id == 0) {
+    return MetadataReader();
+  }
+  const auto module_info = GetModuleInfo(&info, module_id);
+  return MetadataReader(module_info.base_load_address, module_info.flags);
+}
+
+void RunStringBenchmarks(BenchmarkRunner& runner) {
+  const std::string narrow =
+      "System.Threading.Tasks.Task`1<System.Net.Http.HttpResponseMessage>";
+  const WSTRING wide = ToWSTRING(narrow);
+  runner.Run("ToString", 1, [&wide]() { return ToString(wide).size(); });
+  runner.Run("ToWSTRING", 1, [&narrow]() { return ToWSTRING(narrow).size(); });
+}
+
+void RunLoggingBenchmarks(BenchmarkRunner& runner) {
+  const WSTRING type_name = "System.Net.Http.HttpClientHandler"_W;
+  const mdToken token = 0x06000042;
+
+  const bool debug_enabled = debug_logging_enabled;
+  debug_logging_enabled = false;
+  runner.Run("Logging/Debug/Disabled", 1, [&]() {
+    Debug("JITCompilationStarted: function_id=", 42, " token=", token,
+          " name=", type_name, ".SendAsync()");
+    return 1;
+  });
+  debug_logging_enabled = true;
+  runner.Run("Logging/Debug/Enabled", 1, [&]() {
+    Debug("JITCompilationStarted: function_id=", 42, " token=", token,
+          " name=", type_name, ".SendAsync()");
+    return 1;
+  });
+  debug_logging_enabled = debug_enabled;
+
+  runner.Run("Logging/Info", 1, [&]() {
+    Info("ModuleLoadFinished: ", 42, " ", type_name, " AppDomain ", 1);
+    return 1;
+  });
+}
+
+void RunCatalogBenchmarks(BenchmarkRunner& runner,
+                          const MetadataReader& metadata_reader) {
+  const auto assembly_names = GetAssemblyNames(metadata_reader);
+  for (const size_t size : {100, 1000, 10000}) {
+    const auto catalog = SyntheticCatalog(size, assembly_names);
+    const auto suffix = "/" + std::to_string(size);
+
+    runner.Run("LoadIntegrationsFromStream" + suffix, size, [&catalog]() {
+      std::istringstream stream(catalog);
+      return LoadIntegrationsFromStream(stream).size();
+    });
+
+    if (!metadata_reader.IsValid()) {
+      continue;
+    }
+    const auto integration_methods = LoadCatalog(catalog);
+    runner.Run("FilterIntegrationsByTarget" + suffix, size, [&]() {
+      return FilterIntegrationsByTarget(integration_methods,
+                                        ComPtr<IMetaDataAssemblyImport>(),
+                                        metadata_reader)
+          .size();
+    });
+  }
+}
+
+void RunMethodBodyBenchmarks(BenchmarkRunner& runner, MockProfilerInfo& info,
+                             ModuleID module_id) {
+  const auto methods = info.GetMethodsWithBody(module_id);
+  if (methods.empty()) {
+    return;
+  }
+
+  MockFunctionControl function_control;
+  runner.Run("ILRewriter/Import", methods.size(), [&]() {
+    size_t instructions = 0;
+    for (const auto method_def : methods) {
+      ILRewriter rewriter(&info, &function_control, module_id, method_def);
+      if (SUCCEEDED(rewriter.Import())) {
+        instructions++;
+      }
+    }
+    return instructions;
+  });
+
+  std::vector<std::unique_ptr<ILRewriter>> rewriters;
+  for (const auto method_def : methods) {
+    std::unique_ptr<ILRewriter> rewriter(
+        new ILRewriter(&info, &function_control, module_id, method_def));
+    if (SUCCEEDED(rewriter->Import())) {
+      rewriters.push_back(std::move(rewriter));
+    }
+  }
+  runner.Run("ILRewriter/Export", rewriters.size(), [&]() {
+    size_t exported = 0;
+    for (const auto& rewriter : rewriters) {
+      if (SUCCEEDED(rewriter->Export())) {
+        exported++;
+      }
+    }
+    return exported;
+  });
+
+  ComPtr<IUnknown> metadata_interfaces;
+  if (FAILED(info.GetModuleMetaData(module_id, ofRead, IID_IMetaDataImport2,
+                                    metadata_interfaces.GetAddressOf()))) {
+    return;
+  }
+  const auto metadata_import =
+      metadata_interfaces.As<IMetaDataImport2>(IID_IMetaDataImport2);
+  std::vector<FunctionInfo> functions;
+  for (const auto method_def : methods) {
+    const auto function_info = GetFunctionInfo(metadata_import, method_def);
+    if (function_info.IsValid()) {
+      functions.push_back(function_info);
+    }
+  }
+  runner.Run("TryParseSignatureTypes", functions.size(), [&]() {
+    size_t parsed = 0;
+    std::vector<WSTRING> signature_types;
+    for (const auto& function_info : functions) {
+      if (TryParseSignatureTypes(metadata_import, function_info,
+                                 signature_types)) {
+        parsed++;
+      }
+    }
+    return parsed;
+  });
+}
+
+// CallTarget_RewriterCallback runs in GetReJITParameters, for the methods the
+// profiler requested a ReJIT for
+void RunRewriteBenchmark(BenchmarkRunner& runner, const Options& options,
+                         MockProfilerInfo& info, ModuleID module_id) {
+  const std::string name = "CallTarget_RewriterCallback";
+  if (!runner.IsSelected(name)) {
+    return;
+  }
+
+  const auto catalog =
+      RewriteCatalog(info, module_id, options.rewrite_methods);
+  if (catalog.empty()) {
+    std::cerr << name << ": no method of the assembly to rewrite" << std::endl;
+    return;
+  }
+
+  const auto catalog_path = UseSyntheticCatalog(catalog);
+  if (catalog_path.empty()) {
+    return;
+  }
+
+  ICorProfilerCallback4* profiler = nullptr;
+  if (FAILED(CreateProfiler(&profiler))) {
+    unlink(catalog_path.c_str());
+    return;
+  }
+
+  if (SUCCEEDED(profiler->Initialize(static_cast<ICorProfilerInfo4*>(&info)))) {
+    profiler->ModuleLoadFinished(module_id, S_OK);
+
+    // The analysis of the module starts at the latest with its first JIT
+    // compilation
+    const auto methods = info.GetMethodsWithBody(module_id);
+    profiler->JITCompilationStarted(info.GetFunctionId(module_id, methods[0]),
+                                    TRUE);
+
+    const auto requests = info.WaitForReJitRequests(500);
+    if (requests.empty()) {
+      std::cerr << name << ": the profiler requested no ReJIT" << std::endl;
+    } else {
+      MockFunctionControl function_control;
+      runner.Run(name, requests.size(), [&]() {
+        size_t rewritten = 0;
+        for (const auto& request : requests) {
+          if (SUCCEEDED(profiler->GetReJITParameters(
+                  request.module_id, request.method_def, &function_control))) {
+            rewritten++;
+          }
+        }
+        return rewritten;
+      });
+    }
+  }
+
+  profiler->Shutdown();
+  profiler->Release();
+  unlink(catalog_path.c_str());
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  Options options;
+  if (!ParseOptions(argc, argv, &options)) {
+    std::cerr << "Usage: " << argv[0]
+              << " [--filter <text>] [--min-time-ms <n>]"
+                 " [--rewrite-methods <n>] [--out <file>] [assembly]"
+              << std::endl;
+    return 2;
+  }
+
+  // The logging benchmarks write to the log file, keep it out of the logs of
+  // the applications
+  if (GetEnvironmentValue(environment::log_path).empty()) {
+    setenv(ToString(environment::log_path).c_str(),
+           "/tmp/dd-benchmark-native.log", 1);
+  }
+
+  MockProfilerInfo info;
+  ModuleID module_id = 0;
+  if (!options.assembly_path.empty()) {
+    module_id = info.LoadModule(ToWSTRING(options.assembly_path));
+    if (module_id == 0) {
+      std::cerr << "No readable metadata in " << options.assembly_path
+                << std::endl;
+      return 1;
+    }
+  }
+
+  BenchmarkRunner runner(options);
+  RunStringBenchmarks(runner);
+  RunLoggingBenchmarks(runner);
+
+  RunCatalogBenchmarks(runner, GetMetadataReader(info, module_id));
+
+  if (module_id != 0) {
+    RunMethodBodyBenchmarks(runner, info, module_id);
+    RunRewriteBenchmark(runner, options, info, module_id);
+  }
+
+  const auto results = runner.ToJson(argv[0]).dump(2);
+  if (options.output_path.empty()) {
+    std::cout << results << std::endl;
+  } else {
+    std::ofstream(options.output_path) << results << std::endl;
+  }
+  return 0;
+}
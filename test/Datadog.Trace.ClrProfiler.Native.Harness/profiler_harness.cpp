@@ -0,0 +1,705 @@
+// Drives the profiler callbacks from a mock of the profiling API, so the
+// callback paths can be measured without a CLR.
+//
+//   Datadog.Trace.ClrProfiler.Harness [options] <assembly or directory>...
+//   Datadog.Trace.ClrProfiler.Harness --replay <trace> [--idle-ms <n>]
+//                                     [<image directory>...]
+//
+//   --repeat <n>    load every assembly n times, as distinct modules
+//   --jit <n>       JIT callbacks per module, 0 for every method with a body
+//   --threads <n>   threads making the JIT callbacks
+//   --idle-ms <n>   time without new ReJIT requests after which the
+//                   asynchronous analysis of the modules is considered done
+//   --unload        unload the modules before the shutdown
+//   --synthetic-integrations <n>
+//                   instrument the first n methods of the first assembly
+//                   with synthetic CallTarget integrations
+//   --check         exit with 1 if a ReJIT fails or, with synthetic
+//                   integrations, if no method is rewritten
+//   --replay <trace> replay the callbacks recorded by a profiler with
+//                   DD_CLR_CALLBACK_RECORDING_PATH, the images missing from
+//                   their recorded path are searched in the directories
+//
+// The profiler reads its configuration as in an application (DD_INTEGRATIONS,
+// DD_TRACE_CALLTARGET_ENABLED, ... or DD_CLR_CONFIG_FILE). The modules are
+// loaded, then the methods are JIT compiled, then the ReJIT requests of the
+// profiler are replayed. The latency of each callback, the callback time
+// against the wall time of the JIT threads and the memory of the profiler are
+// reported.
+//
+// A replay calls the callbacks of the trace in the order they started, on one
+// thread. The recorded modules are loaded again and must have the recorded
+// MVIDs, GetReJITParameters waits for the profiler to request the ReJIT of
+// the method. The recorded and replayed latencies are reported, with the
+// decisions of the profiler that differ from the recording.
+
+#include <dirent.h>
+#include <sys/resource.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <set>
+#include <string>
+#include <thread>
+#include <unordered_map>
+
+#include "../../src/Datadog.Trace.ClrProfiler.Native/callback_recorder.h"
+#include "../../src/Datadog.Trace.ClrProfiler.Native/memory_counters.h"
+#include "mock_profiler_info.h"
+#include "synthetic_catalog.h"
+
+using namespace trace;
+
+namespace {
+
+struct Options {
+  std::vector<std::string> paths;
+  ULONG repeat = 1;
+  ULONG jit_per_module = 0;
+  ULONG threads = 1;
+  ULONG idle_ms = 500;
+  ULONG synthetic_integrations = 0;
+  bool unload = false;
+  bool check = false;
+  std::string replay;
+};
+
+// Latencies of the calls of a callback, in microseconds
+using Latencies = std::vector<double>;
+
+class Stopwatch {
+ private:
+  std::chrono::steady_clock::time_point start_ =
+      std::chrono::steady_clock::now();
+
+ public:
+  double ElapsedMicroseconds() const {
+    return std::chrono::duration<double, std::micro>(
+               std::chrono::steady_clock::now() - start_)
+        .count();
+  }
+};
+
+bool EndsWith(const std::string& value, const std::string& suffix) {
+  return value.size() >= suffix.size() &&
+         value.compare(value.size() - suffix.size(), suffix.size(), suffix) ==
+             0;
+}
+
+// The assemblies of a directory, or the path itself
+void AddAssemblies(const std::string& path, std::vector<std::string>* files) {
+  DIR* directory = opendir(path.c_str());
+  if (directory == nullptr) {
+    files->push_back(path);
+    return;
+  }
+
+  std::vector<std::string> directory_files;
+  while (const dirent* entry = readdir(directory)) {
+    const std::string file_name = entry->d_name;
+    if (EndsWith(file_name, ".dll") || EndsWith(file_name, ".exe")) {
+      directory_files.push_back(path + "/" + file_name);
+    }
+  }
+  closedir(directory);
+
+  std::sort(directory_files.begin(), directory_files.end());
+  files->insert(files->end(), directory_files.begin(), directory_files.end());
+}
+
+bool ParseOptions(int argc, char* argv[], Options* options) {
+  for (int i = 1; i < argc; i++) {
+    const std::string argument = argv[i];
+    if (argument == "--unload") {
+      options->unload = true;
+      continue;
+    }
+    if (argument == "--check") {
+      options->check = true;
+      continue;
+    }
+
+    if (argument == "--replay") {
+      if (++i == argc) {
+        return false;
+      }
+      options->replay = argv[i];
+      continue;
+    }
+
+    ULONG* value = nullptr;
+    if (argument == "--repeat") {
+      value = &options->repeat;
+    } else if (argument == "--jit") {
+      value = &options->jit_per_module;
+    } else if (argument == "--threads") {
+      value = &options->threads;
+    } else if (argument == "--idle-ms") {
+      value = &options->idle_ms;
+    } else if (argument == "--synthetic-integrations") {
+      value = &options->synthetic_integrations;
+    } else if (argument.compare(0, 2, "--") == 0) {
+      return false;
+    } else {
+      options->paths.push_back(argument);
+      continue;
+    }
+
+    if (++i == argc) {
+      return false;
+    }
+    try {
+      *value = std::stoul(argv[i]);
+    } catch (...) {
+      return false;
+    }
+  }
+
+  return (!options->paths.empty() || !options->replay.empty()) &&
+         options->repeat > 0 && options->threads > 0;
+}
+
+void PrintLatencies(const std::string& callback, Latencies latencies) {
+  if (latencies.empty()) {
+    return;
+  }
+
+  std::sort(latencies.begin(), latencies.end());
+  double total = 0;
+  for (const auto latency : latencies) {
+    total += latency;
+  }
+  const auto percentile = [&latencies](double p) {
+    return latencies[static_cast<size_t>(p * (latencies.size() - 1))];
+  };
+
+  std::cout << std::left << std::setw(26) << callback << std::right
+            << " count=" << std::setw(8) << latencies.size() << std::fixed
+            << std::setprecision(1) << " mean=" << std::setw(9)
+            << total / latencies.size() << "us p50=" << std::setw(9)
+            << percentile(0.5) << "us p99=" << std::setw(9)
+            << percentile(0.99) << "us max=" << std::setw(9)
+            << latencies.back() << "us" << std::endl;
+}
+
+using MethodKey = std::pair<ModuleID, mdMethodDef>;
+
+// Loads the image of a recorded module from its recorded path, or from a
+// directory with the same file name. The image must have the recorded MVID.
+ModuleID LoadRecordedModule(MockProfilerInfo& info,
+                            const CallbackRecord& record,
+                            const std::vector<std::string>& directories,
+                            bool* version_mismatch) {
+  const auto path = ToString(record.module_path);
+  if (path.empty()) {
+    return 0;
+  }
+
+  std::vector<std::string> candidates{path};
+  const auto separator = path.find_last_of("/\\");
+  const auto file_name =
+      separator == std::string::npos ? path : path.substr(separator + 1);
+  for (const auto& directory : directories) {
+    candidates.push_back(directory + "/" + file_name);
+  }
+
+  for (const auto& candidate : candidates) {
+    const auto module_id = info.LoadModule(ToWSTRING(candidate));
+    if (module_id == 0) {
+      continue;
+    }
+
+    LPCBYTE base_load_address = nullptr;
+    DWORD flags = 0;
+    GUID module_version_id{};
+    if (SUCCEEDED(info.GetModuleInfo2(module_id, &base_load_address, 0,
+                                      nullptr, nullptr, nullptr, &flags)) &&
+        MetadataReader(base_load_address, flags)
+            .GetModuleVersionId(&module_version_id) &&
+        memcmp(&module_version_id, &record.module_version_id, sizeof(GUID)) ==
+            0) {
+      return module_id;
+    }
+    *version_mismatch = true;
+  }
+  return 0;
+}
+
+// Takes the ReJIT requests of the profiler until the method is requested or
+// the time is up
+bool WaitForReJitRequest(MockProfilerInfo& info, const MethodKey& method,
+                         ULONG timeout_ms, std::set<MethodKey>* requested) {
+  const Stopwatch stopwatch;
+  while (true) {
+    for (const auto& request : info.TakeReJitRequests()) {
+      requested->emplace(request.module_id, request.method_def);
+    }
+    if (requested->count(method) > 0) {
+      return true;
+    }
+    if (stopwatch.ElapsedMicroseconds() >= timeout_ms * 1000.0) {
+      return false;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+}
+
+int Replay(const Options& options) {
+  std::vector<CallbackRecord> records;
+  if (!ReadCallbackTrace(ToWSTRING(options.replay), &records)) {
+    std::cerr << "Failed to read the callback trace " << options.replay
+              << std::endl;
+    return 1;
+  }
+  // the records are written when the callbacks return
+  std::stable_sort(records.begin(), records.end(),
+                   [](const CallbackRecord& a, const CallbackRecord& b) {
+                     return a.start_ns < b.start_ns;
+                   });
+
+  MockProfilerInfo info;
+  ICorProfilerCallback4* profiler = nullptr;
+  if (FAILED(CreateProfiler(&profiler))) {
+    std::cerr << "Failed to create the profiler" << std::endl;
+    return 1;
+  }
+  if (FAILED(profiler->Initialize(static_cast<ICorProfilerInfo4*>(&info)))) {
+    std::cerr << "The profiler didn't attach, check its configuration"
+              << std::endl;
+    profiler->Release();
+    return 1;
+  }
+
+  // The recorded ids to the ids of the replay
+  std::unordered_map<ULONG64, ModuleID> modules;
+  std::unordered_map<ULONG64, AssemblyID> assemblies;
+  std::unordered_map<ULONG64, FunctionID> functions;
+
+  std::set<MethodKey> requested;
+  std::set<MethodKey> recorded_rejits;
+  std::map<std::string, Latencies> recorded_latencies;
+  std::map<std::string, Latencies> replayed_latencies;
+  size_t replayed = 0;
+  size_t missing_modules = 0;
+  size_t version_mismatches = 0;
+  size_t inlining_mismatches = 0;
+  size_t rejits_not_requested = 0;
+  bool shutdown = false;
+  std::string memory_counters;
+  const Stopwatch total_stopwatch;
+
+  const auto find_module = [&modules](ULONG64 recorded_id) -> ModuleID {
+    const auto module = modules.find(recorded_id);
+    return module != modules.end() ? module->second : 0;
+  };
+  // The functions of the JIT and ReJIT records are given by module and token
+  const auto find_function = [&](const CallbackRecord& record) -> FunctionID {
+    const auto module_id = find_module(record.module_id);
+    if (module_id == 0 || TypeFromToken(record.token) != mdtMethodDef) {
+      return 0;
+    }
+    const auto function_id = info.GetFunctionId(module_id, record.token);
+    functions[record.id] = function_id;
+    return function_id;
+  };
+
+  for (const auto& record : records) {
+    const auto module_id = find_module(record.module_id);
+    BOOL should_inline = TRUE;
+    Stopwatch stopwatch;
+
+    switch (record.kind) {
+      case CallbackKind::ModuleLoadFinished: {
+        // the profiler ignores the failed loads
+        if (FAILED(record.hr_status)) {
+          continue;
+        }
+        bool version_mismatch = false;
+        const auto loaded_module_id = LoadRecordedModule(
+            info, record, options.paths, &version_mismatch);
+        if (loaded_module_id == 0) {
+          std::cerr << "Skipping " << ToString(record.module_path)
+                    << (version_mismatch ? ", not the recorded version"
+                                         : ", no readable image")
+                    << std::endl;
+          (version_mismatch ? version_mismatches : missing_modules)++;
+          continue;
+        }
+        modules[record.module_id] = loaded_module_id;
+        assemblies[record.id] = info.GetAssemblyId(loaded_module_id);
+
+        stopwatch = Stopwatch();
+        profiler->ModuleLoadFinished(loaded_module_id, record.hr_status);
+        break;
+      }
+      case CallbackKind::AssemblyLoadFinished: {
+        const auto assembly = assemblies.find(record.id);
+        if (assembly == assemblies.end()) {
+          continue;
+        }
+        stopwatch = Stopwatch();
+        profiler->AssemblyLoadFinished(assembly->second, record.hr_status);
+        break;
+      }
+      case CallbackKind::ModuleUnloadStarted: {
+        if (module_id == 0) {
+          continue;
+        }
+        stopwatch = Stopwatch();
+        profiler->ModuleUnloadStarted(module_id);
+        break;
+      }
+      case CallbackKind::JITCompilationStarted: {
+        const auto function_id = find_function(record);
+        if (function_id == 0) {
+          continue;
+        }
+        stopwatch = Stopwatch();
+        profiler->JITCompilationStarted(function_id, record.flag);
+        break;
+      }
+      case CallbackKind::JITInlining: {
+        const auto callee_id = find_function(record);
+        if (callee_id == 0) {
+          continue;
+        }
+        // the caller is known if it was JIT compiled in the recording
+        const auto caller = functions.find(record.other_id);
+        const FunctionID caller_id =
+            caller != functions.end() ? caller->second : 0;
+        stopwatch = Stopwatch();
+        profiler->JITInlining(caller_id, callee_id, &should_inline);
+        break;
+      }
+      case CallbackKind::GetReJITParameters: {
+        if (module_id == 0) {
+          continue;
+        }
+        const MethodKey method{module_id, record.token};
+        recorded_rejits.insert(method);
+        if (!WaitForReJitRequest(info, method, options.idle_ms, &requested)) {
+          rejits_not_requested++;
+          continue;
+        }
+        MockFunctionControl function_control;
+        stopwatch = Stopwatch();
+        profiler->GetReJITParameters(module_id, record.token,
+                                     &function_control);
+        break;
+      }
+      case CallbackKind::ReJITCompilationStarted: {
+        const auto function_id = find_function(record);
+        if (function_id == 0) {
+          continue;
+        }
+        stopwatch = Stopwatch();
+        profiler->ReJITCompilationStarted(function_id, record.other_id,
+                                          record.flag);
+        break;
+      }
+      case CallbackKind::ReJITCompilationFinished: {
+        const auto function_id = find_function(record);
+        if (function_id == 0) {
+          continue;
+        }
+        stopwatch = Stopwatch();
+        profiler->ReJITCompilationFinished(function_id, record.other_id,
+                                           record.hr_status, record.flag);
+        break;
+      }
+      case CallbackKind::ReJITError: {
+        if (module_id == 0) {
+          continue;
+        }
+        const auto function = functions.find(record.id);
+        const FunctionID function_id =
+            function != functions.end() ? function->second : 0;
+        stopwatch = Stopwatch();
+        profiler->ReJITError(module_id, record.token, function_id,
+                             record.hr_status);
+        break;
+      }
+      case CallbackKind::Shutdown: {
+        // read before the shutdown releases the metadata of the profiler
+        memory_counters = ToString(MemoryCountersStr());
+        shutdown = true;
+        stopwatch = Stopwatch();
+        profiler->Shutdown();
+        break;
+      }
+    }
+
+    const auto elapsed_us = stopwatch.ElapsedMicroseconds();
+    const std::string callback = GetCallbackName(record.kind);
+    recorded_latencies[callback].push_back(record.duration_ns / 1000.0);
+    replayed_latencies[callback].push_back(elapsed_us);
+    replayed++;
+
+    if (record.kind == CallbackKind::JITInlining &&
+        (should_inline != FALSE) != (record.flag != FALSE)) {
+      inlining_mismatches++;
+    }
+  }
+
+  // The ReJIT requests the recorded profiler didn't make, or didn't make
+  // before the end of the recording
+  for (const auto& request : info.TakeReJitRequests()) {
+    requested.emplace(request.module_id, request.method_def);
+  }
+  size_t rejits_not_recorded = 0;
+  for (const auto& method : requested) {
+    if (recorded_rejits.count(method) == 0) {
+      rejits_not_recorded++;
+    }
+  }
+
+  // a process that didn't shut down, e.g. a warmup that was stopped
+  if (!shutdown) {
+    memory_counters = ToString(MemoryCountersStr());
+    profiler->Shutdown();
+  }
+  profiler->Release();
+
+  std::cout << "recorded:" << std::endl;
+  for (const auto& callback : recorded_latencies) {
+    PrintLatencies(callback.first, callback.second);
+  }
+  std::cout << "replayed:" << std::endl;
+  for (const auto& callback : replayed_latencies) {
+    PrintLatencies(callback.first, callback.second);
+  }
+
+  std::cout << std::fixed << std::setprecision(1)
+            << "records=" << records.size() << " replayed=" << replayed
+            << " modules=" << modules.size()
+            << " missing_modules=" << missing_modules
+            << " version_mismatches=" << version_mismatches << std::endl
+            // Decisions of the profiler that differ from the recording
+            << "inlining_mismatches=" << inlining_mismatches
+            << " rejits_not_requested=" << rejits_not_requested
+            << " rejits_not_recorded=" << rejits_not_recorded
+            << " il_bodies_set=" << info.GetReplacedBodyCount() << std::endl
+            << "total=" << total_stopwatch.ElapsedMicroseconds() / 1000
+            << "ms" << std::endl
+            << "memory: " << memory_counters << std::endl;
+  return 0;
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  Options options;
+  if (!ParseOptions(argc, argv, &options)) {
+    std::cerr << "Usage: " << argv[0]
+              << " [--repeat <n>] [--jit <n>] [--threads <n>] [--idle-ms <n>]"
+                 " [--unload] [--synthetic-integrations <n>] [--check]"
+                 " <assembly or directory>..."
+              << std::endl
+              << "       " << argv[0]
+              << " --replay <trace> [--idle-ms <n>] [<image directory>...]"
+              << std::endl;
+    return 2;
+  }
+
+  if (!options.replay.empty()) {
+    return Replay(options);
+  }
+
+  std::vector<std::string> files;
+  for (const auto& path : options.paths) {
+    AddAssemblies(path, &files);
+  }
+
+  MockProfilerInfo info;
+  std::vector<ModuleID> modules;
+  for (ULONG i = 0; i < options.repeat; i++) {
+    for (const auto& file : files) {
+      const auto module_id = info.LoadModule(ToWSTRING(file));
+      if (module_id == 0) {
+        std::cerr << "Skipping " << file << ", no readable metadata"
+                  << std::endl;
+        continue;
+      }
+      modules.push_back(module_id);
+    }
+  }
+  if (modules.empty()) {
+    std::cerr << "No assembly to load" << std::endl;
+    return 1;
+  }
+
+  // The profiler reads the integrations when it is initialized
+  std::string catalog_path;
+  if (options.synthetic_integrations > 0) {
+    catalog_path = UseSyntheticCatalog(
+        RewriteCatalog(info, modules[0], options.synthetic_integrations));
+    if (catalog_path.empty()) {
+      std::cerr << "Failed to write the synthetic integrations" << std::endl;
+      return 1;
+    }
+  }
+
+  ICorProfilerCallback4* profiler = nullptr;
+  if (FAILED(CreateProfiler(&profiler))) {
+    std::cerr << "Failed to create the profiler" << std::endl;
+    return 1;
+  }
+
+  std::map<std::string, Latencies> latencies;
+  const Stopwatch total_stopwatch;
+
+  Stopwatch stopwatch;
+  if (FAILED(profiler->Initialize(static_cast<ICorProfilerInfo4*>(&info)))) {
+    std::cerr << "The profiler didn't attach, check its configuration"
+              << std::endl;
+    profiler->Release();
+    return 1;
+  }
+  latencies["Initialize"].push_back(stopwatch.ElapsedMicroseconds());
+
+  for (const auto module_id : modules) {
+    stopwatch = Stopwatch();
+    profiler->ModuleLoadFinished(module_id, S_OK);
+    latencies["ModuleLoadFinished"].push_back(
+        stopwatch.ElapsedMicroseconds());
+
+    stopwatch = Stopwatch();
+    profiler->AssemblyLoadFinished(info.GetAssemblyId(module_id), S_OK);
+    latencies["AssemblyLoadFinished"].push_back(
+        stopwatch.ElapsedMicroseconds());
+  }
+
+  std::vector<FunctionID> functions;
+  for (const auto module_id : modules) {
+    auto methods = info.GetMethodsWithBody(module_id);
+    if (options.jit_per_module > 0 &&
+        methods.size() > options.jit_per_module) {
+      methods.resize(options.jit_per_module);
+    }
+    for (const auto method_def : methods) {
+      functions.push_back(info.GetFunctionId(module_id, method_def));
+    }
+  }
+
+  // The threads interleave the functions, as the callbacks of concurrent
+  // JIT compilations
+  std::vector<Latencies> thread_latencies(options.threads);
+  std::vector<std::thread> threads;
+  const Stopwatch jit_stopwatch;
+  for (ULONG t = 0; t < options.threads; t++) {
+    threads.emplace_back([&, t]() {
+      auto& jit_latencies = thread_latencies[t];
+      for (size_t i = t; i < functions.size(); i += options.threads) {
+        const Stopwatch function_stopwatch;
+        profiler->JITCompilationStarted(functions[i], TRUE);
+        jit_latencies.push_back(function_stopwatch.ElapsedMicroseconds());
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  const double jit_wall_us = jit_stopwatch.ElapsedMicroseconds();
+
+  double jit_callback_us = 0;
+  auto& jit_latencies = latencies["JITCompilationStarted"];
+  for (const auto& thread_latency : thread_latencies) {
+    for (const auto latency : thread_latency) {
+      jit_callback_us += latency;
+    }
+    jit_latencies.insert(jit_latencies.end(), thread_latency.begin(),
+                         thread_latency.end());
+  }
+
+  const auto requests = info.WaitForReJitRequests(options.idle_ms);
+  ReJITID rejit_id = 1;
+  size_t rejit_failures = 0;
+  size_t rewritten = 0;
+  for (const auto& request : requests) {
+    MockFunctionControl function_control;
+    stopwatch = Stopwatch();
+    const auto hr = profiler->GetReJITParameters(
+        request.module_id, request.method_def, &function_control);
+    latencies["GetReJITParameters"].push_back(
+        stopwatch.ElapsedMicroseconds());
+    if (FAILED(hr)) {
+      rejit_failures++;
+    } else if (!function_control.GetILBody().empty()) {
+      rewritten++;
+    }
+
+    const auto function_id =
+        info.GetFunctionId(request.module_id, request.method_def);
+    stopwatch = Stopwatch();
+    profiler->ReJITCompilationStarted(function_id, rejit_id, TRUE);
+    latencies["ReJITCompilationStarted"].push_back(
+        stopwatch.ElapsedMicroseconds());
+
+    profiler->ReJITCompilationFinished(function_id, rejit_id, S_OK, TRUE);
+    rejit_id++;
+  }
+
+  if (options.unload) {
+    for (const auto module_id : modules) {
+      stopwatch = Stopwatch();
+      profiler->ModuleUnloadStarted(module_id);
+      latencies["ModuleUnloadStarted"].push_back(
+          stopwatch.ElapsedMicroseconds());
+    }
+  }
+
+  // Read before the shutdown releases the metadata of the profiler
+  const auto memory_counters = ToString(MemoryCountersStr());
+
+  stopwatch = Stopwatch();
+  profiler->Shutdown();
+  latencies["Shutdown"].push_back(stopwatch.ElapsedMicroseconds());
+  profiler->Release();
+  if (!catalog_path.empty()) {
+    unlink(catalog_path.c_str());
+  }
+
+  for (const auto& callback : latencies) {
+    PrintLatencies(callback.first, callback.second);
+  }
+
+  rusage usage{};
+  getrusage(RUSAGE_SELF, &usage);
+  std::cout << std::fixed << std::setprecision(1)
+            << "modules=" << modules.size()
+            << " jit_callbacks=" << functions.size()
+            << " rejit_requests=" << requests.size()
+            << " rewritten=" << rewritten
+            << " rejit_failures=" << rejit_failures
+            << " il_bodies_set=" << info.GetReplacedBodyCount()
+            << " metadata_rows_defined=" << info.GetDefinedRowCount()
+            << std::endl
+            // Below 1 with several threads, the callbacks waited on each
+            // other
+            << "jit_threads=" << options.threads
+            << " jit_wall=" << jit_wall_us / 1000 << "ms"
+            << " jit_parallelism="
+            << (jit_wall_us > 0 ? jit_callback_us / jit_wall_us : 0) << "/"
+            << options.threads << std::endl
+            << "total=" << total_stopwatch.ElapsedMicroseconds() / 1000
+            << "ms max_rss=" << usage.ru_maxrss << "KB" << std::endl
+            << "memory: " << memory_counters << std::endl;
+
+  if (options.check) {
+    if (rejit_failures > 0) {
+      std::cerr << "check failed: " << rejit_failures << " ReJITs failed"
+                << std::endl;
+      return 1;
+    }
+    if (options.synthetic_integrations > 0 && rewritten == 0) {
+      std::cerr << "check failed: no method was rewritten" << std::endl;
+      return 1;
+    }
+  }
+  return 0;
+}
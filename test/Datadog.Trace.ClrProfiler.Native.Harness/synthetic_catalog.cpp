@@ -0,0 +1,102 @@
+#include "synthetic_catalog.h"
+
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+
+#include <climits>
+#include <fstream>
+
+#include "../../src/Datadog.Trace.ClrProfiler.Native/clr_helpers.h"
+#include "../../src/Datadog.Trace.ClrProfiler.Native/dd_profiler_constants.h"
+#include "../../src/Datadog.Trace.ClrProfiler.Native/environment_variables.h"
+
+namespace trace {
+
+json SyntheticTarget(const std::string& assembly, const std::string& type,
+                     const std::string& method, size_t argument_count) {
+  return {{"assembly", assembly},
+          {"type", type},
+          {"method", method},
+          {"signature_types", std::vector<std::string>(argument_count + 1, "_")},
+          {"minimum_major", 0},
+          {"maximum_major", USHRT_MAX}};
+}
+
+json SyntheticIntegration(size_t index, const json& target) {
+  const json wrapper = {
+      {"assembly", ToString(managed_profiler_full_assembly_version)},
+      {"type", "Synthetic.Integration" + std::to_string(index)},
+      {"action", ToString(calltarget_modification_action)}};
+  const json replacement = {
+      {"caller", json::object()}, {"target", target}, {"wrapper", wrapper}};
+  return {{"name", "Synthetic" + std::to_string(index / 10)},
+          {"method_replacements", json::array({replacement})}};
+}
+
+std::string RewriteCatalog(MockProfilerInfo& info, ModuleID module_id,
+                           ULONG method_count) {
+  ComPtr<IUnknown> metadata_interfaces;
+  if (FAILED(info.GetModuleMetaData(module_id, ofRead, IID_IMetaDataImport2,
+                                    metadata_interfaces.GetAddressOf()))) {
+    return "";
+  }
+  const auto metadata_import =
+      metadata_interfaces.As<IMetaDataImport2>(IID_IMetaDataImport2);
+  const auto assembly_name = ToString(info.GetAssemblyName(module_id));
+
+  json catalog = json::array();
+  for (const auto method_def : info.GetMethodsWithBody(module_id)) {
+    if (catalog.size() == method_count) {
+      break;
+    }
+
+    auto function_info = GetFunctionInfo(metadata_import, method_def);
+    const auto type_name = ToString(function_info.type.name);
+    const auto method_name = ToString(function_info.name);
+    if (!function_info.IsValid() || function_info.type.isGeneric ||
+        type_name.find_first_of("+<`") != std::string::npos ||
+        method_name.empty() || method_name[0] == '.' ||
+        FAILED(function_info.method_signature.TryParse()) ||
+        (function_info.method_signature.CallingConvention() &
+         IMAGE_CEE_CS_CALLCONV_GENERIC) != 0) {
+      continue;
+    }
+
+    catalog.push_back(SyntheticIntegration(
+        catalog.size(),
+        SyntheticTarget(assembly_name, type_name, method_name,
+                        function_info.method_signature.NumberOfArguments())));
+  }
+  return catalog.empty() ? "" : catalog.dump();
+}
+
+std::string UseSyntheticCatalog(const std::string& catalog) {
+#ifdef _WIN32
+  char directory[MAX_PATH];
+  char catalog_path[MAX_PATH];
+  if (GetTempPathA(MAX_PATH, directory) == 0 ||
+      GetTempFileNameA(directory, "dd", 0, catalog_path) == 0) {
+    return "";
+  }
+#else
+  char catalog_path[] = "/tmp/dd-synthetic-integrations-XXXXXX";
+  const int catalog_file = mkstemp(catalog_path);
+  if (catalog_file == -1) {
+    return "";
+  }
+  close(catalog_file);
+#endif
+  std::ofstream(catalog_path) << catalog;
+
+#ifdef _WIN32
+  _putenv_s(ToString(environment::integrations_path).c_str(), catalog_path);
+  _putenv_s(ToString(environment::calltarget_enabled).c_str(), "1");
+#else
+  setenv(ToString(environment::integrations_path).c_str(), catalog_path, 1);
+  setenv(ToString(environment::calltarget_enabled).c_str(), "1", 1);
+#endif
+  return catalog_path;
+}
+
+}  // namespace trace
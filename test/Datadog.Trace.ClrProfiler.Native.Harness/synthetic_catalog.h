@@ -0,0 +1,31 @@
+#ifndef DD_CLR_PROFILER_SYNTHETIC_CATALOG_H_
+#define DD_CLR_PROFILER_SYNTHETIC_CATALOG_H_
+
+#include <string>
+
+#include "../../src/Datadog.Trace.ClrProfiler.Native/integration_loader.h"
+#include "mock_profiler_info.h"
+
+namespace trace {
+
+// A CallTarget target matching any argument types
+json SyntheticTarget(const std::string& assembly, const std::string& type,
+                     const std::string& method, size_t argument_count);
+
+// An integration with one method replacement, its wrapper type is
+// Synthetic.Integration<index> in the managed profiler
+json SyntheticIntegration(size_t index, const json& target);
+
+// A catalog with a CallTarget integration for each of the first methods of
+// the module the rewrite supports, empty if there is none
+std::string RewriteCatalog(MockProfilerInfo& info, ModuleID module_id,
+                           ULONG method_count);
+
+// Writes the catalog to a temporary file and points the profiler to it, with
+// CallTarget enabled. Returns the path of the file, empty if it can't be
+// written.
+std::string UseSyntheticCatalog(const std::string& catalog);
+
+}  // namespace trace
+
+#endif  // DD_CLR_PROFILER_SYNTHETIC_CATALOG_H_
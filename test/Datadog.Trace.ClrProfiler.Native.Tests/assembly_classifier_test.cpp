@@ -0,0 +1,59 @@
+#include "pch.h"
+
+#include "../../src/Datadog.Trace.ClrProfiler.Native/assembly_classifier.h"
+
+using namespace trace;
+
+TEST(AssemblyClassifierTest, ClassifiesByPrefixAndName) {
+  AssemblyClassifier classifier;
+  classifier.AddPrefix("System.IO"_W);
+  classifier.AddPrefix("Sigil"_W);
+  classifier.AddName("System"_W);
+  classifier.AddName("netstandard"_W);
+
+  EXPECT_EQ(AssemblyClass::SkippedByPrefix, classifier.Classify("System.IO"_W));
+  EXPECT_EQ(AssemblyClass::SkippedByPrefix,
+            classifier.Classify("System.IO.Pipelines"_W));
+  EXPECT_EQ(AssemblyClass::SkippedByPrefix, classifier.Classify("Sigilx"_W));
+  EXPECT_EQ(AssemblyClass::SkippedByName, classifier.Classify("System"_W));
+  EXPECT_EQ(AssemblyClass::SkippedByName, classifier.Classify("netstandard"_W));
+  EXPECT_EQ(AssemblyClass::Instrumentable, classifier.Classify("System.I"_W));
+  EXPECT_EQ(AssemblyClass::Instrumentable, classifier.Classify("Systems"_W));
+  EXPECT_EQ(AssemblyClass::Instrumentable, classifier.Classify("netstandar"_W));
+  EXPECT_EQ(AssemblyClass::Instrumentable, classifier.Classify(""_W));
+
+  const WSTRING path = "C:\\app\\System.IO.dll"_W;
+  EXPECT_EQ(AssemblyClass::SkippedByPrefix,
+            classifier.Classify(path.c_str() + 7, 9));
+}
+
+TEST(AssemblyClassifierTest, DefaultIncludesConfiguredAssemblies) {
+  Configuration configuration;
+  configuration.skip_assembly_prefixes = {"Contoso."_W};
+  configuration.skip_assemblies = {"Samples.Excluded"_W};
+  const auto classifier = AssemblyClassifier::CreateDefault(configuration);
+
+  EXPECT_EQ(AssemblyClass::SkippedByPrefix,
+            classifier.Classify("Datadog.Trace.ClrProfiler.Managed"_W));
+  EXPECT_EQ(AssemblyClass::SkippedByName, classifier.Classify("mscorlib"_W));
+  EXPECT_EQ(AssemblyClass::SkippedByPrefix,
+            classifier.Classify("Contoso.Generated"_W));
+  EXPECT_EQ(AssemblyClass::SkippedByName,
+            classifier.Classify("Samples.Excluded"_W));
+  EXPECT_EQ(AssemblyClass::Instrumentable,
+            classifier.Classify("Samples.ExampleLibrary"_W));
+}
+
+TEST(AssemblyClassifierTest, BuildsAssemblyReferenceInfo) {
+  const AssemblyReferenceInfo reference_info(
+      "Some.Assembly, Version=1.2.3.4, Culture=neutral, "
+      "PublicKeyToken=def86d061d0d2eeb"_W);
+  const auto info = reference_info.Get();
+
+  EXPECT_EQ("Some.Assembly"_W, WSTRING(info->szName));
+  EXPECT_EQ(8, info->cbPublicKeyOrToken);
+  EXPECT_EQ(0xde, static_cast<const BYTE*>(info->pbPublicKeyOrToken)[0]);
+  EXPECT_EQ(1, info->pMetaData->usMajorVersion);
+  EXPECT_EQ(4, info->pMetaData->usRevisionNumber);
+  EXPECT_EQ(0, info->pMetaData->cbLocale);
+}
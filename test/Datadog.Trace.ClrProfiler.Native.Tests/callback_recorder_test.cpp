@@ -0,0 +1,82 @@
+#include "pch.h"
+
+#include <sstream>
+
+#include "../../src/Datadog.Trace.ClrProfiler.Native/callback_recorder.h"
+
+using namespace trace;
+
+TEST(CallbackRecorderTest, RecordsRoundTrip) {
+  CallbackRecord module_load;
+  module_load.kind = CallbackKind::ModuleLoadFinished;
+  module_load.start_ns = 1500;
+  module_load.duration_ns = 250000;
+  module_load.module_id = 0x7FF812345678;
+  module_load.id = 0x7FF887654321;
+  module_load.module_path = "C:\\app\\Samples.Dapper.dll"_W;
+  module_load.module_version_id = {0x12345678, 0x1234, 0x5678,
+                                   {1, 2, 3, 4, 5, 6, 7, 8}};
+
+  CallbackRecord inlining;
+  inlining.kind = CallbackKind::JITInlining;
+  inlining.start_ns = 2000;
+  inlining.duration_ns = 300;
+  inlining.module_id = module_load.module_id;
+  inlining.id = 0x7FF800001000;
+  inlining.other_id = 0x7FF800002000;
+  inlining.token = 0x06000042;
+  inlining.flag = FALSE;
+
+  CallbackRecord rejit_error;
+  rejit_error.kind = CallbackKind::ReJITError;
+  rejit_error.hr_status = E_FAIL;
+  rejit_error.token = 0x06000042;
+
+  std::string bytes;
+  WriteCallbackRecord(module_load, &bytes);
+  WriteCallbackRecord(inlining, &bytes);
+  WriteCallbackRecord(rejit_error, &bytes);
+
+  std::istringstream stream(bytes);
+  CallbackRecord record;
+  ASSERT_TRUE(ReadCallbackRecord(stream, &record));
+  EXPECT_EQ(CallbackKind::ModuleLoadFinished, record.kind);
+  EXPECT_EQ(module_load.start_ns, record.start_ns);
+  EXPECT_EQ(module_load.duration_ns, record.duration_ns);
+  EXPECT_EQ(module_load.module_id, record.module_id);
+  EXPECT_EQ(module_load.id, record.id);
+  EXPECT_EQ(module_load.module_path, record.module_path);
+  EXPECT_EQ(0, memcmp(&module_load.module_version_id,
+                      &record.module_version_id, sizeof(GUID)));
+
+  ASSERT_TRUE(ReadCallbackRecord(stream, &record));
+  EXPECT_EQ(CallbackKind::JITInlining, record.kind);
+  EXPECT_EQ(inlining.id, record.id);
+  EXPECT_EQ(inlining.other_id, record.other_id);
+  EXPECT_EQ(inlining.token, record.token);
+  EXPECT_EQ(FALSE, record.flag);
+  EXPECT_TRUE(record.module_path.empty());
+
+  ASSERT_TRUE(ReadCallbackRecord(stream, &record));
+  EXPECT_EQ(CallbackKind::ReJITError, record.kind);
+  EXPECT_EQ(E_FAIL, record.hr_status);
+
+  EXPECT_FALSE(ReadCallbackRecord(stream, &record));
+}
+
+TEST(CallbackRecorderTest, StopsAtTruncatedRecord) {
+  CallbackRecord module_load;
+  module_load.kind = CallbackKind::ModuleLoadFinished;
+  module_load.module_path = "/app/Samples.Dapper.dll"_W;
+
+  std::string bytes;
+  WriteCallbackRecord(module_load, &bytes);
+  bytes.resize(bytes.size() - 4);
+
+  std::istringstream stream(bytes);
+  CallbackRecord record;
+  EXPECT_FALSE(ReadCallbackRecord(stream, &record));
+
+  std::istringstream unknown_kind(std::string(1, '\x7F'));
+  EXPECT_FALSE(ReadCallbackRecord(unknown_kind, &record));
+}
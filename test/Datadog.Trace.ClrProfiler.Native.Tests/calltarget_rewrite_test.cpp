@@ -0,0 +1,468 @@
+#include "pch.h"
+
+#ifndef _WIN32
+#include <stdlib.h>
+#endif
+
+#include <algorithm>
+#include <cstdio>
+#include <future>
+#include <map>
+
+#include "../../src/Datadog.Trace.ClrProfiler.Native/clr_helpers.h"
+#include "../../src/Datadog.Trace.ClrProfiler.Native/cor_profiler.h"
+#include "../../src/Datadog.Trace.ClrProfiler.Native/environment_variables.h"
+#include "../../src/Datadog.Trace.ClrProfiler.Native/il_rewriter.h"
+#include "../../src/Datadog.Trace.ClrProfiler.Native/memory_counters.h"
+#include "../../src/Datadog.Trace.ClrProfiler.Native/sig_helpers.h"
+#include "../../src/Datadog.Trace.ClrProfiler.Native/version.h"
+#include "../Datadog.Trace.ClrProfiler.Native.Harness/mock_profiler_info.h"
+#include "../Datadog.Trace.ClrProfiler.Native.Harness/synthetic_catalog.h"
+
+using namespace trace;
+
+// Runs the profiler on the mock of the profiling API with synthetic CallTarget
+// integrations targeting the example library, and reads back the bodies it
+// rewrites
+class CallTargetRewriteTest : public ::testing::Test {
+ protected:
+  // How long the profiler may take to request its ReJITs
+  static const ULONG kReJitIdleMs = 500;
+  // The only async method of the example library
+  const WSTRING kAsyncMethodType =
+      "Samples.ExampleLibrary.FakeClient.DogClient`2"_W;
+  const WSTRING kAsyncMethodName = "StayAndLayDown"_W;
+
+  MockProfilerInfo info_;
+  ModuleID module_id_ = 0;
+  CorProfiler* profiler_ = nullptr;
+  std::string catalog_path_;
+
+  void SetUp() override {
+    module_id_ = info_.LoadModule("Samples.ExampleLibrary.dll"_W);
+    ASSERT_NE(0u, module_id_) << "Samples.ExampleLibrary.dll was not found.";
+  }
+
+  void TearDown() override {
+    if (profiler_ != nullptr) {
+      profiler_->Shutdown();
+      profiler_->Release();
+    }
+    if (!catalog_path_.empty()) {
+      std::remove(catalog_path_.c_str());
+    }
+    SetAsyncStateMachineEnabled(false);
+  }
+
+  // Enables the rewrite of the state machines of async methods
+  static void SetAsyncStateMachineEnabled(bool enabled) {
+    const auto name =
+        ToString(environment::calltarget_async_state_machine_enabled);
+#ifdef _WIN32
+    _putenv_s(name.c_str(), enabled ? "1" : "");
+#else
+    if (enabled) {
+      setenv(name.c_str(), "1", 1);
+    } else {
+      unsetenv(name.c_str());
+    }
+#endif
+  }
+
+  ComPtr<IMetaDataImport2> GetMetadataImport() {
+    ComPtr<IUnknown> metadata_interfaces;
+    EXPECT_TRUE(SUCCEEDED(info_.GetModuleMetaData(
+        module_id_, ofRead, IID_IMetaDataImport2,
+        metadata_interfaces.GetAddressOf())));
+    return metadata_interfaces.As<IMetaDataImport2>(IID_IMetaDataImport2);
+  }
+
+  // The async method of the example library and the MoveNext of its state
+  // machine
+  void FindAsyncMethod(mdMethodDef* method_def, mdMethodDef* move_next) {
+    const auto metadata_import = GetMetadataImport();
+    mdTypeDef type_def = mdTypeDefNil;
+    ASSERT_TRUE(SUCCEEDED(metadata_import->FindTypeDefByName(
+        kAsyncMethodType.c_str(), mdTokenNil, &type_def)));
+    HCORENUM method_enum = nullptr;
+    ULONG method_count = 0;
+    ASSERT_TRUE(SUCCEEDED(metadata_import->EnumMethodsWithName(
+        &method_enum, type_def, kAsyncMethodName.c_str(), method_def, 1,
+        &method_count)));
+    metadata_import->CloseEnum(method_enum);
+    ASSERT_EQ(1u, method_count);
+
+    mdTypeDef state_machine = mdTypeDefNil;
+    ASSERT_EQ(S_OK, GetAsyncStateMachineMoveNext(metadata_import, *method_def,
+                                                 &state_machine, move_next));
+  }
+
+  // A catalog instrumenting the async method of the example library
+  json AsyncMethodCatalog() {
+    return json::array({SyntheticIntegration(
+        0, SyntheticTarget(ToString(info_.GetAssemblyName(module_id_)),
+                           ToString(kAsyncMethodType),
+                           ToString(kAsyncMethodName), 5))});
+  }
+
+  // The names of the methods a rewritten body calls, in order
+  std::vector<WSTRING> GetCalledMethods(mdMethodDef method_def,
+                                        const std::vector<BYTE>& body) {
+    std::vector<WSTRING> names;
+    const auto metadata_import = GetMetadataImport();
+    if (FAILED(info_.SetILFunctionBody(module_id_, method_def, body.data()))) {
+      return names;
+    }
+    ILRewriter rewriter(&info_, nullptr, module_id_, method_def);
+    if (FAILED(rewriter.Import())) {
+      return names;
+    }
+    for (ILInstr* instr = rewriter.GetILList()->m_pNext;
+         instr != rewriter.GetILList(); instr = instr->m_pNext) {
+      if (instr->m_opcode != CEE_CALL && instr->m_opcode != CEE_CALLVIRT) {
+        continue;
+      }
+      mdToken method = instr->m_Arg32;
+      if (TypeFromToken(method) == mdtMethodSpec &&
+          FAILED(metadata_import->GetMethodSpecProps(method, &method, nullptr,
+                                                     nullptr))) {
+        continue;
+      }
+      names.push_back(GetFunctionInfo(metadata_import, method).name);
+    }
+    return names;
+  }
+
+  // An integration for each of the first methods the rewrite supports
+  json Catalog(ULONG method_count) {
+    const auto catalog = RewriteCatalog(info_, module_id_, method_count);
+    EXPECT_FALSE(catalog.empty());
+    return catalog.empty() ? json::array() : json::parse(catalog);
+  }
+
+  // Starts the profiler with the integrations and loads the example library
+  void Start(const json& catalog) {
+    catalog_path_ = UseSyntheticCatalog(catalog.dump());
+    ASSERT_FALSE(catalog_path_.empty());
+
+    profiler_ = new CorProfiler();
+    profiler_->AddRef();
+    ASSERT_TRUE(SUCCEEDED(
+        profiler_->Initialize(static_cast<ICorProfilerInfo4*>(&info_))));
+    profiler_->ModuleLoadFinished(module_id_, S_OK);
+    profiler_->AssemblyLoadFinished(info_.GetAssemblyId(module_id_), S_OK);
+  }
+
+  // Runs the ReJITs the profiler requested, returns the bodies it set
+  std::map<mdMethodDef, std::vector<BYTE>> ReJitRequested() {
+    std::map<mdMethodDef, std::vector<BYTE>> bodies;
+    for (const auto& request : info_.WaitForReJitRequests(kReJitIdleMs)) {
+      MockFunctionControl function_control;
+      EXPECT_TRUE(SUCCEEDED(profiler_->GetReJITParameters(
+          request.module_id, request.method_def, &function_control)));
+      bodies[request.method_def] = function_control.GetILBody();
+    }
+    return bodies;
+  }
+
+  // The types of the locals of a rewritten body
+  std::vector<CorElementType> GetLocalTypes(const std::vector<BYTE>& body) {
+    std::vector<CorElementType> types;
+    COR_ILMETHOD_DECODER decoder((COR_ILMETHOD*)body.data());
+    ComPtr<IUnknown> metadata_interfaces;
+    if (IsNilToken(decoder.GetLocalVarSigTok()) ||
+        FAILED(info_.GetModuleMetaData(module_id_, ofRead,
+                                       IID_IMetaDataImport2,
+                                       metadata_interfaces.GetAddressOf()))) {
+      return types;
+    }
+    const auto metadata_import =
+        metadata_interfaces.As<IMetaDataImport2>(IID_IMetaDataImport2);
+
+    PCCOR_SIGNATURE signature = nullptr;
+    ULONG signature_size = 0;
+    if (FAILED(metadata_import->GetSigFromToken(decoder.GetLocalVarSigTok(),
+                                                &signature, &signature_size)) ||
+        *signature++ != IMAGE_CEE_CS_CALLCONV_LOCAL_SIG) {
+      return types;
+    }
+    ULONG count;
+    signature += CorSigUncompressData(signature, &count);
+    for (ULONG i = 0; i < count; i++) {
+      types.push_back(static_cast<CorElementType>(*signature));
+      if (!ParseType(&signature)) {
+        return {};
+      }
+    }
+    return types;
+  }
+};
+
+namespace {
+
+// The index of the local of a stloc or ldloc, ULONG_MAX for other
+// instructions
+ULONG GetLocalIndex(ILInstr* instr, unsigned short_opcode,
+                    unsigned first_opcode, unsigned long_opcode) {
+  if (instr->m_opcode >= first_opcode && instr->m_opcode <= first_opcode + 3) {
+    return instr->m_opcode - first_opcode;
+  }
+  if (instr->m_opcode == short_opcode) {
+    return static_cast<BYTE>(instr->m_Arg8);
+  }
+  if (instr->m_opcode == long_opcode) {
+    return static_cast<UINT16>(instr->m_Arg16);
+  }
+  return static_cast<ULONG>(ULONG_MAX);
+}
+
+}  // namespace
+
+TEST_F(CallTargetRewriteTest, SampledMethodsStartWithTheSamplingProbe) {
+  auto catalog = Catalog(2);
+  ASSERT_EQ(2u, catalog.size());
+  for (auto& integration : catalog) {
+    integration["sampling_rate"] = 4;
+  }
+  Start(catalog);
+
+  const auto bodies = ReJitRequested();
+  ASSERT_EQ(2u, bodies.size());
+
+  std::vector<INT64> counter_addresses;
+  for (const auto& body : bodies) {
+    SCOPED_TRACE(body.first);
+    ASSERT_FALSE(body.second.empty());
+
+    // the flag is an int32 local right before the calltarget state, which
+    // stays the last local
+    const auto local_types = GetLocalTypes(body.second);
+    ASSERT_LE(4u, local_types.size());
+    const ULONG flag_index = static_cast<ULONG>(local_types.size() - 2);
+    EXPECT_EQ(ELEMENT_TYPE_I4, local_types[flag_index]);
+    EXPECT_EQ(ELEMENT_TYPE_VALUETYPE, local_types.back());
+
+    // read the instructions back with the rewriter
+    ASSERT_TRUE(SUCCEEDED(info_.SetILFunctionBody(module_id_, body.first,
+                                                  body.second.data())));
+    ILRewriter rewriter(&info_, nullptr, module_id_, body.first);
+    ASSERT_TRUE(SUCCEEDED(rewriter.Import()));
+    ILInstr* instr = rewriter.GetILList()->m_pNext;
+    while (instr != rewriter.GetILList() && instr->m_opcode != CEE_LDC_I8) {
+      instr = instr->m_pNext;
+    }
+    ASSERT_NE(rewriter.GetILList(), instr) << "The probe was not found.";
+    const INT64 counter_address = instr->m_Arg64;
+    counter_addresses.push_back(counter_address);
+
+    //   *counter = *counter + 1
+    //   flag = (*counter % 4) == 0
+    //   if (!flag) skip the begin method call
+    const std::vector<unsigned> probe = {
+        CEE_LDC_I8, CEE_CONV_I,
+        CEE_LDC_I8, CEE_CONV_I, CEE_LDIND_I4, CEE_LDC_I4_1, CEE_ADD,
+        CEE_STIND_I4,
+        CEE_LDC_I8, CEE_CONV_I, CEE_LDIND_I4, CEE_LDC_I4_4, CEE_REM_UN,
+        CEE_LDC_I4_0, CEE_CEQ};
+    for (const auto opcode : probe) {
+      ASSERT_NE(rewriter.GetILList(), instr);
+      ASSERT_EQ(opcode, instr->m_opcode);
+      if (opcode == CEE_LDC_I8) {
+        EXPECT_EQ(counter_address, instr->m_Arg64);
+      }
+      instr = instr->m_pNext;
+    }
+    EXPECT_EQ(flag_index,
+              GetLocalIndex(instr, CEE_STLOC_S, CEE_STLOC_0, CEE_STLOC));
+    instr = instr->m_pNext;
+    EXPECT_EQ(flag_index,
+              GetLocalIndex(instr, CEE_LDLOC_S, CEE_LDLOC_0, CEE_LDLOC));
+    instr = instr->m_pNext;
+    EXPECT_TRUE(instr->m_opcode == CEE_BRFALSE_S ||
+                instr->m_opcode == CEE_BRFALSE);
+
+    // the counter of the method handler, no call ran yet
+    EXPECT_EQ(0, *reinterpret_cast<volatile LONG*>(counter_address));
+  }
+
+  // each method counts its own calls
+  EXPECT_NE(counter_addresses[0], counter_addresses[1]);
+}
+
+TEST_F(CallTargetRewriteTest, MethodsSampledOnEveryCallHaveNoProbe) {
+  Start(Catalog(1));
+
+  const auto bodies = ReJitRequested();
+  ASSERT_EQ(1u, bodies.size());
+  const auto& body = *bodies.begin();
+  ASSERT_FALSE(body.second.empty());
+
+  // the calltarget state is the last local, with no int32 flag before it
+  const auto local_types = GetLocalTypes(body.second);
+  ASSERT_LE(3u, local_types.size());
+  EXPECT_EQ(ELEMENT_TYPE_VALUETYPE, local_types.back());
+  EXPECT_NE(ELEMENT_TYPE_I4, local_types[local_types.size() - 2]);
+
+  ASSERT_TRUE(SUCCEEDED(
+      info_.SetILFunctionBody(module_id_, body.first, body.second.data())));
+  ILRewriter rewriter(&info_, nullptr, module_id_, body.first);
+  ASSERT_TRUE(SUCCEEDED(rewriter.Import()));
+  for (ILInstr* instr = rewriter.GetILList()->m_pNext;
+       instr != rewriter.GetILList(); instr = instr->m_pNext) {
+    EXPECT_NE(CEE_LDC_I8, instr->m_opcode);
+  }
+}
+
+TEST_F(CallTargetRewriteTest,
+       AsyncMethodsFlowTheirStateToTheRewrittenMoveNext) {
+  mdMethodDef method_def = mdMethodDefNil;
+  mdMethodDef move_next = mdMethodDefNil;
+  ASSERT_NO_FATAL_FAILURE(FindAsyncMethod(&method_def, &move_next));
+  SetAsyncStateMachineEnabled(true);
+  Start(AsyncMethodCatalog());
+
+  const auto bodies = ReJitRequested();
+  ASSERT_EQ(1u, bodies.count(method_def));
+  ASSERT_EQ(1u, bodies.count(move_next));
+  ASSERT_FALSE(bodies.at(method_def).empty());
+  ASSERT_FALSE(bodies.at(move_next).empty());
+
+  // the async method hands its instance and state to the state machine
+  const auto method_calls =
+      GetCalledMethods(method_def, bodies.at(method_def));
+  const auto has_call = [](const std::vector<WSTRING>& calls,
+                           const WSTRING& name) {
+    return std::find(calls.begin(), calls.end(), name) != calls.end();
+  };
+  EXPECT_TRUE(has_call(method_calls, "BeginAsyncStubMethod"_W));
+  EXPECT_TRUE(has_call(method_calls, "EndAsyncStubMethod"_W));
+  EXPECT_FALSE(has_call(method_calls, "EndMethod"_W));
+
+  // the state machine takes the state on its first run and completes it
+  const auto move_next_calls =
+      GetCalledMethods(move_next, bodies.at(move_next));
+  ASSERT_FALSE(move_next_calls.empty());
+  EXPECT_EQ("EnterAsyncMethod"_W, move_next_calls.front());
+  EXPECT_TRUE(has_call(move_next_calls, "EndAsyncMethodResult"_W));
+  EXPECT_TRUE(has_call(move_next_calls, "EndAsyncMethodException"_W));
+
+  ILRewriter rewriter(&info_, nullptr, module_id_, move_next);
+  ASSERT_TRUE(SUCCEEDED(rewriter.Import()));
+  ILInstr* instr = rewriter.GetILList()->m_pNext;
+  EXPECT_EQ(CEE_LDARG_0, instr->m_opcode);
+  instr = instr->m_pNext;
+  ASSERT_EQ(CEE_LDFLD, instr->m_opcode);
+  WCHAR field_name[kNameMaxSize]{};
+  ULONG field_name_length = 0;
+  mdToken field_parent = mdTokenNil;
+  ASSERT_TRUE(SUCCEEDED(GetMetadataImport()->GetMemberRefProps(
+      instr->m_Arg32, &field_parent, field_name, kNameMaxSize,
+      &field_name_length, nullptr, nullptr)));
+  EXPECT_EQ("<>1__state"_W, WSTRING(field_name));
+}
+
+TEST_F(CallTargetRewriteTest,
+       AsyncMethodsUseAContinuationWhenTheMoveNextCantBeRewritten) {
+  mdMethodDef method_def = mdMethodDefNil;
+  mdMethodDef move_next = mdMethodDefNil;
+  ASSERT_NO_FATAL_FAILURE(FindAsyncMethod(&method_def, &move_next));
+
+  // a MoveNext that never completes a builder: ret
+  const BYTE move_next_body[] = {(1 << 2) | CorILMethod_TinyFormat, CEE_RET};
+  ASSERT_TRUE(SUCCEEDED(
+      info_.SetILFunctionBody(module_id_, move_next, move_next_body)));
+  SetAsyncStateMachineEnabled(true);
+  Start(AsyncMethodCatalog());
+
+  const auto bodies = ReJitRequested();
+  ASSERT_EQ(1u, bodies.count(method_def));
+  ASSERT_FALSE(bodies.at(method_def).empty());
+
+  // the MoveNext keeps its code
+  EXPECT_TRUE(bodies.count(move_next) == 0 || bodies.at(move_next).empty());
+
+  // the async method ends like any other method, the returned task gets the
+  // continuation of the integration
+  const auto method_calls =
+      GetCalledMethods(method_def, bodies.at(method_def));
+  EXPECT_NE(method_calls.end(), std::find(method_calls.begin(),
+                                          method_calls.end(), "EndMethod"_W));
+  EXPECT_EQ(method_calls.end(),
+            std::find(method_calls.begin(), method_calls.end(),
+                      "BeginAsyncStubMethod"_W));
+  EXPECT_EQ(method_calls.end(),
+            std::find(method_calls.begin(), method_calls.end(),
+                      "EndAsyncStubMethod"_W));
+}
+
+TEST_F(CallTargetRewriteTest, ModuleUnloadFreesTheNativeMemoryOfTheModule) {
+  const auto counted = [] {
+    std::vector<long long> values;
+    for (int i = 0; i < static_cast<int>(MemoryCounter::Count); i++) {
+      const auto value = GetMemoryCounter(static_cast<MemoryCounter>(i));
+      values.push_back(value.objects);
+      values.push_back(value.bytes);
+    }
+    return values;
+  };
+  // the counters are global, the previous tests may leave their modules
+  const auto before_load = counted();
+
+  Start(Catalog(4));
+  const auto requests = info_.WaitForReJitRequests(kReJitIdleMs);
+  ASSERT_FALSE(requests.empty());
+  EXPECT_NE(before_load, counted());
+
+  // the rewrites race with the unload: each one either runs before it or
+  // finds the module gone, none reads the freed method handlers
+  auto rewrites = std::async(std::launch::async, [&] {
+    for (const auto& request : requests) {
+      MockFunctionControl function_control;
+      EXPECT_TRUE(SUCCEEDED(profiler_->GetReJITParameters(
+          request.module_id, request.method_def, &function_control)));
+    }
+  });
+  EXPECT_EQ(S_OK, profiler_->ModuleUnloadStarted(module_id_));
+  rewrites.get();
+
+  EXPECT_EQ(before_load, counted());
+
+  // the ReJIT of a method of the unloaded module is skipped
+  MockFunctionControl function_control;
+  EXPECT_EQ(S_OK, profiler_->GetReJITParameters(
+                      requests[0].module_id, requests[0].method_def,
+                      &function_control));
+  EXPECT_TRUE(function_control.GetILBody().empty());
+  EXPECT_EQ(before_load, counted());
+}
+
+TEST_F(CallTargetRewriteTest, RewritesFailingForAKnownReasonAreQuarantined) {
+  // an instance method of a generic value type can't be rewritten
+  Start(json::array({SyntheticIntegration(
+      0, SyntheticTarget(ToString(info_.GetAssemblyName(module_id_)),
+                         "Samples.ExampleLibrary.GenericTests.StructContainer`1",
+                         "get_Id", 0))}));
+
+  const auto requests = info_.WaitForReJitRequests(kReJitIdleMs);
+  ASSERT_EQ(1u, requests.size());
+  MockFunctionControl function_control;
+  EXPECT_TRUE(FAILED(profiler_->GetReJITParameters(
+      requests[0].module_id, requests[0].method_def, &function_control)));
+
+  const auto quarantine = profiler_->GetRewriteQuarantine();
+  EXPECT_EQ(0u, quarantine.find(ToWSTRING(PROFILER_VERSION) + "\t"_W));
+  EXPECT_NE(WSTRING::npos, quarantine.find("generic value type"_W));
+  EXPECT_NE(WSTRING::npos, quarantine.find(TokenStr(&requests[0].method_def)));
+}
+
+TEST_F(CallTargetRewriteTest, ReJitErrorsAreNotQuarantined) {
+  Start(Catalog(1));
+
+  const auto requests = info_.WaitForReJitRequests(kReJitIdleMs);
+  ASSERT_EQ(1u, requests.size());
+  // the runtime may succeed the next time, no reason is known
+  EXPECT_EQ(S_OK, profiler_->ReJITError(requests[0].module_id,
+                                        requests[0].method_def, 0, E_FAIL));
+
+  EXPECT_TRUE(profiler_->GetRewriteQuarantine().empty());
+}
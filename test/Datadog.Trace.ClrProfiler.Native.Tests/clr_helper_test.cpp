@@ -1,6 +1,7 @@
 #include "pch.h"
 
 #include "../../src/Datadog.Trace.ClrProfiler.Native/clr_helpers.h"
+#include "../../src/Datadog.Trace.ClrProfiler.Native/metadata_cache.h"
 #include "test_helpers.h"
 
 using namespace trace;
@@ -106,6 +107,13 @@ TEST_F(CLRHelperTest, FiltersIntegrationsByCaller) {
   trace::AssemblyInfo assembly_info = { 1, L"Assembly.One", manifest_module_id,  app_domain_id, L"AppDomain1"};
   auto actual = FilterIntegrationsByCaller(all, assembly_info);
   EXPECT_EQ(actual, expected);
+
+  // the filtered methods are handles to the flattened ones, not copies
+  ASSERT_EQ(actual.size(), 2);
+  EXPECT_TRUE(actual[0].SharesDataWith(all[0]));
+  EXPECT_TRUE(actual[1].SharesDataWith(all[2]));
+  EXPECT_EQ(&actual[0].replacement, &all[0].replacement);
+  EXPECT_FALSE(expected[0].SharesDataWith(all[0]));
 }
 
 TEST_F(CLRHelperTest, FiltersIntegrationsByTarget) {
@@ -224,6 +232,40 @@ TEST_F(CLRHelperTest, GetsTypeInfoFromTypeDefs) {
   EXPECT_EQ(actual, expected);
 }
 
+TEST_F(CLRHelperTest, CachesTypeAndFunctionInfo) {
+  MetadataCache cache(metadata_import_);
+  std::shared_ptr<const TypeInfo> shared_base;
+
+  for (auto& type_def : EnumTypeDefs(metadata_import_)) {
+    const auto expected = GetTypeInfo(metadata_import_, type_def);
+    const auto& cached = cache.GetTypeInfo(type_def);
+    EXPECT_EQ(expected.id, cached.id);
+    EXPECT_EQ(expected.name, cached.name);
+    EXPECT_EQ(expected.valueType, cached.valueType);
+    EXPECT_EQ(&cached, &cache.GetTypeInfo(type_def));
+
+    // Types with the same base share the descriptor of the base type
+    if (cached.extend_from != nullptr &&
+        cached.extend_from->name == L"System.Object") {
+      if (shared_base == nullptr) {
+        shared_base = cached.extend_from;
+      }
+      EXPECT_EQ(shared_base.get(), cached.extend_from.get());
+    }
+
+    for (auto& method_def : EnumMethods(metadata_import_, type_def)) {
+      const auto expected_function = GetFunctionInfo(metadata_import_, method_def);
+      const auto& cached_function = cache.GetFunctionInfo(method_def);
+      EXPECT_EQ(expected_function.name, cached_function.name);
+      EXPECT_EQ(expected_function.type.name, cached_function.type.name);
+      EXPECT_EQ(expected_function.signature.data, cached_function.signature.data);
+      EXPECT_EQ(&cached_function, &cache.GetFunctionInfo(method_def));
+    }
+  }
+
+  EXPECT_NE(shared_base, nullptr);
+}
+
 TEST_F(CLRHelperTest, GetsTypeInfoFromTypeRefs) {
   std::set<std::wstring> expected = {
       L"DebuggingModes",
@@ -1,6 +1,8 @@
 #include "pch.h"
 
 #include "../../src/Datadog.Trace.ClrProfiler.Native/clr_helpers.h"
+#include "../../src/Datadog.Trace.ClrProfiler.Native/module_metadata.h"
+#include "../../src/Datadog.Trace.ClrProfiler.Native/signature_matcher.h"
 #include "test_helpers.h"
 
 using namespace trace;
@@ -120,4 +122,62 @@ TEST_F(CLRHelperTypeCheckTest, SuccessfullyParsesEverySignature) {
   }
 
   EXPECT_EQ(expected_failures, actual_failures);
-}
\ No newline at end of file
+}
+
+TEST_F(CLRHelperTypeCheckTest, CompiledSignatureMatchesParsedSignatureTypes) {
+  ModuleMetadata module_metadata(metadata_import_, metadata_emit_,
+                                 assembly_import_, assembly_emit_,
+                                 L"Samples.ExampleLibrary", {}, {}, {}, NULL);
+
+  for (const auto method_name : {L"Sit", L"Rollover", L"StayAndLayDown"}) {
+    const auto target = FunctionToTest(
+        "Samples.ExampleLibrary.FakeClient.DogClient`2"_W, method_name);
+    std::vector<WSTRING> signature_types;
+    ASSERT_TRUE(TryParseSignatureTypes(metadata_import_, target, signature_types));
+
+    const SignatureMatcher matcher(&module_metadata, signature_types,
+                                   SignatureNaming::ParsedSignatureTypes);
+    EXPECT_TRUE(matcher.IsCompiled()) << method_name;
+    EXPECT_TRUE(matcher.MatchesMethod(target.signature)) << method_name;
+
+    signature_types[1] = L"System.Decimal";
+    const SignatureMatcher mismatch(&module_metadata, signature_types,
+                                    SignatureNaming::ParsedSignatureTypes);
+    EXPECT_FALSE(mismatch.MatchesMethod(target.signature)) << method_name;
+  }
+}
+
+TEST_F(CLRHelperTypeCheckTest, CompiledSignatureMatchesTypeTokNames) {
+  ModuleMetadata module_metadata(metadata_import_, metadata_emit_,
+                                 assembly_import_, assembly_emit_,
+                                 L"Samples.ExampleLibrary", {}, {}, {}, NULL);
+
+  for (const auto method_name : {L"Sit", L"Rollover", L"StayAndLayDown"}) {
+    const auto target = FunctionToTest(
+        "Samples.ExampleLibrary.FakeClient.DogClient`2"_W, method_name);
+    FunctionMethodSignature method_signature(target.signature.data.data(),
+                                             static_cast<unsigned>(target.signature.data.size()));
+    ASSERT_TRUE(SUCCEEDED(method_signature.TryParse()));
+
+    const auto arguments = method_signature.GetMethodArguments();
+    std::vector<WSTRING> signature_types = {L"_"};
+    for (const auto& argument : arguments) {
+      signature_types.push_back(argument.GetTypeTokName(metadata_import_));
+    }
+
+    const SignatureMatcher matcher(&module_metadata, signature_types,
+                                   SignatureNaming::TypeTokName);
+    EXPECT_TRUE(matcher.IsCompiled()) << method_name;
+    EXPECT_TRUE(matcher.MatchesArguments(arguments)) << method_name;
+
+    signature_types[1] = L"_";
+    const SignatureMatcher wildcard(&module_metadata, signature_types,
+                                    SignatureNaming::TypeTokName);
+    EXPECT_TRUE(wildcard.MatchesArguments(arguments)) << method_name;
+
+    signature_types[1] = L"System.Decimal";
+    const SignatureMatcher mismatch(&module_metadata, signature_types,
+                                    SignatureNaming::TypeTokName);
+    EXPECT_FALSE(mismatch.MatchesArguments(arguments)) << method_name;
+  }
+}
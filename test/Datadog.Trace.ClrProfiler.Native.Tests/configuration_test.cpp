@@ -0,0 +1,61 @@
+#include "pch.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+
+#include "../../src/Datadog.Trace.ClrProfiler.Native/configuration.h"
+#include "../../src/Datadog.Trace.ClrProfiler.Native/environment_variables.h"
+
+using namespace trace;
+
+namespace {
+
+// Sets the variable, or removes it when the value is empty
+void SetEnvironmentValue(const WSTRING& name, const std::string& value) {
+#ifdef _WIN32
+  _putenv_s(ToString(name).c_str(), value.c_str());
+#else
+  if (value.empty()) {
+    unsetenv(ToString(name).c_str());
+  } else {
+    setenv(ToString(name).c_str(), value.c_str(), 1);
+  }
+#endif
+}
+
+}  // namespace
+
+TEST(ConfigurationTest, ReadsFileAndPrefersEnvironment) {
+  const auto config_file = ::testing::TempDir() + "dd-clr-config-test.txt";
+  std::ofstream f;
+  f.open(config_file);
+  f << "# comment" << std::endl
+    << "DD_TRACE_CALLTARGET_ENABLED = true" << std::endl
+    << "DD_DISABLED_INTEGRATIONS=One; Two" << std::endl
+    << "DD_CLR_MODULE_ANALYSIS_THREADS=100" << std::endl
+    << "DD_CLR_ENABLE_INLINING=true" << std::endl;
+  f.close();
+
+  SetEnvironmentValue(environment::clr_config_file, config_file);
+  SetEnvironmentValue(environment::clr_enable_inlining, "0");
+
+  const auto configuration = LoadConfiguration();
+  EXPECT_TRUE(configuration->calltarget_enabled);
+  EXPECT_FALSE(configuration->inlining_enabled);
+  EXPECT_TRUE(configuration->tracing_enabled);
+  EXPECT_EQ(kMaxModuleAnalysisThreads, configuration->module_analysis_threads);
+  EXPECT_EQ(std::vector<WSTRING>({"One"_W, "Two"_W}),
+            configuration->disabled_integrations);
+
+  // the snapshot doesn't change until the configuration is loaded again
+  SetEnvironmentValue(environment::calltarget_enabled, "false");
+  EXPECT_EQ(configuration, GetConfiguration());
+  EXPECT_TRUE(GetConfiguration()->calltarget_enabled);
+  EXPECT_FALSE(LoadConfiguration()->calltarget_enabled);
+
+  SetEnvironmentValue(environment::calltarget_enabled, "");
+  SetEnvironmentValue(environment::clr_enable_inlining, "");
+  SetEnvironmentValue(environment::clr_config_file, "");
+  std::remove(config_file.c_str());
+}
@@ -0,0 +1,625 @@
+#include "pch.h"
+
+#include <cstring>
+
+#include "../../src/Datadog.Trace.ClrProfiler.Native/il_rewriter.h"
+#include "../Datadog.Trace.ClrProfiler.Native.Harness/mock_profiler_info.h"
+
+using namespace trace;
+
+// The method bodies are set on a method of the example library, the
+// rewriter reads them and the signatures of their calls through the mock of
+// the profiling API
+class ILRewriterTest : public ::testing::Test {
+ protected:
+  MockProfilerInfo info_;
+  ModuleID module_id_ = 0;
+  mdMethodDef method_def_ = mdMethodDefNil;
+  ComPtr<IMetaDataEmit2> metadata_emit_;
+  mdTypeRef type_ref_ = mdTypeRefNil;
+
+  void SetUp() override {
+    module_id_ = info_.LoadModule("Samples.ExampleLibrary.dll"_W);
+    ASSERT_NE(0u, module_id_) << "Samples.ExampleLibrary.dll was not found.";
+    method_def_ = info_.GetMethodsWithBody(module_id_)[0];
+
+    ComPtr<IUnknown> metadata_interfaces;
+    ASSERT_TRUE(SUCCEEDED(info_.GetModuleMetaData(
+        module_id_, ofRead | ofWrite, IID_IMetaDataImport2,
+        metadata_interfaces.GetAddressOf())));
+    metadata_emit_ =
+        metadata_interfaces.As<IMetaDataEmit2>(IID_IMetaDataEmit2);
+    ASSERT_TRUE(SUCCEEDED(metadata_emit_->DefineTypeRefByName(
+        mdTokenNil, "Test.Calls"_W.c_str(), &type_ref_)));
+  }
+
+  // Sets a fat body with the code and the EH clauses as the body of the method
+  void SetBody(const std::vector<BYTE>& code, USHORT max_stack,
+               const std::vector<IMAGE_COR_ILMETHOD_SECT_EH_CLAUSE_FAT>&
+                   clauses = {},
+               mdToken local_var_sig = mdTokenNil) {
+    IMAGE_COR_ILMETHOD_FAT header{};
+    header.Flags = CorILMethod_FatFormat |
+                   (clauses.empty() ? 0 : CorILMethod_MoreSects);
+    header.Size = sizeof(IMAGE_COR_ILMETHOD_FAT) / sizeof(DWORD);
+    header.MaxStack = max_stack;
+    header.CodeSize = static_cast<DWORD>(code.size());
+    header.LocalVarSigTok = local_var_sig;
+
+    std::vector<BYTE> body(sizeof(header));
+    memcpy(body.data(), &header, sizeof(header));
+    body.insert(body.end(), code.begin(), code.end());
+
+    if (!clauses.empty()) {
+      body.resize((body.size() + 3) & ~3u);
+      IMAGE_COR_ILMETHOD_SECT_FAT section{};
+      section.Kind = CorILMethod_Sect_EHTable | CorILMethod_Sect_FatFormat;
+      section.DataSize = static_cast<unsigned>(
+          sizeof(section) + sizeof(clauses[0]) * clauses.size());
+      const auto section_bytes = reinterpret_cast<const BYTE*>(&section);
+      body.insert(body.end(), section_bytes, section_bytes + sizeof(section));
+      const auto clause_bytes = reinterpret_cast<const BYTE*>(clauses.data());
+      body.insert(body.end(), clause_bytes,
+                  clause_bytes + sizeof(clauses[0]) * clauses.size());
+    }
+
+    ASSERT_TRUE(
+        SUCCEEDED(info_.SetILFunctionBody(module_id_, method_def_, body.data())));
+  }
+
+  mdMemberRef DefineCall(const std::vector<BYTE>& signature) {
+    mdMemberRef member_ref = mdMemberRefNil;
+    EXPECT_TRUE(SUCCEEDED(metadata_emit_->DefineMemberRef(
+        type_ref_, "Call"_W.c_str(), signature.data(),
+        static_cast<ULONG>(signature.size()), &member_ref)));
+    return member_ref;
+  }
+
+  mdSignature DefineLocals(const std::vector<BYTE>& signature) {
+    mdSignature local_var_sig = mdSignatureNil;
+    EXPECT_TRUE(SUCCEEDED(metadata_emit_->GetTokenFromSig(
+        signature.data(), static_cast<ULONG>(signature.size()),
+        &local_var_sig)));
+    return local_var_sig;
+  }
+
+  // Appends an instruction with a token or a 32 bit operand
+  static void AppendInstr32(std::vector<BYTE>* code, BYTE opcode,
+                            UINT32 operand) {
+    code->push_back(opcode);
+    const auto operand_bytes = reinterpret_cast<const BYTE*>(&operand);
+    code->insert(code->end(), operand_bytes, operand_bytes + sizeof(operand));
+  }
+
+  ILInstr* InsertBefore(ILRewriter& rewriter, ILInstr* where,
+                        unsigned opcode) {
+    ILInstr* instr = rewriter.NewILInstr();
+    instr->m_opcode = opcode;
+    rewriter.InsertBefore(where, instr);
+    return instr;
+  }
+
+  void InsertNops(ILRewriter& rewriter, ILInstr* where, int count) {
+    for (int i = 0; i < count; i++) {
+      InsertBefore(rewriter, where, CEE_NOP);
+    }
+  }
+};
+
+TEST_F(ILRewriterTest, ExportWidensShortBranchesOutOfRange) {
+  // br.s L; L: ret
+  SetBody({CEE_BR_S, 0x00, CEE_RET}, 8);
+
+  MockFunctionControl function_control;
+  ILRewriter rewriter(&info_, &function_control, module_id_, method_def_);
+  ASSERT_TRUE(SUCCEEDED(rewriter.Import()));
+  ILInstr* branch = rewriter.GetILList()->m_pNext;
+  ASSERT_EQ(CEE_BR_S, branch->m_opcode);
+  InsertNops(rewriter, branch->m_pTarget, 200);
+  ASSERT_TRUE(SUCCEEDED(rewriter.Export()));
+
+  COR_ILMETHOD_DECODER decoder(
+      (COR_ILMETHOD*)function_control.GetILBody().data());
+  ASSERT_EQ(5u + 200 + 1, decoder.GetCodeSize());
+  EXPECT_EQ(CEE_BR, decoder.Code[0]);
+  INT32 delta;
+  memcpy(&delta, &decoder.Code[1], sizeof(delta));
+  EXPECT_EQ(200, delta);
+  EXPECT_EQ(CEE_RET, decoder.Code[205]);
+}
+
+TEST_F(ILRewriterTest, ExportWidensBranchesPushedOutOfRangeByOthers) {
+  // The first branch reaches its target only while the second one is short
+  //   br.s T1; br.s T2; nop x 125; T1: nop; nop x 200; T2: ret
+  SetBody({CEE_RET}, 8);
+
+  MockFunctionControl function_control;
+  ILRewriter rewriter(&info_, &function_control, module_id_, method_def_);
+  ASSERT_TRUE(SUCCEEDED(rewriter.Import()));
+  ILInstr* ret = rewriter.GetILList()->m_pNext;
+  ILInstr* first = InsertBefore(rewriter, ret, CEE_BR_S);
+  ILInstr* second = InsertBefore(rewriter, ret, CEE_BR_S);
+  InsertNops(rewriter, ret, 125);
+  first->m_pTarget = InsertBefore(rewriter, ret, CEE_NOP);
+  InsertNops(rewriter, ret, 200);
+  second->m_pTarget = ret;
+  ASSERT_TRUE(SUCCEEDED(rewriter.Export()));
+
+  COR_ILMETHOD_DECODER decoder(
+      (COR_ILMETHOD*)function_control.GetILBody().data());
+  ASSERT_EQ(10u + 125 + 1 + 200 + 1, decoder.GetCodeSize());
+  INT32 delta;
+  EXPECT_EQ(CEE_BR, decoder.Code[0]);
+  memcpy(&delta, &decoder.Code[1], sizeof(delta));
+  EXPECT_EQ(135 - 5, delta);
+  EXPECT_EQ(CEE_BR, decoder.Code[5]);
+  memcpy(&delta, &decoder.Code[6], sizeof(delta));
+  EXPECT_EQ(336 - 10, delta);
+}
+
+TEST_F(ILRewriterTest, ExportKeepsShortBranchesInRange) {
+  // L: nop; br.s L (backward); ret
+  SetBody({CEE_NOP, CEE_BR_S, 0xFD, CEE_RET}, 8);
+
+  MockFunctionControl function_control;
+  ILRewriter rewriter(&info_, &function_control, module_id_, method_def_);
+  ASSERT_TRUE(SUCCEEDED(rewriter.Import()));
+  ILInstr* branch = rewriter.GetILList()->m_pNext->m_pNext;
+  // the backward delta becomes -128, the limit of a short branch
+  InsertNops(rewriter, branch, 125);
+  ASSERT_TRUE(SUCCEEDED(rewriter.Export()));
+
+  COR_ILMETHOD_DECODER decoder(
+      (COR_ILMETHOD*)function_control.GetILBody().data());
+  ASSERT_EQ(1u + 125 + 2 + 1, decoder.GetCodeSize());
+  EXPECT_EQ(CEE_BR_S, decoder.Code[126]);
+  EXPECT_EQ(-128, static_cast<INT8>(decoder.Code[127]));
+}
+
+TEST_F(ILRewriterTest, ExportFollowsTheSplicesInListOrder) {
+  // nop; ret
+  SetBody({CEE_NOP, CEE_RET}, 8);
+
+  MockFunctionControl function_control;
+  ILRewriter rewriter(&info_, &function_control, module_id_, method_def_);
+  ASSERT_TRUE(SUCCEEDED(rewriter.Import()));
+  ILInstr* list = rewriter.GetILList();
+  ILInstr* nop = list->m_pNext;
+
+  // inserts next to imported, inserted and removed instructions, and at
+  // both ends of the method
+  auto insert_after = [&](ILInstr* where, unsigned opcode) {
+    ILInstr* instr = rewriter.NewILInstr();
+    instr->m_opcode = opcode;
+    rewriter.InsertAfter(where, instr);
+    return instr;
+  };
+  ILInstr* ldc0 = insert_after(nop, CEE_LDC_I4_0);
+  insert_after(nop, CEE_LDC_I4_1);
+  ILInstr* ldc2 = InsertBefore(rewriter, ldc0, CEE_LDC_I4_2);
+  insert_after(ldc2, CEE_LDC_I4_3);
+  insert_after(list, CEE_LDC_I4_4);
+  InsertBefore(rewriter, list, CEE_LDC_I4_5);
+  // removes the imported nop
+  ASSERT_TRUE(SUCCEEDED(rewriter.PeepholeOptimize()));
+
+  std::vector<BYTE> list_order;
+  for (ILInstr* instr = list->m_pNext; instr != list; instr = instr->m_pNext) {
+    list_order.push_back(static_cast<BYTE>(instr->m_opcode));
+  }
+  ASSERT_TRUE(SUCCEEDED(rewriter.Export()));
+
+  COR_ILMETHOD_DECODER decoder(
+      (COR_ILMETHOD*)function_control.GetILBody().data());
+  const std::vector<BYTE> expected = {CEE_LDC_I4_4, CEE_LDC_I4_1, CEE_LDC_I4_2,
+                                      CEE_LDC_I4_3, CEE_LDC_I4_0, CEE_RET,
+                                      CEE_LDC_I4_5};
+  EXPECT_EQ(expected, list_order);
+  ASSERT_EQ(expected.size(), decoder.GetCodeSize());
+  EXPECT_EQ(expected, std::vector<BYTE>(decoder.Code,
+                                        decoder.Code + expected.size()));
+}
+
+TEST_F(ILRewriterTest, ImportsSwitchTargetsIntoTheInstructions) {
+  // switch (L0, L1); L0: nop; L1: ret
+  std::vector<BYTE> code;
+  AppendInstr32(&code, CEE_SWITCH, 2);
+  for (INT32 delta : {0, 1}) {
+    const auto delta_bytes = reinterpret_cast<const BYTE*>(&delta);
+    code.insert(code.end(), delta_bytes, delta_bytes + sizeof(delta));
+  }
+  code.insert(code.end(), {CEE_NOP, CEE_RET});
+  SetBody(code, 8);
+
+  MockFunctionControl function_control;
+  ILRewriter rewriter(&info_, &function_control, module_id_, method_def_);
+  ASSERT_TRUE(SUCCEEDED(rewriter.Import()));
+  ILInstr* instr = rewriter.GetILList()->m_pNext;
+  ASSERT_EQ(CEE_SWITCH, instr->m_opcode);
+  ILInstr* nop = instr->m_pNext->m_pNext->m_pNext;
+  ASSERT_EQ(CEE_NOP, nop->m_opcode);
+  EXPECT_EQ(nop, instr->m_pNext->m_pTarget);
+  EXPECT_EQ(nop->m_pNext, instr->m_pNext->m_pNext->m_pTarget);
+  ASSERT_TRUE(SUCCEEDED(rewriter.Export()));
+
+  COR_ILMETHOD_DECODER decoder(
+      (COR_ILMETHOD*)function_control.GetILBody().data());
+  ASSERT_EQ(code.size(), decoder.GetCodeSize());
+  EXPECT_EQ(code, std::vector<BYTE>(decoder.Code, decoder.Code + code.size()));
+}
+
+TEST_F(ILRewriterTest, ExportComputesTheMaxStackOfNestedHandlers) {
+  //   try {
+  //     try { ldc.i4.0; pop; leave.s END }
+  //     catch { ldc.i4.1; ldc.i4.2; pop; pop; pop; leave.s END }
+  //   } finally { ldc.i4.3; pop; endfinally }
+  //   END: ret
+  const std::vector<BYTE> code = {
+      CEE_LDC_I4_0, CEE_POP, CEE_LEAVE_S, 10,                    // 0
+      CEE_LDC_I4_1, CEE_LDC_I4_2, CEE_POP, CEE_POP, CEE_POP,     // 4
+      CEE_LEAVE_S, 3,                                            // 9
+      CEE_LDC_I4_3, CEE_POP, CEE_ENDFINALLY,                     // 11
+      CEE_RET};                                                  // 14
+  IMAGE_COR_ILMETHOD_SECT_EH_CLAUSE_FAT catch_clause{};
+  catch_clause.Flags = COR_ILEXCEPTION_CLAUSE_NONE;
+  catch_clause.TryOffset = 0;
+  catch_clause.TryLength = 4;
+  catch_clause.HandlerOffset = 4;
+  catch_clause.HandlerLength = 7;
+  catch_clause.ClassToken = 0x01000001;
+  IMAGE_COR_ILMETHOD_SECT_EH_CLAUSE_FAT finally_clause{};
+  finally_clause.Flags = COR_ILEXCEPTION_CLAUSE_FINALLY;
+  finally_clause.TryOffset = 0;
+  finally_clause.TryLength = 11;
+  finally_clause.HandlerOffset = 11;
+  finally_clause.HandlerLength = 3;
+  SetBody(code, 8, {catch_clause, finally_clause});
+
+  MockFunctionControl function_control;
+  ILRewriter rewriter(&info_, &function_control, module_id_, method_def_);
+  ASSERT_TRUE(SUCCEEDED(rewriter.Import()));
+  ASSERT_EQ(2u, rewriter.GetEHCount());
+  // the nops are before the protected blocks, the clauses move with them
+  InsertNops(rewriter, rewriter.GetILList()->m_pNext, 3);
+  ASSERT_TRUE(SUCCEEDED(rewriter.Export()));
+
+  // the catch handler starts with the exception on the stack
+  COR_ILMETHOD_DECODER decoder(
+      (COR_ILMETHOD*)function_control.GetILBody().data());
+  EXPECT_EQ(3u, decoder.GetMaxStack());
+  EXPECT_EQ(3u, rewriter.GetMaxStackValue());
+  ASSERT_EQ(2u, decoder.EHCount());
+
+  IMAGE_COR_ILMETHOD_SECT_EH_CLAUSE_FAT buffer;
+  const auto exported_catch = decoder.EH->EHClause(0, &buffer);
+  EXPECT_EQ(3u, exported_catch->TryOffset);
+  EXPECT_EQ(4u, exported_catch->TryLength);
+  EXPECT_EQ(7u, exported_catch->HandlerOffset);
+  EXPECT_EQ(7u, exported_catch->HandlerLength);
+  EXPECT_EQ(0x01000001u, exported_catch->ClassToken);
+  const auto exported_finally = decoder.EH->EHClause(1, &buffer);
+  EXPECT_EQ(COR_ILEXCEPTION_CLAUSE_FINALLY, exported_finally->Flags);
+  EXPECT_EQ(3u, exported_finally->TryOffset);
+  EXPECT_EQ(11u, exported_finally->TryLength);
+  EXPECT_EQ(14u, exported_finally->HandlerOffset);
+  EXPECT_EQ(3u, exported_finally->HandlerLength);
+}
+
+TEST_F(ILRewriterTest, ExportReadsTheStackEffectOfCalls) {
+  // instance void Call(int32, int32): pops 3, pushes nothing
+  const auto instance_void = DefineCall(
+      {IMAGE_CEE_CS_CALLCONV_HASTHIS, 2, ELEMENT_TYPE_VOID, ELEMENT_TYPE_I4,
+       ELEMENT_TYPE_I4});
+  // int32 Call(): pops nothing, pushes 1
+  const auto static_int = DefineCall(
+      {IMAGE_CEE_CS_CALLCONV_DEFAULT, 0, ELEMENT_TYPE_I4});
+  // vararg void Call(int32, ..., int32): pops the 2 arguments of the call site
+  const auto vararg_void = DefineCall(
+      {IMAGE_CEE_CS_CALLCONV_VARARG, 2, ELEMENT_TYPE_VOID, ELEMENT_TYPE_I4,
+       ELEMENT_TYPE_SENTINEL, ELEMENT_TYPE_I4});
+  // instance void .ctor(int32): pops 1, pushes the new instance
+  const auto constructor = DefineCall(
+      {IMAGE_CEE_CS_CALLCONV_HASTHIS, 1, ELEMENT_TYPE_VOID, ELEMENT_TYPE_I4});
+
+  std::vector<BYTE> code = {CEE_LDNULL, CEE_LDC_I4_1, CEE_LDC_I4_2};
+  AppendInstr32(&code, CEE_CALLVIRT, instance_void);
+  AppendInstr32(&code, CEE_CALL, static_int);
+  AppendInstr32(&code, CEE_CALL, static_int);
+  code.insert(code.end(), {CEE_ADD, CEE_LDC_I4_2});
+  AppendInstr32(&code, CEE_CALL, vararg_void);
+  code.push_back(CEE_LDC_I4_1);
+  AppendInstr32(&code, CEE_NEWOBJ, constructor);
+  code.insert(code.end(), {CEE_LDNULL, CEE_LDNULL, CEE_POP, CEE_POP, CEE_POP,
+                           CEE_RET});
+  SetBody(code, 16);
+
+  MockFunctionControl function_control;
+  ILRewriter rewriter(&info_, &function_control, module_id_, method_def_);
+  ASSERT_TRUE(SUCCEEDED(rewriter.Import()));
+  ASSERT_TRUE(SUCCEEDED(rewriter.Export()));
+
+  COR_ILMETHOD_DECODER decoder(
+      (COR_ILMETHOD*)function_control.GetILBody().data());
+  EXPECT_EQ(3u, decoder.GetMaxStack());
+}
+
+TEST_F(ILRewriterTest, ExportKeepsTheTrackedMaxStackWithoutASignature) {
+  SetBody({CEE_RET}, 8);
+
+  MockFunctionControl function_control;
+  ILRewriter rewriter(&info_, &function_control, module_id_, method_def_);
+  ASSERT_TRUE(SUCCEEDED(rewriter.Import()));
+  ILInstr* ret = rewriter.GetILList()->m_pNext;
+  // a member ref that isn't in the metadata
+  InsertBefore(rewriter, ret, CEE_CALL)->m_Arg32 =
+      TokenFromRid(0xFFFFFF, mdtMemberRef);
+  InsertBefore(rewriter, ret, CEE_POP);
+  const auto tracked_max_stack = rewriter.GetMaxStackValue();
+  ASSERT_TRUE(SUCCEEDED(rewriter.Export()));
+
+  // the call may pop anything, its depth can't be known
+  COR_ILMETHOD_DECODER decoder(
+      (COR_ILMETHOD*)function_control.GetILBody().data());
+  EXPECT_EQ(tracked_max_stack, decoder.GetMaxStack());
+  EXPECT_LE(8u, decoder.GetMaxStack());
+}
+
+TEST_F(ILRewriterTest, PeepholeRemovesNopsAndForwardsTheirBranches) {
+  // br.s L; nop; L: nop; ret
+  SetBody({CEE_BR_S, 0x01, CEE_NOP, CEE_NOP, CEE_RET}, 8);
+
+  MockFunctionControl function_control;
+  ILRewriter rewriter(&info_, &function_control, module_id_, method_def_);
+  ASSERT_TRUE(SUCCEEDED(rewriter.Import()));
+  ASSERT_TRUE(SUCCEEDED(rewriter.PeepholeOptimize()));
+  ASSERT_TRUE(SUCCEEDED(rewriter.Export()));
+
+  COR_ILMETHOD_DECODER decoder(
+      (COR_ILMETHOD*)function_control.GetILBody().data());
+  ASSERT_EQ(3u, decoder.GetCodeSize());
+  EXPECT_EQ(CEE_BR_S, decoder.Code[0]);
+  EXPECT_EQ(0, decoder.Code[1]);
+  EXPECT_EQ(CEE_RET, decoder.Code[2]);
+}
+
+TEST_F(ILRewriterTest, PeepholeKeepsNopsThatDelimitHandlers) {
+  //   try { nop; nop; leave.s END } finally { nop; endfinally }
+  //   END: nop; ret
+  IMAGE_COR_ILMETHOD_SECT_EH_CLAUSE_FAT finally_clause{};
+  finally_clause.Flags = COR_ILEXCEPTION_CLAUSE_FINALLY;
+  finally_clause.TryOffset = 0;
+  finally_clause.TryLength = 4;
+  finally_clause.HandlerOffset = 4;
+  finally_clause.HandlerLength = 2;
+  SetBody({CEE_NOP, CEE_NOP, CEE_LEAVE_S, 0x02, CEE_NOP, CEE_ENDFINALLY,
+           CEE_NOP, CEE_RET},
+          8, {finally_clause});
+
+  MockFunctionControl function_control;
+  ILRewriter rewriter(&info_, &function_control, module_id_, method_def_);
+  ASSERT_TRUE(SUCCEEDED(rewriter.Import()));
+  ASSERT_TRUE(SUCCEEDED(rewriter.PeepholeOptimize()));
+  ASSERT_TRUE(SUCCEEDED(rewriter.Export()));
+
+  // only the nop in the middle of the try block goes
+  COR_ILMETHOD_DECODER decoder(
+      (COR_ILMETHOD*)function_control.GetILBody().data());
+  const std::vector<BYTE> expected = {CEE_NOP, CEE_LEAVE_S, 0x02,
+                                      CEE_NOP, CEE_ENDFINALLY, CEE_NOP,
+                                      CEE_RET};
+  ASSERT_EQ(expected.size(), decoder.GetCodeSize());
+  EXPECT_EQ(expected,
+            std::vector<BYTE>(decoder.Code, decoder.Code + expected.size()));
+
+  ASSERT_EQ(1u, decoder.EHCount());
+  IMAGE_COR_ILMETHOD_SECT_EH_CLAUSE_FAT buffer;
+  const auto clause = decoder.EH->EHClause(0, &buffer);
+  EXPECT_EQ(0u, clause->TryOffset);
+  EXPECT_EQ(3u, clause->TryLength);
+  EXPECT_EQ(3u, clause->HandlerOffset);
+  EXPECT_EQ(2u, clause->HandlerLength);
+}
+
+TEST_F(ILRewriterTest, PeepholeKeepsBranchTargetsBeforeAProtectedBlock) {
+  //   br.s L; L: nop; try { nop; leave.s END } finally { endfinally }
+  //   END: ret
+  IMAGE_COR_ILMETHOD_SECT_EH_CLAUSE_FAT finally_clause{};
+  finally_clause.Flags = COR_ILEXCEPTION_CLAUSE_FINALLY;
+  finally_clause.TryOffset = 3;
+  finally_clause.TryLength = 3;
+  finally_clause.HandlerOffset = 6;
+  finally_clause.HandlerLength = 1;
+  const std::vector<BYTE> code = {CEE_BR_S, 0x00, CEE_NOP, CEE_NOP,
+                                  CEE_LEAVE_S, 0x01, CEE_ENDFINALLY, CEE_RET};
+  SetBody(code, 8, {finally_clause});
+
+  MockFunctionControl function_control;
+  ILRewriter rewriter(&info_, &function_control, module_id_, method_def_);
+  ASSERT_TRUE(SUCCEEDED(rewriter.Import()));
+  ASSERT_TRUE(SUCCEEDED(rewriter.PeepholeOptimize()));
+  ASSERT_TRUE(SUCCEEDED(rewriter.Export()));
+
+  // the branch can't be forwarded into the try block
+  COR_ILMETHOD_DECODER decoder(
+      (COR_ILMETHOD*)function_control.GetILBody().data());
+  ASSERT_EQ(code.size(), decoder.GetCodeSize());
+  EXPECT_EQ(code, std::vector<BYTE>(decoder.Code, decoder.Code + code.size()));
+}
+
+TEST_F(ILRewriterTest, PeepholeForwardsASingleUseLocal) {
+  const auto locals =
+      DefineLocals({IMAGE_CEE_CS_CALLCONV_LOCAL_SIG, 1, ELEMENT_TYPE_I4});
+  SetBody({CEE_LDC_I4_1, CEE_STLOC_0, CEE_LDLOC_0, CEE_RET}, 8, {}, locals);
+
+  MockFunctionControl function_control;
+  ILRewriter rewriter(&info_, &function_control, module_id_, method_def_);
+  ASSERT_TRUE(SUCCEEDED(rewriter.Import()));
+  ASSERT_TRUE(SUCCEEDED(rewriter.PeepholeOptimize()));
+  ASSERT_TRUE(SUCCEEDED(rewriter.Export()));
+
+  COR_ILMETHOD_DECODER decoder(
+      (COR_ILMETHOD*)function_control.GetILBody().data());
+  ASSERT_EQ(2u, decoder.GetCodeSize());
+  EXPECT_EQ(CEE_LDC_I4_1, decoder.Code[0]);
+  EXPECT_EQ(CEE_RET, decoder.Code[1]);
+}
+
+TEST_F(ILRewriterTest, PeepholeKeepsLocalsThatCantBeForwarded) {
+  const std::vector<BYTE> store_load = {CEE_LDC_I4_1, CEE_STLOC_0,
+                                        CEE_LDLOC_0, CEE_RET};
+  struct Case {
+    const char* name;
+    std::vector<BYTE> local;
+    std::vector<BYTE> code;
+  };
+  const std::vector<Case> cases = {
+      {"address taken",
+       {ELEMENT_TYPE_I4},
+       {CEE_LDLOCA_S, 0x00, CEE_POP, CEE_LDC_I4_1, CEE_STLOC_0, CEE_LDLOC_0,
+        CEE_RET}},
+      {"loaded twice",
+       {ELEMENT_TYPE_I4},
+       {CEE_LDC_I4_1, CEE_STLOC_0, CEE_LDLOC_0, CEE_LDLOC_0, CEE_POP,
+        CEE_RET}},
+      {"pinned", {ELEMENT_TYPE_PINNED, ELEMENT_TYPE_OBJECT}, store_load},
+      {"byref", {ELEMENT_TYPE_BYREF, ELEMENT_TYPE_I4}, store_load},
+      {"small integer", {ELEMENT_TYPE_I2}, store_load},
+      {"boolean", {ELEMENT_TYPE_BOOLEAN}, store_load},
+      {"floating point", {ELEMENT_TYPE_R4}, store_load}};
+
+  for (const auto& test_case : cases) {
+    SCOPED_TRACE(test_case.name);
+    std::vector<BYTE> signature = {IMAGE_CEE_CS_CALLCONV_LOCAL_SIG, 1};
+    signature.insert(signature.end(), test_case.local.begin(),
+                     test_case.local.end());
+    SetBody(test_case.code, 8, {}, DefineLocals(signature));
+
+    MockFunctionControl function_control;
+    ILRewriter rewriter(&info_, &function_control, module_id_, method_def_);
+    ASSERT_TRUE(SUCCEEDED(rewriter.Import()));
+    ASSERT_TRUE(SUCCEEDED(rewriter.PeepholeOptimize()));
+    ASSERT_TRUE(SUCCEEDED(rewriter.Export()));
+
+    COR_ILMETHOD_DECODER decoder(
+        (COR_ILMETHOD*)function_control.GetILBody().data());
+    ASSERT_EQ(test_case.code.size(), decoder.GetCodeSize());
+    EXPECT_EQ(test_case.code,
+              std::vector<BYTE>(decoder.Code,
+                                decoder.Code + test_case.code.size()));
+  }
+}
+
+TEST_F(ILRewriterTest, PeepholeShortBranchesAreWidenedAgainByExport) {
+  //   br NEAR; ldnull; pop; NEAR: br FAR; (ldnull; pop) x 100; FAR: ret
+  std::vector<BYTE> code;
+  AppendInstr32(&code, CEE_BR, 2);
+  code.insert(code.end(), {CEE_LDNULL, CEE_POP});
+  AppendInstr32(&code, CEE_BR, 200);
+  for (int i = 0; i < 100; i++) {
+    code.insert(code.end(), {CEE_LDNULL, CEE_POP});
+  }
+  code.push_back(CEE_RET);
+  SetBody(code, 8);
+
+  MockFunctionControl function_control;
+  ILRewriter rewriter(&info_, &function_control, module_id_, method_def_);
+  ASSERT_TRUE(SUCCEEDED(rewriter.Import()));
+  ASSERT_TRUE(SUCCEEDED(rewriter.PeepholeOptimize()));
+  ASSERT_TRUE(SUCCEEDED(rewriter.Export()));
+
+  COR_ILMETHOD_DECODER decoder(
+      (COR_ILMETHOD*)function_control.GetILBody().data());
+  ASSERT_EQ(2u + 2 + 5 + 200 + 1, decoder.GetCodeSize());
+  EXPECT_EQ(CEE_BR_S, decoder.Code[0]);
+  EXPECT_EQ(2, decoder.Code[1]);
+  EXPECT_EQ(CEE_BR, decoder.Code[4]);
+  INT32 delta;
+  memcpy(&delta, &decoder.Code[5], sizeof(delta));
+  EXPECT_EQ(200, delta);
+  EXPECT_EQ(CEE_RET, decoder.Code[209]);
+}
+
+TEST(ILRewriterArenaTest, ReusesTheBlocksOfTheThreadZeroed) {
+  void* first_memory;
+  {
+    ILRewriterArena arena;
+    first_memory = arena.Alloc(256);
+    ASSERT_NE(nullptr, first_memory);
+    memset(first_memory, 0xFF, 256);
+  }
+
+  // the block of the previous arena comes back from the pool of the thread
+  ILRewriterArena arena;
+  const auto memory = static_cast<BYTE*>(arena.Alloc(256));
+  ASSERT_EQ(first_memory, memory);
+  for (int i = 0; i < 256; i++) {
+    ASSERT_EQ(0, memory[i]) << "at " << i;
+  }
+}
+
+TEST(ILRewriterArenaTest, AllocatesOversizedBlocksAndContinuesAfterThem) {
+  ILRewriterArena arena;
+  const auto small = static_cast<BYTE*>(arena.Alloc(16));
+  const auto large = static_cast<BYTE*>(arena.Alloc(1024 * 1024));
+  const auto next = static_cast<BYTE*>(arena.Alloc(16));
+  ASSERT_NE(nullptr, small);
+  ASSERT_NE(nullptr, large);
+  ASSERT_NE(nullptr, next);
+
+  memset(large, 0xFF, 1024 * 1024);
+  // no allocation overlaps another one
+  EXPECT_TRUE(next + 16 <= large || next >= large + 1024 * 1024);
+  EXPECT_TRUE(small + 16 <= large || small >= large + 1024 * 1024);
+  EXPECT_NE(small, next);
+  for (int i = 0; i < 16; i++) {
+    EXPECT_EQ(0, next[i]);
+  }
+}
+
+TEST_F(ILRewriterTest, RewritersOnOneThreadDontSeeEachOtherInstructions) {
+  // rewriters in sequence reuse the blocks of the previous ones, and one
+  // created while another is alive takes other blocks
+  for (int i = 0; i < 8; i++) {
+    SCOPED_TRACE(i);
+    SetBody({CEE_NOP, CEE_RET}, 8);
+    MockFunctionControl outer_control;
+    ILRewriter outer(&info_, &outer_control, module_id_, method_def_);
+    ASSERT_TRUE(SUCCEEDED(outer.Import()));
+    InsertNops(outer, outer.GetILList()->m_pNext, 100 * (i + 1));
+
+    SetBody({CEE_LDC_I4_1, CEE_POP, CEE_RET}, 8);
+    MockFunctionControl inner_control;
+    {
+      ILRewriter inner(&info_, &inner_control, module_id_, method_def_);
+      ASSERT_TRUE(SUCCEEDED(inner.Import()));
+      // new instructions start zeroed, even in reused memory
+      ILInstr* instr = inner.NewILInstr();
+      EXPECT_EQ(nullptr, instr->m_pNext);
+      EXPECT_EQ(nullptr, instr->m_pTarget);
+      EXPECT_EQ(0, instr->m_Arg64);
+      instr->m_opcode = CEE_NOP;
+      inner.InsertBefore(inner.GetILList()->m_pNext, instr);
+      ASSERT_TRUE(SUCCEEDED(inner.Export()));
+    }
+
+    ASSERT_TRUE(SUCCEEDED(outer.Export()));
+
+    COR_ILMETHOD_DECODER outer_decoder(
+        (COR_ILMETHOD*)outer_control.GetILBody().data());
+    ASSERT_EQ(100u * (i + 1) + 2, outer_decoder.GetCodeSize());
+    for (unsigned offset = 0; offset < outer_decoder.GetCodeSize() - 1;
+         offset++) {
+      ASSERT_EQ(CEE_NOP, outer_decoder.Code[offset]);
+    }
+    EXPECT_EQ(CEE_RET, outer_decoder.Code[outer_decoder.GetCodeSize() - 1]);
+
+    COR_ILMETHOD_DECODER inner_decoder(
+        (COR_ILMETHOD*)inner_control.GetILBody().data());
+    const std::vector<BYTE> expected = {CEE_NOP, CEE_LDC_I4_1, CEE_POP,
+                                        CEE_RET};
+    ASSERT_EQ(expected.size(), inner_decoder.GetCodeSize());
+    EXPECT_EQ(expected, std::vector<BYTE>(inner_decoder.Code,
+                                          inner_decoder.Code +
+                                              expected.size()));
+  }
+}
@@ -0,0 +1,136 @@
+#include "pch.h"
+
+#include <cstdio>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <string>
+
+#include "../../src/Datadog.Trace.ClrProfiler.Native/instrumentation_plan.h"
+#include "../../src/Datadog.Trace.ClrProfiler.Native/util.h"
+
+using namespace trace;
+
+class InstrumentationPlanTest : public ::testing::Test {
+ protected:
+  const GUID module_version_id_ = {
+      0x76543210, 0xfedc, 0xba98, {7, 6, 5, 4, 3, 2, 1, 0}};
+  const unsigned long long candidates_hash_ = 0x0123456789abcdefULL;
+  std::vector<std::string> plan_paths_;
+
+  void TearDown() override {
+    for (const auto& path : plan_paths_) {
+      std::remove(path.c_str());
+    }
+  }
+
+  WSTRING GetDirectory() const { return ToWSTRING(::testing::TempDir()); }
+
+  // The file of the plan of the module for the candidate integrations
+  std::string GetPlanPath(unsigned long long candidates_hash) {
+    std::stringstream ss;
+    ss << ::testing::TempDir() << "/" << ToString(GuidStr(&module_version_id_))
+       << "-" << std::hex << std::setfill('0') << std::setw(16)
+       << candidates_hash << ".plan";
+    plan_paths_.push_back(ss.str());
+    return ss.str();
+  }
+
+  static IntegrationDefinition Definition(const WSTRING& name,
+                                          const std::string& definition) {
+    return {name, {"Samples.ExampleLibrary"_W}, definition};
+  }
+};
+
+TEST_F(InstrumentationPlanTest, PlanRoundTripsThroughTheCache) {
+  const InstrumentationPlanCache cache(GetDirectory());
+  const auto path = GetPlanPath(candidates_hash_);
+  const IntegrationMethodKey first("First"_W, 0x1111222233334444ULL, 0);
+  const IntegrationMethodKey second("Second Integration"_W, 0xabcdULL, 2);
+  InstrumentationPlan plan;
+  plan.integrations = {first, second};
+  plan.rejit_methods = {{0x06000012, second}, {0x06000abc, first}};
+
+  ASSERT_TRUE(cache.Store(module_version_id_, candidates_hash_, plan));
+
+  // the methodDefs are written in hexadecimal with their prefix, the
+  // integrations by definition hash, method index and name
+  std::ifstream stream(path);
+  const std::string contents((std::istreambuf_iterator<char>(stream)),
+                             std::istreambuf_iterator<char>());
+  EXPECT_NE(std::string::npos,
+            contents.find("\nrejit 0x06000012 000000000000abcd 2 "
+                          "Second Integration\n"));
+  EXPECT_NE(std::string::npos,
+            contents.find("\nrejit 0x06000abc 1111222233334444 0 First\n"));
+
+  InstrumentationPlan loaded;
+  ASSERT_TRUE(cache.Load(module_version_id_, candidates_hash_, &loaded));
+  EXPECT_FALSE(loaded.skip_module);
+  EXPECT_EQ(plan.integrations, loaded.integrations);
+  EXPECT_EQ(plan.rejit_methods, loaded.rejit_methods);
+}
+
+TEST_F(InstrumentationPlanTest, SkippedModuleRoundTripsThroughTheCache) {
+  const InstrumentationPlanCache cache(GetDirectory());
+  GetPlanPath(candidates_hash_);
+  InstrumentationPlan plan;
+  plan.skip_module = true;
+
+  ASSERT_TRUE(cache.Store(module_version_id_, candidates_hash_, plan));
+
+  InstrumentationPlan loaded;
+  ASSERT_TRUE(cache.Load(module_version_id_, candidates_hash_, &loaded));
+  EXPECT_TRUE(loaded.skip_module);
+  EXPECT_TRUE(loaded.integrations.empty());
+  EXPECT_TRUE(loaded.rejit_methods.empty());
+}
+
+TEST_F(InstrumentationPlanTest, PlanOfOtherCandidateIntegrationsIsNotLoaded) {
+  const InstrumentationPlanCache cache(GetDirectory());
+  GetPlanPath(candidates_hash_);
+  InstrumentationPlan plan;
+  plan.rejit_methods = {{0x06000012, {"First"_W, 1, 0}}};
+  ASSERT_TRUE(cache.Store(module_version_id_, candidates_hash_, plan));
+
+  InstrumentationPlan loaded;
+  GetPlanPath(candidates_hash_ + 1);
+  EXPECT_FALSE(cache.Load(module_version_id_, candidates_hash_ + 1, &loaded));
+  EXPECT_TRUE(loaded.rejit_methods.empty());
+}
+
+TEST_F(InstrumentationPlanTest, PlanWithAnIncompleteKeyIsNotLoaded) {
+  const InstrumentationPlanCache cache(GetDirectory());
+  InstrumentationPlan loaded;
+
+  std::ofstream(GetPlanPath(candidates_hash_))
+      << "dd-instrumentation-plan 2\nrejit 0x06000012 0000000000000001 0\n";
+  EXPECT_FALSE(cache.Load(module_version_id_, candidates_hash_, &loaded));
+
+  std::ofstream(GetPlanPath(candidates_hash_))
+      << "dd-instrumentation-plan 2\nrejit 0x06000012 0000000000000001 0 "
+         "First\n";
+  EXPECT_TRUE(cache.Load(module_version_id_, candidates_hash_, &loaded));
+}
+
+TEST_F(InstrumentationPlanTest, HashChangesWithTheDefinitions) {
+  const auto first = Definition("First"_W, R"({"name":"First"})");
+  const auto second = Definition("Second"_W, R"({"name":"Second"})");
+  const auto hash = HashIntegrationDefinition(first, true, false);
+
+  EXPECT_EQ(hash, HashIntegrationDefinition(
+                      Definition("First"_W, R"({"name":"First"})"), true,
+                      false));
+  EXPECT_NE(hash, HashIntegrationDefinition(first, false, false));
+  EXPECT_NE(hash, HashIntegrationDefinition(first, true, true));
+  EXPECT_NE(hash, HashIntegrationDefinition(
+                      Definition("First"_W, R"({"name":"First","x":1})"),
+                      true, false));
+  EXPECT_NE(hash, HashIntegrationDefinition(second, true, false));
+
+  const auto second_hash = HashIntegrationDefinition(second, true, false);
+  const auto candidates_hash = HashCandidateIntegrations({hash, second_hash});
+  EXPECT_EQ(candidates_hash, HashCandidateIntegrations({hash, second_hash}));
+  EXPECT_NE(candidates_hash, HashCandidateIntegrations({second_hash, hash}));
+  EXPECT_NE(candidates_hash, HashCandidateIntegrations({hash}));
+}
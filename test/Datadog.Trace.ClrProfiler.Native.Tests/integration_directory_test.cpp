@@ -0,0 +1,105 @@
+#include "pch.h"
+
+#include <sstream>
+
+#include "../../src/Datadog.Trace.ClrProfiler.Native/integration_directory.h"
+#include "../../src/Datadog.Trace.ClrProfiler.Native/integration_loader.h"
+
+using namespace trace;
+
+namespace {
+
+const char kCatalog[] = R"TEXT(
+    [
+      {
+        "name": "HttpMessageHandler",
+        "method_replacements": [
+          { "target": { "assembly": "System.Net.Http", "type": "HttpMessageHandler", "method": "SendAsync" }, "wrapper": { "action": "CallTargetModification" } }
+        ]
+      },
+      {
+        "name": "SqlCommand",
+        "method_replacements": [
+          { "target": { "assembly": "System.Data", "type": "SqlCommand", "method": "ExecuteReader" }, "wrapper": { "action": "CallTargetModification" } },
+          { "target": { "assembly": "System.Data.SqlClient", "type": "SqlCommand", "method": "ExecuteReader" }, "wrapper": { "action": "CallTargetModification" } }
+        ]
+      },
+      {
+        "name": "StackExchangeRedis",
+        "method_replacements": [
+          { "target": { "assembly": "StackExchange.Redis", "type": "ConnectionMultiplexer", "method": "ExecuteSyncImpl" }, "wrapper": { "action": "CallTargetModification" } }
+        ]
+      }
+    ]
+)TEXT";
+
+std::vector<IntegrationDefinition> LoadCatalog() {
+  std::stringstream stream(kCatalog);
+  return LoadIntegrationDefinitionsFromStream(stream, true, false);
+}
+
+}  // namespace
+
+TEST(IntegrationDirectoryTest, FindsIntegrationsByTargetInCatalogOrder) {
+  const IntegrationDirectory directory(LoadCatalog(), true, false);
+  ASSERT_EQ(3u, directory.GetIntegrationCount());
+
+  const auto integrations = directory.FindIntegrations(
+      {"System.Data.SqlClient"_W, "StackExchange.Redis"_W, "System.Data"_W,
+       "System.Data"_W, "Unrelated"_W});
+  EXPECT_EQ((std::vector<ULONG>{1, 2}), integrations);
+  EXPECT_TRUE(directory.FindIntegrations({"Unrelated"_W}).empty());
+
+  // finding the integrations doesn't load their methods
+  EXPECT_EQ(0u, directory.GetMaterializedCount());
+}
+
+TEST(IntegrationDirectoryTest, LoadsTheMethodsOfAnIntegrationOnce) {
+  IntegrationDirectory directory(LoadCatalog(), true, false);
+
+  const auto methods = directory.GetMethods({1}, "Samples.Sql"_W);
+  ASSERT_EQ(2u, methods.size());
+  EXPECT_EQ("System.Data"_W,
+            methods[0].replacement.target_method.assembly.name);
+  EXPECT_EQ("System.Data.SqlClient"_W,
+            methods[1].replacement.target_method.assembly.name);
+  EXPECT_EQ(1u, directory.GetMaterializedCount());
+
+  const auto more_methods = directory.GetMethods({1, 2}, "Samples.Other"_W);
+  ASSERT_EQ(3u, more_methods.size());
+  EXPECT_TRUE(more_methods[1].SharesDataWith(methods[1]));
+  EXPECT_EQ("StackExchangeRedis"_W, more_methods[2].integration_name);
+  EXPECT_EQ(2u, directory.GetMaterializedCount());
+}
+
+TEST(IntegrationDirectoryTest, KeysIdentifyMethodsByIntegrationAndDefinition) {
+  IntegrationDirectory directory(LoadCatalog(), true, false);
+  const auto methods = directory.GetMethods({1}, "Samples.Sql"_W);
+  const auto key = directory.GetKey(methods[1]);
+  EXPECT_EQ("SqlCommand"_W, key.integration_name);
+  EXPECT_EQ(1u, key.method_index);
+  EXPECT_TRUE(directory.GetKey(IntegrationMethod()).integration_name.empty());
+
+  // the key doesn't depend on the other integrations of the catalog
+  auto definitions = LoadCatalog();
+  definitions.erase(definitions.begin());
+  IntegrationDirectory other_directory(definitions, true, false);
+  std::vector<IntegrationMethod> found;
+  ASSERT_TRUE(other_directory.FindMethod(key, "Samples.Sql"_W, &found));
+  ASSERT_EQ(1u, found.size());
+  EXPECT_EQ(methods[1], found[0]);
+
+  // but it does on the definition of its integration and the instrumentation
+  // mode
+  auto changed_definition = key;
+  changed_definition.definition_hash++;
+  EXPECT_FALSE(
+      directory.FindMethod(changed_definition, "Samples.Sql"_W, &found));
+  IntegrationDirectory netstandard_directory(LoadCatalog(), true, true);
+  EXPECT_FALSE(netstandard_directory.FindMethod(key, "Samples.Sql"_W, &found));
+
+  auto unknown_method = key;
+  unknown_method.method_index = 2;
+  EXPECT_FALSE(directory.FindMethod(unknown_method, "Samples.Sql"_W, &found));
+  EXPECT_EQ(1u, found.size());
+}
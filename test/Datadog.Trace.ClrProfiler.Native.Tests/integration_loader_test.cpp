@@ -223,3 +223,78 @@ TEST(IntegrationLoaderTest, DeserializesSignatureTypeArray) {
   EXPECT_STREQ(L"_", target.signature_types[1].c_str());
   EXPECT_STREQ(L"FakeClient.Pipeline'1<T>", target.signature_types[2].c_str());
 }
+
+TEST(IntegrationLoaderTest, DeserializesSamplingRate) {
+  std::stringstream str(R"TEXT(
+        [
+          { "name": "test-integration-1" },
+          { "name": "test-integration-2", "sampling_rate": 100 },
+          { "name": "test-integration-3", "sampling_rate": 0 },
+          { "name": "test-integration-4", "sampling_rate": "abc" }
+        ]
+    )TEXT");
+
+  auto integrations = LoadIntegrationsFromStream(str);
+  EXPECT_EQ(4, integrations.size());
+  EXPECT_EQ(1, integrations[0].sampling_rate);
+  EXPECT_EQ(100, integrations[1].sampling_rate);
+  EXPECT_EQ(1, integrations[2].sampling_rate);
+  EXPECT_EQ(1, integrations[3].sampling_rate);
+}
+
+TEST(IntegrationLoaderTest, LoadsDefinitionsOfTheEnabledMethods) {
+  std::stringstream str(R"TEXT(
+        [
+          { "name": "no-methods" },
+          {
+            "name": "test-integration",
+            "method_replacements": [
+              { "target": { "assembly": "Assembly.One" }, "wrapper": { "action": "CallTargetModification" } },
+              { "target": { "assembly": "Assembly.Two" }, "wrapper": { "action": "ReplaceTargetMethod" } },
+              { "target": { "assembly": "netstandard" }, "wrapper": { "action": "CallTargetModification" } },
+              { "target": { "assembly": "Assembly.One" }, "wrapper": { "action": "CallTargetModification" } }
+            ]
+          },
+          {
+            "name": "callsite-integration",
+            "method_replacements": [
+              { "target": { "assembly": "Assembly.Two" }, "wrapper": { "action": "ReplaceTargetMethod" } }
+            ]
+          }
+        ]
+    )TEXT");
+
+  auto definitions = LoadIntegrationDefinitionsFromStream(str, true, false);
+  // only the methods of the instrumentation mode count, and netstandard is
+  // disabled
+  ASSERT_EQ(1, definitions.size());
+  EXPECT_STREQ(L"test-integration", definitions[0].integration_name.c_str());
+  ASSERT_EQ(1, definitions[0].target_assemblies.size());
+  EXPECT_STREQ(L"Assembly.One", definitions[0].target_assemblies[0].c_str());
+}
+
+TEST(IntegrationLoaderTest, LoadsMethodsOfADefinition) {
+  std::stringstream str(R"TEXT(
+        [{
+            "name": "test-integration",
+            "sampling_rate": 10,
+            "method_replacements": [
+              { "target": { "assembly": "Assembly.One", "type": "Type.One", "method": "Method.One" }, "wrapper": { "action": "CallTargetModification" } },
+              { "target": { "assembly": "Assembly.Two", "type": "Type.Two", "method": "Method.Two" }, "wrapper": { "action": "ReplaceTargetMethod" } },
+              { "target": { "assembly": "netstandard", "type": "Type.Three", "method": "Method.Three" }, "wrapper": { "action": "CallTargetModification" } }
+            ]
+        }]
+    )TEXT");
+
+  auto definitions = LoadIntegrationDefinitionsFromStream(str, true, true);
+  ASSERT_EQ(1, definitions.size());
+
+  auto methods = LoadIntegrationMethods(definitions[0], true, false);
+  ASSERT_EQ(1, methods.size());
+  EXPECT_STREQ(L"test-integration", methods[0].integration_name.c_str());
+  EXPECT_STREQ(L"Method.One",
+               methods[0].replacement.target_method.method_name.c_str());
+  EXPECT_EQ(10, methods[0].sampling_rate);
+
+  EXPECT_EQ(2, LoadIntegrationMethods(definitions[0], true, true).size());
+}
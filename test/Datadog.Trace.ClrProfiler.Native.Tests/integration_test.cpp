@@ -43,4 +43,20 @@ TEST(IntegrationTest, AssemblyReferencePartialVersion) {
 TEST(IntegrationTest, AssemblyReferenceInvalidVersion) {
   AssemblyReference ref(L"Some.Assembly, Version=xyz");
   EXPECT_EQ(ref.version, Version(0, 0, 0, 0));
-}
\ No newline at end of file
+}
+
+TEST(IntegrationTest, MethodReferenceCacheIds) {
+  const Version min_ver(0, 0, 0, 0);
+  const Version max_ver(1, 0, 0, 0);
+  const MethodReference add(L"Samples.ExampleLibrary", L"Class1", L"Add", L"",
+                            min_ver, max_ver, {}, {});
+  const MethodReference add_again(L"Samples.ExampleLibrary", L"Class1", L"Add",
+                                  L"ReplaceTargetMethod", min_ver, max_ver, {},
+                                  {});
+  const MethodReference multiply(L"Samples.ExampleLibrary", L"Class1",
+                                 L"Multiply", L"", min_ver, max_ver, {}, {});
+
+  EXPECT_EQ(add.method_cache_id, add_again.method_cache_id);
+  EXPECT_NE(add.method_cache_id, multiply.method_cache_id);
+  EXPECT_EQ(add.type_cache_id, multiply.type_cache_id);
+}
@@ -98,19 +98,17 @@ TEST_F(MetadataBuilderTest, StoresWrapperMemberRef) {
   ASSERT_EQ(S_OK, hr);
 
   mdMemberRef tmp;
-  auto key_failed = module_metadata_->IsFailedWrapperMemberKey(
-      L"[Samples.ExampleLibrary]Class1.Add_vMin_0.0.0.0_vMax_65535.65535.65535.65535");
-  auto ok = module_metadata_->TryGetWrapperMemberRef(
-      L"[Samples.ExampleLibrary]Class1.Add_vMin_0.0.0.0_vMax_65535.65535.65535.65535", tmp);
+  auto key_failed =
+      module_metadata_->IsFailedWrapperMemberKey(ref3.method_cache_id);
+  auto ok = module_metadata_->TryGetWrapperMemberRef(ref3.method_cache_id, tmp);
   EXPECT_TRUE(ok);
   EXPECT_FALSE(key_failed);
   EXPECT_NE(tmp, 0);
 
   tmp = 0;
-  key_failed = module_metadata_->IsFailedWrapperMemberKey(
-      L"[Samples.ExampleLibrary]Class2.Add_vMin_0.0.0.0_vMax_65535.65535.65535.65535");
-  ok = module_metadata_->TryGetWrapperMemberRef(
-      L"[Samples.ExampleLibrary]Class2.Add_vMin_0.0.0.0_vMax_65535.65535.65535.65535", tmp);
+  const MethodReference ref4(L"Samples.ExampleLibrary", L"Class2", L"Add", L"ReplaceTargetMethod", min_ver, max_ver, {}, empty_sig_type_);
+  key_failed = module_metadata_->IsFailedWrapperMemberKey(ref4.method_cache_id);
+  ok = module_metadata_->TryGetWrapperMemberRef(ref4.method_cache_id, tmp);
   EXPECT_FALSE(ok);
   EXPECT_FALSE(key_failed);
   EXPECT_EQ(tmp, 0);
@@ -129,9 +127,9 @@ TEST_F(MetadataBuilderTest, StoresWrapperMemberRefForSeparateAssembly) {
   ASSERT_EQ(S_OK, hr);
 
   mdMemberRef tmp;
-  auto key_failed = module_metadata_->IsFailedWrapperMemberKey(L"[Samples.ExampleLibraryTracer]Class1.Add_vMin_0.0.0.0_vMax_65535.65535.65535.65535");
-  auto ok = module_metadata_->TryGetWrapperMemberRef(
-      L"[Samples.ExampleLibraryTracer]Class1.Add_vMin_0.0.0.0_vMax_65535.65535.65535.65535", tmp);
+  auto key_failed =
+      module_metadata_->IsFailedWrapperMemberKey(ref3.method_cache_id);
+  auto ok = module_metadata_->TryGetWrapperMemberRef(ref3.method_cache_id, tmp);
   EXPECT_TRUE(ok);
   EXPECT_FALSE(key_failed);
   EXPECT_NE(tmp, 0);
@@ -149,9 +147,28 @@ TEST_F(MetadataBuilderTest, StoresWrapperMemberRefRecordsFailure) {
   auto hr = metadata_builder_->StoreWrapperMethodRef(mr1);
   ASSERT_NE(S_OK, hr);
 
-  auto key_failed = module_metadata_->IsFailedWrapperMemberKey(L"[Samples.ExampleLibraryTracer.AssemblyDoesNotExist]Class1.Add_vMin_0.0.0.0_vMax_65535.65535.65535.65535");
+  auto key_failed =
+      module_metadata_->IsFailedWrapperMemberKey(ref3.method_cache_id);
   EXPECT_TRUE(key_failed);
 
-  key_failed = module_metadata_->IsFailedWrapperMemberKey(L"[Samples.ExampleLibraryTracer]Class1.Add_vMin_0.0.0.0_vMax_65535.65535.65535.65535");
+  const MethodReference ref4(L"Samples.ExampleLibraryTracer", L"Class1", L"Add", L"ReplaceTargetMethod",
+                             min_ver, max_ver, {}, empty_sig_type_);
+  key_failed = module_metadata_->IsFailedWrapperMemberKey(ref4.method_cache_id);
   EXPECT_FALSE(key_failed);
-}
\ No newline at end of file
+}
+
+TEST_F(MetadataBuilderTest, FindsTypeDefsAndAssemblyRefsByName) {
+  ASSERT_NE(module_metadata_->FindTypeDef(L"Samples.ExampleLibrary.Class1"),
+            mdTypeDefNil);
+  ASSERT_NE(module_metadata_->FindTypeDef(
+                L"Samples.ExampleLibrary.FakeClient.Biscuit+Cookie+Raisin"),
+            mdTypeDefNil);
+  ASSERT_EQ(module_metadata_->FindTypeDef(L"Samples.ExampleLibrary.Raisin"),
+            mdTypeDefNil);
+
+  // defined at runtime by SetUp, so only visible through the fallback
+  ASSERT_NE(module_metadata_->FindAssemblyRef(L"Samples.ExampleLibraryTracer"),
+            mdAssemblyRefNil);
+  ASSERT_EQ(module_metadata_->FindAssemblyRef(L"Does.Not.Exist"),
+            mdAssemblyRefNil);
+}
@@ -0,0 +1,127 @@
+#include "pch.h"
+
+#include <fstream>
+#include <iterator>
+
+#include "../../src/Datadog.Trace.ClrProfiler.Native/clr_helpers.h"
+#include "../../src/Datadog.Trace.ClrProfiler.Native/metadata_reader.h"
+#include "test_helpers.h"
+
+using namespace trace;
+
+class MetadataReaderTest : public ::CLRHelperTestBase {
+ protected:
+  std::vector<BYTE> image_;
+  MetadataReader reader_;
+
+  void SetUp() override {
+    CLRHelperTestBase::SetUp();
+
+    std::ifstream file("Samples.ExampleLibrary.dll", std::ios::binary);
+    ASSERT_TRUE(file.good()) << "Samples.ExampleLibrary.dll was not found.";
+    image_.assign(std::istreambuf_iterator<char>(file),
+                  std::istreambuf_iterator<char>());
+
+    // The file is read as is, so the image has the flat (on disk) layout
+    reader_ = MetadataReader(image_.data(), COR_PRF_MODULE_FLAT_LAYOUT);
+    ASSERT_TRUE(reader_.IsValid());
+  }
+};
+
+TEST_F(MetadataReaderTest, RejectsInvalidImages) {
+  const BYTE garbage[64]{};
+  EXPECT_FALSE(MetadataReader(nullptr, COR_PRF_MODULE_FLAT_LAYOUT).IsValid());
+  EXPECT_FALSE(MetadataReader(garbage, COR_PRF_MODULE_FLAT_LAYOUT).IsValid());
+  EXPECT_FALSE(
+      MetadataReader(image_.data(), COR_PRF_MODULE_DYNAMIC).IsValid());
+}
+
+TEST_F(MetadataReaderTest, ReadsTypeDefsLikeMetadataImport) {
+  std::vector<mdTypeDef> expected;
+  for (auto& def : EnumTypeDefs(metadata_import_)) {
+    expected.push_back(def);
+  }
+
+  // Row 1 is the <Module> type, which is not enumerated
+  ASSERT_EQ(expected.size() + 1, reader_.GetRowCount(MetadataTable::TypeDef));
+
+  for (auto& def : expected) {
+    WCHAR name[kNameMaxSize]{};
+    DWORD name_len = 0;
+    DWORD flags = 0;
+    mdToken extends = mdTokenNil;
+    ASSERT_TRUE(SUCCEEDED(metadata_import_->GetTypeDefProps(
+        def, name, kNameMaxSize, &name_len, &flags, &extends)));
+
+    TypeDefRow row;
+    ASSERT_TRUE(reader_.GetTypeDef(RidFromToken(def), &row));
+    EXPECT_EQ(flags, row.flags);
+    EXPECT_EQ(IsNilToken(extends) ? mdTokenNil : extends, row.extends);
+
+    WSTRING full_name = ToWSTRING(row.name);
+    if (row.name_space[0] != '\0') {
+      full_name = ToWSTRING(row.name_space) + "."_W + full_name;
+    }
+    EXPECT_EQ(WSTRING(name), full_name);
+  }
+}
+
+TEST_F(MetadataReaderTest, FindsTypesAndMethodsByName) {
+  const auto type_def =
+      reader_.FindTypeDefByName("Samples.ExampleLibrary.Class1");
+
+  mdTypeDef expected_type_def = mdTypeDefNil;
+  ASSERT_TRUE(SUCCEEDED(metadata_import_->FindTypeDefByName(
+      L"Samples.ExampleLibrary.Class1", mdTokenNil, &expected_type_def)));
+  EXPECT_EQ(expected_type_def, type_def);
+
+  std::vector<mdMethodDef> expected_methods;
+  for (auto& method_def : EnumMethods(metadata_import_, type_def)) {
+    const auto method = GetFunctionInfo(metadata_import_, method_def);
+    if (method.name == L"Add") {
+      expected_methods.push_back(method_def);
+    }
+  }
+  EXPECT_EQ(expected_methods, reader_.FindMethodsByName(type_def, "Add"));
+
+  // Nested types are not found by their simple name
+  EXPECT_EQ(mdTypeDefNil, reader_.FindTypeDefByName("Cookie"));
+  EXPECT_EQ(mdTypeDefNil, reader_.FindTypeDefByName("Samples.Missing"));
+}
+
+TEST_F(MetadataReaderTest, ReadsAssemblyRefsLikeMetadataImport) {
+  std::vector<WSTRING> expected;
+  for (auto& ref : EnumAssemblyRefs(assembly_import_)) {
+    expected.push_back(GetReferencedAssemblyMetadata(assembly_import_, ref).name);
+  }
+
+  std::vector<WSTRING> actual;
+  AssemblyRefRow row;
+  for (ULONG rid = 1; rid <= reader_.GetRowCount(MetadataTable::AssemblyRef);
+       rid++) {
+    ASSERT_TRUE(reader_.GetAssemblyRef(rid, &row));
+    actual.push_back(ToWSTRING(row.name));
+  }
+  EXPECT_EQ(expected, actual);
+
+  EXPECT_EQ(TokenFromRid(1, mdtAssemblyRef),
+            reader_.FindAssemblyRef(ToString(expected[0])));
+  EXPECT_EQ(mdAssemblyRefNil, reader_.FindAssemblyRef("Missing.Assembly"));
+}
+
+TEST_F(MetadataReaderTest, ReadsModuleVersionIdAndAssemblyLikeMetadataImport) {
+  GUID expected_mvid;
+  ASSERT_TRUE(SUCCEEDED(
+      metadata_import_->GetScopeProps(nullptr, 0, nullptr, &expected_mvid)));
+
+  GUID mvid{};
+  ASSERT_TRUE(reader_.GetModuleVersionId(&mvid));
+  EXPECT_EQ(0, memcmp(&expected_mvid, &mvid, sizeof(GUID)));
+
+  const auto expected = GetAssemblyImportMetadata(assembly_import_);
+  AssemblyRow row;
+  ASSERT_TRUE(reader_.GetAssembly(&row));
+  EXPECT_EQ(expected.name, ToWSTRING(row.name));
+  EXPECT_EQ(expected.version,
+            Version(row.major, row.minor, row.build, row.revision));
+}
@@ -0,0 +1,184 @@
+#include "pch.h"
+
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <mutex>
+#include <thread>
+
+#include "../../src/Datadog.Trace.ClrProfiler.Native/module_analysis_pool.h"
+#include "../Datadog.Trace.ClrProfiler.Native.Harness/mock_profiler_info.h"
+
+using namespace trace;
+
+namespace {
+
+// long enough for a thread that is not blocked to get to its next step
+const auto kNotBlocked = std::chrono::seconds(5);
+// short enough to keep the tests fast when a thread is expected to block
+const auto kBlocked = std::chrono::milliseconds(100);
+
+}  // namespace
+
+TEST(ModuleAnalysisTest, PendingAnalysisIsClaimedOnce) {
+  ModuleAnalysis analysis;
+  EXPECT_TRUE(analysis.IsReady());
+  EXPECT_FALSE(analysis.TryBegin());
+
+  analysis.SetPending();
+  EXPECT_EQ(ModuleAnalysisState::Pending, analysis.GetState());
+  EXPECT_TRUE(analysis.TryBegin());
+  EXPECT_EQ(ModuleAnalysisState::Running, analysis.GetState());
+  EXPECT_FALSE(analysis.TryBegin());
+
+  analysis.End();
+  EXPECT_TRUE(analysis.IsReady());
+  EXPECT_FALSE(analysis.TryBegin());
+}
+
+TEST(ModuleAnalysisTest, WaitBlocksUntilTheRunningAnalysisEnds) {
+  ModuleAnalysis analysis;
+  std::mutex module_map_lock;
+  analysis.SetPending();
+  ASSERT_TRUE(analysis.TryBegin());
+
+  auto waiter = std::async(std::launch::async, [&] {
+    std::unique_lock<std::mutex> guard(module_map_lock);
+    analysis.Wait(guard);
+    return guard.owns_lock() && analysis.IsReady();
+  });
+
+  EXPECT_EQ(std::future_status::timeout, waiter.wait_for(kBlocked));
+  {
+    // the module map lock is released while waiting
+    std::lock_guard<std::mutex> guard(module_map_lock);
+  }
+
+  analysis.End();
+  ASSERT_EQ(std::future_status::ready, waiter.wait_for(kNotBlocked));
+  EXPECT_TRUE(waiter.get());
+}
+
+TEST(ModuleAnalysisTest, WaitDoesntBlockWithoutARunningAnalysis) {
+  ModuleAnalysis analysis;
+  std::mutex module_map_lock;
+  std::unique_lock<std::mutex> guard(module_map_lock);
+
+  analysis.Wait(guard);
+  EXPECT_TRUE(guard.owns_lock());
+
+  analysis.SetPending();
+  analysis.Wait(guard);
+  EXPECT_TRUE(guard.owns_lock());
+  EXPECT_EQ(ModuleAnalysisState::Pending, analysis.GetState());
+}
+
+TEST(ModuleAnalysisTest, CancelDropsThePendingAnalysis) {
+  ModuleAnalysis analysis;
+  analysis.SetPending();
+
+  analysis.Cancel();
+
+  EXPECT_TRUE(analysis.IsReady());
+  EXPECT_FALSE(analysis.TryBegin());
+}
+
+TEST(ModuleAnalysisTest, CancelWaitsForTheRunningAnalysisAndItsWaiters) {
+  ModuleAnalysis analysis;
+  std::mutex module_map_lock;
+  analysis.SetPending();
+  ASSERT_TRUE(analysis.TryBegin());
+
+  std::atomic_bool waiter_done{false};
+  auto waiter = std::async(std::launch::async, [&] {
+    std::unique_lock<std::mutex> guard(module_map_lock);
+    analysis.Wait(guard);
+    waiter_done = true;
+  });
+  // let the waiter block in Wait, which releases the module map lock
+  std::this_thread::sleep_for(kBlocked);
+
+  auto unload = std::async(std::launch::async, [&] {
+    std::lock_guard<std::mutex> guard(module_map_lock);
+    analysis.Cancel();
+    // the waiter takes the module map lock back before it is done
+    return waiter_done.load();
+  });
+
+  EXPECT_EQ(std::future_status::timeout, unload.wait_for(kBlocked));
+
+  analysis.End();
+  ASSERT_EQ(std::future_status::ready, unload.wait_for(kNotBlocked));
+  EXPECT_FALSE(unload.get());
+  ASSERT_EQ(std::future_status::ready, waiter.wait_for(kNotBlocked));
+  EXPECT_TRUE(waiter_done);
+}
+
+TEST(ModuleAnalysisTest, CallbackClaimsTheAnalysisBeforeThePoolWorker) {
+  MockProfilerInfo info;
+  ModuleAnalysis analysis;
+  std::promise<void> inline_analysis_done;
+  std::atomic_int analyzed{0};
+  std::promise<bool> worker_claimed;
+
+  analysis.SetPending();
+  // the callback that needs the module first analyzes it inline
+  ASSERT_TRUE(analysis.TryBegin());
+  analyzed++;
+
+  ModuleAnalysisPool pool(&info, 1, [&](ModuleID module_id) {
+    const bool claimed = analysis.TryBegin();
+    if (claimed) {
+      analyzed++;
+      analysis.End();
+    }
+    worker_claimed.set_value(claimed);
+  });
+  pool.Enqueue(1);
+
+  auto worker_result = worker_claimed.get_future();
+  ASSERT_EQ(std::future_status::ready, worker_result.wait_for(kNotBlocked));
+  EXPECT_FALSE(worker_result.get());
+
+  analysis.End();
+  EXPECT_EQ(1, analyzed.load());
+  EXPECT_TRUE(analysis.IsReady());
+}
+
+TEST(ModuleAnalysisTest, PoolWorkerClaimsThePendingAnalysis) {
+  MockProfilerInfo info;
+  ModuleAnalysis analysis;
+  std::promise<bool> worker_claimed;
+
+  analysis.SetPending();
+  ModuleAnalysisPool pool(&info, 2, [&](ModuleID module_id) {
+    const bool claimed = analysis.TryBegin();
+    if (claimed) {
+      analysis.End();
+    }
+    worker_claimed.set_value(claimed);
+  });
+  pool.Enqueue(1);
+
+  auto worker_result = worker_claimed.get_future();
+  ASSERT_EQ(std::future_status::ready, worker_result.wait_for(kNotBlocked));
+  EXPECT_TRUE(worker_result.get());
+  EXPECT_TRUE(analysis.IsReady());
+  // the callback that comes after the worker doesn't analyze again
+  EXPECT_FALSE(analysis.TryBegin());
+}
+
+TEST(ModuleAnalysisTest, PoolShutdownCanBeCalledBeforeTheDestructor) {
+  MockProfilerInfo info;
+  std::atomic_int analyzed{0};
+
+  auto pool = new ModuleAnalysisPool(&info, 3,
+                                     [&](ModuleID module_id) { analyzed++; });
+  pool->Shutdown();
+  pool->Shutdown();
+  // the modules queued after the shutdown are not analyzed
+  pool->Enqueue(1);
+  delete pool;
+
+  EXPECT_EQ(0, analyzed.load());
+}
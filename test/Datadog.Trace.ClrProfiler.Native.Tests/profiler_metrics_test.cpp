@@ -0,0 +1,74 @@
+#include "pch.h"
+
+#include <vector>
+
+#include "../../src/Datadog.Trace.ClrProfiler.Native/profiler_metrics.h"
+
+using namespace trace;
+
+TEST(ProfilerMetricsTest, BucketsContainTheirValues) {
+  const ULONG64 values[] = {0,    1,     15,      16,          17,
+                            1000, 65535, 1000000, 123456789012, ~ULONG64(0)};
+  for (const auto value : values) {
+    const auto index = LatencyHistogram::GetBucketIndex(value);
+    ASSERT_LT(index, LatencyHistogram::kBucketCount);
+    EXPECT_GE(LatencyHistogram::GetBucketUpperBound(index), value);
+    if (index > 0) {
+      EXPECT_LT(LatencyHistogram::GetBucketUpperBound(index - 1), value);
+    }
+  }
+
+  // the values below 16 have their own bucket
+  EXPECT_EQ(15, LatencyHistogram::GetBucketUpperBound(
+                    LatencyHistogram::GetBucketIndex(15)));
+  EXPECT_EQ(~ULONG64(0), LatencyHistogram::GetBucketUpperBound(
+                             LatencyHistogram::kBucketCount - 1));
+}
+
+TEST(ProfilerMetricsTest, PercentilesAreWithinTheBucketPrecision) {
+  LatencyHistogram histogram;
+  EXPECT_EQ(0, histogram.GetPercentile(99));
+
+  for (ULONG64 i = 1; i <= 1000; i++) {
+    histogram.Record(i * 1000);
+  }
+
+  EXPECT_EQ(1000, histogram.GetCount());
+  EXPECT_EQ(500500000, histogram.GetSum());
+  EXPECT_EQ(1000000, histogram.GetMax());
+
+  const auto p50 = histogram.GetPercentile(50);
+  EXPECT_GE(p50, 500000);
+  EXPECT_LE(p50, 500000 * 1.125);
+  const auto p99 = histogram.GetPercentile(99);
+  EXPECT_GE(p99, 990000);
+  EXPECT_LE(p99, 1000000);
+  EXPECT_EQ(1000000, histogram.GetPercentile(100));
+}
+
+TEST(ProfilerMetricsTest, ExportsCountersThenOperations) {
+  ProfilerMetrics metrics;
+  metrics.Increment(ProfilerCounter::Rewrites);
+  metrics.Increment(ProfilerCounter::ILBytesEmitted, 120);
+  metrics.RecordLatency(TimedOperation::GetReJITParameters, 2000);
+  metrics.RecordLatency(TimedOperation::GetReJITParameters, 4000);
+
+  EXPECT_EQ(kProfilerMetricsExportValues, metrics.Export(nullptr, 0));
+
+  std::vector<INT64> values(kProfilerMetricsExportValues, -1);
+  ASSERT_EQ(kProfilerMetricsExportValues,
+            metrics.Export(values.data(), values.size()));
+
+  EXPECT_EQ(1, values[static_cast<size_t>(ProfilerCounter::Rewrites)]);
+  EXPECT_EQ(0, values[static_cast<size_t>(ProfilerCounter::RejitRequests)]);
+  EXPECT_EQ(120, values[static_cast<size_t>(ProfilerCounter::ILBytesEmitted)]);
+
+  const auto offset =
+      static_cast<size_t>(ProfilerCounter::Count) +
+      static_cast<size_t>(TimedOperation::GetReJITParameters) *
+          kTimedOperationExportValues;
+  EXPECT_EQ(2, values[offset]);
+  EXPECT_EQ(6000, values[offset + 1]);
+  EXPECT_EQ(4000, values[offset + 2]);
+  EXPECT_EQ(0, values[static_cast<size_t>(ProfilerCounter::Count)]);
+}
@@ -0,0 +1,103 @@
+#include "pch.h"
+
+#include <cstdio>
+#include <fstream>
+#include <string>
+
+#include "../../src/Datadog.Trace.ClrProfiler.Native/rewrite_quarantine.h"
+#include "../../src/Datadog.Trace.ClrProfiler.Native/util.h"
+
+using namespace trace;
+
+class RewriteQuarantineTest : public ::testing::Test {
+ protected:
+  const GUID module_version_id_ = {
+      0x01234567, 0x89ab, 0xcdef, {0, 1, 2, 3, 4, 5, 6, 7}};
+  const mdMethodDef method_def_ = 0x06000012;
+  const MethodReplacement replacement_ = MethodReplacement(
+      {}, Method("Samples.ExampleLibrary"_W, "Samples.ExampleLibrary.Class1"_W,
+                 "Add"_W),
+      Method("Datadog.Trace.ClrProfiler.Managed"_W,
+             "Datadog.Trace.ClrProfiler.Integrations.Class1Integration"_W,
+             ""_W));
+  std::string path_;
+
+  static MethodReference Method(const WSTRING& assembly, const WSTRING& type,
+                                const WSTRING& name) {
+    return MethodReference(assembly, type, name, ""_W, Version(0, 0, 0, 0),
+                           Version(USHRT_MAX, USHRT_MAX, USHRT_MAX, USHRT_MAX),
+                           {}, {});
+  }
+
+  void SetUp() override {
+    path_ = ::testing::TempDir() + "dd-rewrite-quarantine-test.txt";
+    std::remove(path_.c_str());
+  }
+
+  void TearDown() override { std::remove(path_.c_str()); }
+
+  void Quarantine(const WSTRING& profiler_version) {
+    RewriteQuarantine quarantine(ToWSTRING(path_), profiler_version);
+    EXPECT_TRUE(quarantine.Add("Samples.ExampleLibrary"_W, module_version_id_,
+                               method_def_, replacement_,
+                               "by-ref argument"_W));
+  }
+};
+
+TEST_F(RewriteQuarantineTest, MethodsAreQuarantinedOnce) {
+  RewriteQuarantine quarantine(""_W, "1.0.0"_W);
+  EXPECT_FALSE(
+      quarantine.IsQuarantined(module_version_id_, method_def_, replacement_));
+
+  EXPECT_TRUE(quarantine.Add("Samples.ExampleLibrary"_W, module_version_id_,
+                             method_def_, replacement_, "by-ref argument"_W));
+  EXPECT_FALSE(quarantine.Add("Samples.ExampleLibrary"_W, module_version_id_,
+                              method_def_, replacement_, "by-ref argument"_W));
+
+  EXPECT_TRUE(
+      quarantine.IsQuarantined(module_version_id_, method_def_, replacement_));
+  EXPECT_FALSE(quarantine.IsQuarantined(module_version_id_, method_def_ + 1,
+                                        replacement_));
+  ASSERT_EQ(1u, quarantine.GetMethods().size());
+  EXPECT_EQ("1.0.0"_W, quarantine.GetMethods()[0].profiler_version);
+}
+
+TEST_F(RewriteQuarantineTest, QuarantineIsReloadedBySameProfilerVersion) {
+  Quarantine("1.0.0"_W);
+
+  RewriteQuarantine quarantine(ToWSTRING(path_), "1.0.0"_W);
+  EXPECT_TRUE(
+      quarantine.IsQuarantined(module_version_id_, method_def_, replacement_));
+  ASSERT_EQ(1u, quarantine.GetMethods().size());
+  const auto method = quarantine.GetMethods()[0];
+  EXPECT_EQ(GuidStr(&module_version_id_), method.module_version_id);
+  EXPECT_EQ(method_def_, method.method_def);
+  EXPECT_EQ("Samples.ExampleLibrary"_W, method.assembly_name);
+  EXPECT_EQ("by-ref argument"_W, method.reason);
+  EXPECT_EQ(0u, quarantine.Export().find("1.0.0\t"_W));
+}
+
+TEST_F(RewriteQuarantineTest, QuarantineOfOtherProfilerVersionsIsIgnored) {
+  Quarantine("1.0.0"_W);
+
+  // the rewrite of the next version may succeed
+  RewriteQuarantine quarantine(ToWSTRING(path_), "1.1.0"_W);
+  EXPECT_FALSE(
+      quarantine.IsQuarantined(module_version_id_, method_def_, replacement_));
+  EXPECT_TRUE(quarantine.GetMethods().empty());
+  EXPECT_TRUE(quarantine.Add("Samples.ExampleLibrary"_W, module_version_id_,
+                             method_def_, replacement_, "by-ref argument"_W));
+}
+
+TEST_F(RewriteQuarantineTest, LinesWithoutProfilerVersionAreIgnored) {
+  RewriteQuarantine unversioned(""_W, "1.0.0"_W);
+  unversioned.Add("Samples.ExampleLibrary"_W, module_version_id_, method_def_,
+                  replacement_, "by-ref argument"_W);
+  // the previous format started with the module version id
+  const auto line = ToString(unversioned.Export());
+  std::ofstream(path_) << line.substr(line.find('\t') + 1);
+
+  RewriteQuarantine quarantine(ToWSTRING(path_), "1.0.0"_W);
+  EXPECT_FALSE(
+      quarantine.IsQuarantined(module_version_id_, method_def_, replacement_));
+}